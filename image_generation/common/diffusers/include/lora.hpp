@@ -1,13 +1,19 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <list>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "openvino/core/model.hpp"
 #include "openvino/op/constant.hpp"
 #include "openvino/pass/graph_rewrite.hpp"
+#include "openvino/runtime/compiled_model.hpp"
+#include "openvino/runtime/infer_request.hpp"
 
 class InsertLoRA : public ov::pass::MatcherPass {
 public:
@@ -23,3 +29,51 @@ private:
 
 std::map<std::string, InsertLoRA::LoRAMap>
 read_lora_adapters(const std::string& filename, const float alpha = 0.75f);
+
+// low-rank weights of a LoRA layer, whose product alpha * up * down is added to weights of the layer:
+// up [out_features, rank] and down [rank, in_features * kernel_size] f32 tensors
+struct LoRAFactors {
+    ov::Tensor up;
+    ov::Tensor down;
+};
+
+using LoRAFactorsMap = std::map<std::string, LoRAFactors>;
+
+// reads LoRA layers of 'type' model ("unet" or "text_encoder") without multiplying their weights
+LoRAFactorsMap read_lora_factors(const std::string& filename, const std::string& type);
+
+// Adds LoRA of layers from 'layer_names' (e.g. the union of layers of adapters of a catalog) as model inputs: output
+// of a layer gets alpha * up(down(x)), where "lora_down.<layer>" and "lora_up.<layer>" inputs have 'max_rank' channels
+// and "lora_alpha" is a scalar input. Unlike InsertLoRA, adapters are switched on compiled model by LoRAAdapterCache
+void insert_lora_inputs(std::shared_ptr<ov::Model> model, const std::set<std::string>& layer_names, size_t max_rank);
+
+// Tensors of LoRA inputs of a compiled model (see insert_lora_inputs) for 'capacity' recently used adapters, so
+// switching to a cached adapter only sets tensors of infer request
+class LoRAAdapterCache {
+public:
+    LoRAAdapterCache(const ov::CompiledModel& compiled_model, const std::string& type, size_t capacity = 8);
+
+    // applies adapter from safetensors 'filename' to 'request'; empty 'filename' is the base model
+    void set_adapter(ov::InferRequest& request, const std::string& filename, float alpha = 0.75f);
+
+    static void set_alpha(ov::InferRequest& request, float alpha);
+
+private:
+    struct LoRAInput {
+        std::string name;
+        std::string layer_name;
+        bool is_down;
+        ov::Shape shape;
+    };
+
+    // tensor of each LoRA input
+    using AdapterTensors = std::vector<ov::Tensor>;
+
+    std::shared_ptr<const AdapterTensors> get(const std::string& filename);
+
+    std::string m_type;
+    size_t m_capacity;
+    std::vector<LoRAInput> m_inputs;
+    // filename => tensors of adapter, the most recently used at first
+    std::list<std::pair<std::string, std::shared_ptr<const AdapterTensors>>> m_adapters;
+};
@@ -0,0 +1,17 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fills 'data' with 'size' samples of N(0, 1) from the stream ('seed', 'subsequence') of the counter-based
+// Philox4x32-10 generator: value i depends only on seed, subsequence and i, so values are computed in parallel and
+// a tensor is reproduced regardless of the number of threads, and e.g. an image is reproduced by its seed
+// regardless of other images in batch; subsequences of the same seed are independent streams, e.g. initial latents
+// and noise of each denoising step
+void randn_philox(float* data, size_t size, uint64_t seed, uint64_t subsequence = 0);
+
+// Replaces 'counter' by 4 random numbers of Philox4x32-10 with key ('key0', 'key1'); exposed for the known-answer test
+void philox4x32(uint32_t counter[4], uint32_t key0, uint32_t key1);
@@ -48,10 +48,13 @@ private:
     float dynamic_thresholding_ratio;
     float sample_max_value;
     bool read_torch_noise;
-    std::mt19937 gen;
-    std::normal_distribution<float> normal;
     uint32_t seed;
 
+    // buffers of step, which are reused by the following steps
+    std::vector<float> m_predicted_original_sample;
+    std::vector<float> m_noise;
+
     std::vector<float> threshold_sample(const std::vector<float>& flat_sample);
-    std::vector<float> randn_function(uint32_t size, uint32_t seed);
+    // fills 'noise' with 'size' samples of N(0, I) of 'inference_step', which depend on 'seed' and the step only
+    void randn_function(std::vector<float>& noise, size_t size, size_t inference_step);
 };
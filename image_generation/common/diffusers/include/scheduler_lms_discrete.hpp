@@ -1,8 +1,6 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
-#include <list>
-
 #include "scheduler.hpp"
 
 class LMSDiscreteScheduler : public Scheduler {
@@ -28,7 +26,12 @@ private:
     std::vector<float> m_log_sigmas;
     std::vector<float> m_sigmas;
     std::vector<int64_t> m_timesteps;
-    std::list<std::vector<float>> m_derivative_list;
+    // linear multistep coefficients of each inference step, where coefficient k is applied to derivative of step - k
+    std::vector<std::vector<float>> m_lms_coeffs;
+    // ring buffer of derivatives of the last LMS_ORDER steps
+    std::vector<ov::Tensor> m_derivatives;
+
+    static constexpr size_t LMS_ORDER = 4;
 
     int64_t _sigma_to_t(float sigma) const;
 };
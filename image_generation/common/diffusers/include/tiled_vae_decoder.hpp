@@ -0,0 +1,39 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <vector>
+
+#include "openvino/runtime/compiled_model.hpp"
+#include "openvino/runtime/infer_request.hpp"
+
+// Decoder of latents of any size by a VAE decoder compiled for a static tile [1, C, tile_h, tile_w] with NHWC output:
+// latents are split to tiles overlapped by 'tile_overlap' latent pixels, which are decoded by 'num_requests'
+// infer requests at once and blended with linear weights in overlapped areas, so the peak activation memory
+// is bounded by the tile size instead of the image size
+class TiledVAEDecoder {
+public:
+    TiledVAEDecoder(ov::CompiledModel vae_decoder, size_t tile_overlap, size_t num_requests = 2);
+
+    // 'latent' [1, C, h, w] with h >= tile_h, w >= tile_w; returns f32 image [1, h * scale, w * scale, channels]
+    ov::Tensor decode(ov::Tensor latent);
+
+private:
+    struct Tile {
+        size_t y;
+        size_t x;
+    };
+
+    // accumulates the decoded tile of 'request' to 'image' and 'weights'
+    void _accumulate(ov::InferRequest& request, const Tile& tile, ov::Tensor& image, std::vector<float>& weights) const;
+
+    ov::Shape m_tile_shape;
+    size_t m_tile_overlap;
+    size_t m_scale_factor;
+    size_t m_channels;
+    // blending weight of a pixel of decoded tile at (y, x) is m_blend_weights_y[y] * m_blend_weights_x[x]
+    std::vector<float> m_blend_weights_y;
+    std::vector<float> m_blend_weights_x;
+    std::vector<ov::InferRequest> m_requests;
+};
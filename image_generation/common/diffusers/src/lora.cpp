@@ -8,13 +8,26 @@
 #include <map>
 #include <string>
 #include <vector>
-#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <Eigen/Dense>
 
+#include "openvino/core/parallel.hpp"
 #include "openvino/op/add.hpp"
+#include "openvino/op/convert.hpp"
 #include "openvino/op/convolution.hpp"
 #include "openvino/op/matmul.hpp"
+#include "openvino/op/multiply.hpp"
+#include "openvino/op/parameter.hpp"
 #include "openvino/pass/pattern/matcher.hpp"
 #include "openvino/pass/pattern/op/wrap_type.hpp"
 
@@ -63,110 +76,346 @@ InsertLoRA::InsertLoRA(LoRAMap& lora_map) :
 
 namespace {
 
-std::vector<std::uint8_t> read_file(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
-    OPENVINO_ASSERT(file.is_open(), "Cannot open file ", filename, " with LoRA weights");
-
-    size_t filesize = file.tellg();
-    std::vector<std::uint8_t> buffer;
-    buffer.reserve(filesize);
+// read-only mapping of a file, so safetensors are parsed and converted in place without reading them to memory first
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        OPENVINO_ASSERT(file != INVALID_HANDLE_VALUE, "Cannot open file ", filename, " with LoRA weights");
+        LARGE_INTEGER file_size;
+        HANDLE mapping = GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 ?
+            CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        OPENVINO_ASSERT(mapping, "Cannot map file ", filename, " with LoRA weights");
+        m_data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        OPENVINO_ASSERT(m_data, "Cannot map file ", filename, " with LoRA weights");
+        m_size = static_cast<size_t>(file_size.QuadPart);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        OPENVINO_ASSERT(fd >= 0, "Cannot open file ", filename, " with LoRA weights");
+        struct stat file_stat;
+        const bool has_size = fstat(fd, &file_stat) == 0 && file_stat.st_size > 0;
+        void* data = has_size ? mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        OPENVINO_ASSERT(data != MAP_FAILED, "Cannot map file ", filename, " with LoRA weights");
+        m_data = data;
+        m_size = static_cast<size_t>(file_stat.st_size);
+        // tensors are read once from the beginning to the end
+        madvise(m_data, m_size, MADV_SEQUENTIAL);
+#endif
+    }
 
-    file.seekg(0, std::ios::beg);
-    std::copy(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), std::back_inserter(buffer));
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
 
-    return buffer;
-}
+    ~MappedFile() {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(m_data, m_size);
+#endif
+    }
 
-std::vector<float> convert_to_float(const safetensors_TensorDescriptor& tensor) {
-    std::vector<float> data;
-    size_t tensor_size = (tensor.end_offset_bytes - tensor.begin_offset_bytes) / sizeof(ov::float16);
+    void* data() const {
+        return m_data;
+    }
 
-    const ov::float16* ptr = static_cast<const ov::float16*>(tensor.ptr);
-    for (size_t i = 0; i < tensor_size; ++i) {
-        data.push_back(ptr[i]);
+    size_t size() const {
+        return m_size;
     }
 
-    return data;
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+using FloatMatrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using FloatMatrixMap = Eigen::Map<FloatMatrix>;
+using HalfMatrixMap = Eigen::Map<const Eigen::Matrix<Eigen::half, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>;
+
+// f16 tensor [rows, ...] is converted to f32 matrix [rows, cols] by Eigen, which uses vector conversion instructions
+// (e.g. F16C) if they are available
+void convert_to_float(const safetensors_TensorDescriptor& tensor, float* dst, size_t rows, size_t cols) {
+    OPENVINO_ASSERT(rows * cols * sizeof(ov::float16) <= tensor.end_offset_bytes - tensor.begin_offset_bytes, "LoRA weights are damaged");
+    FloatMatrixMap(dst, rows, cols) = HalfMatrixMap(static_cast<const Eigen::half*>(tensor.ptr), rows, cols).cast<float>();
 }
 
-} // namespace
+// tensor is viewed as a matrix [shape[0], product of other dimensions], e.g. kernel dimensions of convolution weights
+std::pair<size_t, size_t> get_matrix_shape(const safetensors_TensorDescriptor& tensor) {
+    OPENVINO_ASSERT(tensor.n_dimensions >= 2, "LoRA weights must have at least 2 dimensions");
+    size_t cols = 1;
+    for (int dim_idx = 1; dim_idx < tensor.n_dimensions; ++dim_idx)
+        cols *= tensor.shape[dim_idx];
+    return {static_cast<size_t>(tensor.shape[0]), cols};
+}
 
-std::map<std::string, InsertLoRA::LoRAMap>
-read_lora_adapters(const std::string& filename, const float alpha) {
-    std::vector<std::uint8_t> file_buffer = read_file(filename);
-    void* buffer_ptr = file_buffer.data();
+FloatMatrix convert_to_float(const safetensors_TensorDescriptor& tensor) {
+    const auto [rows, cols] = get_matrix_shape(tensor);
+    FloatMatrix matrix(rows, cols);
+    convert_to_float(tensor, matrix.data(), rows, cols);
+    return matrix;
+}
 
-    safetensors_File safe_tensors_file = {0};
-    OPENVINO_ASSERT(safetensors_file_init(buffer_ptr, file_buffer.size(), &safe_tensors_file) == NULL, "Cannot parse ", filename, " using safetensors");
+ov::Tensor convert_to_tensor(const safetensors_TensorDescriptor& tensor) {
+    const auto [rows, cols] = get_matrix_shape(tensor);
+    ov::Tensor converted(ov::element::f32, {rows, cols});
+    convert_to_float(tensor, converted.data<float>(), rows, cols);
+    return converted;
+}
 
-    using FloatMatrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
-    using FloatMatrixMap = Eigen::Map<FloatMatrix>;
+// LoRA of a layer: 'up' and 'down' matrices, which product is added to weights of the layer
+struct LoRALayer {
+    std::string type;
+    std::string name;
+    safetensors_TensorDescriptor up;
+    safetensors_TensorDescriptor down;
+};
 
-    // modify the layer name
-    std::map<std::string, InsertLoRA::LoRAMap> lora_constants;
+// pairs up and down tensors of layers, while their data stays in the mapped file
+std::vector<LoRALayer> read_lora_layers(const MappedFile& file, const std::string& filename) {
+    safetensors_File safe_tensors_file = {0};
+    OPENVINO_ASSERT(safetensors_file_init(file.data(), file.size(), &safe_tensors_file) == NULL, "Cannot parse ", filename, " using safetensors");
 
     std::set<std::string> visited;
     const std::string LORA_PREFIX_UNET = "lora_unet";
     const std::string LORA_PREFIX_TEXT_ENCODER = "lora_te";
 
-    // loading safetensor
+    std::vector<LoRALayer> layers;
     for (int i = 0; i < safe_tensors_file.num_tensors; i++) {
-        std::map<std::string, std::string> lora_map;
-
         safetensors_TensorDescriptor tensor = safe_tensors_file.tensors[i];
         std::string tensor_name(tensor.name.ptr, tensor.name.ptr + tensor.name.len);
 
-        const bool tensor_visited = std::find(visited.begin(), visited.end(), tensor_name) != visited.end();
+        const bool tensor_visited = visited.count(tensor_name) > 0;
         // alpha tensors are overriden by users' alpha
         bool alpha_tensor = tensor_name.find(".alpha") != std::string::npos;
         if (alpha_tensor || tensor_visited)
             continue;
+        if (i + 1 == safe_tensors_file.num_tensors) {
+            free(safe_tensors_file.tensors);
+            free(safe_tensors_file.metadata);
+            OPENVINO_THROW("LoRA weights of tensor ", tensor_name, " do not have a pair");
+        }
 
         const bool is_text_lora = tensor_name.find("text") != std::string::npos;
         const std::string lora_prefix = is_text_lora ? LORA_PREFIX_TEXT_ENCODER : LORA_PREFIX_UNET;
         std::string layer_infos = tensor_name.substr(tensor_name.find(lora_prefix) + lora_prefix.length() + 1);
         // drop LoRA name suffixes which comes after '.'
-        std::string layer_name_str = layer_infos.substr(0, layer_infos.find("."));
-        // Create C++ lora_map instead of Python lora_dict
-        lora_map["name"] = layer_name_str;
-        lora_map["type"] = is_text_lora ? "text_encoder" : "unet";
-
-        // update value of weights
-        std::vector<safetensors_TensorDescriptor> pair_tensor;
+        LoRALayer layer;
+        layer.name = layer_infos.substr(0, layer_infos.find("."));
+        layer.type = is_text_lora ? "text_encoder" : "unet";
 
         // up at first, down at second
         if (tensor_name.find("lora_down") != std::string::npos) {
-            pair_tensor.push_back(safe_tensors_file.tensors[i + 1]);
-            pair_tensor.push_back(safe_tensors_file.tensors[i]);
+            layer.up = safe_tensors_file.tensors[i + 1];
+            layer.down = safe_tensors_file.tensors[i];
         } else {
-            pair_tensor.push_back(safe_tensors_file.tensors[i]);
-            pair_tensor.push_back(safe_tensors_file.tensors[i + 1]);
+            layer.up = safe_tensors_file.tensors[i];
+            layer.down = safe_tensors_file.tensors[i + 1];
         }
 
-        for (auto p_t : pair_tensor) {
+        for (const safetensors_TensorDescriptor& p_t : {layer.up, layer.down}) {
             safetensors_Str key_st = p_t.name;
             std::string k_s(key_st.ptr, key_st.ptr + key_st.len);
             visited.insert(k_s);
         }
+        layers.push_back(std::move(layer));
+    }
 
-        ov::Shape shape_vec_0(pair_tensor[0].shape, pair_tensor[0].shape + pair_tensor[0].n_dimensions);
-        ov::Shape shape_vec_1(pair_tensor[1].shape, pair_tensor[1].shape + pair_tensor[1].n_dimensions);
+    // descriptors of tensors are copied to layers
+    free(safe_tensors_file.tensors);
+    free(safe_tensors_file.metadata);
+    return layers;
+}
 
-        // matmul with floats
-        std::vector<float> float_data_0 = convert_to_float(pair_tensor[0]);
-        std::vector<float> float_data_1 = convert_to_float(pair_tensor[1]);
+const std::string LORA_DOWN_PREFIX = "lora_down.";
+const std::string LORA_UP_PREFIX = "lora_up.";
+const std::string LORA_ALPHA_NAME = "lora_alpha";
 
-        // RowMajor
-        FloatMatrixMap mat2d_f_0(float_data_0.data(), shape_vec_0[0], shape_vec_0[1]);
-        FloatMatrixMap mat2d_f_1(float_data_1.data(), shape_vec_1[0], shape_vec_1[1]);
-        FloatMatrix matmul_f = alpha * mat2d_f_0 * mat2d_f_1;
+std::shared_ptr<ov::op::v0::Parameter> create_lora_input(const std::string& name, const ov::Shape& shape) {
+    auto input = std::make_shared<ov::op::v0::Parameter>(ov::element::f32, shape);
+    input->set_friendly_name(name);
+    input->get_output_tensor(0).set_names({name});
+    return input;
+}
 
-        lora_constants[is_text_lora ? "text_encoder" : "unet"][layer_name_str] =
-            ov::op::v0::Constant::create(ov::element::f32, {static_cast<size_t>(matmul_f.rows() * matmul_f.cols())}, matmul_f.data());
-    }
+} // namespace
 
-    free(safe_tensors_file.tensors);
-    free(safe_tensors_file.metadata);
+std::map<std::string, InsertLoRA::LoRAMap>
+read_lora_adapters(const std::string& filename, const float alpha) {
+    MappedFile file(filename);
+    std::vector<LoRALayer> layers = read_lora_layers(file, filename);
+
+    // alpha * up * down of each layer
+    std::vector<std::shared_ptr<ov::op::v0::Constant>> weights(layers.size());
+    ov::parallel_for(layers.size(), [&] (size_t layer_idx) {
+        FloatMatrix up = convert_to_float(layers[layer_idx].up), down = convert_to_float(layers[layer_idx].down);
+        OPENVINO_ASSERT(up.cols() == down.rows(), "Ranks of LoRA weights of layer ", layers[layer_idx].name, " do not match");
+        // product is written directly to memory of the constant
+        ov::Tensor product(ov::element::f32, {static_cast<size_t>(up.rows() * down.cols())});
+        FloatMatrixMap(product.data<float>(), up.rows(), down.cols()).noalias() = alpha * up * down;
+        weights[layer_idx] = std::make_shared<ov::op::v0::Constant>(product);
+    });
 
+    // modify the layer name
+    std::map<std::string, InsertLoRA::LoRAMap> lora_constants;
+    for (size_t layer_idx = 0; layer_idx < layers.size(); ++layer_idx)
+        lora_constants[layers[layer_idx].type][layers[layer_idx].name] = weights[layer_idx];
     return lora_constants;
 }
+
+LoRAFactorsMap read_lora_factors(const std::string& filename, const std::string& type) {
+    MappedFile file(filename);
+    std::vector<LoRALayer> layers = read_lora_layers(file, filename);
+    layers.erase(std::remove_if(layers.begin(), layers.end(), [&type] (const LoRALayer& layer) {
+        return layer.type != type;
+    }), layers.end());
+
+    std::vector<LoRAFactors> factors(layers.size());
+    ov::parallel_for(layers.size(), [&] (size_t layer_idx) {
+        factors[layer_idx].up = convert_to_tensor(layers[layer_idx].up);
+        factors[layer_idx].down = convert_to_tensor(layers[layer_idx].down);
+        OPENVINO_ASSERT(factors[layer_idx].up.get_shape()[1] == factors[layer_idx].down.get_shape()[0],
+                        "Ranks of LoRA weights of layer ", layers[layer_idx].name, " do not match");
+    });
+
+    LoRAFactorsMap lora_factors;
+    for (size_t layer_idx = 0; layer_idx < layers.size(); ++layer_idx)
+        lora_factors[layers[layer_idx].name] = std::move(factors[layer_idx]);
+    return lora_factors;
+}
+
+void insert_lora_inputs(std::shared_ptr<ov::Model> model, const std::set<std::string>& layer_names, size_t max_rank) {
+    OPENVINO_ASSERT(max_rank > 0, "Max rank of LoRA adapters must be positive");
+    std::set<std::string> remaining_layer_names = layer_names;
+    auto alpha = create_lora_input(LORA_ALPHA_NAME, {1});
+    ov::ParameterVector lora_inputs;
+
+    for (const std::shared_ptr<ov::Node>& root : model->get_ordered_ops()) {
+        auto matmul = std::dynamic_pointer_cast<ov::op::v0::MatMul>(root);
+        auto convolution = std::dynamic_pointer_cast<ov::op::v1::Convolution>(root);
+        if ((!matmul && !convolution) || remaining_layer_names.empty())
+            continue;
+        std::string root_name = root->get_friendly_name();
+        std::replace(root_name.begin(), root_name.end(), '.', '_');
+        // as InsertLoRA, a layer of adapter is applied to the first operation, which name contains the layer name
+        auto layer_name_it = std::find_if(remaining_layer_names.begin(), remaining_layer_names.end(), [&root_name] (const std::string& layer_name) {
+            return root_name.find(layer_name) != std::string::npos;
+        });
+        if (layer_name_it == remaining_layer_names.end())
+            continue;
+
+        const ov::PartialShape& weights_shape = root->get_input_partial_shape(1);
+        OPENVINO_ASSERT(weights_shape.is_static(), "Weights of layer ", root->get_friendly_name(), " with LoRA must be static");
+        const ov::Shape shape = weights_shape.to_shape();
+        std::shared_ptr<ov::op::v0::Parameter> down, up;
+        ov::Output<ov::Node> lora_output;
+        if (matmul) {
+            // y = x * W^T + alpha * (x * down^T) * up^T, where W is [out_features, in_features] or transposed
+            OPENVINO_ASSERT(shape.size() == 2 && !matmul->get_transpose_a(), "Layer ", root->get_friendly_name(), " is not supported by LoRA");
+            const size_t in_features = matmul->get_transpose_b() ? shape[1] : shape[0],
+                         out_features = matmul->get_transpose_b() ? shape[0] : shape[1];
+            down = create_lora_input(LORA_DOWN_PREFIX + *layer_name_it, {max_rank, in_features});
+            up = create_lora_input(LORA_UP_PREFIX + *layer_name_it, {out_features, max_rank});
+            auto down_output = std::make_shared<ov::op::v0::MatMul>(root->input_value(0), down, false, true);
+            lora_output = std::make_shared<ov::op::v0::MatMul>(down_output, up, false, true);
+        } else {
+            // down is a convolution with the kernel of layer, while up is 1x1 convolution
+            OPENVINO_ASSERT(shape.size() == 4, "Layer ", root->get_friendly_name(), " is not supported by LoRA");
+            down = create_lora_input(LORA_DOWN_PREFIX + *layer_name_it, {max_rank, shape[1], shape[2], shape[3]});
+            up = create_lora_input(LORA_UP_PREFIX + *layer_name_it, {shape[0], max_rank, 1, 1});
+            auto down_output = std::make_shared<ov::op::v1::Convolution>(root->input_value(0), down, convolution->get_strides(),
+                convolution->get_pads_begin(), convolution->get_pads_end(), convolution->get_dilations(), convolution->get_auto_pad());
+            lora_output = std::make_shared<ov::op::v1::Convolution>(down_output, up, ov::Strides{1, 1},
+                ov::CoordinateDiff{0, 0}, ov::CoordinateDiff{0, 0}, ov::Strides{1, 1});
+        }
+        lora_output = std::make_shared<ov::op::v1::Multiply>(lora_output, alpha);
+        if (root->get_output_element_type(0) != ov::element::f32)
+            lora_output = std::make_shared<ov::op::v0::Convert>(lora_output, root->get_output_element_type(0));
+
+        std::set<ov::Input<ov::Node>> consumers = root->output(0).get_target_inputs();
+        auto lora_add = std::make_shared<ov::op::v1::Add>(root->output(0), lora_output);
+        for (auto consumer : consumers)
+            consumer.replace_source_output(lora_add->output(0));
+        lora_inputs.push_back(down);
+        lora_inputs.push_back(up);
+        remaining_layer_names.erase(layer_name_it);
+    }
+
+    OPENVINO_ASSERT(!lora_inputs.empty(), "Model does not have layers of LoRA adapters");
+    OPENVINO_ASSERT(remaining_layer_names.empty(), "Model does not have LoRA layer ", *remaining_layer_names.begin());
+    lora_inputs.push_back(alpha);
+    model->add_parameters(lora_inputs);
+    model->validate_nodes_and_infer_types();
+}
+
+LoRAAdapterCache::LoRAAdapterCache(const ov::CompiledModel& compiled_model, const std::string& type, size_t capacity) :
+    m_type(type),
+    m_capacity(capacity) {
+    OPENVINO_ASSERT(m_capacity > 0, "Capacity of LoRA adapter cache must be positive");
+    for (const ov::Output<const ov::Node>& input : compiled_model.inputs()) {
+        const std::string& name = input.get_any_name();
+        const bool is_down = name.rfind(LORA_DOWN_PREFIX, 0) == 0, is_up = name.rfind(LORA_UP_PREFIX, 0) == 0;
+        if (is_down || is_up)
+            m_inputs.push_back({name, name.substr((is_down ? LORA_DOWN_PREFIX : LORA_UP_PREFIX).size()), is_down, input.get_shape()});
+    }
+    OPENVINO_ASSERT(!m_inputs.empty(), "Model is compiled without LoRA inputs, see insert_lora_inputs");
+}
+
+std::shared_ptr<const LoRAAdapterCache::AdapterTensors> LoRAAdapterCache::get(const std::string& filename) {
+    auto adapter_it = std::find_if(m_adapters.begin(), m_adapters.end(), [&filename] (const auto& adapter) {
+        return adapter.first == filename;
+    });
+    if (adapter_it != m_adapters.end()) {
+        m_adapters.splice(m_adapters.begin(), m_adapters, adapter_it);
+        return m_adapters.front().second;
+    }
+
+    // factors of adapter are padded by zeros to max rank of inputs, while inputs of layers without LoRA are zeros
+    LoRAFactorsMap factors = filename.empty() ? LoRAFactorsMap{} : read_lora_factors(filename, m_type);
+    for (const auto& layer : factors) {
+        const bool has_input = std::any_of(m_inputs.begin(), m_inputs.end(), [&layer] (const LoRAInput& input) {
+            return input.layer_name == layer.first;
+        });
+        OPENVINO_ASSERT(has_input, "LoRA layer ", layer.first, " of ", filename, " does not have inputs in the model, see insert_lora_inputs");
+    }
+    auto tensors = std::make_shared<AdapterTensors>(m_inputs.size());
+    ov::parallel_for(m_inputs.size(), [&] (size_t input_idx) {
+        const LoRAInput& input = m_inputs[input_idx];
+        ov::Tensor& tensor = (*tensors)[input_idx] = ov::Tensor(ov::element::f32, input.shape);
+        std::fill_n(tensor.data<float>(), tensor.get_size(), 0.0f);
+        auto layer_it = factors.find(input.layer_name);
+        if (layer_it == factors.end())
+            return;
+        const ov::Tensor& factor = input.is_down ? layer_it->second.down : layer_it->second.up;
+        const size_t rows = factor.get_shape()[0], cols = factor.get_shape()[1],
+                     max_rows = input.shape[0], max_cols = tensor.get_size() / max_rows;
+        const size_t rank = input.is_down ? rows : cols;
+        OPENVINO_ASSERT(rank <= (input.is_down ? max_rows : max_cols), "Rank ", rank, " of LoRA layer ", input.layer_name,
+                        " is greater than the max rank of the model");
+        OPENVINO_ASSERT(input.is_down ? cols == max_cols : rows == max_rows, "Shape of LoRA layer ", input.layer_name,
+                        " does not match the model");
+        for (size_t row = 0; row < rows; ++row)
+            std::copy_n(factor.data<const float>() + row * cols, cols, tensor.data<float>() + row * max_cols);
+    });
+
+    m_adapters.emplace_front(filename, std::move(tensors));
+    if (m_adapters.size() > m_capacity)
+        m_adapters.pop_back();
+    return m_adapters.front().second;
+}
+
+void LoRAAdapterCache::set_adapter(ov::InferRequest& request, const std::string& filename, float alpha) {
+    std::shared_ptr<const AdapterTensors> tensors = get(filename);
+    // tensors are shared with infer request, so switching of adapters does not copy weights
+    for (size_t input_idx = 0; input_idx < m_inputs.size(); ++input_idx)
+        request.set_tensor(m_inputs[input_idx].name, (*tensors)[input_idx]);
+    set_alpha(request, alpha);
+}
+
+void LoRAAdapterCache::set_alpha(ov::InferRequest& request, float alpha) {
+    ov::Tensor alpha_tensor(ov::element::f32, {1});
+    alpha_tensor.data<float>()[0] = alpha;
+    request.set_tensor(LORA_ALPHA_NAME, alpha_tensor);
+}
@@ -0,0 +1,69 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "philox_generator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "openvino/core/parallel.hpp"
+
+namespace {
+
+constexpr uint32_t PHILOX_M0 = 0xD2511F53, PHILOX_M1 = 0xCD9E8D57;
+constexpr uint32_t PHILOX_W0 = 0x9E3779B9, PHILOX_W1 = 0xBB67AE85;
+constexpr size_t PHILOX_ROUNDS = 10;
+// Philox outputs are distributed between threads by blocks of 'BLOCK_SIZE', so a task amortizes its scheduling
+constexpr size_t BLOCK_SIZE = 256;
+
+}  // namespace
+
+void philox4x32(uint32_t counter[4], uint32_t key0, uint32_t key1) {
+    for (size_t round = 0; round < PHILOX_ROUNDS; ++round) {
+        const uint64_t product0 = static_cast<uint64_t>(PHILOX_M0) * counter[0];
+        const uint64_t product1 = static_cast<uint64_t>(PHILOX_M1) * counter[2];
+        const uint32_t hi0 = static_cast<uint32_t>(product0 >> 32), lo0 = static_cast<uint32_t>(product0);
+        const uint32_t hi1 = static_cast<uint32_t>(product1 >> 32), lo1 = static_cast<uint32_t>(product1);
+        counter[0] = hi1 ^ counter[1] ^ key0;
+        counter[1] = lo1;
+        counter[2] = hi0 ^ counter[3] ^ key1;
+        counter[3] = lo0;
+        key0 += PHILOX_W0;
+        key1 += PHILOX_W1;
+    }
+}
+
+namespace {
+
+// uniform value in (0, 1]
+inline float to_uniform(uint32_t value) {
+    return (static_cast<float>(value) + 1.0f) * (1.0f / 4294967296.0f);
+}
+
+}  // namespace
+
+void randn_philox(float* data, size_t size, uint64_t seed, uint64_t subsequence) {
+    // each Philox output of counter i gives 4 normal values 4 * i, ..., 4 * i + 3 by Box-Muller transform
+    const size_t num_outputs = (size + 3) / 4;
+    const size_t num_blocks = (num_outputs + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const uint32_t key0 = static_cast<uint32_t>(seed), key1 = static_cast<uint32_t>(seed >> 32);
+    const float two_pi = 6.2831853071795864769f;
+
+    ov::parallel_for(num_blocks, [&] (size_t block_idx) {
+        const size_t begin = block_idx * BLOCK_SIZE, end = std::min(begin + BLOCK_SIZE, num_outputs);
+        float values[BLOCK_SIZE * 4];
+        for (size_t output_idx = begin; output_idx < end; ++output_idx) {
+            uint32_t counter[4] = {static_cast<uint32_t>(output_idx), static_cast<uint32_t>(static_cast<uint64_t>(output_idx) >> 32),
+                                   static_cast<uint32_t>(subsequence), static_cast<uint32_t>(subsequence >> 32)};
+            philox4x32(counter, key0, key1);
+            float* value = values + (output_idx - begin) * 4;
+            for (size_t pair_idx = 0; pair_idx < 2; ++pair_idx) {
+                const float radius = std::sqrt(-2.0f * std::log(to_uniform(counter[2 * pair_idx])));
+                const float angle = two_pi * to_uniform(counter[2 * pair_idx + 1]);
+                value[2 * pair_idx] = radius * std::cos(angle);
+                value[2 * pair_idx + 1] = radius * std::sin(angle);
+            }
+        }
+        std::copy_n(values, std::min(end * 4, size) - begin * 4, data + begin * 4);
+    });
+}
@@ -2,12 +2,21 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <cassert>
-#include <random>
 #include <fstream>
 #include <iterator>
 
+#include <Eigen/Core>
+
+#include "philox_generator.hpp"
 #include "scheduler_lcm.hpp"
 
+namespace {
+
+using FloatArrayMap = Eigen::Map<Eigen::ArrayXf>;
+using ConstFloatArrayMap = Eigen::Map<const Eigen::ArrayXf>;
+
+}  // namespace
+
 // https://gist.github.com/lorenzoriano/5414671
 template <typename T, typename U>
 std::vector<T> linspace(U start, U end, size_t num, bool endpoint = false) {
@@ -63,9 +72,7 @@ LCMScheduler::LCMScheduler(size_t num_train_timesteps,
                            dynamic_thresholding_ratio(dynamic_thresholding_ratio),
                            sample_max_value(sample_max_value),
                            read_torch_noise(read_torch_noise),
-                           seed(seed),
-                           gen(seed),
-                           normal(0.0f, 1.0f) {
+                           seed(seed) {
 
     sigma_data = 0.5f; // Default: 0.5
 
@@ -134,10 +141,10 @@ void LCMScheduler::set_timesteps(size_t num_inference_steps) {
 }
 
 std::map<std::string, ov::Tensor> LCMScheduler::step(ov::Tensor noise_pred, ov::Tensor latents, size_t inference_step) {
-    ov::Tensor timestep(ov::element::i64, {1}, &m_timesteps[inference_step]);
-
-    float* noise_pred_data = noise_pred.data<float>();
-    float* latents_data = latents.data<float>();
+    OPENVINO_ASSERT(prediction_type_config == PredictionType::EPSILON, "LCMScheduler supports only EPSILON prediction type");
+    const size_t size = latents.get_size();
+    const ConstFloatArrayMap noise_pred_data(noise_pred.data<const float>(), size);
+    const ConstFloatArrayMap latents_data(latents.data<const float>(), size);
 
     // 1. get previous step value
     int64_t prev_step_index = inference_step + 1;
@@ -159,51 +166,43 @@ std::map<std::string, ov::Tensor> LCMScheduler::step(ov::Tensor noise_pred, ov::
     float c_out = scaled_timestep / std::sqrt((std::pow(scaled_timestep, 2) + std::pow(sigma_data, 2)));
 
     // 4. Compute the predicted original sample x_0 based on the model parameterization
-    std::vector<float> predicted_original_sample(latents.get_size());
     // "epsilon" by default
-    if (prediction_type_config == PredictionType::EPSILON) {
-        for (std::size_t i = 0; i < latents.get_size(); ++i) {
-            predicted_original_sample[i] = (latents_data[i] - beta_prod_t_sqrt * noise_pred_data[i]) / alpha_prod_t_sqrt;
-        }
-    }
+    m_predicted_original_sample.resize(size);
+    FloatArrayMap predicted_original_sample(m_predicted_original_sample.data(), size);
+    predicted_original_sample = (latents_data - beta_prod_t_sqrt * noise_pred_data) / alpha_prod_t_sqrt;
 
     // 5. Clip or threshold "predicted x_0"
     if (thresholding) {
-        predicted_original_sample = threshold_sample(predicted_original_sample);
+        const std::vector<float> thresholded_sample = threshold_sample(m_predicted_original_sample);
+        std::copy_n(thresholded_sample.begin(), size, m_predicted_original_sample.begin());
     } else if (clip_sample) {
-        for (float& value : predicted_original_sample) {
-            value = std::clamp(value, - clip_sample_range, clip_sample_range);
-        }
+        predicted_original_sample = predicted_original_sample.max(-clip_sample_range).min(clip_sample_range);
     }
 
     // 6. Denoise model output using boundary conditions
+    // output tensors are not reused, since a caller may keep them, e.g. to decode 'denoised' while the next image is denoised
     ov::Tensor denoised(latents.get_element_type(), latents.get_shape());
-    float* denoised_data = denoised.data<float>();
-    for (std::size_t i = 0; i < denoised.get_size(); ++i) {
-        denoised_data[i] = c_out * predicted_original_sample[i] + c_skip * latents_data[i];
-    }
+    FloatArrayMap denoised_data(denoised.data<float>(), size);
+    denoised_data = c_out * predicted_original_sample + c_skip * latents_data;
 
     /// 7. Sample and inject noise z ~ N(0, I) for MultiStep Inference
     // Noise is not used on the final timestep of the timestep schedule.
     // This also means that noise is not used for one-step sampling.
     ov::Tensor prev_sample(latents.get_element_type(), latents.get_shape());
-    float* prev_sample_data = prev_sample.data<float>();
+    FloatArrayMap prev_sample_data(prev_sample.data<float>(), size);
 
     if (inference_step != num_inference_steps - 1) {
-        std::vector<float> noise;
         if (read_torch_noise) {
             std::string noise_file = "./latents/torch_noise_step_" + std::to_string(inference_step) + ".txt";
-            noise = read_vector_from_txt(noise_file);
+            m_noise = read_vector_from_txt(noise_file);
+            OPENVINO_ASSERT(m_noise.size() >= size, "File ", noise_file, " has less than ", size, " values");
         } else {
-            noise = randn_function(noise_pred.get_size(), seed);
-        }        
-
-        for (std::size_t i = 0; i < noise_pred.get_size(); ++i) {
-            prev_sample_data[i] = alpha_prod_t_prev_sqrt * denoised_data[i] + beta_prod_t_prev_sqrt * noise[i];
+            randn_function(m_noise, size, inference_step);
         }
 
+        prev_sample_data = alpha_prod_t_prev_sqrt * denoised_data + beta_prod_t_prev_sqrt * ConstFloatArrayMap(m_noise.data(), size);
     } else {
-        std::copy_n(denoised_data, denoised.get_size(), prev_sample_data);
+        prev_sample_data = denoised_data;
     }
 
     std::map<std::string, ov::Tensor> result{{"latent", prev_sample}, {"denoised", denoised}};
@@ -233,7 +232,7 @@ std::vector<float> LCMScheduler::threshold_sample(const std::vector<float>& flat
     https://arxiv.org/abs/2205.11487
     */
 
-    std::vector<float> thresholded_sample;
+    std::vector<float> thresholded_sample = flat_sample;
     // Calculate abs
     std::vector<float> abs_sample(flat_sample.size());
     std::transform(flat_sample.begin(), flat_sample.end(), abs_sample.begin(), [](float val) { return std::abs(val); });
@@ -253,12 +252,8 @@ std::vector<float> LCMScheduler::threshold_sample(const std::vector<float>& flat
     return thresholded_sample;
 }
 
-std::vector<float> LCMScheduler::randn_function(uint32_t size, uint32_t seed = 42) {
-    std::vector<float> noise(size);
-    {
-        std::for_each(noise.begin(), noise.end(), [&](float& x) {
-            x = normal(gen);
-        });
-    }
-    return noise;
+void LCMScheduler::randn_function(std::vector<float>& noise, size_t size, size_t inference_step) {
+    noise.resize(size);
+    // subsequence 0 of the seed is used by initial latents
+    randn_philox(noise.data(), size, seed, inference_step + 1);
 }
@@ -5,8 +5,13 @@
 
 #include <cmath>
 
+#include <Eigen/Core>
+
 namespace {
 
+using FloatArrayMap = Eigen::Map<Eigen::ArrayXf>;
+using ConstFloatArrayMap = Eigen::Map<const Eigen::ArrayXf>;
+
 // https://gist.github.com/lorenzoriano/5414671
 template <typename T>
 std::vector<T> linspace(T a, T b, size_t N) {
@@ -129,14 +134,15 @@ float LMSDiscreteScheduler::get_init_noise_sigma() const {
 }
 
 void LMSDiscreteScheduler::scale_model_input(ov::Tensor sample, size_t inference_step) {
-    const double scale = 1.0 / std::sqrt((m_sigmas[inference_step] * m_sigmas[inference_step] + 1));
-    float* sample_data = sample.data<float>();
-    for (size_t i = 0; i < sample.get_size(); i++) {
-        sample_data[i] *= scale;
-    }
+    const float scale = 1.0 / std::sqrt((m_sigmas[inference_step] * m_sigmas[inference_step] + 1));
+    FloatArrayMap(sample.data<float>(), sample.get_size()) *= scale;
 }
 
 void LMSDiscreteScheduler::set_timesteps(size_t num_inference_steps) {
+    m_sigmas.clear();
+    m_timesteps.clear();
+    m_lms_coeffs.clear();
+
     float delta = -999.0f / (num_inference_steps - 1);
     // transform interpolation to time range
     for (size_t i = 0; i < num_inference_steps; i++) {
@@ -154,6 +160,19 @@ void LMSDiscreteScheduler::set_timesteps(size_t num_inference_steps) {
         int64_t timestep = _sigma_to_t(m_sigmas[i]);
         m_timesteps.push_back(timestep);
     }
+
+    // linear multistep coefficients depend on sigmas only, so they are computed once instead of every step
+    for (size_t inference_step = 0; inference_step < num_inference_steps; ++inference_step) {
+        const size_t order = std::min(inference_step + 1, LMS_ORDER);
+        std::vector<float> lms_coeffs(order);
+        for (size_t curr_order = 0; curr_order < order; curr_order++) {
+            auto lms_derivative_functor = [order, curr_order, &sigmas = m_sigmas, inference_step] (float tau) {
+                return lms_derivative_function(tau, order, curr_order, sigmas, inference_step);
+            };
+            lms_coeffs[curr_order] = trapezoidal(lms_derivative_functor, static_cast<double>(m_sigmas[inference_step]), static_cast<double>(m_sigmas[inference_step + 1]), 1e-4);
+        }
+        m_lms_coeffs.push_back(std::move(lms_coeffs));
+    }
 }
 
 std::vector<int64_t> LMSDiscreteScheduler::get_timesteps() const {
@@ -161,47 +180,35 @@ std::vector<int64_t> LMSDiscreteScheduler::get_timesteps() const {
 }
 
 std::map<std::string, ov::Tensor> LMSDiscreteScheduler::step(ov::Tensor noise_pred, ov::Tensor latents, size_t inference_step) {
-    // LMS step function:
-    std::vector<float> derivative;
-    derivative.reserve(latents.get_size());
-
-    for (size_t j = 0; j < latents.get_size(); j++) {
-        // 1. compute predicted original sample (x_0) from sigma-scaled predicted noise default "epsilon"
-        float pred_latent = latents.data<float>()[j] - m_sigmas[inference_step] * noise_pred.data<float>()[j];
-        // 2. Convert to an ODE derivative
-        derivative.push_back((latents.data<float>()[j] - pred_latent) / m_sigmas[inference_step]);
+    OPENVINO_ASSERT(inference_step < m_lms_coeffs.size(), "'set_timesteps' must be called before 'step'");
+    const size_t size = latents.get_size();
+    const ConstFloatArrayMap latents_data(latents.data<const float>(), size);
+    const ConstFloatArrayMap noise_pred_data(noise_pred.data<const float>(), size);
+
+    // derivatives of the last LMS_ORDER steps are kept in a ring buffer, where derivative of step i is at i % LMS_ORDER
+    if (m_derivatives.empty() || m_derivatives[0].get_shape() != latents.get_shape()) {
+        m_derivatives.clear();
+        for (size_t i = 0; i < LMS_ORDER; ++i)
+            m_derivatives.emplace_back(ov::element::f32, latents.get_shape());
     }
 
-    m_derivative_list.push_back(derivative);
-    // keep the list size within 4
-    size_t order = 4;
-    if (order < m_derivative_list.size()) {
-        m_derivative_list.pop_front();
-    }
+    // 1. compute predicted original sample (x_0) from sigma-scaled predicted noise default "epsilon"
+    // 2. Convert to an ODE derivative
+    const float sigma = m_sigmas[inference_step];
+    FloatArrayMap(m_derivatives[inference_step % LMS_ORDER].data<float>(), size) =
+        (latents_data - (latents_data - sigma * noise_pred_data)) / sigma;
 
-    // 3. Compute linear multistep coefficients
-    order = std::min(inference_step + 1, order);
-
-    std::vector<float> lms_coeffs(order);
-    for (size_t curr_order = 0; curr_order < order; curr_order++) {
-        auto lms_derivative_functor = [order, curr_order, sigmas = this->m_sigmas, inference_step] (float tau) {
-            return lms_derivative_function(tau, order, curr_order, sigmas, inference_step);
-        };
-        lms_coeffs[curr_order] = trapezoidal(lms_derivative_functor, static_cast<double>(m_sigmas[inference_step]), static_cast<double>(m_sigmas[inference_step + 1]), 1e-4);
-    }
+    // 3. Linear multistep coefficients are precomputed by set_timesteps
+    const std::vector<float>& lms_coeffs = m_lms_coeffs[inference_step];
 
     // 4. Compute previous sample based on the derivatives path
     // prev_sample = sample + sum(coeff * derivative for coeff, derivative in zip(lms_coeffs, reversed(self.derivatives)))
     ov::Tensor prev_sample(latents.get_element_type(), latents.get_shape());
-    float* prev_sample_data = prev_sample.data<float>();
-    const float* latents_data = latents.data<const float>();
-    for (size_t i = 0; i < prev_sample.get_size(); ++i) {
-        float derivative_sum = 0.0f;
-        auto derivative_it = m_derivative_list.begin();
-        for (size_t curr_order = 0; curr_order < order; derivative_it++, curr_order++) {
-            derivative_sum += (*derivative_it)[i] * lms_coeffs[order - curr_order - 1];
-        }
-        prev_sample_data[i] = latents_data[i] + derivative_sum;
+    FloatArrayMap prev_sample_data(prev_sample.data<float>(), size);
+    prev_sample_data = latents_data;
+    for (size_t curr_order = 0; curr_order < lms_coeffs.size(); ++curr_order) {
+        const ov::Tensor& derivative = m_derivatives[(inference_step - curr_order) % LMS_ORDER];
+        prev_sample_data += lms_coeffs[curr_order] * ConstFloatArrayMap(derivative.data<const float>(), size);
     }
 
     std::map<std::string, ov::Tensor> result{{"latent", prev_sample}};
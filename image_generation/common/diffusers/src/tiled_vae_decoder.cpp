@@ -0,0 +1,114 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "tiled_vae_decoder.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// offsets of tiles of 'tile_size' with at least 'overlap' common pixels, which cover 'size' pixels
+std::vector<size_t> get_tile_offsets(size_t size, size_t tile_size, size_t overlap) {
+    OPENVINO_ASSERT(size >= tile_size, "Latent of size ", size, " is smaller than VAE tile of size ", tile_size);
+    const size_t stride = tile_size - overlap;
+    std::vector<size_t> offsets;
+    for (size_t offset = 0; offset + tile_size < size; offset += stride)
+        offsets.push_back(offset);
+    // the last tile is aligned to the end
+    offsets.push_back(size - tile_size);
+    return offsets;
+}
+
+// weights, which linearly grow from edges of tile to 1 over 'overlap' pixels
+std::vector<float> get_blend_weights(size_t tile_size, size_t overlap) {
+    std::vector<float> weights(tile_size);
+    for (size_t i = 0; i < tile_size; ++i)
+        weights[i] = std::min(1.0f, static_cast<float>(std::min(i, tile_size - 1 - i) + 1) / (overlap + 1));
+    return weights;
+}
+
+}  // namespace
+
+TiledVAEDecoder::TiledVAEDecoder(ov::CompiledModel vae_decoder, size_t tile_overlap, size_t num_requests) :
+    m_tile_overlap(tile_overlap) {
+    OPENVINO_ASSERT(vae_decoder.input().get_partial_shape().is_static() && vae_decoder.output().get_partial_shape().is_static(),
+                    "VAE decoder must be compiled for a static tile shape");
+    OPENVINO_ASSERT(num_requests > 0, "At least one infer request is required");
+    m_tile_shape = vae_decoder.input().get_shape();
+    const ov::Shape output_shape = vae_decoder.output().get_shape();
+    OPENVINO_ASSERT(m_tile_shape.size() == 4 && m_tile_shape[0] == 1 && output_shape.size() == 4,
+                    "VAE decoder must have [1, C, H, W] input and [1, H, W, C] output");
+    OPENVINO_ASSERT(tile_overlap < std::min(m_tile_shape[2], m_tile_shape[3]), "Tile overlap must be less than tile size");
+    m_scale_factor = output_shape[1] / m_tile_shape[2];
+    m_channels = output_shape[3];
+
+    m_blend_weights_y = get_blend_weights(output_shape[1], m_tile_overlap * m_scale_factor);
+    m_blend_weights_x = get_blend_weights(output_shape[2], m_tile_overlap * m_scale_factor);
+    for (size_t request_idx = 0; request_idx < num_requests; ++request_idx) {
+        m_requests.push_back(vae_decoder.create_infer_request());
+        m_requests.back().set_input_tensor(ov::Tensor(ov::element::f32, m_tile_shape));
+    }
+}
+
+void TiledVAEDecoder::_accumulate(ov::InferRequest& request, const Tile& tile, ov::Tensor& image, std::vector<float>& weights) const {
+    request.wait();
+    const ov::Tensor decoded_tile = request.get_output_tensor();
+    const size_t tile_height = decoded_tile.get_shape()[1], tile_width = decoded_tile.get_shape()[2];
+    const size_t image_width = image.get_shape()[2];
+    const size_t y0 = tile.y * m_scale_factor, x0 = tile.x * m_scale_factor;
+
+    const float* tile_data = decoded_tile.data<const float>();
+    float* image_data = image.data<float>();
+    for (size_t y = 0; y < tile_height; ++y) {
+        for (size_t x = 0; x < tile_width; ++x) {
+            const float weight = m_blend_weights_y[y] * m_blend_weights_x[x];
+            const size_t pixel_idx = (y0 + y) * image_width + x0 + x;
+            const float* tile_pixel = tile_data + (y * tile_width + x) * m_channels;
+            float* image_pixel = image_data + pixel_idx * m_channels;
+            for (size_t c = 0; c < m_channels; ++c)
+                image_pixel[c] += weight * tile_pixel[c];
+            weights[pixel_idx] += weight;
+        }
+    }
+}
+
+ov::Tensor TiledVAEDecoder::decode(ov::Tensor latent) {
+    const ov::Shape latent_shape = latent.get_shape();
+    OPENVINO_ASSERT(latent_shape.size() == 4 && latent_shape[0] == 1 && latent_shape[1] == m_tile_shape[1],
+                    "Latent must have [1, ", m_tile_shape[1], ", H, W] shape");
+    const size_t channels = latent_shape[1], height = latent_shape[2], width = latent_shape[3];
+    const size_t tile_height = m_tile_shape[2], tile_width = m_tile_shape[3];
+
+    std::vector<Tile> tiles;
+    for (size_t y : get_tile_offsets(height, tile_height, m_tile_overlap))
+        for (size_t x : get_tile_offsets(width, tile_width, m_tile_overlap))
+            tiles.push_back({y, x});
+
+    ov::Tensor image(ov::element::f32, {1, height * m_scale_factor, width * m_scale_factor, m_channels});
+    std::fill_n(image.data<float>(), image.get_size(), 0.0f);
+    std::vector<float> weights(height * m_scale_factor * width * m_scale_factor, 0.0f);
+
+    // tile i is decoded by request i % num_requests, whose previous tile is accumulated before
+    const float* latent_data = latent.data<const float>();
+    for (size_t tile_idx = 0; tile_idx < tiles.size(); ++tile_idx) {
+        ov::InferRequest& request = m_requests[tile_idx % m_requests.size()];
+        if (tile_idx >= m_requests.size())
+            _accumulate(request, tiles[tile_idx - m_requests.size()], image, weights);
+
+        const Tile& tile = tiles[tile_idx];
+        float* tile_data = request.get_input_tensor().data<float>();
+        for (size_t c = 0; c < channels; ++c)
+            for (size_t y = 0; y < tile_height; ++y)
+                std::copy_n(latent_data + (c * height + tile.y + y) * width + tile.x, tile_width,
+                            tile_data + (c * tile_height + y) * tile_width);
+        request.start_async();
+    }
+    for (size_t tile_idx = tiles.size() > m_requests.size() ? tiles.size() - m_requests.size() : 0; tile_idx < tiles.size(); ++tile_idx)
+        _accumulate(m_requests[tile_idx % m_requests.size()], tiles[tile_idx], image, weights);
+
+    float* image_data = image.data<float>();
+    for (size_t pixel_idx = 0; pixel_idx < weights.size(); ++pixel_idx)
+        for (size_t c = 0; c < m_channels; ++c)
+            image_data[pixel_idx * m_channels + c] /= weights[pixel_idx];
+    return image;
+}
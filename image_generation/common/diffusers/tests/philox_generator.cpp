@@ -0,0 +1,40 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "philox_generator.hpp"
+
+// known answers of Philox4x32-10 from kat_vectors of Random123 library: counter, key, result
+const uint32_t KNOWN_ANSWERS[][10] = {
+    {0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+    {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+    {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0, 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1},
+};
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        return EXIT_FAILURE; \
+    }
+
+int main() {
+    for (const auto& known_answer : KNOWN_ANSWERS) {
+        uint32_t counter[4] = {known_answer[0], known_answer[1], known_answer[2], known_answer[3]};
+        philox4x32(counter, known_answer[4], known_answer[5]);
+        CHECK(std::equal(counter, counter + 4, known_answer + 6));
+    }
+
+    // values don't depend on size of tensor, which is split between threads by blocks
+    std::vector<float> values(1000), prefix(257);
+    randn_philox(values.data(), values.size(), 42, 1);
+    randn_philox(prefix.data(), prefix.size(), 42, 1);
+    CHECK(std::equal(prefix.begin(), prefix.end(), values.begin()));
+    // subsequences are different streams
+    randn_philox(prefix.data(), prefix.size(), 42, 2);
+    CHECK(!std::equal(prefix.begin(), prefix.end(), values.begin()));
+    return EXIT_SUCCESS;
+}
@@ -3,14 +3,76 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "openvino/runtime/tensor.hpp"
 
+enum class ImageFormat {
+    BMP,
+    PNG,  // deflate compressed, rows are compressed in parallel
+};
+
 /**
- * @brief Writes image to file
+ * @brief Returns format of file by its extension: PNG for ".png", BMP otherwise
  * @param name File name
+ */
+ImageFormat get_image_format(const std::string& name);
+
+/**
+ * @brief Encodes image to bytes of a file of given format, e.g. to send it without writing to file system
+ * @param image Image tensor
+ * @param convert_bgr2rgb Convert BGR to RGB; the same image and flag give the same colors in all formats
+ * @param format Format of file
+ */
+std::vector<std::uint8_t> imencode(ov::Tensor image, bool convert_bgr2rgb, ImageFormat format = ImageFormat::BMP);
+
+/**
+ * @brief Writes image to file
+ * @param name File name, which extension defines format of file (see get_image_format)
  * @param image Image tensor
  * @param convert_bgr2rgb Convert BGR to RGB
  */
 void imwrite(const std::string& name, ov::Tensor image, bool convert_bgr2rgb);
+
+/**
+ * @brief Writer of images by a pool of threads, so a caller continues generation of the next images instead of
+ * waiting for encoding and disk I/O; write() blocks while 'max_queue_size' images are waiting for writing, which
+ * bounds memory of queued images
+ */
+class AsyncImageWriter {
+public:
+    explicit AsyncImageWriter(size_t num_threads = 2, size_t max_queue_size = 8);
+
+    AsyncImageWriter(const AsyncImageWriter&) = delete;
+    AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+    // waits for writing of all images
+    ~AsyncImageWriter();
+
+    // queues writing of 'image' to file 'name' (see imwrite); 'image' must not be changed until it's written
+    void write(std::string name, ov::Tensor image, bool convert_bgr2rgb);
+
+    // waits for writing of all queued images and rethrows the first error of writing
+    void wait();
+
+private:
+    void _run();
+
+    std::vector<std::thread> m_threads;
+    size_t m_max_queue_size;
+    std::mutex m_mutex;
+    std::condition_variable m_queue_changed;
+    std::deque<std::function<void()>> m_queue;
+    // number of queued images and images, which are being written
+    size_t m_num_pending = 0;
+    bool m_stopped = false;
+    std::exception_ptr m_error;
+};
@@ -1,18 +1,26 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <limits>
 #include <string>
 #include <iostream>
+#include <utility>
+
+#ifdef IMWRITE_WITH_PNG
+#include <zlib.h>
+#endif
 
 #include "imwrite.hpp"
 
 #include "openvino/core/except.hpp"
+#include "openvino/core/parallel.hpp"
 
 namespace {
 
-unsigned char file[14] = {
+const unsigned char file_header[14] = {
     'B',
     'M',  // magic
     0,
@@ -29,7 +37,7 @@ unsigned char file[14] = {
     0  // start of data offset
 };
 
-unsigned char info[40] = {
+const unsigned char info_header[40] = {
         40,
         0,
         0,
@@ -73,61 +81,240 @@ unsigned char info[40] = {
         0,  // #important colors
     };
 
+void write_le32(unsigned char* dst, int32_t value) {
+    for (size_t i = 0; i < 4; ++i)
+        dst[i] = static_cast<unsigned char>(static_cast<uint32_t>(value) >> (8 * i));
 }
 
-void imwrite(const std::string& name, ov::Tensor image, bool convert_bgr2rgb) {
-    std::ofstream output_file(name, std::ofstream::binary);
-    OPENVINO_ASSERT(output_file.is_open(), "Failed to open the output BMP image path");
-
+// [height, width, channels] of u8 [1, H, W, 3] image
+ov::Shape get_image_shape(const ov::Tensor& image) {
     const ov::Shape shape = image.get_shape();
-    const size_t width = shape[2], height = shape[1], channels = shape[3];
     OPENVINO_ASSERT(image.get_element_type() == ov::element::u8 &&
-        shape.size() == 4 && shape[0] == 1 && channels == 3,
+        shape.size() == 4 && shape[0] == 1 && shape[3] == 3,
         "Image of u8 type and [1, H, W, 3] shape is expected");
+    return {shape[1], shape[2], shape[3]};
+}
+
+std::vector<std::uint8_t> encode_bmp(ov::Tensor image, bool convert_bgr2rgb) {
+    const ov::Shape shape = get_image_shape(image);
+    const size_t height = shape[0], width = shape[1], channels = shape[2];
 
     int padSize = static_cast<int>(4 - (width * channels) % 4) % 4;
     int sizeData = static_cast<int>(width * height * channels + height * padSize);
-    int sizeAll = sizeData + sizeof(file) + sizeof(info);
+    int sizeAll = sizeData + sizeof(file_header) + sizeof(info_header);
 
-    file[2] = (unsigned char)(sizeAll);
-    file[3] = (unsigned char)(sizeAll >> 8);
-    file[4] = (unsigned char)(sizeAll >> 16);
-    file[5] = (unsigned char)(sizeAll >> 24);
+    std::vector<std::uint8_t> bytes(file_header, file_header + sizeof(file_header));
+    bytes.insert(bytes.end(), info_header, info_header + sizeof(info_header));
+    unsigned char* file = bytes.data();
+    unsigned char* info = bytes.data() + sizeof(file_header);
+    write_le32(file + 2, sizeAll);
+    write_le32(info + 4, static_cast<int32_t>(width));
+    write_le32(info + 8, -static_cast<int32_t>(height));
+    write_le32(info + 20, sizeData);
 
-    info[4] = (unsigned char)(width);
-    info[5] = (unsigned char)(width >> 8);
-    info[6] = (unsigned char)(width >> 16);
-    info[7] = (unsigned char)(width >> 24);
+    bytes.resize(sizeAll, 0);
+    const std::uint8_t* data = image.data<const std::uint8_t>();
+    std::uint8_t* dst = bytes.data() + sizeof(file_header) + sizeof(info_header);
+    for (size_t y = 0; y < height; y++) {
+        const std::uint8_t* current_row = data + y * width * channels;
+        if (convert_bgr2rgb) {
+            for (size_t x = 0; x < width; ++x, current_row += channels, dst += channels) {
+                dst[0] = current_row[2];
+                dst[1] = current_row[1];
+                dst[2] = current_row[0];
+            }
+        } else {
+            dst = std::copy_n(current_row, width * channels, dst);
+        }
+        dst += padSize;
+    }
+    return bytes;
+}
 
-    std::int32_t negativeHeight = -(int32_t)height;
-    info[8] = (unsigned char)(negativeHeight);
-    info[9] = (unsigned char)(negativeHeight >> 8);
-    info[10] = (unsigned char)(negativeHeight >> 16);
-    info[11] = (unsigned char)(negativeHeight >> 24);
+#ifdef IMWRITE_WITH_PNG
 
-    info[20] = (unsigned char)(sizeData);
-    info[21] = (unsigned char)(sizeData >> 8);
-    info[22] = (unsigned char)(sizeData >> 16);
-    info[23] = (unsigned char)(sizeData >> 24);
+// rows of PNG image, which are compressed as an independent part of deflate stream by a thread
+const size_t PNG_ROWS_PER_PART = 64;
 
-    output_file.write(reinterpret_cast<char*>(file), sizeof(file));
-    output_file.write(reinterpret_cast<char*>(info), sizeof(info));
+void append_be32(std::vector<std::uint8_t>& dst, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        dst.push_back(static_cast<std::uint8_t>(value >> shift));
+}
+
+// raw deflate stream of 'size' bytes, which is ended by a sync flush, so streams of parts are concatenated
+std::vector<std::uint8_t> deflate_part(const std::uint8_t* data, size_t size, bool is_last) {
+    z_stream stream{};
+    OPENVINO_ASSERT(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK,
+                    "Failed to initialize deflate");
+    // sync flush adds an empty block of a few bytes to the bound
+    std::vector<std::uint8_t> compressed(deflateBound(&stream, size) + 16);
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = compressed.data();
+    stream.avail_out = static_cast<uInt>(compressed.size());
+    const int status = deflate(&stream, is_last ? Z_FINISH : Z_SYNC_FLUSH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    OPENVINO_ASSERT(status == (is_last ? Z_STREAM_END : Z_OK) && stream.avail_in == 0, "Failed to compress PNG image");
+    return compressed;
+}
 
-    const std::uint8_t pad[3] = {0, 0, 0};
+void append_png_chunk(std::vector<std::uint8_t>& bytes, const char type[4], const std::uint8_t* data, size_t size) {
+    append_be32(bytes, static_cast<uint32_t>(size));
+    const size_t type_offset = bytes.size();
+    bytes.insert(bytes.end(), type, type + 4);
+    bytes.insert(bytes.end(), data, data + size);
+    append_be32(bytes, crc32(0, bytes.data() + type_offset, static_cast<uInt>(size + 4)));
+}
+
+std::vector<std::uint8_t> encode_png(ov::Tensor image, bool convert_bgr2rgb) {
+    const ov::Shape shape = get_image_shape(image);
+    const size_t height = shape[0], width = shape[1], channels = shape[2];
+    const size_t row_size = 1 + width * channels;
     const std::uint8_t* data = image.data<const std::uint8_t>();
 
-    for (size_t y = 0; y < height; y++) {
-        const std::uint8_t* current_row = data + y * width * channels;
-        if (convert_bgr2rgb) {
-            for (size_t x = 0; x < width; ++x) {
-                output_file.write(reinterpret_cast<const char*>(current_row + 2), 1);
-                output_file.write(reinterpret_cast<const char*>(current_row + 1), 1);
-                output_file.write(reinterpret_cast<const char*>(current_row), 1);
-                current_row += channels;
+    // each part of rows is filtered by 'Sub' filter and compressed by a thread, while checksums of parts are combined
+    const size_t num_parts = std::max<size_t>(1, (height + PNG_ROWS_PER_PART - 1) / PNG_ROWS_PER_PART);
+    std::vector<std::vector<std::uint8_t>> compressed_parts(num_parts);
+    std::vector<uLong> part_adlers(num_parts);
+    ov::parallel_for(num_parts, [&] (size_t part_idx) {
+        const size_t begin_row = part_idx * PNG_ROWS_PER_PART, end_row = std::min(height, begin_row + PNG_ROWS_PER_PART);
+        std::vector<std::uint8_t> rows((end_row - begin_row) * row_size);
+        for (size_t y = begin_row; y < end_row; ++y) {
+            const std::uint8_t* src = data + y * width * channels;
+            std::uint8_t* dst = rows.data() + (y - begin_row) * row_size;
+            *dst++ = 1;  // 'Sub' filter
+            // BMP stores BGR, while PNG stores RGB, so channels are swapped without 'convert_bgr2rgb'
+            const size_t first = convert_bgr2rgb ? 0 : 2, last = 2 - first;
+            std::uint8_t prev[3] = {0, 0, 0};
+            for (size_t x = 0; x < width; ++x, src += channels, dst += channels) {
+                const std::uint8_t pixel[3] = {src[first], src[1], src[last]};
+                for (size_t c = 0; c < 3; ++c)
+                    dst[c] = static_cast<std::uint8_t>(pixel[c] - prev[c]);
+                std::copy_n(pixel, 3, prev);
             }
-        } else {
-            output_file.write(reinterpret_cast<const char*>(current_row), width * channels);
         }
-        output_file.write(reinterpret_cast<const char*>(pad), padSize);
+        part_adlers[part_idx] = adler32(1, rows.data(), static_cast<uInt>(rows.size()));
+        compressed_parts[part_idx] = deflate_part(rows.data(), rows.size(), part_idx + 1 == num_parts);
+    });
+
+    // zlib stream: header, deflate stream of all parts and adler32 of uncompressed data
+    std::vector<std::uint8_t> idat = {0x78, 0x9C};
+    uLong adler = part_adlers[0];
+    for (size_t part_idx = 0; part_idx < num_parts; ++part_idx) {
+        idat.insert(idat.end(), compressed_parts[part_idx].begin(), compressed_parts[part_idx].end());
+        if (part_idx > 0) {
+            const size_t part_size = (std::min(height, (part_idx + 1) * PNG_ROWS_PER_PART) - part_idx * PNG_ROWS_PER_PART) * row_size;
+            adler = adler32_combine(adler, part_adlers[part_idx], static_cast<z_off_t>(part_size));
+        }
+    }
+    append_be32(idat, static_cast<uint32_t>(adler));
+
+    std::vector<std::uint8_t> bytes = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<std::uint8_t> ihdr;
+    append_be32(ihdr, static_cast<uint32_t>(width));
+    append_be32(ihdr, static_cast<uint32_t>(height));
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0});  // 8 bits per channel, RGB, deflate, adaptive filtering, no interlace
+    append_png_chunk(bytes, "IHDR", ihdr.data(), ihdr.size());
+    append_png_chunk(bytes, "IDAT", idat.data(), idat.size());
+    append_png_chunk(bytes, "IEND", nullptr, 0);
+    return bytes;
+}
+
+#else
+
+std::vector<std::uint8_t> encode_png(ov::Tensor, bool) {
+    OPENVINO_THROW("PNG format is not supported, because imwrite is built without zlib");
+}
+
+#endif  // IMWRITE_WITH_PNG
+
+}  // namespace
+
+ImageFormat get_image_format(const std::string& name) {
+    const std::string png_extension = ".png";
+    if (name.size() >= png_extension.size()) {
+        std::string extension = name.substr(name.size() - png_extension.size());
+        std::transform(extension.begin(), extension.end(), extension.begin(), [] (unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+        if (extension == png_extension)
+            return ImageFormat::PNG;
+    }
+    return ImageFormat::BMP;
+}
+
+std::vector<std::uint8_t> imencode(ov::Tensor image, bool convert_bgr2rgb, ImageFormat format) {
+    return format == ImageFormat::PNG ? encode_png(image, convert_bgr2rgb) : encode_bmp(image, convert_bgr2rgb);
+}
+
+void imwrite(const std::string& name, ov::Tensor image, bool convert_bgr2rgb) {
+    const std::vector<std::uint8_t> bytes = imencode(image, convert_bgr2rgb, get_image_format(name));
+    std::ofstream output_file(name, std::ofstream::binary);
+    OPENVINO_ASSERT(output_file.is_open(), "Failed to open the output image path ", name);
+    output_file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    OPENVINO_ASSERT(output_file.good(), "Failed to write image ", name);
+}
+
+AsyncImageWriter::AsyncImageWriter(size_t num_threads, size_t max_queue_size) :
+    m_max_queue_size(max_queue_size) {
+    OPENVINO_ASSERT(num_threads > 0 && max_queue_size > 0, "Number of threads and size of queue must be positive");
+    for (size_t thread_idx = 0; thread_idx < num_threads; ++thread_idx)
+        m_threads.emplace_back([this] { _run(); });
+}
+
+AsyncImageWriter::~AsyncImageWriter() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queue_changed.wait(lock, [this] { return m_num_pending == 0; });
+        m_stopped = true;
+    }
+    m_queue_changed.notify_all();
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+void AsyncImageWriter::write(std::string name, ov::Tensor image, bool convert_bgr2rgb) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queue_changed.wait(lock, [this] { return m_queue.size() < m_max_queue_size; });
+        m_queue.push_back([name = std::move(name), image, convert_bgr2rgb] {
+            imwrite(name, image, convert_bgr2rgb);
+        });
+        ++m_num_pending;
+    }
+    m_queue_changed.notify_all();
+}
+
+void AsyncImageWriter::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue_changed.wait(lock, [this] { return m_num_pending == 0; });
+    if (m_error)
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+}
+
+void AsyncImageWriter::_run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_queue_changed.wait(lock, [this] { return m_stopped || !m_queue.empty(); });
+        if (m_queue.empty())
+            return;
+        std::function<void()> task = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_queue_changed.notify_all();
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error && !m_error)
+            m_error = error;
+        --m_num_pending;
+        m_queue_changed.notify_all();
     }
 }
@@ -5,7 +5,6 @@
 #include <ctime>
 #include <iostream>
 #include <fstream>
-#include <random>
 #include <string>
 #include <vector>
 #include <cmath>
@@ -20,6 +19,7 @@
 #include "scheduler_lcm.hpp"
 #include "lora.hpp"
 #include "imwrite.hpp"
+#include "philox_generator.hpp"
 
 const size_t TOKENIZER_MODEL_MAX_LENGTH = 77;   // 'model_max_length' parameter from 'tokenizer_config.json'
 const size_t VAE_SCALE_FACTOR = 8;
@@ -39,11 +39,8 @@ ov::Tensor randn_tensor(ov::Shape shape, bool use_np_latents, uint32_t seed = 42
         for (size_t i = 0; i < noise.get_size(); ++i)
             latent_copy_file >> noise.data<float>()[i];
     } else {
-        std::mt19937 gen{static_cast<unsigned long>(seed)};
-        std::normal_distribution<float> normal{0.0f, 1.0f};
-        std::generate_n(noise.data<float>(), noise.get_size(), [&]() {
-            return normal(gen);
-        });
+        // noise of denoising steps is generated by LCMScheduler from the next subsequences of the seed
+        randn_philox(noise.data<float>(), noise.get_size(), seed);
     }
     return noise;
 }
@@ -231,16 +228,14 @@ ov::Tensor unet(ov::InferRequest req, ov::Tensor sample, ov::Tensor timestep, ov
     return req.get_output_tensor();
 }
 
-ov::Tensor vae_decoder(ov::CompiledModel& decoder_compiled_model, ov::Tensor sample) {
+// starts decoding of 'sample' by 'req', which output is valid after req.wait()
+void vae_decoder_start(ov::InferRequest& req, ov::Tensor sample) {
     const float coeffs_const{1 / 0.18215};
     for (size_t i = 0; i < sample.get_size(); ++i)
         sample.data<float>()[i] *= coeffs_const;
 
-    ov::InferRequest req = decoder_compiled_model.create_infer_request();
     req.set_input_tensor(sample);
-    req.infer();
-
-    return req.get_output_tensor();
+    req.start_async();
 }
 
 ov::Tensor postprocess_image(ov::Tensor decoded_image) {
@@ -330,6 +325,7 @@ int32_t main(int32_t argc, char* argv[]) try {
     StableDiffusionModels models = 
         compile_models(model_path, device, lora_path, alpha, use_cache, use_dynamic_shapes, batch_size, height, width);
     ov::InferRequest unet_infer_request = models.unet.create_infer_request();
+    ov::InferRequest vae_decoder_infer_request = models.vae_decoder.create_infer_request();
 
     ov::PartialShape sample_shape = models.unet.input("sample").get_partial_shape();
     OPENVINO_ASSERT(sample_shape.is_dynamic() ||
@@ -340,13 +336,6 @@ int32_t main(int32_t argc, char* argv[]) try {
     // https://huggingface.co/docs/diffusers/api/pipelines/latent_consistency_models#diffusers.LatentConsistencyModelPipeline
     ov::Tensor text_embeddings = text_encoder(models, positive_prompt);
 
-    std::shared_ptr<Scheduler> scheduler = std::make_shared<LCMScheduler>(LCMScheduler(
-        1000, 0.00085f, 0.012f, BetaSchedule::SCALED_LINEAR,
-        PredictionType::EPSILON, {}, 50, true, 10.0f, false,
-        false, 1.0f, 0.995f, 1.0f, read_np_latent, user_seed));
-    scheduler->set_timesteps(num_inference_steps);
-    std::vector<std::int64_t> timesteps = scheduler->get_timesteps();
-
     float guidance_scale = 8.0;
     const size_t unet_time_cond_proj_dim = static_cast<size_t>(models.unet.input("timestep_cond").get_partial_shape()[1].get_length());
     ov::Tensor guidance_scale_embedding = get_w_embedding(guidance_scale, unet_time_cond_proj_dim);
@@ -356,10 +345,28 @@ int32_t main(int32_t argc, char* argv[]) try {
 
     ov::Tensor denoised(ov::element::f32, latent_model_input_shape);
 
+    // VAE decoder runs asynchronously, so an image is decoded while UNet denoises the next one, and it's written by
+    // another thread
+    AsyncImageWriter image_writer(1);
+    std::vector<std::string> image_paths;
+    auto write_decoded_image = [&vae_decoder_infer_request, &image_writer, &image_paths] (std::uint32_t seed) {
+        vae_decoder_infer_request.wait();
+        image_paths.push_back(std::string("./images/seed_") + std::to_string(seed) + ".bmp");
+        image_writer.write(image_paths.back(), postprocess_image(vae_decoder_infer_request.get_output_tensor()), true);
+    };
+
     for (uint32_t n = 0; n < num_images; n++) {
         std::uint32_t seed = num_images == 1 ? user_seed: user_seed + n;
         ov::Tensor latent_model_input = randn_tensor(latent_model_input_shape, read_np_latent, seed);
 
+        // noise of steps depends on the seed of image only, so an image is reproduced regardless of other images
+        std::shared_ptr<Scheduler> scheduler = std::make_shared<LCMScheduler>(LCMScheduler(
+            1000, 0.00085f, 0.012f, BetaSchedule::SCALED_LINEAR,
+            PredictionType::EPSILON, {}, 50, true, 10.0f, false,
+            false, 1.0f, 0.995f, 1.0f, read_np_latent, seed));
+        scheduler->set_timesteps(num_inference_steps);
+        std::vector<std::int64_t> timesteps = scheduler->get_timesteps();
+
         for (size_t inference_step = 0; inference_step < num_inference_steps; inference_step++) {
             ov::Tensor timestep(ov::element::i64, {1}, &timesteps[inference_step]);
             ov::Tensor noisy_residual = unet(unet_infer_request, latent_model_input, timestep, text_embeddings, guidance_scale_embedding);
@@ -368,10 +375,15 @@ int32_t main(int32_t argc, char* argv[]) try {
             latent_model_input = step_res["latent"], denoised = step_res["denoised"];
         }
 
-        ov::Tensor decoded_image = vae_decoder(models.vae_decoder, denoised);
-        imwrite(std::string("./images/seed_") + std::to_string(seed) + ".bmp", postprocess_image(decoded_image), true);
-        std::cout << "Result image saved to: " << std::string("./images/seed_") + std::to_string(seed) + ".bmp" << std::endl;
+        if (n > 0)
+            write_decoded_image(seed - 1);
+        vae_decoder_start(vae_decoder_infer_request, denoised);
     }
+    if (num_images > 0)
+        write_decoded_image(num_images == 1 ? user_seed : user_seed + num_images - 1);
+    image_writer.wait();
+    for (const std::string& image_path : image_paths)
+        std::cout << "Result image saved to: " << image_path << std::endl;
 
     return EXIT_SUCCESS;
 } catch (const std::exception& error) {
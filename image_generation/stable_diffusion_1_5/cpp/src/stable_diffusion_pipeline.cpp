@@ -0,0 +1,602 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stable_diffusion_pipeline.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+
+#include "lora.hpp"
+#include "openvino/core/preprocess/pre_post_process.hpp"
+#include "openvino/op/parameter.hpp"
+#include "openvino/op/result.hpp"
+#include "openvino/pass/manager.hpp"
+#include "openvino/runtime/core.hpp"
+#include "philox_generator.hpp"
+#include "scheduler_lms_discrete.hpp"
+
+namespace {
+
+const size_t TOKENIZER_MODEL_MAX_LENGTH = 77;   // 'model_max_length' parameter from 'tokenizer_config.json'
+const char DEEP_FEATURE_NAME[] = "deep_feature";
+
+void apply_lora(std::shared_ptr<ov::Model> model, InsertLoRA::LoRAMap& lora_map) {
+    if (!lora_map.empty()) {
+        ov::pass::Manager manager;
+        manager.register_pass<InsertLoRA>(lora_map);
+        manager.run_passes(model);
+    }
+}
+
+// adds inputs for layers of LoRA adapter, so it's applied by LoRAAdapterCache after compilation of model
+void add_lora_inputs(std::shared_ptr<ov::Model> model, const LoRAFactorsMap& lora_factors) {
+    if (!lora_factors.empty()) {
+        std::set<std::string> layer_names;
+        size_t max_rank = 0;
+        for (const auto& [layer_name, factors] : lora_factors) {
+            layer_names.insert(layer_name);
+            max_rank = std::max(max_rank, factors.down.get_shape()[0]);
+        }
+        insert_lora_inputs(model, layer_names, max_rank);
+    }
+}
+
+// index of UNet up block, which 'node' belongs to, or -1
+int get_up_block_idx(const std::shared_ptr<ov::Node>& node) {
+    const std::string prefix = "/up_blocks.";
+    const std::string& name = node->get_friendly_name();
+    return name.compare(0, prefix.size(), prefix) == 0 ? std::atoi(name.c_str() + prefix.size()) : -1;
+}
+
+// output of the last but one up block of UNet, i.e. features of all deep blocks, which are combined with skip
+// connections of the first down block by the last up block
+ov::Output<ov::Node> find_deep_feature(const std::shared_ptr<ov::Model>& model) {
+    int last_up_block_idx = -1;
+    for (const auto& node : model->get_ordered_ops())
+        last_up_block_idx = std::max(last_up_block_idx, get_up_block_idx(node));
+    OPENVINO_ASSERT(last_up_block_idx > 0, "UNet model doesn't have names of up blocks, which are required by DeepCache");
+
+    std::vector<ov::Output<ov::Node>> deep_features;
+    for (const auto& node : model->get_ordered_ops()) {
+        if (get_up_block_idx(node) != last_up_block_idx - 1)
+            continue;
+        for (const ov::Output<ov::Node>& output : node->outputs()) {
+            for (const ov::Input<ov::Node>& consumer : output.get_target_inputs()) {
+                if (get_up_block_idx(consumer.get_node()->shared_from_this()) == last_up_block_idx) {
+                    deep_features.push_back(output);
+                    break;
+                }
+            }
+        }
+    }
+    OPENVINO_ASSERT(deep_features.size() == 1, "UNet model has ", deep_features.size(), " outputs of up block ",
+                    last_up_block_idx - 1, " to the last up block, while DeepCache requires one");
+    return deep_features[0];
+}
+
+// splits 'unet_model' for DeepCache: the full model additionally returns features of deep blocks, while the returned
+// shallow model computes the first down block and the last up block only, taking deep features as input
+std::shared_ptr<ov::Model> split_unet_for_deep_cache(std::shared_ptr<ov::Model> unet_model) {
+    std::shared_ptr<ov::Model> shallow_model = unet_model->clone();
+    ov::Output<ov::Node> shallow_deep_feature = find_deep_feature(shallow_model);
+    auto deep_feature_input = std::make_shared<ov::op::v0::Parameter>(shallow_deep_feature.get_element_type(),
+                                                                      shallow_deep_feature.get_partial_shape());
+    deep_feature_input->set_friendly_name(DEEP_FEATURE_NAME);
+    deep_feature_input->output(0).set_names({DEEP_FEATURE_NAME});
+    const int last_up_block_idx = get_up_block_idx(shallow_deep_feature.get_node_shared_ptr()) + 1;
+    for (ov::Input<ov::Node> consumer : shallow_deep_feature.get_target_inputs()) {
+        if (get_up_block_idx(consumer.get_node()->shared_from_this()) == last_up_block_idx)
+            consumer.replace_source_output(deep_feature_input);
+    }
+    // deep blocks aren't reachable from results anymore, so they are not a part of the shallow model
+    ov::ParameterVector parameters = shallow_model->get_parameters();
+    parameters.push_back(deep_feature_input);
+    shallow_model = std::make_shared<ov::Model>(shallow_model->get_results(), parameters, "unet_shallow");
+
+    ov::Output<ov::Node> deep_feature = find_deep_feature(unet_model);
+    auto deep_feature_result = std::make_shared<ov::op::v0::Result>(deep_feature);
+    deep_feature_result->output(0).set_names({DEEP_FEATURE_NAME});
+    unet_model->add_results({deep_feature_result});
+    return shallow_model;
+}
+
+void reshape_text_encoder(std::shared_ptr<ov::Model> model, ov::Dimension batch_size, size_t tokenizer_model_max_length) {
+    ov::PartialShape input_shape = model->input(0).get_partial_shape();
+    input_shape[0] = batch_size;
+    input_shape[1] = tokenizer_model_max_length;
+    std::map<size_t, ov::PartialShape> idx_to_shape{{0, input_shape}};
+    model->reshape(idx_to_shape);
+}
+
+void reshape_unet_encoder(std::shared_ptr<ov::Model> model,
+                          int64_t batch_size,
+                          int64_t height,
+                          int64_t width,
+                          int64_t tokenizer_model_max_length) {
+    // The factor of 2 comes from the guidance scale > 1
+    for (auto input : model->inputs()) {
+        if (input.get_any_name().find("timestep_cond") == std::string::npos) {
+            batch_size *= 2;
+            break;
+        }
+    }
+
+    height = height / VAE_SCALE_FACTOR;
+    width = width / VAE_SCALE_FACTOR;
+
+    std::map<std::string, ov::PartialShape> name_to_shape;
+
+    for (auto input : model->inputs()) {
+        std::string input_name = input.get_any_name();
+        name_to_shape[input_name] = input.get_partial_shape();
+        if (input_name == "timestep") {
+            name_to_shape[input_name][0] = 1;
+        } else if (input_name == "sample") {
+            name_to_shape[input_name] = {batch_size, name_to_shape[input_name][1], height, width};
+        } else if (input_name == "time_ids") {
+            name_to_shape[input_name][0] = batch_size;
+        } else {
+            name_to_shape[input_name][0] = batch_size;
+            name_to_shape[input_name][1] = TOKENIZER_MODEL_MAX_LENGTH;
+        }
+    }
+
+    model->reshape(name_to_shape);
+}
+
+void reshape_vae_decoder(std::shared_ptr<ov::Model> model, int64_t height, int64_t width) {
+    height = height / VAE_SCALE_FACTOR;
+    width = width / VAE_SCALE_FACTOR;
+
+    ov::PartialShape input_shape = model->input(0).get_partial_shape();
+    std::map<size_t, ov::PartialShape> idx_to_shape{{0, {1, input_shape[1], height, width}}};
+    model->reshape(idx_to_shape);
+}
+
+} // namespace
+
+ov::Tensor randn_tensor(ov::Shape shape, bool use_np_latents, const std::vector<uint32_t>& seeds) {
+    ov::Tensor noise(ov::element::f32, shape);
+    OPENVINO_ASSERT(seeds.size() == shape[0], "Each latent in batch requires a seed");
+    if (use_np_latents) {
+        // read np generated latents with defaut seed 42
+        const char* latent_file_name = "../np_latents_512x512.txt";
+        std::ifstream latent_copy_file(latent_file_name, std::ios::ate);
+        OPENVINO_ASSERT(latent_copy_file.is_open(), "Cannot open ", latent_file_name);
+
+        size_t file_size = latent_copy_file.tellg() / sizeof(float);
+        OPENVINO_ASSERT(file_size >= noise.get_size(),
+                        "Cannot generate ",
+                        noise.get_shape(),
+                        " with ",
+                        latent_file_name,
+                        ". File size is small");
+
+        latent_copy_file.seekg(0, std::ios::beg);
+        for (size_t i = 0; i < noise.get_size(); ++i)
+            latent_copy_file >> noise.data<float>()[i];
+    } else {
+        // every latent is generated from its own seed, so an image does not depend on other images in batch
+        const size_t latent_size = noise.get_size() / shape[0];
+        for (size_t batch_idx = 0; batch_idx < shape[0]; ++batch_idx) {
+            randn_philox(noise.data<float>() + batch_idx * latent_size, latent_size, seeds[batch_idx]);
+        }
+    }
+    return noise;
+}
+
+StableDiffusionModels compile_models(const std::string& model_path,
+                                     const std::string& device,
+                                     const std::string& lora_path,
+                                     const float alpha,
+                                     const bool switch_lora,
+                                     const bool use_cache,
+                                     const bool use_dynamic_shapes,
+                                     const size_t batch_size,
+                                     const size_t height,
+                                     const size_t width,
+                                     const size_t vae_tile_size,
+                                     const bool deep_cache) {
+    OPENVINO_ASSERT(!deep_cache || !switch_lora, "DeepCache doesn't support switching of LoRA adapters");
+    OPENVINO_ASSERT(vae_tile_size % VAE_SCALE_FACTOR == 0 && vae_tile_size <= std::min(height, width),
+                    "VAE tile size must be a multiple of ", VAE_SCALE_FACTOR, " not larger than image");
+    StableDiffusionModels models;
+
+    ov::Core core;
+    if (use_cache)
+        core.set_property(ov::cache_dir("./cache_dir"));
+
+    core.add_extension(TOKENIZERS_LIBRARY_PATH);
+
+    // read LoRA weights
+    std::map<std::string, InsertLoRA::LoRAMap> lora_weights;
+    std::map<std::string, LoRAFactorsMap> lora_factors;
+    if (!lora_path.empty() && switch_lora) {
+        Timer t("Loading LoRA weights");
+        lora_factors["text_encoder"] = read_lora_factors(lora_path, "text_encoder");
+        lora_factors["unet"] = read_lora_factors(lora_path, "unet");
+    } else if (!lora_path.empty()) {
+        Timer t("Loading and multiplying LoRA weights");
+        lora_weights = read_lora_adapters(lora_path, alpha);
+    }
+
+    // Text encoder
+    {
+        Timer t("Loading and compiling text encoder");
+        auto text_encoder_model = core.read_model(model_path + "/text_encoder/openvino_model.xml");
+        if (!use_dynamic_shapes) {
+            // prompts, which embeddings are not cached, are encoded in a batch
+            reshape_text_encoder(text_encoder_model, ov::Dimension::dynamic(), TOKENIZER_MODEL_MAX_LENGTH);
+        }
+        apply_lora(text_encoder_model, lora_weights["text_encoder"]);
+        add_lora_inputs(text_encoder_model, lora_factors["text_encoder"]);
+        models.text_encoder = core.compile_model(text_encoder_model, device);
+    }
+
+    // UNet
+    {
+        Timer t("Loading and compiling UNet");
+        auto unet_model = core.read_model(model_path + "/unet/openvino_model.xml");
+        if (!use_dynamic_shapes) {
+            reshape_unet_encoder(unet_model, batch_size, height, width, TOKENIZER_MODEL_MAX_LENGTH);
+        }
+        apply_lora(unet_model, lora_weights["unet"]);
+        add_lora_inputs(unet_model, lora_factors["unet"]);
+        if (deep_cache) {
+            models.unet_shallow = core.compile_model(split_unet_for_deep_cache(unet_model), device);
+        }
+        models.unet = core.compile_model(unet_model, device);
+    }
+
+    // VAE decoder
+    {
+        Timer t("Loading and compiling VAE decoder");
+        auto vae_decoder_model = core.read_model(model_path + "/vae_decoder/openvino_model.xml");
+        if (vae_tile_size > 0) {
+            // tiles have static shape even with dynamic shapes of other models
+            reshape_vae_decoder(vae_decoder_model, vae_tile_size, vae_tile_size);
+        } else if (!use_dynamic_shapes) {
+            reshape_vae_decoder(vae_decoder_model, height, width);
+        }
+        ov::preprocess::PrePostProcessor ppp(vae_decoder_model);
+        ppp.output().model().set_layout("NCHW");
+        ppp.output().tensor().set_layout("NHWC");
+        models.vae_decoder = core.compile_model(vae_decoder_model = ppp.build(), device);
+    }
+
+    // Tokenizer
+    {
+        Timer t("Loading and compiling tokenizer");
+        // Tokenizer model wil be loaded to CPU: OpenVINO Tokenizers can be inferred on a CPU device only.
+        models.tokenizer = core.compile_model(model_path + "/tokenizer/openvino_tokenizer.xml", "CPU");
+    }
+
+    return models;
+}
+
+StableDiffusionModelCache::StableDiffusionModelCache(std::string model_path, std::string device, size_t capacity, bool use_cache) :
+    m_model_path(std::move(model_path)),
+    m_device(std::move(device)),
+    m_capacity(capacity),
+    m_use_cache(use_cache) {
+    OPENVINO_ASSERT(m_capacity > 0, "Capacity of cache of models must be positive");
+}
+
+StableDiffusionModels StableDiffusionModelCache::get(size_t batch_size,
+                                                     size_t height,
+                                                     size_t width,
+                                                     const std::string& lora_path,
+                                                     float alpha,
+                                                     bool switch_lora,
+                                                     size_t vae_tile_size,
+                                                     bool deep_cache) {
+    // alpha is fused into weights only if LoRA is applied at compilation
+    const bool is_alpha_compiled = !lora_path.empty() && !switch_lora;
+    const Key key{batch_size, height, width, lora_path, is_alpha_compiled ? alpha : 0.0f, switch_lora, vae_tile_size, deep_cache};
+    std::promise<StableDiffusionModels> promise;
+    std::shared_future<StableDiffusionModels> models;
+    bool is_cached = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto models_it = std::find_if(m_models.begin(), m_models.end(), [&key] (const auto& entry) {
+            return entry.first == key;
+        });
+        is_cached = models_it != m_models.end();
+        if (is_cached) {
+            m_models.splice(m_models.begin(), m_models, models_it);
+        } else {
+            m_models.emplace_front(key, promise.get_future().share());
+            // compiled models are shared with pipelines, which use them, so an evicted entry is released by the last pipeline
+            if (m_models.size() > m_capacity)
+                m_models.pop_back();
+        }
+        models = m_models.front().second;
+    }
+    // models are compiled or being compiled by another request
+    if (is_cached)
+        return models.get();
+
+    // other keys are not blocked by compilation
+    try {
+        promise.set_value(compile_models(m_model_path, m_device, lora_path, alpha, switch_lora, m_use_cache, false,
+                                         batch_size, height, width, vae_tile_size, deep_cache));
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        // the next request of the key compiles models again
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_models.remove_if([&key] (const auto& entry) {
+            return entry.first == key;
+        });
+    }
+    return models.get();
+}
+
+StableDiffusionPipeline::StableDiffusionPipeline(StableDiffusionModels models, size_t height, size_t width, size_t deep_cache_interval) :
+    m_models(std::move(models)),
+    m_height(height),
+    m_width(width),
+    m_deep_cache_interval(deep_cache_interval),
+    m_tokenizer_request(m_models.tokenizer.create_infer_request()),
+    m_text_encoder_request(m_models.text_encoder.create_infer_request()),
+    m_unet_request(m_models.unet.create_infer_request()),
+    m_vae_decoder_request(m_models.vae_decoder.create_infer_request()) {
+    ov::PartialShape sample_shape = m_models.unet.input("sample").get_partial_shape();
+    OPENVINO_ASSERT(sample_shape.is_dynamic() ||
+                        (sample_shape[2] * VAE_SCALE_FACTOR == height && sample_shape[3] * VAE_SCALE_FACTOR == width),
+                    "UNet model has static shapes [2 * batch, 4, H/8, W/8] or dynamic shapes [?, 4, ?, ?]");
+    if (m_deep_cache_interval > 1) {
+        OPENVINO_ASSERT(m_models.unet_shallow, "DeepCache requires models compiled with 'deep_cache'");
+        m_unet_shallow_request = m_models.unet_shallow.create_infer_request();
+    }
+
+    // VAE decoder compiled for a smaller static shape decodes tiles overlapped by a quarter of tile size
+    ov::PartialShape vae_input_shape = m_models.vae_decoder.input().get_partial_shape();
+    if (vae_input_shape.is_static() &&
+        (vae_input_shape[2] * VAE_SCALE_FACTOR != height || vae_input_shape[3] * VAE_SCALE_FACTOR != width)) {
+        const size_t tile_size = static_cast<size_t>(std::min(vae_input_shape[2].get_length(), vae_input_shape[3].get_length()));
+        m_tiled_vae_decoder.emplace(m_models.vae_decoder, tile_size / 4);
+    }
+}
+
+ov::Tensor StableDiffusionPipeline::_encode_prompts(std::vector<std::string> prompts) {
+    const int32_t EOS_TOKEN_ID = 49407, PAD_TOKEN_ID = EOS_TOKEN_ID;
+    const ov::Shape input_ids_shape({prompts.size(), TOKENIZER_MODEL_MAX_LENGTH});
+
+    ov::Tensor input_ids(ov::element::i32, input_ids_shape);
+    std::fill_n(input_ids.data<int32_t>(), input_ids.get_size(), PAD_TOKEN_ID);
+
+    // tokenization, where token ids of shorter prompts are padded to the longest one, so only tokens of attention mask
+    // are copied and padded by PAD_TOKEN_ID
+    m_tokenizer_request.set_input_tensor(ov::Tensor{ov::element::string, {prompts.size()}, prompts.data()});
+    m_tokenizer_request.infer();
+    ov::Tensor input_ids_token = m_tokenizer_request.get_tensor("input_ids");
+    ov::Tensor attention_mask = m_tokenizer_request.get_tensor("attention_mask");
+    const size_t max_num_tokens = input_ids_token.get_shape()[1];
+    for (size_t prompt_idx = 0; prompt_idx < prompts.size(); ++prompt_idx) {
+        const std::int64_t* mask = attention_mask.data<const std::int64_t>() + prompt_idx * max_num_tokens;
+        const size_t num_tokens = std::min<size_t>(std::count(mask, mask + max_num_tokens, 1), TOKENIZER_MODEL_MAX_LENGTH);
+        std::copy_n(input_ids_token.data<const std::int64_t>() + prompt_idx * max_num_tokens, num_tokens,
+                    input_ids.data<std::int32_t>() + prompt_idx * TOKENIZER_MODEL_MAX_LENGTH);
+    }
+
+    // text embeddings
+    const size_t HIDDEN_SIZE = static_cast<size_t>(m_models.text_encoder.output(0).get_partial_shape()[2].get_length());
+    ov::Tensor text_embeddings(ov::element::f32, {prompts.size(), TOKENIZER_MODEL_MAX_LENGTH, HIDDEN_SIZE});
+    m_text_encoder_request.set_tensor("input_ids", input_ids);
+    m_text_encoder_request.set_output_tensor(0, text_embeddings);
+    m_text_encoder_request.infer();
+    return text_embeddings;
+}
+
+ov::Tensor StableDiffusionPipeline::_get_prompt_embedding(const std::string& prompt) {
+    auto embedding_it = std::find_if(m_prompt_embeddings.begin(), m_prompt_embeddings.end(), [&prompt] (const auto& entry) {
+        return entry.first == prompt;
+    });
+    if (embedding_it == m_prompt_embeddings.end())
+        return {};
+    m_prompt_embeddings.splice(m_prompt_embeddings.begin(), m_prompt_embeddings, embedding_it);
+    return m_prompt_embeddings.front().second;
+}
+
+ov::Tensor StableDiffusionPipeline::_text_encoder(const std::vector<std::string>& positive_prompts,
+                                                  const std::string& negative_prompt,
+                                                  size_t num_images_per_prompt) {
+    const size_t HIDDEN_SIZE = static_cast<size_t>(m_models.text_encoder.output(0).get_partial_shape()[2].get_length());
+    const size_t batch_size = positive_prompts.size() * num_images_per_prompt;
+    auto get_embedding = [&] (ov::Tensor& text_embeddings, size_t batch_idx) {
+        return ov::Tensor(text_embeddings, {batch_idx, 0, 0}, {batch_idx + 1, TOKENIZER_MODEL_MAX_LENGTH, HIDDEN_SIZE});
+    };
+
+    // embeddings of prompts, which are not cached, are computed by a single text encoder call
+    std::vector<std::string> prompts = {negative_prompt};
+    prompts.insert(prompts.end(), positive_prompts.begin(), positive_prompts.end());
+    std::vector<std::string> uncached_prompts;
+    for (const std::string& prompt : prompts) {
+        if (!_get_prompt_embedding(prompt) && std::find(uncached_prompts.begin(), uncached_prompts.end(), prompt) == uncached_prompts.end())
+            uncached_prompts.push_back(prompt);
+    }
+    if (!uncached_prompts.empty()) {
+        ov::Tensor uncached_embeddings = _encode_prompts(uncached_prompts);
+        for (size_t prompt_idx = 0; prompt_idx < uncached_prompts.size(); ++prompt_idx) {
+            ov::Tensor embedding(ov::element::f32, {1, TOKENIZER_MODEL_MAX_LENGTH, HIDDEN_SIZE});
+            get_embedding(uncached_embeddings, prompt_idx).copy_to(embedding);
+            m_prompt_embeddings.emplace_front(uncached_prompts[prompt_idx], embedding);
+        }
+    }
+
+    // unconditional embeddings of all images go first, while embeddings of a prompt are repeated for each of its images
+    ov::Tensor text_embeddings(ov::element::f32, {2 * batch_size, TOKENIZER_MODEL_MAX_LENGTH, HIDDEN_SIZE});
+    ov::Tensor embedding = _get_prompt_embedding(negative_prompt);
+    for (size_t batch_idx = 0; batch_idx < batch_size; ++batch_idx)
+        embedding.copy_to(get_embedding(text_embeddings, batch_idx));
+    for (size_t prompt_idx = 0; prompt_idx < positive_prompts.size(); ++prompt_idx) {
+        embedding = _get_prompt_embedding(positive_prompts[prompt_idx]);
+        for (size_t image_idx = 0; image_idx < num_images_per_prompt; ++image_idx)
+            embedding.copy_to(get_embedding(text_embeddings, batch_size + prompt_idx * num_images_per_prompt + image_idx));
+    }
+
+    // the least recently used embeddings are evicted after embeddings of the current prompts are used
+    while (m_prompt_embeddings.size() > std::max(PROMPT_EMBEDDING_CACHE_CAPACITY, prompts.size()))
+        m_prompt_embeddings.pop_back();
+
+    return text_embeddings;
+}
+
+ov::Tensor StableDiffusionPipeline::_unet(ov::Tensor sample, ov::Tensor timestep, ov::Tensor text_embedding_1d, bool use_deep_cache) {
+    // the shallow UNet reuses deep features of the last step computed by the full UNet
+    ov::InferRequest& unet_request = use_deep_cache ? m_unet_shallow_request : m_unet_request;
+    unet_request.set_tensor("sample", sample);
+    unet_request.set_tensor("timestep", timestep);
+    unet_request.set_tensor("encoder_hidden_states", text_embedding_1d);
+    if (use_deep_cache)
+        unet_request.set_tensor(DEEP_FEATURE_NAME, m_unet_request.get_tensor(DEEP_FEATURE_NAME));
+
+    unet_request.infer();
+
+    // the first half of batch is unconditional noise prediction, the second one is text conditioned
+    ov::Tensor noise_pred_tensor = unet_request.get_output_tensor(0);
+    ov::Shape noise_pred_shape = noise_pred_tensor.get_shape();
+    noise_pred_shape[0] /= 2;
+
+    // perform guidance
+    const float guidance_scale = 7.5f;
+    const float* noise_pred_uncond = noise_pred_tensor.data<const float>();
+    const float* noise_pred_text = noise_pred_uncond + ov::shape_size(noise_pred_shape);
+
+    ov::Tensor noisy_residual(noise_pred_tensor.get_element_type(), noise_pred_shape);
+    for (size_t i = 0; i < ov::shape_size(noise_pred_shape); ++i)
+        noisy_residual.data<float>()[i] =
+            noise_pred_uncond[i] + guidance_scale * (noise_pred_text[i] - noise_pred_uncond[i]);
+
+    return noisy_residual;
+}
+
+ov::Tensor StableDiffusionPipeline::_vae_decoder(ov::Tensor sample) {
+    const float coeffs_const{1 / 0.18215};
+    for (size_t i = 0; i < sample.get_size(); ++i)
+        sample.data<float>()[i] *= coeffs_const;
+
+    if (m_tiled_vae_decoder)
+        return m_tiled_vae_decoder->decode(sample);
+
+    m_vae_decoder_request.set_input_tensor(sample);
+    m_vae_decoder_request.infer();
+
+    return m_vae_decoder_request.get_output_tensor();
+}
+
+ov::Tensor StableDiffusionPipeline::_postprocess_image(ov::Tensor decoded_image) {
+    ov::Tensor generated_image(ov::element::u8, decoded_image.get_shape());
+
+    // convert to u8 image
+    const float* decoded_data = decoded_image.data<const float>();
+    std::uint8_t* generated_data = generated_image.data<std::uint8_t>();
+    for (size_t i = 0; i < decoded_image.get_size(); ++i) {
+        generated_data[i] = static_cast<std::uint8_t>(std::clamp(decoded_data[i] * 0.5f + 0.5f, 0.0f, 1.0f) * 255);
+    }
+
+    return generated_image;
+}
+
+void StableDiffusionPipeline::_check_request(const GenerationRequest& request) const {
+    const size_t batch_size = request.positive_prompts.size() * request.num_images_per_prompt;
+    OPENVINO_ASSERT(batch_size > 0, "At least one image must be generated");
+    OPENVINO_ASSERT(request.seeds.size() == batch_size, "Each image requires a seed");
+    const ov::PartialShape sample_shape = m_models.unet.input("sample").get_partial_shape();
+    OPENVINO_ASSERT(sample_shape[0].is_dynamic() || static_cast<size_t>(sample_shape[0].get_length()) == 2 * batch_size,
+                    "UNet is compiled for batch of ", sample_shape[0], " samples, while ", 2 * batch_size, " are required");
+}
+
+ov::Tensor StableDiffusionPipeline::_denoise(const GenerationRequest& request, ov::Tensor text_embeddings) {
+    const size_t batch_size = request.seeds.size();
+    std::shared_ptr<Scheduler> scheduler = std::make_shared<LMSDiscreteScheduler>();
+    scheduler->set_timesteps(request.num_inference_steps);
+    std::vector<std::int64_t> timesteps = scheduler->get_timesteps();
+
+    const size_t unet_in_channels = static_cast<size_t>(m_models.unet.input("sample").get_partial_shape()[1].get_length());
+
+    // latents are multiplied by 'init_noise_sigma'
+    ov::Shape latent_shape = ov::Shape({batch_size, unet_in_channels, m_height / VAE_SCALE_FACTOR, m_width / VAE_SCALE_FACTOR});
+    ov::Shape latent_model_input_shape = latent_shape;
+    ov::Tensor noise = randn_tensor(latent_shape, request.read_np_latent, request.seeds);
+    latent_model_input_shape[0] = 2 * batch_size;  // Unet accepts unconditional and conditional latents
+    ov::Tensor latent(ov::element::f32, latent_shape),
+        latent_model_input(ov::element::f32, latent_model_input_shape);
+    for (size_t i = 0; i < noise.get_size(); ++i) {
+        latent.data<float>()[i] = noise.data<float>()[i] * scheduler->get_init_noise_sigma();
+    }
+
+    for (size_t inference_step = 0; inference_step < request.num_inference_steps; inference_step++) {
+        // concat the same latents twice along a batch dimension
+        latent.copy_to(
+            ov::Tensor(latent_model_input, {0, 0, 0, 0}, {batch_size, latent_shape[1], latent_shape[2], latent_shape[3]}));
+        latent.copy_to(
+            ov::Tensor(latent_model_input, {batch_size, 0, 0, 0}, {2 * batch_size, latent_shape[1], latent_shape[2], latent_shape[3]}));
+
+        scheduler->scale_model_input(latent_model_input, inference_step);
+
+        ov::Tensor timestep(ov::element::i64, {1}, &timesteps[inference_step]);
+        const bool use_deep_cache = m_deep_cache_interval > 1 && inference_step % m_deep_cache_interval != 0;
+        ov::Tensor noisy_residual = _unet(latent_model_input, timestep, text_embeddings, use_deep_cache);
+
+        latent = scheduler->step(noisy_residual, latent, inference_step)["latent"];
+    }
+    return latent;
+}
+
+std::vector<ov::Tensor> StableDiffusionPipeline::_decode(ov::Tensor latent) {
+    // VAE decoder has batch 1, since its activations of a single image are already large
+    std::vector<ov::Tensor> images;
+    ov::Shape image_latent_shape = latent.get_shape();
+    image_latent_shape[0] = 1;
+    for (size_t batch_idx = 0; batch_idx < latent.get_shape()[0]; ++batch_idx) {
+        ov::Tensor image_latent(ov::element::f32, image_latent_shape);
+        std::copy_n(latent.data<const float>() + batch_idx * image_latent.get_size(), image_latent.get_size(), image_latent.data<float>());
+        images.push_back(_postprocess_image(_vae_decoder(image_latent)));
+    }
+    return images;
+}
+
+std::vector<ov::Tensor> StableDiffusionPipeline::generate(const std::vector<std::string>& positive_prompts,
+                                                          const std::string& negative_prompt,
+                                                          size_t num_images_per_prompt,
+                                                          const std::vector<uint32_t>& seeds,
+                                                          size_t num_inference_steps,
+                                                          bool read_np_latent) {
+    const GenerationRequest request{positive_prompts, negative_prompt, num_images_per_prompt, seeds, num_inference_steps, read_np_latent};
+    _check_request(request);
+    ov::Tensor text_embeddings = _text_encoder(positive_prompts, negative_prompt, num_images_per_prompt);
+    return _decode(_denoise(request, text_embeddings));
+}
+
+void StableDiffusionPipeline::generate(const std::vector<GenerationRequest>& requests, const ImagesCallback& callback) {
+    for (const GenerationRequest& request : requests)
+        _check_request(request);
+    if (requests.empty())
+        return;
+
+    // stages of consecutive requests run on their own infer requests: while UNet denoises latents of a request,
+    // prompts of the next request are encoded and images of the previous one are decoded
+    auto encode = [this, &requests] (size_t request_idx) {
+        const GenerationRequest& request = requests[request_idx];
+        return _text_encoder(request.positive_prompts, request.negative_prompt, request.num_images_per_prompt);
+    };
+    std::future<ov::Tensor> text_embeddings = std::async(std::launch::async, encode, 0);
+    std::future<void> decoding;
+    for (size_t request_idx = 0; request_idx < requests.size(); ++request_idx) {
+        ov::Tensor request_text_embeddings = text_embeddings.get();
+        if (request_idx + 1 < requests.size())
+            text_embeddings = std::async(std::launch::async, encode, request_idx + 1);
+
+        ov::Tensor latent = _denoise(requests[request_idx], request_text_embeddings);
+
+        // VAE decoder request is reused, so decoding of the previous request must be finished
+        if (decoding.valid())
+            decoding.get();
+        decoding = std::async(std::launch::async, [this, &callback, request_idx, latent] () {
+            callback(request_idx, _decode(latent));
+        });
+    }
+    decoding.get();
+}
@@ -0,0 +1,194 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "openvino/runtime/compiled_model.hpp"
+#include "openvino/runtime/infer_request.hpp"
+#include "tiled_vae_decoder.hpp"
+
+const size_t VAE_SCALE_FACTOR = 8;
+
+class Timer {
+    const decltype(std::chrono::steady_clock::now()) m_start;
+
+public:
+    Timer(const std::string& scope) : m_start(std::chrono::steady_clock::now()) {
+        (std::cout << scope << ": ").flush();
+    }
+
+    ~Timer() {
+        auto m_end = std::chrono::steady_clock::now();
+        std::cout << std::chrono::duration<double, std::milli>(m_end - m_start).count() << " ms" << std::endl;
+    }
+};
+
+struct StableDiffusionModels {
+    ov::CompiledModel text_encoder;
+    ov::CompiledModel unet;
+    ov::CompiledModel vae_decoder;
+    ov::CompiledModel tokenizer;
+    // UNet without deep blocks, which takes their features computed by 'unet' at a previous step (DeepCache)
+    ov::CompiledModel unet_shallow;
+};
+
+// latents [batch, C, H, W], where latent of batch_idx is generated from seeds[batch_idx]
+ov::Tensor randn_tensor(ov::Shape shape, bool use_np_latents, const std::vector<uint32_t>& seeds);
+
+// 'batch_size' is the number of images generated by a UNet call, i.e. number of prompts * images per prompt;
+// VAE decoder is compiled for tiles of 'vae_tile_size' x 'vae_tile_size' pixels if it's not 0 or for the whole image;
+// 'deep_cache' additionally compiles the shallow UNet, while the full one also returns features of deep blocks
+StableDiffusionModels compile_models(const std::string& model_path,
+                                     const std::string& device,
+                                     const std::string& lora_path,
+                                     const float alpha,
+                                     const bool switch_lora,
+                                     const bool use_cache,
+                                     const bool use_dynamic_shapes,
+                                     const size_t batch_size,
+                                     const size_t height,
+                                     const size_t width,
+                                     const size_t vae_tile_size = 0,
+                                     const bool deep_cache = false);
+
+// models compiled for static shapes of each requested resolution and LoRA adapter, so requests of mixed resolutions
+// compile models once instead of each request; models are compiled on the first use with ov::cache_dir,
+// so models of an evicted or a previous process' resolution are loaded from the disk cache instead of compilation
+class StableDiffusionModelCache {
+public:
+    // the least recently used models are evicted over 'capacity' entries; each entry keeps its own copy of weights,
+    // which dominate memory of compiled models, so 'capacity' bounds memory of the cache
+    StableDiffusionModelCache(std::string model_path, std::string device, size_t capacity = 4, bool use_cache = true);
+
+    // thread-safe, models of different keys are compiled concurrently, while requests of the same key wait for
+    // a single compilation; 'alpha' is ignored without 'lora_path' or with 'switch_lora', which sets it to requests
+    StableDiffusionModels get(size_t batch_size,
+                              size_t height,
+                              size_t width,
+                              const std::string& lora_path = "",
+                              float alpha = 0.75f,
+                              bool switch_lora = false,
+                              size_t vae_tile_size = 0,
+                              bool deep_cache = false);
+
+private:
+    struct Key {
+        size_t batch_size;
+        size_t height;
+        size_t width;
+        std::string lora_path;
+        float alpha;
+        bool switch_lora;
+        size_t vae_tile_size;
+        bool deep_cache;
+
+        bool operator==(const Key& other) const = default;
+    };
+
+    std::string m_model_path;
+    std::string m_device;
+    size_t m_capacity;
+    bool m_use_cache;
+    std::mutex m_mutex;
+    // the most recently used models at first; models are ready once the future is set by the compiling request
+    std::list<std::pair<Key, std::shared_future<StableDiffusionModels>>> m_models;
+};
+
+// images of 'num_images_per_prompt' for each of 'positive_prompts' generated by the same UNet calls;
+// latent of i-th image is generated from seeds[i]
+struct GenerationRequest {
+    std::vector<std::string> positive_prompts;
+    std::string negative_prompt = " ";
+    size_t num_images_per_prompt = 1;
+    std::vector<uint32_t> seeds;
+    size_t num_inference_steps = 20;
+    bool read_np_latent = false;
+};
+
+// Text-to-image pipeline, which generates images of several prompts at once: every UNet call processes a batch of
+// 2 * N * M latents for M images of each of N prompts, where the first half of batch is unconditional and the second
+// one is conditioned by prompts (classifier-free guidance)
+class StableDiffusionPipeline {
+public:
+    // with 'deep_cache_interval' > 1 the full UNet runs every 'deep_cache_interval' steps, while the shallow one
+    // reuses its deep features at the rest of steps (https://arxiv.org/abs/2312.00858)
+    StableDiffusionPipeline(StableDiffusionModels models, size_t height, size_t width, size_t deep_cache_interval = 0);
+
+    // returns u8 NHWC images: 'num_images_per_prompt' images of the first prompt, then of the second one, etc.;
+    // latent of i-th image is generated from seeds[i]
+    std::vector<ov::Tensor> generate(const std::vector<std::string>& positive_prompts,
+                                     const std::string& negative_prompt,
+                                     size_t num_images_per_prompt,
+                                     const std::vector<uint32_t>& seeds,
+                                     size_t num_inference_steps,
+                                     bool read_np_latent = false);
+
+    // called with index of request and its images
+    using ImagesCallback = std::function<void(size_t, std::vector<ov::Tensor>)>;
+
+    // generates images of a queue of requests, where text encoding of the next request and VAE decoding of the previous
+    // one overlap with denoising of the current request, so UNet runs without waiting for other stages; 'callback' is
+    // called from a decoding thread in order of requests
+    void generate(const std::vector<GenerationRequest>& requests, const ImagesCallback& callback);
+
+    // infer requests of stages of generation, e.g. to set LoRA adapters (see LoRAAdapterCache);
+    // cached prompt embeddings are dropped, since the text encoder request may be changed
+    ov::InferRequest& get_text_encoder_request() {
+        m_prompt_embeddings.clear();
+        return m_text_encoder_request;
+    }
+
+    ov::InferRequest& get_unet_request() {
+        return m_unet_request;
+    }
+
+private:
+    // embeddings [N, 77, H] of N prompts
+    ov::Tensor _encode_prompts(std::vector<std::string> prompts);
+
+    // cached embedding [1, 77, H] of 'prompt', which becomes the most recently used one, or empty tensor
+    ov::Tensor _get_prompt_embedding(const std::string& prompt);
+
+    ov::Tensor _text_encoder(const std::vector<std::string>& positive_prompts, const std::string& negative_prompt, size_t num_images_per_prompt);
+
+    ov::Tensor _unet(ov::Tensor sample, ov::Tensor timestep, ov::Tensor text_embedding_1d, bool use_deep_cache);
+
+    ov::Tensor _vae_decoder(ov::Tensor sample);
+
+    void _check_request(const GenerationRequest& request) const;
+
+    // denoising loop, which returns latents of images
+    ov::Tensor _denoise(const GenerationRequest& request, ov::Tensor text_embeddings);
+
+    std::vector<ov::Tensor> _decode(ov::Tensor latent);
+
+    static ov::Tensor _postprocess_image(ov::Tensor decoded_image);
+
+    StableDiffusionModels m_models;
+    size_t m_height;
+    size_t m_width;
+    size_t m_deep_cache_interval;
+    ov::InferRequest m_tokenizer_request;
+    ov::InferRequest m_text_encoder_request;
+    ov::InferRequest m_unet_request;
+    ov::InferRequest m_unet_shallow_request;
+    ov::InferRequest m_vae_decoder_request;
+    // decoder of images larger than VAE decoder input, which is compiled for tiles
+    std::optional<TiledVAEDecoder> m_tiled_vae_decoder;
+
+    // embeddings of repeated prompts (e.g. the same negative prompt of all requests) are computed once;
+    // prompt => embedding, the most recently used at first
+    static constexpr size_t PROMPT_EMBEDDING_CACHE_CAPACITY = 64;
+    std::list<std::pair<std::string, ov::Tensor>> m_prompt_embeddings;
+};
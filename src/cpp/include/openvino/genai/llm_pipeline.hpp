@@ -224,5 +224,31 @@ private:
 std::pair<std::string, Any> streamer(StreamerVariant func);
 std::pair<std::string, Any> generation_config(const GenerationConfig& config);
 
+/**
+* @brief plugin_config property, which makes LLMPipeline use continuous batching backend (paged attention and
+* dynamic batching): prompts of a batch are scheduled independently instead of being padded to a common length.
+* Chat mode is not supported by this backend.
+*/
+static constexpr ov::Property<bool> continuous_batching{"continuous_batching"};
+
+/**
+* @brief plugin_config property: KV cache size of continuous batching backend in GB, 1 by default.
+*/
+static constexpr ov::Property<size_t> kv_cache_size{"kv_cache_size"};
+
+/**
+* @brief plugin_config property: directory to store KV cache of finished conversations on disk, so a later conversation
+* starting with a stored one, also after restart of the application, skips computation of its prefix. Stateful pipeline
+* stores a chat conversation when it's finished (finish_chat() or start_chat() of a new one), continuous batching backend
+* stores every finished request. Files are kept across runs, so the directory must be used with the same model only.
+*/
+static constexpr ov::Property<std::string> session_cache_dir{"session_cache_dir"};
+
+/**
+* @brief plugin_config property: max number of conversations stored by stateful pipeline in session_cache_dir, 64 by
+* default; the least recently stored or restored ones are removed first.
+*/
+static constexpr ov::Property<size_t> session_cache_capacity{"session_cache_capacity"};
+
 }  // namespace genai
 }  // namespace ov
@@ -8,6 +8,14 @@
 namespace ov {
 namespace genai {
 
+/// @brief a token generated for one of sequences, which are generated at once
+struct StreamedToken {
+    /// @brief index of a sequence in results of generate(): for a batch of prompts the sequences of
+    /// the i-th prompt have indices [i * num_return_sequences, (i + 1) * num_return_sequences)
+    size_t sequence_idx;
+    int64_t token;
+};
+
 /** 
  * @brief base class for streamers. In order to use inherit from from this class and inplement put, and methods
  * 
@@ -22,6 +30,20 @@ public:
     /// @brief end is called at the end of generation. It can be used to flush cache if your own streamer has one
     virtual void end() = 0;
 
+    /// @brief put_batch is called every time new tokens of several sequences are generated, e.g. for a batch of prompts.
+    /// Several tokens of a sequence can be passed at once, they are in order of generation. By default tokens
+    /// of the first sequence are passed to put(), so streamers of a single sequence can be used with batches.
+    /// @param tokens new tokens of sequences, which are still streamed
+    /// @param stopped_sequences indices of sequences, which generation should be stopped, are appended to it
+    /// @return bool flag to indicate whether generation of all sequences should be stopped
+    virtual bool put_batch(const std::vector<StreamedToken>& tokens, std::vector<size_t>& stopped_sequences) {
+        for (const StreamedToken& streamed_token : tokens) {
+            if (streamed_token.sequence_idx == 0 && put(streamed_token.token))
+                return true;
+        }
+        return false;
+    }
+
     virtual ~StreamerBase() = default;
 };
 
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <filesystem>
 #include <string>
 #include <vector>
@@ -45,6 +46,21 @@ public:
     TokenizedInputs encode(std::vector<std::string>& prompts);
     TokenizedInputs encode(std::vector<std::string>&& prompts);
     TokenizedInputs encode(std::initializer_list<std::string>& prompts);
+
+    /**
+    * @brief encode a single prompt together with prompts passed by other threads within the batching window.
+    * The first caller waits for batching_window and encodes all collected prompts with a single inference.
+    * @param prompt prompt to encode
+    * @param batching_window time to wait for prompts of other threads
+    * @return pair of [input_ids, attention_mask] without padding
+    */
+    TokenizedInputs encode(const std::string prompt, std::chrono::microseconds batching_window);
+
+    /**
+    * @brief enable LRU cache of single prompts encoding results, e.g. for repeated system prompts.
+    * @param capacity_bytes memory limit of cached prompts and their tokens, 0 disables the cache (default)
+    */
+    void set_cache_capacity(size_t capacity_bytes);
     
     /**
     * @brief decode sequence of tokens
@@ -1,6 +1,9 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+#include <numeric>
+
 #include "openvino/genai/llm_pipeline.hpp"
 #include "utils.hpp"
 
@@ -8,11 +11,11 @@ namespace ov {
 namespace genai {
 
 EncodedResults greedy_decoding(
-    ov::InferRequest& m_model_runner, 
-    ov::Tensor input_ids, 
-    ov::Tensor attention_mask, 
-    const ov::genai::GenerationConfig generation_config, 
-    const std::shared_ptr<StreamerBase> streamer, 
+    ov::InferRequest& m_model_runner,
+    ov::Tensor input_ids,
+    ov::Tensor attention_mask,
+    const ov::genai::GenerationConfig generation_config,
+    const std::shared_ptr<StreamerBase> streamer,
     const bool is_chat_conversation,
     const bool is_cache_empty
 ) {
@@ -20,7 +23,7 @@ EncodedResults greedy_decoding(
     const size_t batch_size = prompts_shape[0];
     size_t running_batch_size = batch_size;
     size_t prompt_len = prompts_shape[1];
-       
+
     auto num_inputs = m_model_runner.get_compiled_model().inputs().size();
     bool position_ids_available = num_inputs == 4;
     ov::Tensor position_ids;
@@ -29,118 +32,125 @@ EncodedResults greedy_decoding(
     results.scores.resize(running_batch_size);
     results.tokens.resize(running_batch_size);
     std::fill(results.scores.begin(), results.scores.end(), 0);
-    
+
     int64_t kv_cache_len = 0;
+    ov::Tensor atten_mask_history;
     if (is_chat_conversation && !is_cache_empty) {
         OPENVINO_ASSERT(batch_size == 1, "continuation of generation is possible only for batch 1");
-        
+
         // between subsequent runs attention_mask should not be modified
-        auto atten_mask_history = m_model_runner.get_tensor("attention_mask");
+        atten_mask_history = m_model_runner.get_tensor("attention_mask");
         kv_cache_len = atten_mask_history.get_shape()[1];
-
-        size_t prompt_len = attention_mask.get_shape()[1];
-        ov::Tensor new_atten_mask =  ov::Tensor{ov::element::i64, {batch_size, kv_cache_len + prompt_len}};
-
-        std::copy(atten_mask_history.data<int64_t>(), atten_mask_history.data<int64_t>() + kv_cache_len,
-                  new_atten_mask.data<int64_t>());
-        std::copy(attention_mask.data<int64_t>(), attention_mask.data<int64_t>() + prompt_len,
-                  new_atten_mask.data<int64_t>() + kv_cache_len);
-
-        m_model_runner.set_tensor("attention_mask", new_atten_mask);
     } else if (!is_cache_empty) {
         OPENVINO_THROW("KV cache contains initial values but generate is run not in chat scenario. "
                         "Initial KV cache can contain values only if start_chat() is called.");
-    } else {
-        m_model_runner.set_tensor("attention_mask", attention_mask);
     }
+    utils::AttentionMaskBuffer atten_mask_buffer(atten_mask_history, attention_mask);
+    m_model_runner.set_tensor("attention_mask", atten_mask_buffer.get_tensor());
 
     if (position_ids_available) {
         position_ids = ov::Tensor{ov::element::i64, input_ids.get_shape()};
         utils::initialize_position_ids(position_ids, attention_mask, kv_cache_len);
     }
-    
+
     m_model_runner.set_tensor("input_ids", input_ids);
     if (position_ids_available)
         m_model_runner.set_tensor("position_ids", position_ids);
 
-    m_model_runner.get_tensor("beam_idx").set_shape({running_batch_size});
-    auto beam_data = m_model_runner.get_tensor("beam_idx").data<int32_t>();
-    std::iota(beam_data, beam_data + running_batch_size, 0);
-
-    m_model_runner.infer();
-    auto logits = m_model_runner.get_tensor("logits");
-    ov::Shape logits_shape = logits.get_shape();
-    size_t seq_len = logits_shape[1], vocab_size = logits_shape[2];
-    m_model_runner.get_tensor("input_ids").set_shape({running_batch_size, 1});
-
-    std::vector<int64_t> token_iter_results(running_batch_size);  // results of a single infer request
-    std::vector<int> eos_met(running_batch_size, 0);  // use int because can not use std::all_of with vector<bool>
-    for (size_t batch = 0; batch < running_batch_size; ++batch) {
-        auto out_token = utils::argmax(logits, batch);
-        results.tokens[batch].emplace_back(out_token);
-
-        token_iter_results[batch] = out_token;
-        eos_met[batch] = (out_token == generation_config.eos_token_id);
-        m_model_runner.get_tensor("input_ids").data<int64_t>()[batch] = out_token;
-    }
-    if (streamer && streamer->put(token_iter_results[0])) {
-        return results;
+    // Inputs of generation steps are allocated once: finished sequences are removed from the batch, so these
+    // tensors are only shrunk, while running rows are packed to the beginning (in-flight batch compaction)
+    ov::Tensor next_input_ids{ov::element::i64, {batch_size, 1}};
+    ov::Tensor next_position_ids{ov::element::i64, {batch_size, 1}};
+    ov::Tensor beam_idx{ov::element::i32, {batch_size}};
+    std::iota(beam_idx.data<int32_t>(), beam_idx.data<int32_t>() + batch_size, 0);
+    m_model_runner.set_tensor("beam_idx", beam_idx);
+
+    // row of running sequence => its index in the initial batch
+    std::vector<size_t> batch_indices(batch_size);
+    std::iota(batch_indices.begin(), batch_indices.end(), 0);
+    // position of the next token of each running sequence
+    std::vector<int64_t> positions(batch_size);
+    for (size_t batch = 0; batch < batch_size; ++batch) {
+        const int64_t* mask_data = attention_mask.data<const int64_t>() + batch * prompt_len;
+        positions[batch] = kv_cache_len + std::accumulate(mask_data, mask_data + prompt_len, int64_t{0});
     }
 
-    bool all_are_eos = std::all_of(eos_met.begin(), eos_met.end(), [](int elem) { return elem == 1; });
-    if (!generation_config.ignore_eos && all_are_eos)
-        return results;
-    
     size_t max_tokens = generation_config.get_max_new_tokens(prompt_len);
-    for (size_t i = 0; i < max_tokens - 1; ++i) {
-        if (position_ids_available)
-            utils::update_position_ids(m_model_runner.get_tensor("position_ids"), m_model_runner.get_tensor("attention_mask"));
-        m_model_runner.set_tensor("attention_mask", utils::extend_attention(m_model_runner.get_tensor("attention_mask")));
-
+    std::vector<int32_t> running_rows;
+    std::vector<StreamedToken> streamed_tokens;
+    std::vector<size_t> stopped_sequences;
+    size_t num_generated_tokens = 0;
+    bool is_stopped_by_streamer = false;
+    while (true) {
         m_model_runner.infer();
         auto logits = m_model_runner.get_tensor("logits");
-        ov::Shape logits_shape = logits.get_shape();
-        size_t seq_len = logits_shape[1], vocab_size = logits_shape[2];
-        
-        std::vector<int64_t> token_iter_results(running_batch_size);  // results of a single infer request
-        std::vector<int> eos_met(running_batch_size, 0);  // use int because can not use std::all_of with vector<bool>
-        for (size_t batch = 0; batch < running_batch_size; ++batch) {
-            auto out_token = ov::genai::utils::argmax(logits, batch);
-            results.tokens[batch].emplace_back(out_token);
-
-            token_iter_results[batch] = out_token;
-            eos_met[batch] = (out_token == generation_config.eos_token_id);
-            
-            m_model_runner.get_tensor("input_ids").data<int64_t>()[batch] = out_token;
+
+        streamed_tokens.clear();
+        int64_t* next_input_ids_data = next_input_ids.data<int64_t>();
+        for (size_t row = 0; row < running_batch_size; ++row) {
+            auto out_token = utils::argmax(logits, row);
+            results.tokens[batch_indices[row]].emplace_back(out_token);
+            next_input_ids_data[row] = out_token;
+            streamed_tokens.push_back({batch_indices[row], out_token});
         }
+        ++num_generated_tokens;
 
-        if (streamer && streamer->put(token_iter_results[0]))
-            return results;
+        stopped_sequences.clear();
+        if (streamer && streamer->put_batch(streamed_tokens, stopped_sequences)) {
+            is_stopped_by_streamer = true;
+            break;
+        }
 
-        if (generation_config.ignore_eos)
-            continue;
-        
+        // sequences stopped by streamer are filtered out as the ones which met eos
+        running_rows.clear();
+        for (size_t row = 0; row < running_batch_size; ++row) {
+            const bool is_eos = !generation_config.ignore_eos && next_input_ids_data[row] == generation_config.eos_token_id;
+            const bool is_stopped = std::find(stopped_sequences.begin(), stopped_sequences.end(), batch_indices[row]) != stopped_sequences.end();
+            if (!is_eos && !is_stopped)
+                running_rows.push_back(row);
+        }
         // stop generation when EOS is met in all batches
-        bool all_are_eos = std::all_of(eos_met.begin(), eos_met.end(), [](int elem) { return elem == 1; });
-        if (all_are_eos)
+        if (running_rows.empty() || num_generated_tokens >= max_tokens)
             break;
 
         // Filter out batches where eos is met
-        std::vector<int32_t> beam_idx(running_batch_size);
-        std::iota(beam_idx.begin(), beam_idx.end(), 0);
-        auto end_it = std::remove_if(beam_idx.begin(), beam_idx.end(), [&eos_met](int idx) { return eos_met[idx]; });
-        beam_idx.erase(end_it, beam_idx.end());  // Remove the eos met indices
-
-        m_model_runner.get_tensor("beam_idx").set_shape({beam_idx.size()});
-        auto beam_data = m_model_runner.get_tensor("beam_idx").data<int32_t>();
-        std::copy(beam_idx.begin(), beam_idx.end(), beam_data);
-        running_batch_size = beam_idx.size();
+        if (running_rows.size() < running_batch_size) {
+            for (size_t row = 0; row < running_rows.size(); ++row) {
+                next_input_ids_data[row] = next_input_ids_data[running_rows[row]];
+                batch_indices[row] = batch_indices[running_rows[row]];
+                positions[row] = positions[running_rows[row]];
+            }
+            atten_mask_buffer.compact(running_rows);
+            running_batch_size = running_rows.size();
+            batch_indices.resize(running_batch_size);
+            positions.resize(running_batch_size);
+        }
+        // beam_idx selects KV cache rows of running sequences, they are the same rows after the first step
+        beam_idx.set_shape({running_batch_size});
+        std::copy(running_rows.begin(), running_rows.end(), beam_idx.data<int32_t>());
+
+        next_input_ids.set_shape({running_batch_size, 1});
+        m_model_runner.set_tensor("input_ids", next_input_ids);
+        if (position_ids_available) {
+            next_position_ids.set_shape({running_batch_size, 1});
+            std::copy(positions.begin(), positions.end(), next_position_ids.data<int64_t>());
+            m_model_runner.set_tensor("position_ids", next_position_ids);
+        }
+        for (int64_t& position : positions)
+            ++position;
+        atten_mask_buffer.extend();
+        m_model_runner.set_tensor("attention_mask", atten_mask_buffer.get_tensor());
+        m_model_runner.set_tensor("beam_idx", beam_idx);
     }
-    if (streamer) {
+
+    // attention mask is kept by model runner as KV cache history of chat, so it must not refer to the buffer
+    m_model_runner.set_tensor("attention_mask", atten_mask_buffer.get_tensor_copy());
+
+    if (streamer && !is_stopped_by_streamer) {
         streamer->end();
     }
     return results;
 }
 
 }  //namespace genai
-}  //namespace ov
\ No newline at end of file
+}  //namespace ov
@@ -1,6 +1,9 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <unordered_map>
+
+#include <openvino/core/parallel.hpp>
 #include <openvino/runtime/tensor.hpp>
 
 #include "openvino/genai/llm_pipeline.hpp"
@@ -8,77 +11,130 @@
 
 namespace {
 
-// Modifyed Knuth–Morris–Pratt algorithm which returns tokens following after every needle occurance in haystack
-std::vector<int64_t> kmp_search(const std::vector<int64_t>& haystack, const std::vector<int64_t>& needle) {
-    if (needle.empty()) {  // no_repeat_ngram_size == 1, ban every token
-        return {haystack.begin(), haystack.end()};
+struct Token {
+    float log_prob;
+    int64_t idx;
+};
+
+bool greater_log_prob(const Token& left, const Token& right) {
+    return left.log_prob > right.log_prob;
+}
+
+// Log-sum-exp of a row of logits and its most probable tokens. Both are computed in a single pass over the vocab,
+// so neither log-probabilities of the whole vocab are materialized nor the vocab is sorted
+struct RowCandidates {
+    const float* logits = nullptr;
+    // log-probability of a token is its logit minus the normalizer
+    float log_normalizer = 0.0f;
+    // the most probable tokens with their log-probabilities, most probable tokens in front
+    std::vector<Token> top;
+    // the number of top tokens, which are requested by beams of the row at the current step
+    size_t num_top = 0;
+
+    float log_prob(int64_t idx) const {
+        return logits[idx] - log_normalizer;
     }
-    std::vector<int> partial_match_table(needle.size() + 1, -1);
-    int cnd = 0;
-    for (size_t pos = 1; pos < needle.size(); ++pos) {
-        if (needle.at(pos) == needle.at(size_t(cnd))) {
-            partial_match_table.at(pos) = partial_match_table.at(size_t(cnd));
-        } else {
-            partial_match_table.at(pos) = cnd;
-            while (cnd >= 0 && needle.at(pos) != needle.at(size_t(cnd))) {
-                cnd = partial_match_table.at(size_t(cnd));
+
+    void compute(const float* row_logits, size_t vocab_size) {
+        logits = row_logits;
+        num_top = std::min(num_top, vocab_size);
+        top.resize(num_top);
+        // online log-sum-exp: the sum of exponents is rescaled whenever the maximum is updated
+        float max_logit = logits[0], exp_sum = 0.0f;
+        for (size_t idx = 0; idx < num_top; ++idx) {
+            const float logit = logits[idx];
+            if (logit > max_logit) {
+                exp_sum = exp_sum * std::exp(max_logit - logit) + 1.0f;
+                max_logit = logit;
+            } else {
+                exp_sum += std::exp(logit - max_logit);
             }
+            top[idx] = {logit, int64_t(idx)};
         }
-        ++cnd;
-    }
-    partial_match_table.back() = cnd;
-    std::vector<int64_t> res;
-    size_t haystack_id = 0;
-    int needle_id = 0;
-    while (haystack_id < haystack.size() - 1) {
-        if (needle.at(size_t(needle_id)) == haystack.at(haystack_id)) {
-            ++haystack_id;
-            ++needle_id;
-            if (needle_id == int(needle.size())) {
-                res.push_back(haystack.at(haystack_id));
-                needle_id = partial_match_table.at(size_t(needle_id));
+        // min-heap of the best tokens, the worst of them is the first
+        std::make_heap(top.begin(), top.end(), greater_log_prob);
+        for (size_t idx = num_top; idx < vocab_size; ++idx) {
+            const float logit = logits[idx];
+            if (logit > max_logit) {
+                exp_sum = exp_sum * std::exp(max_logit - logit) + 1.0f;
+                max_logit = logit;
+            } else {
+                exp_sum += std::exp(logit - max_logit);
             }
-        } else {
-            needle_id = partial_match_table.at(size_t(needle_id));
-            if (needle_id < 0) {
-                ++haystack_id;
-                ++needle_id;
+            if (logit > top.front().log_prob) {
+                std::pop_heap(top.begin(), top.end(), greater_log_prob);
+                top.back() = {logit, int64_t(idx)};
+                std::push_heap(top.begin(), top.end(), greater_log_prob);
             }
         }
+        std::sort_heap(top.begin(), top.end(), greater_log_prob);
+        log_normalizer = max_logit + std::log(exp_sum);
+        for (Token& token : top) {
+            token.log_prob -= log_normalizer;
+        }
     }
-    return res;
+};
+
+// Positions of tokens following every (no_repeat_ngram_size - 1)-gram of prompt and generated tokens, keyed by
+// the hash of the (n - 1)-gram. It's updated with every generated token, so the history is not searched again
+using NgramIndex = std::unordered_map<uint64_t, std::vector<size_t>>;
+
+// a token of prompt continued by generated tokens
+int64_t text_token(const std::vector<int64_t>& prompt, const std::vector<int64_t>& tokens, size_t pos) {
+    return pos < prompt.size() ? prompt[pos] : tokens[pos - prompt.size()];
 }
 
-struct Token {
-    float log_prob;
-    int64_t idx;
-};
+uint64_t ngram_hash(const std::vector<int64_t>& prompt, const std::vector<int64_t>& tokens, size_t first, size_t length) {
+    uint64_t hash = length;
+    for (size_t pos = first; pos < first + length; ++pos) {
+        hash ^= uint64_t(text_token(prompt, tokens, pos)) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
 
-std::vector<Token> log_softmax(const ov::Tensor& logits, const size_t batch_idx) {
-    if (logits.get_shape().at(0) <= batch_idx) {
-        throw std::runtime_error("logits batch size doesn't match the number of beams");
+// registers the n-gram, which ends with a token at pos
+void index_ngram(NgramIndex& ngrams, const std::vector<int64_t>& prompt, const std::vector<int64_t>& tokens,
+                 size_t pos, size_t ngram_size) {
+    if (pos + 1 < ngram_size) {
+        return;
     }
-    size_t vocab_size = logits.get_shape().back();
-    size_t batch_offset = batch_idx * logits.get_shape().at(1) * vocab_size;
-    size_t sequence_offset = (logits.get_shape().at(1) - 1) * vocab_size;
-    const float* beam_logits = logits.data<const float>() + batch_offset + sequence_offset;
-    float max_logit = *std::max_element(beam_logits, beam_logits + vocab_size);
-    float log_sum = std::log(
-        std::accumulate(beam_logits, beam_logits + vocab_size, 0.0f, [max_logit](float accumulated, float to_add) {
-            return accumulated + std::exp(to_add - max_logit);
-        }));
-    std::vector<Token> tokens;
-    tokens.reserve(vocab_size);
-    for (size_t idx = 0; idx < vocab_size; ++idx) {
-        tokens.push_back({beam_logits[idx] - max_logit - log_sum, int64_t(idx)});
+    ngrams[ngram_hash(prompt, tokens, pos + 1 - ngram_size, ngram_size - 1)].push_back(pos);
+}
+
+// tokens, which would repeat an n-gram met in the text, if they are appended to it
+void get_banned_tokens(const NgramIndex& ngrams, const std::vector<int64_t>& prompt, const std::vector<int64_t>& tokens,
+                       size_t ngram_size, std::vector<int64_t>& banned_tokens) {
+    const size_t text_len = prompt.size() + tokens.size();
+    if (text_len <= 1 || text_len < ngram_size) {
+        return;
+    }
+    const size_t tail_start = text_len + 1 - ngram_size;
+    auto positions = ngrams.find(ngram_hash(prompt, tokens, tail_start, ngram_size - 1));
+    if (positions == ngrams.end()) {
+        return;
+    }
+    for (size_t pos : positions->second) {
+        // hashes can collide, so n-grams are compared
+        const size_t first = pos + 1 - ngram_size;
+        bool is_equal = true;
+        for (size_t offset = 0; offset + 1 < ngram_size && is_equal; ++offset) {
+            is_equal = text_token(prompt, tokens, first + offset) == text_token(prompt, tokens, tail_start + offset);
+        }
+        if (is_equal) {
+            banned_tokens.push_back(text_token(prompt, tokens, pos));
+        }
     }
-    return tokens;
 }
 
 struct Beam {
     float score = -std::numeric_limits<float>::infinity();  // The bigger, the better
     std::vector<int64_t> tokens;
     size_t global_beam_idx = 0;
+    // n-grams of the prompt are shared by all beams, so beams copy only n-grams ending with generated tokens
+    std::shared_ptr<const NgramIndex> prompt_ngrams;
+    NgramIndex ngrams;
+    // tokens, which are banned for the next step by no_repeat_ngram_size
+    std::vector<int64_t> banned_tokens;
 };
 
 bool greater(const Beam& left, const Beam& right) {
@@ -95,10 +151,13 @@ struct Parameters {
     ov::genai::StopCriteria stop_criteria = ov::genai::StopCriteria::HEURISTIC;
     float length_penalty = 1.0;
     size_t no_repeat_ngram_size = std::numeric_limits<size_t>::max();
+};
 
-    std::function<bool(const Beam&)> early_finish = [](const Beam&) {
-        return false;
-    };
+// continuation of an ongoing beam of a group with a token
+struct Candidate {
+    float score;
+    size_t beam_idx;
+    int64_t token;
 };
 
 struct Group {
@@ -150,16 +209,26 @@ struct Group {
 struct GroupBeamSearcher {
     Parameters parameters;
     std::vector<std::vector<Group>> prompts_groups;
+    // candidates of logits rows of the current step, which are indexed by global_beam_idx
+    std::vector<RowCandidates> rows;
 
     GroupBeamSearcher(Parameters parameters) : parameters{parameters}, prompts_groups{parameters.prompts.size()} {
         if (parameters.no_repeat_ngram_size == 0) {
             throw std::runtime_error("no_repeat_ngram_size must be positive");
         }
-        for (std::vector<Group>& prompts_groups : prompts_groups) {
-            prompts_groups.resize(parameters.n_groups);
-            for (Group& group : prompts_groups) {
+        for (size_t prompt_id = 0; prompt_id < prompts_groups.size(); ++prompt_id) {
+            const std::vector<int64_t>& prompt = parameters.prompts[prompt_id];
+            auto prompt_ngrams = std::make_shared<NgramIndex>();
+            for (size_t pos = 0; pos < prompt.size(); ++pos) {
+                index_ngram(*prompt_ngrams, prompt, {}, pos, parameters.no_repeat_ngram_size);
+            }
+            prompts_groups[prompt_id].resize(parameters.n_groups);
+            for (Group& group : prompts_groups[prompt_id]) {
                 group.ongoing.resize(parameters.group_size);
                 group.ongoing.front().score = 0.0;
+                for (Beam& beam : group.ongoing) {
+                    beam.prompt_ngrams = prompt_ngrams;
+                }
             }
         }
     }
@@ -173,6 +242,12 @@ struct GroupBeamSearcher {
         next_tokens.reserve(promts_size * parameters.n_groups * parameters.group_size);
         next_beams.reserve(promts_size * parameters.n_groups * parameters.group_size);
 
+        const size_t num_rows = logits.get_shape().at(0);
+        rows.resize(num_rows);
+        for (RowCandidates& row : rows) {
+            row.num_top = 0;
+        }
+
         size_t beam_count = 0;
         size_t prompt_id = 0;
         for (std::vector<Group>& groups : prompts_groups) {
@@ -189,16 +264,40 @@ struct GroupBeamSearcher {
                         beam.global_beam_idx = beam_count;
                         ++beam_count;
                     }
+                    if (num_rows <= beam.global_beam_idx) {
+                        throw std::runtime_error("logits batch size doesn't match the number of beams");
+                    }
+                    beam.banned_tokens.clear();
+                    get_banned_tokens(*beam.prompt_ngrams, parameters.prompts[prompt_id], beam.tokens,
+                                      parameters.no_repeat_ngram_size, beam.banned_tokens);
+                    get_banned_tokens(beam.ngrams, parameters.prompts[prompt_id], beam.tokens,
+                                      parameters.no_repeat_ngram_size, beam.banned_tokens);
+                    // 2 * group_size tokens of a beam are selected among the best tokens of its row, which aren't
+                    // penalized by diversity of previous groups and no_repeat_ngram_size
+                    const size_t num_penalized = (parameters.n_groups - 1) * parameters.group_size + beam.banned_tokens.size();
+                    RowCandidates& row = rows[beam.global_beam_idx];
+                    row.num_top = std::max(row.num_top, 2 * parameters.group_size + num_penalized);
                 }
             }
 
             prompt_id += 1;
         }
 
+        // rows are independent, so they are processed in parallel
+        const size_t vocab_size = logits.get_shape().back();
+        const size_t row_size = logits.get_shape().at(1) * vocab_size;
+        const size_t sequence_offset = (logits.get_shape().at(1) - 1) * vocab_size;
+        const float* logits_data = logits.data<const float>();
+        ov::parallel_for(num_rows, [&](size_t row_idx) {
+            if (rows[row_idx].num_top > 0) {
+                rows[row_idx].compute(logits_data + row_idx * row_size + sequence_offset, vocab_size);
+            }
+        });
+
         for (int prompt_id = 0; prompt_id < promts_size; prompt_id++) {
-            const std::vector<int64_t> prompt = parameters.prompts[prompt_id];
+            const std::vector<int64_t>& prompt = parameters.prompts[prompt_id];
             std::vector<Group>& groups = prompts_groups[prompt_id];
-            auto [prompt_next_tokens, prompt_next_beams] = select_prompt_next_tokens(logits, prompt, groups);
+            auto [prompt_next_tokens, prompt_next_beams] = select_prompt_next_tokens(prompt, groups);
 
             next_tokens.insert(next_tokens.end(), prompt_next_tokens.begin(), prompt_next_tokens.end());
             next_beams.insert(next_beams.end(), prompt_next_beams.begin(), prompt_next_beams.end());
@@ -207,77 +306,98 @@ struct GroupBeamSearcher {
         return {next_tokens, next_beams};
     }
 
-    std::pair<std::vector<int64_t>, std::vector<int32_t>> select_prompt_next_tokens(const ov::Tensor& logits,
-                                                                                    const std::vector<int64_t>& prompt,
+    std::pair<std::vector<int64_t>, std::vector<int32_t>> select_prompt_next_tokens(const std::vector<int64_t>& prompt,
                                                                                     std::vector<Group>& groups) {
         std::vector<int64_t> next_tokens;
         std::vector<int32_t> next_beams;
         next_tokens.reserve(parameters.n_groups * parameters.group_size);
         next_beams.reserve(parameters.n_groups * parameters.group_size);
 
+        std::vector<Candidate> candidates;
+        std::vector<Token> penalized_tokens, beam_tokens;
         for (auto group = groups.begin(); group != groups.end(); ++group) {
             if (group->done) {
                 continue;
             }
-            std::vector<Beam> candidates;
-            candidates.reserve(parameters.group_size * 2 * parameters.group_size);
-            for (const Beam& beam : group->ongoing) {
-                std::vector<Token> tokens = log_softmax(logits, beam.global_beam_idx);
+            candidates.clear();
+            for (size_t beam_idx = 0; beam_idx < group->ongoing.size(); ++beam_idx) {
+                const Beam& beam = group->ongoing[beam_idx];
+                const RowCandidates& row = rows[beam.global_beam_idx];
+                auto find_penalized = [&penalized_tokens](int64_t idx) {
+                    return std::find_if(penalized_tokens.begin(), penalized_tokens.end(), [idx](const Token& token) {
+                        return token.idx == idx;
+                    });
+                };
+                penalized_tokens.clear();
                 for (auto prev_group = groups.cbegin(); prev_group != group; ++prev_group) {
                     for (const Beam& prev_beam : prev_group->ongoing) {
                         if (prev_beam.tokens.size() > beam.tokens.size()) {
-                            tokens.at(size_t(prev_beam.tokens.back())).log_prob -= parameters.diversity_penalty;
+                            auto penalized = find_penalized(prev_beam.tokens.back());
+                            if (penalized == penalized_tokens.end()) {
+                                penalized_tokens.push_back({row.log_prob(prev_beam.tokens.back()), prev_beam.tokens.back()});
+                                penalized = penalized_tokens.end() - 1;
+                            }
+                            penalized->log_prob -= parameters.diversity_penalty;
                         }
                     }
                 }
-                std::vector<int64_t> full_text{prompt};
-                full_text.insert(full_text.end(), beam.tokens.begin(), beam.tokens.end());
-                if (full_text.size() > 1 && full_text.size() >= parameters.no_repeat_ngram_size) {
-                    auto tail_start = full_text.end() - ptrdiff_t(parameters.no_repeat_ngram_size) + 1;
-                    for (int64_t banned_token : kmp_search(full_text, {tail_start, full_text.end()})) {
-                        tokens.at(size_t(banned_token)).log_prob = -std::numeric_limits<float>::infinity();
+                for (int64_t banned_token : beam.banned_tokens) {
+                    auto penalized = find_penalized(banned_token);
+                    if (penalized == penalized_tokens.end()) {
+                        penalized_tokens.push_back({0.0f, banned_token});
+                        penalized = penalized_tokens.end() - 1;
                     }
+                    penalized->log_prob = -std::numeric_limits<float>::infinity();
                 }
-                std::sort(tokens.begin(), tokens.end(), [](Token left, Token right) {
-                    return left.log_prob > right.log_prob;  // Most probable tokens in front
-                });
-                size_t add_count = 0;
-                for (Token token : tokens) {
-                    Beam new_candidate = beam;
-                    new_candidate.score += token.log_prob;
-                    new_candidate.tokens.push_back(token.idx);
-                    if (parameters.early_finish(new_candidate)) {
-                        group->finish(std::move(new_candidate), parameters);
-                    } else {
-                        candidates.push_back(std::move(new_candidate));
-                        ++add_count;
-                        if (add_count == 2 * parameters.group_size) {
-                            break;
-                        }
+
+                // the best tokens of the row, which aren't penalized, are merged with penalized ones
+                const size_t num_beam_tokens = 2 * parameters.group_size;
+                beam_tokens = penalized_tokens;
+                size_t num_unpenalized = 0;
+                for (auto token = row.top.begin(); token != row.top.end() && num_unpenalized < num_beam_tokens; ++token) {
+                    if (find_penalized(token->idx) == penalized_tokens.end()) {
+                        beam_tokens.push_back(*token);
+                        ++num_unpenalized;
                     }
                 }
+                const size_t num_selected = std::min(num_beam_tokens, beam_tokens.size());
+                std::partial_sort(beam_tokens.begin(), beam_tokens.begin() + num_selected, beam_tokens.end(), greater_log_prob);
+                for (size_t token_idx = 0; token_idx < num_selected; ++token_idx) {
+                    candidates.push_back({beam.score + beam_tokens[token_idx].log_prob, beam_idx, beam_tokens[token_idx].idx});
+                }
             }
             // Sample 2 * group_size highest score tokens to get at least 1 non EOS token per beam
             if (candidates.size() < 2 * parameters.group_size) {
                 throw std::runtime_error("No beams left to search");
             }
             auto to_sort = candidates.begin() + ptrdiff_t(2 * parameters.group_size);
-            std::partial_sort(candidates.begin(), to_sort, candidates.end(), greater);
-            group->ongoing.clear();
+            std::partial_sort(candidates.begin(), to_sort, candidates.end(), [](const Candidate& left, const Candidate& right) {
+                return left.score > right.score;
+            });
+            // only selected candidates become beams, so tokens and n-grams of the others are not copied
+            std::vector<Beam> ongoing;
+            ongoing.reserve(parameters.group_size);
             for (size_t cand_idx = 0; cand_idx < candidates.size(); ++cand_idx) {
-                if (parameters.eos_token_id == candidates.at(cand_idx).tokens.back()) {
-                    // If beam_token does not belong to top num_beams tokens, it should not be added
-                    if (cand_idx >= parameters.group_size) {
-                        continue;
-                    }
-                    group->finish(std::move(candidates.at(cand_idx)), parameters);
+                const Candidate& candidate = candidates.at(cand_idx);
+                // If beam_token does not belong to top num_beams tokens, it should not be added
+                if (parameters.eos_token_id == candidate.token && cand_idx >= parameters.group_size) {
+                    continue;
+                }
+                Beam new_beam = group->ongoing.at(candidate.beam_idx);
+                new_beam.score = candidate.score;
+                new_beam.tokens.push_back(candidate.token);
+                if (parameters.eos_token_id == candidate.token) {
+                    group->finish(std::move(new_beam), parameters);
                 } else {
-                    group->ongoing.push_back(std::move(candidates.at(cand_idx)));
-                    if (group->ongoing.size() == parameters.group_size) {
+                    index_ngram(new_beam.ngrams, prompt, new_beam.tokens, prompt.size() + new_beam.tokens.size() - 1,
+                                parameters.no_repeat_ngram_size);
+                    ongoing.push_back(std::move(new_beam));
+                    if (ongoing.size() == parameters.group_size) {
                         break;
                     }
                 }
             }
+            group->ongoing = std::move(ongoing);
             group->is_done(parameters);
             if (!group->done) {
                 for (const Beam& beam : group->ongoing) {
@@ -330,37 +450,6 @@ void initialize_inputs(const ov::Tensor& input_ids, const ov::Tensor& attention_
     std::fill_n(beam_idx.data<int32_t>(), input_shape.at(0), 0);
 }
 
-void update_attention_mask_with_beams(ov::Tensor&& attention_mask, std::vector<int32_t> next_beams) {
-    ov::Tensor original_mask{ov::element::i64, attention_mask.get_shape()};
-    ov::Shape original_shape = original_mask.get_shape();
-    attention_mask.copy_to(original_mask);
-
-    ov::Shape new_shape{next_beams.size(), original_mask.get_shape().at(1) + 1};
-    attention_mask.set_shape(new_shape);
-
-    for (size_t beam_id = 0; beam_id < next_beams.size(); beam_id++) {
-        const size_t original_prompt_offset = next_beams.at(beam_id) * original_shape.at(1);
-        const size_t result_prompt_offset = beam_id * new_shape.at(1);
-
-        int64_t* dest = attention_mask.data<int64_t>() + result_prompt_offset;
-        const int64_t* src = original_mask.data<int64_t>() + original_prompt_offset;
-
-        std::memcpy(dest, src, original_shape.at(1) * sizeof(int64_t));
-        attention_mask.data<int64_t>()[result_prompt_offset + new_shape.at(1) - 1] = 1;
-    }
-}
-
-void update_position_ids(ov::Tensor&& position_ids, const ov::Tensor&& attention_mask) {
-    const size_t batch_size = attention_mask.get_shape().at(0);
-    const size_t sequence_length = attention_mask.get_shape().at(1);
-    position_ids.set_shape({batch_size, 1});
-
-    for (size_t batch = 0; batch < batch_size; batch++) {
-        int64_t* mask_start = attention_mask.data<int64_t>() + batch * sequence_length;
-        position_ids.data<int64_t>()[batch] = std::accumulate(mask_start, mask_start + sequence_length - 1, 0);
-    }
-}
-
 void reset_all_inputs_to_empty_tensors(ov::InferRequest& request) {
     request.set_tensor("input_ids", ov::Tensor(ov::element::i64, {0, 0}));
     request.set_tensor("attention_mask", ov::Tensor(ov::element::i64, {0, 0}));
@@ -376,7 +465,8 @@ namespace genai {
 EncodedResults beam_search(ov::InferRequest& lm,
                            ov::Tensor input_ids,
                            ov::Tensor attention_mask,
-                           GenerationConfig config) {
+                           GenerationConfig config,
+                           std::shared_ptr<StreamerBase> streamer) {
     OPENVINO_ASSERT(config.num_beams % config.num_beam_groups == 0,
                     "number of beams should be divisible by number of groups");
 
@@ -392,7 +482,16 @@ EncodedResults beam_search(ov::InferRequest& lm,
         prompts.push_back(std::vector<int64_t>{prompt_start, prompt_start + sequence_length});
     }
 
-    initialize_inputs(input_ids, attention_mask, lm);
+    utils::AttentionMaskBuffer atten_mask_buffer(ov::Tensor(), attention_mask);
+    initialize_inputs(input_ids, atten_mask_buffer.get_tensor(), lm);
+
+    // a number of attended tokens of each row, which is a position of its next token
+    std::vector<int64_t> attended_lengths(batch_size), next_attended_lengths, next_position_ids;
+    for (size_t batch = 0; batch < batch_size; batch++) {
+        const size_t sequence_length = attention_mask.get_shape().at(1);
+        const int64_t* mask_start = attention_mask.data<const int64_t>() + batch * sequence_length;
+        attended_lengths[batch] = std::accumulate(mask_start, mask_start + sequence_length, int64_t{0});
+    }
 
     Parameters parameters{std::move(prompts)};
     parameters.max_new_tokens = config.max_new_tokens;
@@ -423,9 +522,18 @@ EncodedResults beam_search(ov::InferRequest& lm,
         lm.set_tensor("beam_idx", ov::Tensor{ov::element::i32, {batch_size}, next_beams.data()});
 
         // Set auxiliary inputs
-        update_attention_mask_with_beams(lm.get_tensor("attention_mask"), next_beams);
+        atten_mask_buffer.extend_with_beams(next_beams);
+        lm.set_tensor("attention_mask", atten_mask_buffer.get_tensor());
+
+        next_position_ids.resize(batch_size);
+        next_attended_lengths.resize(batch_size);
+        for (size_t beam_id = 0; beam_id < batch_size; ++beam_id) {
+            next_position_ids[beam_id] = attended_lengths[next_beams[beam_id]];
+            next_attended_lengths[beam_id] = next_position_ids[beam_id] + 1;
+        }
+        std::swap(attended_lengths, next_attended_lengths);
         if (position_ids_available)
-            update_position_ids(lm.get_tensor("position_ids"), lm.get_tensor("attention_mask"));
+            lm.set_tensor("position_ids", ov::Tensor{ov::element::i64, {batch_size, 1}, next_position_ids.data()});
     }
 
     reset_all_inputs_to_empty_tensors(lm);
@@ -464,6 +572,18 @@ EncodedResults beam_search(ov::InferRequest& lm,
             results.tokens.push_back(std::move(beam->get().tokens));
         }
     }
+
+    // beams are reordered and replaced at every step, so only final sequences are streamed
+    if (streamer) {
+        std::vector<StreamedToken> streamed_tokens;
+        std::vector<size_t> stopped_sequences;
+        for (size_t sequence_idx = 0; sequence_idx < results.tokens.size(); ++sequence_idx) {
+            for (int64_t token : results.tokens[sequence_idx])
+                streamed_tokens.push_back({sequence_idx, token});
+        }
+        if (!streamer->put_batch(streamed_tokens, stopped_sequences))
+            streamer->end();
+    }
     return results;
 }
 
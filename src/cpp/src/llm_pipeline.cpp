@@ -11,6 +11,8 @@
 #include "openvino/genai/llm_pipeline.hpp"
 #include "llm_pipeline_base.hpp"
 #include "llm_pipeline_static.hpp"
+#include "llm_pipeline_continuous_batching.hpp"
+#include "session_state_cache.hpp"
 #include "utils.hpp"
 #include "text_callback_streamer.hpp"
 
@@ -39,7 +41,8 @@ EncodedResults beam_search(
     ov::InferRequest& lm, 
     ov::Tensor prompts, 
     ov::Tensor attention_mask, 
-    GenerationConfig config
+    GenerationConfig config,
+    std::shared_ptr<StreamerBase> streamer
 );
 
 class StatefulLLMPipeline final : public LLMPipelineImplBase {
@@ -49,7 +52,10 @@ public:
     bool is_chat_conversation = false;
     bool m_is_cache_empty = true;
     ChatHistory m_history;
-    std::string m_templated_chat_history = "";
+    // tokens which are stored in KV cache during chat
+    std::vector<int64_t> m_tokenized_chat_history;
+    // finished conversations stored on disk, see ov::genai::session_cache_dir
+    std::unique_ptr<SessionStateCache> m_session_cache;
 
     StatefulLLMPipeline(
         const ov::InferRequest& request,
@@ -69,9 +75,19 @@ public:
     ): 
         LLMPipelineImplBase(tokenizer, utils::from_config_json_if_exists(model_path))
     {
-        ov::Core core;
-        core.set_property(device, plugin_config);
-        m_model_runner = core.compile_model(model_path / "openvino_model.xml", device).create_infer_request();
+        // plugin config, e.g. ov::cache_dir for compiled blobs, is passed to the model only, since the core is shared
+        ov::AnyMap compile_config = plugin_config;
+        size_t session_cache_capacity = SessionStateCache::DEFAULT_CAPACITY;
+        if (auto it = compile_config.find(ov::genai::session_cache_capacity.name()); it != compile_config.end()) {
+            session_cache_capacity = it->second.as<size_t>();
+            compile_config.erase(it);
+        }
+        if (auto it = compile_config.find(ov::genai::session_cache_dir.name()); it != compile_config.end()) {
+            m_session_cache = std::make_unique<SessionStateCache>(it->second.as<std::string>(), session_cache_capacity);
+            compile_config.erase(it);
+        }
+        ov::Core& core = utils::singleton_core();
+        m_model_runner = core.compile_model(model_path / "openvino_model.xml", device, compile_config).create_infer_request();
 
         // If eos_token_id was not provided, take value
         if (m_generation_config.eos_token_id == -1)
@@ -100,23 +116,22 @@ public:
             if (is_chat_conversation) {
                 m_history.push_back({{"role", "user"}, {"content", prompt}});
                 constexpr bool add_generation_prompt = true;
-                auto new_templated_chat_history  = m_tokenizer.apply_chat_template(m_history, add_generation_prompt);
-                
-                prompt = new_templated_chat_history.substr(m_templated_chat_history.size());
-                m_templated_chat_history = new_templated_chat_history;
+                auto templated_chat_history = m_tokenizer.apply_chat_template(m_history, add_generation_prompt);
+                ov::Tensor chat_history_ids = m_tokenizer.encode(templated_chat_history).input_ids;
+                // KV cache of the previous turns is reused by greedy decoding only
+                if (m_session_cache && m_is_cache_empty && config.is_greedy_decoding())
+                    restore_session(chat_history_ids);
+                encoded_input = get_chat_history_tail(chat_history_ids);
+            } else {
+                encoded_input = m_tokenizer.encode(prompt);
             }
-            
-            encoded_input = m_tokenizer.encode(prompt);
         }
 
         auto encoded_results  = generate(encoded_input, config, streamer);
         DecodedResults decoded_results = {m_tokenizer.decode(encoded_results.tokens), encoded_results.scores};
         
         if (is_chat_conversation) {
-            // Tail of chat template is missing in KV cache.
-            // Find the tail to concatenate it with the next input prompt.
             auto answer = decoded_results.texts[0];
-            m_templated_chat_history.append(answer);
             m_history.push_back({{"role", "assistant"}, {"content", answer}});
         }
         
@@ -156,9 +171,8 @@ public:
         }
 
         auto batch_size = input_ids.get_shape().at(0);
-        if ((batch_size != 1 || !(config.is_greedy_decoding() || config.is_multinomial())) && streamer_ptr) {
-            OPENVINO_THROW("Currently streaming is possible only with batch size=1 and "
-                            "only for greedy or multinomial decoding");
+        if (std::holds_alternative<std::function<bool(std::string)>>(streamer) && batch_size * config.num_return_sequences != 1) {
+            OPENVINO_THROW("Text callback streams a single sequence, StreamerBase::put_batch() can be used to stream several sequences");
         }
 
         auto num_inputs = m_model_runner.get_compiled_model().inputs().size();
@@ -173,7 +187,7 @@ public:
                                                 config, streamer_ptr,
                                                 is_chat_conversation, m_is_cache_empty);
         } else if (config.is_beam_search()) {
-            result = beam_search(m_model_runner, input_ids, attention_mask, config);
+            result = beam_search(m_model_runner, input_ids, attention_mask, config, streamer_ptr);
         } else if (config.is_multinomial()) {
             result = multinominal_decoding(m_model_runner, input_ids, attention_mask, config, streamer_ptr);
         } else {
@@ -184,21 +198,114 @@ public:
             m_model_runner.reset_state();
         } else {
             m_is_cache_empty = false;
+            if (batch_size == 1) {
+                // the last generated token is not passed to the model, so KV cache is as long as attention mask
+                const int64_t* input_ids_data = input_ids.data<const int64_t>();
+                m_tokenized_chat_history.insert(m_tokenized_chat_history.end(), input_ids_data, input_ids_data + input_ids.get_size());
+                m_tokenized_chat_history.insert(m_tokenized_chat_history.end(), result.tokens[0].begin(), result.tokens[0].end());
+                m_tokenized_chat_history.resize(m_model_runner.get_tensor("attention_mask").get_shape().at(1));
+            }
         }
 
         return result;
     }
 
-    void start_chat() override {
-        is_chat_conversation = true;
-        if (!m_is_cache_empty) {
+    // Finds the longest common prefix of tokens in KV cache and templated chat history, trims KV cache
+    // to this prefix and returns the rest of tokens, so only the new part of chat history is processed.
+    // Unlike diff of templated strings, it works for templates modifying previous messages as well.
+    TokenizedInputs get_chat_history_tail(const ov::Tensor& chat_history_ids) {
+        const int64_t* chat_history_data = chat_history_ids.data<const int64_t>();
+        const size_t chat_history_len = chat_history_ids.get_size();
+
+        size_t common_len = std::mismatch(m_tokenized_chat_history.begin(), m_tokenized_chat_history.end(),
+                                          chat_history_data, chat_history_data + chat_history_len).first - m_tokenized_chat_history.begin();
+        // at least one token has to be passed to the model to get logits
+        if (common_len == chat_history_len && common_len > 0)
+            --common_len;
+        trim_kv_cache(common_len);
+
+        ov::Tensor input_ids{ov::element::i64, {1, chat_history_len - common_len}};
+        std::copy(chat_history_data + common_len, chat_history_data + chat_history_len, input_ids.data<int64_t>());
+        return {input_ids, utils::init_attention_mask(input_ids)};
+    }
+
+    // loads KV cache of a stored conversation sharing the longest prefix with chat history; it's trimmed to the common
+    // prefix by get_chat_history_tail, so only the rest of chat history is computed
+    void restore_session(const ov::Tensor& chat_history_ids) {
+        std::vector<int64_t> session_ids;
+        try {
+            session_ids = m_session_cache->restore(chat_history_ids.data<const int64_t>(), chat_history_ids.get_size(), m_model_runner);
+        } catch (...) {
+            // states can be partially set
             m_model_runner.reset_state();
-            m_is_cache_empty = true;
+            throw;
         }
+        if (session_ids.empty())
+            return;
+
+        m_is_cache_empty = false;
+        m_tokenized_chat_history = std::move(session_ids);
+        ov::Tensor attention_mask{ov::element::i64, {1, m_tokenized_chat_history.size()}};
+        std::fill_n(attention_mask.data<int64_t>(), m_tokenized_chat_history.size(), 1);
+        m_model_runner.set_tensor("attention_mask", attention_mask);
+    }
+
+    void trim_kv_cache(size_t kv_cache_len) {
+        if (kv_cache_len == 0) {
+            if (!m_is_cache_empty) {
+                m_model_runner.reset_state();
+                m_is_cache_empty = true;
+            }
+            m_tokenized_chat_history.clear();
+            return;
+        }
+        if (m_tokenized_chat_history.size() == kv_cache_len)
+            return;
+
+        const size_t old_kv_cache_len = m_tokenized_chat_history.size();
+        for (ov::VariableState& state : m_model_runner.query_state()) {
+            ov::Tensor old_tensor = state.get_state();
+            ov::Shape old_shape = old_tensor.get_shape();
+            // most models keep [batch_size, num_kv_heads, seq_len, head_size] layout, while others (e.g. chatglm) put sequence
+            // first, so the axis is found by the current KV cache length; the usual one is preferred, if e.g. num_kv_heads is the same
+            size_t seq_len_axis = 2;
+            if (old_shape.size() <= seq_len_axis || old_shape[seq_len_axis] != old_kv_cache_len)
+                seq_len_axis = std::find(old_shape.begin(), old_shape.end(), old_kv_cache_len) - old_shape.begin();
+            OPENVINO_ASSERT(seq_len_axis < old_shape.size(), "KV cache state ", state.get_name(), " of shape ", old_shape,
+                            " does not have ", old_kv_cache_len, " cached tokens");
+            ov::Coordinate new_shape_begin(old_shape.size(), 0);
+            ov::Coordinate new_shape_end{old_shape};
+            new_shape_end[seq_len_axis] = kv_cache_len;
+
+            ov::Tensor trimmed_tensor(old_tensor, new_shape_begin, new_shape_end);
+            ov::Tensor new_tensor(old_tensor.get_element_type(), trimmed_tensor.get_shape());
+            trimmed_tensor.copy_to(new_tensor);
+            state.set_state(new_tensor);
+        }
+
+        // greedy decoding takes KV cache length from attention mask of previous run
+        ov::Tensor attention_mask{ov::element::i64, {1, kv_cache_len}};
+        std::fill_n(attention_mask.data<int64_t>(), kv_cache_len, 1);
+        m_model_runner.set_tensor("attention_mask", attention_mask);
+        m_tokenized_chat_history.resize(kv_cache_len);
+    }
+
+    void start_chat() override {
+        is_chat_conversation = true;
+        reset_chat();
     }
 
     void finish_chat() override {
         is_chat_conversation = false;
+        reset_chat();
+    }
+
+    void reset_chat() {
+        // KV cache contains the whole conversation only for a single sequence
+        if (m_session_cache && !m_is_cache_empty && !m_tokenized_chat_history.empty())
+            m_session_cache->store(m_tokenized_chat_history, m_model_runner);
+        m_history.clear();
+        m_tokenized_chat_history.clear();
         if (!m_is_cache_empty) {
             m_model_runner.reset_state();
             m_is_cache_empty = true;
@@ -256,6 +363,15 @@ std::pair<std::string, Any> generation_config(const GenerationConfig& config) {
 
 using namespace std;
 
+namespace {
+
+bool is_continuous_batching_enabled(const ov::AnyMap& plugin_config) {
+    auto it = plugin_config.find(ov::genai::continuous_batching.name());
+    return it != plugin_config.end() && it->second.as<bool>();
+}
+
+}  // namespace
+
 ov::genai::LLMPipeline::LLMPipeline(
     const ov::InferRequest& request,
     const ov::genai::Tokenizer& tokenizer,
@@ -270,7 +386,9 @@ ov::genai::LLMPipeline::LLMPipeline(
     const std::string& device,
     const ov::AnyMap& plugin_config
 ) {
-    if (device == "NPU") {
+    if (is_continuous_batching_enabled(plugin_config)) {
+        m_pimpl = make_unique<ContinuousBatchingLLMPipeline>(std::filesystem::path(model_path), tokenizer, device, plugin_config);
+    } else if (device == "NPU") {
         m_pimpl = make_unique<StaticLLMPipeline>(std::filesystem::path(model_path), tokenizer, device, plugin_config);
     } else {
         m_pimpl = make_unique<StatefulLLMPipeline>(std::filesystem::path(model_path), tokenizer, device, plugin_config);
@@ -282,7 +400,9 @@ ov::genai::LLMPipeline::LLMPipeline(
     const std::string& device,
     const ov::AnyMap& config
 ) {
-    if (device == "NPU") {
+    if (is_continuous_batching_enabled(config)) {
+        m_pimpl = make_unique<ContinuousBatchingLLMPipeline>(std::filesystem::path(path), device, config);
+    } else if (device == "NPU") {
         m_pimpl = make_unique<StaticLLMPipeline>(std::filesystem::path(path), device, config);
     } else {
         m_pimpl = make_unique<StatefulLLMPipeline>(std::filesystem::path(path), device, config);
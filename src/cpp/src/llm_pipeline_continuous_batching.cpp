@@ -0,0 +1,284 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "llm_pipeline_continuous_batching.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "continuous_batching_pipeline.hpp"
+
+#include "text_callback_streamer.hpp"
+#include "utils.hpp"
+
+namespace {
+
+::GenerationConfig to_continuous_batching_config(const ov::genai::GenerationConfig& config) {
+    ::GenerationConfig cb_config;
+    cb_config.max_new_tokens = config.max_new_tokens;
+    cb_config.max_length = config.max_length;
+    cb_config.ignore_eos = config.ignore_eos;
+    cb_config.eos_token_id = config.eos_token_id;
+    cb_config.num_return_sequences = config.num_return_sequences;
+
+    if (config.is_beam_search()) {
+        cb_config.num_groups = config.num_beam_groups;
+        cb_config.group_size = config.num_beams / config.num_beam_groups;
+        cb_config.diversity_penalty = config.diversity_penalty;
+        cb_config.length_penalty = config.length_penalty;
+        cb_config.no_repeat_ngram_size = config.no_repeat_ngram_size;
+        switch (config.stop_criteria) {
+        case ov::genai::StopCriteria::EARLY: cb_config.stop_criteria = StopCriteria::EARLY; break;
+        case ov::genai::StopCriteria::HEURISTIC: cb_config.stop_criteria = StopCriteria::HEURISTIC; break;
+        case ov::genai::StopCriteria::NEVER: cb_config.stop_criteria = StopCriteria::NEVER; break;
+        }
+    } else if (config.is_multinomial()) {
+        cb_config.do_sample = true;
+        cb_config.temperature = config.temperature;
+        cb_config.top_p = config.top_p;
+        cb_config.top_k = static_cast<int>(config.top_k);
+        cb_config.repetition_penalty = config.repetition_penalty;
+    } else {
+        // greedy decoding
+        cb_config.temperature = 0.0f;
+        cb_config.num_return_sequences = 1;
+    }
+    return cb_config;
+}
+
+// properties of continuous batching backend are not passed to plugin
+SchedulerConfig extract_scheduler_config(ov::AnyMap& plugin_config) {
+    SchedulerConfig scheduler_config;
+    scheduler_config.cache_size = 1;
+    plugin_config.erase(ov::genai::continuous_batching.name());
+    if (auto it = plugin_config.find(ov::genai::kv_cache_size.name()); it != plugin_config.end()) {
+        scheduler_config.cache_size = it->second.as<size_t>();
+        plugin_config.erase(it);
+    }
+    if (auto it = plugin_config.find(ov::genai::session_cache_dir.name()); it != plugin_config.end()) {
+        scheduler_config.session_cache_dir = it->second.as<std::string>();
+        plugin_config.erase(it);
+    }
+    // stored sessions of continuous batching backend are bounded by their size
+    plugin_config.erase(ov::genai::session_cache_capacity.name());
+    return scheduler_config;
+}
+
+// continuous batching backend uses tokenizer of LLMPipeline, so tokenizer models are not read and compiled again
+std::shared_ptr<::Tokenizer> wrap_tokenizer(ov::genai::Tokenizer tokenizer) {
+    const int64_t eos_token_id = tokenizer.get_eos_token_id();
+    OPENVINO_ASSERT(eos_token_id >= 0, "Continuous batching requires eos_token_id of tokenizer");
+    return std::make_shared<::Tokenizer>(
+        [tokenizer] (const std::string& prompt) mutable {
+            return tokenizer.encode(prompt).input_ids;
+        },
+        [tokenizer] (std::vector<std::vector<int64_t>> tokens) mutable {
+            return tokenizer.decode(std::move(tokens));
+        },
+        static_cast<size_t>(eos_token_id));
+}
+
+// tokens of a row of left padded batch
+ov::Tensor get_prompt_ids(const ov::Tensor& input_ids, const ov::Tensor& attention_mask, size_t batch_idx) {
+    const size_t sequence_length = input_ids.get_shape().at(1);
+    const int64_t* input_ids_data = input_ids.data<const int64_t>() + batch_idx * sequence_length;
+    const int64_t* attention_mask_data = attention_mask.data<const int64_t>() + batch_idx * sequence_length;
+
+    std::vector<int64_t> prompt_ids;
+    for (size_t token_idx = 0; token_idx < sequence_length; ++token_idx) {
+        if (attention_mask_data[token_idx] != 0)
+            prompt_ids.push_back(input_ids_data[token_idx]);
+    }
+    ov::Tensor prompt_tensor(ov::element::i64, {prompt_ids.size()});
+    std::copy(prompt_ids.begin(), prompt_ids.end(), prompt_tensor.data<int64_t>());
+    return prompt_tensor;
+}
+
+}  // namespace
+
+namespace ov {
+namespace genai {
+
+ContinuousBatchingLLMPipeline::ContinuousBatchingLLMPipeline(
+    const std::filesystem::path& path,
+    const ov::genai::Tokenizer& tokenizer,
+    const std::string& device,
+    const ov::AnyMap& config
+) : LLMPipelineImplBase(tokenizer,
+                        utils::from_config_json_if_exists(path)) {
+    ov::AnyMap plugin_config = config;
+    SchedulerConfig scheduler_config = extract_scheduler_config(plugin_config);
+    m_pipeline = std::make_unique<ContinuousBatchingPipeline>(path.string(), wrap_tokenizer(m_tokenizer), scheduler_config, device, plugin_config);
+
+    // If eos_token_id was not provided, take value
+    if (m_generation_config.eos_token_id == -1)
+        m_generation_config.eos_token_id = m_tokenizer.get_eos_token_id();
+}
+
+ContinuousBatchingLLMPipeline::ContinuousBatchingLLMPipeline(
+    const std::filesystem::path& path,
+    const std::string& device,
+    const ov::AnyMap& config
+) : ContinuousBatchingLLMPipeline(path, path.string(), device, config) {
+}
+
+ContinuousBatchingLLMPipeline::~ContinuousBatchingLLMPipeline() = default;
+
+DecodedResults ContinuousBatchingLLMPipeline::generate(
+    StringInputs inputs,
+    OptionalGenerationConfig generation_config,
+    StreamerVariant streamer
+) {
+    GenerationConfig config = (generation_config.has_value()) ? *generation_config : m_generation_config;
+    TokenizedInputs tokenized_inputs;
+    if (auto input_vector = std::get_if<std::vector<std::string>>(&inputs)) {
+        tokenized_inputs = m_tokenizer.encode(*input_vector);
+    } else if (auto input_prompt = std::get_if<std::string>(&inputs)) {
+        tokenized_inputs = m_tokenizer.encode(*input_prompt);
+    }
+    auto encoded_results = generate(tokenized_inputs, config, streamer);
+    return {m_tokenizer.decode(encoded_results.tokens), encoded_results.scores};
+}
+
+EncodedResults ContinuousBatchingLLMPipeline::generate(
+    const EncodedInputs& inputs,
+    OptionalGenerationConfig generation_config,
+    StreamerVariant streamer
+) {
+    ov::Tensor input_ids;
+    ov::Tensor attention_mask;
+
+    if (auto data = std::get_if<ov::Tensor>(&inputs)) {
+        input_ids = *data;
+        attention_mask = ov::genai::utils::init_attention_mask(input_ids);
+    } else if (auto data = std::get_if<TokenizedInputs>(&inputs)) {
+        input_ids = data->input_ids;
+        attention_mask = data->attention_mask;
+    }
+
+    GenerationConfig config = (generation_config.has_value()) ? *generation_config : m_generation_config;
+    // If eos_token_id was not provided, take value from default m_generation_config
+    if (config.eos_token_id == -1)
+        config.eos_token_id = m_generation_config.eos_token_id;
+    config.validate();
+
+    std::shared_ptr<StreamerBase> streamer_ptr;
+    if (auto streamer_obj = std::get_if<std::monostate>(&streamer)) {
+        streamer_ptr = nullptr;
+    } else if (auto streamer_obj = std::get_if<std::shared_ptr<StreamerBase>>(&streamer)) {
+        streamer_ptr = *streamer_obj;
+    } else if (auto callback = std::get_if<std::function<bool(std::string)>>(&streamer)) {
+        streamer_ptr = std::make_shared<TextCallbackStreamer>(m_tokenizer, *callback);
+    }
+
+    const ::GenerationConfig cb_config = to_continuous_batching_config(config);
+    const size_t batch_size = input_ids.get_shape().at(0);
+    const size_t num_return_sequences = cb_config.num_return_sequences;
+    if (std::holds_alternative<std::function<bool(std::string)>>(streamer) && batch_size * config.num_return_sequences != 1) {
+        OPENVINO_THROW("Text callback streams a single sequence, StreamerBase::put_batch() can be used to stream several sequences");
+    }
+
+    // all prompts of the batch are scheduled independently, so they are not padded
+    std::vector<GenerationHandle> generations;
+    for (size_t batch_idx = 0; batch_idx < batch_size; ++batch_idx) {
+        generations.push_back(m_pipeline->add_request(m_next_request_id++, get_prompt_ids(input_ids, attention_mask, batch_idx), cb_config));
+    }
+
+    // streamed tokens are read as soon as they are generated, so they are not returned by read_all();
+    // sequences of the i-th prompt are streamed as [i * num_return_sequences, (i + 1) * num_return_sequences)
+    // in order of their first outputs, and outputs which arrive at once (beam search, parallel sampling) are sorted by score
+    std::vector<std::unordered_map<uint64_t, size_t>> sequence_indices(batch_size);
+    std::vector<std::vector<int64_t>> streamed_tokens(batch_size * num_return_sequences);
+    std::vector<float> streamed_scores(streamed_tokens.size(), 0.0f);
+    std::vector<bool> is_sequence_stopped(streamed_tokens.size(), false);
+    std::vector<size_t> num_stopped_sequences(batch_size, 0);
+    std::vector<StreamedToken> step_tokens;
+    std::vector<size_t> stopped_sequences;
+    bool is_stopped_by_streamer = false;
+    while (m_pipeline->has_non_finished_requests()) {
+        m_pipeline->step();
+        if (!streamer_ptr || is_stopped_by_streamer)
+            continue;
+
+        step_tokens.clear();
+        for (size_t batch_idx = 0; batch_idx < batch_size; ++batch_idx) {
+            if (!generations[batch_idx])
+                continue;
+            GenerationOutputs available_outputs = generations[batch_idx]->read_available();
+            std::vector<std::pair<uint64_t, GenerationOutput*>> outputs;
+            for (auto& output : available_outputs)
+                outputs.emplace_back(output.first, &output.second);
+            std::sort(outputs.begin(), outputs.end(), [] (const auto& lhs, const auto& rhs) {
+                return lhs.second->score > rhs.second->score;
+            });
+            for (const auto& output : outputs) {
+                auto sequence_index = sequence_indices[batch_idx].find(output.first);
+                if (sequence_index == sequence_indices[batch_idx].end()) {
+                    // beam search returns more sequences than requested, the worst of them are not streamed
+                    if (sequence_indices[batch_idx].size() == num_return_sequences)
+                        continue;
+                    sequence_index = sequence_indices[batch_idx].emplace(output.first,
+                        batch_idx * num_return_sequences + sequence_indices[batch_idx].size()).first;
+                }
+                const size_t sequence_idx = sequence_index->second;
+                if (is_sequence_stopped[sequence_idx])
+                    continue;
+                streamed_scores[sequence_idx] = output.second->score;
+                for (int64_t token : output.second->generated_token_ids) {
+                    streamed_tokens[sequence_idx].push_back(token);
+                    step_tokens.push_back({sequence_idx, token});
+                }
+            }
+        }
+        if (step_tokens.empty())
+            continue;
+
+        stopped_sequences.clear();
+        is_stopped_by_streamer = streamer_ptr->put_batch(step_tokens, stopped_sequences);
+        for (size_t sequence_idx : stopped_sequences) {
+            OPENVINO_ASSERT(sequence_idx < streamed_tokens.size(), "Streamer stopped unknown sequence ", sequence_idx);
+            if (is_sequence_stopped[sequence_idx])
+                continue;
+            // tokens which are passed together with the stopped one are kept, as streamer has seen them
+            is_sequence_stopped[sequence_idx] = true;
+            const size_t batch_idx = sequence_idx / num_return_sequences;
+            // a request generates all its sequences, so it's dropped only when all of them are stopped;
+            // dropped request is released by the next step
+            if (++num_stopped_sequences[batch_idx] == num_return_sequences)
+                generations[batch_idx].reset();
+        }
+        if (is_stopped_by_streamer) {
+            for (GenerationHandle& generation : generations)
+                generation.reset();
+        }
+    }
+
+    EncodedResults results;
+    if (streamer_ptr) {
+        if (!is_stopped_by_streamer)
+            streamer_ptr->end();
+        for (size_t batch_idx = 0; batch_idx < batch_size; ++batch_idx) {
+            for (size_t sequence_idx = batch_idx * num_return_sequences; sequence_idx < batch_idx * num_return_sequences + sequence_indices[batch_idx].size(); ++sequence_idx) {
+                results.tokens.push_back(std::move(streamed_tokens[sequence_idx]));
+                results.scores.push_back(streamed_scores[sequence_idx]);
+            }
+        }
+        return results;
+    }
+
+    for (const GenerationHandle& generation : generations) {
+        std::vector<GenerationOutput> generation_outputs = generation->read_all();
+        std::sort(generation_outputs.begin(), generation_outputs.end(), [] (const GenerationOutput& r1, const GenerationOutput& r2) {
+            return r1.score > r2.score;
+        });
+        const size_t num_outputs = std::min(cb_config.num_return_sequences, generation_outputs.size());
+        for (size_t output_idx = 0; output_idx < num_outputs; ++output_idx) {
+            results.tokens.push_back(std::move(generation_outputs[output_idx].generated_token_ids));
+            results.scores.push_back(generation_outputs[output_idx].score);
+        }
+    }
+    return results;
+}
+
+}  // namespace genai
+}  // namespace ov
@@ -0,0 +1,57 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "llm_pipeline_base.hpp"
+
+class ContinuousBatchingPipeline;
+
+namespace ov {
+namespace genai {
+
+// LLMPipeline backend based on ContinuousBatchingPipeline: prompts of a batch are processed as independent
+// requests with paged attention and dynamic batching instead of being padded to a common length
+class ContinuousBatchingLLMPipeline final : public LLMPipelineImplBase {
+public:
+    ContinuousBatchingLLMPipeline(
+        const std::filesystem::path& path,
+        const ov::genai::Tokenizer& tokenizer,
+        const std::string& device,
+        const ov::AnyMap& config
+    );
+
+    ContinuousBatchingLLMPipeline(
+        const std::filesystem::path& path,
+        const std::string& device,
+        const ov::AnyMap& config
+    );
+
+    ~ContinuousBatchingLLMPipeline();
+
+    DecodedResults generate(
+        StringInputs inputs,
+        OptionalGenerationConfig generation_config,
+        StreamerVariant streamer
+    ) override;
+
+    EncodedResults generate(
+        const EncodedInputs& inputs,
+        OptionalGenerationConfig generation_config,
+        StreamerVariant streamer
+    ) override;
+
+    void start_chat() override {
+        OPENVINO_THROW("Currently chat conversation mode isn't supported");
+    };
+    void finish_chat() override {
+        OPENVINO_THROW("Currently chat conversation mode isn't supported");
+    };
+
+private:
+    std::unique_ptr<ContinuousBatchingPipeline> m_pipeline;
+    uint64_t m_next_request_id = 0;
+};
+
+}  // namespace genai
+}  // namespace ov
@@ -3,14 +3,21 @@
 
 #include "llm_pipeline_static.hpp"
 
+#include <algorithm>
+#include <future>
+#include <numeric>
+#include <optional>
+
 #include "openvino/opsets/opset13.hpp"
 
+#include "random_sampling.hpp"
 #include "text_callback_streamer.hpp"
 #include "utils.hpp"
 
 namespace {
 
-std::shared_ptr<ov::Model> add_slices_to_kvcache_inputs(const std::shared_ptr<ov::Model>& model) {
+std::shared_ptr<ov::Model> add_slices_to_kvcache_inputs(const std::shared_ptr<ov::Model>& model,
+                                                        const uint32_t input_size = 1u) {
     const auto kvcache_name_pattern = "past_key_values";
     std::vector<std::shared_ptr<ov::opset13::Parameter>> new_params;
     for (auto param : model->get_parameters()) {
@@ -20,14 +27,14 @@ std::shared_ptr<ov::Model> add_slices_to_kvcache_inputs(const std::shared_ptr<ov
             continue;
         }
         auto shape = param->get_output_shape(0);
-        shape[2] += 1;
+        shape[2] += input_size;
 
         auto new_param = std::make_shared<ov::opset13::Parameter>(param->get_element_type(), shape);
         new_param->set_friendly_name(tensor_name);
         new_param->outputs().begin()->get_tensor().set_names(param->outputs().begin()->get_tensor().get_names());
 
         auto slice_start = std::make_shared<ov::opset13::Constant>(
-            ov::element::Type_t::i32, ov::Shape{1}, std::vector<int32_t>{1}
+            ov::element::Type_t::i32, ov::Shape{1}, std::vector<int32_t>{static_cast<int32_t>(input_size)}
         );
         auto slice_stop = std::make_shared<ov::opset13::Constant>(
             ov::element::Type_t::i32, ov::Shape{1}, std::vector<int32_t>{static_cast<int32_t>(shape[2])}
@@ -98,6 +105,44 @@ ov::AnyMap extract_config_or_empty(const ov::AnyMap& config, const std::string&
     return stage_cfg;
 }
 
+uint32_t extract_size_or_default(const ov::AnyMap& config, const std::string& name, uint32_t default_value) {
+    auto it = config.find(name);
+    if (it == config.end()) {
+        return default_value;
+    }
+    // NB: Python integers are passed as int64_t
+    if (it->second.is<int64_t>()) {
+        return static_cast<uint32_t>(it->second.as<int64_t>());
+    }
+    return it->second.as<uint32_t>();
+}
+
+// NB: Sizes of prefill models sorted in ascending order, the largest one is always max_prompt_size
+std::vector<uint32_t> extract_prefill_buckets(const ov::AnyMap& config, uint32_t max_prompt_size) {
+    std::vector<uint32_t> buckets;
+    if (auto it = config.find("PREFILL_BUCKETS"); it != config.end()) {
+        // NB: Python lists of integers are passed as std::vector<int64_t>
+        if (it->second.is<std::vector<int64_t>>()) {
+            for (const int64_t bucket : it->second.as<std::vector<int64_t>>()) {
+                buckets.push_back(static_cast<uint32_t>(bucket));
+            }
+        } else {
+            buckets = it->second.as<std::vector<uint32_t>>();
+        }
+    } else {
+        for (uint32_t bucket = 128u; bucket < max_prompt_size; bucket *= 2u) {
+            buckets.push_back(bucket);
+        }
+    }
+    buckets.erase(std::remove_if(buckets.begin(), buckets.end(), [max_prompt_size](uint32_t bucket) {
+        return bucket == 0u || bucket >= max_prompt_size;
+    }), buckets.end());
+    buckets.push_back(max_prompt_size);
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+    return buckets;
+}
+
 } // anonymous namespace
 
 namespace ov {
@@ -116,36 +161,73 @@ StaticLLMPipeline::StaticLLMPipeline(
        Initialization assumes multiple steps:
        1) Read the template model - this will be kvcache model
        2) Expose KV-cache input and output layers from kvcache model
-       3) Clone the model - this will be prefill
-       3) Reshape both models to static shape
+       3) Clone the model - this will be prefill, one per prompt size bucket
+       3) Reshape all models to static shape
        4) Add slices to KV-cache inputs for kvcache model, this will make input and output KV-cache
           layers to have the same shape and allow outputs writes directly to inputs for the next iteration.
-       5) Compile both models
-       6) Initialize input tensors for kvcache and prefill models
+       5) Compile all models
+       6) Initialize input tensors for kvcache model
     */
-    ov::Core core;
+    ov::Core& core = utils::singleton_core();
     // (1) Read the template model - this will be kvcache model
     auto kvcache_model = core.read_model(path / "openvino_model.xml");
     // (2) TODO: Expose KV-cache input and output layers from kvcache model
-    // (3) Clone the model - this will be prefill
-    auto prefill_model = kvcache_model->clone();
-    prefill_model->set_friendly_name(kvcache_model->get_friendly_name() + "_prefill");
-    // (4) Reshape both models to static shape
-    m_kvcache_desc = KVCacheDesc { 1024u, 0u };
-    const uint32_t max_prompt_size = m_kvcache_desc.total_size;
-    const uint32_t max_kvcache_size = m_kvcache_desc.total_size;
-    reshape_to_static(prefill_model, max_prompt_size, max_kvcache_size);
-    reshape_to_static(kvcache_model, 1u, max_kvcache_size);
+    // (3) Clone the model for every prefill bucket
+    const uint32_t max_prompt_size = extract_size_or_default(config, "MAX_PROMPT_LEN", 1024u);
+    const uint32_t min_response_size = extract_size_or_default(config, "MIN_RESPONSE_LEN", 128u);
+    m_kvcache_desc = KVCacheDesc { max_prompt_size, max_prompt_size + min_response_size, 0u };
+    // NB: Prompts longer than chunk size are processed in chunks by the model which takes past KV-cache
+    m_prefill_chunk_size = std::min(extract_size_or_default(config, "PREFILL_CHUNK_SIZE", 0u), max_prompt_size);
+    const uint32_t max_prefill_size = m_prefill_chunk_size > 0u ? m_prefill_chunk_size : max_prompt_size;
+    const auto prefill_buckets = extract_prefill_buckets(config, max_prefill_size);
+    std::vector<std::shared_ptr<ov::Model>> prefill_models;
+    for (const uint32_t bucket_size : prefill_buckets) {
+        auto prefill_model = kvcache_model->clone();
+        prefill_model->set_friendly_name(kvcache_model->get_friendly_name() + "_prefill_" + std::to_string(bucket_size));
+        // (4) Reshape prefill model to static shape
+        reshape_to_static(prefill_model, bucket_size, bucket_size);
+        prefill_models.push_back(prefill_model);
+    }
+    std::shared_ptr<ov::Model> prefill_chunk_model;
+    if (m_prefill_chunk_size > 0u) {
+        prefill_chunk_model = kvcache_model->clone();
+        prefill_chunk_model->set_friendly_name(kvcache_model->get_friendly_name() + "_prefill_chunk");
+        reshape_to_static(prefill_chunk_model, m_prefill_chunk_size, m_kvcache_desc.total_size);
+        prefill_chunk_model = add_slices_to_kvcache_inputs(prefill_chunk_model, m_prefill_chunk_size);
+    }
+    // (4) Reshape kvcache model to static shape
+    reshape_to_static(kvcache_model, 1u, m_kvcache_desc.total_size);
     // (5) Add slices to kvcache model
     kvcache_model = add_slices_to_kvcache_inputs(kvcache_model);
-    // (6) Compile both model
-    m_prefill_request = core.compile_model(
-        prefill_model, device, extract_config_or_empty(config, "PREFILL_CONFIG")
-    ).create_infer_request();
-    m_kvcache_request = core.compile_model(
-        kvcache_model, device, extract_config_or_empty(config, "GENERATE_CONFIG")
-    ).create_infer_request();
+    // (6) Compile all models concurrently, compiled blobs are cached if cache directory is provided
+    auto prefill_config = extract_config_or_empty(config, "PREFILL_CONFIG");
+    auto generate_config = extract_config_or_empty(config, "GENERATE_CONFIG");
+    if (auto it = config.find(ov::cache_dir.name()); it != config.end()) {
+        prefill_config.insert(*it);
+        generate_config.insert(*it);
+    }
+    auto compile = [&core, &device](const std::shared_ptr<ov::Model>& model, const ov::AnyMap& stage_config) {
+        return std::async(std::launch::async, [&core, &device, model, &stage_config] {
+            return core.compile_model(model, device, stage_config).create_infer_request();
+        });
+    };
+    std::vector<std::future<ov::InferRequest>> prefill_requests;
+    for (const auto& prefill_model : prefill_models) {
+        prefill_requests.push_back(compile(prefill_model, prefill_config));
+    }
+    std::future<ov::InferRequest> prefill_chunk_request;
+    if (prefill_chunk_model) {
+        prefill_chunk_request = compile(prefill_chunk_model, prefill_config);
+    }
+    m_kvcache_request = compile(kvcache_model, generate_config).get();
+    for (size_t i = 0; i < prefill_buckets.size(); ++i) {
+        m_prefill_buckets.push_back(PrefillBucket { prefill_buckets[i], prefill_requests[i].get() });
+    }
+    if (prefill_chunk_request.valid()) {
+        m_prefill_chunk_request = prefill_chunk_request.get();
+    }
     // (7) Initialize tensors
+    bind_kvcache_tensors();
     prepare_for_new_conversation();
 };
 
@@ -156,14 +238,99 @@ StaticLLMPipeline::StaticLLMPipeline(
 ) : StaticLLMPipeline(path, path.string(), device, config) {
 }
 
+void StaticLLMPipeline::bind_kvcache_tensors() {
+    // Inputs: input_ids, attention_mask, position_ids, ...
+    // Outputs: logits, ...
+    const auto kStartInputKVCacheLayers = 3u;
+    const auto kStartOutputKVCacheLayers = 1u;
+
+    // NB: Outputs are written directly to inputs for the next iteration,
+    // prefill chunk model works on the same KV-cache and attention mask as kvcache model
+    const auto& kvcache_compiled = m_kvcache_request.get_compiled_model();
+    for (int i = 0; i < kvcache_compiled.outputs().size() - 1; ++i) {
+        const auto& input_name = kvcache_compiled.inputs()[kStartInputKVCacheLayers + i].get_any_name();
+        const auto& output_name = kvcache_compiled.outputs()[kStartOutputKVCacheLayers + i].get_any_name();
+        auto kvcache_out_tensor = m_kvcache_request.get_tensor(output_name);
+        m_kvcache_request.set_tensor(input_name, kvcache_out_tensor);
+        if (m_prefill_chunk_size > 0u) {
+            m_prefill_chunk_request.set_tensor(input_name, kvcache_out_tensor);
+            m_prefill_chunk_request.set_tensor(output_name, kvcache_out_tensor);
+        }
+    }
+    if (m_prefill_chunk_size > 0u) {
+        m_prefill_chunk_request.set_tensor("attention_mask", m_kvcache_request.get_tensor("attention_mask"));
+    }
+
+    // NB: KV-cache is filled from the right, so prefill models write their outputs directly to the last
+    // slots of KV-cache via ROI tensors. If device doesn't accept strided output, outputs are copied after prefill
+    for (auto& bucket : m_prefill_buckets) {
+        try {
+            for (int i = 0; i < kvcache_compiled.outputs().size() - 1; ++i) {
+                const auto& output_name = kvcache_compiled.outputs()[kStartOutputKVCacheLayers + i].get_any_name();
+                bucket.request.set_tensor(output_name, get_kvcache_tail(m_kvcache_request.get_tensor(output_name), bucket.size));
+            }
+            bucket.writes_to_kvcache = true;
+        } catch (const ov::Exception&) {
+            for (int i = 0; i < kvcache_compiled.outputs().size() - 1; ++i) {
+                const auto& output = bucket.request.get_compiled_model().outputs()[kStartOutputKVCacheLayers + i];
+                bucket.request.set_tensor(output, ov::Tensor(output.get_element_type(), output.get_shape()));
+            }
+        }
+    }
+}
+
+ov::Tensor StaticLLMPipeline::get_kvcache_tail(const ov::Tensor& kvcache_tensor, uint32_t num_slots) const {
+    // NB: KV-cache layers have [batch, num_heads, seq_len, head_size] layout
+    const auto& kvcache_shape = kvcache_tensor.get_shape();
+    ov::Coordinate begin(kvcache_shape.size(), 0u);
+    begin[2] = m_kvcache_desc.total_size - num_slots;
+    return ov::Tensor(kvcache_tensor, begin, ov::Coordinate{kvcache_shape});
+}
+
 void StaticLLMPipeline::prepare_for_new_conversation() {
-    fill_tensor(m_prefill_request.get_tensor("input_ids"), m_tokenizer.get_pad_token_id());
-    fill_tensor(m_prefill_request.get_tensor("position_ids"), 0u);
-    fill_tensor(m_prefill_request.get_tensor("attention_mask"), 0u);
     fill_tensor(m_kvcache_request.get_tensor("attention_mask"), 0u);
     m_kvcache_desc.num_stored_tokens = 0u;
 }
 
+void StaticLLMPipeline::start_chat() {
+    m_is_chat_conversation = true;
+    reset_chat();
+}
+
+void StaticLLMPipeline::finish_chat() {
+    m_is_chat_conversation = false;
+    reset_chat();
+}
+
+void StaticLLMPipeline::reset_chat() {
+    m_history.clear();
+    m_tokenized_chat_history.clear();
+    prepare_for_new_conversation();
+}
+
+// NB: KV-cache slots are filled from right to left, so stored tokens can't be trimmed cheaply.
+// If templated chat history still starts with tokens stored in KV-cache, only the rest of tokens is returned,
+// otherwise KV-cache is reset and the whole chat history is processed by prefill model.
+TokenizedInputs StaticLLMPipeline::get_chat_history_tail(const ov::Tensor& chat_history_ids) {
+    const int64_t* chat_history_data = chat_history_ids.data<const int64_t>();
+    const size_t chat_history_len = chat_history_ids.get_size();
+
+    size_t common_len = 0u;
+    if (!m_tokenized_chat_history.empty() &&
+        m_tokenized_chat_history.size() < chat_history_len &&
+        chat_history_len <= m_kvcache_desc.total_size &&
+        std::equal(m_tokenized_chat_history.begin(), m_tokenized_chat_history.end(), chat_history_data)) {
+        common_len = m_tokenized_chat_history.size();
+    } else {
+        m_tokenized_chat_history.clear();
+        prepare_for_new_conversation();
+    }
+
+    ov::Tensor input_ids{ov::element::i64, {1, chat_history_len - common_len}};
+    std::copy(chat_history_data + common_len, chat_history_data + chat_history_len, input_ids.data<int64_t>());
+    return {input_ids, utils::init_attention_mask(input_ids)};
+}
+
 DecodedResults StaticLLMPipeline::generate(
     StringInputs inputs,
     OptionalGenerationConfig generation_config,
@@ -175,9 +342,23 @@ DecodedResults StaticLLMPipeline::generate(
     }
 
     OPENVINO_ASSERT(std::holds_alternative<std::string>(inputs));
-    auto tokenized_input = m_tokenizer.encode(std::get<std::string>(inputs));
+    const std::string& prompt = std::get<std::string>(inputs);
+    TokenizedInputs tokenized_input;
+    if (m_is_chat_conversation) {
+        m_history.push_back({{"role", "user"}, {"content", prompt}});
+        constexpr bool add_generation_prompt = true;
+        auto templated_chat_history = m_tokenizer.apply_chat_template(m_history, add_generation_prompt);
+        tokenized_input = get_chat_history_tail(m_tokenizer.encode(templated_chat_history).input_ids);
+    } else {
+        tokenized_input = m_tokenizer.encode(prompt);
+    }
+
     auto encoded_results = generate(tokenized_input, config, streamer);
-    return {m_tokenizer.decode(encoded_results.tokens), encoded_results.scores};
+    DecodedResults decoded_results = {m_tokenizer.decode(encoded_results.tokens), encoded_results.scores};
+    if (m_is_chat_conversation) {
+        m_history.push_back({{"role", "assistant"}, {"content", decoded_results.texts[0]}});
+    }
+    return decoded_results;
 }
 
 EncodedResults StaticLLMPipeline::generate(
@@ -215,94 +396,184 @@ EncodedResults StaticLLMPipeline::generate(
         streamer_ptr = std::make_shared<TextCallbackStreamer>(m_tokenizer, *callback);
     }
 
-    if (!config.is_greedy_decoding()) {
-        OPENVINO_THROW("Currently only greedy decoding is supported");
+    if (config.is_beam_search()) {
+        OPENVINO_THROW("Currently only greedy decoding and multinomial sampling are supported");
     }
 
     ov::genai::EncodedResults results;
     // NB: Only batch=1 is supported now
-    results.scores.resize(1u);
+    results.scores.resize(1u, 0.0f);
     results.tokens.resize(1u);
 
+    // NB: Within chat conversation KV-cache of the previous turns is kept, so only new tokens are processed
+    const bool is_continuation = m_is_chat_conversation && m_kvcache_desc.num_stored_tokens > 0u;
+    if (!is_continuation) {
+        prepare_for_new_conversation();
+    }
+
     // NB: Check if input prompt less than maximum size
     auto prompt_len = input_ids.get_size();
-    if (prompt_len > m_kvcache_desc.total_size) {
+    if (!is_continuation && prompt_len > m_kvcache_desc.max_prompt_size) {
+        OPENVINO_THROW("Currently static pipeline only process up to " + std::to_string(m_kvcache_desc.max_prompt_size) + " tokens");
+    }
+    if (m_kvcache_desc.num_stored_tokens + prompt_len > m_kvcache_desc.total_size) {
         OPENVINO_THROW("Currently static pipeline only process up to " + std::to_string(m_kvcache_desc.total_size) + " tokens");
     }
 
-    // NB: Reset tensors on every generate call - chat conversation isn't supported yet!
-    prepare_for_new_conversation();
+    const auto* input_ids_data = input_ids.data<const int64_t>();
+    // NB: Sampling works directly on logits of the model which has been inferred last
+    std::optional<RandomSampling> sampling;
+    if (config.is_multinomial()) {
+        sampling.emplace(config, input_ids_data, prompt_len);
+    }
+    auto select_token = [&](ov::Tensor logits) {
+        if (!sampling) {
+            return utils::argmax(logits, 0);
+        }
+        TokenIdScore out_token = sampling->get_out_token(logits);
+        results.scores[0] += out_token.score;
+        return out_token.id;
+    };
+
+    int64_t last_token;
+    if (is_continuation) {
+        last_token = select_token(append_tokens(input_ids_data, prompt_len));
+    } else if (prompt_len <= m_prefill_buckets.back().size) {
+        last_token = select_token(prefill(input_ids, attention_mask));
+    } else {
+        // NB: Prompt head is prefilled, so the rest of prompt consists of full chunks
+        const size_t head_len = prompt_len - (prompt_len - 1u) / m_prefill_chunk_size * m_prefill_chunk_size;
+        prefill(ov::Tensor(input_ids, {0u, 0u}, {1u, head_len}), ov::Tensor(attention_mask, {0u, 0u}, {1u, head_len}));
+        last_token = select_token(append_tokens(input_ids_data + head_len, prompt_len - head_len));
+    }
 
-    auto padded_input_ids = m_prefill_request.get_tensor("input_ids");
+    const size_t max_tokens = config.get_max_new_tokens(prompt_len);
+    while (true) {
+        results.tokens[0].push_back(last_token);
+
+        if (streamer_ptr && utils::stream_single_sequence_token(*streamer_ptr, last_token)) {
+            break;
+        }
+
+        if (results.tokens[0].size() >= max_tokens) {
+            break;
+        }
+
+        if (!config.ignore_eos && last_token == config.eos_token_id) {
+            break;
+        }
+
+        // NB: KV-cache is full, further generation is impossible
+        if (m_kvcache_desc.num_stored_tokens == m_kvcache_desc.total_size) {
+            break;
+        }
+
+        infer_kvcache_step(last_token);
+        last_token = select_token(m_kvcache_request.get_tensor("logits"));
+    }
+
+    if (m_is_chat_conversation) {
+        // NB: The last generated token isn't passed to the model, so it isn't stored in KV-cache
+        const auto* input_ids_data = input_ids.data<const int64_t>();
+        m_tokenized_chat_history.insert(m_tokenized_chat_history.end(), input_ids_data, input_ids_data + prompt_len);
+        m_tokenized_chat_history.insert(m_tokenized_chat_history.end(), results.tokens[0].begin(), results.tokens[0].end());
+        m_tokenized_chat_history.resize(m_kvcache_desc.num_stored_tokens);
+    }
+    return results;
+}
+
+ov::Tensor StaticLLMPipeline::prefill(const ov::Tensor& input_ids, const ov::Tensor& attention_mask) {
+    const auto prompt_len = input_ids.get_size();
+
+    // NB: The smallest prefill model which fits the prompt is used
+    auto bucket = std::find_if(m_prefill_buckets.begin(), m_prefill_buckets.end(), [prompt_len](const PrefillBucket& bucket) {
+        return bucket.size >= prompt_len;
+    });
+    OPENVINO_ASSERT(bucket != m_prefill_buckets.end());
+    auto& prefill_request = bucket->request;
+
+    auto padded_input_ids = prefill_request.get_tensor("input_ids");
+    fill_tensor(padded_input_ids, m_tokenizer.get_pad_token_id());
     copy_with_left_offset(input_ids, padded_input_ids);
 
-    auto padded_attention_mask = m_prefill_request.get_tensor("attention_mask");
+    auto padded_attention_mask = prefill_request.get_tensor("attention_mask");
+    fill_tensor(padded_attention_mask, 0u);
     copy_with_left_offset(attention_mask, padded_attention_mask);
 
-    auto padded_position_ids = m_prefill_request.get_tensor("position_ids");
+    auto padded_position_ids = prefill_request.get_tensor("position_ids");
+    fill_tensor(padded_position_ids, 0u);
     auto* padded_pos_data = padded_position_ids.data<int64_t>();
-    std::iota(padded_pos_data + (m_kvcache_desc.total_size - prompt_len + 1), padded_pos_data + padded_position_ids.get_size(), 0u);
+    std::iota(padded_pos_data + (bucket->size - prompt_len), padded_pos_data + padded_position_ids.get_size(), 0u);
 
-    m_prefill_request.infer();
+    prefill_request.infer();
 
     // NB: Now there are prompt_len tokens in KV-cache
     m_kvcache_desc.num_stored_tokens += prompt_len;
-    int64_t last_token = utils::argmax(m_prefill_request.get_tensor("logits"), 0);
-    if (streamer_ptr && streamer_ptr->put(last_token)) {
-        return results;
-    }
 
-    padded_attention_mask.copy_to(m_kvcache_request.get_tensor("attention_mask"));
+    // NB: KV-cache is filled from the right, so prefill outputs occupy its last bucket->size slots
+    auto kvcache_attention_mask = m_kvcache_request.get_tensor("attention_mask");
+    std::copy_n(padded_attention_mask.data<int64_t>(), bucket->size,
+                kvcache_attention_mask.data<int64_t>() + (m_kvcache_desc.total_size - bucket->size));
 
+    if (!bucket->writes_to_kvcache) {
+        // Outputs: logits, ...
+        const auto kStartOutputKVCacheLayers = 1u;
 
-    // Inputs: input_ids, attention_mask, position_ids, ...
-    // Outputs: logits, ...
-    const auto kStartInputKVCacheLayers = 3u;
-    const auto kStartOutputKVCacheLayers = 1u;
-
-    const auto& kvcache_compiled = m_kvcache_request.get_compiled_model();
-    for (int i = 0; i < kvcache_compiled.outputs().size() - 1; ++i) {
-        const auto& input_name = kvcache_compiled.inputs()[kStartInputKVCacheLayers + i].get_any_name();
-        const auto& output_name = kvcache_compiled.outputs()[kStartOutputKVCacheLayers + i].get_any_name();
-        auto kvcache_out_tensor = m_kvcache_request.get_tensor(output_name);
-        m_kvcache_request.set_tensor(input_name, kvcache_out_tensor);
-        auto prefill_tensor = m_prefill_request.get_tensor(output_name);
-        auto kvcache_tensor = m_kvcache_request.get_tensor(input_name);
-        prefill_tensor.copy_to(kvcache_tensor);
+        const auto& kvcache_compiled = m_kvcache_request.get_compiled_model();
+        for (int i = 0; i < kvcache_compiled.outputs().size() - 1; ++i) {
+            const auto& output_name = kvcache_compiled.outputs()[kStartOutputKVCacheLayers + i].get_any_name();
+            auto kvcache_tail = get_kvcache_tail(m_kvcache_request.get_tensor(output_name), bucket->size);
+            prefill_request.get_tensor(output_name).copy_to(kvcache_tail);
+        }
     }
 
-    auto* input_ids_data = m_kvcache_request.get_tensor("input_ids").data<int64_t>();
-    auto* position_ids_data = m_kvcache_request.get_tensor("position_ids").data<int64_t>();
-    auto* attention_mask_data = m_kvcache_request.get_tensor("attention_mask").data<int64_t>();
+    return prefill_request.get_tensor("logits");
+}
 
-    const size_t max_tokens = config.get_max_new_tokens(prompt_len);
-    for (int i = 0; i < max_tokens - 1; ++i) {
-        input_ids_data[0] = last_token;
-        position_ids_data[0] = m_kvcache_desc.num_stored_tokens;
-        attention_mask_data[m_kvcache_desc.total_size - m_kvcache_desc.num_stored_tokens - 1] = 1u;
+// NB: Tokens are appended to KV-cache by chunks as long as they fit, the rest is appended one by one
+ov::Tensor StaticLLMPipeline::append_tokens(const int64_t* tokens, size_t num_tokens) {
+    ov::InferRequest* last_request = nullptr;
+    size_t i = 0;
+    if (m_prefill_chunk_size > 0u) {
+        for (; i + m_prefill_chunk_size <= num_tokens; i += m_prefill_chunk_size) {
+            infer_prefill_chunk(tokens + i);
+            last_request = &m_prefill_chunk_request;
+        }
+    }
+    for (; i < num_tokens; ++i) {
+        infer_kvcache_step(tokens[i]);
+        last_request = &m_kvcache_request;
+    }
+    OPENVINO_ASSERT(last_request != nullptr);
+    return last_request->get_tensor("logits");
+}
 
-        m_kvcache_request.infer();
-        m_kvcache_desc.num_stored_tokens += 1;
+void StaticLLMPipeline::infer_prefill_chunk(const int64_t* tokens) {
+    auto* input_ids_data = m_prefill_chunk_request.get_tensor("input_ids").data<int64_t>();
+    auto* position_ids_data = m_prefill_chunk_request.get_tensor("position_ids").data<int64_t>();
+    auto* attention_mask_data = m_prefill_chunk_request.get_tensor("attention_mask").data<int64_t>();
 
-        last_token = utils::argmax(m_kvcache_request.get_tensor("logits"), 0);
-        results.tokens[0].push_back(last_token);
-        results.scores[0] = 0u;
+    std::copy_n(tokens, m_prefill_chunk_size, input_ids_data);
+    std::iota(position_ids_data, position_ids_data + m_prefill_chunk_size, m_kvcache_desc.num_stored_tokens);
+    // NB: KV-cache slots are shifted left by chunk size, new tokens occupy the last ones
+    std::fill_n(attention_mask_data + (m_kvcache_desc.total_size - m_kvcache_desc.num_stored_tokens - m_prefill_chunk_size),
+                m_prefill_chunk_size, 1u);
 
-        if (streamer_ptr && streamer_ptr->put(last_token)) {
-            break;
-        }
+    m_prefill_chunk_request.infer();
+    m_kvcache_desc.num_stored_tokens += m_prefill_chunk_size;
+}
 
-        if (last_token == m_generation_config.eos_token_id) {
-            break;
-        }
+void StaticLLMPipeline::infer_kvcache_step(int64_t token) {
+    auto* input_ids_data = m_kvcache_request.get_tensor("input_ids").data<int64_t>();
+    auto* position_ids_data = m_kvcache_request.get_tensor("position_ids").data<int64_t>();
+    auto* attention_mask_data = m_kvcache_request.get_tensor("attention_mask").data<int64_t>();
 
-        // NB: KV-cache is full, further generation is impossible
-        if (m_kvcache_desc.num_stored_tokens == m_kvcache_desc.total_size) {
-            break;
-        }
+    input_ids_data[0] = token;
+    position_ids_data[0] = m_kvcache_desc.num_stored_tokens;
+    attention_mask_data[m_kvcache_desc.total_size - m_kvcache_desc.num_stored_tokens - 1] = 1u;
 
-    }
-    return results;
+    m_kvcache_request.infer();
+    m_kvcache_desc.num_stored_tokens += 1;
 }
 
 }  // namespace genai
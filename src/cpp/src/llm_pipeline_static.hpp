@@ -35,25 +35,48 @@ public:
         StreamerVariant streamer
     ) override;
 
-    void start_chat() override {
-        OPENVINO_THROW("Currently chat conversation mode isn't supported");
-    };
-    void finish_chat() override {
-        OPENVINO_THROW("Currently chat conversation mode isn't supported");
-    };
+    void start_chat() override;
+    void finish_chat() override;
 
 private:
     void prepare_for_new_conversation();
+    void reset_chat();
+    TokenizedInputs get_chat_history_tail(const ov::Tensor& chat_history_ids);
+
+    void bind_kvcache_tensors();
+    ov::Tensor get_kvcache_tail(const ov::Tensor& kvcache_tensor, uint32_t num_slots) const;
+    // NB: Return logits of the last processed token
+    ov::Tensor prefill(const ov::Tensor& input_ids, const ov::Tensor& attention_mask);
+    ov::Tensor append_tokens(const int64_t* tokens, size_t num_tokens);
+    void infer_prefill_chunk(const int64_t* tokens);
+    void infer_kvcache_step(int64_t token);
 
 private:
     struct KVCacheDesc {
+        uint32_t max_prompt_size;
         uint32_t total_size;
         uint32_t num_stored_tokens;
     };
 
+    struct PrefillBucket {
+        uint32_t size;
+        ov::InferRequest request;
+        // NB: Whether outputs are bound to KV-cache tensors of kvcache model
+        bool writes_to_kvcache = false;
+    };
+
     KVCacheDesc m_kvcache_desc;
     ov::InferRequest m_kvcache_request;
-    ov::InferRequest m_prefill_request;
+    // NB: Prefill models compiled for different prompt sizes, sorted by size
+    std::vector<PrefillBucket> m_prefill_buckets;
+    // NB: Zero chunk size means that prompt is processed by prefill models only
+    uint32_t m_prefill_chunk_size = 0u;
+    ov::InferRequest m_prefill_chunk_request;
+
+    bool m_is_chat_conversation = false;
+    ChatHistory m_history;
+    // NB: Tokens which are stored in KV-cache during chat
+    std::vector<int64_t> m_tokenized_chat_history;
 };
 
 }  // namespace genai
@@ -0,0 +1,170 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "random_sampling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+using ov::genai::TokenIdScore;
+
+// the number of candidates, which are selected first when nucleus of the whole vocab is searched
+constexpr size_t INITIAL_TOP_P_CANDIDATES = 64;
+
+// Selects num_candidates tokens with the largest logits sorted by descending logit. A min-heap of candidates is kept,
+// so most of logits are only compared with its top and the vocab is neither copied nor sorted
+void select_top_tokens(const float* logits, size_t vocab_size, size_t num_candidates, std::vector<TokenIdScore>& candidates) {
+    candidates.resize(num_candidates);
+    for (size_t id = 0; id < num_candidates; ++id) {
+        candidates[id] = TokenIdScore{int64_t(id), logits[id]};
+    }
+    const auto comparator = std::greater<TokenIdScore>();
+    std::make_heap(candidates.begin(), candidates.end(), comparator);
+    for (size_t id = num_candidates; id < vocab_size; ++id) {
+        if (logits[id] > candidates.front().score) {
+            std::pop_heap(candidates.begin(), candidates.end(), comparator);
+            candidates.back() = TokenIdScore{int64_t(id), logits[id]};
+            std::push_heap(candidates.begin(), candidates.end(), comparator);
+        }
+    }
+    std::sort_heap(candidates.begin(), candidates.end(), comparator);
+}
+
+float max_logit(const float* logits, size_t vocab_size) {
+    float max_value = logits[0];
+    for (size_t id = 1; id < vocab_size; ++id) {
+        max_value = std::max(max_value, logits[id]);
+    }
+    return max_value;
+}
+
+// sum of unnormalized probabilities exp((logit - max_value) * inv_temperature) of the whole vocab
+float exp_sum(const float* logits, size_t vocab_size, float max_value, float inv_temperature) {
+    float sum = 0.f;
+    for (size_t id = 0; id < vocab_size; ++id) {
+        sum += std::exp((logits[id] - max_value) * inv_temperature);
+    }
+    return sum;
+}
+
+// replaces logits of candidates sorted by descending logit with unnormalized probabilities, returns their sum
+float candidates_to_probs(std::vector<TokenIdScore>& candidates, float inv_temperature) {
+    const float max_value = candidates.front().score;
+    float sum = 0.f;
+    for (TokenIdScore& candidate : candidates) {
+        candidate.score = std::exp((candidate.score - max_value) * inv_temperature);
+        sum += candidate.score;
+    }
+    return sum;
+}
+
+// keeps the smallest prefix of candidates sorted by descending probability, which total probability reaches top_p
+float cut_nucleus(std::vector<TokenIdScore>& candidates, float probs_sum, float top_p) {
+    const float threshold = top_p * probs_sum;
+    float prefix_sum = 0.f;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        prefix_sum += candidates[i].score;
+        if (prefix_sum >= threshold) {
+            candidates.resize(i + 1);
+            return prefix_sum;
+        }
+    }
+    return prefix_sum;
+}
+
+}  // namespace
+
+namespace ov {
+namespace genai {
+
+RandomSampling::RandomSampling(ov::genai::GenerationConfig generation_config, const int64_t* prompt_ids, size_t prompt_len)
+    : top_k{generation_config.top_k},
+      top_p{generation_config.top_p},
+      inv_temperature{1.f / generation_config.temperature},
+      repetition_penalty{generation_config.repetition_penalty} {
+    if (repetition_penalty != 1.0f) {
+        for (size_t i = 0; i < prompt_len; ++i) {
+            register_token(prompt_ids[i]);
+        }
+    }
+}
+
+void RandomSampling::register_token(int64_t token) {
+    if (repetition_penalty == 1.0f) {
+        return;
+    }
+    if (size_t(token) >= m_is_penalized.size()) {
+        m_is_penalized.resize(token + 1, false);
+    }
+    if (!m_is_penalized[token]) {
+        m_is_penalized[token] = true;
+        m_penalized_tokens.push_back(token);
+    }
+}
+
+TokenIdScore RandomSampling::get_out_token(float* logits, size_t vocab_size) {
+    for (int64_t id : m_penalized_tokens) {
+        logits[id] *= (logits[id] > 0) ? 1.f / repetition_penalty : repetition_penalty;
+    }
+
+    // Temperature doesn't change order of logits, so candidates are selected by raw logits and
+    // softmax is computed only over them
+    float probs_sum;
+    if (0 < top_k && top_k < vocab_size) {
+        select_top_tokens(logits, vocab_size, top_k, m_candidates);
+        probs_sum = candidates_to_probs(m_candidates, inv_temperature);
+        if (0.f < top_p && top_p < 1.0f) {
+            probs_sum = cut_nucleus(m_candidates, probs_sum, top_p);
+        }
+    } else if (0.f < top_p && top_p < 1.0f) {
+        // nucleus is searched among growing number of the most probable tokens, until their probability reaches top_p
+        const float max_value = max_logit(logits, vocab_size);
+        const float vocab_probs_sum = exp_sum(logits, vocab_size, max_value, inv_temperature);
+        size_t num_candidates = std::min(INITIAL_TOP_P_CANDIDATES, vocab_size);
+        while (true) {
+            select_top_tokens(logits, vocab_size, num_candidates, m_candidates);
+            probs_sum = candidates_to_probs(m_candidates, inv_temperature);
+            // the most probable candidate has the same unnormalized probability 1 in candidates and the vocab
+            if (probs_sum >= top_p * vocab_probs_sum || num_candidates == vocab_size) {
+                break;
+            }
+            num_candidates = std::min(2 * num_candidates, vocab_size);
+        }
+        probs_sum = cut_nucleus(m_candidates, vocab_probs_sum, top_p);
+    } else {
+        // the whole vocab is sampled, its probabilities are stored in logits
+        const float max_value = max_logit(logits, vocab_size);
+        probs_sum = 0.f;
+        for (size_t id = 0; id < vocab_size; ++id) {
+            logits[id] = std::exp((logits[id] - max_value) * inv_temperature);
+            probs_sum += logits[id];
+        }
+        float threshold = std::uniform_real_distribution<float>{0.f, probs_sum}(gen);
+        size_t id = 0;
+        for (; id + 1 < vocab_size && threshold >= logits[id]; ++id) {
+            threshold -= logits[id];
+        }
+        register_token(id);
+        return TokenIdScore{int64_t(id), logits[id] / probs_sum};
+    }
+
+    float threshold = std::uniform_real_distribution<float>{0.f, probs_sum}(gen);
+    size_t idx = 0;
+    for (; idx + 1 < m_candidates.size() && threshold >= m_candidates[idx].score; ++idx) {
+        threshold -= m_candidates[idx].score;
+    }
+    register_token(m_candidates[idx].id);
+    return TokenIdScore{m_candidates[idx].id, m_candidates[idx].score / probs_sum};
+}
+
+TokenIdScore RandomSampling::get_out_token(ov::Tensor& logits, size_t batch_idx) {
+    const ov::Shape& shape = logits.get_shape();
+    size_t seq_len = shape.at(1);
+    size_t vocab_size = shape.back();
+    return get_out_token(logits.data<float>() + (batch_idx * seq_len + seq_len - 1) * vocab_size, vocab_size);
+}
+
+}  // namespace genai
+}  // namespace ov
@@ -0,0 +1,61 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <random>
+#include <vector>
+
+#include <openvino/runtime/tensor.hpp>
+
+#include "openvino/genai/generation_config.hpp"
+
+namespace ov {
+namespace genai {
+
+struct TokenIdScore {
+    int64_t id;
+    float score;
+
+    bool operator<(const TokenIdScore& other) const {
+        return score < other.score;
+    }
+
+    bool operator>(const TokenIdScore& other) const {
+        return score > other.score;
+    }
+};
+
+// Multinomial sampling with top_k, top_p, temperature and repetition penalty, which is shared by pipelines.
+// An instance samples a single sequence: it keeps the set of its tokens for repetition penalty and its own
+// random generator, so sequences of a batch can be sampled in parallel by their instances.
+struct RandomSampling {
+    const size_t top_k;
+    const float top_p;
+    const float inv_temperature;
+    const float repetition_penalty;
+
+    std::mt19937 gen{std::random_device{}()};
+
+    // prompt tokens are penalized as well as generated ones
+    RandomSampling(ov::genai::GenerationConfig generation_config, const int64_t* prompt_ids = nullptr, size_t prompt_len = 0);
+
+    // sampled token is registered for repetition penalty; penalized logits are modified in place
+    TokenIdScore get_out_token(float* logits, size_t vocab_size);
+
+    // samples from the last position of batch_idx row of [batch, seq_len, vocab_size] logits
+    TokenIdScore get_out_token(ov::Tensor& logits, size_t batch_idx = 0);
+
+    // registers a token for repetition penalty, it's done incrementally, so it doesn't depend on sequence length
+    void register_token(int64_t token);
+
+private:
+    // distinct tokens of the sequence, their occurrence is a bitset indexed by token ids
+    std::vector<int64_t> m_penalized_tokens;
+    std::vector<bool> m_is_penalized;
+    // candidates buffer is reused between steps
+    std::vector<TokenIdScore> m_candidates;
+};
+
+}  // namespace genai
+}  // namespace ov
@@ -0,0 +1,238 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "session_state_cache.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// file layout: magic, version, number of tokens, tokens, number of states and for each state:
+// name, element type, rank, dimensions, byte size and data; integers are stored in host byte order
+constexpr uint32_t SESSION_MAGIC = 0x5353564F; // "OVSS"
+constexpr uint32_t SESSION_VERSION = 1;
+const char SESSION_EXTENSION[] = ".state";
+
+template <typename T>
+void write_value(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void write_string(std::ofstream& file, const std::string& str) {
+    write_value<uint64_t>(file, str.size());
+    file.write(str.data(), str.size());
+}
+
+template <typename T>
+T read_value(std::ifstream& file) {
+    T value{};
+    file.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+std::string read_string(std::ifstream& file) {
+    const uint64_t size = read_value<uint64_t>(file);
+    // names of states and element types are short, a larger size means a damaged file
+    OPENVINO_ASSERT(file && size <= 4096, "Session file is damaged");
+    std::string str(size, '\0');
+    file.read(str.data(), size);
+    return str;
+}
+
+// reads header and tokens of a session file; returns false if it's not a session file
+bool read_session_tokens(std::ifstream& file, std::vector<int64_t>& token_ids) {
+    if (read_value<uint32_t>(file) != SESSION_MAGIC || read_value<uint32_t>(file) != SESSION_VERSION)
+        return false;
+    const uint64_t num_tokens = read_value<uint64_t>(file);
+    const auto tokens_begin = file.tellg();
+    file.seekg(0, std::ios::end);
+    if (!file || num_tokens == 0 || num_tokens > static_cast<uint64_t>(file.tellg() - tokens_begin) / sizeof(int64_t))
+        return false;
+    file.seekg(tokens_begin);
+    token_ids.resize(num_tokens);
+    file.read(reinterpret_cast<char*>(token_ids.data()), num_tokens * sizeof(int64_t));
+    return static_cast<bool>(file);
+}
+
+}  // namespace
+
+namespace ov {
+namespace genai {
+
+size_t SessionStateCache::compute_hash(const int64_t* token_ids, size_t num_tokens, size_t hash) {
+    for (size_t token_idx = 0; token_idx < num_tokens; ++token_idx)
+        hash ^= std::hash<int64_t>()(token_ids[token_idx]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+size_t SessionStateCache::compute_first_block_hash(const int64_t* token_ids, size_t num_tokens) {
+    return compute_hash(token_ids, std::min(num_tokens, BLOCK_SIZE));
+}
+
+void SessionStateCache::_insert(Session session) {
+    m_sessions.push_front(std::move(session));
+    m_hash_2_session[m_sessions.front().hash] = m_sessions.begin();
+    m_first_block_2_sessions.emplace(m_sessions.front().first_block_hash, m_sessions.begin());
+    while (m_sessions.size() > m_capacity) {
+        std::filesystem::remove(m_sessions.back().path);
+        _erase(std::prev(m_sessions.end()));
+    }
+}
+
+void SessionStateCache::_erase(std::list<Session>::iterator session_it) {
+    auto [begin, end] = m_first_block_2_sessions.equal_range(session_it->first_block_hash);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == session_it) {
+            m_first_block_2_sessions.erase(it);
+            break;
+        }
+    }
+    m_hash_2_session.erase(session_it->hash);
+    m_sessions.erase(session_it);
+}
+
+SessionStateCache::SessionStateCache(const std::filesystem::path& dir, size_t capacity) : m_dir(dir), m_capacity(capacity) {
+    OPENVINO_ASSERT(m_capacity > 0, "Capacity of session cache must be positive");
+    std::filesystem::create_directories(m_dir);
+    // the most recently written files are the most recently used sessions
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(m_dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == SESSION_EXTENSION)
+            paths.emplace_back(entry.last_write_time(), entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+    for (const auto& [time, path] : paths) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<int64_t> token_ids;
+        if (read_session_tokens(file, token_ids)) {
+            const size_t hash = compute_hash(token_ids.data(), token_ids.size());
+            auto session_it = m_hash_2_session.find(hash);
+            if (session_it != m_hash_2_session.end())
+                _erase(session_it->second);
+            const size_t first_block_hash = compute_first_block_hash(token_ids.data(), token_ids.size());
+            _insert({path, std::move(token_ids), hash, first_block_hash});
+        }
+    }
+}
+
+void SessionStateCache::store(const std::vector<int64_t>& token_ids, ov::InferRequest& request) {
+    OPENVINO_ASSERT(!token_ids.empty(), "Session without tokens cannot be stored");
+    const size_t hash = compute_hash(token_ids.data(), token_ids.size());
+    std::stringstream file_name;
+    file_name << std::hex << hash << SESSION_EXTENSION;
+    const std::filesystem::path path = m_dir / file_name.str();
+    // a partially written file is not a valid session, so it's renamed after it's written completely
+    std::filesystem::path tmp_path = path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        write_value(file, SESSION_MAGIC);
+        write_value(file, SESSION_VERSION);
+        write_value<uint64_t>(file, token_ids.size());
+        file.write(reinterpret_cast<const char*>(token_ids.data()), token_ids.size() * sizeof(int64_t));
+
+        std::vector<ov::VariableState> states = request.query_state();
+        write_value<uint64_t>(file, states.size());
+        for (ov::VariableState& state : states) {
+            ov::Tensor tensor = state.get_state();
+            write_string(file, state.get_name());
+            write_string(file, tensor.get_element_type().get_type_name());
+            write_value<uint64_t>(file, tensor.get_shape().size());
+            for (size_t dim : tensor.get_shape())
+                write_value<uint64_t>(file, dim);
+            write_value<uint64_t>(file, tensor.get_byte_size());
+            file.write(static_cast<const char*>(tensor.data()), tensor.get_byte_size());
+        }
+        file.close();
+        OPENVINO_ASSERT(!file.fail(), "Session cannot be written to ", tmp_path.string());
+    }
+    std::filesystem::rename(tmp_path, path);
+
+    // stored prefixes of the conversation are replaced by it: prefixes of the first block length or longer have
+    // the same first block, while hashes of shorter ones are intermediate values of hash of the first block
+    std::vector<std::list<Session>::iterator> prefixes;
+    const size_t first_block_hash = compute_first_block_hash(token_ids.data(), token_ids.size());
+    auto [begin, end] = m_first_block_2_sessions.equal_range(first_block_hash);
+    for (auto it = begin; it != end; ++it) {
+        const std::vector<int64_t>& session_token_ids = it->second->token_ids;
+        if (session_token_ids.size() >= std::min(token_ids.size(), BLOCK_SIZE) &&
+            session_token_ids.size() <= token_ids.size() &&
+            std::equal(session_token_ids.begin(), session_token_ids.end(), token_ids.begin()))
+            prefixes.push_back(it->second);
+    }
+    size_t prefix_hash = 0;
+    for (size_t prefix_len = 1; prefix_len < std::min(token_ids.size(), BLOCK_SIZE); ++prefix_len) {
+        prefix_hash = compute_hash(token_ids.data() + prefix_len - 1, 1, prefix_hash);
+        auto session_it = m_hash_2_session.find(prefix_hash);
+        if (session_it != m_hash_2_session.end() && session_it->second->token_ids.size() == prefix_len &&
+            std::equal(token_ids.begin(), token_ids.begin() + prefix_len, session_it->second->token_ids.begin()))
+            prefixes.push_back(session_it->second);
+    }
+    for (auto session_it : prefixes) {
+        // the same conversation is overwritten by the new file
+        if (session_it->path != path)
+            std::filesystem::remove(session_it->path);
+        _erase(session_it);
+    }
+    // a session with colliding hash shares the file name, so it's overwritten
+    auto session_it = m_hash_2_session.find(hash);
+    if (session_it != m_hash_2_session.end())
+        _erase(session_it->second);
+    _insert({path, token_ids, hash, first_block_hash});
+}
+
+std::vector<int64_t> SessionStateCache::restore(const int64_t* token_ids, size_t num_tokens, ov::InferRequest& request) {
+    std::list<Session>::iterator best_session = m_sessions.end();
+    size_t best_common_len = 0;
+    auto [begin, end] = m_first_block_2_sessions.equal_range(compute_first_block_hash(token_ids, num_tokens));
+    for (auto it = begin; it != end; ++it) {
+        const Session& session = *it->second;
+        const size_t max_len = std::min(num_tokens, session.token_ids.size());
+        const size_t common_len = std::mismatch(token_ids, token_ids + max_len, session.token_ids.begin()).first - token_ids;
+        if (common_len > best_common_len) {
+            best_session = it->second;
+            best_common_len = common_len;
+        }
+    }
+    if (best_session == m_sessions.end())
+        return {};
+    m_sessions.splice(m_sessions.begin(), m_sessions, best_session);
+
+    // a removed or damaged file is skipped; the file is touched, so the order of use is kept after restart
+    std::ifstream file(best_session->path, std::ios::binary);
+    std::vector<int64_t> session_token_ids;
+    if (!read_session_tokens(file, session_token_ids) || session_token_ids != best_session->token_ids)
+        return {};
+
+    // states are read directly to tensors, which are set by name
+    std::vector<ov::VariableState> states = request.query_state();
+    OPENVINO_ASSERT(read_value<uint64_t>(file) == states.size(), "Session ", best_session->path.string(), " is stored by another model");
+    for (size_t state_idx = 0; state_idx < states.size(); ++state_idx) {
+        const std::string name = read_string(file);
+        const ov::element::Type element_type(read_string(file));
+        const uint64_t rank = read_value<uint64_t>(file);
+        OPENVINO_ASSERT(file && rank <= 8, "Session file is damaged");
+        ov::Shape shape(rank);
+        for (size_t& dim : shape)
+            dim = read_value<uint64_t>(file);
+        const uint64_t byte_size = read_value<uint64_t>(file);
+        OPENVINO_ASSERT(file && byte_size == (ov::shape_size(shape) * element_type.bitwidth() + 7) / 8, "Session file is damaged");
+        ov::Tensor tensor(element_type, shape);
+        file.read(static_cast<char*>(tensor.data()), tensor.get_byte_size());
+        OPENVINO_ASSERT(file, "Session file is damaged");
+
+        auto state_it = std::find_if(states.begin(), states.end(), [&name] (const ov::VariableState& state) {
+            return state.get_name() == name;
+        });
+        OPENVINO_ASSERT(state_it != states.end(), "Session ", best_session->path.string(), " is stored by another model");
+        state_it->set_state(tensor);
+    }
+    std::error_code error;
+    std::filesystem::last_write_time(best_session->path, std::filesystem::file_time_type::clock::now(), error);
+    return session_token_ids;
+}
+
+}  // namespace genai
+}  // namespace ov
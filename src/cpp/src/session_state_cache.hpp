@@ -0,0 +1,67 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <filesystem>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <openvino/openvino.hpp>
+
+namespace ov {
+namespace genai {
+
+/**
+ * Variable states (KV cache) of finished chat conversations of stateful LLMPipeline stored on disk, so a later
+ * conversation sharing a prefix with a stored one (e.g. the same conversation after restart of the application)
+ * loads them instead of computing the prefix. Each conversation is a file with its tokens and all states, which
+ * is named by the hash of tokens; a stored conversation is replaced by its continuation. Conversations are indexed
+ * by their first block of tokens, so a conversation sharing less than the first block with stored ones computes
+ * the whole prompt, while the least recently used ones are removed over capacity.
+ */
+class SessionStateCache {
+    struct Session {
+        std::filesystem::path path;
+        std::vector<int64_t> token_ids;
+        size_t hash;
+        size_t first_block_hash;
+    };
+
+    std::filesystem::path m_dir;
+    size_t m_capacity;
+    // the most recently stored or restored conversations are at the front
+    std::list<Session> m_sessions;
+    // hash of conversation tokens => stored conversation
+    std::unordered_map<size_t, std::list<Session>::iterator> m_hash_2_session;
+    // hash of the first block of conversation tokens => stored conversations
+    std::unordered_multimap<size_t, std::list<Session>::iterator> m_first_block_2_sessions;
+
+    // hash of the first 'num_tokens' tokens; hash of a prefix is an intermediate value of hash of the whole sequence
+    static size_t compute_hash(const int64_t* token_ids, size_t num_tokens, size_t hash = 0);
+
+    static size_t compute_first_block_hash(const int64_t* token_ids, size_t num_tokens);
+
+    void _insert(Session session);
+
+    void _erase(std::list<Session>::iterator session_it);
+
+public:
+    // number of tokens in the first block, by which conversations are found
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    static constexpr size_t DEFAULT_CAPACITY = 64;
+
+    SessionStateCache(const std::filesystem::path& dir, size_t capacity = DEFAULT_CAPACITY);
+
+    // stores states of 'request', whose KV cache contains 'token_ids'
+    void store(const std::vector<int64_t>& token_ids, ov::InferRequest& request);
+
+    // sets states of a stored conversation, which has the longest common prefix with 'token_ids', to 'request';
+    // returns tokens of the conversation (KV cache is trimmed to the common prefix by caller) or empty vector
+    std::vector<int64_t> restore(const int64_t* token_ids, size_t num_tokens, ov::InferRequest& request);
+};
+
+}  // namespace genai
+}  // namespace ov
@@ -11,40 +11,40 @@ TextCallbackStreamer::TextCallbackStreamer(const Tokenizer& tokenizer, std::func
     on_finalized_subword_callback = callback;
 }
 
+std::pair<std::string, std::string> TextCallbackStreamer::decode_cache() {
+    if (m_read_offset == 0)
+        return {"", m_tokenizer.decode(m_tokens_cache)};
+    std::vector<int64_t> printed_tokens(m_tokens_cache.begin(), m_tokens_cache.begin() + m_read_offset);
+    std::vector<std::string> texts = m_tokenizer.decode(std::vector<std::vector<int64_t>>{printed_tokens, m_tokens_cache});
+    return {texts[0], texts[1]};
+}
+
 bool TextCallbackStreamer::put(int64_t token) {
-    std::stringstream res;
     m_tokens_cache.push_back(token);
-    std::string text = m_tokenizer.decode(m_tokens_cache);
-    if (!text.empty() && '\n' == text.back() && text.size() > print_len) {
-        // Flush the cache after the new line symbol
-        res << std::string_view{text.data() + print_len, text.size() - print_len};
-        m_tokens_cache.clear();
-        print_len = 0;
-        return on_finalized_subword_callback(res.str());
-    }
-
-    if (text.size() >= 3 && text.compare(text.size() - 3, 3, "�") == 0) {
-        // Don't print incomplete text
-        return on_finalized_subword_callback(res.str());
-    } else if (text.size() > print_len) {
-        // It is possible to have a shorter text after adding new token.
-        // Print to output only if text lengh is increaesed.
-        res << std::string_view{text.data() + print_len, text.size() - print_len} << std::flush;
-        print_len = text.size();
+    // decoding of a token can depend on previous ones (e.g. leading spaces or UTF-8 symbols split between tokens),
+    // so new tokens are decoded together with tokens printed on the previous call, and only the text difference is printed
+    auto [printed_text, text] = decode_cache();
+
+    if (text.size() <= printed_text.size() || (text.size() >= 3 && text.compare(text.size() - 3, 3, "�") == 0)) {
+        // Don't print incomplete text.
+        // It is possible to have a shorter text after adding new token, print to output only if text lengh is increaesed.
+        return on_finalized_subword_callback("");
     }
 
-    return on_finalized_subword_callback(res.str());
+    std::string new_text = text.substr(printed_text.size());
+    // only just printed tokens are kept as a context, so decoded windows stay short regardless of generation length
+    m_tokens_cache.erase(m_tokens_cache.begin(), m_tokens_cache.begin() + m_read_offset);
+    m_read_offset = m_tokens_cache.size();
+    return on_finalized_subword_callback(new_text);
 }
 
 void TextCallbackStreamer::end() {
-    std::stringstream res;
-    std::string text = m_tokenizer.decode(m_tokens_cache);
-    if (text.size() <= print_len)
-        return ;
-    res << std::string_view{text.data() + print_len, text.size() - print_len} << std::flush;
+    auto [printed_text, text] = decode_cache();
     m_tokens_cache.clear();
-    print_len = 0;
-    on_finalized_subword_callback(res.str());
+    m_read_offset = 0;
+    if (text.size() <= printed_text.size())
+        return ;
+    on_finalized_subword_callback(text.substr(printed_text.size()));
     return;
 }
 
@@ -19,8 +19,13 @@ public:
     std::function<bool(std::string)> on_finalized_subword_callback = [](std::string words)->bool { return false; };
 private:
     Tokenizer m_tokenizer;
+    // already printed tokens, which are kept as a context for decoding of the following ones, and not printed tokens
     std::vector<int64_t> m_tokens_cache;
-    size_t print_len = 0;
+    // a number of printed tokens in the cache
+    size_t m_read_offset = 0;
+
+    // decodes printed tokens of the cache and the whole cache in a single detokenizer call
+    std::pair<std::string, std::string> decode_cache();
 };
 
 }  // namespace genai
@@ -7,7 +7,13 @@
 #include <jinja2cpp/template.h>
 #include <jinja2cpp/template_env.h>
 #include "tokenizers_path.hpp"
+#include "tokenization_cache.hpp"
+#include <algorithm>
+#include <condition_variable>
 #include <fstream>
+#include <future>
+#include <mutex>
+#include <thread>
 
 namespace {
 
@@ -44,6 +50,67 @@ ov::genai::TokenizedInputs pad_left(ov::Tensor& input_ids, ov::Tensor& attention
     return {input_ids, attention_mask};
 }
 
+// Infer requests of the same compiled model shared by concurrent callers: a caller takes an idle request
+// or creates a new one, until the pool reaches its size, and waits for an idle request otherwise
+class InferRequestPool {
+    ov::CompiledModel m_compiled_model;
+    size_t m_max_size = 0;
+    size_t m_num_created = 0;
+    std::vector<ov::InferRequest> m_idle_requests;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    ov::InferRequest acquire() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return !m_idle_requests.empty() || m_num_created < m_max_size; });
+        if (!m_idle_requests.empty()) {
+            ov::InferRequest request = std::move(m_idle_requests.back());
+            m_idle_requests.pop_back();
+            return request;
+        }
+        ++m_num_created;
+        lock.unlock();
+        return m_compiled_model.create_infer_request();
+    }
+
+    void release(ov::InferRequest request) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_idle_requests.push_back(std::move(request));
+        }
+        m_cv.notify_one();
+    }
+
+public:
+    InferRequestPool() = default;
+
+    InferRequestPool(ov::CompiledModel compiled_model, size_t max_size)
+        : m_compiled_model(std::move(compiled_model)), m_max_size(std::max<size_t>(max_size, 1)) {
+        // at least one request is always created, e.g. to validate the model
+        release(acquire());
+    }
+
+    // runs 'func' with exclusively owned infer request and returns its result
+    template <typename Func>
+    auto run(Func&& func) {
+        struct Releaser {
+            InferRequestPool& m_pool;
+            ov::InferRequest m_request;
+            ~Releaser() { m_pool.release(std::move(m_request)); }
+        } releaser{*this, acquire()};
+        return func(releaser.m_request);
+    }
+};
+
+ov::Tensor copy_tensor(const ov::Tensor& tensor) {
+    ov::Tensor copy(tensor.get_element_type(), tensor.get_shape());
+    tensor.copy_to(copy);
+    return copy;
+}
+
+// a number of infer requests of each tokenizer model
+const size_t infer_request_pool_size = std::max(1u, std::thread::hardware_concurrency());
+
 constexpr char bos_token_key_name[] = "bos_token";
 constexpr char eos_token_key_name[] = "eos_token";      
 constexpr char pad_token_key_name[] = "pad_token";
@@ -55,8 +122,10 @@ namespace genai {
 
 class Tokenizer::TokenizerImpl {
 public:
-    ov::InferRequest m_tokenize_request;
-    ov::InferRequest m_detokenizer_request;
+    // tokenizer can be used from many threads concurrently
+    std::unique_ptr<InferRequestPool> m_tokenize_requests;
+    std::unique_ptr<InferRequestPool> m_detokenizer_requests;
+    TokenizationCache m_cache;
     int64_t m_pad_token_id = -1;
     int64_t m_bos_token_id = -1;
     int64_t m_eos_token_id = -1;
@@ -71,14 +140,18 @@ public:
 
     TokenizerImpl(std::filesystem::path tokenizer_path)
         : m_chat_template{chat_template_from_tokenizer_json_if_exists(tokenizer_path)} {
-        ov::Core core;
+        ov::Core& core = ov::genai::utils::singleton_core();
         
         if (tokenizer_path.extension() == ".xml")
             OPENVINO_THROW("ov_tokenizers_path should be a path to a dir not a xml file");
 
         const char* ov_tokenizers_path = getenv(ScopedVar::ENVIRONMENT_VARIABLE_NAME);
         if (ov_tokenizers_path) {
-            core.add_extension(ov_tokenizers_path);
+            // extension is registered in the shared core by the first tokenizer
+            static std::once_flag extension_flag;
+            std::call_once(extension_flag, [&core, ov_tokenizers_path] {
+                core.add_extension(ov_tokenizers_path);
+            });
         } else {
             OPENVINO_THROW("openvino_tokenizers path is not set");
         }
@@ -90,10 +163,13 @@ public:
         read_tokenizer_config_if_necessary(tokenizer_path); 
 
         auto device = "CPU"; // currently openvino_tokenizer supports only CPU
-        m_tokenize_request = core.compile_model(tokenizer_path / "openvino_tokenizer.xml", 
-                                                device).create_infer_request();
-        m_detokenizer_request = core.compile_model(tokenizer_path / "openvino_detokenizer.xml", 
-                                                   device).create_infer_request();
+        // tokenizer and detokenizer are independent, so they are compiled concurrently
+        auto detokenizer_model = std::async(std::launch::async, [&core, &tokenizer_path, device] {
+            return core.compile_model(tokenizer_path / "openvino_detokenizer.xml", device);
+        });
+        m_tokenize_requests = std::make_unique<InferRequestPool>(
+            core.compile_model(tokenizer_path / "openvino_tokenizer.xml", device), infer_request_pool_size);
+        m_detokenizer_requests = std::make_unique<InferRequestPool>(detokenizer_model.get(), infer_request_pool_size);
 
         // Get special token ids by inference if they are not defined.
         // todo: do not call until CVS-143410 is resolved
@@ -226,25 +302,108 @@ public:
     }
 
     TokenizedInputs encode(std::string prompt) {
+        // callers of generate() write to input tensors, so copies of cached tensors are returned;
+        // a single prompt is not padded, so its attention mask consists of ones
+        ov::Tensor cached_input_ids;
+        if (m_cache.get(prompt, cached_input_ids)) {
+            ov::Tensor attention_mask{ov::element::i64, cached_input_ids.get_shape()};
+            std::fill_n(attention_mask.data<int64_t>(), attention_mask.get_size(), 1);
+            return {copy_tensor(cached_input_ids), attention_mask};
+        }
+
         size_t batch_size = 1;
-        m_tokenize_request.set_input_tensor(ov::Tensor{ov::element::string, {batch_size}, &prompt});
-        m_tokenize_request.infer();
-        return get_copied_results();
+        TokenizedInputs res = m_tokenize_requests->run([&](ov::InferRequest& request) {
+            request.set_input_tensor(ov::Tensor{ov::element::string, {batch_size}, &prompt});
+            request.infer();
+            return get_copied_results(request);
+        });
+        m_cache.put(prompt, copy_tensor(res.input_ids));
+        return res;
     }
 
     TokenizedInputs encode(std::vector<std::string>& prompts) {
-        m_tokenize_request.set_input_tensor(ov::Tensor{ov::element::string, {prompts.size()}, prompts.data()});
-        auto size_ = m_tokenize_request.get_input_tensor().get_shape();
-        m_tokenize_request.infer();
-       
-        auto res = get_copied_results();
+        auto res = encode_right_padded(prompts);
         pad_left(res.input_ids, res.attention_mask);
         return {res.input_ids, res.attention_mask};
     }
 
-    TokenizedInputs get_copied_results() {
-        auto input_ids = m_tokenize_request.get_tensor("input_ids");
-        auto attention_mask = m_tokenize_request.get_tensor("attention_mask");
+    // tokenizer pads sequences on the right
+    TokenizedInputs encode_right_padded(std::vector<std::string>& prompts) {
+        return m_tokenize_requests->run([&](ov::InferRequest& request) {
+            request.set_input_tensor(ov::Tensor{ov::element::string, {prompts.size()}, prompts.data()});
+            request.infer();
+            return get_copied_results(request);
+        });
+    }
+
+    // prompts encoded by concurrent callers within a batching window
+    struct PendingPrompt {
+        std::string m_prompt;
+        std::promise<TokenizedInputs> m_result;
+    };
+    std::vector<std::shared_ptr<PendingPrompt>> m_pending_prompts;
+    // whether some caller waits for batching window to end, so others just add their prompts
+    bool m_is_batch_collected = false;
+    std::mutex m_pending_prompts_mutex;
+
+    // the first caller collects prompts of concurrent callers during 'batching_window' and encodes all of them at once
+    TokenizedInputs encode(std::string prompt, std::chrono::microseconds batching_window) {
+        auto pending_prompt = std::make_shared<PendingPrompt>();
+        pending_prompt->m_prompt = std::move(prompt);
+        std::future<TokenizedInputs> result = pending_prompt->m_result.get_future();
+
+        bool is_collector = false;
+        {
+            std::lock_guard<std::mutex> lock(m_pending_prompts_mutex);
+            m_pending_prompts.push_back(pending_prompt);
+            is_collector = !m_is_batch_collected;
+            m_is_batch_collected = true;
+        }
+
+        if (is_collector) {
+            std::this_thread::sleep_for(batching_window);
+            std::vector<std::shared_ptr<PendingPrompt>> batch;
+            {
+                std::lock_guard<std::mutex> lock(m_pending_prompts_mutex);
+                std::swap(batch, m_pending_prompts);
+                m_is_batch_collected = false;
+            }
+            encode_pending_prompts(batch);
+        }
+        return result.get();
+    }
+
+    // splits batched results into unpadded results of each prompt
+    void encode_pending_prompts(const std::vector<std::shared_ptr<PendingPrompt>>& batch) {
+        // results are set in order, so prompts starting from 'batch_idx' are not satisfied on failure
+        size_t batch_idx = 0;
+        try {
+            std::vector<std::string> prompts;
+            prompts.reserve(batch.size());
+            for (const auto& pending_prompt : batch)
+                prompts.push_back(pending_prompt->m_prompt);
+            TokenizedInputs res = encode_right_padded(prompts);
+
+            const size_t sequence_length = res.input_ids.get_shape()[1];
+            const int64_t* input_ids_data = res.input_ids.data<const int64_t>();
+            const int64_t* attention_mask_data = res.attention_mask.data<const int64_t>();
+            for (; batch_idx < batch.size(); ++batch_idx) {
+                const int64_t* row_attention_mask = attention_mask_data + batch_idx * sequence_length;
+                const size_t length = std::count(row_attention_mask, row_attention_mask + sequence_length, 1);
+                ov::Tensor input_ids{ov::element::i64, {1, length}}, attention_mask{ov::element::i64, {1, length}};
+                std::copy_n(input_ids_data + batch_idx * sequence_length, length, input_ids.data<int64_t>());
+                std::fill_n(attention_mask.data<int64_t>(), length, 1);
+                batch[batch_idx]->m_result.set_value({input_ids, attention_mask});
+            }
+        } catch (...) {
+            for (; batch_idx < batch.size(); ++batch_idx)
+                batch[batch_idx]->m_result.set_exception(std::current_exception());
+        }
+    }
+
+    TokenizedInputs get_copied_results(ov::InferRequest& request) {
+        auto input_ids = request.get_tensor("input_ids");
+        auto attention_mask = request.get_tensor("attention_mask");
         ov::Tensor input_ids_ = ov::Tensor(input_ids.get_element_type(), input_ids.get_shape());
         ov::Tensor attention_mask_ = ov::Tensor(attention_mask.get_element_type(), attention_mask.get_shape());
         input_ids.copy_to(input_ids_);
@@ -255,21 +414,25 @@ public:
 
     std::string decode(std::vector<int64_t> tokens) {
         size_t batch_size = 1;
-        m_detokenizer_request.set_input_tensor(ov::Tensor{ov::element::i64, {batch_size, tokens.size()}, tokens.data()});
-        m_detokenizer_request.infer();
-        return m_detokenizer_request.get_output_tensor().data<std::string>()[0];
+        return m_detokenizer_requests->run([&](ov::InferRequest& request) {
+            request.set_input_tensor(ov::Tensor{ov::element::i64, {batch_size, tokens.size()}, tokens.data()});
+            request.infer();
+            return request.get_output_tensor().data<std::string>()[0];
+        });
     }
 
     std::vector<std::string> decode(ov::Tensor tokens) {
         OPENVINO_ASSERT(tokens.get_element_type() == ov::element::i64, "tokens tensor element type should be an i64");
         OPENVINO_ASSERT(tokens.get_shape().size() == 2, "tokens tensor should of rank 2 with shape [batch_size, seq_len]");
 
-        m_detokenizer_request.set_input_tensor(tokens);
-        m_detokenizer_request.infer();
-        
-        auto res = m_detokenizer_request.get_output_tensor();
-        auto res_data = res.data<std::string>();
-        return std::vector<std::string>(res_data, res_data + res.get_shape()[0]);
+        return m_detokenizer_requests->run([&](ov::InferRequest& request) {
+            request.set_input_tensor(tokens);
+            request.infer();
+
+            auto res = request.get_output_tensor();
+            auto res_data = res.data<std::string>();
+            return std::vector<std::string>(res_data, res_data + res.get_shape()[0]);
+        });
     }
 
     std::vector<std::string> decode(std::vector<std::vector<int64_t>> lines) {
@@ -280,7 +443,7 @@ public:
 
         ov::Tensor tokens = ov::Tensor{ov::element::i64, {lines.size(), max_len}};
         auto tokens_data = tokens.data<int64_t>();
-        
+
         for (size_t i = 0; i < lines.size(); ++i) {
             const auto& line = lines[i];
             size_t line_len = line.size();
@@ -288,11 +451,7 @@ public:
             std::fill(tokens_data + i * max_len + line_len, tokens_data + (i + 1) * max_len, m_pad_token_id);
         }
 
-        m_detokenizer_request.set_input_tensor(tokens);
-        m_detokenizer_request.infer();
-        auto res = m_detokenizer_request.get_output_tensor();
-        auto res_data = res.data<std::string>();
-        return std::vector<std::string>(res_data, res_data + res.get_shape()[0]);
+        return decode(tokens);
     }
 
     std::string chat_template_from_tokenizer_json_if_exists(const std::filesystem::path& path) {
@@ -374,6 +533,14 @@ TokenizedInputs Tokenizer::encode(std::initializer_list<std::string>& text) {
     return encode(std::vector<std::string>(text.begin(), text.end()));
 }
 
+TokenizedInputs Tokenizer::encode(const std::string prompt, std::chrono::microseconds batching_window) {
+    return m_pimpl->encode(std::move(prompt), batching_window);
+}
+
+void Tokenizer::set_cache_capacity(size_t capacity_bytes) {
+    m_pimpl->m_cache.set_capacity(capacity_bytes);
+}
+
 std::string Tokenizer::decode(std::vector<int64_t> tokens) {
     return m_pimpl->decode(tokens);
 }
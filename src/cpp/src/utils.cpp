@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "utils.hpp"
+#include <algorithm>
 #include <fstream>
 
 namespace ov {
@@ -118,41 +119,76 @@ void set_attention_mask(ov::Tensor&& attention_mask, std::vector<int32_t> next_b
     }
 }
 
-/**
- * Set position ids tensor data for next token inference based on provided attention mask
- * Supports multi batch
- * Supports sparse attention_mask
- */
-void update_position_ids(ov::Tensor&& position_ids, const ov::Tensor&& attention_mask) {
-    const size_t batch_size = attention_mask.get_shape().at(0);
-    const size_t atten_length = attention_mask.get_shape().at(1);
-    position_ids.set_shape({batch_size, 1});
+namespace {
 
-    for (size_t batch = 0; batch < batch_size; batch++) {
-        int64_t* start = attention_mask.data<int64_t>() + batch * atten_length;
-        // todo: be careful with start + atten_length, probably need to replace with start + atten_length -1
-        position_ids.data<int64_t>()[batch] = std::accumulate(start, start + atten_length, 0);
+void reserve(ov::Tensor& buffer, size_t required_size, size_t used_size) {
+    const size_t capacity = buffer ? buffer.get_size() : 0;
+    if (required_size <= capacity)
+        return;
+    ov::Tensor new_buffer{ov::element::i64, {std::max(required_size, 2 * capacity)}};
+    if (buffer)
+        std::copy_n(buffer.data<const int64_t>(), used_size, new_buffer.data<int64_t>());
+    buffer = new_buffer;
+}
+
+}  // namespace
+
+AttentionMaskBuffer::AttentionMaskBuffer(const ov::Tensor& history, const ov::Tensor& attention_mask) {
+    m_batch_size = attention_mask.get_shape().at(0);
+    const size_t history_len = history ? history.get_shape().at(1) : 0;
+    const size_t prompt_len = attention_mask.get_shape().at(1);
+    m_seq_len = history_len + prompt_len;
+    reserve(m_buffer, m_batch_size * (m_seq_len + 1), 0);
+
+    int64_t* data = m_buffer.data<int64_t>();
+    for (size_t batch = 0; batch < m_batch_size; ++batch) {
+        if (history)
+            std::copy_n(history.data<const int64_t>() + batch * history_len, history_len, data + batch * m_seq_len);
+        std::copy_n(attention_mask.data<const int64_t>() + batch * prompt_len, prompt_len, data + batch * m_seq_len + history_len);
     }
 }
 
-/**
- * Get attention mask tensor for next token inference
- * Supports multi batch
- * Supports sparse attention_mask
- */
-ov::Tensor extend_attention(ov::Tensor attention_mask) {
-    auto shape = attention_mask.get_shape();
-    auto batch_size = shape[0];
-    auto seq_len = shape[1];
-
-    ov::Tensor new_atten_mask = ov::Tensor{attention_mask.get_element_type(), {batch_size, seq_len + 1}};
-    auto old_data = attention_mask.data<int64_t>();
-    auto new_data = new_atten_mask.data<int64_t>();
-    for (size_t batch = 0; batch < batch_size; ++batch) {
-        std::memcpy(new_data + batch * (seq_len + 1), old_data + batch * seq_len, seq_len * sizeof(int64_t));
-        new_data[batch * (seq_len + 1) + seq_len] = 1;
+ov::Tensor AttentionMaskBuffer::get_tensor() {
+    return ov::Tensor{ov::element::i64, {m_batch_size, m_seq_len}, m_buffer.data<int64_t>()};
+}
+
+ov::Tensor AttentionMaskBuffer::get_tensor_copy() {
+    ov::Tensor copy{ov::element::i64, {m_batch_size, m_seq_len}};
+    std::copy_n(m_buffer.data<const int64_t>(), m_batch_size * m_seq_len, copy.data<int64_t>());
+    return copy;
+}
+
+void AttentionMaskBuffer::compact(const std::vector<int32_t>& running_rows) {
+    int64_t* data = m_buffer.data<int64_t>();
+    for (size_t row = 0; row < running_rows.size(); ++row)
+        std::copy_n(data + running_rows[row] * m_seq_len, m_seq_len, data + row * m_seq_len);
+    m_batch_size = running_rows.size();
+}
+
+void AttentionMaskBuffer::extend() {
+    reserve(m_buffer, m_batch_size * (m_seq_len + 1), m_batch_size * m_seq_len);
+    int64_t* data = m_buffer.data<int64_t>();
+    // rows are moved forward, so the last one is moved first; the first row stays in place
+    for (size_t batch = m_batch_size; batch-- > 1;) {
+        std::copy_backward(data + batch * m_seq_len, data + (batch + 1) * m_seq_len, data + batch * (m_seq_len + 1) + m_seq_len);
+        data[batch * (m_seq_len + 1) + m_seq_len] = 1;
     }
-    return new_atten_mask;
+    if (m_batch_size > 0)
+        data[m_seq_len] = 1;
+    ++m_seq_len;
+}
+
+void AttentionMaskBuffer::extend_with_beams(const std::vector<int32_t>& next_beams) {
+    reserve(m_gather_buffer, next_beams.size() * (m_seq_len + 1), 0);
+    const int64_t* src = m_buffer.data<const int64_t>();
+    int64_t* dst = m_gather_buffer.data<int64_t>();
+    for (size_t beam_id = 0; beam_id < next_beams.size(); ++beam_id) {
+        std::copy_n(src + next_beams[beam_id] * m_seq_len, m_seq_len, dst + beam_id * (m_seq_len + 1));
+        dst[beam_id * (m_seq_len + 1) + m_seq_len] = 1;
+    }
+    std::swap(m_buffer, m_gather_buffer);
+    m_batch_size = next_beams.size();
+    ++m_seq_len;
 }
 
 ov::genai::GenerationConfig from_config_json_if_exists(const std::filesystem::path& model_path) {
@@ -178,6 +214,16 @@ ov::genai::StreamerVariant get_streamer_from_map(const ov::AnyMap& config_map) {
     return streamer;
 }
 
+bool stream_single_sequence_token(ov::genai::StreamerBase& streamer, int64_t token) {
+    std::vector<size_t> stopped_sequences;
+    return streamer.put_batch({ov::genai::StreamedToken{0, token}}, stopped_sequences) || !stopped_sequences.empty();
+}
+
+ov::Core& singleton_core() {
+    static ov::Core core;
+    return core;
+}
+
 ov::genai::OptionalGenerationConfig get_config_from_map(const ov::AnyMap& config_map) {
     if (config_map.count(CONFIG_ARG_NAME))
         return config_map.at(CONFIG_ARG_NAME).as<ov::genai::GenerationConfig>();
@@ -20,9 +20,37 @@ int64_t argmax(const ov::Tensor& logits, const size_t batch_idx);
 
 void initialize_position_ids(ov::Tensor& position_ids, const ov::Tensor& attention_mask, int64_t start_pos = 0);
 
-ov::Tensor extend_attention(ov::Tensor attention_mask);
-
-void update_position_ids(ov::Tensor&& position_ids, const ov::Tensor&& attention_mask);
+/**
+ * Attention mask of running sequences, which is updated in place during generation. Rows are stored contiguously,
+ * so the first batch_size * seq_len elements form [batch_size, seq_len] tensor passed to the model, while
+ * capacity grows geometrically to avoid allocations on every generated token
+ */
+class AttentionMaskBuffer {
+    ov::Tensor m_buffer;
+    // rows selected by beams are gathered here, then buffers are swapped
+    ov::Tensor m_gather_buffer;
+    size_t m_batch_size = 0;
+    size_t m_seq_len = 0;
+
+public:
+    // history is KV cache attention mask of previous chat turns, it can be empty
+    AttentionMaskBuffer(const ov::Tensor& history, const ov::Tensor& attention_mask);
+
+    // non-owning view of rows, which is valid until the next update
+    ov::Tensor get_tensor();
+
+    // a copy, which can be kept by infer request after generation, e.g. as KV cache history of chat
+    ov::Tensor get_tensor_copy();
+
+    // keeps only rows of running sequences, which are sorted in ascending order
+    void compact(const std::vector<int32_t>& running_rows);
+
+    // appends attended position of a new token to each row
+    void extend();
+
+    // takes rows of selected beams and appends attended position of a new token to each of them
+    void extend_with_beams(const std::vector<int32_t>& next_beams);
+};
 
 template <typename>
 struct json_type_traits {};
@@ -74,8 +102,15 @@ ov::genai::GenerationConfig from_config_json_if_exists(const std::filesystem::pa
 
 ov::genai::StreamerVariant get_streamer_from_map(const ov::AnyMap& config_map);
 
+// Streams a token of the only generated sequence, returns true if streamer stops its generation
+bool stream_single_sequence_token(ov::genai::StreamerBase& streamer, int64_t token);
+
 ov::genai::OptionalGenerationConfig get_config_from_map(const ov::AnyMap& config_map);
 
+// Core shared by all pipelines and tokenizers of the process, so plugins and extensions are loaded once.
+// Its properties are global, so device specific options must be passed to compile_model instead
+ov::Core& singleton_core();
+
 }  // namespace utils
 }  // namespace genai
 }  // namespace ov
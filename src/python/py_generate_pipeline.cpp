@@ -3,6 +3,7 @@
 
 #include <filesystem>
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
 #include <pybind11/functional.h>
@@ -29,6 +30,10 @@ using ov::genai::Tokenizer;
 // Therefore strings decoding should be handled with PyUnicode_DecodeUTF8(..., "replace") to not throw errors.
 using PyBindStreamerVariant = std::variant<std::function<bool(py::str)>, std::shared_ptr<StreamerBase>, std::monostate>;
 
+// C-contiguous int64 numpy arrays of token ids are passed to C++ without copying
+using PyBindTokenIds = py::array_t<int64_t, py::array::c_style>;
+using PyBindInputs = std::variant<ov::Tensor, PyBindTokenIds, TokenizedInputs, std::string, std::vector<std::string>>;
+
 template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
 template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
@@ -38,7 +43,7 @@ auto generate_docstring = R"(
     Generates sequences or tokens for LLMs. If input is a string or list of strings then resulting sequences will be already detokenized.
     
     :param inputs: inputs in the form of string, list of strings or tokenized input_ids
-    :type inputs: str, List[str], ov.genai.TokenizedInputs, or ov.Tensor
+    :type inputs: str, List[str], ov.genai.TokenizedInputs, ov.Tensor or int64 numpy.ndarray, which is not copied
     
     :param generation_config: generation_config
     :type generation_config: GenerationConfig or a Dict
@@ -263,9 +268,18 @@ py::list handle_utf8_results(const std::vector<std::string>& decoded_res) {
     return res;
 }
 
+// tensor sharing memory of numpy array, which must outlive it; a 1D array is a single prompt
+ov::Tensor as_tensor(const PyBindTokenIds& token_ids) {
+    OPENVINO_ASSERT(token_ids.ndim() == 1 || token_ids.ndim() == 2,
+        "Token ids must be 1D or 2D [batch, sequence length] array, got ", token_ids.ndim(), "D one");
+    ov::Shape shape = token_ids.ndim() == 1 ? ov::Shape{1, static_cast<size_t>(token_ids.shape(0))}
+                                            : ov::Shape{static_cast<size_t>(token_ids.shape(0)), static_cast<size_t>(token_ids.shape(1))};
+    return ov::Tensor(ov::element::i64, shape, const_cast<int64_t*>(token_ids.data()));
+}
+
 py::object call_common_generate(
     LLMPipeline& pipe, 
-    const std::variant<ov::Tensor, TokenizedInputs, std::string, std::vector<std::string>>& inputs, 
+    const PyBindInputs& inputs, 
     const OptionalGenerationConfig& config, 
     const PyBindStreamerVariant& py_streamer, 
     const py::kwargs& kwargs
@@ -279,7 +293,9 @@ py::object call_common_generate(
     [&streamer](const std::function<bool(py::str)>& py_callback){
         // Wrap python streamer with manual utf-8 decoding. Do not rely
         // on pybind automatic decoding since it raises exceptions on incomplete strings.
+        // generation runs without GIL, so it's acquired only to call Python
         auto callback_wrapped = [&py_callback](std::string subword) -> bool {
+            py::gil_scoped_acquire acquire;
             auto py_str = PyUnicode_DecodeUTF8(subword.data(), subword.length(), "replace");
             return py_callback(py::reinterpret_borrow<py::str>(py_str));
         };
@@ -291,16 +307,26 @@ py::object call_common_generate(
     [](std::monostate none){ /*streamer is already a monostate */ }
     }, py_streamer);
 
+    // GIL is released for the whole generation, so other Python threads are not blocked by it;
+    // Python streamers acquire it back for each call
+    auto generate_without_gil = [&](const auto& input) {
+        py::gil_scoped_release release;
+        return pipe.generate(input, updated_config, streamer);
+    };
+
     // Call suitable generate overload for each type of input.
     std::visit(overloaded {
     [&](ov::Tensor ov_tensor) {
-        results = py::cast(pipe.generate(ov_tensor, updated_config, streamer));
+        results = py::cast(generate_without_gil(ov_tensor));
+    },
+    [&](const PyBindTokenIds& token_ids) {
+        results = py::cast(generate_without_gil(as_tensor(token_ids)));
     },
     [&](TokenizedInputs tokenized_input) {
-        results = py::cast(pipe.generate(tokenized_input, updated_config, streamer));
+        results = py::cast(generate_without_gil(tokenized_input));
     },
     [&](std::string string_input) {
-        DecodedResults res = pipe.generate(string_input, updated_config, streamer);
+        DecodedResults res = generate_without_gil(string_input);
         // If input was a string return a single string otherwise return DecodedResults.
         if (updated_config.num_return_sequences == 1) {
             results = py::cast<py::object>(handle_utf8_results(res.texts)[0]);
@@ -310,7 +336,7 @@ py::object call_common_generate(
     },
     [&](std::vector<std::string> string_input) {
         // For DecodedResults texts getter already handles utf8 decoding.
-        results = py::cast(pipe.generate(string_input, updated_config, streamer));
+        results = py::cast(generate_without_gil(string_input));
     }},
     inputs);
     
@@ -338,6 +364,23 @@ class ConstructableStreamer: public StreamerBase {
     void end() override {
         PYBIND11_OVERRIDE_PURE(void, StreamerBase, end);
     }
+    // Python override returns either a bool flag to stop all sequences or a list of indices of sequences to stop
+    bool put_batch(const std::vector<ov::genai::StreamedToken>& tokens, std::vector<size_t>& stopped_sequences) override {
+        py::gil_scoped_acquire acquire;
+        py::function override = py::get_override(static_cast<const StreamerBase*>(this), "put_batch");
+        if (!override) {
+            return StreamerBase::put_batch(tokens, stopped_sequences);
+        }
+        py::object result = override(tokens);
+        if (py::isinstance<py::bool_>(result)) {
+            return result.cast<bool>();
+        }
+        if (!result.is_none()) {
+            for (size_t sequence_idx : result.cast<std::vector<size_t>>())
+                stopped_sequences.push_back(sequence_idx);
+        }
+        return false;
+    }
 };
 
 } // namespace
@@ -378,7 +421,7 @@ PYBIND11_MODULE(py_generate_pipeline, m) {
         .def(
             "generate", 
             [](LLMPipeline& pipe, 
-                const std::variant<ov::Tensor, TokenizedInputs, std::string, std::vector<std::string>>& inputs, 
+                const PyBindInputs& inputs, 
                 const OptionalGenerationConfig& generation_config, 
                 const PyBindStreamerVariant& streamer, 
                 const py::kwargs& kwargs
@@ -394,7 +437,7 @@ PYBIND11_MODULE(py_generate_pipeline, m) {
         .def(
             "__call__", 
             [](LLMPipeline& pipe, 
-                const std::variant<ov::Tensor, TokenizedInputs, std::string, std::vector<std::string>>& inputs, 
+                const PyBindInputs& inputs, 
                 const OptionalGenerationConfig& generation_config, 
                 const PyBindStreamerVariant& streamer, 
                 const py::kwargs& kwargs
@@ -455,6 +498,10 @@ PYBIND11_MODULE(py_generate_pipeline, m) {
             },
             py::arg("tokens"),
             R"(Decode a batch of tokens into a list of string prompt.)")
+
+        .def("set_cache_capacity", &Tokenizer::set_cache_capacity,
+            py::arg("capacity_bytes"),
+            R"(Enables LRU cache of encoded single prompts limited by capacity_bytes, 0 disables the cache.)")
         
         .def("apply_chat_template", [](Tokenizer& tok,
                                         const ChatHistory& history,
@@ -514,15 +561,41 @@ PYBIND11_MODULE(py_generate_pipeline, m) {
 
     py::class_<TokenizedInputs>(m, "TokenizedInputs")
         .def(py::init<ov::Tensor, ov::Tensor>())
+        // tensors share memory of numpy arrays, which are kept alive by TokenizedInputs
+        .def(py::init([](const PyBindTokenIds& input_ids, const PyBindTokenIds& attention_mask) {
+            return TokenizedInputs{as_tensor(input_ids), as_tensor(attention_mask)};
+        }), py::arg("input_ids"), py::arg("attention_mask"), py::keep_alive<1, 2>(), py::keep_alive<1, 3>())
         .def_readwrite("input_ids", &TokenizedInputs::input_ids)
         .def_readwrite("attention_mask", &TokenizedInputs::attention_mask);
 
+    // results are numpy arrays viewing memory of EncodedResults, which is kept alive by them
     py::class_<EncodedResults>(m, "EncodedResults")
-        .def_readonly("tokens", &EncodedResults::tokens)
-        .def_readonly("scores", &EncodedResults::scores);
+        .def_property_readonly("tokens", [](py::object self) {
+            EncodedResults& results = self.cast<EncodedResults&>();
+            py::list tokens;
+            for (std::vector<int64_t>& sequence_tokens : results.tokens)
+                tokens.append(py::array_t<int64_t>(sequence_tokens.size(), sequence_tokens.data(), self));
+            return tokens;
+        }, "list of 1D int64 numpy arrays of generated tokens of each sequence")
+        .def_property_readonly("scores", [](py::object self) {
+            EncodedResults& results = self.cast<EncodedResults&>();
+            return py::array_t<float>(results.scores.size(), results.scores.data(), self);
+        }, "float32 numpy array of scores of each sequence");
+
+    py::class_<ov::genai::StreamedToken>(m, "StreamedToken", "A token generated for one of sequences, which are generated at once")
+        .def_readonly("sequence_idx", &ov::genai::StreamedToken::sequence_idx)
+        .def_readonly("token", &ov::genai::StreamedToken::token);
 
     py::class_<StreamerBase, ConstructableStreamer, std::shared_ptr<StreamerBase>>(m, "StreamerBase")  // Change the holder form unique_ptr to shared_ptr
         .def(py::init<>())
         .def("put", &StreamerBase::put)
+        .def("put_batch", [](StreamerBase& self, const std::vector<ov::genai::StreamedToken>& tokens) {
+            std::vector<size_t> stopped_sequences;
+            bool is_stopped = self.StreamerBase::put_batch(tokens, stopped_sequences);
+            return is_stopped ? py::object(py::bool_(true)) : py::object(py::cast(stopped_sequences));
+        }, py::arg("tokens"), R"(
+            Called with new tokens of several sequences, e.g. for a batch of prompts. By default tokens of the first sequence are passed to put().
+            Returns True to stop generation of all sequences or a list of indices of sequences to stop.
+        )")
         .def("end", &StreamerBase::end);
 }
@@ -218,6 +218,22 @@ def test_ov_tensors(model_descr, inputs):
     hf_ov_genai_tensors_comparison(read_model(model_descr), dict(max_new_tokens=20), *inputs)
 
 
+@pytest.mark.parametrize("model_descr", models_list())
+@pytest.mark.precommit
+def test_numpy_inputs_and_results(model_descr):
+    model_id, path, tokenizer, model, pipe = read_model(model_descr)
+    input_ids = np.array([[1, 4, 42]], dtype=np.int64)
+    attention_mask = np.ones_like(input_ids)
+
+    # int64 numpy arrays are accepted as is and results are numpy arrays
+    ov_output = pipe.generate(input_ids, max_new_tokens=20)
+    assert isinstance(ov_output.tokens[0], np.ndarray) and ov_output.tokens[0].dtype == np.int64
+    assert isinstance(ov_output.scores, np.ndarray) and ov_output.scores.dtype == np.float32
+
+    ov_output_with_mask = pipe.generate(ov_genai.TokenizedInputs(input_ids, attention_mask), max_new_tokens=20)
+    assert np.all(ov_output.tokens[0] == ov_output_with_mask.tokens[0])
+
+
 prompts = [
     'table is made of',
     '你好！ 你好嗎？',
@@ -302,6 +318,23 @@ def test_multibatch(model_descr, generation_config, prompts):
     run_hf_ov_genai_comparison_batched(read_model(model_descr), generation_config, prompts)
 
 
+
+@pytest.mark.parametrize("prompts", batched_prompts)
+@pytest.mark.precommit
+def test_multibatch_multinomial(prompts):
+    pipe = read_model(models_list()[0])[4]
+    tokenizer = pipe.get_tokenizer()
+    inputs = tokenizer.encode(prompts)
+    results = pipe.generate(inputs, max_new_tokens=10, do_sample=True, top_k=20, top_p=0.9, repetition_penalty=1.1)
+    assert len(results.tokens) == len(prompts)
+    for tokens in results.tokens:
+        assert 0 < len(tokens) <= 10
+
+    # top_k=1 leaves the only candidate, so sampling is equal to greedy decoding
+    sampled = pipe.generate(inputs, max_new_tokens=10, do_sample=True, top_k=1)
+    greedy = pipe.generate(inputs, max_new_tokens=10, do_sample=False)
+    assert [list(tokens) for tokens in sampled.tokens] == [list(tokens) for tokens in greedy.tokens]
+
 prompts = ['The Sun is yellow because', 'Difference between Jupiter and Mars is that', 'table is made of']
 @pytest.mark.parametrize("num_beam_groups", [2, 3, 8])
 @pytest.mark.parametrize("group_size", [5, 3, 10])
@@ -322,6 +355,26 @@ def test_beam_search_decoding(model_descr, num_beam_groups, group_size,
     run_hf_ov_genai_comparison(read_model(model_descr), generation_config, prompt)
 
 
+# candidates of each beam are its top tokens merged with tokens penalized by diversity or banned by no_repeat_ngram_size,
+# while n-grams of prompt are shared by all beams
+@pytest.mark.parametrize("no_repeat_ngram_size", [1, 2, 3])
+@pytest.mark.parametrize("num_beam_groups,group_size", [(1, 4), (2, 3), (3, 5)])
+@pytest.mark.parametrize("prompt", prompts)
+@pytest.mark.parametrize("model_descr", models_list())
+@pytest.mark.precommit
+def test_beam_search_no_repeat_ngram(model_descr, no_repeat_ngram_size, num_beam_groups, group_size, prompt):
+    generation_config = dict(
+        num_beam_groups=num_beam_groups,
+        num_beams=num_beam_groups * group_size,
+        num_return_sequences=num_beam_groups * group_size,
+        max_new_tokens=20,
+        no_repeat_ngram_size=no_repeat_ngram_size,
+    )
+    if num_beam_groups > 1:
+        generation_config['diversity_penalty'] = 1.0
+    run_hf_ov_genai_comparison(read_model(model_descr), generation_config, prompt)
+
+
 @pytest.mark.parametrize("stop_criteria", [StopCriteria.NEVER, StopCriteria.EARLY, StopCriteria.HEURISTIC])
 @pytest.mark.parametrize("prompt", prompts)
 @pytest.mark.parametrize("max_new_tokens", [10, 80])
@@ -434,12 +487,41 @@ def test_streamer_one_string():
     pipe.generate('table is made of', generation_config, printer)
 
 
+class BatchCollector(ov_genai.StreamerBase):
+    def __init__(self, stopped_sequence_idx=None):
+        ov_genai.StreamerBase.__init__(self)
+        self.tokens = {}
+        self.stopped_sequence_idx = stopped_sequence_idx
+    def put(self, token_id):
+        raise AssertionError('put_batch() is overridden, so put() is not called')
+    def put_batch(self, tokens):
+        for streamed_token in tokens:
+            self.tokens.setdefault(streamed_token.sequence_idx, []).append(streamed_token.token)
+        return [] if self.stopped_sequence_idx is None else [self.stopped_sequence_idx]
+    def end(self):
+        pass
+
+
 @pytest.mark.precommit
-def test_streamer_batch_fail():
+def test_streamer_batch():
     pipe = read_model(models_list()[0])[4]
-    printer = Printer(pipe.get_tokenizer())
-    with pytest.raises(RuntimeError):
-        pipe.generate(['1', '2'], ov_genai.GenerationConfig(), printer)
+    tokenizer = pipe.get_tokenizer()
+    prompts = ['table is made of', 'Alan Turing was a']
+    config = ov_genai.GenerationConfig()
+    config.max_new_tokens = 10
+    inputs = tokenizer.encode(prompts)
+    reference = pipe.generate(inputs, config)
+
+    collector = BatchCollector()
+    results = pipe.generate(inputs, config, collector)
+    assert [collector.tokens[idx] for idx in range(len(prompts))] == [list(tokens) for tokens in results.tokens]
+    assert [list(tokens) for tokens in results.tokens] == [list(tokens) for tokens in reference.tokens]
+
+    # stopping one sequence doesn't affect others
+    collector = BatchCollector(stopped_sequence_idx=0)
+    results = pipe.generate(inputs, config, collector)
+    assert len(results.tokens[0]) == 1
+    assert list(results.tokens[1]) == list(reference.tokens[1])
 
 
 @pytest.mark.precommit
@@ -450,11 +532,13 @@ def test_streamer_kwargs_one_string():
 
 
 @pytest.mark.precommit
-def test_streamer_kwargs_batch_fail():
+def test_streamer_kwargs_beam_search():
     pipe = read_model(models_list()[0])[4]
-    printer = Printer(pipe.get_tokenizer())
-    with pytest.raises(RuntimeError):
-        pipe.generate('', num_beams=2, streamer=printer)
+    collector = BatchCollector()
+    inputs = pipe.get_tokenizer().encode('table is made of')
+    results = pipe.generate(inputs, max_new_tokens=10, num_beams=2, num_return_sequences=2, streamer=collector)
+    # beams change at every step, so final sequences are streamed
+    assert [collector.tokens[idx] for idx in range(2)] == [list(tokens) for tokens in results.tokens]
 
 
 @pytest.mark.precommit
@@ -821,3 +905,27 @@ def test_left_pad():
 
     models[2].pad_token = models[2].eos_token
     run_hf_ov_genai_comparison_batched(models, config, prompts)
+
+
+@pytest.mark.parametrize("model_descr", chat_models_list())
+@pytest.mark.precommit
+@pytest.mark.skipif(sys.platform == "linux", reason="no space left on linux device for chat models")
+def test_chat_session_cache(model_descr, tmp_path):
+    model_id, path, tokenizer, model_opt, pipe = read_model(model_descr)
+    ov_tokenizer, ov_detokenizer = openvino_tokenizers.convert_tokenizer(tokenizer, add_special_tokens=False, with_detokenizer=True)
+    openvino.save_model(ov_tokenizer, path / "openvino_tokenizer.xml")
+    openvino.save_model(ov_detokenizer, path / "openvino_detokenizer.xml")
+    config = {"ENABLE_MMAP": False, "session_cache_dir": str(tmp_path / "sessions")}
+
+    def chat(pipe):
+        pipe.start_chat()
+        answers = [pipe.generate(prompt, max_new_tokens=50, do_sample=False) for prompt in quenstions]
+        pipe.finish_chat()
+        return answers
+
+    ref_answers = chat(ov_genai.LLMPipeline(str(path), device='CPU', config=config))
+    assert len(list((tmp_path / "sessions").glob("*.state"))) == 1
+
+    # conversation of a new pipeline starts with the stored one, so its KV cache is loaded instead of computation
+    assert chat(ov_genai.LLMPipeline(str(path), device='CPU', config=config)) == ref_answers
+    assert len(list((tmp_path / "sessions").glob("*.state"))) == 1
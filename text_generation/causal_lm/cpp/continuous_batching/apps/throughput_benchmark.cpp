@@ -1,9 +1,11 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
 #include <fstream>
 #include <cstdlib>
 #include <chrono>
+#include <numeric>
 #include <ostream>
 #include <random>
 #include <stdexcept>
@@ -139,50 +141,52 @@ Dataset filtered_dataset(const std::string& models_path, const std::string& data
     return sampled_dataset;
 }
 
-class GenerationInfo {
+// percentile with linear interpolation between closest ranks; 'values' must be sorted
+double get_percentile(const std::vector<double>& values, double percentile) {
+    if (values.empty())
+        return 0.0;
+    const double rank = percentile / 100.0 * (values.size() - 1);
+    const size_t lower_rank = static_cast<size_t>(rank);
+    const size_t upper_rank = std::min(lower_rank + 1, values.size() - 1);
+    return values[lower_rank] + (values[upper_rank] - values[lower_rank]) * (rank - lower_rank);
+}
 
-    struct SequenceInfo {
-        std::chrono::milliseconds ttft;
-        std::chrono::milliseconds cumulated_tpot;
-        std::chrono::milliseconds mean_tpot;
-        size_t num_output_tokens;
-    
-        std::chrono::steady_clock::time_point start_time;
-        std::chrono::steady_clock::time_point last_read_time;
-
-        SequenceInfo(std::chrono::steady_clock::time_point& start_time) {
-            num_output_tokens = 0;
-            ttft = std::chrono::milliseconds::zero();
-            cumulated_tpot = std::chrono::milliseconds::zero();
-            this->start_time = start_time;
-        }
+struct LatencyStatistics {
+    double mean = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0;
 
-        void update() {
-            std::chrono::steady_clock::time_point new_read_time = std::chrono::steady_clock::now();
-            if (last_read_time.time_since_epoch() == std::chrono::milliseconds::zero()) {
-                ttft = std::chrono::duration_cast<std::chrono::milliseconds>(new_read_time - start_time);
-            } else {
-                cumulated_tpot += std::chrono::duration_cast<std::chrono::milliseconds>(new_read_time - last_read_time);
-                mean_tpot = cumulated_tpot / num_output_tokens;
+    explicit LatencyStatistics(std::vector<double> values) {
+        if (values.empty())
+            return;
+        std::sort(values.begin(), values.end());
+        mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+        p50 = get_percentile(values, 50.0);
+        p90 = get_percentile(values, 90.0);
+        p99 = get_percentile(values, 99.0);
+    }
 
-            }
-            num_output_tokens++;
-            last_read_time = new_read_time;
-        }
-    };
+    nlohmann::json to_json() const {
+        return {{"mean", mean}, {"p50", p50}, {"p90", p90}, {"p99", p99}};
+    }
+};
 
-    struct GenerationMetrics {
-        std::chrono::milliseconds mean_ttft = std::chrono::milliseconds::zero();
-        std::chrono::milliseconds mean_tpot = std::chrono::milliseconds::zero();
-        size_t num_output_tokens = 0;
-        size_t num_input_tokens;
-    };
+// service level objective of online serving; zero values are not checked
+struct SLO {
+    double ttft_ms = 0.0;
+    double tpot_ms = 0.0;
+    double e2e_ms = 0.0;
+};
 
+class GenerationInfo {
     GenerationHandle generation_handle;
-    std::chrono::steady_clock::time_point start_time;
-    std::unordered_map<int64_t, SequenceInfo> sequences_info;
+    std::chrono::steady_clock::time_point start_time, first_token_time, last_token_time;
+    size_t num_output_tokens = 0;
     bool active = true;
     size_t input_len;
+    RequestMetrics request_metrics;
+
+    static double get_duration_ms(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
 
 public:
     GenerationInfo(GenerationHandle generation_handle, size_t input_len) : input_len(input_len)
@@ -191,57 +195,79 @@ public:
         start_time = std::chrono::steady_clock::now();
     }
 
-    void update_sequence(int64_t sequence_id) {
-        if (sequences_info.find(sequence_id) == sequences_info.end())
-            sequences_info.emplace(sequence_id, SequenceInfo(start_time));
-        sequences_info.at(sequence_id).update();
-    }
-
     void update(GenerationOutputs& outputs){
+        // speculative decoding can generate several tokens per step
+        size_t num_tokens = 0;
         for (auto const& output: outputs) {
-            update_sequence(output.first);
+            num_tokens += output.second.generated_token_ids.size();
         }
+        if (num_tokens == 0)
+            return;
+        last_token_time = std::chrono::steady_clock::now();
+        if (num_output_tokens == 0)
+            first_token_time = last_token_time;
+        num_output_tokens += num_tokens;
     }
 
-    GenerationOutputs read() {
-        return generation_handle->read();
-    }
-
-    bool can_read() {
-        return generation_handle->can_read();
+    GenerationOutputs read_available() {
+        return generation_handle->read_available();
     }
 
     bool is_finished() {
-        return generation_handle->get_status() == GenerationStatus::FINISHED;
+        return generation_handle->get_status() != GenerationStatus::RUNNING;
     }
 
     void set_inactive() {
         active = false;
+        request_metrics = generation_handle->get_metrics();
     }
 
     bool is_active() {
         return active;
     }
 
-    GenerationMetrics get_metrics() {
-        GenerationMetrics generation_metrics;
-        for (auto& sequenceInfoPair : sequences_info) {
-            generation_metrics.mean_ttft += sequenceInfoPair.second.ttft;
-            generation_metrics.mean_tpot += sequenceInfoPair.second.mean_tpot;
-            generation_metrics.num_output_tokens += sequenceInfoPair.second.num_output_tokens;
-        }
-        generation_metrics.mean_ttft /= sequences_info.size();
-        generation_metrics.mean_tpot /= sequences_info.size();
-        generation_metrics.num_input_tokens = input_len;
-        return generation_metrics;
+    bool has_output() const {
+        return num_output_tokens > 0;
+    }
+
+    double get_ttft_ms() const {
+        return get_duration_ms(start_time, first_token_time);
+    }
+
+    // time per output token after the first one
+    double get_tpot_ms() const {
+        return num_output_tokens > 1 ? get_duration_ms(first_token_time, last_token_time) / (num_output_tokens - 1) : 0.0;
+    }
+
+    double get_e2e_ms() const {
+        return get_duration_ms(start_time, last_token_time);
+    }
+
+    bool meets(const SLO& slo) const {
+        return has_output() &&
+            (slo.ttft_ms <= 0.0 || get_ttft_ms() <= slo.ttft_ms) &&
+            (slo.tpot_ms <= 0.0 || get_tpot_ms() <= slo.tpot_ms) &&
+            (slo.e2e_ms <= 0.0 || get_e2e_ms() <= slo.e2e_ms);
+    }
+
+    size_t get_num_input_tokens() const {
+        return input_len;
+    }
+
+    size_t get_num_output_tokens() const {
+        return num_output_tokens;
+    }
+
+    const RequestMetrics& get_request_metrics() const {
+        return request_metrics;
     }
 };
 
 class GenerationInfoCollector {
     std::mutex mutex;
     std::vector<GenerationInfo> generations_info;
-    size_t num_finished = 0;
-    std::chrono::steady_clock::time_point start_time;
+    std::atomic<size_t> num_added{0}, num_finished{0};
+    std::chrono::steady_clock::time_point start_time, end_time;
 
 public:
 
@@ -253,6 +279,11 @@ public:
         GenerationHandle generation_handle = pipe->add_request(request_id, dataset->m_prompts[request_id], dataset->m_sampling_params[request_id]);
         std::lock_guard<std::mutex> lock(mutex);
         generations_info.emplace_back(std::move(generation_handle), dataset->m_input_lens[request_id]);
+        ++num_added;
+    }
+
+    size_t get_num_in_flight() const {
+        return num_added - num_finished;
     }
 
     int run() {
@@ -261,88 +292,121 @@ public:
             if (!generation_info.is_active())
                 continue;
             
-            if (generation_info.is_finished()) {
-                num_finished++;
+            // status is checked before reading, so the final outputs are consumed before generation is marked inactive
+            bool is_finished = generation_info.is_finished();
+            GenerationOutputs outputs = generation_info.read_available();
+            generation_info.update(outputs);
+            if (is_finished) {
                 generation_info.set_inactive();
-            } else if (generation_info.can_read()) {
-                auto outputs = generation_info.read();
-                generation_info.update(outputs);
+                ++num_finished;
             }
         }
+        if (num_finished == generations_info.size())
+            end_time = std::chrono::steady_clock::now();
         return num_finished;
     }
 
-    void print_statistics() {
-        std::chrono::seconds total_duration = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start_time);
-        std::chrono::milliseconds mean_ttft = std::chrono::milliseconds::zero();
-        std::chrono::milliseconds mean_tpot = std::chrono::milliseconds::zero();
-        size_t total_input_len = 0;
-        size_t total_output_len = 0;
-        
-    
-        for (GenerationInfo& generation_info : generations_info){
-            auto generation_metrics = generation_info.get_metrics();
-            mean_ttft += generation_metrics.mean_ttft;
-            mean_tpot += generation_metrics.mean_tpot;
-            total_input_len += generation_metrics.num_input_tokens;
-            total_output_len += generation_metrics.num_output_tokens;
+    nlohmann::json get_statistics(const SLO& slo) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const double total_duration_s = std::chrono::duration<double>(end_time - start_time).count();
+        std::vector<double> ttfts, tpots, e2e_latencies;
+        size_t total_input_len = 0, total_output_len = 0, num_good_requests = 0, num_preemptions = 0, num_recomputed_tokens = 0;
+        for (const GenerationInfo& generation_info : generations_info) {
+            total_input_len += generation_info.get_num_input_tokens();
+            total_output_len += generation_info.get_num_output_tokens();
+            num_preemptions += generation_info.get_request_metrics().num_preemptions;
+            num_recomputed_tokens += generation_info.get_request_metrics().num_recomputed_tokens;
+            if (!generation_info.has_output())
+                continue;
+            ttfts.push_back(generation_info.get_ttft_ms());
+            if (generation_info.get_num_output_tokens() > 1)
+                tpots.push_back(generation_info.get_tpot_ms());
+            e2e_latencies.push_back(generation_info.get_e2e_ms());
+            num_good_requests += generation_info.meets(slo);
         }
-        mean_ttft /= generations_info.size();
-        mean_tpot /= generations_info.size();
-        std::cout << "Benchmark duration: " << total_duration.count() << " s" << std::endl;
-        std::cout << "Total number of input tokens: " << total_input_len << std::endl;
-        std::cout << "Total number of output tokens: " << total_output_len << std::endl;
-        std::cout << "Input throughput: " << total_input_len / total_duration.count() << " tokens / s" << std::endl;
-        std::cout << "Output throughput: " << total_output_len / total_duration.count() << " tokens / s" << std::endl;
-        std::cout << "Mean TTFT: " << mean_ttft.count() << " ms" << std::endl;
-        std::cout << "Mean TPOT: " << mean_tpot.count() << " ms" << std::endl; 
+
+        return {
+            {"duration_s", total_duration_s},
+            {"num_requests", generations_info.size()},
+            {"total_input_tokens", total_input_len},
+            {"total_output_tokens", total_output_len},
+            {"request_throughput", generations_info.size() / total_duration_s},
+            {"input_throughput", total_input_len / total_duration_s},
+            {"output_throughput", total_output_len / total_duration_s},
+            {"ttft_ms", LatencyStatistics(ttfts).to_json()},
+            {"tpot_ms", LatencyStatistics(tpots).to_json()},
+            {"e2e_latency_ms", LatencyStatistics(e2e_latencies).to_json()},
+            {"slo", {{"ttft_ms", slo.ttft_ms}, {"tpot_ms", slo.tpot_ms}, {"e2e_ms", slo.e2e_ms}}},
+            {"goodput", num_good_requests / total_duration_s},
+            {"num_preemptions", num_preemptions},
+            {"num_recomputed_tokens", num_recomputed_tokens},
+        };
     }
 };
 
-void trafficSimulator(ContinuousBatchingPipeline* pipe, Dataset* dataset, std::string request_rate, GenerationInfoCollector* generation_info_collector) {
+void print_statistics(const nlohmann::json& statistics) {
+    auto print_latency = [&statistics] (const std::string& title, const std::string& key) {
+        const nlohmann::json& latency = statistics[key];
+        std::cout << title << " mean / p50 / p90 / p99: " << latency["mean"].get<double>() << " / " << latency["p50"].get<double>()
+                  << " / " << latency["p90"].get<double>() << " / " << latency["p99"].get<double>() << " ms" << std::endl;
+    };
+    std::cout << "Benchmark duration: " << statistics["duration_s"].get<double>() << " s" << std::endl;
+    std::cout << "Total number of input tokens: " << statistics["total_input_tokens"].get<size_t>() << std::endl;
+    std::cout << "Total number of output tokens: " << statistics["total_output_tokens"].get<size_t>() << std::endl;
+    std::cout << "Request throughput: " << statistics["request_throughput"].get<double>() << " requests / s" << std::endl;
+    std::cout << "Input throughput: " << statistics["input_throughput"].get<double>() << " tokens / s" << std::endl;
+    std::cout << "Output throughput: " << statistics["output_throughput"].get<double>() << " tokens / s" << std::endl;
+    print_latency("TTFT", "ttft_ms");
+    print_latency("TPOT", "tpot_ms");
+    print_latency("E2E latency", "e2e_latency_ms");
+    std::cout << "Goodput (requests meeting SLO): " << statistics["goodput"].get<double>() << " requests / s" << std::endl;
+    std::cout << "Preemptions: " << statistics["num_preemptions"].get<size_t>()
+              << ", recomputed tokens: " << statistics["num_recomputed_tokens"].get<size_t>() << std::endl;
+}
+
+// arrival process of requests: intervals between requests follow gamma distribution with mean 1 / request_rate,
+// where burstiness is its shape; 1 gives Poisson process, lower values make arrivals burstier, higher ones more uniform
+struct TrafficConfig {
+    std::string request_rate = "inf";
+    double burstiness = 1.0;
+    // max number of requests processed simultaneously; 0 means no limit
+    size_t max_concurrency = 0;
+    unsigned int seed = 42;
+};
+
+void trafficSimulator(ContinuousBatchingPipeline* pipe, Dataset* dataset, TrafficConfig traffic_config, GenerationInfoCollector* generation_info_collector) {
     double numeric_request_rate;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::exponential_distribution<> distribution;
+    std::mt19937 gen(traffic_config.seed);
+    std::gamma_distribution<> distribution;
 
-    if (request_rate == "inf") {
+    if (traffic_config.request_rate == "inf") {
         numeric_request_rate = -1.0;
     } else {
-        numeric_request_rate = std::stod(request_rate);
+        numeric_request_rate = std::stod(traffic_config.request_rate);
         if (numeric_request_rate < 0)
             throw std::invalid_argument("request_rate cannot be a negative number");
+        if (traffic_config.burstiness <= 0)
+            throw std::invalid_argument("burstiness must be a positive number");
 
-        distribution = std::exponential_distribution<>(numeric_request_rate);
+        if (numeric_request_rate > 0)
+            distribution = std::gamma_distribution<>(traffic_config.burstiness, 1.0 / (numeric_request_rate * traffic_config.burstiness));
     }
 
-    /*
-    std::cout << "Total input tokens: " << dataset->m_total_input_len << std::endl;
-    std::cout << "Total output tokens: " << dataset->m_total_output_len << std::endl;
-    std::cout << "Average input len: " << dataset->get_average_input_len() << " tokens" << std::endl;
-    std::cout << "Average output len: " << dataset->get_average_output_len() << " tokens" << std::endl;
-    */
-
-    std::cout << "Launching traffic simulator thread with request_rate: " << request_rate << std::endl;
+    std::cout << "Launching traffic simulator thread with request_rate: " << traffic_config.request_rate
+              << ", burstiness: " << traffic_config.burstiness << ", max concurrency: " << traffic_config.max_concurrency << std::endl;
     generation_info_collector->set_start_time(std::chrono::steady_clock::now());
+    auto next_arrival_time = std::chrono::steady_clock::now();
     for (size_t request_id = 0; request_id < dataset->size(); ++request_id) {
-        std::cout << "Traffic thread adding request to the queue..." << std::endl;
+        while (traffic_config.max_concurrency > 0 && generation_info_collector->get_num_in_flight() >= traffic_config.max_concurrency)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         generation_info_collector->add_generation(pipe, dataset, request_id);
-        if (numeric_request_rate > 0)
-            std::this_thread::sleep_for(std::chrono::milliseconds(int(distribution(gen) * 1000)));
-    }
-    std::cout << "All requests sent, traffic simulation finished. Exiting thread." << std::endl;
-}
-
-void llmEngineLoop(ContinuousBatchingPipeline* pipe, Dataset* dataset, std::atomic<bool>* finishThread) {
-    std::cout << "Launching LLM engine thread" << std::endl;
-    size_t num_finished = 0;
-
-    while (!(*finishThread)) {
-        while (pipe->has_non_finished_requests()) {
-            pipe->step();
+        // arrivals are scheduled by absolute time, so adding requests doesn't shift them
+        if (numeric_request_rate > 0) {
+            next_arrival_time += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(distribution(gen)));
+            std::this_thread::sleep_until(next_arrival_time);
         }
     }
-    std::cout << "All requests processed, LLM Engine loop escaped. Exiting thread." << std::endl;
+    std::cout << "All requests sent, traffic simulation finished. Exiting thread." << std::endl;
 }
 
 void statisticsReporter(GenerationInfoCollector* generations_info_collector, int num_prompts) {
@@ -351,8 +415,6 @@ void statisticsReporter(GenerationInfoCollector* generations_info_collector, int
         num_finished = generations_info_collector->run();
     }
     std::cout << "Benchmark finished, summarizing statistics..." << std::endl;
-    generations_info_collector->print_statistics();
-
     std::cout << "Exiting statistics reporter thread." << std::endl;
 }
 
@@ -427,11 +489,20 @@ int main(int argc, char* argv[]) try {
     ("b,max_batch_size", "A maximum number of batched tokens", cxxopts::value<size_t>()->default_value("256"))
     ("dynamic_split_fuse", "Whether to use dynamic split-fuse or vLLM scheduling", cxxopts::value<bool>()->default_value("false"))
     ("m,model", "Path to model and tokenizers base directory", cxxopts::value<std::string>()->default_value("."))
+    ("draft_model", "Path to draft model for speculative decoding. Default: no speculative decoding", cxxopts::value<std::string>()->default_value(""))
+    ("num_speculative_tokens", "A number of candidates proposed by draft model per step", cxxopts::value<size_t>()->default_value("5"))
     ("dataset", "Path to dataset .json file", cxxopts::value<std::string>()->default_value("./ShareGPT_V3_unfiltered_cleaned_split.json"))
     ("max_input_len", "Max input length take from dataset", cxxopts::value<size_t>()->default_value("1024"))
     ("max_output_len", "Max output length", cxxopts::value<size_t>()->default_value("2048"))
     ("request_rate", "Number of requests per second. If this is inf, then all the requests are sent at time 0. Otherwise, we use Poisson process to synthesize the request arrival times.", cxxopts::value<std::string>()->default_value("inf"))
-    ("cache_size", "Size of memory used for KV cache in GB. Default: 16", cxxopts::value<size_t>()->default_value("16"))
+    ("burstiness", "Shape of gamma distribution of request inter-arrival times: 1 is Poisson process, lower values are burstier", cxxopts::value<double>()->default_value("1.0"))
+    ("max_concurrency", "Max number of requests processed simultaneously, new requests wait for it. Default: 0 (no limit)", cxxopts::value<size_t>()->default_value("0"))
+    ("seed", "Seed of request arrival times", cxxopts::value<unsigned int>()->default_value("42"))
+    ("ttft_slo", "TTFT SLO in ms for goodput. Default: 0 (not checked)", cxxopts::value<double>()->default_value("0"))
+    ("tpot_slo", "TPOT SLO in ms for goodput. Default: 0 (not checked)", cxxopts::value<double>()->default_value("0"))
+    ("e2e_slo", "End-to-end latency SLO in ms for goodput. Default: 0 (not checked)", cxxopts::value<double>()->default_value("0"))
+    ("output_json", "Path to JSON file with benchmark parameters and results. Default: not written", cxxopts::value<std::string>()->default_value(""))
+    ("cache_size", "Size of memory used for KV cache in GB, 0 sizes KV cache by free memory. Default: 16", cxxopts::value<size_t>()->default_value("16"))
     ("device", "Target device to run the model. Default: CPU", cxxopts::value<std::string>()->default_value("CPU"))
     ("device_config", "Plugin configuration JSON. Example: '{\"MODEL_DISTRIBUTION_POLICY\":\"TENSOR_PARALLEL\",\"PERF_COUNT\":true}' Default: {\"PERF_COUNT\":true}", cxxopts::value<std::string>()->default_value("{\"PERF_COUNT\":true}"))
     ("h,help", "Print usage");
@@ -454,10 +525,21 @@ int main(int argc, char* argv[]) try {
     const size_t max_batch_size = result["max_batch_size"].as<size_t>();
     const bool dynamic_split_fuse = result["dynamic_split_fuse"].as<bool>();
     const std::string models_path = result["model"].as<std::string>();
+    const std::string draft_models_path = result["draft_model"].as<std::string>();
+    const size_t num_speculative_tokens = result["num_speculative_tokens"].as<size_t>();
     const std::string dataset_path = result["dataset"].as<std::string>();
     const size_t max_input_len = result["max_input_len"].as<size_t>();
     const size_t max_output_len = result["max_output_len"].as<size_t>();
-    const std::string request_rate = result["request_rate"].as<std::string>();
+    TrafficConfig traffic_config;
+    traffic_config.request_rate = result["request_rate"].as<std::string>();
+    traffic_config.burstiness = result["burstiness"].as<double>();
+    traffic_config.max_concurrency = result["max_concurrency"].as<size_t>();
+    traffic_config.seed = result["seed"].as<unsigned int>();
+    SLO slo;
+    slo.ttft_ms = result["ttft_slo"].as<double>();
+    slo.tpot_ms = result["tpot_slo"].as<double>();
+    slo.e2e_ms = result["e2e_slo"].as<double>();
+    const std::string output_json = result["output_json"].as<std::string>();
     const std::string device = result["device"].as<std::string>();
     const std::string device_config = result["device_config"].as<std::string>();
     const size_t cache_size = result["cache_size"].as<size_t>();
@@ -472,6 +554,7 @@ int main(int argc, char* argv[]) try {
         .block_size = 32,
         .dynamic_split_fuse = dynamic_split_fuse,
         .max_num_seqs = 256, // not used if dynamic_split_fuse=True
+        .num_speculative_tokens = draft_models_path.empty() ? 0 : num_speculative_tokens,
     };
 
     std::cout << "Benchmarking parameters: " << std::endl;
@@ -480,6 +563,9 @@ int main(int argc, char* argv[]) try {
     if (!scheduler_config.dynamic_split_fuse) {
         std::cout << "\tMax number of batched sequences: " << scheduler_config.max_num_seqs << std::endl;
     }
+    if (!draft_models_path.empty()) {
+        std::cout << "\tDraft model: " << draft_models_path << ", speculative tokens: " << scheduler_config.num_speculative_tokens << std::endl;
+    }
     std::cout << "Dataset parameters: " << std::endl;
     std::cout << "\tNum prompts: " << num_prompts << std::endl;
     std::cout << "\tMax input length: " << max_input_len << std::endl;
@@ -495,27 +581,63 @@ int main(int argc, char* argv[]) try {
     
     // Benchmarking
     std::cout << "Loading models, creating pipelines, preparing environment..." << std::endl;
-    ContinuousBatchingPipeline pipe(models_path, scheduler_config, device, device_config_map);
+    ContinuousBatchingPipeline pipe = draft_models_path.empty() ?
+        ContinuousBatchingPipeline(models_path, scheduler_config, device, device_config_map) :
+        ContinuousBatchingPipeline(models_path, draft_models_path, scheduler_config, device, device_config_map);
 
     std::cout << "Setup finished, launching LLM executor, traffic simulation and statistics reporter threads" << std::endl;
 
     GenerationInfoCollector generation_info_collector;
 
-    std::atomic<bool> finishGenerationThread{false};
-    if (request_rate == "inf") {
-        std::thread trafficSimulatorThread(trafficSimulator, &pipe, &dataset, request_rate, &generation_info_collector);
+    // all requests arrive before serving starts, unless concurrency is limited, so the first step sees all of them
+    const bool is_offline = traffic_config.request_rate == "inf" && traffic_config.max_concurrency == 0;
+    if (is_offline) {
+        std::thread trafficSimulatorThread(trafficSimulator, &pipe, &dataset, traffic_config, &generation_info_collector);
         trafficSimulatorThread.join();
     }
-    
-    std::thread lmmEngineThread(llmEngineLoop, &pipe, &dataset, &finishGenerationThread);
+
+    // pipeline steps are run by its own serving thread, which sleeps while there are no requests
+    std::cout << "Launching LLM engine serving thread" << std::endl;
+    pipe.start_serving();
     std::thread statisticsReporterThread(statisticsReporter, &generation_info_collector, num_prompts);
-    if (request_rate != "inf") {
-        std::thread trafficSimulatorThread(trafficSimulator, &pipe, &dataset, request_rate, &generation_info_collector);
+    if (!is_offline) {
+        std::thread trafficSimulatorThread(trafficSimulator, &pipe, &dataset, traffic_config, &generation_info_collector);
         trafficSimulatorThread.join();
     }
     statisticsReporterThread.join();
-    finishGenerationThread = true;
-    lmmEngineThread.join();
+    pipe.stop_serving();
+    std::cout << "All requests processed, LLM engine serving thread stopped." << std::endl;
+
+    nlohmann::json statistics = generation_info_collector.get_statistics(slo);
+    print_statistics(statistics);
+    if (!output_json.empty()) {
+        nlohmann::json report = {
+            {"parameters", {
+                {"model", models_path},
+                {"draft_model", draft_models_path},
+                {"device", device},
+                {"plugin_config", device_config},
+                {"num_prompts", num_prompts},
+                {"max_input_len", max_input_len},
+                {"max_output_len", max_output_len},
+                {"max_num_batched_tokens", scheduler_config.max_num_batched_tokens},
+                {"max_num_seqs", scheduler_config.max_num_seqs},
+                {"dynamic_split_fuse", scheduler_config.dynamic_split_fuse},
+                {"cache_size", scheduler_config.cache_size},
+                {"num_speculative_tokens", scheduler_config.num_speculative_tokens},
+                {"request_rate", traffic_config.request_rate},
+                {"burstiness", traffic_config.burstiness},
+                {"max_concurrency", traffic_config.max_concurrency},
+                {"seed", traffic_config.seed},
+            }},
+            {"results", statistics},
+            {"pipeline_metrics", pipe.get_prometheus_metrics()},
+        };
+        std::ofstream output_file(output_json);
+        OPENVINO_ASSERT(output_file.is_open(), "Cannot open ", output_json);
+        output_file << report.dump(4) << std::endl;
+        std::cout << "Results are written to " << output_json << std::endl;
+    }
 
     std::cout << "Benchmark finished" << std::endl;
 } catch (const std::exception& error) {
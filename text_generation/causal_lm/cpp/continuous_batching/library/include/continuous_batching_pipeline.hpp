@@ -4,12 +4,14 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <openvino/openvino.hpp>
 
 #include "scheduler_config.hpp"
 #include "tokenizer.hpp"
 #include "generation_config.hpp"
 #include "generation_handle.hpp"
+#include "lora_adapter.hpp"
 
 struct PipelineMetrics { 
     // All requests as viewed by the pipeline
@@ -23,25 +25,85 @@ struct PipelineMetrics {
 class ContinuousBatchingPipeline {
     class Impl;
     std::shared_ptr<Impl> m_impl;
+    // NUMA worker mode (SchedulerConfig::enable_numa_workers): a pipeline with own compiled model per NUMA node,
+    // m_impl is the first one; empty otherwise
+    std::vector<std::shared_ptr<Impl>> m_workers;
+
+    explicit ContinuousBatchingPipeline(std::shared_ptr<Impl> impl);
+
+    // worker with the smallest number of unfinished requests
+    std::shared_ptr<Impl> _get_least_loaded_worker() const;
 
 public:
+    // 'device' can list several GPUs as "HETERO:GPU.0,GPU.1" for models, which don't fit into a single one: decoder layers
+    // are split between devices (pipeline parallel execution), and each device keeps KV cache of own layers
     ContinuousBatchingPipeline(const std::string& models_path,
                                const SchedulerConfig& scheduler_config,
                                const std::string& device = "CPU",
                                const ov::AnyMap& plugin_config = {});
 
+    // uses 'tokenizer' instead of reading tokenizer models from 'models_path', e.g. to share it with another pipeline
+    ContinuousBatchingPipeline(const std::string& models_path,
+                               std::shared_ptr<Tokenizer> tokenizer,
+                               const SchedulerConfig& scheduler_config,
+                               const std::string& device = "CPU",
+                               const ov::AnyMap& plugin_config = {});
+
+    // speculative decoding: draft model proposes scheduler_config.num_speculative_tokens candidates per step,
+    // which are validated by main model at once
+    ContinuousBatchingPipeline(const std::string& models_path,
+                               const std::string& draft_models_path,
+                               const SchedulerConfig& scheduler_config,
+                               const std::string& device = "CPU",
+                               const ov::AnyMap& plugin_config = {});
+
+    // creates a pipeline, which shares compiled model (weights) and tokenizer with this one, but has own KV cache
+    // configured by 'scheduler_config' and processes own requests; replicas can step in parallel, when model is
+    // compiled with several streams (ov::num_streams in plugin_config)
+    ContinuousBatchingPipeline create_replica(const SchedulerConfig& scheduler_config) const;
+
     std::shared_ptr<Tokenizer> get_tokenizer();
 
     GenerationConfig get_config() const;
 
     PipelineMetrics get_metrics() const;
 
+    // metrics accumulated since creation of pipeline in Prometheus text format: histograms of TTFT, inter-token
+    // latency, step phase durations and batch sizes, counters of preemptions and generated tokens, gauges of
+    // the last step; execution time of model operations is reported, if ov::enable_profiling(true) is in plugin_config
+    std::string get_prometheus_metrics() const;
+
     GenerationHandle add_request(uint64_t request_id, std::string prompt, GenerationConfig sampling_params);
 
+    // adds already tokenized prompt: i64 tensor of token ids, which are copied by the pipeline
+    GenerationHandle add_request(uint64_t request_id, ov::Tensor input_ids, GenerationConfig sampling_params);
+
+    // disaggregated prefill and decode: continues generation of a prompt, which KV cache is exported by another pipeline
+    // (see GenerationConfig::export_kv_cache) with the same model, KV cache precision and block size; requires
+    // dynamic_split_fuse scheduling; if KV cache has no free blocks to import the blob, prompt is computed instead
+    GenerationHandle add_request(uint64_t request_id, KVCacheBlob::Ptr kv_cache, GenerationConfig sampling_params);
+
     void step();
 
     bool has_non_finished_requests();
 
+    // serving mode: pipeline runs step() on its own thread, which sleeps while there are no requests to process
+    // and wakes up on add_request(); step() must not be called manually in this mode
+    void start_serving();
+
+    // processes already added requests and stops the serving thread; rethrows an error, which stopped serving
+    void stop_serving();
+
+    bool is_serving() const;
+
+    // loads LoRA adapter (requires scheduler_config.max_num_lora_adapters > 0), so requests can refer to it by
+    // GenerationConfig::lora_adapter_id; 'alpha' scales adapter's delta (lora_alpha / rank in terms of PEFT)
+    // adapters cannot be added or removed while pipeline is serving
+    void add_lora_adapter(size_t adapter_id, const LoRAAdapter& adapter, float alpha = 1.0f);
+
+    // adapter must not be used by non finished requests
+    void remove_lora_adapter(size_t adapter_id);
+
     // more high level interface, which can process multiple prompts in continuous batching manner
     std::vector<GenerationResult> generate(const std::vector<std::string>& prompts, std::vector<GenerationConfig> sampling_params);
 };
@@ -6,6 +6,7 @@
 
 #include <cstdlib>
 #include <limits>
+#include <set>
 #include <string>
 #include <functional>
 
@@ -24,6 +25,10 @@ struct GenerationConfig {
     size_t min_new_tokens = 0;
     size_t max_length = std::numeric_limits<std::size_t>::max(); // m_max_new_tokens should have priority over m_max_length
     bool ignore_eos = false;
+    // generation is also stopped by any of these tokens or once generated text contains any of these strings
+    // (stop token or the token completing stop string is the last generated one); ignore_eos doesn't affect them
+    std::set<int64_t> stop_token_ids;
+    std::set<std::string> stop_strings;
 
     // Beam search specific
     size_t num_groups = 1;
@@ -46,6 +51,33 @@ struct GenerationConfig {
     bool do_sample = false;
     size_t rng_seed = 0;
 
+    // Prompt lookup decoding: candidates are taken from prompt and generated tokens and validated by a single inference
+    size_t prompt_lookup_num_tokens = 0; // a number of candidates per step, 0 disables prompt lookup
+    size_t max_ngram_size = 3; // the longest suffix of generated text to look up
+
+    // Scheduling: requests with higher priority are processed first and preempted last
+    size_t priority = 0;
+    // time limit in milliseconds since request is added; requests exceeding it are dropped, 0 means no limit
+    size_t deadline_ms = 0;
+    // tenant submitting the request, which shares batch and KV cache with other tenants (see SchedulerConfig::enable_fair_share)
+    size_t tenant_id = 0;
+
+    // id of LoRA adapter added by ContinuousBatchingPipeline::add_lora_adapter, 0 means base model
+    size_t lora_adapter_id = 0;
+
+    // Structured generation: generated text must match the whole regular expression (e.g. derived from JSON schema);
+    // supported for greedy and multinomial sampling, empty means no constraint
+    std::string regex_constraint;
+
+    // Scoring: log-probabilities of this number of the last prompt tokens (e.g. of a continuation) are returned instead
+    // of generated tokens, so only the prompt is processed and KV cache is never allocated beyond it; 0 means generation
+    size_t num_scored_tokens = 0;
+
+    // Disaggregated prefill: KV cache of all prompt tokens except the last one is computed and returned as
+    // GenerationOutput::kv_cache instead of generated tokens; generation is continued by another pipeline,
+    // which imports it by ContinuousBatchingPipeline::add_request and computes the last prompt token itself
+    bool export_kv_cache = false;
+
     // special tokens IDs
     int64_t bos_token_id = -1;
     int64_t pad_token_id = -1;
@@ -68,10 +100,18 @@ struct GenerationConfig {
         return num_groups * group_size > 1;
     }
 
+    bool is_stop_token(int64_t token_id) const {
+        return (token_id == eos_token_id && !ignore_eos) || stop_token_ids.count(token_id) > 0;
+    }
+
     bool is_multinomial() const {
         return do_sample;
     }
 
+    bool is_scoring() const {
+        return num_scored_tokens > 0;
+    }
+
     void set_eos_token_id(size_t tokenizer_eos_token_id);
 
     void validate() const;
@@ -3,20 +3,42 @@
 
 #pragma once
 
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <unordered_map>
 
 #include "generation_config.hpp"
+#include "kv_cache_blob.hpp"
 
 
 enum class GenerationStatus {
     RUNNING = 0, // Default status for ongoing generation
     FINISHED = 1, // Status set when generation has been finished
     IGNORED = 2, // Status set when generation run into out-of-memory condition and could not be continued
-    DROPPED_BY_PIPELINE = 3, // Currently not used, TODO: implement abort functionality
+    DROPPED_BY_PIPELINE = 3, // Status set when generation exceeded its deadline or pipeline failed
     DROPPED_BY_HANDLE = 4 // Status set when generation handle is dropped
 };
 
+// lifecycle of a request measured by pipeline, e.g. to size KV cache and batch from production load;
+// time points are of std::chrono::steady_clock and have default value until corresponding event happens
+struct RequestMetrics {
+    std::chrono::steady_clock::time_point enqueued_time;
+    std::chrono::steady_clock::time_point first_scheduled_time;
+    std::chrono::steady_clock::time_point first_token_time;
+    // time of leaving RUNNING status, i.e. of finishing, ignoring or dropping the request
+    std::chrono::steady_clock::time_point finished_time;
+    // number of times request was preempted by swapping or recomputation
+    size_t num_preemptions = 0;
+    // processed tokens, which KV cache was released by preemption and which were computed again
+    size_t num_recomputed_tokens = 0;
+    // prompt tokens, which KV cache was restored from prefix cache instead of computation (including prefixes
+    // computed by a request of the same prefix grouped with this one, see SchedulerConfig::enable_prefix_grouping)
+    size_t num_cached_prompt_tokens = 0;
+    // prompt tokens, which KV cache was imported from KVCacheBlob instead of computation
+    size_t num_imported_prompt_tokens = 0;
+};
+
 struct GenerationResult {
     // request ID - obsolete when handle API is approved as handle will connect results with prompts.
     uint64_t m_request_id;
@@ -29,11 +51,17 @@ struct GenerationResult {
 
     // Status of generation
     GenerationStatus m_status = GenerationStatus::RUNNING;
+
+    RequestMetrics m_metrics;
 };
 
 struct GenerationOutput {
     std::vector<int64_t> generated_token_ids;
     float score;
+    // scoring requests return scored prompt tokens as generated ones together with their log-probabilities
+    std::vector<float> log_probs;
+    // KV cache export requests return KV cache of prompt instead of generated tokens
+    KVCacheBlob::Ptr kv_cache;
 };
 
 using GenerationOutputs = std::unordered_map<uint64_t, GenerationOutput>;
@@ -57,12 +85,30 @@ public:
 
     GenerationStatus get_status();
 
+    // metrics of the request as of the last pipeline step, which processed it; final once status is not RUNNING
+    RequestMetrics get_metrics();
+
     bool can_read();
 
     // Reads result of a generation for single iteration
     GenerationOutputs read();
+    // Blocking read of a single iteration, which returns false once generation is over and all outputs are read
+    bool read(GenerationOutputs& outputs);
+    // Non-blocking poll: returns false if there are no new outputs yet
+    bool try_read(GenerationOutputs& outputs);
+    // Non-blocking batched read: tokens of all iterations available so far, merged per sequence
+    GenerationOutputs read_available();
     // Reads all generated tokens for all sequences
     std::vector<GenerationOutput> read_all();
+
+    // Sets a callback, which is called with final status once generation finishes; all outputs are readable at that point.
+    // The callback is called from the thread running pipeline's steps, so it should not block
+    void set_completion_callback(std::function<void(GenerationStatus)> callback);
+
+    // Sets a callback, which is called each time new outputs are pushed or status is changed, e.g. to wake up an event loop
+    // instead of blocking a thread in read(); it's called from the thread running pipeline's steps, so it should not block.
+    // Outputs pushed before the callback is set do not invoke it, so readiness must be checked after setting it
+    void set_output_callback(std::function<void()> callback);
 };
 
 using GenerationHandle = std::unique_ptr<GenerationHandleImpl>;
@@ -0,0 +1,88 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// KV cache of a prompt, which is computed by one pipeline and imported by another one to continue generation there,
+// e.g. prefill and decode are run on different machines (see GenerationConfig::export_kv_cache). The blob is a single
+// buffer, which is sent and received as is:
+//
+//   Header | prompt token ids | padding to kAlignment | block 0 | block 1 | ... | block N - 1
+//
+// where each block holds keys and values of all decoder layers: [layer 0 keys | layer 0 values | layer 1 keys | ...],
+// so a block is contiguous and is written to KV cache of importing pipeline directly from the received buffer.
+// Integers are stored in host byte order; pipelines must have the same model, KV cache precision and block size
+class KVCacheBlob {
+public:
+    using Ptr = std::shared_ptr<const KVCacheBlob>;
+
+    static constexpr uint32_t kMagic = 0x564B564F; // "OVKV"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kAlignment = 64;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        // name of KV cache element type, e.g. "f16" or "u8"
+        char precision[16];
+        uint64_t block_size;
+        uint64_t num_layers;
+        // byte sizes of keys and values of a single decoder layer within a block
+        uint64_t key_block_byte_size;
+        uint64_t value_block_byte_size;
+        uint64_t num_prompt_tokens;
+        // the first prompt tokens, which KV cache is stored; the rest of prompt is computed by importing pipeline
+        uint64_t num_kv_tokens;
+        uint64_t num_blocks;
+    };
+
+    // allocates a blob for 'prompt_ids', whose first 'num_kv_tokens' have KV cache; blocks are filled by caller
+    KVCacheBlob(const std::vector<int64_t>& prompt_ids, size_t num_kv_tokens, const std::string& precision, size_t block_size,
+                size_t num_layers, size_t key_block_byte_size, size_t value_block_byte_size);
+
+    // takes ownership of a received buffer and validates its layout
+    explicit KVCacheBlob(std::vector<uint8_t> buffer);
+
+    // wraps 'size' bytes of external memory, e.g. a memory mapped file, which is kept alive by 'data'; validates its layout
+    KVCacheBlob(std::shared_ptr<uint8_t> data, size_t size);
+
+    const Header& get_header() const;
+
+    std::vector<int64_t> get_prompt_ids() const;
+
+    size_t get_num_kv_tokens() const {
+        return get_header().num_kv_tokens;
+    }
+
+    size_t get_num_blocks() const {
+        return get_header().num_blocks;
+    }
+
+    // bytes of keys and values of all layers within a block
+    size_t get_block_byte_size() const;
+
+    uint8_t* get_block_data(size_t block_idx);
+    const uint8_t* get_block_data(size_t block_idx) const;
+
+    // serialized form, which can be sent or written without copies
+    const uint8_t* data() const {
+        return m_data.get();
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+    std::shared_ptr<uint8_t> m_data;
+    size_t m_size = 0;
+
+    void _validate() const;
+
+    size_t _get_blocks_offset() const;
+};
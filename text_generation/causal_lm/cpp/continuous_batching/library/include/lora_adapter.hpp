@@ -0,0 +1,15 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <openvino/runtime/tensor.hpp>
+
+// LoRA adapter weights: layer name => {A [rank, in_features], B [out_features, rank]} f32 matrices, so that
+// delta of layer output is alpha * x * A^T * B^T; layer names are matched against friendly names of model's
+// linear layers with '.' replaced by '_' (e.g. "model.layers.0.self_attn.q_proj")
+using LoRAAdapter = std::map<std::string, std::pair<ov::Tensor, ov::Tensor>>;
@@ -4,6 +4,21 @@
 #pragma once
 
 #include <cstddef>
+#include <map>
+#include <string>
+
+// share and limits of requests of a tenant (see GenerationConfig::tenant_id and SchedulerConfig::tenants)
+struct TenantConfig {
+    // share of batch and KV cache relative to other tenants, which have requests to process
+    float weight = 1.0f;
+
+    // max number of tokens of the tenant scheduled on a step; 0 means no limit
+    std::size_t max_num_batched_tokens = 0;
+
+    // max number of KV blocks used by sequences of the tenant; 0 means no limit
+    // (generated sequences, which don't fit it, preempt lower priority sequences of the same tenant or wait for them to finish)
+    std::size_t max_num_kv_blocks = 0;
+};
 
 struct SchedulerConfig {
     // a maximum number of tokens to batch
@@ -17,16 +32,125 @@ struct SchedulerConfig {
     // total size of KV cache in GB
     std::size_t cache_size = 0;
 
+    // if neither num_kv_blocks nor cache_size is set, KV cache is sized automatically: a forward pass of
+    // max_num_batched_tokens tokens is run at startup, so the plugin allocates intermediate buffers of the largest step,
+    // and this fraction of device (or host for CPU) memory left free after it is given to KV cache
+    float kv_cache_memory_fraction = 0.9f;
+
     // block size for KV cache
     std::size_t block_size = 32;
 
     // whether to split prompt / generate to different scheduling phases
     bool dynamic_split_fuse = true;
 
+    // number of host KV blocks (swap space) to keep KV cache of preempted sequences
+    // 0 means that preempted sequences are always recomputed
+    std::size_t num_swap_blocks = 0;
+
+    // minimal number of processed tokens in a sequence group to preempt it by swapping instead of recomputation
+    // (swapping costs two copies of KV cache, while recomputation requires prefill of the whole context)
+    std::size_t swap_min_context_len = 256;
+
     //
     // vLLM-like settings
     //
 
     // max number of scheduled sequences (you can think of it as "max batch size")
     std::size_t max_num_seqs = 256;
+
+    // whether to split every step into two parts executed on separate infer requests, so input preparation
+    // and sampling of one part overlap with inference of another one; with pipeline parallel execution
+    // (e.g. "HETERO:GPU.0,GPU.1" device) the parts are micro-batches, which are computed by different devices at once
+    bool enable_async_execution = false;
+
+    // multi-step decode: number of steps run for a batch of generation tokens only without rescheduling it; KV cache is
+    // reserved for all steps at once and model inputs are updated in place, while new requests wait for the next
+    // scheduling (1 disables multi-step decode)
+    std::size_t num_decode_steps = 1;
+
+    // whether to reuse KV blocks of common prompt prefixes between requests
+    // (currently supported only with dynamic_split_fuse)
+    bool enable_prefix_caching = false;
+
+    // whether to defer a new prompt sharing full blocks of prefix with a prompt scheduled on the same step, until the
+    // latter computes the common prefix, so the prefix is computed once and its blocks are restored from prefix cache
+    // (requires enable_prefix_caching)
+    bool enable_prefix_grouping = false;
+
+    // directory to store KV cache of finished requests (e.g. chat conversations), so a later request continuing one of them,
+    // also after restart of the pipeline, imports KV cache of the stored prefix instead of computing it; files are kept
+    // across runs, so the directory must be used by pipelines of the same model only; empty disables the session cache
+    // (supported only with dynamic_split_fuse and without speculative decoding)
+    std::string session_cache_dir;
+
+    // max total size of stored sessions in GB; the least recently used sessions are removed first
+    std::size_t session_cache_size = 16;
+
+    // max number of compiled constraints of constrained generation (GenerationConfig::regex_constraint) cached by pattern;
+    // the least recently used ones are removed first, while requests keep constraints they use
+    std::size_t token_constraint_cache_size = 64;
+
+    // number of candidate tokens proposed by a draft model on each generation step of a sequence group,
+    // which are then validated by a single inference of the main model (requires pipeline with a draft model)
+    // 0 disables speculative decoding
+    std::size_t num_speculative_tokens = 0;
+
+    //
+    // decode-first policy of dynamic_split_fuse: generation tokens are scheduled before prompt ones,
+    // while prompts get a bounded part of max_num_batched_tokens, so long prompts neither stall ongoing generation
+    // nor are starved by it
+    //
+
+    // number of tokens reserved for prompts on each step when there are prompts to process (0 disables reservation)
+    std::size_t min_prefill_chunk_size = 0;
+
+    // maximum fraction of max_num_batched_tokens, which prompts can occupy on a single step
+    // (reserved min_prefill_chunk_size tokens are always available for prompts)
+    float max_prefill_fraction = 1.0f;
+
+    // KV cache is allocated lazily by chunks of this number of blocks up to num_kv_blocks (or cache_size),
+    // when scheduled sequences do not fit into already allocated blocks; 0 allocates the whole KV cache at start
+    std::size_t num_kv_blocks_per_chunk = 0;
+
+    // whether to shrink lazily allocated KV cache back to a single chunk, when there are no requests to process
+    bool release_idle_kv_cache = false;
+
+    //
+    // sliding window KV cache (StreamingLLM): KV blocks of the oldest tokens are evicted, while the first blocks of
+    // a sequence ("attention sinks") are kept, so KV cache of a sequence is bounded for arbitrary long generation;
+    // tokens keep their original positions, so it's applicable only to models, which tolerate such attention context
+    //
+
+    // max number of the most recent KV blocks of a sequence in addition to sink blocks; 0 disables eviction
+    std::size_t kv_window_blocks = 0;
+
+    // number of the first KV blocks of a sequence, which are never evicted
+    std::size_t num_sink_blocks = 1;
+
+    // whether to run a worker per NUMA node of CPU host (e.g. per socket); each worker runs inference on CPUs of its node
+    // with own copy of weights and KV cache of the size configured above, allocated in local memory of the node, and
+    // requests are dispatched to the least loaded worker
+    bool enable_numa_workers = false;
+
+    //
+    // multi-LoRA serving: requests use different LoRA adapters of the same base model within one batch
+    //
+
+    // max number of simultaneously loaded LoRA adapters; 0 disables LoRA support
+    std::size_t max_num_lora_adapters = 0;
+
+    // max rank of LoRA adapters; adapters of lower ranks are padded with zeros
+    std::size_t max_lora_rank = 16;
+
+    //
+    // fair share scheduling of tenants (GenerationConfig::tenant_id) with dynamic_split_fuse: requests of the same priority
+    // are ordered by weighted fair queuing of scheduled tokens, so every tenant gets a part of batch proportional to its
+    // weight, while sequences of tenants using more KV blocks than their share are preempted first
+    //
+
+    // whether tenants share batch and KV cache fairly; otherwise requests of all tenants are served in the same queue
+    bool enable_fair_share = false;
+
+    // tenant id => share and limits of the tenant; tenants, which are not listed, use default TenantConfig
+    std::map<std::size_t, TenantConfig> tenants;
 };
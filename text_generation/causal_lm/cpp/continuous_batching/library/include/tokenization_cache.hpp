@@ -0,0 +1,92 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "openvino/runtime/tensor.hpp"
+
+// LRU cache of tokenized prompts bounded by memory occupied by prompts and their tokens, e.g. for repeated
+// system prompts or tool descriptions. Entries are found by hash of prompt, while prompt itself is compared
+// to resolve collisions. Cached tensors are returned without copying, so they must not be modified
+class TokenizationCache {
+    struct Entry {
+        size_t m_hash;
+        std::string m_prompt;
+        ov::Tensor m_input_ids;
+
+        size_t get_size() const {
+            return m_prompt.size() + m_input_ids.get_byte_size();
+        }
+    };
+
+    // the most recently used entries are at the front
+    std::list<Entry> m_entries;
+    std::unordered_map<size_t, std::list<Entry>::iterator> m_hash_2_entry;
+    size_t m_capacity;
+    size_t m_size = 0;
+    mutable std::mutex m_mutex;
+
+    void _erase(std::list<Entry>::iterator entry) {
+        m_size -= entry->get_size();
+        m_hash_2_entry.erase(entry->m_hash);
+        m_entries.erase(entry);
+    }
+
+    void _evict() {
+        while (m_size > m_capacity)
+            _erase(std::prev(m_entries.end()));
+    }
+
+public:
+    // zero capacity disables cache
+    explicit TokenizationCache(size_t capacity_bytes = 0) : m_capacity(capacity_bytes) {}
+
+    void set_capacity(size_t capacity_bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity_bytes;
+        _evict();
+    }
+
+    size_t get_capacity() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_capacity;
+    }
+
+    // memory occupied by cached entries in bytes
+    size_t get_size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_size;
+    }
+
+    bool get(const std::string& prompt, ov::Tensor& input_ids) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_hash_2_entry.find(std::hash<std::string>{}(prompt));
+        if (it == m_hash_2_entry.end() || it->second->m_prompt != prompt)
+            return false;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        input_ids = it->second->m_input_ids;
+        return true;
+    }
+
+    void put(const std::string& prompt, const ov::Tensor& input_ids) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry entry{std::hash<std::string>{}(prompt), prompt, input_ids};
+        if (entry.get_size() > m_capacity)
+            return;
+        // replaces the same prompt or another prompt with colliding hash
+        auto it = m_hash_2_entry.find(entry.m_hash);
+        if (it != m_hash_2_entry.end())
+            _erase(it->second);
+
+        m_size += entry.get_size();
+        m_entries.push_front(std::move(entry));
+        m_hash_2_entry[m_entries.front().m_hash] = m_entries.begin();
+        _evict();
+    }
+};
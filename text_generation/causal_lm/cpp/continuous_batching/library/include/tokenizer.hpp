@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include <string>
 #include <memory>
 #include <vector>
@@ -17,11 +18,23 @@ class Tokenizer {
 public:
     explicit Tokenizer(const std::string& models_path);
 
-    // note, that returned tensor is shared with internal state of InferRequest
-    // so, it can be changed. Please, copy values
+    // wraps an already created tokenizer, e.g. ov::genai::Tokenizer, so its models are not read and compiled again:
+    // 'encode' returns i64 token ids of shape [1, N], 'decode' decodes a batch of token sequences
+    Tokenizer(std::function<ov::Tensor(const std::string&)> encode,
+              std::function<std::vector<std::string>(std::vector<std::vector<int64_t>>)> decode,
+              size_t eos_token_id);
+
+    // note, that returned tensor can be shared with tokenization cache
+    // so, it must not be changed. Please, copy values
     ov::Tensor encode(std::string prompt);
 
+    // enables LRU cache of tokenized prompts occupying up to 'capacity_bytes'; zero disables cache
+    void set_cache_capacity(size_t capacity_bytes);
+
     std::string decode(std::vector<int64_t> tokens);
 
+    // decodes each token separately, e.g. to get texts of all tokens in vocabulary
+    std::vector<std::string> decode_tokens(std::vector<int64_t> tokens);
+
     size_t get_eos_token_id() const;
 };
@@ -0,0 +1,108 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <numeric>
+
+#include "block_manager.hpp"
+#include "sequence_group.hpp"
+#include "generation_config.hpp"
+
+namespace {
+
+const size_t kBlockSize = 32;
+const size_t kPromptLen = 128;
+// sequence groups are recreated after this number of generated tokens, so steps of a run are alike
+const size_t kMaxNewTokens = 64;
+
+struct BeamSearchState {
+    std::unique_ptr<BlockManager> block_manager;
+    std::vector<SequenceGroup::Ptr> requests;
+    size_t beam_width;
+
+    BeamSearchState(size_t num_groups, size_t beam_width) : beam_width(beam_width) {
+        // forks share blocks, so this is an upper bound
+        const size_t max_num_blocks_per_sequence = (kPromptLen + kMaxNewTokens + kBlockSize - 1) / kBlockSize + 1;
+        block_manager = std::make_unique<BlockManager>(num_groups * beam_width * max_num_blocks_per_sequence);
+
+        std::vector<int64_t> prompt(kPromptLen);
+        std::iota(prompt.begin(), prompt.end(), 0);
+        for (size_t request_id = 0; request_id < num_groups; ++request_id) {
+            SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(request_id, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                                                GenerationConfig::beam_search(), kBlockSize);
+            // prompt phase
+            sequence_group->schedule_tokens(kPromptLen);
+            block_manager->append_slots(sequence_group);
+            sequence_group->finish_iteration();
+
+            // the first generated token is shared by all beams, which are forked from the prompt sequence
+            Sequence::Ptr prompt_sequence = (*sequence_group)[0];
+            prompt_sequence->append_token(0, -1.0f);
+            for (size_t beam_idx = 1; beam_idx < beam_width; ++beam_idx)
+                block_manager->fork_sequence(prompt_sequence->get_id(), sequence_group->fork_sequence(prompt_sequence)->get_id());
+            requests.push_back(sequence_group);
+        }
+    }
+
+    // emulates a generation step of beam search: KV slots are reserved for scheduled tokens, and then
+    // the worst half of beams is replaced by continuations of the best half; returns a number of block copies
+    size_t step() {
+        size_t num_copies = 0;
+        for (SequenceGroup::Ptr sequence_group : requests) {
+            sequence_group->schedule_tokens(1);
+            OPENVINO_ASSERT(block_manager->can_append_slots(sequence_group));
+            for (const auto& block_copies : block_manager->append_slots(sequence_group))
+                num_copies += block_copies.second.size();
+        }
+
+        for (SequenceGroup::Ptr sequence_group : requests) {
+            std::vector<Sequence::Ptr> running_sequences = sequence_group->get_running_sequences();
+            const size_t num_kept_beams = beam_width - beam_width / 2;
+            for (size_t beam_idx = num_kept_beams; beam_idx < running_sequences.size(); ++beam_idx) {
+                block_manager->free_sequence(running_sequences[beam_idx]->get_id());
+                sequence_group->remove_sequence(running_sequences[beam_idx]->get_id());
+            }
+            for (size_t beam_idx = 0; beam_idx < beam_width / 2; ++beam_idx) {
+                Sequence::Ptr parent_sequence = running_sequences[beam_idx % num_kept_beams];
+                block_manager->fork_sequence(parent_sequence->get_id(), sequence_group->fork_sequence(parent_sequence)->get_id());
+            }
+            int64_t token_id = 0;
+            for (Sequence::Ptr sequence : sequence_group->get_running_sequences())
+                sequence->append_token(token_id++, -1.0f);
+            sequence_group->finish_iteration();
+        }
+        return num_copies;
+    }
+};
+
+}  // namespace
+
+// append_slots / fork_sequence / free_sequence of beam search, where forked beams share KV blocks and
+// their last partially filled blocks are copied on write
+static void BM_BlockManagerBeamSearch(benchmark::State& state) {
+    const size_t num_groups = state.range(0);
+    const size_t beam_width = state.range(1);
+
+    std::unique_ptr<BeamSearchState> beam_search_state;
+    size_t num_steps = kMaxNewTokens, num_copies = 0;
+    for (auto _ : state) {
+        if (num_steps == kMaxNewTokens) {
+            state.PauseTiming();
+            beam_search_state = std::make_unique<BeamSearchState>(num_groups, beam_width);
+            num_steps = 0;
+            state.ResumeTiming();
+        }
+
+        num_copies += beam_search_state->step();
+        ++num_steps;
+    }
+    state.SetItemsProcessed(state.iterations() * num_groups * beam_width);
+    state.counters["block_copies"] = benchmark::Counter(num_copies, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_BlockManagerBeamSearch)
+    ->ArgNames({"groups", "beam_width"})
+    ->ArgsProduct({{64, 256, 1024}, {4, 8, 16}})
+    ->Unit(benchmark::kMicrosecond);
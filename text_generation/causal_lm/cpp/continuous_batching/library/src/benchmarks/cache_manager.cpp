@@ -0,0 +1,42 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include "openvino/runtime/core.hpp"
+#include "scheduler.hpp"
+#include "device_config.hpp"
+#include "cache_manager.hpp"
+
+// copy-on-write of KV blocks, which are forked by beam search or parallel sampling, over all decoder layers
+static void BM_CacheManagerCopyBlocks(benchmark::State& state) {
+    const size_t num_copies = state.range(0);
+    const size_t num_copies_per_block = state.range(1);
+
+    ov::Core core;
+    SchedulerConfig scheduler_config;
+    scheduler_config.num_kv_blocks = 256;
+    scheduler_config.block_size = 32;
+    DeviceConfig device_config(core, scheduler_config, "CPU");
+    // KV heads, head size and layers of a small GQA model
+    device_config.set_model_params(8, 64, 16);
+    CacheManager cache_manager(device_config);
+
+    // the first half of blocks is copied to the second one
+    std::map<size_t, std::list<size_t>> block_copy_map;
+    for (size_t copy_idx = 0; copy_idx < num_copies; ++copy_idx) {
+        size_t src_block_id = copy_idx / num_copies_per_block;
+        block_copy_map[src_block_id].push_back(scheduler_config.num_kv_blocks / 2 + copy_idx);
+    }
+
+    for (auto _ : state) {
+        cache_manager.copy_blocks(block_copy_map);
+    }
+    state.SetItemsProcessed(state.iterations() * num_copies);
+    state.SetBytesProcessed(state.iterations() * num_copies * device_config.get_block_byte_size());
+}
+
+BENCHMARK(BM_CacheManagerCopyBlocks)
+    ->ArgNames({"copies", "copies_per_block"})
+    ->ArgsProduct({{1, 16, 128}, {1, 8}})
+    ->Unit(benchmark::kMicrosecond);
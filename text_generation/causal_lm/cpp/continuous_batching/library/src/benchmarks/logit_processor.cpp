@@ -0,0 +1,103 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <numeric>
+#include <random>
+
+#include "logit_processor.hpp"
+
+using namespace LogitTransformers;
+
+namespace {
+
+std::vector<Token> get_random_logits(size_t vocab_size) {
+    std::mt19937 rng_engine(42);
+    std::normal_distribution<float> distribution(0.0f, 4.0f);
+    std::vector<Token> logits(vocab_size);
+    for (size_t token_id = 0; token_id < vocab_size; ++token_id)
+        logits[token_id] = Token(distribution(rng_engine), token_id);
+    return logits;
+}
+
+// transformers can reorder and shrink logits, so each iteration starts from the same input, which copy is not measured
+void run_transformer_benchmark(benchmark::State& state, ILogitTransformer& transformer, bool normalize_input = true) {
+    std::vector<Token> input_logits = get_random_logits(state.range(0));
+    if (normalize_input) {
+        // filters of multinomial sampling are applied to probabilities
+        TemperatureLogitTransform(1.0).apply_inplace(input_logits);
+    }
+
+    std::vector<Token> logits;
+    for (auto _ : state) {
+        state.PauseTiming();
+        logits = input_logits;
+        state.ResumeTiming();
+
+        transformer.apply_inplace(logits);
+        benchmark::DoNotOptimize(logits.data());
+    }
+    state.SetItemsProcessed(state.iterations() * input_logits.size());
+}
+
+const std::vector<int64_t> kVocabSizes = {32000, 128256, 151936};
+
+}  // namespace
+
+static void BM_TemperatureLogitTransform(benchmark::State& state) {
+    TemperatureLogitTransform transformer(0.7);
+    run_transformer_benchmark(state, transformer, false);
+}
+
+BENCHMARK(BM_TemperatureLogitTransform)->ArgName("vocab")->ArgsProduct({kVocabSizes})->Unit(benchmark::kMicrosecond);
+
+static void BM_TopPFilter(benchmark::State& state) {
+    TopPFilter transformer(0.9);
+    run_transformer_benchmark(state, transformer);
+}
+
+BENCHMARK(BM_TopPFilter)->ArgName("vocab")->ArgsProduct({kVocabSizes})->Unit(benchmark::kMicrosecond);
+
+static void BM_TopKFilter(benchmark::State& state) {
+    TopKFilter transformer(50);
+    run_transformer_benchmark(state, transformer);
+}
+
+BENCHMARK(BM_TopKFilter)->ArgName("vocab")->ArgsProduct({kVocabSizes})->Unit(benchmark::kMicrosecond);
+
+// the whole chain of multinomial sampling with penalties of already generated tokens
+static void BM_LogitProcessorMultinomial(benchmark::State& state) {
+    const size_t vocab_size = state.range(0);
+    const size_t num_generated_tokens = state.range(1);
+
+    GenerationConfig sampling_params = GenerationConfig::multinomial();
+    sampling_params.min_new_tokens = 0;
+    sampling_params.repetition_penalty = 1.1f;
+    std::vector<int64_t> prompt(128);
+    std::iota(prompt.begin(), prompt.end(), 0);
+    LogitProcessor logit_processor(sampling_params, prompt);
+
+    std::mt19937 rng_engine(42);
+    std::uniform_int_distribution<int64_t> token_distribution(0, vocab_size - 1);
+    for (size_t token_idx = 0; token_idx < num_generated_tokens; ++token_idx) {
+        logit_processor.register_new_generated_token(token_distribution(rng_engine));
+        logit_processor.increment_gen_tokens();
+    }
+
+    std::vector<Token> input_logits = get_random_logits(vocab_size), logits;
+    for (auto _ : state) {
+        state.PauseTiming();
+        logits = input_logits;
+        state.ResumeTiming();
+
+        logit_processor.apply(logits);
+        benchmark::DoNotOptimize(logits.data());
+    }
+    state.SetItemsProcessed(state.iterations() * vocab_size);
+}
+
+BENCHMARK(BM_LogitProcessorMultinomial)
+    ->ArgNames({"vocab", "generated"})
+    ->ArgsProduct({kVocabSizes, {16, 1024}})
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,129 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+
+#include "sampler.hpp"
+#include "sequence_group.hpp"
+#include "generation_config.hpp"
+
+namespace {
+
+const size_t kBlockSize = 32;
+const size_t kPromptLen = 128;
+// sequence groups are recreated after this number of generated tokens, so steps of a run are alike
+const size_t kMaxNewTokens = 64;
+
+// logits of a step, which are random, but the same for all runs
+std::vector<float> get_random_logits(size_t num_rows, size_t vocab_size) {
+    std::mt19937 rng_engine(42);
+    std::normal_distribution<float> distribution(0.0f, 4.0f);
+    std::vector<float> logits(num_rows * vocab_size);
+    for (float& logit : logits)
+        logit = distribution(rng_engine);
+    return logits;
+}
+
+struct SamplingState {
+    std::unique_ptr<Sampler> sampler;
+    std::vector<SequenceGroup::Ptr> requests;
+    std::vector<float>& logits;
+    size_t vocab_size;
+
+    SamplingState(const GenerationConfig& sampling_params, size_t num_groups, std::vector<float>& logits, size_t vocab_size) :
+        sampler(std::make_unique<Sampler>()), logits(logits), vocab_size(vocab_size) {
+        // generated tokens are not read by handles
+        sampler->set_notify_finished_only(true);
+
+        std::vector<int64_t> prompt(kPromptLen);
+        std::iota(prompt.begin(), prompt.end(), 0);
+        for (size_t request_id = 0; request_id < num_groups; ++request_id) {
+            requests.push_back(std::make_shared<SequenceGroup>(request_id, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                               sampling_params, kBlockSize));
+            // only the last prompt token is left, so the first step samples the first generated token
+            requests.back()->update_processed_tokens_num(kPromptLen - 1);
+        }
+        // beam search forks beams on the first step, so the next steps have the same number of sequences
+        step();
+    }
+
+    void step() {
+        size_t num_running_sequences = 0;
+        for (SequenceGroup::Ptr sequence_group : requests) {
+            sequence_group->schedule_tokens(1);
+            num_running_sequences += sequence_group->num_running_seqs();
+        }
+        OPENVINO_ASSERT(num_running_sequences * vocab_size <= logits.size());
+        ov::Tensor logits_tensor(ov::element::f32, {num_running_sequences, 1, vocab_size}, logits.data());
+        SamplerOutput sampler_output = sampler->sample(requests, logits_tensor);
+        benchmark::DoNotOptimize(sampler_output);
+    }
+};
+
+// a step of a batch of sequence groups sharing the same sampling parameters
+void run_sampler_benchmark(benchmark::State& state, const GenerationConfig& sampling_params) {
+    const size_t vocab_size = state.range(0);
+    const size_t num_groups = state.range(1);
+    const size_t num_sequences_per_group = sampling_params.is_beam_search() ? sampling_params.num_groups * sampling_params.group_size : 1;
+    std::vector<float> logits = get_random_logits(num_groups * num_sequences_per_group, vocab_size);
+
+    std::unique_ptr<SamplingState> sampling_state;
+    size_t num_steps = kMaxNewTokens;
+    for (auto _ : state) {
+        if (num_steps == kMaxNewTokens) {
+            state.PauseTiming();
+            sampling_state = std::make_unique<SamplingState>(sampling_params, num_groups, logits, vocab_size);
+            num_steps = 0;
+            state.ResumeTiming();
+        }
+
+        sampling_state->step();
+        ++num_steps;
+    }
+    state.SetItemsProcessed(state.iterations() * num_groups * num_sequences_per_group);
+}
+
+const std::vector<int64_t> kVocabSizes = {32000, 128256, 151936};
+
+}  // namespace
+
+// argmax over raw logits, when there are no penalties
+static void BM_SamplerGreedy(benchmark::State& state) {
+    GenerationConfig sampling_params;
+    sampling_params.num_return_sequences = 1;
+    run_sampler_benchmark(state, sampling_params);
+}
+
+BENCHMARK(BM_SamplerGreedy)
+    ->ArgNames({"vocab", "groups"})
+    ->ArgsProduct({kVocabSizes, {1, 32, 256}})
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_SamplerMultinomial(benchmark::State& state) {
+    GenerationConfig sampling_params = GenerationConfig::multinomial();
+    sampling_params.num_return_sequences = 1;
+    sampling_params.min_new_tokens = 0;
+    sampling_params.max_new_tokens = std::numeric_limits<size_t>::max();
+    run_sampler_benchmark(state, sampling_params);
+}
+
+BENCHMARK(BM_SamplerMultinomial)
+    ->ArgNames({"vocab", "groups"})
+    ->ArgsProduct({kVocabSizes, {1, 32, 256}})
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_SamplerBeamSearch(benchmark::State& state) {
+    GenerationConfig sampling_params = GenerationConfig::beam_search();
+    sampling_params.max_new_tokens = std::numeric_limits<size_t>::max();
+    run_sampler_benchmark(state, sampling_params);
+}
+
+BENCHMARK(BM_SamplerBeamSearch)
+    ->ArgNames({"vocab", "groups"})
+    ->ArgsProduct({kVocabSizes, {1, 8, 32}})
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,139 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+
+#include "scheduler.hpp"
+#include "sequence_group.hpp"
+#include "generation_config.hpp"
+
+namespace {
+
+const size_t kBlockSize = 32;
+const size_t kPromptLen = 128;
+// sequence groups are recreated after this number of generated tokens, so steps of a run are alike
+const size_t kMaxNewTokens = 64;
+
+// emulates sampling: a token is appended to each running sequence of scheduled groups, which are not in prompt phase
+void finish_step(std::vector<SequenceGroup::Ptr>& requests, const Scheduler::Output& scheduler_output) {
+    for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+        SequenceGroup::Ptr sequence_group = requests[sequence_group_id];
+        if (sequence_group->requires_sampling()) {
+            for (Sequence::Ptr sequence : sequence_group->get_running_sequences())
+                sequence->append_token(sequence_group->get_num_processed_tokens() % 32000, -1.0f);
+        }
+        sequence_group->finish_iteration();
+    }
+}
+
+struct SchedulingState {
+    std::unique_ptr<Scheduler> scheduler;
+    std::vector<SequenceGroup::Ptr> requests;
+
+    SchedulingState(const SchedulerConfig& scheduler_config, size_t num_groups) {
+        scheduler = std::make_unique<Scheduler>(scheduler_config);
+        std::vector<int64_t> prompt(kPromptLen);
+        std::iota(prompt.begin(), prompt.end(), 0);
+        for (size_t request_id = 0; request_id < num_groups; ++request_id) {
+            requests.push_back(std::make_shared<SequenceGroup>(request_id, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                               GenerationConfig::greedy(), scheduler_config.block_size));
+        }
+    }
+
+    // processes prompts of all sequence groups, so the next steps are generation ones
+    void prefill() {
+        auto has_prompts = [this] () {
+            return std::any_of(requests.begin(), requests.end(), [] (SequenceGroup::CPtr sequence_group) {
+                return sequence_group->get_num_processed_tokens() < sequence_group->get_prompt_len();
+            });
+        };
+        while (has_prompts()) {
+            finish_step(requests, scheduler->schedule(requests));
+        }
+    }
+};
+
+SchedulerConfig get_scheduler_config(size_t num_groups, bool dynamic_split_fuse, size_t num_kv_blocks) {
+    SchedulerConfig scheduler_config;
+    scheduler_config.max_num_batched_tokens = num_groups * kPromptLen;
+    scheduler_config.num_kv_blocks = num_kv_blocks;
+    scheduler_config.block_size = kBlockSize;
+    scheduler_config.dynamic_split_fuse = dynamic_split_fuse;
+    scheduler_config.max_num_seqs = num_groups;
+    return scheduler_config;
+}
+
+size_t get_required_num_kv_blocks(size_t num_groups) {
+    return num_groups * ((kPromptLen + kMaxNewTokens + kBlockSize - 1) / kBlockSize);
+}
+
+}  // namespace
+
+// scheduling of prompts of all waiting sequence groups at once
+static void BM_SchedulePrompts(benchmark::State& state) {
+    const size_t num_groups = state.range(0);
+    const bool dynamic_split_fuse = state.range(1);
+    SchedulerConfig scheduler_config = get_scheduler_config(num_groups, dynamic_split_fuse, get_required_num_kv_blocks(num_groups));
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        SchedulingState scheduling_state(scheduler_config, num_groups);
+        state.ResumeTiming();
+
+        Scheduler::Output scheduler_output = scheduling_state.scheduler->schedule(scheduling_state.requests);
+        benchmark::DoNotOptimize(scheduler_output);
+
+        // destruction of state is not measured
+        state.PauseTiming();
+        scheduling_state.requests.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * num_groups);
+}
+
+BENCHMARK(BM_SchedulePrompts)
+    ->ArgNames({"groups", "split_fuse"})
+    ->ArgsProduct({{256, 1024, 4096}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+// generation steps of running sequence groups; when KV cache is oversubscribed, steps also include preemption
+static void BM_ScheduleGeneration(benchmark::State& state) {
+    const size_t num_groups = state.range(0);
+    const bool dynamic_split_fuse = state.range(1);
+    // percentage of KV blocks required by all sequence groups, which is available to scheduler
+    const size_t kv_cache_percentage = state.range(2);
+    const size_t num_kv_blocks = get_required_num_kv_blocks(num_groups) * kv_cache_percentage / 100;
+    SchedulerConfig scheduler_config = get_scheduler_config(num_groups, dynamic_split_fuse, num_kv_blocks);
+
+    std::unique_ptr<SchedulingState> scheduling_state;
+    size_t num_steps = kMaxNewTokens, num_scheduled_groups = 0, num_preemptions = 0;
+    for (auto _ : state) {
+        if (num_steps == kMaxNewTokens) {
+            state.PauseTiming();
+            scheduling_state = std::make_unique<SchedulingState>(scheduler_config, num_groups);
+            scheduling_state->prefill();
+            num_steps = 0;
+            state.ResumeTiming();
+        }
+
+        Scheduler::Output scheduler_output = scheduling_state->scheduler->schedule(scheduling_state->requests);
+
+        state.PauseTiming();
+        num_scheduled_groups += scheduler_output.m_scheduled_sequence_groups_ids.size();
+        num_preemptions += scheduler_output.m_num_preemptions;
+        finish_step(scheduling_state->requests, scheduler_output);
+        ++num_steps;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(num_scheduled_groups);
+    state.counters["preemptions"] = benchmark::Counter(num_preemptions, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_ScheduleGeneration)
+    ->ArgNames({"groups", "split_fuse", "kv_cache_pct"})
+    ->ArgsProduct({{256, 1024, 4096}, {0, 1}, {100, 90}})
+    ->Unit(benchmark::kMicrosecond);
@@ -3,18 +3,31 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <list>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 #include "sequence_group.hpp"
 
+// blocks are owned by BlockAllocator's contiguous pool, so they are referred by raw pointers
+// to avoid separate heap allocations and atomic reference counting of std::shared_ptr
 class KVCacheBlock {
     int m_ref_count;
     int m_index;
+    // prefix caching: hash of block content (including all previous blocks), its independent check hash and last usage time
+    size_t m_hash = 0;
+    uint64_t m_check_hash = 0;
+    bool m_has_hash = false;
+    size_t m_timestamp = 0;
 public:
-    using Ptr = std::shared_ptr<KVCacheBlock>;
-    using CPtr = std::shared_ptr<const KVCacheBlock>;
+    using Ptr = KVCacheBlock*;
+    using CPtr = const KVCacheBlock*;
 
     explicit KVCacheBlock(int index)
         : m_ref_count(0),
@@ -43,62 +56,293 @@ public:
     int get_references_count() const {
         return m_ref_count;
     }
+
+    bool has_hash() const {
+        return m_has_hash;
+    }
+
+    size_t get_hash() const {
+        OPENVINO_ASSERT(m_has_hash, "Block ", m_index, " is not hashed");
+        return m_hash;
+    }
+
+    uint64_t get_check_hash() const {
+        OPENVINO_ASSERT(m_has_hash, "Block ", m_index, " is not hashed");
+        return m_check_hash;
+    }
+
+    void set_hash(size_t hash, uint64_t check_hash) {
+        m_hash = hash;
+        m_check_hash = check_hash;
+        m_has_hash = true;
+    }
+
+    void reset_hash() {
+        m_hash = 0;
+        m_check_hash = 0;
+        m_has_hash = false;
+    }
+
+    size_t get_timestamp() const {
+        return m_timestamp;
+    }
+
+    void set_timestamp(size_t timestamp) {
+        m_timestamp = timestamp;
+    }
 };
 
 
 class BlockAllocator {
-    std::list<KVCacheBlock::Ptr> m_free_blocks;
+    // contiguous storage of all KV blocks, which can ever be allocated; never resized after construction,
+    // so block pointers are stable, while only the first m_total_num_blocks of them are available for allocation
+    std::vector<KVCacheBlock> m_blocks;
+    // intrusive FIFO list of free blocks: freed blocks are appended to the tail, allocated from the head
+    std::vector<int32_t> m_next_free_block;
+    int32_t m_free_head = -1, m_free_tail = -1;
+    size_t m_num_free_blocks = 0;
     int m_total_num_blocks;
+
+    // prefix caching:
+    // all hashed blocks (both used and free ones), which can be shared between sequences with the same prefix
+    std::unordered_map<size_t, KVCacheBlock::Ptr> m_cached_blocks;
+    // free hashed blocks ordered by the time they were released (LRU first); evicted only when there are no other free blocks
+    std::map<size_t, KVCacheBlock::Ptr> m_evictable_blocks;
+    size_t m_time_counter = 0;
+
+    KVCacheBlock::Ptr _evict_lru_block() {
+        OPENVINO_ASSERT(!m_evictable_blocks.empty());
+        KVCacheBlock::Ptr block = m_evictable_blocks.begin()->second;
+        m_evictable_blocks.erase(m_evictable_blocks.begin());
+        m_cached_blocks.erase(block->get_hash());
+        block->reset_hash();
+        return block;
+    }
+
+    void _push_free_block(KVCacheBlock::Ptr block) {
+        int32_t block_id = block->get_index();
+        m_next_free_block[block_id] = -1;
+        if (m_free_tail < 0) {
+            m_free_head = block_id;
+        } else {
+            m_next_free_block[m_free_tail] = block_id;
+        }
+        m_free_tail = block_id;
+        ++m_num_free_blocks;
+    }
+
+    KVCacheBlock::Ptr _pop_free_block() {
+        OPENVINO_ASSERT(m_free_head >= 0);
+        int32_t block_id = m_free_head;
+        m_free_head = m_next_free_block[block_id];
+        if (m_free_head < 0) {
+            m_free_tail = -1;
+        }
+        --m_num_free_blocks;
+        return &m_blocks[block_id];
+    }
+
 public:
-    BlockAllocator(int num_blocks) :
+    // 'max_num_blocks' allows to grow a number of available blocks later via resize
+    BlockAllocator(int num_blocks, int max_num_blocks = 0) :
+        m_next_free_block(std::max(num_blocks, max_num_blocks), -1),
         m_total_num_blocks(num_blocks) {
-        for (int block_id = 0; block_id < m_total_num_blocks; ++block_id) {
-            m_free_blocks.push_back(std::make_shared<KVCacheBlock>(block_id));
+        int capacity = std::max(num_blocks, max_num_blocks);
+        m_blocks.reserve(capacity);
+        for (int block_id = 0; block_id < capacity; ++block_id) {
+            m_blocks.emplace_back(block_id);
+            if (block_id < m_total_num_blocks)
+                _push_free_block(&m_blocks.back());
         }
     }
 
+    // moving keeps the pool storage (and so block pointers) intact, while copying would not
+    BlockAllocator(const BlockAllocator&) = delete;
+    BlockAllocator& operator=(const BlockAllocator&) = delete;
+    BlockAllocator(BlockAllocator&&) = default;
+    BlockAllocator& operator=(BlockAllocator&&) = default;
+
     ~BlockAllocator() {
         // sanity check to validate that all blocks are freed
-        // OPENVINO_ASSERT(m_total_num_blocks == m_free_blocks.size());
+        // OPENVINO_ASSERT(m_total_num_blocks == num_free_blocks());
     }
 
     size_t num_free_blocks() const {
-        return m_free_blocks.size();
+        return m_num_free_blocks + m_evictable_blocks.size();
     }
 
     bool can_allocate_blocks(size_t num_blocks) const {
-        return num_blocks <= m_free_blocks.size();
+        return num_blocks <= num_free_blocks();
     }
 
     void free(KVCacheBlock::Ptr block) {
         block->release();
         if (block->is_free()) {
-            m_free_blocks.push_back(block);
+            auto cached_it = block->has_hash() ? m_cached_blocks.find(block->get_hash()) : m_cached_blocks.end();
+            if (cached_it != m_cached_blocks.end() && cached_it->second == block) {
+                // keep block content for possible reuse by next sequences with the same prefix
+                block->set_timestamp(m_time_counter++);
+                m_evictable_blocks[block->get_timestamp()] = block;
+            } else {
+                block->reset_hash();
+                _push_free_block(block);
+            }
         }
     }
 
     KVCacheBlock::Ptr allocate_block() {
         OPENVINO_ASSERT(can_allocate_blocks(1));
-        KVCacheBlock::Ptr allocated_block = m_free_blocks.front();
+        KVCacheBlock::Ptr allocated_block = nullptr;
+        if (m_num_free_blocks > 0) {
+            allocated_block = _pop_free_block();
+        } else {
+            allocated_block = _evict_lru_block();
+        }
         allocated_block->increment();
-        m_free_blocks.pop_front();
         return allocated_block;
     }
 
+    // registers block content hashes, so the block can be found by get_cached_block
+    void cache_block(KVCacheBlock::Ptr block, size_t hash, uint64_t check_hash) {
+        block->set_hash(hash, check_hash);
+        // the same content can be computed by several sequences simultaneously; keep the first one only
+        m_cached_blocks.emplace(hash, block);
+    }
+
+    // returns a cached block with specified hashes (incrementing its reference counter) or nullptr; a block with the same
+    // hash, but a different check hash has another content, which hash collides
+    KVCacheBlock::Ptr get_cached_block(size_t hash, uint64_t check_hash) {
+        auto cached_it = m_cached_blocks.find(hash);
+        if (cached_it == m_cached_blocks.end() || cached_it->second->get_check_hash() != check_hash)
+            return nullptr;
+
+        KVCacheBlock::Ptr block = cached_it->second;
+        if (block->is_free()) {
+            OPENVINO_ASSERT(m_evictable_blocks.erase(block->get_timestamp()) == 1);
+        }
+        block->increment();
+        return block;
+    }
+
     float get_used_percentage() const {
-        return static_cast<float>(m_total_num_blocks - m_free_blocks.size()) / m_total_num_blocks;
+        return static_cast<float>(m_total_num_blocks - num_free_blocks()) / m_total_num_blocks;
+    }
+
+    size_t get_total_num_blocks() const {
+        return m_total_num_blocks;
+    }
+
+    // changes a number of blocks available for allocation; the number can be reduced only when all blocks are free,
+    // and then cached content of all blocks is dropped, because memory of KV cache is reallocated
+    void resize(size_t num_blocks) {
+        OPENVINO_ASSERT(num_blocks <= m_blocks.size(), "Number of KV blocks ", num_blocks, " exceeds capacity ", m_blocks.size());
+        if (num_blocks < static_cast<size_t>(m_total_num_blocks)) {
+            OPENVINO_ASSERT(num_free_blocks() == static_cast<size_t>(m_total_num_blocks), "KV cache can be shrunk only when all blocks are free");
+            while (!m_evictable_blocks.empty())
+                _push_free_block(_evict_lru_block());
+
+            m_free_head = m_free_tail = -1;
+            m_num_free_blocks = 0;
+            for (size_t block_id = 0; block_id < num_blocks; ++block_id)
+                _push_free_block(&m_blocks[block_id]);
+        } else {
+            for (size_t block_id = m_total_num_blocks; block_id < num_blocks; ++block_id)
+                _push_free_block(&m_blocks[block_id]);
+        }
+        m_total_num_blocks = static_cast<int>(num_blocks);
     }
 };
 
 class BlockManager {
     BlockAllocator m_allocator;
+    bool m_enable_prefix_caching;
+    // host (swap space) blocks used by sequences preempted by swapping
+    BlockAllocator m_swap_allocator;
 
     // stores blocks for each sequence (not sequence group)
     // the same block can be seen in multiple block_tables for different sequences
     std::map<uint64_t, std::vector<KVCacheBlock::Ptr>> m_block_table;
+    // stores swap blocks for each swapped out sequence
+    std::map<uint64_t, std::vector<KVCacheBlock::Ptr>> m_swapped_block_table;
+    // swap blocks, which are swapped in on current scheduling step; they are released on the next one
+    // to ensure that they are not overwritten by swap out of other sequences before their content is copied
+    std::vector<KVCacheBlock::Ptr> m_swapped_in_blocks;
+
+    // counts unique blocks within a sequence group's block tables
+    static size_t _num_unique_blocks(const std::map<uint64_t, std::vector<KVCacheBlock::Ptr>>& block_tables, SequenceGroup::CPtr seq_group) {
+        std::set<KVCacheBlock::CPtr> unique_blocks;
+        for (const auto& seq : seq_group->get_running_sequences()) {
+            auto table_it = block_tables.find(seq->get_id());
+            if (table_it != block_tables.end())
+                unique_blocks.insert(table_it->second.begin(), table_it->second.end());
+        }
+        return unique_blocks.size();
+    }
+
+    // moves blocks of all running sequences from 'src_block_tables' to 'dst_block_tables' allocating them via 'dst_allocator';
+    // returns a map of src -> dst block indices, which need to be copied by CacheManager
+    static std::map<size_t, size_t> _move_block_tables(SequenceGroup::CPtr seq_group,
+                                                       std::map<uint64_t, std::vector<KVCacheBlock::Ptr>>& src_block_tables,
+                                                       std::map<uint64_t, std::vector<KVCacheBlock::Ptr>>& dst_block_tables,
+                                                       BlockAllocator& dst_allocator,
+                                                       std::vector<KVCacheBlock::Ptr>& released_src_blocks) {
+        std::map<size_t, size_t> block_copy_map;
+        // blocks shared between sequences (e.g. prompt for beam search) must stay shared after moving
+        std::map<KVCacheBlock::CPtr, KVCacheBlock::Ptr> src_to_dst;
+        for (const auto& seq : seq_group->get_running_sequences()) {
+            auto table_it = src_block_tables.find(seq->get_id());
+            if (table_it == src_block_tables.end())
+                continue;
+
+            std::vector<KVCacheBlock::Ptr>& dst_block_table = dst_block_tables[seq->get_id()];
+            OPENVINO_ASSERT(dst_block_table.empty());
+            dst_block_table.reserve(table_it->second.size());
+            for (KVCacheBlock::Ptr src_block : table_it->second) {
+                auto dst_it = src_to_dst.find(src_block);
+                KVCacheBlock::Ptr dst_block = nullptr;
+                if (dst_it == src_to_dst.end()) {
+                    dst_block = dst_allocator.allocate_block();
+                    src_to_dst[src_block] = dst_block;
+                    block_copy_map[src_block->get_index()] = dst_block->get_index();
+                } else {
+                    dst_block = dst_it->second;
+                    dst_block->increment();
+                }
+                dst_block_table.push_back(dst_block);
+                released_src_blocks.push_back(src_block);
+            }
+            src_block_tables.erase(table_it);
+        }
+        return block_copy_map;
+    }
+
 public:
-    BlockManager(int num_blocks)
-        : m_allocator(num_blocks) { }
+    // rolling hash of a block content, which depends on all previous blocks via 'prev_hash'
+    // (also keys KV cache of sessions stored on disk, see SessionKVStore)
+    static size_t compute_block_hash(size_t prev_hash, const TokenIds& token_ids, size_t block_idx, size_t block_size) {
+        size_t hash = prev_hash;
+        for (size_t i = block_idx * block_size; i < (block_idx + 1) * block_size; ++i) {
+            hash ^= std::hash<int64_t>()(token_ids[i]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+
+    // prefix caching: an independent rolling hash of the same content (splitmix64 mixing of tokens), which is compared
+    // on lookup, so KV blocks of another prefix are not reused, when 'compute_block_hash' of prefixes collide
+    static uint64_t compute_block_check_hash(uint64_t prev_hash, const TokenIds& token_ids, size_t block_idx, size_t block_size) {
+        uint64_t hash = prev_hash;
+        for (size_t i = block_idx * block_size; i < (block_idx + 1) * block_size; ++i) {
+            hash += 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>(token_ids[i]);
+            hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+            hash ^= hash >> 31;
+        }
+        return hash;
+    }
+
+    // 'max_num_blocks' allows to grow KV cache up to this number of blocks via resize
+    BlockManager(int num_blocks, bool enable_prefix_caching = false, int num_swap_blocks = 0, int max_num_blocks = 0)
+        : m_allocator(num_blocks, max_num_blocks), m_enable_prefix_caching(enable_prefix_caching), m_swap_allocator(num_swap_blocks) { }
 
     ~BlockManager() {
         // sanity check that all sequences are freed
@@ -134,6 +378,14 @@ public:
         return m_allocator.get_used_percentage();
     }
 
+    size_t get_total_num_blocks() const {
+        return m_allocator.get_total_num_blocks();
+    }
+
+    void resize(size_t num_blocks) {
+        m_allocator.resize(num_blocks);
+    }
+
     void fork_sequence(uint64_t parent_id, uint64_t child_id) {
         OPENVINO_ASSERT(m_block_table.count(child_id) == 0);
         m_block_table[child_id].reserve(m_block_table[parent_id].size());
@@ -144,10 +396,26 @@ public:
     }
 
     void free_sequence(size_t seq_id) {
+        auto swapped_it = m_swapped_block_table.find(seq_id);
+        if (swapped_it != m_swapped_block_table.end()) {
+            for (KVCacheBlock::Ptr& block : swapped_it->second) {
+                m_swap_allocator.free(block);
+            }
+            m_swapped_block_table.erase(swapped_it);
+            return;
+        }
+
         auto block_table = m_block_table[seq_id];
 
-        for (KVCacheBlock::Ptr& block : block_table) {
-            m_allocator.free(block);
+        if (m_enable_prefix_caching) {
+            // release tail blocks first, so they are evicted earlier than prefix blocks shared by longer chains
+            for (auto block_it = block_table.rbegin(); block_it != block_table.rend(); ++block_it) {
+                m_allocator.free(*block_it);
+            }
+        } else {
+            for (KVCacheBlock::Ptr& block : block_table) {
+                m_allocator.free(block);
+            }
         }
 
         OPENVINO_ASSERT(m_block_table.erase(seq_id) == 1);
@@ -162,7 +430,8 @@ public:
         for (size_t idx = 0; idx < block_num; idx++) {
             size_t block_idx = m_block_table[seq_id].size() - idx - 1;
             m_allocator.free(block_table[block_idx]);
-            OPENVINO_ASSERT(block_table[block_idx]->is_free());
+            // with prefix caching the block can be still used by other sequences
+            OPENVINO_ASSERT(m_enable_prefix_caching || block_table[block_idx]->is_free());
         } 
         m_block_table[seq_id].resize(m_block_table[seq_id].size() - block_num);
 
@@ -171,6 +440,141 @@ public:
         }
     }
 
+    // frees blocks at the end of block table, which exceed 'num_required_blocks' (e.g. after rejection of speculative candidates)
+    void free_redundant_blocks(size_t seq_id, size_t num_required_blocks) {
+        if (!has_block_table(seq_id))
+            return;
+        size_t num_blocks = m_block_table[seq_id].size();
+        if (num_blocks > num_required_blocks)
+            free_sequence_partially(seq_id, num_blocks - num_required_blocks);
+    }
+
+    // sliding window KV cache: frees 'num_blocks' blocks of each running sequence following its first 'num_sink_blocks' ones
+    void evict_blocks(SequenceGroup::CPtr seq_group, size_t num_sink_blocks, size_t num_blocks) {
+        for (const auto& seq : seq_group->get_running_sequences()) {
+            auto& block_table = m_block_table[seq->get_id()];
+            OPENVINO_ASSERT(block_table.size() >= num_sink_blocks + num_blocks);
+            const auto evicted_begin = block_table.begin() + num_sink_blocks, evicted_end = evicted_begin + num_blocks;
+            // blocks shared by beam search sequences are freed when they are evicted by all of them
+            for (auto block_it = evicted_begin; block_it != evicted_end; ++block_it)
+                m_allocator.free(*block_it);
+            block_table.erase(evicted_begin, evicted_end);
+        }
+    }
+
+    // looks up KV blocks computed by previous requests with the same prompt prefix and adds them to the block table
+    // of a not yet scheduled sequence group; returns a number of tokens, whose computation can be skipped
+    size_t restore_cached_blocks(SequenceGroup::Ptr seq_group) {
+        if (!m_enable_prefix_caching)
+            return 0;
+
+        OPENVINO_ASSERT(seq_group->num_running_seqs() == 1 && seq_group->get_num_processed_tokens() == 0);
+        uint64_t seq_id = (*seq_group)[0]->get_id();
+        if (has_block_table(seq_id))
+            return 0;
+
+        const TokenIds& prompt_ids = seq_group->get_prompt_ids();
+        const size_t block_size = seq_group->get_block_size();
+        // prompt tokens, whose logits are used (the last one for generation or scored ones for scoring), must be computed
+        const size_t max_num_cached_blocks = prompt_ids.empty() ? 0 : seq_group->get_first_sampled_prompt_position() / block_size;
+
+        // KV cache depends on LoRA adapter, so prefixes are not shared between requests of different adapters
+        size_t hash = seq_group->get_sampling_parameters().lora_adapter_id, num_restored_blocks = 0;
+        uint64_t check_hash = hash;
+        for (; num_restored_blocks < max_num_cached_blocks; ++num_restored_blocks) {
+            hash = compute_block_hash(hash, prompt_ids, num_restored_blocks, block_size);
+            check_hash = compute_block_check_hash(check_hash, prompt_ids, num_restored_blocks, block_size);
+            KVCacheBlock::Ptr block = m_allocator.get_cached_block(hash, check_hash);
+            if (!block)
+                break;
+            m_block_table[seq_id].push_back(block);
+        }
+
+        size_t num_restored_tokens = num_restored_blocks * block_size;
+        if (num_restored_tokens > 0)
+            seq_group->update_processed_tokens_num(num_restored_tokens);
+        return num_restored_tokens;
+    }
+
+    // registers hashes of fully computed prompt blocks, so they can be reused by next requests
+    void update_cached_blocks(SequenceGroup::CPtr seq_group) {
+        if (!m_enable_prefix_caching || seq_group->has_finished())
+            return;
+
+        std::vector<Sequence::CPtr> running_sequences = seq_group->get_running_sequences();
+        if (running_sequences.empty())
+            return;
+        // prompt blocks are shared between all sequences within a group, so any sequence can be used
+        uint64_t seq_id = running_sequences[0]->get_id();
+        if (!has_block_table(seq_id))
+            return;
+
+        const TokenIds& prompt_ids = seq_group->get_prompt_ids();
+        const size_t block_size = seq_group->get_block_size();
+        const std::vector<KVCacheBlock::Ptr>& block_table = m_block_table[seq_id];
+        size_t num_computed_blocks = std::min(seq_group->get_num_processed_tokens(), prompt_ids.size()) / block_size;
+        num_computed_blocks = std::min(num_computed_blocks, block_table.size());
+
+        // find the first computed block without hash; typically all previous ones are already processed
+        size_t first_block_idx = num_computed_blocks;
+        while (first_block_idx > 0 && !block_table[first_block_idx - 1]->has_hash())
+            --first_block_idx;
+
+        size_t hash = first_block_idx > 0 ? block_table[first_block_idx - 1]->get_hash() : seq_group->get_sampling_parameters().lora_adapter_id;
+        uint64_t check_hash = first_block_idx > 0 ? block_table[first_block_idx - 1]->get_check_hash() : hash;
+        for (size_t block_idx = first_block_idx; block_idx < num_computed_blocks; ++block_idx) {
+            hash = compute_block_hash(hash, prompt_ids, block_idx, block_size);
+            check_hash = compute_block_check_hash(check_hash, prompt_ids, block_idx, block_size);
+            m_allocator.cache_block(block_table[block_idx], hash, check_hash);
+        }
+    }
+
+    bool is_swapped(SequenceGroup::CPtr seq_group) const {
+        for (const auto& seq : seq_group->get_running_sequences()) {
+            if (m_swapped_block_table.count(seq->get_id()) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool can_swap_out(SequenceGroup::CPtr seq_group) const {
+        return _num_unique_blocks(m_block_table, seq_group) <= m_swap_allocator.num_free_blocks();
+    }
+
+    size_t required_swap_in_blocks_count(SequenceGroup::CPtr seq_group) const {
+        return _num_unique_blocks(m_swapped_block_table, seq_group);
+    }
+
+    bool can_swap_in(SequenceGroup::CPtr seq_group) const {
+        return _num_unique_blocks(m_swapped_block_table, seq_group) <= m_allocator.num_free_blocks();
+    }
+
+    // moves KV blocks of all running sequences to swap space; returns a map of device -> swap block copies
+    std::map<size_t, size_t> swap_out(SequenceGroup::CPtr seq_group) {
+        OPENVINO_ASSERT(can_swap_out(seq_group));
+        std::vector<KVCacheBlock::Ptr> released_blocks;
+        std::map<size_t, size_t> block_copy_map = _move_block_tables(seq_group, m_block_table, m_swapped_block_table, m_swap_allocator, released_blocks);
+        // device blocks can be reused right away, because swap out copies are performed before inference
+        for (KVCacheBlock::Ptr block : released_blocks) {
+            m_allocator.free(block);
+        }
+        return block_copy_map;
+    }
+
+    // moves KV blocks of all running sequences back from swap space; returns a map of swap -> device block copies
+    std::map<size_t, size_t> swap_in(SequenceGroup::CPtr seq_group) {
+        OPENVINO_ASSERT(can_swap_in(seq_group));
+        return _move_block_tables(seq_group, m_swapped_block_table, m_block_table, m_allocator, m_swapped_in_blocks);
+    }
+
+    // releases swap blocks, which content has already been copied back to device on previous step
+    void free_swapped_in_blocks() {
+        for (KVCacheBlock::Ptr block : m_swapped_in_blocks) {
+            m_swap_allocator.free(block);
+        }
+        m_swapped_in_blocks.clear();
+    }
+
     bool can_append_slots(SequenceGroup::CPtr seq_group) {
         return required_blocks_count(seq_group) <= m_allocator.num_free_blocks();
     }
@@ -2,36 +2,208 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <list>
+#include <map>
+#include <utility>
 
+#include "openvino/core/parallel.hpp"
+#include "openvino/runtime/remote_tensor.hpp"
 #include "openvino/runtime/tensor.hpp"
 
 #include "device_config.hpp"
+#include "kv_cache_blob.hpp"
 
 class CacheManager {
     DeviceConfig m_device_config;
     std::vector<ov::Tensor> m_key_cache;
     std::vector<ov::Tensor> m_value_cache;
+    // host copies of KV cache for swapped out sequences
+    std::vector<ov::Tensor> m_key_swap_cache;
+    std::vector<ov::Tensor> m_value_swap_cache;
+    // host memory reserved for all KV blocks, while KV caches are views of its first allocated blocks,
+    // so memory pages are committed by OS only when blocks are allocated
+    std::vector<ov::Tensor> m_key_storage;
+    std::vector<ov::Tensor> m_value_storage;
+    size_t m_num_allocated_blocks = 0;
+
+    // copies 'num_blocks' consecutive blocks between caches with the same block shape; caches can be located in device or host memory
+    static void _copy_block(const ov::Tensor& src_cache, size_t src_block_id, const ov::Tensor& dst_cache, size_t dst_block_id, size_t num_blocks = 1) {
+        ov::Shape src_shape = src_cache.get_shape(), dst_shape = dst_cache.get_shape();
+        ov::Coordinate src_start_roi(src_shape.size(), 0), src_end_roi = src_shape;
+        ov::Coordinate dst_start_roi(dst_shape.size(), 0), dst_end_roi = dst_shape;
+        src_end_roi[0] = (src_start_roi[0] = src_block_id) + num_blocks;
+        dst_end_roi[0] = (dst_start_roi[0] = dst_block_id) + num_blocks;
+
+        if (src_cache.is<ov::RemoteTensor>()) {
+            ov::RemoteTensor src_cache_roi(src_cache.as<ov::RemoteTensor>(), src_start_roi, src_end_roi);
+            ov::Tensor dst_cache_roi = dst_cache.is<ov::RemoteTensor>() ?
+                ov::RemoteTensor(dst_cache.as<ov::RemoteTensor>(), dst_start_roi, dst_end_roi) :
+                ov::Tensor(dst_cache, dst_start_roi, dst_end_roi);
+            // device side copy, if both caches are in device memory
+            src_cache_roi.copy_to(dst_cache_roi);
+        } else if (dst_cache.is<ov::RemoteTensor>()) {
+            ov::RemoteTensor dst_cache_roi(dst_cache.as<ov::RemoteTensor>(), dst_start_roi, dst_end_roi);
+            dst_cache_roi.copy_from(ov::Tensor(src_cache, src_start_roi, src_end_roi));
+        } else {
+            ov::Tensor src_cache_roi(src_cache, src_start_roi, src_end_roi);
+            ov::Tensor dst_cache_roi(dst_cache, dst_start_roi, dst_end_roi);
+            src_cache_roi.copy_to(dst_cache_roi);
+        }
+    }
+
+    // copies blocks between caches with the same block shape; blocks of host caches are contiguous in memory, so they are
+    // copied directly with all layers processed in parallel, while blocks of device caches are copied by plugin
+    void _copy_blocks_between(const std::vector<ov::Tensor>& src_cache, const std::vector<ov::Tensor>& dst_cache,
+                              const std::vector<std::pair<size_t, size_t>>& block_copies) {
+        if (block_copies.empty())
+            return;
+
+        const size_t num_decoder_layers = m_device_config.get_num_layers();
+        if (src_cache[0].is<ov::RemoteTensor>() || dst_cache[0].is<ov::RemoteTensor>()) {
+            for (const auto& block_copy : block_copies) {
+                for (size_t decoder_layer_id = 0; decoder_layer_id < num_decoder_layers; ++decoder_layer_id)
+                    _copy_block(src_cache[decoder_layer_id], block_copy.first, dst_cache[decoder_layer_id], block_copy.second);
+            }
+            return;
+        }
+
+        ov::parallel_for(num_decoder_layers, [&] (size_t decoder_layer_id) {
+            const ov::Tensor& src_layer_cache = src_cache[decoder_layer_id], & dst_layer_cache = dst_cache[decoder_layer_id];
+            const size_t block_byte_size = src_layer_cache.get_byte_size() / src_layer_cache.get_shape()[0];
+            OPENVINO_ASSERT(block_byte_size == dst_layer_cache.get_byte_size() / dst_layer_cache.get_shape()[0]);
+
+            const uint8_t* src_data = static_cast<const uint8_t*>(src_layer_cache.data());
+            uint8_t* dst_data = static_cast<uint8_t*>(dst_layer_cache.data());
+            for (const auto& block_copy : block_copies)
+                std::memcpy(dst_data + block_copy.second * block_byte_size, src_data + block_copy.first * block_byte_size, block_byte_size);
+        });
+    }
+
+    static size_t _get_block_byte_size(const std::vector<ov::Tensor>& cache) {
+        OPENVINO_ASSERT(!cache.empty());
+        return cache[0].get_byte_size() / cache[0].get_shape()[0];
+    }
+
+    // copies a block of a layer cache from / to contiguous host memory of blob's block
+    static void _copy_block_to_host(const ov::Tensor& cache, size_t block_id, uint8_t* dst, size_t block_byte_size) {
+        if (cache.is<ov::RemoteTensor>()) {
+            ov::Shape block_shape = cache.get_shape();
+            block_shape[0] = 1;
+            _copy_block(cache, block_id, ov::Tensor(cache.get_element_type(), block_shape, dst), 0);
+        } else {
+            std::memcpy(dst, static_cast<const uint8_t*>(cache.data()) + block_id * block_byte_size, block_byte_size);
+        }
+    }
+
+    static void _copy_block_from_host(const uint8_t* src, const ov::Tensor& cache, size_t block_id, size_t block_byte_size) {
+        if (cache.is<ov::RemoteTensor>()) {
+            ov::Shape block_shape = cache.get_shape();
+            block_shape[0] = 1;
+            _copy_block(ov::Tensor(cache.get_element_type(), block_shape, const_cast<uint8_t*>(src)), 0, cache, block_id);
+        } else {
+            std::memcpy(static_cast<uint8_t*>(cache.data()) + block_id * block_byte_size, src, block_byte_size);
+        }
+    }
+
+    // host caches of layers are processed in parallel, while copies of device caches are serialized by plugin
+    template <typename F>
+    void _for_each_layer(const F& func) const {
+        if (m_key_cache[0].is<ov::RemoteTensor>()) {
+            for (size_t decoder_layer_id = 0; decoder_layer_id < get_num_layers(); ++decoder_layer_id)
+                func(decoder_layer_id);
+        } else {
+            ov::parallel_for(get_num_layers(), func);
+        }
+    }
+
+    static std::vector<std::pair<size_t, size_t>> _get_block_copies(const std::map<size_t, size_t>& block_copy_map) {
+        return std::vector<std::pair<size_t, size_t>>(block_copy_map.begin(), block_copy_map.end());
+    }
+
+    // allocates KV caches of 'num_cache_blocks' and keeps the whole cache content, when cache grows on device
+    void _allocate_cache(std::vector<ov::Tensor>& cache, std::vector<ov::Tensor>& storage, ov::Shape shape, size_t num_cache_blocks) {
+        const size_t num_decoder_layers = m_device_config.get_num_layers();
+        const bool grows = num_cache_blocks > m_num_allocated_blocks;
+        cache.resize(num_decoder_layers);
+        storage.resize(m_device_config.has_remote_context() ? 0 : num_decoder_layers);
+        for (size_t decoder_layer_id = 0; decoder_layer_id < num_decoder_layers; ++decoder_layer_id) {
+            if (m_device_config.has_remote_context()) {
+                // device memory is allocated by plugin, so it does not need to be touched
+                shape[0] = num_cache_blocks;
+                ov::Tensor new_cache = m_device_config.get_remote_context(decoder_layer_id).create_tensor(m_device_config.get_cache_precision(), shape);
+                if (grows && m_num_allocated_blocks > 0)
+                    _copy_block(cache[decoder_layer_id], 0, new_cache, 0, m_num_allocated_blocks);
+                cache[decoder_layer_id] = new_cache;
+                continue;
+            }
+
+            if (!grows || !storage[decoder_layer_id]) {
+                // shrunk cache is reserved again to return memory of all blocks to OS
+                storage[decoder_layer_id] = ov::Tensor(m_device_config.get_cache_precision(), shape);
+            }
+            if (num_cache_blocks == shape[0]) {
+                cache[decoder_layer_id] = storage[decoder_layer_id];
+            } else {
+                ov::Coordinate start_roi(shape.size(), 0), end_roi = shape;
+                end_roi[0] = num_cache_blocks;
+                cache[decoder_layer_id] = ov::Tensor(storage[decoder_layer_id], start_roi, end_roi);
+            }
+
+            // force allocation of new blocks
+            const size_t block_byte_size = storage[decoder_layer_id].get_byte_size() / shape[0];
+            const size_t first_new_block = grows ? m_num_allocated_blocks : 0;
+            std::memset(static_cast<uint8_t*>(cache[decoder_layer_id].data()) + first_new_block * block_byte_size, 0,
+                        (num_cache_blocks - first_new_block) * block_byte_size);
+        }
+    }
 
 public:
-    explicit CacheManager(const DeviceConfig& device_config) :
+    // allocates 'num_allocated_blocks' out of device_config.get_num_kv_blocks() KV blocks (0 means all of them),
+    // while remaining ones can be allocated later by resize
+    explicit CacheManager(const DeviceConfig& device_config, size_t num_allocated_blocks = 0) :
         m_device_config(device_config) {
-        m_key_cache.reserve(m_device_config.get_num_layers());
-        m_value_cache.reserve(m_device_config.get_num_layers());
+        resize(num_allocated_blocks > 0 ? num_allocated_blocks : m_device_config.get_num_kv_blocks());
+
+        // Allocate swap space
+        if (m_device_config.get_num_swap_blocks() > 0) {
+            ov::Shape key_swap_shape = device_config.get_key_cache_shape(), value_swap_shape = device_config.get_value_cache_shape();
+            key_swap_shape[0] = value_swap_shape[0] = m_device_config.get_num_swap_blocks();
+            for (size_t decoder_layer_id = 0; decoder_layer_id < m_device_config.get_num_layers(); ++decoder_layer_id) {
+                if (device_config.has_remote_context()) {
+                    // USM host memory makes transfers between device and swap space faster
+                    ov::RemoteContext remote_context = device_config.get_remote_context(decoder_layer_id);
+                    m_key_swap_cache.emplace_back(remote_context.create_host_tensor(device_config.get_cache_precision(), key_swap_shape));
+                    m_value_swap_cache.emplace_back(remote_context.create_host_tensor(device_config.get_cache_precision(), value_swap_shape));
+                } else {
+                    m_key_swap_cache.emplace_back(device_config.get_cache_precision(), key_swap_shape);
+                    m_value_swap_cache.emplace_back(device_config.get_cache_precision(), value_swap_shape);
+                }
+            }
+        }
+    }
 
-        // Allocate KV caches
-        for (size_t decoder_layer_id = 0; decoder_layer_id < m_device_config.get_num_layers(); ++decoder_layer_id) {
-            ov::Tensor key_cache(device_config.get_cache_precision(), device_config.get_key_cache_shape());
-            ov::Tensor value_cache(device_config.get_cache_precision(), device_config.get_value_cache_shape());
+    // changes a number of allocated KV blocks keeping content of blocks, if the number grows; a number of blocks can be
+    // reduced only when all of them are free; KV caches must be set to infer requests again after this call
+    void resize(size_t num_blocks) {
+        OPENVINO_ASSERT(num_blocks > 0 && num_blocks <= m_device_config.get_num_kv_blocks(),
+            "Number of allocated KV blocks ", num_blocks, " must be in range [1, ", m_device_config.get_num_kv_blocks(), "]");
+        if (num_blocks == m_num_allocated_blocks)
+            return;
 
-            // force allocation
-            std::memset(key_cache.data(), 0, key_cache.get_byte_size());
-            std::memset(value_cache.data(), 0, value_cache.get_byte_size());
+        _allocate_cache(m_key_cache, m_key_storage, m_device_config.get_key_cache_shape(), num_blocks);
+        _allocate_cache(m_value_cache, m_value_storage, m_device_config.get_value_cache_shape(), num_blocks);
+        m_num_allocated_blocks = num_blocks;
+    }
 
-            m_key_cache.emplace_back(key_cache);
-            m_value_cache.emplace_back(value_cache);
-        }
+    size_t get_num_allocated_blocks() const {
+        return m_num_allocated_blocks;
+    }
+
+    size_t get_num_layers() const {
+        return m_device_config.get_num_layers();
     }
 
     ov::Tensor get_key_cache(size_t decoder_layer_id) const {
@@ -44,41 +216,78 @@ public:
         return m_value_cache[decoder_layer_id];
     }
 
-    void copy_blocks(const std::map<size_t, std::list<size_t>>& block_copy_map) {
-        ov::Shape key_shape = m_device_config.get_key_cache_shape();
-        ov::Shape value_shape = m_device_config.get_value_cache_shape();
-
-        ov::Coordinate key_src_start_roi(key_shape.size(), 0);
-        ov::Coordinate key_src_end_roi = key_shape;
-        ov::Coordinate key_dst_start_roi(key_shape.size(), 0);
-        ov::Coordinate key_dst_end_roi = key_shape;
-        
-        ov::Coordinate value_src_start_roi(value_shape.size(), 0);
-        ov::Coordinate value_src_end_roi = value_shape;
-        ov::Coordinate value_dst_start_roi(value_shape.size(), 0);
-        ov::Coordinate value_dst_end_roi = value_shape;
+    void swap_out(const std::map<size_t, size_t>& block_copy_map) {
+        OPENVINO_ASSERT(block_copy_map.empty() || !m_key_swap_cache.empty(), "Swap space is not allocated");
+        std::vector<std::pair<size_t, size_t>> block_copies = _get_block_copies(block_copy_map);
+        _copy_blocks_between(m_key_cache, m_key_swap_cache, block_copies);
+        _copy_blocks_between(m_value_cache, m_value_swap_cache, block_copies);
+    }
 
-        for (const auto & blocks_pair : block_copy_map) {
-            size_t src_block_id = blocks_pair.first;
-            key_src_end_roi[0] = (key_src_start_roi[0] = src_block_id) + 1;
-            value_src_end_roi[0] = (value_src_start_roi[0] = src_block_id) + 1;
+    void swap_in(const std::map<size_t, size_t>& block_copy_map) {
+        OPENVINO_ASSERT(block_copy_map.empty() || !m_key_swap_cache.empty(), "Swap space is not allocated");
+        std::vector<std::pair<size_t, size_t>> block_copies = _get_block_copies(block_copy_map);
+        _copy_blocks_between(m_key_swap_cache, m_key_cache, block_copies);
+        _copy_blocks_between(m_value_swap_cache, m_value_cache, block_copies);
+    }
 
-            const std::list<size_t>& dst_block_ids = blocks_pair.second;
-            for (size_t dst_block_id : dst_block_ids) {
-                key_dst_end_roi[0] = (key_dst_start_roi[0] = dst_block_id) + 1;
-                value_dst_end_roi[0] = (value_dst_start_roi[0] = dst_block_id) + 1;
+    // byte sizes of keys and values of a single decoder layer within a block
+    size_t get_key_block_byte_size() const {
+        return _get_block_byte_size(m_key_cache);
+    }
 
-                for (size_t decoder_layer_id = 0; decoder_layer_id < m_device_config.get_num_layers(); ++decoder_layer_id) {
-                    ov::Tensor key_src_cache_roi(m_key_cache[decoder_layer_id], key_src_start_roi, key_src_end_roi);
-                    ov::Tensor key_dst_cache_roi(m_key_cache[decoder_layer_id], key_dst_start_roi, key_dst_end_roi);
+    size_t get_value_block_byte_size() const {
+        return _get_block_byte_size(m_value_cache);
+    }
 
-                    ov::Tensor value_src_cache_roi(m_value_cache[decoder_layer_id], value_src_start_roi, value_src_end_roi);
-                    ov::Tensor value_dst_cache_roi(m_value_cache[decoder_layer_id], value_dst_start_roi, value_dst_end_roi);
+    // serializes KV cache of the first 'num_kv_tokens' of 'prompt_ids', which is stored in 'block_ids' (the rest
+    // of block table is not exported); each layer writes own parts of blob's blocks, so layers are copied independently
+    KVCacheBlob::Ptr export_blocks(const std::vector<size_t>& block_ids, const std::vector<int64_t>& prompt_ids, size_t num_kv_tokens, size_t block_size) const {
+        const size_t key_block_byte_size = get_key_block_byte_size(), value_block_byte_size = get_value_block_byte_size();
+        auto blob = std::make_shared<KVCacheBlob>(prompt_ids, num_kv_tokens, m_device_config.get_cache_precision().to_string(), block_size,
+                                                  get_num_layers(), key_block_byte_size, value_block_byte_size);
+        OPENVINO_ASSERT(blob->get_num_blocks() <= block_ids.size(), "Block table doesn't contain all exported tokens");
+        const size_t layer_byte_size = key_block_byte_size + value_block_byte_size;
+        _for_each_layer([&] (size_t decoder_layer_id) {
+            for (size_t block_idx = 0; block_idx < blob->get_num_blocks(); ++block_idx) {
+                uint8_t* layer_data = blob->get_block_data(block_idx) + decoder_layer_id * layer_byte_size;
+                _copy_block_to_host(m_key_cache[decoder_layer_id], block_ids[block_idx], layer_data, key_block_byte_size);
+                _copy_block_to_host(m_value_cache[decoder_layer_id], block_ids[block_idx], layer_data + key_block_byte_size, value_block_byte_size);
+            }
+        });
+        return blob;
+    }
 
-                    key_src_cache_roi.copy_to(key_dst_cache_roi);
-                    value_src_cache_roi.copy_to(value_dst_cache_roi);
-                }
+    // fills 'block_ids' with KV cache of blob's blocks starting from 'first_block_idx'; blob must be compatible with this cache
+    // (see is_compatible)
+    void import_blocks(const KVCacheBlob& blob, const std::vector<size_t>& block_ids, size_t first_block_idx = 0) {
+        OPENVINO_ASSERT(is_compatible(blob) && first_block_idx + block_ids.size() <= blob.get_num_blocks());
+        const size_t key_block_byte_size = get_key_block_byte_size(), value_block_byte_size = get_value_block_byte_size();
+        const size_t layer_byte_size = key_block_byte_size + value_block_byte_size;
+        _for_each_layer([&] (size_t decoder_layer_id) {
+            for (size_t block_idx = 0; block_idx < block_ids.size(); ++block_idx) {
+                const uint8_t* layer_data = blob.get_block_data(first_block_idx + block_idx) + decoder_layer_id * layer_byte_size;
+                _copy_block_from_host(layer_data, m_key_cache[decoder_layer_id], block_ids[block_idx], key_block_byte_size);
+                _copy_block_from_host(layer_data + key_block_byte_size, m_value_cache[decoder_layer_id], block_ids[block_idx], value_block_byte_size);
             }
+        });
+    }
+
+    // whether blob is exported by a pipeline with the same model and KV cache layout (block size is checked by caller)
+    bool is_compatible(const KVCacheBlob& blob) const {
+        const KVCacheBlob::Header& header = blob.get_header();
+        return header.precision == m_device_config.get_cache_precision().to_string() && header.num_layers == get_num_layers() &&
+            header.key_block_byte_size == get_key_block_byte_size() && header.value_block_byte_size == get_value_block_byte_size();
+    }
+
+    // performs copy-on-write of forked blocks; all copies of a step are coalesced into a single pass over layers
+    void copy_blocks(const std::map<size_t, std::list<size_t>>& block_copy_map) {
+        std::vector<std::pair<size_t, size_t>> block_copies;
+        for (const auto & blocks_pair : block_copy_map) {
+            for (size_t dst_block_id : blocks_pair.second)
+                block_copies.emplace_back(blocks_pair.first, dst_block_id);
         }
+
+        _copy_blocks_between(m_key_cache, m_key_cache, block_copies);
+        _copy_blocks_between(m_value_cache, m_value_cache, block_copies);
     }
 };
@@ -1,91 +1,331 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <mutex>
+#include <exception>
+#include <future>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <thread>
+#include <unordered_map>
 
 #include "continuous_batching_pipeline.hpp"
 #include "cache_manager.hpp"
+#include "lora_adapter_pool.hpp"
+#include "lock_free_queue.hpp"
 #include "sampler.hpp"
 #include "model_runner.hpp"
+#include "numa_utils.hpp"
 #include "scheduler.hpp"
+#include "session_kv_store.hpp"
+#include "telemetry.hpp"
 #include "timer.hpp"
+#include "token_constraint.hpp"
 #include "tokenizer.hpp"
 
 #include "debug_utils.hpp"
 
 void apply_paged_attention_transformations(std::shared_ptr<ov::Model> model, DeviceConfig& device_config);
+std::vector<LoRALayer> apply_lora_transformations(std::shared_ptr<ov::Model> model, size_t num_channels);
 
 class ContinuousBatchingPipeline::Impl {
+    // compiled model and configuration of its KV cache, which are shared by replicas of the pipeline
+    std::shared_ptr<ov::Core> m_core;
+    ov::CompiledModel m_compiled_model;
+    std::shared_ptr<DeviceConfig> m_device_config;
+
     std::shared_ptr<Tokenizer> m_tokenizer;
     std::shared_ptr<Scheduler> m_scheduler;
     std::shared_ptr<CacheManager> m_cache_manager;
     std::shared_ptr<ModelRunner> m_model_runner;
     std::shared_ptr<Sampler> m_sampler;
+    // weights of LoRA adapters applied by main model; draft model proposes candidates using base weights
+    std::shared_ptr<LoRAAdapterPool> m_lora_adapter_pool;
+
+    // constrained generation and stop strings: texts of model vocabulary tokens are decoded on the first request using them,
+    // and compiled constraints are cached by pattern, since requests typically share few schemas
+    size_t m_vocab_size = 0;
+    TokenVocabulary::Ptr m_token_vocabulary;
+    // the most recently used constraints are at the front
+    std::list<std::pair<std::string, TokenConstraint::Ptr>> m_token_constraints;
+    std::unordered_map<std::string, std::list<std::pair<std::string, TokenConstraint::Ptr>>::iterator> m_pattern_2_token_constraint;
+    std::mutex m_token_constraints_mutex;
+
+    // draft model for speculative decoding; it has own KV cache, but shares block tables with main model
+    std::shared_ptr<CacheManager> m_draft_cache_manager;
+    std::shared_ptr<ModelRunner> m_draft_model_runner;
+
+    // KV cache of finished requests stored on disk; shared by replicas storing sessions to the same directory
+    std::shared_ptr<SessionKVStore> m_session_kv_store;
 
     // TODO (mzegla): GenerationConfig is request specific object
-    // and pipeline only uses default rng_seed. 
     GenerationConfig m_generation_config;
 
-    PipelineMetrics m_pipeline_metrics;
+    PipelineTelemetry m_telemetry;
+    // op-level profiling is collected only if model is compiled with ov::enable_profiling, because it slows down inference
+    bool m_enable_profiling = false;
+
+    // current requests to process
+    std::vector<SequenceGroup::Ptr> m_requests;
+    // requests added to the pipeline that will be added to m_requests in the next iteration;
+    // lock-free queue, so add_request can be called from many threads without contention with step
+    MPSCQueue<SequenceGroup::Ptr> m_awaiting_requests;
+    // notified on new awaiting requests and serving stop
+    QueueWaiter m_awaiting_requests_waiter;
 
-    struct PerfTime {
-        float m_paged_attention_time_ms = 0.0f;
-        float m_matmul_time_ms = 0.0f;
-        float m_infer_total_ms = 0.0f;
+    // serving mode state
+    std::thread m_serving_thread;
+    std::atomic<bool> m_stop_serving{false};
+    std::atomic<bool> m_serving_failed{false};
+    // written by serving thread, read after it's joined
+    std::exception_ptr m_serving_error;
 
-        ~PerfTime() {
-            std::cout << "Inference requests aggregated statistic: " << std::endl;
-            std::cout << "Paged attention % of inference execution: " << (m_paged_attention_time_ms / m_infer_total_ms) * 100 << std::endl;
-            std::cout << "MatMul % of inference execution: " << (m_matmul_time_ms / m_infer_total_ms) * 100 << std::endl;
-            std::cout << "Total inference execution secs: " << m_infer_total_ms / 1000. << std::endl;
-            std::cout << std::endl;
+    // NUMA worker mode: CPUs of the node, which serving thread is pinned to; empty means no pinning
+    std::vector<int> m_cpus;
+    // added, but not yet released requests; used by dispatcher to balance load between workers
+    std::atomic<size_t> m_num_unfinished_requests{0};
+
+    // must be called under m_token_constraints_mutex
+    TokenVocabulary::Ptr _get_token_vocabulary() {
+        if (!m_token_vocabulary) {
+            OPENVINO_ASSERT(m_vocab_size > 0, "Constrained generation and stop strings require a model with static vocabulary size");
+            std::vector<int64_t> token_ids(m_vocab_size);
+            std::iota(token_ids.begin(), token_ids.end(), 0);
+            m_token_vocabulary = std::make_shared<TokenVocabulary>(m_tokenizer->decode_tokens(token_ids));
         }
-    } m_perf;
+        return m_token_vocabulary;
+    }
 
-    // current requests to process
-    std::vector<SequenceGroup::Ptr> m_requests;
-    // requests added to the pipeline that will be added to m_requests in the next iteration
-    std::vector<SequenceGroup::Ptr> m_awaiting_requests;
-    // Mutex protecting access to m_awaiting_requests, so add_request and step methods can be called from different threads
-    std::mutex m_awaiting_requests_mutex;
+    TokenConstraint::Ptr _get_token_constraint(const std::string& pattern) {
+        std::lock_guard<std::mutex> lock(m_token_constraints_mutex);
+        auto constraint_it = m_pattern_2_token_constraint.find(pattern);
+        if (constraint_it != m_pattern_2_token_constraint.end()) {
+            m_token_constraints.splice(m_token_constraints.begin(), m_token_constraints, constraint_it->second);
+            return constraint_it->second->second;
+        }
+
+        TokenConstraint::Ptr token_constraint = std::make_shared<TokenConstraint>(pattern, _get_token_vocabulary());
+        const size_t capacity = m_scheduler->get_config().token_constraint_cache_size;
+        if (capacity == 0)
+            return token_constraint;
+        m_token_constraints.emplace_front(pattern, token_constraint);
+        m_pattern_2_token_constraint[pattern] = m_token_constraints.begin();
+        if (m_token_constraints.size() > capacity) {
+            m_pattern_2_token_constraint.erase(m_token_constraints.back().first);
+            m_token_constraints.pop_back();
+        }
+        return token_constraint;
+    }
+
+    void _pull_awaiting_requests() {
+        SequenceGroup::Ptr request;
+        while (m_awaiting_requests.try_pull(request)) {
+            if (m_session_kv_store && !request->has_imported_kv_cache() && request->get_sampling_parameters().lora_adapter_id == 0)
+                request->set_imported_kv_cache(_find_session_kv_cache(request));
+            m_requests.push_back(std::move(request));
+        }
+    }
+
+    // pipeline parallel execution: HETERO plugin splits decoder layers between devices by their memory and streams
+    // activations between them; operations are assigned to devices explicitly, so KV cache of each layer is allocated on the
+    // device of its PagedAttention (KV caches are inputs 2 + 2 * layer and 3 + 2 * layer, see _set_kv_caches)
+    static ov::AnyMap _assign_pipeline_stages(ov::Core& core, std::shared_ptr<ov::Model> model, DeviceConfig& device_config,
+                                              const ov::AnyMap& plugin_config) {
+        ov::AnyMap compile_config = plugin_config;
+        compile_config.emplace(ov::hint::model_distribution_policy.name(),
+                               std::set<ov::hint::ModelDistributionPolicy>{ov::hint::ModelDistributionPolicy::PIPELINE_PARALLEL});
+        const ov::SupportedOpsMap devices = core.query_model(model, device_config.get_device(), compile_config);
+        for (const std::shared_ptr<ov::Node>& op : model->get_ops()) {
+            auto device_it = devices.find(op->get_friendly_name());
+            OPENVINO_ASSERT(device_it != devices.end(), op->get_friendly_name(), " is not supported by ", device_config.get_device());
+            op->get_rt_info()["affinity"] = device_it->second;
+        }
+
+        device_config.set_layer_devices(DeviceConfig::get_layer_devices(model, devices, device_config.get_num_layers()));
+        return compile_config;
+    }
+
+    static std::shared_ptr<SessionKVStore> _get_session_kv_store(const SchedulerConfig& scheduler_config,
+                                                                 std::shared_ptr<SessionKVStore> other_store = nullptr) {
+        if (scheduler_config.session_cache_dir.empty())
+            return nullptr;
+        OPENVINO_ASSERT(scheduler_config.dynamic_split_fuse, "Session cache is supported only with dynamic_split_fuse scheduling");
+        if (other_store && other_store->get_dir() == scheduler_config.session_cache_dir && other_store->get_block_size() == scheduler_config.block_size)
+            return other_store;
+        return std::make_shared<SessionKVStore>(scheduler_config.session_cache_dir, scheduler_config.block_size,
+                                                scheduler_config.session_cache_size * 1024 * 1024 * 1024);
+    }
+
+    // a stored session sharing prompt prefix, which is imported on scheduling (the rest of prompt is computed)
+    KVCacheBlob::Ptr _find_session_kv_cache(SequenceGroup::CPtr sequence_group) const {
+        const size_t max_num_blocks = sequence_group->get_first_sampled_prompt_position() / m_scheduler->get_config().block_size;
+        KVCacheBlob::Ptr kv_cache = m_session_kv_store->find(sequence_group->get_prompt_ids(), max_num_blocks);
+        return kv_cache && m_cache_manager->is_compatible(*kv_cache) ? kv_cache : nullptr;
+    }
+
+    // KV cache of finished requests is stored before their blocks are freed: full blocks of prompt and generated tokens,
+    // which have KV cache (i.e. all tokens except the last generated one)
+    void _store_finished_sessions(const std::vector<uint64_t>& scheduled_ids) {
+        if (!m_session_kv_store)
+            return;
+        const size_t block_size = m_scheduler->get_config().block_size;
+        for (uint64_t sequence_group_id : scheduled_ids) {
+            SequenceGroup::CPtr sequence_group = m_requests[sequence_group_id];
+            if (!sequence_group->has_finished() || sequence_group->get_sequences().size() != 1 || sequence_group->is_scoring() ||
+                sequence_group->is_exporting_kv_cache() || sequence_group->get_num_evicted_tokens() > 0 ||
+                sequence_group->get_sampling_parameters().lora_adapter_id != 0)
+                continue;
+            Sequence::CPtr sequence = (*sequence_group)[0];
+            if (!sequence->has_finished() || !m_scheduler->has_block_table(sequence->get_id()))
+                continue;
+
+            TokenIds token_ids = sequence_group->get_prompt_ids();
+            token_ids.insert(token_ids.end(), sequence->get_generated_ids().begin(), sequence->get_generated_ids().end());
+            const std::vector<KVCacheBlock::Ptr>& block_table = m_scheduler->get_block_table(*sequence);
+            const size_t num_kv_tokens = std::min(sequence_group->get_num_processed_tokens(), token_ids.size() - 1);
+            const size_t num_blocks = std::min(num_kv_tokens / block_size, block_table.size());
+            token_ids.resize(num_blocks * block_size);
+            if (num_blocks == 0 || m_session_kv_store->contains(token_ids))
+                continue;
+
+            std::vector<size_t> block_ids;
+            for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx)
+                block_ids.push_back(block_table[block_idx]->get_index());
+            m_session_kv_store->store(m_cache_manager->export_blocks(block_ids, token_ids, token_ids.size(), block_size));
+        }
+    }
 
+    void _serving_loop() {
+        if (!m_cpus.empty())
+            pin_current_thread(m_cpus);
+        try {
+            while (true) {
+                m_awaiting_requests_waiter.wait([this] {
+                    return m_stop_serving || !m_awaiting_requests.empty() || !m_requests.empty();
+                });
+                // already added requests are processed before serving stops
+                if (m_awaiting_requests.empty() && m_requests.empty())
+                    break;
+                step();
+            }
+        } catch (...) {
+            m_serving_error = std::current_exception();
+            m_serving_failed = true;
+            _drop_all_requests();
+        }
+    }
+
+    // readers of remaining requests must not wait forever
+    void _drop_all_requests() {
+        _pull_awaiting_requests();
+        for (const auto& request : m_requests)
+            request->set_generation_status(GenerationStatus::DROPPED_BY_PIPELINE);
+        _free_non_running_requests();
+    }
+
+
+    // requests, which are not finished by their deadlines, are dropped to release KV cache for other requests
+    void _drop_expired_requests() {
+        const auto now = std::chrono::steady_clock::now();
+        for (const auto& request : m_requests) {
+            if (request->is_deadline_exceeded(now) && !request->has_finished() && !request->handle_dropped())
+                request->set_generation_status(GenerationStatus::DROPPED_BY_PIPELINE);
+        }
+    }
 
     void _free_non_running_requests() {
         std::vector<SequenceGroup::Ptr>::iterator requests_iterator = m_requests.begin();
         while (requests_iterator != m_requests.end()) {
             const auto& request = *requests_iterator;
-            if(request->has_finished() || request->out_of_memory() || request->handle_dropped()) {
+            if(request->has_finished() || request->out_of_memory() || request->handle_dropped() || request->dropped_by_pipeline()) {
                 for (const auto& sequence: request->get_sequences()) {
                     m_scheduler->free_sequence(sequence->get_id());
                 }
+                m_sampler->clear_request_info(request->get_group_id());
                 requests_iterator = m_requests.erase(requests_iterator);
+                --m_num_unfinished_requests;
             } else {
                 requests_iterator++;
             }
         }
     }
 
-public:
-    Impl(const std::string& models_path, const SchedulerConfig& scheduler_config, const std::string device, const ov::AnyMap& plugin_config) {
-        ov::Core core;
-        m_tokenizer = std::make_shared<Tokenizer>(models_path);
+    // runs a prompt of max_num_batched_tokens tokens, i.e. the step with the largest intermediate buffers, with a temporary
+    // KV cache, so memory allocated by plugin for inference is not given to KV cache sized by free memory afterwards
+    void _run_peak_memory_profile(ov::InferRequest& infer_request, const SchedulerConfig& scheduler_config, const DeviceConfig& device_config) {
+        const size_t num_tokens = scheduler_config.max_num_batched_tokens, block_size = scheduler_config.block_size;
+        const size_t num_blocks = (num_tokens + block_size - 1) / block_size;
 
-        // The model can be compiled for GPU as well
-        std::shared_ptr<ov::Model> model = core.read_model(models_path + "/openvino_model.xml");
+        DeviceConfig profile_device_config = device_config;
+        profile_device_config.set_num_kv_blocks(num_blocks);
+        CacheManager cache_manager(profile_device_config);
+        _set_kv_caches(infer_request, cache_manager, profile_device_config.get_num_layers());
 
-        DeviceConfig device_config(core, scheduler_config, device);
+        SchedulerConfig profile_scheduler_config = scheduler_config;
+        profile_scheduler_config.num_kv_blocks = num_blocks;
+        ModelRunner model_runner(infer_request, profile_scheduler_config);
+        if (device_config.has_remote_context() && !device_config.is_pipeline_parallel()) {
+            model_runner.set_remote_context(device_config.get_remote_context());
+        }
 
-        apply_paged_attention_transformations(model, device_config);
+        ov::Tensor prompt_ids(ov::element::i64, {num_tokens});
+        std::fill_n(prompt_ids.data<int64_t>(), num_tokens, 0);
+        std::vector<SequenceGroup::Ptr> sequence_groups{std::make_shared<SequenceGroup>(0, prompt_ids, GenerationConfig::greedy(), block_size)};
+        sequence_groups[0]->schedule_tokens(num_tokens);
 
-        ov::InferRequest infer_request = core.compile_model(model, device_config.get_device(), plugin_config).create_infer_request();
+        std::vector<KVCacheBlock> blocks;
+        blocks.reserve(num_blocks);
+        Scheduler::Output scheduler_output;
+        std::vector<KVCacheBlock::Ptr>& block_table = scheduler_output.m_block_tables[(*sequence_groups[0])[0]->get_id()];
+        for (size_t block_id = 0; block_id < num_blocks; ++block_id) {
+            blocks.emplace_back(block_id);
+            block_table.push_back(&blocks.back());
+        }
+        scheduler_output.m_scheduled_sequence_groups_ids = {0};
+        scheduler_output.m_total_num_scheduled_tokens = num_tokens;
+        scheduler_output.is_prompt = true;
+        model_runner.forward(sequence_groups, scheduler_output);
+    }
 
-        // setup KV caches
-        m_cache_manager = std::make_shared<CacheManager>(device_config);
-        for (size_t decoder_layer_id = 0; decoder_layer_id < device_config.get_num_layers(); ++decoder_layer_id) {
-            infer_request.set_input_tensor(2 + decoder_layer_id * 2, m_cache_manager->get_key_cache(decoder_layer_id));
-            infer_request.set_input_tensor(2 + decoder_layer_id * 2 + 1, m_cache_manager->get_value_cache(decoder_layer_id));
+    // creates infer requests of compiled model with own KV cache, scheduler, model runner and sampler;
+    // returns scheduler config with actual number of KV blocks
+    SchedulerConfig _init_model_runner(const SchedulerConfig& scheduler_config, DeviceConfig& device_config) {
+        ov::InferRequest infer_request = m_compiled_model.create_infer_request();
+        // the second request for overlapped execution shares the same KV caches
+        ov::InferRequest pipelined_infer_request;
+        if (scheduler_config.enable_async_execution) {
+            pipelined_infer_request = m_compiled_model.create_infer_request();
+        }
+
+        // KV cache takes device memory left after model compilation and the largest step, if its size is not configured;
+        // LoRA inputs are set only after KV cache is created, so models with LoRA adapters are not profiled
+        if (device_config.requires_num_kv_blocks()) {
+            ManualTimer timer;
+            timer.start();
+            if (scheduler_config.max_num_lora_adapters == 0) {
+                _run_peak_memory_profile(infer_request, scheduler_config, device_config);
+                if (pipelined_infer_request)
+                    _run_peak_memory_profile(pipelined_infer_request, scheduler_config, device_config);
+            }
+            device_config.set_num_kv_blocks_by_free_memory(*m_core, scheduler_config.kv_cache_memory_fraction);
+            m_telemetry.set_startup_duration("kv_cache_sizing", timer.end());
+            m_telemetry.set_kv_cache_size(device_config.get_num_kv_blocks(),
+                device_config.get_num_kv_blocks() * device_config.get_block_byte_size());
+        }
+
+        // setup KV caches; with lazy allocation only the first chunk of KV blocks is allocated at start
+        m_cache_manager = std::make_shared<CacheManager>(device_config,
+            std::min(scheduler_config.num_kv_blocks_per_chunk, device_config.get_num_kv_blocks()));
+        _set_kv_caches(infer_request, *m_cache_manager, device_config.get_num_layers());
+        if (pipelined_infer_request) {
+            _set_kv_caches(pipelined_infer_request, *m_cache_manager, device_config.get_num_layers());
         }
 
         SchedulerConfig updated_config = scheduler_config;
@@ -96,19 +336,345 @@ public:
 
         m_scheduler = std::make_shared<Scheduler>(updated_config);
         // and finally create model runner
-        m_model_runner = std::make_shared<ModelRunner>(infer_request, updated_config);
+        m_model_runner = pipelined_infer_request ?
+            std::make_shared<ModelRunner>(infer_request, pipelined_infer_request, updated_config) :
+            std::make_shared<ModelRunner>(infer_request, updated_config);
+        // inputs of pipeline parallel execution are used by all devices, so they are left in regular host memory
+        if (device_config.has_remote_context() && !device_config.is_pipeline_parallel()) {
+            m_model_runner->set_remote_context(device_config.get_remote_context());
+        }
         m_sampler = std::make_shared<Sampler>();
-        m_sampler->set_seed(m_generation_config.rng_seed);
+        // in overlapped mode sampling runs concurrently with inference, so it should not compete for the same cores
+        m_sampler->set_parallel(!updated_config.enable_async_execution);
+        return updated_config;
+    }
+
+    static void _set_kv_caches(ov::InferRequest& infer_request, const CacheManager& cache_manager, size_t num_decoder_layers) {
+        for (size_t decoder_layer_id = 0; decoder_layer_id < num_decoder_layers; ++decoder_layer_id) {
+            infer_request.set_input_tensor(2 + decoder_layer_id * 2, cache_manager.get_key_cache(decoder_layer_id));
+            infer_request.set_input_tensor(2 + decoder_layer_id * 2 + 1, cache_manager.get_value_cache(decoder_layer_id));
+        }
+    }
+
+    // reallocates KV caches of main and draft models, if lazily allocated KV cache grows or shrinks
+    void _resize_kv_caches(size_t num_kv_blocks) {
+        if (num_kv_blocks == m_cache_manager->get_num_allocated_blocks())
+            return;
+
+        m_cache_manager->resize(num_kv_blocks);
+        ov::InferRequest infer_request = m_model_runner->get_infer_request();
+        _set_kv_caches(infer_request, *m_cache_manager, m_cache_manager->get_num_layers());
+        if (m_model_runner->has_pipelined_request()) {
+            ov::InferRequest pipelined_infer_request = m_model_runner->get_pipelined_infer_request();
+            _set_kv_caches(pipelined_infer_request, *m_cache_manager, m_cache_manager->get_num_layers());
+        }
+
+        if (m_draft_cache_manager) {
+            m_draft_cache_manager->resize(num_kv_blocks);
+            ov::InferRequest draft_infer_request = m_draft_model_runner->get_infer_request();
+            _set_kv_caches(draft_infer_request, *m_draft_cache_manager, m_draft_cache_manager->get_num_layers());
+        }
+    }
+
+    void _set_lora_tensors() {
+        ov::InferRequest infer_request = m_model_runner->get_infer_request();
+        m_lora_adapter_pool->set_tensors(infer_request);
+        if (m_model_runner->has_pipelined_request()) {
+            ov::InferRequest pipelined_infer_request = m_model_runner->get_pipelined_infer_request();
+            m_lora_adapter_pool->set_tensors(pipelined_infer_request);
+        }
+    }
+
+    void _collect_profiling_info(ov::InferRequest infer_request) {
+        if (!m_enable_profiling)
+            return;
+        std::vector<ov::ProfilingInfo> profiling_info = infer_request.get_profiling_info();
+        for (const ov::ProfilingInfo& info : profiling_info) {
+            m_telemetry.add_op_duration(info.node_type, std::chrono::duration<double>(info.real_time).count());
+        }
+    }
+
+    // TTFT and inter-token latency of scheduled sequence groups; tokens generated on the same step (e.g. accepted
+    // speculative candidates or multi-step decode) share the time of the step
+    void _observe_token_latencies(const Scheduler::Output& scheduler_output) {
+        const auto now = std::chrono::steady_clock::now();
+        for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+            SequenceGroup::Ptr sequence_group = m_requests[sequence_group_id];
+            const bool is_first_token = sequence_group->get_num_timed_tokens() == 0;
+            double duration_s = 0.0;
+            size_t num_new_tokens = sequence_group->time_generated_tokens(now, duration_s);
+            if (num_new_tokens == 0)
+                continue;
+            if (is_first_token) {
+                m_telemetry.observe_time_to_first_token(duration_s);
+                duration_s = 0.0;
+                --num_new_tokens;
+            }
+            if (num_new_tokens > 0)
+                m_telemetry.observe_inter_token_latency(duration_s, num_new_tokens);
+        }
+    }
+
+    // Splits scheduled sequence groups into two parts with roughly equal number of tokens and runs them on two infer requests:
+    // inputs of the second part are prepared while the first one is inferring, and the first part is sampled
+    // while the second one is inferring. Parts are independent, because they consist of different sequence groups.
+    SamplerOutput _forward_and_sample_overlapped(const Scheduler::Output& scheduler_output) {
+        const std::vector<uint64_t>& scheduled_ids = scheduler_output.m_scheduled_sequence_groups_ids;
+        size_t split = 0;
+        for (size_t num_tokens = 0; split < scheduled_ids.size() - 1 && num_tokens * 2 < scheduler_output.m_total_num_scheduled_tokens; ++split) {
+            SequenceGroup::CPtr sequence_group = m_requests[scheduled_ids[split]];
+            num_tokens += sequence_group->get_num_scheduled_tokens() * sequence_group->num_running_seqs();
+        }
+        split = std::max<size_t>(split, 1);
+
+        const std::vector<uint64_t> first_part_ids(scheduled_ids.begin(), scheduled_ids.begin() + split),
+                                    second_part_ids(scheduled_ids.begin() + split, scheduled_ids.end());
+
+        m_model_runner->start_async(m_requests, scheduler_output, 0, split, false);
+        m_model_runner->start_async(m_requests, scheduler_output, split, scheduled_ids.size(), true);
+
+        SamplerOutput sampler_output = m_sampler->sample(m_requests, m_model_runner->wait(false), first_part_ids);
+        _collect_profiling_info(m_model_runner->get_infer_request());
+
+        SamplerOutput second_part_output = m_sampler->sample(m_requests, m_model_runner->wait(true), second_part_ids);
+        _collect_profiling_info(m_model_runner->get_pipelined_infer_request());
+
+        // merge outputs
+        sampler_output.m_dropped_sequences.insert(sampler_output.m_dropped_sequences.end(),
+            second_part_output.m_dropped_sequences.begin(), second_part_output.m_dropped_sequences.end());
+        sampler_output.m_forked_sequences.insert(second_part_output.m_forked_sequences.begin(), second_part_output.m_forked_sequences.end());
+        return sampler_output;
+    }
+
+    // runs draft model token by token to propose candidates for speculating sequence groups
+    void _propose_candidates(const Scheduler::Output& scheduler_output) {
+        size_t num_draft_passes = 1;
+        for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids)
+            num_draft_passes = std::max(num_draft_passes, m_requests[sequence_group_id]->get_num_candidate_tokens());
+
+        for (size_t draft_step = 0; draft_step < num_draft_passes; ++draft_step) {
+            bool has_draft_tokens = std::any_of(scheduler_output.m_scheduled_sequence_groups_ids.begin(), scheduler_output.m_scheduled_sequence_groups_ids.end(),
+                [&] (uint64_t sequence_group_id) { return m_requests[sequence_group_id]->get_num_draft_tokens(draft_step) > 0; });
+            if (!has_draft_tokens)
+                break;
+
+            ov::Tensor logits = m_draft_model_runner->forward_draft(m_requests, scheduler_output, draft_step);
+            m_sampler->sample_candidates(m_requests, logits, scheduler_output.m_scheduled_sequence_groups_ids, draft_step);
+        }
+    }
+
+    // serializes KV cache of scheduled export requests, which have processed their prompts on this step, and notifies their handles
+    void _export_kv_caches(const Scheduler::Output& scheduler_output) {
+        for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+            SequenceGroup::Ptr sequence_group = m_requests[sequence_group_id];
+            if (!sequence_group->is_exporting_kv_cache() || !sequence_group->has_finished())
+                continue;
+
+            const uint64_t seq_id = (*sequence_group)[0]->get_id();
+            std::vector<size_t> block_ids;
+            for (KVCacheBlock::CPtr block : scheduler_output.m_block_tables.at(seq_id))
+                block_ids.push_back(block->get_index());
+            const TokenIds& prompt_ids = sequence_group->get_prompt_ids();
+            sequence_group->set_exported_kv_cache(m_cache_manager->export_blocks(block_ids, prompt_ids, prompt_ids.size() - 1,
+                                                                                 m_scheduler->get_config().block_size));
+            sequence_group->notify_handle();
+        }
+    }
+
+    // multi-step decode is applied to batches, where every running sequence generates a single token on regular forward pass
+    bool _is_multi_step_decode(const Scheduler::Output& scheduler_output) const {
+        const std::vector<uint64_t>& scheduled_ids = scheduler_output.m_scheduled_sequence_groups_ids;
+        if (m_scheduler->get_config().num_decode_steps < 2 || m_draft_model_runner || scheduler_output.is_prompt ||
+            (m_model_runner->has_pipelined_request() && scheduled_ids.size() > 1))
+            return false;
+        return std::all_of(scheduled_ids.begin(), scheduled_ids.end(), [this] (uint64_t sequence_group_id) {
+            SequenceGroup::CPtr sequence_group = m_requests[sequence_group_id];
+            return sequence_group->get_num_scheduled_tokens() == 1 && sequence_group->get_num_candidate_tokens() == 0 &&
+                sequence_group->requires_sampling() && !sequence_group->get_sampling_parameters().is_beam_search() &&
+                !sequence_group->is_scoring();
+        });
+    }
+
+    // runs up to num_decode_steps - 1 more steps for the batch decoded on this step without rescheduling, while none of
+    // its sequences is finished or forked; 'num_running_seqs' are numbers of running sequences of scheduled groups
+    void _run_decode_steps(Scheduler::Output& scheduler_output, const std::vector<size_t>& num_running_seqs) {
+        const std::vector<uint64_t>& scheduled_ids = scheduler_output.m_scheduled_sequence_groups_ids;
+        auto is_batch_unchanged = [&] {
+            for (size_t i = 0; i < scheduled_ids.size(); ++i) {
+                SequenceGroup::Ptr sequence_group = m_requests[scheduled_ids[i]];
+                if (sequence_group->has_finished() || sequence_group->handle_dropped() || sequence_group->dropped_by_pipeline() ||
+                    sequence_group->num_running_seqs() != num_running_seqs[i])
+                    return false;
+            }
+            return true;
+        };
+
+        if (!is_batch_unchanged())
+            return;
+        const size_t num_steps = m_scheduler->reserve_decode_slots(m_requests, scheduler_output, m_scheduler->get_config().num_decode_steps - 1);
+        if (num_steps == 0)
+            return;
+
+        // intermediate tokens of running groups are not pushed to their streams on each step
+        m_sampler->set_notify_finished_only(true);
+        for (size_t decode_step = 0; decode_step < num_steps && is_batch_unchanged(); ++decode_step) {
+            for (uint64_t sequence_group_id : scheduled_ids)
+                m_requests[sequence_group_id]->schedule_tokens(1);
+            ov::Tensor logits = m_model_runner->forward_next_decode_step(m_requests, scheduler_output);
+            SamplerOutput sampler_output = m_sampler->sample(m_requests, logits, scheduled_ids);
+            _store_finished_sessions(scheduled_ids);
+            for (auto seq_id : sampler_output.m_dropped_sequences)
+                m_scheduler->free_sequence(seq_id);
+        }
+        m_sampler->set_notify_finished_only(false);
+
+        for (uint64_t sequence_group_id : scheduled_ids) {
+            SequenceGroup::Ptr sequence_group = m_requests[sequence_group_id];
+            if (sequence_group->is_running()) {
+                sequence_group->notify_handle();
+                // KV cache reserved for steps, which were not run
+                m_scheduler->free_rejected_tokens(sequence_group);
+            }
+        }
+    }
+
+    // proposes candidates for sequence groups with prompt lookup decoding from their own prompt and generated tokens;
+    // tokens of candidates, which are not found, are not counted by 'scheduler_output'
+    void _lookup_candidates(Scheduler::Output& scheduler_output) {
+        for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+            SequenceGroup::Ptr sequence_group = m_requests[sequence_group_id];
+            if (!sequence_group->is_prompt_lookup() || sequence_group->get_num_candidate_tokens() == 0)
+                continue;
+
+            Sequence::Ptr sequence = sequence_group->get_running_sequences()[0];
+            NGramIndex& ngram_index = sequence_group->get_ngram_index();
+            ngram_index.update(sequence_group->get_prompt_ids(), sequence->get_generated_ids());
+
+            // fewer candidates than reserved by scheduler can be found, redundant KV blocks are released after sampling
+            const size_t num_reserved_candidates = sequence_group->get_num_candidate_tokens();
+            TokenIds candidates = ngram_index.find_candidates(num_reserved_candidates);
+            sequence_group->schedule_candidate_tokens(candidates.size());
+            scheduler_output.m_total_num_scheduled_tokens -= num_reserved_candidates - candidates.size();
+            for (int64_t candidate : candidates)
+                sequence->append_token(candidate, 0.0f);
+        }
+    }
+
+public:
+    // 'tokenizer' is read from 'models_path', if it's not passed
+    Impl(const std::string& models_path, std::shared_ptr<Tokenizer> tokenizer, const SchedulerConfig& scheduler_config, const std::string device,
+         const ov::AnyMap& plugin_config, const std::string& draft_models_path = "") {
+        // startup stages are timed, compiled blobs are reused between runs if ov::cache_dir is in plugin_config
+        m_core = std::make_shared<ov::Core>();
+        auto enable_profiling = plugin_config.find(ov::enable_profiling.name());
+        m_enable_profiling = enable_profiling != plugin_config.end() && enable_profiling->second.as<bool>();
+        // tokenizer doesn't depend on the model, so it's compiled concurrently
+        std::future<std::shared_ptr<Tokenizer>> tokenizer_future;
+        if (!tokenizer) {
+            tokenizer_future = std::async(std::launch::async, [this, &models_path] {
+                ManualTimer timer;
+                timer.start();
+                auto tokenizer = std::make_shared<Tokenizer>(models_path);
+                m_telemetry.set_startup_duration("tokenizer", timer.end());
+                return tokenizer;
+            });
+        }
+
+        ManualTimer read_model_timer;
+        read_model_timer.start();
+        // The model can be compiled for GPU as well
+        std::shared_ptr<ov::Model> model = m_core->read_model(models_path + "/openvino_model.xml");
+        const ov::PartialShape& logits_shape = model->output(0).get_partial_shape();
+        if (logits_shape.rank().is_static() && logits_shape[logits_shape.rank().get_length() - 1].is_static())
+            m_vocab_size = logits_shape[logits_shape.rank().get_length() - 1].get_length();
+
+        DeviceConfig device_config(*m_core, scheduler_config, device, plugin_config);
+
+        apply_paged_attention_transformations(model, device_config);
+
+        std::vector<LoRALayer> lora_layers;
+        if (scheduler_config.max_num_lora_adapters > 0) {
+            lora_layers = apply_lora_transformations(model, scheduler_config.max_num_lora_adapters * scheduler_config.max_lora_rank);
+        }
+
+        m_telemetry.set_startup_duration("read_model", read_model_timer.end());
+
+        ManualTimer compile_model_timer;
+        compile_model_timer.start();
+        const ov::AnyMap compile_config = device_config.is_pipeline_parallel() ?
+            _assign_pipeline_stages(*m_core, model, device_config, plugin_config) : plugin_config;
+        m_compiled_model = m_core->compile_model(model, device_config.get_device(), compile_config);
+        m_telemetry.set_startup_duration("compile_model", compile_model_timer.end());
+
+        SchedulerConfig updated_config = _init_model_runner(scheduler_config, device_config);
+        m_device_config = std::make_shared<DeviceConfig>(device_config);
+
+        if (!draft_models_path.empty()) {
+            OPENVINO_ASSERT(scheduler_config.num_speculative_tokens > 0, "num_speculative_tokens must be set for speculative decoding");
+            OPENVINO_ASSERT(!scheduler_config.enable_async_execution, "Speculative decoding is not supported with async execution");
+            OPENVINO_ASSERT(!device_config.is_pipeline_parallel(), "Speculative decoding is not supported with pipeline parallel execution");
 
+            std::shared_ptr<ov::Model> draft_model = m_core->read_model(draft_models_path + "/openvino_model.xml");
+            // block tables are shared with main model, so draft KV cache must have the same number of blocks
+            DeviceConfig draft_device_config(*m_core, updated_config, device, plugin_config);
+            apply_paged_attention_transformations(draft_model, draft_device_config);
+
+            ov::InferRequest draft_infer_request = m_core->compile_model(draft_model, draft_device_config.get_device(), plugin_config).create_infer_request();
+            m_draft_cache_manager = std::make_shared<CacheManager>(draft_device_config, m_cache_manager->get_num_allocated_blocks());
+            _set_kv_caches(draft_infer_request, *m_draft_cache_manager, draft_device_config.get_num_layers());
+            m_draft_model_runner = std::make_shared<ModelRunner>(draft_infer_request, updated_config);
+            if (draft_device_config.has_remote_context()) {
+                m_draft_model_runner->set_remote_context(draft_device_config.get_remote_context());
+            }
+            OPENVINO_ASSERT(scheduler_config.session_cache_dir.empty(), "Session cache is not supported with speculative decoding");
+        } else {
+            OPENVINO_ASSERT(scheduler_config.num_speculative_tokens == 0, "Speculative decoding requires a draft model");
+        }
+        m_session_kv_store = _get_session_kv_store(scheduler_config);
+
+        m_tokenizer = tokenizer ? tokenizer : tokenizer_future.get();
+
+        if (scheduler_config.max_num_lora_adapters > 0) {
+            m_lora_adapter_pool = std::make_shared<LoRAAdapterPool>(lora_layers, scheduler_config.max_num_lora_adapters, scheduler_config.max_lora_rank);
+            m_model_runner->set_lora_adapter_pool(m_lora_adapter_pool);
+            _set_lora_tensors();
+        }
         // read default generation config
     }
 
+    // replica shares compiled model (i.e. weights), tokenizer and generation config with 'other', while KV cache,
+    // scheduler and requests are its own, so replicas process requests in parallel; on CPU infer requests of replicas
+    // run on free streams of the compiled model
+    Impl(const Impl& other, const SchedulerConfig& scheduler_config) {
+        OPENVINO_ASSERT(!other.m_draft_model_runner && scheduler_config.num_speculative_tokens == 0,
+            "Replicas of pipeline are not supported for speculative decoding");
+        OPENVINO_ASSERT(!other.m_lora_adapter_pool && scheduler_config.max_num_lora_adapters == 0,
+            "Replicas of pipeline are not supported with LoRA adapters");
+        m_core = other.m_core;
+        m_compiled_model = other.m_compiled_model;
+        m_tokenizer = other.m_tokenizer;
+        m_vocab_size = other.m_vocab_size;
+        m_generation_config = other.m_generation_config;
+        m_enable_profiling = other.m_enable_profiling;
+
+        DeviceConfig device_config = *other.m_device_config;
+        device_config.set_scheduler_config(scheduler_config);
+        _init_model_runner(scheduler_config, device_config);
+        m_device_config = std::make_shared<DeviceConfig>(device_config);
+        m_session_kv_store = _get_session_kv_store(scheduler_config, other.m_session_kv_store);
+    }
+
     GenerationConfig get_config() const {
         return m_generation_config;
     }
 
     PipelineMetrics get_metrics() const {
-        return m_pipeline_metrics;
+        PipelineTelemetry::Snapshot snapshot = m_telemetry.get_snapshot();
+        return {snapshot.requests, snapshot.scheduled_requests, snapshot.cache_usage};
+    }
+
+    const PipelineTelemetry& get_telemetry() const {
+        return m_telemetry;
     }
 
     std::shared_ptr<Tokenizer> get_tokenizer() {
@@ -116,51 +682,98 @@ public:
     }
 
     GenerationHandle add_request(uint64_t request_id, std::string prompt, GenerationConfig sampling_params) {
-        sampling_params.set_eos_token_id(m_tokenizer->get_eos_token_id());
-        sampling_params.validate();
-
         ov::Tensor input_ids;
         {
-            static ManualTimer timer("tokenize");
+            ManualTimer timer;
             timer.start();
             input_ids = m_tokenizer->encode(prompt);
-            timer.end();
+            m_telemetry.observe_tokenize(timer.end());
         }
+        return add_request(request_id, input_ids, sampling_params);
+    }
+
+    GenerationHandle add_request(uint64_t request_id, ov::Tensor input_ids, GenerationConfig sampling_params, KVCacheBlob::Ptr kv_cache = nullptr) {
+        sampling_params.set_eos_token_id(m_tokenizer->get_eos_token_id());
+        sampling_params.validate();
+        OPENVINO_ASSERT(sampling_params.lora_adapter_id == 0 || (m_lora_adapter_pool && m_lora_adapter_pool->has_adapter(sampling_params.lora_adapter_id)),
+            "LoRA adapter ", sampling_params.lora_adapter_id, " is not loaded");
+        OPENVINO_ASSERT(input_ids.get_element_type() == ov::element::i64 && input_ids.get_size() > 0,
+            "Prompt must be a non-empty tensor of i64 token ids");
 
         SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(request_id, input_ids,
                                                                             sampling_params, m_scheduler->get_config().block_size);
-        {
-            std::lock_guard<std::mutex> lock{m_awaiting_requests_mutex};
-            m_awaiting_requests.push_back(sequence_group);
+        if (!sampling_params.regex_constraint.empty()) {
+            sequence_group->set_token_constraint(_get_token_constraint(sampling_params.regex_constraint));
+        }
+        if (!sampling_params.stop_strings.empty()) {
+            std::lock_guard<std::mutex> lock(m_token_constraints_mutex);
+            sequence_group->set_stop_string_matcher(std::make_shared<StopStringMatcher>(sampling_params.stop_strings, _get_token_vocabulary()));
+        }
+        if (kv_cache) {
+            sequence_group->set_imported_kv_cache(std::move(kv_cache));
         }
+        OPENVINO_ASSERT(!m_serving_failed, "Requests cannot be added, because serving has failed. Call ContinuousBatchingPipeline::stop_serving to get the error");
+        ++m_num_unfinished_requests;
+        m_awaiting_requests.push(sequence_group);
+        m_awaiting_requests_waiter.notify();
         return std::make_unique<GenerationHandleImpl>(sequence_group->get_generation_stream(), sampling_params);
     }
 
+    // continues a request, which prompt KV cache is exported by another pipeline; blob is kept until it's imported on scheduling
+    GenerationHandle add_request(uint64_t request_id, KVCacheBlob::Ptr kv_cache, GenerationConfig sampling_params) {
+        OPENVINO_ASSERT(kv_cache, "KV cache blob is empty");
+        OPENVINO_ASSERT(m_scheduler->get_config().dynamic_split_fuse, "KV cache import is supported only with dynamic_split_fuse scheduling");
+        OPENVINO_ASSERT(!m_draft_model_runner, "KV cache import is not supported with speculative decoding");
+        OPENVINO_ASSERT(kv_cache->get_header().block_size == m_scheduler->get_config().block_size && m_cache_manager->is_compatible(*kv_cache),
+            "KV cache blob is exported by a pipeline with a different model or KV cache configuration");
+        std::vector<int64_t> prompt_ids = kv_cache->get_prompt_ids();
+        ov::Tensor input_ids(ov::element::i64, {prompt_ids.size()}, prompt_ids.data());
+        return add_request(request_id, input_ids, sampling_params, std::move(kv_cache));
+    }
+
     void step() {
-        static ManualTimer step_timer("step()");
+        ManualTimer step_timer;
         step_timer.start();
 
         // Pull awaiting requests
-        {
-            std::lock_guard<std::mutex> lock{m_awaiting_requests_mutex};
-            m_requests.insert(m_requests.end(), m_awaiting_requests.begin(), m_awaiting_requests.end());
-            m_awaiting_requests.clear();
-        }
+        _pull_awaiting_requests();
+
+        // KV blocks of cancelled and expired requests are released before scheduling, so they are reused on this step
+        _drop_expired_requests();
+        _free_non_running_requests();
 
-        m_pipeline_metrics.requests = m_requests.size();
         Scheduler::Output scheduler_output;
         {
-            static ManualTimer timer("scheduling");
+            ManualTimer timer;
             timer.start();
             scheduler_output = m_scheduler->schedule(m_requests);
-            m_pipeline_metrics.scheduled_requests = scheduler_output.m_scheduled_sequence_groups_ids.size();
-            m_pipeline_metrics.cache_usage = scheduler_output.m_cache_usage;
+            const auto now = std::chrono::steady_clock::now();
+            for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids)
+                m_requests[sequence_group_id]->record_scheduled(now);
+            m_telemetry.set_snapshot({m_requests.size(), scheduler_output.m_scheduled_sequence_groups_ids.size(), scheduler_output.m_cache_usage});
+            m_telemetry.add_preemptions(scheduler_output.m_num_preemptions);
+            for (const auto& tenant_usage : scheduler_output.m_tenant_usage)
+                m_telemetry.observe_tenant(tenant_usage.first, tenant_usage.second.m_num_scheduled_tokens,
+                                           tenant_usage.second.m_num_kv_blocks, tenant_usage.second.m_num_preemptions);
+            // lazily allocated KV cache grows, when scheduled sequences do not fit into already allocated blocks
+            _resize_kv_caches(scheduler_output.m_num_kv_blocks);
+            // swap out must go first, because freed blocks can be reused by swapped in sequences
+            m_cache_manager->swap_out(scheduler_output.m_swap_out_block_map);
+            m_cache_manager->swap_in(scheduler_output.m_swap_in_block_map);
             m_cache_manager->copy_blocks(scheduler_output.m_block_copy_map);
-            timer.end();
+            for (const auto& kv_cache_import : scheduler_output.m_kv_cache_imports)
+                m_cache_manager->import_blocks(*kv_cache_import.m_kv_cache, kv_cache_import.m_block_ids, kv_cache_import.m_first_block_idx);
+            if (m_draft_cache_manager) {
+                m_draft_cache_manager->swap_out(scheduler_output.m_swap_out_block_map);
+                m_draft_cache_manager->swap_in(scheduler_output.m_swap_in_block_map);
+                m_draft_cache_manager->copy_blocks(scheduler_output.m_block_copy_map);
+            }
+            m_telemetry.observe_phase(PipelineTelemetry::StepPhase::SCHEDULE, timer.end());
         }
 
         // if no tokens were scheduled, we are out of memory
         if (scheduler_output.m_total_num_scheduled_tokens == 0) {
+            m_telemetry.add_out_of_memory_step();
             for (size_t i = 0; i < m_requests.size(); ++i) {
                 SequenceGroup::Ptr sequence_group = m_requests[i];
                 sequence_group->set_out_of_memory();
@@ -170,37 +783,56 @@ public:
             return;
         }
 
-        ov::Tensor logits;
         {
-            static ManualTimer timer("forward");
+            ManualTimer timer;
             timer.start();
-            logits = m_model_runner->forward(m_requests, scheduler_output);
-            timer.end();
-
-            // collect detailed statistic
-            std::vector<ov::ProfilingInfo> profiling_info = m_model_runner->get_infer_request().get_profiling_info();
-            for (const ov::ProfilingInfo& info : profiling_info) {
-                double current_time = info.real_time.count();
-                if (info.node_type == "PagedAttentionExtension") {
-                    m_perf.m_paged_attention_time_ms += current_time;
-                } else if (info.node_type == "FullyConnected") {
-                    m_perf.m_matmul_time_ms += current_time;
-                }
-                m_perf.m_infer_total_ms += current_time;
-            }
+            _lookup_candidates(scheduler_output);
+            m_telemetry.observe_phase(PipelineTelemetry::StepPhase::LOOKUP_CANDIDATES, timer.end());
+        }
+
+        // scheduled tokens are cleared by sampler, so multi-step decode is checked in advance
+        const bool is_multi_step_decode = _is_multi_step_decode(scheduler_output);
+        std::vector<size_t> num_running_seqs;
+        if (is_multi_step_decode) {
+            for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids)
+                num_running_seqs.push_back(m_requests[sequence_group_id]->num_running_seqs());
         }
 
         SamplerOutput sampler_output;
-        {
-            static ManualTimer timer("sample");
+        if (m_model_runner->has_pipelined_request() && scheduler_output.m_scheduled_sequence_groups_ids.size() > 1) {
+            ManualTimer timer;
             timer.start();
-            sampler_output = m_sampler->sample(m_requests, logits);
-            timer.end();
+            sampler_output = _forward_and_sample_overlapped(scheduler_output);
+            m_telemetry.observe_phase(PipelineTelemetry::StepPhase::FORWARD_AND_SAMPLE, timer.end());
+        } else {
+            if (m_draft_model_runner) {
+                ManualTimer timer;
+                timer.start();
+                _propose_candidates(scheduler_output);
+                m_telemetry.observe_phase(PipelineTelemetry::StepPhase::PROPOSE_CANDIDATES, timer.end());
+            }
+
+            ov::Tensor logits;
+            {
+                ManualTimer timer;
+                timer.start();
+                logits = m_model_runner->forward(m_requests, scheduler_output);
+                m_telemetry.observe_phase(PipelineTelemetry::StepPhase::FORWARD, timer.end());
+
+                _collect_profiling_info(m_model_runner->get_infer_request());
+            }
+
+            {
+                ManualTimer timer;
+                timer.start();
+                sampler_output = m_sampler->sample(m_requests, logits);
+                m_telemetry.observe_phase(PipelineTelemetry::StepPhase::SAMPLE, timer.end());
+            }
         }
 
         // process sampler_output (e.g. fork or drop sequences from BlockScheduler)
         {
-            static ManualTimer timer("fork / free sequence");
+            ManualTimer timer;
             timer.start();
 
             for (const auto& pair : sampler_output.m_forked_sequences) {
@@ -210,31 +842,122 @@ public:
                     m_scheduler->fork_sequence(parent_id, child_id);
             }
 
+            // blocks of finished KV cache export requests and sessions are read before they are freed
+            _export_kv_caches(scheduler_output);
+            _store_finished_sessions(scheduler_output.m_scheduled_sequence_groups_ids);
+
             for (auto seq_id : sampler_output.m_dropped_sequences)
                 m_scheduler->free_sequence(seq_id);
 
-            timer.end();
+            // KV cache of rejected speculative candidates is not needed anymore
+            for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+                SequenceGroup::CPtr sequence_group = m_requests[sequence_group_id];
+                if (sequence_group->is_running())
+                    m_scheduler->free_rejected_tokens(sequence_group);
+            }
+
+            m_telemetry.observe_phase(PipelineTelemetry::StepPhase::FORK, timer.end());
         }
 
+        if (is_multi_step_decode) {
+            ManualTimer timer;
+            timer.start();
+            _run_decode_steps(scheduler_output, num_running_seqs);
+            m_telemetry.observe_phase(PipelineTelemetry::StepPhase::MULTI_STEP_DECODE, timer.end());
+        }
+
+        // indices of scheduled sequence groups are valid until non running requests are freed
+        _observe_token_latencies(scheduler_output);
+
         // free non running requests for current step
 
         {
-            static ManualTimer timer("free non running requests");
+            ManualTimer timer;
             timer.start();
             _free_non_running_requests();
-            timer.end();
+            m_telemetry.observe_phase(PipelineTelemetry::StepPhase::FREE, timer.end());
+        }
+
+        if (m_requests.empty() && m_scheduler->get_config().release_idle_kv_cache) {
+            _resize_kv_caches(m_scheduler->release_idle_kv_cache());
         }
 
-        step_timer.end();
+        m_telemetry.observe_step(step_timer.end(), scheduler_output.m_total_num_scheduled_tokens);
     }
 
     bool has_non_finished_requests() {
-        std::lock_guard<std::mutex> lock{m_awaiting_requests_mutex};
         return !m_awaiting_requests.empty() || !m_requests.empty();
     }
 
+    bool is_serving() const {
+        return m_serving_thread.joinable();
+    }
+
+    // blocks of the whole KV cache, including not yet allocated ones
+    size_t get_num_kv_blocks() const {
+        return m_scheduler->get_config().num_kv_blocks;
+    }
+
+    size_t get_num_unfinished_requests() const {
+        return m_num_unfinished_requests;
+    }
+
+    void set_cpus(const std::vector<int>& cpus) {
+        m_cpus = cpus;
+    }
+
+    void add_lora_adapter(size_t adapter_id, const LoRAAdapter& adapter, float alpha) {
+        OPENVINO_ASSERT(m_lora_adapter_pool, "LoRA adapters require SchedulerConfig::max_num_lora_adapters > 0");
+        OPENVINO_ASSERT(!is_serving(), "LoRA adapters cannot be added while ContinuousBatchingPipeline is serving");
+        m_lora_adapter_pool->add_adapter(adapter_id, adapter, alpha);
+        // updated weights must be uploaded again by device plugins, which copy inputs
+        _set_lora_tensors();
+    }
+
+    void remove_lora_adapter(size_t adapter_id) {
+        OPENVINO_ASSERT(m_lora_adapter_pool, "LoRA adapters require SchedulerConfig::max_num_lora_adapters > 0");
+        OPENVINO_ASSERT(!is_serving(), "LoRA adapters cannot be removed while ContinuousBatchingPipeline is serving");
+        m_lora_adapter_pool->remove_adapter(adapter_id);
+    }
+
+    void start_serving() {
+        OPENVINO_ASSERT(!is_serving(), "ContinuousBatchingPipeline is already serving");
+        m_stop_serving = false;
+        m_serving_failed = false;
+        m_serving_error = nullptr;
+        m_serving_thread = std::thread(&Impl::_serving_loop, this);
+    }
+
+    void stop_serving() {
+        OPENVINO_ASSERT(is_serving(), "ContinuousBatchingPipeline is not serving");
+        m_stop_serving = true;
+        m_awaiting_requests_waiter.notify();
+        m_serving_thread.join();
+        // requests may be added after the failed serving loop has dropped the awaiting ones
+        if (m_serving_failed)
+            _drop_all_requests();
+
+        if (m_serving_error) {
+            std::exception_ptr serving_error = m_serving_error;
+            m_serving_error = nullptr;
+            std::rethrow_exception(serving_error);
+        }
+    }
+
+    ~Impl() {
+        if (is_serving()) {
+            m_stop_serving = true;
+            m_awaiting_requests_waiter.notify();
+            m_serving_thread.join();
+            if (m_serving_failed)
+                _drop_all_requests();
+        }
+    }
+
     std::vector<GenerationResult> generate(const std::vector<std::string> prompts, std::vector<GenerationConfig> sampling_params) {
-        OPENVINO_ASSERT(!has_non_finished_requests(), "Generate cannot be called while ContinuousBatchingPipeline is already in running state. Use ContinuousBatchingPipeline::add_request");
+        // in serving mode requests are processed by serving thread together with other in-flight requests
+        const bool serving = is_serving();
+        OPENVINO_ASSERT(serving || !has_non_finished_requests(), "Generate cannot be called while ContinuousBatchingPipeline is already in running state. Use ContinuousBatchingPipeline::add_request or serving mode");
         OPENVINO_ASSERT(prompts.size() == sampling_params.size());
 
         std::vector<GenerationHandle> generations;
@@ -242,13 +965,22 @@ public:
             generations.push_back(add_request(request_id, prompts[request_id], sampling_params[request_id]));
         }
 
-        std::vector<GenerationResult> results;
-        results.reserve(m_awaiting_requests.size());
-
-        while (has_non_finished_requests()) {
+        while (!serving && has_non_finished_requests()) {
             step();
         }
 
+        std::vector<GenerationResult> results = read_results(generations, sampling_params, *m_tokenizer);
+        OPENVINO_ASSERT(results.size() == prompts.size());
+        return results;
+    }
+
+    // waits for finished generations and decodes their best num_return_sequences outputs
+    static std::vector<GenerationResult> read_results(const std::vector<GenerationHandle>& generations,
+                                                      const std::vector<GenerationConfig>& sampling_params,
+                                                      Tokenizer& tokenizer) {
+        std::vector<GenerationResult> results;
+        results.reserve(generations.size());
+
         for (size_t generation_idx = 0; generation_idx < generations.size(); ++generation_idx) {
             const auto& generation = generations[generation_idx];
             GenerationResult result;
@@ -261,24 +993,96 @@ public:
             auto num_outputs = std::min(sampling_params[generation_idx].num_return_sequences, generation_outputs.size());
             for (size_t generation_output_idx = 0; generation_output_idx < num_outputs; ++generation_output_idx) {
                 const auto& generation_output = generation_outputs[generation_output_idx];
-                std::string output_text = m_tokenizer->decode(generation_output.generated_token_ids);
+                std::string output_text = tokenizer.decode(generation_output.generated_token_ids);
                 result.m_generation_ids.push_back(output_text);
                 result.m_scores.push_back(generation_output.score);
             }
             result.m_status = generation->get_status();
+            result.m_metrics = generation->get_metrics();
             results.push_back(result);
         }
 
-        OPENVINO_ASSERT(results.size() == prompts.size());
         return results;
     }
 };
 
 ContinuousBatchingPipeline::ContinuousBatchingPipeline( const std::string& models_path,
+                                                        const SchedulerConfig& scheduler_config,
+                                                        const std::string& device,
+                                                        const ov::AnyMap& plugin_config ) :
+    ContinuousBatchingPipeline(models_path, std::shared_ptr<Tokenizer>(), scheduler_config, device, plugin_config) {
+}
+
+ContinuousBatchingPipeline::ContinuousBatchingPipeline( const std::string& models_path,
+                                                        std::shared_ptr<Tokenizer> tokenizer,
                                                         const SchedulerConfig& scheduler_config,
                                                         const std::string& device,
                                                         const ov::AnyMap& plugin_config ) {
-    m_impl = std::make_shared<Impl>(models_path, scheduler_config, device, plugin_config);
+    const std::vector<std::vector<int>> nodes_cpus = scheduler_config.enable_numa_workers ?
+        get_numa_nodes_cpus() : std::vector<std::vector<int>>{};
+    if (nodes_cpus.size() < 2) {
+        m_impl = std::make_shared<Impl>(models_path, tokenizer, scheduler_config, device, plugin_config);
+        return;
+    }
+
+    // each worker compiles own model on a thread pinned to its node: CPU plugin runs an inference of a compiled model on
+    // any free stream, so streams of a shared model cannot be bound to requests of a worker, while threads of streams,
+    // which are not pinned by plugin, inherit affinity of the compiling thread; this places a copy of weights to local
+    // memory of every node as well
+    SchedulerConfig workers_scheduler_config = scheduler_config;
+    const bool is_kv_cache_sized_by_free_memory = scheduler_config.num_kv_blocks == 0 && scheduler_config.cache_size == 0;
+
+    // workers are created on threads pinned to their nodes, so KV caches are placed to local memory of nodes
+    // by the first touch (CacheManager initializes allocated blocks)
+    m_workers.resize(nodes_cpus.size());
+    for (size_t node_id = 0; node_id < nodes_cpus.size(); ++node_id) {
+        ov::AnyMap worker_plugin_config = plugin_config;
+        worker_plugin_config.emplace(ov::num_streams.name(), ov::streams::Num(1));
+        worker_plugin_config.emplace(ov::inference_num_threads.name(), static_cast<int>(nodes_cpus[node_id].size()));
+        worker_plugin_config[ov::hint::enable_cpu_pinning.name()] = false;
+        // KV cache sized by free memory is split between workers: each worker takes its part of host memory left
+        // by previous workers and its own weights
+        if (is_kv_cache_sized_by_free_memory)
+            workers_scheduler_config.kv_cache_memory_fraction = scheduler_config.kv_cache_memory_fraction / (nodes_cpus.size() - node_id);
+
+        std::exception_ptr error;
+        std::thread worker_thread([&, node_id] {
+            try {
+                pin_current_thread(nodes_cpus[node_id]);
+                m_workers[node_id] = std::make_shared<Impl>(models_path, tokenizer, workers_scheduler_config, device, worker_plugin_config);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        });
+        worker_thread.join();
+        if (error)
+            std::rethrow_exception(error);
+        m_workers[node_id]->set_cpus(nodes_cpus[node_id]);
+    }
+    m_impl = m_workers[0];
+}
+
+ContinuousBatchingPipeline::ContinuousBatchingPipeline( const std::string& models_path,
+                                                        const std::string& draft_models_path,
+                                                        const SchedulerConfig& scheduler_config,
+                                                        const std::string& device,
+                                                        const ov::AnyMap& plugin_config ) {
+    m_impl = std::make_shared<Impl>(models_path, nullptr, scheduler_config, device, plugin_config, draft_models_path);
+}
+
+ContinuousBatchingPipeline::ContinuousBatchingPipeline(std::shared_ptr<Impl> impl) : m_impl(std::move(impl)) {
+}
+
+std::shared_ptr<ContinuousBatchingPipeline::Impl> ContinuousBatchingPipeline::_get_least_loaded_worker() const {
+    if (m_workers.empty())
+        return m_impl;
+    return *std::min_element(m_workers.begin(), m_workers.end(), [] (const std::shared_ptr<Impl>& lhs, const std::shared_ptr<Impl>& rhs) {
+        return lhs->get_num_unfinished_requests() < rhs->get_num_unfinished_requests();
+    });
+}
+
+ContinuousBatchingPipeline ContinuousBatchingPipeline::create_replica(const SchedulerConfig& scheduler_config) const {
+    return ContinuousBatchingPipeline(std::make_shared<Impl>(*m_impl, scheduler_config));
 }
 
 std::shared_ptr<Tokenizer> ContinuousBatchingPipeline::get_tokenizer() {
@@ -290,21 +1094,139 @@ GenerationConfig ContinuousBatchingPipeline::get_config() const{
 }
 
 PipelineMetrics ContinuousBatchingPipeline::get_metrics() const{
-    return m_impl->get_metrics();
+    if (m_workers.empty())
+        return m_impl->get_metrics();
+
+    // cache usage is averaged, since workers have KV caches of the same size
+    PipelineMetrics metrics;
+    for (const auto& worker : m_workers) {
+        PipelineMetrics worker_metrics = worker->get_metrics();
+        metrics.requests += worker_metrics.requests;
+        metrics.scheduled_requests += worker_metrics.scheduled_requests;
+        metrics.cache_usage += worker_metrics.cache_usage / m_workers.size();
+    }
+    return metrics;
+}
+
+std::string ContinuousBatchingPipeline::get_prometheus_metrics() const {
+    if (m_workers.empty())
+        return m_impl->get_telemetry().to_prometheus();
+
+    PipelineTelemetry telemetry;
+    for (const auto& worker : m_workers)
+        telemetry.merge(worker->get_telemetry());
+    PipelineTelemetry::Snapshot snapshot = telemetry.get_snapshot();
+    snapshot.cache_usage /= m_workers.size();
+    telemetry.set_snapshot(snapshot);
+    return telemetry.to_prometheus();
 }
 
 GenerationHandle ContinuousBatchingPipeline::add_request(uint64_t request_id, std::string prompt, GenerationConfig sampling_params) {
-    return m_impl->add_request(request_id, prompt, sampling_params);
+    return _get_least_loaded_worker()->add_request(request_id, prompt, sampling_params);
+}
+
+GenerationHandle ContinuousBatchingPipeline::add_request(uint64_t request_id, ov::Tensor input_ids, GenerationConfig sampling_params) {
+    return _get_least_loaded_worker()->add_request(request_id, input_ids, sampling_params);
+}
+
+GenerationHandle ContinuousBatchingPipeline::add_request(uint64_t request_id, KVCacheBlob::Ptr kv_cache, GenerationConfig sampling_params) {
+    return _get_least_loaded_worker()->add_request(request_id, std::move(kv_cache), sampling_params);
 }
 
 void ContinuousBatchingPipeline::step() {
-    m_impl->step();
+    OPENVINO_ASSERT(!is_serving(), "step() cannot be called in serving mode");
+    if (m_workers.empty()) {
+        m_impl->step();
+        return;
+    }
+    // without serving threads workers are stepped in turn; serving mode runs them in parallel
+    for (const auto& worker : m_workers) {
+        if (worker->has_non_finished_requests())
+            worker->step();
+    }
 }
 
 bool ContinuousBatchingPipeline::has_non_finished_requests() {
-    return m_impl->has_non_finished_requests();
+    if (m_workers.empty())
+        return m_impl->has_non_finished_requests();
+    return std::any_of(m_workers.begin(), m_workers.end(), [] (const std::shared_ptr<Impl>& worker) {
+        return worker->has_non_finished_requests();
+    });
+}
+
+void ContinuousBatchingPipeline::start_serving() {
+    if (m_workers.empty()) {
+        m_impl->start_serving();
+        return;
+    }
+    OPENVINO_ASSERT(!is_serving(), "ContinuousBatchingPipeline is already serving");
+    for (const auto& worker : m_workers)
+        worker->start_serving();
+}
+
+void ContinuousBatchingPipeline::stop_serving() {
+    if (m_workers.empty()) {
+        m_impl->stop_serving();
+        return;
+    }
+    // all workers are stopped before the first error is rethrown
+    std::exception_ptr error;
+    for (const auto& worker : m_workers) {
+        try {
+            worker->stop_serving();
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+bool ContinuousBatchingPipeline::is_serving() const {
+    if (m_workers.empty())
+        return m_impl->is_serving();
+    return std::any_of(m_workers.begin(), m_workers.end(), [] (const std::shared_ptr<Impl>& worker) {
+        return worker->is_serving();
+    });
+}
+
+// requests are placed to any worker, so every worker keeps all adapters
+void ContinuousBatchingPipeline::add_lora_adapter(size_t adapter_id, const LoRAAdapter& adapter, float alpha) {
+    if (m_workers.empty()) {
+        m_impl->add_lora_adapter(adapter_id, adapter, alpha);
+        return;
+    }
+    OPENVINO_ASSERT(!is_serving(), "LoRA adapters cannot be added while ContinuousBatchingPipeline is serving");
+    for (const auto& worker : m_workers)
+        worker->add_lora_adapter(adapter_id, adapter, alpha);
+}
+
+void ContinuousBatchingPipeline::remove_lora_adapter(size_t adapter_id) {
+    if (m_workers.empty()) {
+        m_impl->remove_lora_adapter(adapter_id);
+        return;
+    }
+    OPENVINO_ASSERT(!is_serving(), "LoRA adapters cannot be removed while ContinuousBatchingPipeline is serving");
+    for (const auto& worker : m_workers)
+        worker->remove_lora_adapter(adapter_id);
 }
 
 std::vector<GenerationResult> ContinuousBatchingPipeline::generate(const std::vector<std::string>& prompts, std::vector<GenerationConfig> sampling_params) {
-    return m_impl->generate(prompts, sampling_params);
+    if (m_workers.empty())
+        return m_impl->generate(prompts, sampling_params);
+
+    const bool serving = is_serving();
+    OPENVINO_ASSERT(serving || !has_non_finished_requests(), "Generate cannot be called while ContinuousBatchingPipeline is already in running state. Use ContinuousBatchingPipeline::add_request or serving mode");
+    OPENVINO_ASSERT(prompts.size() == sampling_params.size());
+
+    // prompts are spread over workers and processed in parallel
+    std::vector<GenerationHandle> generations;
+    for (size_t request_id = 0; request_id < prompts.size(); ++request_id) {
+        generations.push_back(add_request(request_id, prompts[request_id], sampling_params[request_id]));
+    }
+    while (!serving && has_non_finished_requests()) {
+        step();
+    }
+    return Impl::read_results(generations, sampling_params, *m_impl->get_tokenizer());
 }
\ No newline at end of file
@@ -3,7 +3,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "openvino/core/model.hpp"
 #include "openvino/runtime/core.hpp"
+#include "openvino/runtime/intel_gpu/properties.hpp"
 #include "openvino/core/shape.hpp"
 #include "openvino/core/type/element_type.hpp"
 
@@ -14,27 +22,114 @@ class DeviceConfig {
     ov::Shape m_key_cache_shape, m_value_cache_shape;
     ov::Shape::value_type m_num_kv_heads, m_head_size, m_num_decoder_layers;
     size_t m_num_kv_blocks = 0;
+    size_t m_num_swap_blocks = 0;
     size_t m_block_size = 0;
     size_t m_cache_size = 0;
     std::string m_device;
+    // KV cache and model inputs of GPU are allocated via plugin's default context
+    ov::RemoteContext m_remote_context;
+    bool m_has_remote_context = false;
+    // pipeline parallel execution ("HETERO:GPU.0,GPU.1"): decoder layers are split between devices, so KV cache of each
+    // layer is allocated by context of the device computing it
+    std::vector<std::string> m_stage_devices;
+    std::vector<ov::RemoteContext> m_stage_remote_contexts;
+    std::vector<size_t> m_layer_stages;
+
+    size_t _get_block_byte_size(size_t num_decoder_layers) const {
+        return num_decoder_layers * 2 * m_num_kv_heads * m_block_size * m_head_size * m_kv_cache_type.size();
+    }
+
+    size_t _get_block_byte_size() const {
+        return _get_block_byte_size(m_num_decoder_layers);
+    }
+
+    static size_t _get_device_free_memory(ov::Core& core, const std::string& device) {
+        size_t total_memory = core.get_property(device, ov::intel_gpu::device_total_mem_size), used_memory = 0;
+        for (const auto& memory_statistics : core.get_property(device, ov::intel_gpu::memory_statistics)) {
+            if (memory_statistics.first != "usm_host")
+                used_memory += memory_statistics.second;
+        }
+        return total_memory > used_memory ? total_memory - used_memory : 0;
+    }
+
+    // MemAvailable of Linux, i.e. memory which can be allocated without swapping; 0 if it cannot be detected
+    static size_t _get_available_host_memory() {
+#ifdef __linux__
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key, unit;
+        size_t value_kb = 0;
+        while (meminfo >> key >> value_kb >> unit) {
+            if (key == "MemAvailable:")
+                return value_kb * 1024;
+        }
+#endif
+        return 0;
+    }
+
+    void _update_cache_shapes() {
+        m_key_cache_shape = m_value_cache_shape = ov::Shape{m_num_kv_blocks,
+                                                            m_num_kv_heads,
+                                                            m_block_size,
+                                                            m_head_size};
+        if (m_has_remote_context) {
+            // GPU PagedAttention keeps keys transposed within a block
+            m_key_cache_shape = ov::Shape{m_num_kv_blocks,
+                                          m_num_kv_heads,
+                                          m_head_size,
+                                          m_block_size};
+        }
+    }
 
 public:
-    DeviceConfig(ov::Core& core, const SchedulerConfig& scheduling_config, const std::string& device) {
+    // KV cache precision can be set via ov::hint::kv_cache_precision in 'plugin_config', e.g. u8 for quantized KV cache
+    DeviceConfig(ov::Core& core, const SchedulerConfig& scheduling_config, const std::string& device, const ov::AnyMap& plugin_config = {}) {
         m_device = device;
 
         // keep information about blocsk
         m_block_size = scheduling_config.block_size;
+        m_num_swap_blocks = scheduling_config.num_swap_blocks;
 
         if (m_device == "CPU") {
+            auto kv_cache_precision_it = plugin_config.find(ov::hint::kv_cache_precision.name());
+            if (kv_cache_precision_it != plugin_config.end()) {
+                m_kv_cache_type = kv_cache_precision_it->second.as<ov::element::Type>();
+            } else {
+                auto inference_precision = core.get_property(device, ov::hint::inference_precision);
+                m_kv_cache_type = inference_precision == ov::element::bf16 ? ov::element::bf16 : ov::element::f16;
+            }
+            OPENVINO_ASSERT(m_kv_cache_type == ov::element::f32 || m_kv_cache_type == ov::element::f16 ||
+                            m_kv_cache_type == ov::element::bf16 || m_kv_cache_type == ov::element::u8,
+                            "KV cache precision ", m_kv_cache_type, " is not supported by ", m_device,
+                            ", supported precisions are f32, f16, bf16 and u8");
+        } else if (m_device.find("HETERO:") == 0) {
+            for (size_t begin = 7, end = 0; begin <= m_device.size(); begin = end + 1) {
+                end = std::min(m_device.find(',', begin), m_device.size());
+                m_stage_devices.push_back(m_device.substr(begin, end - begin));
+                OPENVINO_ASSERT(m_stage_devices.back().find("GPU") == 0, "Pipeline parallel execution supports only GPU devices, while ",
+                                m_stage_devices.back(), " is set");
+                m_stage_remote_contexts.push_back(core.get_default_context(m_stage_devices.back()));
+            }
+            // all stages must have the same KV cache precision, which is defined by the first one
+            auto inference_precision = core.get_property(m_stage_devices[0], ov::hint::inference_precision);
+            m_kv_cache_type = inference_precision == ov::element::f32 ? ov::element::f32 : ov::element::f16;
+            for (const std::string& stage_device : m_stage_devices) {
+                OPENVINO_ASSERT(core.get_property(stage_device, ov::hint::inference_precision) == inference_precision,
+                                "Devices of pipeline parallel execution must have the same inference precision");
+            }
+            OPENVINO_ASSERT(m_block_size == 16, "GPU PagedAttention supports only block_size 16, while ", m_block_size, " is set");
+            m_remote_context = m_stage_remote_contexts[0];
+            m_has_remote_context = true;
+        } else if (m_device.find("GPU") == 0) {
             auto inference_precision = core.get_property(device, ov::hint::inference_precision);
-            m_kv_cache_type = inference_precision == ov::element::bf16 ? ov::element::bf16 : ov::element::f16;
-        } else if (m_device == "GPU") {
-            OPENVINO_ASSERT("GPU is not currently supported. Please, remove this assert and fill configuration");
+            m_kv_cache_type = inference_precision == ov::element::f32 ? ov::element::f32 : ov::element::f16;
+            OPENVINO_ASSERT(m_block_size == 16, "GPU PagedAttention supports only block_size 16, while ", m_block_size, " is set");
+            m_remote_context = core.get_default_context(device);
+            m_has_remote_context = true;
         } else {
             OPENVINO_THROW(m_device, " is not supported by OpenVINO Continuous Batching");
         }
 
-        OPENVINO_ASSERT(scheduling_config.num_kv_blocks > 0 || scheduling_config.cache_size > 0, "num_kv_blocks or cache_size should be more than zero.");
+        // otherwise KV cache is sized by free memory, see set_num_kv_blocks_by_free_memory
         if (scheduling_config.num_kv_blocks > 0) {
             m_num_kv_blocks = scheduling_config.num_kv_blocks;
         }
@@ -49,16 +144,154 @@ public:
         m_head_size = head_size;
         m_num_decoder_layers = num_decoder_layers;
 
-        if (m_num_kv_blocks == 0) {
-            OPENVINO_ASSERT(m_cache_size > 0, "num_kv_blocks or cache_size should be more than zero.");
+        if (m_device == "CPU" && m_kv_cache_type == ov::element::u8) {
+            // quantized KV cache keeps scale and zero point of each token of each head together with its data:
+            // |scale (f32)|zero point (f32)|quantized data (u8) x head_size|
+            m_head_size += 2 * sizeof(float);
+        }
+
+        if (m_num_kv_blocks == 0 && m_cache_size > 0) {
             size_t size_in_bytes = m_cache_size * 1024 * 1024 * 1024;
-            m_num_kv_blocks = size_in_bytes / (m_num_decoder_layers * 2 * m_num_kv_heads * m_block_size * m_head_size * m_kv_cache_type.size());
+            m_num_kv_blocks = size_in_bytes / _get_block_byte_size();
         }
 
-        m_key_cache_shape = m_value_cache_shape = ov::Shape{m_num_kv_blocks,
-                                                            m_num_kv_heads,
-                                                            m_block_size,
-                                                            m_head_size};
+        _update_cache_shapes();
+    }
+
+    // configures KV cache of a pipeline replica, which shares the compiled model (and so model params) with this config
+    void set_scheduler_config(const SchedulerConfig& scheduling_config) {
+        OPENVINO_ASSERT(scheduling_config.block_size == m_block_size, "Replicas of pipeline must have the same block_size");
+        m_num_swap_blocks = scheduling_config.num_swap_blocks;
+        m_cache_size = scheduling_config.cache_size;
+        m_num_kv_blocks = scheduling_config.num_kv_blocks;
+        if (m_num_kv_blocks == 0 && m_cache_size > 0) {
+            size_t size_in_bytes = m_cache_size * 1024 * 1024 * 1024;
+            m_num_kv_blocks = size_in_bytes / _get_block_byte_size();
+        }
+        _update_cache_shapes();
+    }
+
+    // whether number of KV blocks is not configured and must be set by set_num_kv_blocks_by_free_memory
+    bool requires_num_kv_blocks() const {
+        return m_num_kv_blocks == 0;
+    }
+
+    // sets KV cache size explicitly, e.g. for a temporary KV cache of profiling run
+    void set_num_kv_blocks(size_t num_kv_blocks) {
+        m_num_kv_blocks = num_kv_blocks;
+        _update_cache_shapes();
+    }
+
+    // pipeline parallel execution: devices of decoder layers, i.e. devices of PagedAttention operations in 'devices'
+    // (a result of query_model), which are consumers of KV caches (inputs 2 + 2 * layer and 3 + 2 * layer)
+    static std::vector<std::string> get_layer_devices(std::shared_ptr<const ov::Model> model, const ov::SupportedOpsMap& devices,
+                                                      size_t num_decoder_layers) {
+        std::vector<std::string> layer_devices;
+        const ov::ParameterVector& parameters = model->get_parameters();
+        OPENVINO_ASSERT(parameters.size() >= 2 + num_decoder_layers * 2, "Model does not have KV cache inputs of ", num_decoder_layers, " decoder layers");
+        for (size_t decoder_layer_id = 0; decoder_layer_id < num_decoder_layers; ++decoder_layer_id) {
+            const auto& key_cache_consumers = parameters[2 + decoder_layer_id * 2]->output(0).get_target_inputs();
+            OPENVINO_ASSERT(!key_cache_consumers.empty(), "KV cache of decoder layer ", decoder_layer_id, " is not used");
+            const std::string& consumer_name = key_cache_consumers.begin()->get_node()->get_friendly_name();
+            auto device_it = devices.find(consumer_name);
+            OPENVINO_ASSERT(device_it != devices.end(), consumer_name, " is not assigned to a device");
+            layer_devices.push_back(device_it->second);
+        }
+        return layer_devices;
+    }
+
+    // indices of 'stage_devices' computing decoder layers
+    static std::vector<size_t> get_layer_stages(const std::vector<std::string>& stage_devices, const std::vector<std::string>& layer_devices) {
+        std::vector<size_t> layer_stages;
+        for (const std::string& layer_device : layer_devices) {
+            auto stage_it = std::find(stage_devices.begin(), stage_devices.end(), layer_device);
+            OPENVINO_ASSERT(stage_it != stage_devices.end(), "Decoder layer is assigned to ", layer_device, ", which is not a device of pipeline parallel execution");
+            layer_stages.push_back(stage_it - stage_devices.begin());
+        }
+        return layer_stages;
+    }
+
+    // every device keeps blocks of own layers, so the device with the least memory per block limits their number;
+    // 'layer_block_byte_size' is a size of KV block of a single decoder layer
+    static size_t get_num_kv_blocks_by_stages(const std::vector<size_t>& layer_stages, const std::vector<size_t>& stage_free_memory,
+                                              size_t layer_block_byte_size, float memory_fraction) {
+        size_t num_kv_blocks = std::numeric_limits<size_t>::max();
+        for (size_t stage_id = 0; stage_id < stage_free_memory.size(); ++stage_id) {
+            const size_t num_stage_layers = std::count(layer_stages.begin(), layer_stages.end(), stage_id);
+            if (num_stage_layers > 0)
+                num_kv_blocks = std::min(num_kv_blocks, static_cast<size_t>(stage_free_memory[stage_id] * memory_fraction) / (num_stage_layers * layer_block_byte_size));
+        }
+        return num_kv_blocks == std::numeric_limits<size_t>::max() ? 0 : num_kv_blocks;
+    }
+
+    // pipeline parallel execution: assigns decoder layers to devices, which compute them (see get_stage_devices)
+    void set_layer_devices(const std::vector<std::string>& layer_devices) {
+        OPENVINO_ASSERT(is_pipeline_parallel() && layer_devices.size() == m_num_decoder_layers,
+                        "Each decoder layer must be assigned to a device of pipeline parallel execution");
+        m_layer_stages = get_layer_stages(m_stage_devices, layer_devices);
+    }
+
+    bool is_pipeline_parallel() const {
+        return !m_stage_devices.empty();
+    }
+
+    const std::vector<std::string>& get_stage_devices() const {
+        return m_stage_devices;
+    }
+
+    // bytes of device memory, which can be allocated for KV cache; with pipeline parallel execution it's a sum over devices
+    size_t get_free_memory(ov::Core& core) const {
+        if (!m_has_remote_context)
+            return _get_available_host_memory();
+        if (!is_pipeline_parallel())
+            return _get_device_free_memory(core, m_device);
+        size_t free_memory = 0;
+        for (const std::string& stage_device : m_stage_devices)
+            free_memory += _get_device_free_memory(core, stage_device);
+        return free_memory;
+    }
+
+    // sizes KV cache by device memory left after compilation of models and allocation of intermediate buffers, so it must
+    // be called after compile_model and the profiling run; 'memory_fraction' keeps a part of free memory for fragmentation
+    // and buffers of other requests
+    void set_num_kv_blocks_by_free_memory(ov::Core& core, float memory_fraction) {
+        OPENVINO_ASSERT(memory_fraction > 0.0f && memory_fraction <= 1.0f, "KV cache memory fraction must be in the interval (0, 1]");
+        if (is_pipeline_parallel()) {
+            OPENVINO_ASSERT(m_layer_stages.size() == m_num_decoder_layers, "Decoder layers are not assigned to devices");
+            std::vector<size_t> stage_free_memory;
+            for (const std::string& stage_device : m_stage_devices)
+                stage_free_memory.push_back(_get_device_free_memory(core, stage_device));
+            m_num_kv_blocks = get_num_kv_blocks_by_stages(m_layer_stages, stage_free_memory, _get_block_byte_size(1), memory_fraction);
+            OPENVINO_ASSERT(m_num_kv_blocks > 0, "There is no free memory for KV cache on ", m_device);
+            _update_cache_shapes();
+            return;
+        }
+        size_t free_memory = get_free_memory(core);
+        OPENVINO_ASSERT(free_memory > 0, "Free memory of ", m_device, " cannot be detected, set num_kv_blocks or cache_size");
+        m_num_kv_blocks = static_cast<size_t>(free_memory * memory_fraction) / _get_block_byte_size();
+        OPENVINO_ASSERT(m_num_kv_blocks > 0, "There is no free memory for KV cache on ", m_device);
+        _update_cache_shapes();
+    }
+
+    size_t get_block_byte_size() const {
+        return _get_block_byte_size();
+    }
+
+    bool has_remote_context() const {
+        return m_has_remote_context;
+    }
+
+    ov::RemoteContext get_remote_context() const {
+        OPENVINO_ASSERT(m_has_remote_context, m_device, " does not have remote context");
+        return m_remote_context;
+    }
+
+    // context of the device computing a decoder layer, which allocates KV cache of the layer
+    ov::RemoteContext get_remote_context(size_t decoder_layer_id) const {
+        if (!is_pipeline_parallel())
+            return get_remote_context();
+        OPENVINO_ASSERT(decoder_layer_id < m_layer_stages.size(), "Decoder layer ", decoder_layer_id, " is not assigned to a device");
+        return m_stage_remote_contexts[m_layer_stages[decoder_layer_id]];
     }
 
     std::string get_device() const {
@@ -86,4 +319,8 @@ public:
     size_t get_num_kv_blocks() const {
         return m_num_kv_blocks;
     }
+
+    size_t get_num_swap_blocks() const {
+        return m_num_swap_blocks;
+    }
 };
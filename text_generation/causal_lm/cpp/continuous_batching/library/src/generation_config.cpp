@@ -34,6 +34,22 @@ void GenerationConfig::validate() const {
             OPENVINO_ASSERT(temperature >= 0.0f, "temperature must be a positive value");
         }
     }
+    if (!stop_strings.empty()) {
+        OPENVINO_ASSERT(!is_beam_search(), "stop_strings are not supported with beam search");
+    }
+    if (!regex_constraint.empty()) {
+        OPENVINO_ASSERT(!is_beam_search(), "regex_constraint is not supported with beam search");
+    }
+    if (prompt_lookup_num_tokens > 0) {
+        OPENVINO_ASSERT(!is_beam_search(), "prompt lookup is not supported with beam search");
+        OPENVINO_ASSERT(max_ngram_size > 0, "max_ngram_size must be positive");
+    }
+    if (is_scoring()) {
+        OPENVINO_ASSERT(!is_beam_search() && !is_multinomial(), "scoring request doesn't sample, so it must use greedy parameters");
+        OPENVINO_ASSERT(prompt_lookup_num_tokens == 0 && regex_constraint.empty() && stop_strings.empty(),
+            "scoring request doesn't generate tokens, so generation parameters are not supported");
+    }
+    OPENVINO_ASSERT(!export_kv_cache || !is_scoring(), "KV cache export is not supported for scoring requests");
 }
 
 GenerationConfig GenerationConfig::from_file(const std::string& generation_config_json) {
@@ -14,6 +14,10 @@ GenerationStatus GenerationHandleImpl::get_status() {
     return m_generation_stream->get_status();
 }
 
+RequestMetrics GenerationHandleImpl::get_metrics() {
+    return m_generation_stream->get_metrics();
+}
+
 bool GenerationHandleImpl::can_read() {
     return m_generation_stream->can_read();
 }
@@ -22,25 +26,53 @@ std::unordered_map<uint64_t, GenerationOutput> GenerationHandleImpl::read() {
     return m_generation_stream->read();
 }
 
+bool GenerationHandleImpl::read(GenerationOutputs& outputs) {
+    return m_generation_stream->read(outputs);
+}
+
+bool GenerationHandleImpl::try_read(GenerationOutputs& outputs) {
+    return m_generation_stream->try_read(outputs);
+}
+
+void GenerationHandleImpl::set_completion_callback(std::function<void(GenerationStatus)> callback) {
+    m_generation_stream->set_completion_callback(std::move(callback));
+}
+
+void GenerationHandleImpl::set_output_callback(std::function<void()> callback) {
+    m_generation_stream->set_output_callback(std::move(callback));
+}
+
 void add_partial_result(std::unordered_map<uint64_t, GenerationOutput>& partial_results, std::unordered_map<uint64_t, GenerationOutput>& iteration_results) {
     for (auto& iteration_result: iteration_results) {
         auto partial_result_iter = partial_results.find(iteration_result.first);
         if (partial_result_iter == partial_results.end()) {
             partial_results.emplace(iteration_result.first, iteration_result.second);
         } else {
-            partial_result_iter->second.generated_token_ids.push_back(iteration_result.second.generated_token_ids[0]);
+            std::vector<int64_t>& generated_token_ids = partial_result_iter->second.generated_token_ids;
+            generated_token_ids.insert(generated_token_ids.end(), iteration_result.second.generated_token_ids.begin(),
+                                       iteration_result.second.generated_token_ids.end());
+            std::vector<float>& log_probs = partial_result_iter->second.log_probs;
+            log_probs.insert(log_probs.end(), iteration_result.second.log_probs.begin(), iteration_result.second.log_probs.end());
             partial_result_iter->second.score = iteration_result.second.score;
         }
     }
 }
 
+GenerationOutputs GenerationHandleImpl::read_available() {
+    GenerationOutputs available_results, iteration_results;
+    while (m_generation_stream->try_read(iteration_results)) {
+        add_partial_result(available_results, iteration_results);
+    }
+    return available_results;
+}
+
 std::vector<GenerationOutput> GenerationHandleImpl::read_all() {
     std::vector<GenerationOutput> results;
     std::unordered_map<uint64_t, GenerationOutput> partial_results;
     // We iterate until generation is running or there are tokens we haven't read yet
-    while (get_status() == GenerationStatus::RUNNING || can_read()) {
-        // For unary case there's only one iteration and we get all results in a single read() call
-        std::unordered_map<uint64_t, GenerationOutput> iteration_results = read();
+    // For unary case there's only one iteration and we get all results in a single read() call
+    std::unordered_map<uint64_t, GenerationOutput> iteration_results;
+    while (m_generation_stream->read(iteration_results)) {
         add_partial_result(partial_results, iteration_results);
     }
 
@@ -4,18 +4,44 @@
 #pragma once
 #include <mutex>
 #include <atomic>
+#include <functional>
 #include "continuous_batching_pipeline.hpp"
-#include "synchronized_queue.hpp"
+#include "lock_free_queue.hpp"
 #include "generation_handle.hpp"
 
 
+// Outputs are pushed by the thread running pipeline steps and read by a single reader (generation handle)
 class GenerationStream {
     std::mutex m_mutex;
     GenerationStatus m_status = GenerationStatus::RUNNING;
-    SynchronizedQueue<GenerationOutputs> m_output_queue;
+    SPSCQueue<GenerationOutputs> m_output_queue;
+    // lets blocking readers sleep until outputs are pushed or status is changed
+    QueueWaiter m_output_waiter;
 
     std::vector<uint64_t> last_sequence_ids;
 
+    // invoked once, when generation leaves RUNNING status
+    std::function<void(GenerationStatus)> m_completion_callback;
+
+    // published by pipeline, guarded by m_mutex
+    RequestMetrics m_metrics;
+
+    // invoked on each push and status change, guarded by m_mutex; the flag lets push() skip locking without a callback
+    std::function<void()> m_output_callback;
+    std::atomic<bool> m_has_output_callback{false};
+
+    void _notify_output_callback() {
+        if (!m_has_output_callback.load(std::memory_order_acquire))
+            return;
+        std::function<void()> output_callback;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            output_callback = m_output_callback;
+        }
+        if (output_callback)
+            output_callback();
+    }
+
 public:
     using Ptr = std::shared_ptr<GenerationStream>;
 
@@ -27,12 +53,31 @@ public:
     }
 
     void push(GenerationOutputs outputs) {
-        m_output_queue.push(outputs);
+        m_output_queue.push(std::move(outputs));
+        m_output_waiter.notify();
+        _notify_output_callback();
     }
 
     // Retriving vector of pairs <sequence_id, token_id> as we can generate multiple outputs for a single prompt
     GenerationOutputs read() {
-        return m_output_queue.pull();
+        GenerationOutputs outputs;
+        m_output_waiter.wait([&] { return m_output_queue.try_pull(outputs); });
+        return outputs;
+    }
+
+    // Blocks until outputs are available or generation is not running anymore; returns false if there is nothing else to read
+    bool read(GenerationOutputs& outputs) {
+        bool pulled = false;
+        m_output_waiter.wait([&] {
+            return (pulled = m_output_queue.try_pull(outputs)) || get_status() != GenerationStatus::RUNNING;
+        });
+        // final outputs are pushed before status is changed
+        return pulled || m_output_queue.try_pull(outputs);
+    }
+
+    // Non-blocking read: returns false if there are no outputs ready
+    bool try_read(GenerationOutputs& outputs) {
+        return m_output_queue.try_pull(outputs);
     }
 
     bool can_read() {
@@ -40,8 +85,53 @@ public:
     }
 
     void set_generation_status(GenerationStatus status) {
+        std::function<void(GenerationStatus)> completion_callback;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_status = status;
+            if (status != GenerationStatus::RUNNING)
+                std::swap(completion_callback, m_completion_callback);
+        }
+        // wake up readers waiting for outputs of finished generation
+        m_output_waiter.notify();
+        _notify_output_callback();
+        if (completion_callback)
+            completion_callback(status);
+    }
+
+    // Callback is called from the thread running pipeline steps, or immediately if generation has already completed
+    void set_completion_callback(std::function<void(GenerationStatus)> completion_callback) {
+        GenerationStatus status;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            status = m_status;
+            if (status == GenerationStatus::RUNNING) {
+                m_completion_callback = std::move(completion_callback);
+                return;
+            }
+        }
+        if (completion_callback)
+            completion_callback(status);
+    }
+
+    // Callback is called from the thread running pipeline steps after each push of outputs and status change, so a caller
+    // must check the stream after setting it; a previous callback is destroyed outside of the lock, as it can own objects of the caller
+    void set_output_callback(std::function<void()> output_callback) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::swap(m_output_callback, output_callback);
+            m_has_output_callback.store(static_cast<bool>(m_output_callback), std::memory_order_release);
+        }
+    }
+
+    void set_metrics(const RequestMetrics& metrics) {
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_status = status;
+        m_metrics = metrics;
+    }
+
+    RequestMetrics get_metrics() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_metrics;
     }
 
     GenerationStatus get_status() {
@@ -50,7 +140,14 @@ public:
     }
 
     void drop() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_status = GenerationStatus::DROPPED_BY_HANDLE;
+        // output callback is destroyed outside of the lock
+        std::function<void()> output_callback;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_status = GenerationStatus::DROPPED_BY_HANDLE;
+            m_completion_callback = nullptr;
+            std::swap(m_output_callback, output_callback);
+            m_has_output_callback.store(false, std::memory_order_release);
+        }
     }
 };
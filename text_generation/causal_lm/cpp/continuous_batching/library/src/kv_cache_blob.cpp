@@ -0,0 +1,144 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstring>
+#include <limits>
+
+#include "openvino/core/except.hpp"
+
+#include "kv_cache_blob.hpp"
+
+constexpr uint32_t KVCacheBlob::kMagic;
+constexpr uint32_t KVCacheBlob::kVersion;
+constexpr size_t KVCacheBlob::kAlignment;
+
+namespace {
+
+std::shared_ptr<uint8_t> make_shared_buffer(std::vector<uint8_t> buffer) {
+    auto owner = std::make_shared<std::vector<uint8_t>>(std::move(buffer));
+    // aliasing pointer keeps the whole vector alive
+    return std::shared_ptr<uint8_t>(owner, owner->data());
+}
+
+// sizes of received blobs come from untrusted headers, so their arithmetic must not wrap around
+bool checked_multiply(size_t lhs, size_t rhs, size_t& result) {
+    if (lhs != 0 && rhs > std::numeric_limits<size_t>::max() / lhs)
+        return false;
+    result = lhs * rhs;
+    return true;
+}
+
+bool checked_add(size_t lhs, size_t rhs, size_t& result) {
+    if (rhs > std::numeric_limits<size_t>::max() - lhs)
+        return false;
+    result = lhs + rhs;
+    return true;
+}
+
+// returns false on overflow
+bool get_blocks_offset(size_t num_prompt_tokens, size_t& blocks_offset) {
+    size_t metadata_size = 0;
+    if (!checked_multiply(num_prompt_tokens, sizeof(int64_t), metadata_size) ||
+        !checked_add(metadata_size, sizeof(KVCacheBlob::Header) + KVCacheBlob::kAlignment - 1, metadata_size))
+        return false;
+    blocks_offset = metadata_size / KVCacheBlob::kAlignment * KVCacheBlob::kAlignment;
+    return true;
+}
+
+bool get_blocks_byte_size(size_t num_blocks, size_t num_layers, size_t key_block_byte_size, size_t value_block_byte_size,
+                          size_t& blocks_byte_size) {
+    size_t block_byte_size = 0;
+    return checked_add(key_block_byte_size, value_block_byte_size, block_byte_size) &&
+           checked_multiply(num_layers, block_byte_size, block_byte_size) &&
+           checked_multiply(num_blocks, block_byte_size, blocks_byte_size);
+}
+
+}  // namespace
+
+KVCacheBlob::KVCacheBlob(const std::vector<int64_t>& prompt_ids, size_t num_kv_tokens, const std::string& precision, size_t block_size,
+                         size_t num_layers, size_t key_block_byte_size, size_t value_block_byte_size) {
+    OPENVINO_ASSERT(num_kv_tokens <= prompt_ids.size(), "KV cache cannot be stored for more tokens than prompt has");
+    OPENVINO_ASSERT(block_size > 0 && num_layers > 0, "Block size and number of layers must be positive");
+    OPENVINO_ASSERT(precision.size() < sizeof(Header::precision), "Unexpected KV cache precision ", precision);
+
+    Header header = {};
+    header.magic = kMagic;
+    header.version = kVersion;
+    std::strncpy(header.precision, precision.c_str(), sizeof(header.precision) - 1);
+    header.block_size = block_size;
+    header.num_layers = num_layers;
+    header.key_block_byte_size = key_block_byte_size;
+    header.value_block_byte_size = value_block_byte_size;
+    header.num_prompt_tokens = prompt_ids.size();
+    header.num_kv_tokens = num_kv_tokens;
+    header.num_blocks = (num_kv_tokens + block_size - 1) / block_size;
+
+    size_t blocks_offset = 0, blocks_byte_size = 0;
+    OPENVINO_ASSERT(get_blocks_offset(prompt_ids.size(), blocks_offset) &&
+                    get_blocks_byte_size(header.num_blocks, num_layers, key_block_byte_size, value_block_byte_size, blocks_byte_size) &&
+                    checked_add(blocks_offset, blocks_byte_size, m_size),
+                    "KV cache blob is too large");
+    m_data = make_shared_buffer(std::vector<uint8_t>(m_size));
+    std::memcpy(m_data.get(), &header, sizeof(header));
+    std::memcpy(m_data.get() + sizeof(header), prompt_ids.data(), prompt_ids.size() * sizeof(int64_t));
+}
+
+KVCacheBlob::KVCacheBlob(std::vector<uint8_t> buffer) : m_size(buffer.size()) {
+    m_data = make_shared_buffer(std::move(buffer));
+    _validate();
+}
+
+KVCacheBlob::KVCacheBlob(std::shared_ptr<uint8_t> data, size_t size) : m_data(std::move(data)), m_size(size) {
+    OPENVINO_ASSERT(m_data || m_size == 0, "KV cache blob memory is empty");
+    _validate();
+}
+
+void KVCacheBlob::_validate() const {
+    OPENVINO_ASSERT(m_size >= sizeof(Header), "KV cache blob is too small to contain a header");
+    const Header& header = get_header();
+    OPENVINO_ASSERT(header.magic == kMagic, "Buffer is not a KV cache blob");
+    OPENVINO_ASSERT(header.version == kVersion, "KV cache blob version ", header.version, " is not supported");
+    OPENVINO_ASSERT(header.precision[sizeof(header.precision) - 1] == '\0', "KV cache blob has malformed precision");
+    OPENVINO_ASSERT(header.block_size > 0 && header.num_layers > 0 && header.num_kv_tokens <= header.num_prompt_tokens &&
+                    header.num_blocks == (header.num_kv_tokens + header.block_size - 1) / header.block_size,
+                    "KV cache blob has inconsistent header");
+    size_t blocks_offset = 0, blocks_byte_size = 0, expected_size = 0;
+    OPENVINO_ASSERT(header.num_prompt_tokens <= (m_size - sizeof(Header)) / sizeof(int64_t) &&
+                    get_blocks_offset(header.num_prompt_tokens, blocks_offset) &&
+                    get_blocks_byte_size(header.num_blocks, header.num_layers, header.key_block_byte_size, header.value_block_byte_size,
+                                         blocks_byte_size) &&
+                    checked_add(blocks_offset, blocks_byte_size, expected_size) && m_size == expected_size,
+                    "KV cache blob size ", m_size, " doesn't match its header");
+}
+
+const KVCacheBlob::Header& KVCacheBlob::get_header() const {
+    return *reinterpret_cast<const Header*>(m_data.get());
+}
+
+std::vector<int64_t> KVCacheBlob::get_prompt_ids() const {
+    std::vector<int64_t> prompt_ids(get_header().num_prompt_tokens);
+    std::memcpy(prompt_ids.data(), m_data.get() + sizeof(Header), prompt_ids.size() * sizeof(int64_t));
+    return prompt_ids;
+}
+
+size_t KVCacheBlob::get_block_byte_size() const {
+    const Header& header = get_header();
+    return header.num_layers * (header.key_block_byte_size + header.value_block_byte_size);
+}
+
+uint8_t* KVCacheBlob::get_block_data(size_t block_idx) {
+    OPENVINO_ASSERT(block_idx < get_num_blocks());
+    return m_data.get() + _get_blocks_offset() + block_idx * get_block_byte_size();
+}
+
+const uint8_t* KVCacheBlob::get_block_data(size_t block_idx) const {
+    OPENVINO_ASSERT(block_idx < get_num_blocks());
+    return m_data.get() + _get_blocks_offset() + block_idx * get_block_byte_size();
+}
+
+size_t KVCacheBlob::_get_blocks_offset() const {
+    // doesn't overflow, since blob is validated
+    size_t blocks_offset = 0;
+    get_blocks_offset(get_header().num_prompt_tokens, blocks_offset);
+    return blocks_offset;
+}
@@ -0,0 +1,175 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+// Unbounded multi-producer single-consumer queue: producers link nodes with a single atomic exchange,
+// the consumer unlinks them without synchronization with other consumers
+template <typename T>
+class MPSCQueue {
+    struct Node {
+        T m_value;
+        std::atomic<Node*> m_next{nullptr};
+    };
+
+    // the most recently pushed node, shared between producers
+    std::atomic<Node*> m_head;
+    // already consumed node, whose successor is the next node to pull; owned by consumer
+    Node* m_tail;
+    std::atomic<size_t> m_size{0};
+
+public:
+    MPSCQueue() {
+        m_tail = new Node();
+        m_head.store(m_tail);
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    ~MPSCQueue() {
+        while (m_tail) {
+            Node* next = m_tail->m_next.load(std::memory_order_relaxed);
+            delete m_tail;
+            m_tail = next;
+        }
+    }
+
+    // can be called from any thread
+    void push(T value) {
+        Node* node = new Node();
+        node->m_value = std::move(value);
+        // size is increased before publishing, so it never underflows on pull
+        m_size.fetch_add(1);
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->m_next.store(node, std::memory_order_release);
+    }
+
+    // must be called from consumer thread only; returns false if the queue is empty
+    bool try_pull(T& value) {
+        Node* next = m_tail->m_next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return false;
+        value = std::move(next->m_value);
+        delete m_tail;
+        m_tail = next;
+        m_size.fetch_sub(1);
+        return true;
+    }
+
+    // can be called from any thread
+    bool empty() const {
+        return m_size.load() == 0;
+    }
+};
+
+// Unbounded single-producer single-consumer queue: items are stored in fixed size ring segments,
+// so allocation happens once per segment and the producer never waits for a slow consumer
+template <typename T, size_t SEGMENT_SIZE = 32>
+class SPSCQueue {
+    struct Segment {
+        std::array<T, SEGMENT_SIZE> m_items;
+        // number of items published by producer
+        std::atomic<size_t> m_num_written{0};
+        std::atomic<Segment*> m_next{nullptr};
+    };
+
+    // owned by producer
+    Segment* m_write_segment;
+    size_t m_write_index = 0;
+    // owned by consumer
+    Segment* m_read_segment;
+    size_t m_read_index = 0;
+
+    std::atomic<size_t> m_size{0};
+
+public:
+    SPSCQueue() {
+        m_write_segment = m_read_segment = new Segment();
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    ~SPSCQueue() {
+        while (m_read_segment) {
+            Segment* next = m_read_segment->m_next.load(std::memory_order_relaxed);
+            delete m_read_segment;
+            m_read_segment = next;
+        }
+    }
+
+    // must be called from producer thread only
+    void push(T value) {
+        if (m_write_index == SEGMENT_SIZE) {
+            Segment* segment = new Segment();
+            m_write_segment->m_next.store(segment, std::memory_order_release);
+            m_write_segment = segment;
+            m_write_index = 0;
+        }
+        m_write_segment->m_items[m_write_index] = std::move(value);
+        m_size.fetch_add(1);
+        m_write_segment->m_num_written.store(++m_write_index, std::memory_order_release);
+    }
+
+    // must be called from consumer thread only; returns false if the queue is empty
+    bool try_pull(T& value) {
+        if (m_read_index == SEGMENT_SIZE) {
+            Segment* next = m_read_segment->m_next.load(std::memory_order_acquire);
+            if (next == nullptr)
+                return false;
+            // producer has already moved to the next segment
+            delete m_read_segment;
+            m_read_segment = next;
+            m_read_index = 0;
+        }
+        if (m_read_index == m_read_segment->m_num_written.load(std::memory_order_acquire))
+            return false;
+        value = std::move(m_read_segment->m_items[m_read_index++]);
+        m_size.fetch_sub(1);
+        return true;
+    }
+
+    // can be called from any thread
+    bool empty() const {
+        return m_size.load() == 0;
+    }
+};
+
+// Lets a consumer of lock-free queue sleep until it has something to do;
+// notify() takes the mutex only if there is a sleeping consumer
+class QueueWaiter {
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::atomic<size_t> m_num_waiters{0};
+
+public:
+    // blocks until 'is_ready' returns true; 'is_ready' must observe state changed by notifier before notify() call
+    template <typename Predicate>
+    void wait(Predicate is_ready) {
+        if (is_ready())
+            return;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_num_waiters.fetch_add(1);
+        // pairs with the fence in notify(): either notifier sees a waiter, or waiter sees notifier's changes
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_cv.wait(lock, is_ready);
+        m_num_waiters.fetch_sub(1);
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_num_waiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_all();
+        }
+    }
+};
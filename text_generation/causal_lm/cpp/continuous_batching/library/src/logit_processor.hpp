@@ -5,8 +5,12 @@
 
 #include <algorithm>
 #include <cmath>
+#include <map>
+#include <memory>
+#include <set>
 
 #include "generation_config.hpp"
+#include "token_constraint.hpp"
 
 struct Token {
     float m_log_prob = 0.;
@@ -21,7 +25,14 @@ using TokenIds = std::vector<int64_t>;
 
 class ILogitTransformer {
 public:
-    virtual std::vector<Token> apply(const std::vector<Token>& input_logits) = 0;
+    // transforms logits in place; transformers can reorder and shrink the vector
+    virtual void apply_inplace(std::vector<Token>& logits) = 0;
+
+    std::vector<Token> apply(const std::vector<Token>& input_logits) {
+        std::vector<Token> output(input_logits);
+        apply_inplace(output);
+        return output;
+    }
 
     virtual bool is_applicable(size_t generated_tokens_cnt = 0) {
         return true;
@@ -32,18 +43,24 @@ class TopPFilter : public ILogitTransformer {
 public:
     TopPFilter(double top_p) : m_top_p(top_p) {}
 
-    std::vector<Token> apply(const std::vector<Token>& input_probs) override {
-        std::vector<Token> tmp(input_probs);
-        std::sort(tmp.begin(), tmp.end(), [](const Token& lhs, const Token& rhs) {return lhs.m_log_prob > rhs.m_log_prob; });
+    void apply_inplace(std::vector<Token>& probs) override {
+        auto greater = [](const Token& lhs, const Token& rhs) {return lhs.m_log_prob > rhs.m_log_prob; };
+        // nucleus is typically much smaller than vocabulary, so sort only top candidates in growing chunks
+        // instead of sorting the whole vector
         float probability_sum = 0.0f;
-        size_t nucleus_size = 0;
-        for (const auto& probability : tmp) {
-            probability_sum += probability.m_log_prob;
+        size_t nucleus_size = 0, sorted_size = 0, chunk_size = 64;
+        while (nucleus_size < probs.size()) {
+            if (nucleus_size == sorted_size) {
+                size_t new_sorted_size = std::min(probs.size(), sorted_size + chunk_size);
+                std::partial_sort(probs.begin() + sorted_size, probs.begin() + new_sorted_size, probs.end(), greater);
+                sorted_size = new_sorted_size;
+                chunk_size *= 2;
+            }
+            probability_sum += probs[nucleus_size].m_log_prob;
             nucleus_size += 1;
             if (probability_sum > m_top_p) break;
         }
-        tmp.resize(nucleus_size);
-        return tmp;
+        probs.resize(nucleus_size);
     }
 
 protected:
@@ -54,12 +71,11 @@ class TopKFilter : public ILogitTransformer {
 public:
     TopKFilter(size_t top_k) : m_top_k(top_k) {}
 
-    std::vector<Token> apply(const std::vector<Token>& input_probs) override {
-        std::vector<Token> tmp(input_probs);
-        std::sort(tmp.begin(), tmp.end(), [](const Token& lhs, const Token& rhs) {return lhs.m_log_prob > rhs.m_log_prob; });
-        size_t top_k = input_probs.size() >= m_top_k ? m_top_k : input_probs.size();
-        tmp.resize(top_k);
-        return tmp;
+    void apply_inplace(std::vector<Token>& probs) override {
+        size_t top_k = probs.size() >= m_top_k ? m_top_k : probs.size();
+        // O(N log K) partial selection instead of sorting the whole vocabulary
+        std::partial_sort(probs.begin(), probs.begin() + top_k, probs.end(), [](const Token& lhs, const Token& rhs) {return lhs.m_log_prob > rhs.m_log_prob; });
+        probs.resize(top_k);
     }
 
 protected:
@@ -70,20 +86,21 @@ class TemperatureLogitTransform : public ILogitTransformer {
 public:
     TemperatureLogitTransform(double temperature) : m_temperature(temperature) {};
 
-    std::vector<Token> apply(const std::vector<Token>& input_logits) override {
-        std::vector<Token> output(input_logits.begin(), input_logits.end());
-        std::sort(output.begin(), output.end(), [](const Token& lhs, const Token& rhs) {return lhs.m_log_prob > rhs.m_log_prob; });
-        float max_logit = output[0].m_log_prob;
-
-        std::for_each(output.begin(), output.end(), [max_logit, this](Token& val) {val.m_log_prob = expf((val.m_log_prob - max_logit) / this->m_temperature);});
+    void apply_inplace(std::vector<Token>& logits) override {
+        // softmax does not require sorted input, only the max value for numerical stability
+        float max_logit = std::max_element(logits.begin(), logits.end(), [](const Token& lhs, const Token& rhs) {return lhs.m_log_prob < rhs.m_log_prob; })->m_log_prob;
+        const float inv_temperature = 1.0f / m_temperature;
 
         float norm_sum = 0.0;
-        for (const auto& val : output) {
+        for (auto& val : logits) {
+            val.m_log_prob = expf((val.m_log_prob - max_logit) * inv_temperature);
             norm_sum += val.m_log_prob;
         }
 
-        std::for_each(output.begin(), output.end(), [norm_sum](Token& val) {val.m_log_prob /= norm_sum;});
-        return output;
+        const float inv_norm_sum = 1.0f / norm_sum;
+        for (auto& val : logits) {
+            val.m_log_prob *= inv_norm_sum;
+        }
     }
 
 protected:
@@ -124,31 +141,31 @@ public:
         m_penalty = repetition_penalty;
     };
 
-    std::vector<Token> apply(const std::vector<Token>& input_logits) override {
-        std::vector<Token> output(input_logits.begin(), input_logits.end());
-        size_t vocab_size = input_logits.size();
+    using ILogitTransformer::apply;
+
+    void apply_inplace(std::vector<Token>& logits) override {
+        size_t vocab_size = logits.size();
         for (const auto& prompt_id : *m_unique_prompt_token_ids) {
             OPENVINO_ASSERT((prompt_id >= 0) && (prompt_id < vocab_size), "input_ids token out of bounds");
-            OPENVINO_ASSERT(input_logits[prompt_id].m_index == prompt_id, "input_logits must have original index order");
-            auto logit_value = output[prompt_id].m_log_prob;
+            OPENVINO_ASSERT(logits[prompt_id].m_index == prompt_id, "input_logits must have original index order");
+            auto logit_value = logits[prompt_id].m_log_prob;
             if (logit_value >= 0) {
-                output[prompt_id].m_log_prob /= m_penalty;
+                logits[prompt_id].m_log_prob /= m_penalty;
             } else {
-                output[prompt_id].m_log_prob *= m_penalty;
+                logits[prompt_id].m_log_prob *= m_penalty;
             };
         }
         for (const auto& input_id_pair : *m_unique_generated_token_ids) {
             const auto& input_id = input_id_pair.first;
             OPENVINO_ASSERT((input_id >= 0) && (input_id < vocab_size), "input_ids token out of bounds");
-            OPENVINO_ASSERT(input_logits[input_id].m_index == input_id, "input_logits must have original index order");
-            auto logit_value = output[input_id].m_log_prob;
+            OPENVINO_ASSERT(logits[input_id].m_index == input_id, "input_logits must have original index order");
+            auto logit_value = logits[input_id].m_log_prob;
             if (logit_value >= 0) {
-                output[input_id].m_log_prob /= m_penalty;
+                logits[input_id].m_log_prob /= m_penalty;
             } else {
-                output[input_id].m_log_prob *= m_penalty;
+                logits[input_id].m_log_prob *= m_penalty;
             };
         }
-        return output;
     }
 
     std::vector<Token> apply(const std::vector<Token>& input_logits, const TokenIds& input_ids) {
@@ -174,14 +191,17 @@ public:
     EOSPenaltyTransform(size_t eos_token_id, size_t min_generated_tokens) : 
         m_eos_token_id(eos_token_id), m_applicable_tensor_len(min_generated_tokens) {}
 
-    std::vector<Token> apply(const std::vector<Token>& input_logits) {
-        std::vector<Token> output(input_logits.begin(), input_logits.end());
-        for (auto& token_id : output) {
+    void apply_inplace(std::vector<Token>& logits) override {
+        // logits are typically in original index order, so EOS can be found without a full scan
+        if (m_eos_token_id < logits.size() && logits[m_eos_token_id].m_index == m_eos_token_id) {
+            logits[m_eos_token_id].m_log_prob = 0.f;
+            return;
+        }
+        for (auto& token_id : logits) {
             if (token_id.m_index == m_eos_token_id) {
                 token_id.m_log_prob = 0.f;
             }
         }
-        return output;
     }
     
 
@@ -200,21 +220,21 @@ public:
         m_penalty = value;
     };
 
-    std::vector<Token> apply(const std::vector<Token>& input_logits) override {
-        std::vector<Token> output(input_logits.begin(), input_logits.end());
-        size_t vocab_size = input_logits.size();
+    using ILogitTransformer::apply;
+
+    void apply_inplace(std::vector<Token>& logits) override {
+        size_t vocab_size = logits.size();
         for (const auto& input_id_pair : *m_unique_generated_token_ids) {
             const auto& input_id = input_id_pair.first;
             OPENVINO_ASSERT((input_id >= 0) && (input_id < vocab_size), "input_ids token out of bounds");
-            OPENVINO_ASSERT(input_logits[input_id].m_index == input_id, "input_logits must have original index order");
-            auto logit_value = output[input_id].m_log_prob;
+            OPENVINO_ASSERT(logits[input_id].m_index == input_id, "input_logits must have original index order");
+            auto logit_value = logits[input_id].m_log_prob;
             if (logit_value >= 0) {
-                output[input_id].m_log_prob -= m_penalty * input_id_pair.second;
+                logits[input_id].m_log_prob -= m_penalty * input_id_pair.second;
             } else {
-                output[input_id].m_log_prob += m_penalty * input_id_pair.second;
+                logits[input_id].m_log_prob += m_penalty * input_id_pair.second;
             };
         }
-        return output;
     }
 
     std::vector<Token> apply(const std::vector<Token>& input_logits, const TokenIds& input_ids) {
@@ -229,21 +249,21 @@ public:
         m_penalty = value;
     };
 
-    std::vector<Token> apply(const std::vector<Token>& input_logits) override {
-        std::vector<Token> output(input_logits.begin(), input_logits.end());
-        size_t vocab_size = input_logits.size();
+    using ILogitTransformer::apply;
+
+    void apply_inplace(std::vector<Token>& logits) override {
+        size_t vocab_size = logits.size();
         for (const auto& input_id_pair : *m_unique_generated_token_ids) {
             const auto& input_id = input_id_pair.first;
             OPENVINO_ASSERT((input_id >= 0) && (input_id < vocab_size), "input_ids token out of bounds");
-            OPENVINO_ASSERT(input_logits[input_id].m_index == input_id, "input_logits must have original index order");
-            auto logit_value = output[input_id].m_log_prob;
+            OPENVINO_ASSERT(logits[input_id].m_index == input_id, "input_logits must have original index order");
+            auto logit_value = logits[input_id].m_log_prob;
             if (logit_value >= 0) {
-                output[input_id].m_log_prob -= m_penalty;
+                logits[input_id].m_log_prob -= m_penalty;
             } else {
-                output[input_id].m_log_prob += m_penalty;
+                logits[input_id].m_log_prob += m_penalty;
             };
         }
-        return output;
     }
 
     std::vector<Token> apply(const std::vector<Token>& input_logits, const TokenIds& input_ids) {
@@ -253,16 +273,69 @@ public:
 };
 
 
+// Keeps only tokens allowed by constraint in current state, EOS is allowed once the whole pattern is matched.
+// Logits must be in original index order, so it's applied after penalties; the vector is shrunk to allowed tokens
+class TokenConstraintTransform : public ILogitTransformer {
+public:
+    TokenConstraintTransform(const TokenConstraint::Ptr& token_constraint, int64_t eos_token_id) :
+        m_token_constraint(token_constraint),
+        m_eos_token_id(eos_token_id),
+        m_state(token_constraint->get_initial_state()) {}
+
+    void apply_inplace(std::vector<Token>& logits) override {
+        const std::vector<uint64_t>& allowed_tokens = m_token_constraint->get_allowed_tokens(m_state);
+        const bool has_eos = m_eos_token_id >= 0 && m_eos_token_id < static_cast<int64_t>(logits.size());
+        const Token eos_token = has_eos ? logits[m_eos_token_id] : Token();
+
+        // allowed tokens are visited in ascending order, so compaction doesn't overwrite tokens which are not visited yet
+        size_t num_allowed_tokens = 0;
+        for (size_t word_id = 0; word_id < allowed_tokens.size() && word_id * 64 < logits.size(); ++word_id) {
+            for (uint64_t word = allowed_tokens[word_id]; word != 0; word &= word - 1) {
+                const size_t token_id = word_id * 64 + TokenConstraint::lowest_bit_index(word);
+                if (token_id >= logits.size())
+                    break;
+                OPENVINO_ASSERT(logits[token_id].m_index == token_id, "input_logits must have original index order");
+                if (static_cast<int64_t>(token_id) != m_eos_token_id)
+                    logits[num_allowed_tokens++] = logits[token_id];
+            }
+        }
+        logits.resize(num_allowed_tokens);
+
+        // EOS also finishes generation, which cannot be continued by any token
+        if (has_eos && (num_allowed_tokens == 0 || m_token_constraint->is_accepting(m_state)))
+            logits.push_back(eos_token);
+    }
+
+    void register_new_generated_token(int64_t token_id) {
+        m_state = m_token_constraint->next_state(m_state, token_id);
+    }
+
+    const TokenConstraint::Ptr& get_token_constraint() const {
+        return m_token_constraint;
+    }
+
+    int get_state() const {
+        return m_state;
+    }
+
+    void set_state(int state) {
+        m_state = state;
+    }
+
+protected:
+    TokenConstraint::Ptr m_token_constraint;
+    int64_t m_eos_token_id;
+    int m_state;
+};
+
 class ProbabilityNormalizeTransform : public ILogitTransformer {
 public:
     ProbabilityNormalizeTransform() = default;
 
-    std::vector<Token> apply(const std::vector<Token>& input_probs) override {
-        std::vector<Token> output(input_probs);
+    void apply_inplace(std::vector<Token>& probs) override {
         float norm_sum = 0.0;
-        for (const auto& val : output) norm_sum += val.m_log_prob;
-        for (auto& val : output) val.m_log_prob /= norm_sum;
-        return output;
+        for (const auto& val : probs) norm_sum += val.m_log_prob;
+        for (auto& val : probs) val.m_log_prob /= norm_sum;
     }
 };
 
@@ -270,19 +343,21 @@ public:
 
 class LogitProcessor {
 protected:
+    GenerationConfig m_sampling_params;
     std::vector<std::shared_ptr<LogitTransformers::ILogitTransformer>> m_logit_transformers;
     
     std::shared_ptr<std::map<int64_t, size_t>> m_unique_generated_token_ids = std::shared_ptr<std::map<int64_t, size_t>>(new std::map<int64_t, size_t>);
-    std::shared_ptr<std::set<int64_t>> m_unique_prompt_token_ids = std::shared_ptr<std::set<int64_t>>(new std::set<int64_t>);
+    // prompt is the same for all forked processors, so it's shared between them
+    std::shared_ptr<std::set<int64_t>> m_unique_prompt_token_ids;
     size_t m_generated_tokens = 0;
+    // constraint of generated text, which state is advanced by generated tokens
+    std::shared_ptr<LogitTransformers::TokenConstraintTransform> m_token_constraint_transform;
 
-public:
     LogitProcessor(const GenerationConfig& sampling_params,
-                   const LogitTransformers::TokenIds& input_ids) {
-        for (const auto& input_id : input_ids) {
-            m_unique_prompt_token_ids->insert(input_id);
-        }
-
+                   const std::shared_ptr<std::set<int64_t>>& unique_prompt_token_ids,
+                   const TokenConstraint::Ptr& token_constraint) :
+        m_sampling_params(sampling_params),
+        m_unique_prompt_token_ids(unique_prompt_token_ids) {
         if (sampling_params.min_new_tokens > 0) {
             m_logit_transformers.emplace_back(
                 new LogitTransformers::EOSPenaltyTransform(sampling_params.eos_token_id, sampling_params.min_new_tokens)
@@ -310,6 +385,10 @@ public:
                 transformer->set_unique_generated_token_ids(m_unique_generated_token_ids);
                 m_logit_transformers.push_back(transformer);
             }
+            if (token_constraint) {
+                m_token_constraint_transform = std::make_shared<LogitTransformers::TokenConstraintTransform>(token_constraint, sampling_params.eos_token_id);
+                m_logit_transformers.push_back(m_token_constraint_transform);
+            }
 
             if (sampling_params.is_multinomial()) {
                 m_logit_transformers.emplace_back(new LogitTransformers::TemperatureLogitTransform(sampling_params.temperature));
@@ -324,14 +403,42 @@ public:
         }
     }
 
-    std::vector<Token> apply(const std::vector<Token>& logits) {
-        std::vector<Token> outputs(logits.begin(), logits.end());
+public:
+    using Ptr = std::shared_ptr<LogitProcessor>;
+
+    LogitProcessor(const GenerationConfig& sampling_params,
+                   const LogitTransformers::TokenIds& input_ids,
+                   const TokenConstraint::Ptr& token_constraint = nullptr) :
+        LogitProcessor(sampling_params, std::make_shared<std::set<int64_t>>(input_ids.begin(), input_ids.end()), token_constraint) {
+    }
+
+    // creates a processor with the same state, which is then updated independently (e.g. for forked sequences)
+    Ptr fork() const {
+        Ptr forked(new LogitProcessor(m_sampling_params, m_unique_prompt_token_ids,
+            m_token_constraint_transform ? m_token_constraint_transform->get_token_constraint() : nullptr));
+        *forked->m_unique_generated_token_ids = *m_unique_generated_token_ids;
+        forked->m_generated_tokens = m_generated_tokens;
+        if (m_token_constraint_transform)
+            forked->m_token_constraint_transform->set_state(m_token_constraint_transform->get_state());
+        return forked;
+    }
+
+    void apply(std::vector<Token>& logits) {
         for (const auto& transformer : m_logit_transformers) {
             if (transformer->is_applicable(m_generated_tokens)) {
-                outputs = transformer->apply(outputs);
+                transformer->apply_inplace(logits);
             }
         }
-        return outputs;
+    }
+
+    // whether logits are left intact, e.g. greedy sampling without penalties
+    bool is_identity() {
+        for (const auto& transformer : m_logit_transformers) {
+            if (transformer->is_applicable(m_generated_tokens)) {
+                return false;
+            }
+        }
+        return true;
     }
 
     void increment_gen_tokens() {
@@ -339,6 +446,8 @@ public:
     }
 
     void register_new_generated_token(int64_t new_token_id) {
+        if (m_token_constraint_transform)
+            m_token_constraint_transform->register_new_generated_token(new_token_id);
         auto it = m_unique_generated_token_ids->find(new_token_id);
         if (it == m_unique_generated_token_ids->end()) {
             m_unique_generated_token_ids->insert({new_token_id, 1});
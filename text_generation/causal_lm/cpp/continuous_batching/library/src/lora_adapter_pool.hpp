@@ -0,0 +1,154 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "openvino/core/except.hpp"
+#include "openvino/runtime/infer_request.hpp"
+
+#include "lora_adapter.hpp"
+
+// linear layer of base model, which output is corrected by low-rank deltas of LoRA adapters
+struct LoRALayer {
+    std::string m_name;
+    size_t m_in_features;
+    size_t m_out_features;
+};
+
+// Weights of all loaded LoRA adapters, which are passed to the model once and shared by all requests.
+// Each adapter occupies a slot of 'max_rank' channels in stacked matrices of every layer:
+// A [max_num_adapters * max_rank, in_features] and B [out_features, max_num_adapters * max_rank], while
+// ModelRunner passes per-token masks selecting channels of request's adapter (see apply_lora_transformations)
+class LoRAAdapterPool {
+    std::vector<LoRALayer> m_layers;
+    size_t m_max_num_adapters;
+    size_t m_max_rank;
+    std::vector<ov::Tensor> m_a_weights, m_b_weights;
+    // adapter id => slot
+    std::map<size_t, size_t> m_slots;
+
+    size_t _find_layer(const std::string& adapter_layer_name) const {
+        std::string name = adapter_layer_name;
+        std::replace(name.begin(), name.end(), '.', '_');
+        for (size_t layer_id = 0; layer_id < m_layers.size(); ++layer_id) {
+            std::string layer_name = m_layers[layer_id].m_name;
+            std::replace(layer_name.begin(), layer_name.end(), '.', '_');
+            if (layer_name.find(name) != std::string::npos)
+                return layer_id;
+        }
+        OPENVINO_THROW("Cannot find linear layer '", adapter_layer_name, "' of LoRA adapter in the model");
+    }
+
+    size_t _find_free_slot() const {
+        for (size_t slot = 0; slot < m_max_num_adapters; ++slot) {
+            bool is_used = std::any_of(m_slots.begin(), m_slots.end(), [slot] (const std::pair<const size_t, size_t>& adapter_slot) {
+                return adapter_slot.second == slot;
+            });
+            if (!is_used)
+                return slot;
+        }
+        OPENVINO_THROW("Max number of LoRA adapters (", m_max_num_adapters, ") is already loaded");
+    }
+
+    void _clear_slot(size_t slot) {
+        const size_t num_channels = get_num_channels();
+        for (size_t layer_id = 0; layer_id < m_layers.size(); ++layer_id) {
+            float* a_data = m_a_weights[layer_id].data<float>() + slot * m_max_rank * m_layers[layer_id].m_in_features;
+            std::fill_n(a_data, m_max_rank * m_layers[layer_id].m_in_features, 0.0f);
+            float* b_data = m_b_weights[layer_id].data<float>();
+            for (size_t out_id = 0; out_id < m_layers[layer_id].m_out_features; ++out_id)
+                std::fill_n(b_data + out_id * num_channels + slot * m_max_rank, m_max_rank, 0.0f);
+        }
+    }
+
+public:
+    LoRAAdapterPool(const std::vector<LoRALayer>& layers, size_t max_num_adapters, size_t max_rank) :
+        m_layers(layers),
+        m_max_num_adapters(max_num_adapters),
+        m_max_rank(max_rank) {
+        OPENVINO_ASSERT(max_num_adapters > 0 && max_rank > 0, "Max number of LoRA adapters and max LoRA rank must be positive");
+        for (const LoRALayer& layer : m_layers) {
+            m_a_weights.emplace_back(ov::element::f32, ov::Shape{get_num_channels(), layer.m_in_features});
+            m_b_weights.emplace_back(ov::element::f32, ov::Shape{layer.m_out_features, get_num_channels()});
+            std::memset(m_a_weights.back().data(), 0, m_a_weights.back().get_byte_size());
+            std::memset(m_b_weights.back().data(), 0, m_b_weights.back().get_byte_size());
+        }
+    }
+
+    // number of channels in stacked LoRA matrices and in per-token masks
+    size_t get_num_channels() const {
+        return m_max_num_adapters * m_max_rank;
+    }
+
+    size_t get_max_rank() const {
+        return m_max_rank;
+    }
+
+    const ov::Tensor& get_a_weights(size_t layer_id) const {
+        return m_a_weights.at(layer_id);
+    }
+
+    const ov::Tensor& get_b_weights(size_t layer_id) const {
+        return m_b_weights.at(layer_id);
+    }
+
+    bool has_adapter(size_t adapter_id) const {
+        return m_slots.count(adapter_id) > 0;
+    }
+
+    size_t get_slot(size_t adapter_id) const {
+        auto slot_it = m_slots.find(adapter_id);
+        OPENVINO_ASSERT(slot_it != m_slots.end(), "LoRA adapter ", adapter_id, " is not loaded");
+        return slot_it->second;
+    }
+
+    // 'alpha' scales low-rank delta (it corresponds to lora_alpha / rank in terms of PEFT)
+    void add_adapter(size_t adapter_id, const LoRAAdapter& adapter, float alpha) {
+        OPENVINO_ASSERT(adapter_id != 0, "LoRA adapter id 0 is reserved for base model");
+        OPENVINO_ASSERT(!has_adapter(adapter_id), "LoRA adapter ", adapter_id, " is already loaded");
+        const size_t slot = _find_free_slot(), num_channels = get_num_channels();
+        // slot can contain weights of previously removed adapter
+        _clear_slot(slot);
+
+        for (const auto& layer_weights : adapter) {
+            const size_t layer_id = _find_layer(layer_weights.first);
+            const LoRALayer& layer = m_layers[layer_id];
+            const ov::Tensor& a = layer_weights.second.first, & b = layer_weights.second.second;
+            OPENVINO_ASSERT(a.get_element_type() == ov::element::f32 && b.get_element_type() == ov::element::f32,
+                "LoRA weights of layer '", layer_weights.first, "' must be f32");
+            OPENVINO_ASSERT(a.get_shape().size() == 2 && b.get_shape().size() == 2, "LoRA weights of layer '", layer_weights.first, "' must be matrices");
+            const size_t rank = a.get_shape()[0];
+            OPENVINO_ASSERT(rank <= m_max_rank, "LoRA rank (", rank, ") is greater than max LoRA rank (", m_max_rank, ")");
+            OPENVINO_ASSERT(a.get_shape()[1] == layer.m_in_features && b.get_shape() == ov::Shape({layer.m_out_features, rank}),
+                "Shapes of LoRA weights ", a.get_shape(), " and ", b.get_shape(), " do not match layer '", layer.m_name, "'");
+
+            std::memcpy(m_a_weights[layer_id].data<float>() + slot * m_max_rank * layer.m_in_features, a.data<float>(), a.get_byte_size());
+            float* b_data = m_b_weights[layer_id].data<float>();
+            const float* adapter_b_data = b.data<float>();
+            for (size_t out_id = 0; out_id < layer.m_out_features; ++out_id) {
+                for (size_t rank_id = 0; rank_id < rank; ++rank_id)
+                    b_data[out_id * num_channels + slot * m_max_rank + rank_id] = alpha * adapter_b_data[out_id * rank + rank_id];
+            }
+        }
+
+        m_slots[adapter_id] = slot;
+    }
+
+    void remove_adapter(size_t adapter_id) {
+        OPENVINO_ASSERT(m_slots.erase(adapter_id) == 1, "LoRA adapter ", adapter_id, " is not loaded");
+    }
+
+    // stacked weights are passed to the model as inputs once, so base model weights are never duplicated
+    void set_tensors(ov::InferRequest& request) const {
+        for (size_t layer_id = 0; layer_id < m_layers.size(); ++layer_id) {
+            request.set_tensor("lora_A." + std::to_string(layer_id), get_a_weights(layer_id));
+            request.set_tensor("lora_B." + std::to_string(layer_id), get_b_weights(layer_id));
+        }
+    }
+};
@@ -5,59 +5,135 @@
 
 #include <vector>
 #include <cstdlib>
+#include <limits>
+#include <string>
 
 #include <openvino/runtime/infer_request.hpp>
+#include <openvino/runtime/remote_context.hpp>
 
 #include "debug_utils.hpp"
+#include "lora_adapter_pool.hpp"
 #include "sequence_group.hpp"
 #include "scheduler.hpp"
-#include "timer.hpp"
 
 class ModelRunner {
+    // input tensors are allocated once and only reshaped on every step; host memory is reallocated
+    // only when a step needs more of it than any of previous steps
+    struct InputTensors {
+        ov::Tensor
+            input_ids{ov::element::i64, {0}},
+            position_ids{ov::element::i64, {0}},
+            // PA specific parameters
+            past_lens{ov::element::i32, {0}},
+            subsequence_begins{ov::element::i32, {1}},
+            block_indices{ov::element::i32, {0}},
+            block_indices_begins{ov::element::i32, {1}},
+            max_context_len{ov::element::i32, {}},
+            // indices of tokens, which logits are computed for
+            sampled_tokens_indices{ov::element::i64, {0}},
+            // channels of LoRA adapters used by tokens
+            lora_mask{ov::element::f32, {0, 1, 0}};
+    };
+
     ov::InferRequest m_request;
+    // optional second infer request used for overlapped execution
+    ov::InferRequest m_pipelined_request;
     SchedulerConfig m_scheduler_config;
-public:
-    ModelRunner(ov::InferRequest request, const SchedulerConfig& scheduler_config) :
-        m_request(request),
-        m_scheduler_config(scheduler_config) { }
+    // each infer request has own inputs, because they can be in flight simultaneously
+    InputTensors m_inputs, m_pipelined_inputs;
+    // whether model computes logits only for sampled tokens (see apply_paged_attention_transformations)
+    bool m_has_sampled_tokens_indices = false;
+    // weights of LoRA adapters, if model applies them (see apply_lora_transformations)
+    std::shared_ptr<const LoRAAdapterPool> m_lora_adapter_pool;
 
-    ov::InferRequest get_infer_request() const {
-        return m_request;
+    static constexpr size_t MAIN_MODEL_PASS = std::numeric_limits<size_t>::max();
+
+    // main model processes all scheduled tokens, while draft model processes only a part of them on each pass
+    // 'num_sampled_tokens' last tokens of each sequence require logits
+    static void _get_tokens_range(SequenceGroup::CPtr sequence_group, size_t draft_step, size_t& first_position, size_t& num_tokens,
+                                  size_t& num_sampled_tokens) {
+        if (draft_step == MAIN_MODEL_PASS) {
+            first_position = sequence_group->get_num_processed_tokens();
+            num_tokens = sequence_group->get_num_scheduled_tokens();
+            num_sampled_tokens = sequence_group->get_num_sampled_tokens();
+        } else {
+            first_position = sequence_group->get_draft_position(draft_step);
+            num_tokens = sequence_group->get_num_draft_tokens(draft_step);
+            num_sampled_tokens = sequence_group->get_num_sampled_draft_tokens(draft_step);
+        }
     }
 
-    ov::Tensor forward(const std::vector<SequenceGroup::Ptr> & sequence_groups, const Scheduler::Output& scheduler_output) {
-        size_t num_sequence_groups = scheduler_output.m_scheduled_sequence_groups_ids.size();
+    static bool _has_input(ov::InferRequest request, const std::string& name) {
+        for (const auto& input : request.get_compiled_model().inputs()) {
+            if (input.get_names().count(name) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    // fills inputs of 'request' for scheduled sequence groups with indices in range [begin, end) of scheduled groups list
+    void _prepare_inputs(ov::InferRequest& request, InputTensors& inputs, const std::vector<SequenceGroup::Ptr> & sequence_groups, const Scheduler::Output& scheduler_output,
+                         size_t begin, size_t end, size_t draft_step = MAIN_MODEL_PASS) {
+        OPENVINO_ASSERT(begin <= end && end <= scheduler_output.m_scheduled_sequence_groups_ids.size());
         size_t batch_size_in_sequences = 0;
-        size_t total_num_tokens = 0, total_num_blocks = 0;
+        size_t total_num_tokens = 0, total_num_blocks = 0, total_num_sampled_tokens = 0;
         size_t max_context_len_val = 0;
+        size_t block_size = m_scheduler_config.block_size;
 
         // compute aggregated values
-        for (size_t i = 0; i < num_sequence_groups; ++i) {
+        for (size_t i = begin; i < end; ++i) {
             size_t seq_group_id = scheduler_output.m_scheduled_sequence_groups_ids[i];
             SequenceGroup::CPtr sequence_group = sequence_groups[seq_group_id];
+            size_t first_position, num_tokens, num_sampled_tokens;
+            _get_tokens_range(sequence_group, draft_step, first_position, num_tokens, num_sampled_tokens);
+            if (num_tokens == 0)
+                continue;
             size_t num_sequences = sequence_group->num_running_seqs();
+            // KV cache of evicted tokens is not attended
+            size_t context_len = first_position + num_tokens - sequence_group->get_num_evicted_tokens();
             batch_size_in_sequences += num_sequences;
-            total_num_tokens += sequence_group->get_num_scheduled_tokens() * num_sequences;
-            total_num_blocks += sequence_group->get_num_blocks() * num_sequences;
-            max_context_len_val = std::max(max_context_len_val, sequence_group->get_context_len());
+            total_num_tokens += num_tokens * num_sequences;
+            total_num_sampled_tokens += num_sampled_tokens * num_sequences;
+            total_num_blocks += (context_len + block_size - 1) / block_size * num_sequences;
+            max_context_len_val = std::max(max_context_len_val, context_len);
         }
 
         ov::Tensor
-            input_ids(ov::element::i64, {total_num_tokens}),
-            position_ids(ov::element::i64, {total_num_tokens}),
+            & input_ids = inputs.input_ids,
+            & position_ids = inputs.position_ids,
             // PA specific parameters
-            past_lens(ov::element::i32, {batch_size_in_sequences}),
-            subsequence_begins(ov::element::i32, {batch_size_in_sequences + 1}),
-            block_indices(ov::element::i32, {total_num_blocks}),
-            block_indices_begins(ov::element::i32, {batch_size_in_sequences + 1}),
-            max_context_len(ov::element::i32, {});
+            & past_lens = inputs.past_lens,
+            & subsequence_begins = inputs.subsequence_begins,
+            & block_indices = inputs.block_indices,
+            & block_indices_begins = inputs.block_indices_begins,
+            & max_context_len = inputs.max_context_len,
+            & sampled_tokens_indices = inputs.sampled_tokens_indices;
+
+        input_ids.set_shape({total_num_tokens});
+        position_ids.set_shape({total_num_tokens});
+        past_lens.set_shape({batch_size_in_sequences});
+        subsequence_begins.set_shape({batch_size_in_sequences + 1});
+        block_indices.set_shape({total_num_blocks});
+        block_indices_begins.set_shape({batch_size_in_sequences + 1});
+        // logits of at least one token are computed to avoid empty LM head computation
+        sampled_tokens_indices.set_shape({std::max<size_t>(total_num_sampled_tokens, 1)});
+        sampled_tokens_indices.data<int64_t>()[0] = 0;
+
+        float* lora_mask_data = nullptr;
+        const size_t num_lora_channels = m_lora_adapter_pool ? m_lora_adapter_pool->get_num_channels() : 0;
+        if (m_lora_adapter_pool) {
+            inputs.lora_mask.set_shape({total_num_tokens, 1, num_lora_channels});
+            lora_mask_data = inputs.lora_mask.data<float>();
+            std::fill_n(lora_mask_data, inputs.lora_mask.get_size(), 0.0f);
+        }
 
         max_context_len.data<int32_t>()[0] = max_context_len_val;
 
         // get raw pointers to copy to
         int64_t
             * input_ids_data = input_ids.data<int64_t>(),
-            * position_ids_data = position_ids.data<int64_t>();
+            * position_ids_data = position_ids.data<int64_t>(),
+            * sampled_tokens_indices_data = sampled_tokens_indices.data<int64_t>();
         int32_t 
             * past_lens_data = past_lens.data<int32_t>(),
             * subsequence_begins_data = subsequence_begins.data<int32_t>(),
@@ -68,19 +144,27 @@ public:
         subsequence_begins_data[0] = 0;
         block_indices_begins_data[0] = 0;
 
-        for (size_t i = 0; i < num_sequence_groups; ++i) {
+        for (size_t i = begin, token_offset = 0; i < end; ++i) {
             size_t seq_group_id = scheduler_output.m_scheduled_sequence_groups_ids[i];
             SequenceGroup::CPtr sequence_group = sequence_groups[seq_group_id];
-            std::vector<Sequence::CPtr> running_sequences = sequence_group->get_running_sequences();
-            size_t num_running_sequences = running_sequences.size();
-            size_t num_scheduled_tokens = sequence_group->get_num_scheduled_tokens();
-            size_t num_blocks = sequence_group->get_num_blocks();
-            size_t group_position_id = sequence_group->get_num_processed_tokens(),
-                // spec: In case of multiple input tokens for current sequence (prompt_len > 1), context_len corresponds to first token within subgroup of scheduled tokens
-                group_context_len = group_position_id;
+            size_t group_position_id, num_scheduled_tokens, num_sampled_tokens;
+            _get_tokens_range(sequence_group, draft_step, group_position_id, num_scheduled_tokens, num_sampled_tokens);
+            if (num_scheduled_tokens == 0)
+                continue;
+            // sliding window KV cache: tokens keep their positions, while KV cache of evicted ones is skipped
+            size_t group_context_len = group_position_id - sequence_group->get_num_evicted_tokens();
+            size_t num_blocks = (group_context_len + num_scheduled_tokens + block_size - 1) / block_size;
+            // spec: In case of multiple input tokens for current sequence (prompt_len > 1), context_len corresponds to first token within subgroup of scheduled tokens
+            // tokens of requests without adapter have zero masks, so only base model weights are applied
+            const size_t lora_adapter_id = sequence_group->get_sampling_parameters().lora_adapter_id;
+            const size_t lora_channels_begin = lora_mask_data && lora_adapter_id != 0 ?
+                m_lora_adapter_pool->get_slot(lora_adapter_id) * m_lora_adapter_pool->get_max_rank() : 0;
 
-            for (size_t seq_id = 0; seq_id < num_running_sequences; ++seq_id) {
-                Sequence::CPtr sequence = running_sequences[seq_id];
+            // iterate over sequences in place instead of copying a list of running ones
+            for (size_t seq_id = 0; seq_id < sequence_group->num_total_seqs(); ++seq_id) {
+                Sequence::CPtr sequence = (*sequence_group)[seq_id];
+                if (!sequence->is_running())
+                    continue;
 
                 for (size_t token_id = 0, position_id = group_position_id; token_id < num_scheduled_tokens; ++token_id, ++position_id) {
                     // compute token for current sequence
@@ -89,6 +173,9 @@ public:
                         sequence->get_generated_ids()[position_id - sequence_group->get_prompt_len()];
 
                     position_ids_data[token_id] = position_id;
+
+                    if (lora_mask_data && lora_adapter_id != 0)
+                        std::fill_n(lora_mask_data + token_id * num_lora_channels + lora_channels_begin, m_lora_adapter_pool->get_max_rank(), 1.0f);
                 }
 
                 past_lens_data[0] = group_context_len;
@@ -100,9 +187,15 @@ public:
                 for (size_t block_id = 0; block_id < num_blocks; ++block_id)
                     block_indices_data[block_id] = kv_blocks[block_id]->get_index();
 
+                for (size_t token_id = num_scheduled_tokens - num_sampled_tokens; token_id < num_scheduled_tokens; ++token_id)
+                    *sampled_tokens_indices_data++ = token_offset + token_id;
+
                 // apply strides to shift to a next sequence
+                token_offset += num_scheduled_tokens;
                 input_ids_data += num_scheduled_tokens;
                 position_ids_data += num_scheduled_tokens;
+                if (lora_mask_data)
+                    lora_mask_data += num_scheduled_tokens * num_lora_channels;
                 past_lens_data += 1;
                 subsequence_begins_data += 1;
                 block_indices_data += num_blocks;
@@ -111,15 +204,21 @@ public:
         }
 
         // typical LLM parameters
-        m_request.set_tensor("input_ids", input_ids);
-        m_request.set_tensor("position_ids", position_ids);
+        request.set_tensor("input_ids", input_ids);
+        request.set_tensor("position_ids", position_ids);
 
         // PA specific parameters
-        m_request.set_tensor("past_lens", past_lens);
-        m_request.set_tensor("subsequence_begins", subsequence_begins);
-        m_request.set_tensor("block_indices", block_indices);
-        m_request.set_tensor("block_indices_begins", block_indices_begins);
-        m_request.set_tensor("max_context_len", max_context_len);
+        request.set_tensor("past_lens", past_lens);
+        request.set_tensor("subsequence_begins", subsequence_begins);
+        request.set_tensor("block_indices", block_indices);
+        request.set_tensor("block_indices_begins", block_indices_begins);
+        request.set_tensor("max_context_len", max_context_len);
+
+        if (m_has_sampled_tokens_indices)
+            request.set_tensor("sampled_tokens_indices", sampled_tokens_indices);
+
+        if (m_lora_adapter_pool)
+            request.set_tensor("lora_mask", inputs.lora_mask);
 
         // print_tensor("input_ids", input_ids);
         // print_tensor("position_ids", position_ids);
@@ -129,15 +228,142 @@ public:
         // print_tensor("block_indices", block_indices);
         // print_tensor("block_indices_begins", block_indices_begins);
         // print_tensor("max_context_len", max_context_len);
+    }
+
+public:
+    ModelRunner(ov::InferRequest request, const SchedulerConfig& scheduler_config) :
+        m_request(request),
+        m_scheduler_config(scheduler_config),
+        m_has_sampled_tokens_indices(_has_input(request, "sampled_tokens_indices")) { }
+
+    // 'pipelined_request' must share KV cache tensors with 'request'
+    ModelRunner(ov::InferRequest request, ov::InferRequest pipelined_request, const SchedulerConfig& scheduler_config) :
+        m_request(request),
+        m_pipelined_request(pipelined_request),
+        m_scheduler_config(scheduler_config),
+        m_has_sampled_tokens_indices(_has_input(request, "sampled_tokens_indices")) { }
 
-        {
-            static ManualTimer timer("pure generate inference");
-            timer.start();
-            m_request.infer();
-            timer.end();
+    // allocates inputs in USM host memory of device context, so they are not copied once again before inference
+    void set_remote_context(ov::RemoteContext remote_context) {
+        for (InputTensors* inputs : {&m_inputs, &m_pipelined_inputs}) {
+            for (ov::Tensor* input : {&inputs->input_ids, &inputs->position_ids, &inputs->past_lens, &inputs->subsequence_begins,
+                                      &inputs->block_indices, &inputs->block_indices_begins, &inputs->max_context_len,
+                                      &inputs->sampled_tokens_indices, &inputs->lora_mask}) {
+                *input = remote_context.create_host_tensor(input->get_element_type(), input->get_shape());
+            }
         }
+    }
+
+    // model must be transformed by apply_lora_transformations; LoRA weights are set by owner of the pool
+    void set_lora_adapter_pool(std::shared_ptr<const LoRAAdapterPool> lora_adapter_pool) {
+        m_lora_adapter_pool = lora_adapter_pool;
+    }
+
+    ov::InferRequest get_infer_request() const {
+        return m_request;
+    }
+
+    bool has_pipelined_request() const {
+        return static_cast<bool>(m_pipelined_request);
+    }
+
+    ov::InferRequest get_pipelined_infer_request() const {
+        OPENVINO_ASSERT(has_pipelined_request());
+        return m_pipelined_request;
+    }
+
+    ov::Tensor forward(const std::vector<SequenceGroup::Ptr> & sequence_groups, const Scheduler::Output& scheduler_output) {
+        _prepare_inputs(m_request, m_inputs, sequence_groups, scheduler_output, 0, scheduler_output.m_scheduled_sequence_groups_ids.size());
+
+        m_request.infer();
 
         // return logits
         return m_request.get_output_tensor();
     }
+
+    // multi-step decode: runs the next step for the same batch as the previous forward(), which has processed a single
+    // token of each running sequence; staged inputs are reused, so only the last generated tokens are written, while
+    // positions and context lengths are incremented; block indices are rebuilt only when some sequence enters a new block
+    ov::Tensor forward_next_decode_step(const std::vector<SequenceGroup::Ptr> & sequence_groups, const Scheduler::Output& scheduler_output) {
+        const size_t block_size = m_scheduler_config.block_size;
+        int64_t
+            * input_ids_data = m_inputs.input_ids.data<int64_t>(),
+            * position_ids_data = m_inputs.position_ids.data<int64_t>();
+        int32_t * past_lens_data = m_inputs.past_lens.data<int32_t>();
+
+        size_t num_sequences = 0, total_num_blocks = 0;
+        bool has_new_blocks = false;
+        for (uint64_t seq_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+            SequenceGroup::CPtr sequence_group = sequence_groups[seq_group_id];
+            for (size_t seq_id = 0; seq_id < sequence_group->num_total_seqs(); ++seq_id) {
+                Sequence::CPtr sequence = (*sequence_group)[seq_id];
+                if (!sequence->is_running())
+                    continue;
+                OPENVINO_ASSERT(num_sequences < m_inputs.input_ids.get_size(), "Multi-step decode requires the same batch on every step");
+                input_ids_data[num_sequences] = sequence->get_generated_ids().back();
+                ++position_ids_data[num_sequences];
+                const size_t past_len = ++past_lens_data[num_sequences];
+                has_new_blocks |= past_len % block_size == 0;
+                total_num_blocks += past_len / block_size + 1;
+                ++num_sequences;
+            }
+        }
+        OPENVINO_ASSERT(num_sequences == m_inputs.input_ids.get_size(), "Multi-step decode requires the same batch on every step");
+        ++m_inputs.max_context_len.data<int32_t>()[0];
+
+        if (has_new_blocks) {
+            m_inputs.block_indices.set_shape({total_num_blocks});
+            int32_t
+                * block_indices_data = m_inputs.block_indices.data<int32_t>(),
+                * block_indices_begins_data = m_inputs.block_indices_begins.data<int32_t>();
+            size_t sequence_idx = 0;
+            for (uint64_t seq_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+                SequenceGroup::CPtr sequence_group = sequence_groups[seq_group_id];
+                for (size_t seq_id = 0; seq_id < sequence_group->num_total_seqs(); ++seq_id) {
+                    Sequence::CPtr sequence = (*sequence_group)[seq_id];
+                    if (!sequence->is_running())
+                        continue;
+                    const size_t num_blocks = past_lens_data[sequence_idx++] / block_size + 1;
+                    const std::vector<KVCacheBlock::Ptr> & kv_blocks = scheduler_output.m_block_tables.at(sequence->get_id());
+                    for (size_t block_id = 0; block_id < num_blocks; ++block_id)
+                        block_indices_data[block_id] = kv_blocks[block_id]->get_index();
+                    block_indices_begins_data[1] = block_indices_begins_data[0] + num_blocks;
+                    block_indices_data += num_blocks;
+                    block_indices_begins_data += 1;
+                }
+            }
+            m_request.set_tensor("block_indices", m_inputs.block_indices);
+        }
+
+        m_request.infer();
+
+        return m_request.get_output_tensor();
+    }
+
+    // runs one pass of draft model for speculative decoding and returns logits of sequence groups processed on this pass;
+    // pass 'draft_step' proposes candidate tokens with index 'draft_step'
+    ov::Tensor forward_draft(const std::vector<SequenceGroup::Ptr> & sequence_groups, const Scheduler::Output& scheduler_output, size_t draft_step) {
+        _prepare_inputs(m_request, m_inputs, sequence_groups, scheduler_output, 0, scheduler_output.m_scheduled_sequence_groups_ids.size(), draft_step);
+
+        m_request.infer();
+
+        return m_request.get_output_tensor();
+    }
+
+    // starts asynchronous inference of scheduled sequence groups with indices in range [begin, end) of scheduled groups list;
+    // 'pipelined' selects the second infer request, so two parts of the same step can be in flight simultaneously
+    void start_async(const std::vector<SequenceGroup::Ptr> & sequence_groups, const Scheduler::Output& scheduler_output,
+                     size_t begin, size_t end, bool pipelined) {
+        ov::InferRequest& request = pipelined ? m_pipelined_request : m_request;
+        OPENVINO_ASSERT(request, "Pipelined infer request is not set");
+        _prepare_inputs(request, pipelined ? m_pipelined_inputs : m_inputs, sequence_groups, scheduler_output, begin, end);
+        request.start_async();
+    }
+
+    // waits for inference started by start_async and returns logits
+    ov::Tensor wait(bool pipelined) {
+        ov::InferRequest& request = pipelined ? m_pipelined_request : m_request;
+        request.wait();
+        return request.get_output_tensor();
+    }
 };
@@ -0,0 +1,85 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "openvino/core/except.hpp"
+
+// Incrementally maintained index of n-grams of a token sequence, which is used by prompt lookup decoding:
+// a continuation of the most recent previous occurrence of sequence suffix is proposed as candidate tokens
+class NGramIndex {
+    size_t m_max_ngram_size;
+    // indexed tokens: prompt and already validated generated tokens
+    std::vector<int64_t> m_tokens;
+    // for each n-gram size: n-gram hash => position of a token following the most recent n-gram occurrence
+    std::vector<std::unordered_map<size_t, size_t>> m_ngrams;
+    // a number of tokens, whose following n-grams are indexed
+    size_t m_num_indexed_tokens = 0;
+
+    static size_t _hash_combine(size_t seed, int64_t token_id) {
+        return seed ^ (std::hash<int64_t>()(token_id) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+
+    // indexes all n-grams ending at 'end_position' - 1
+    void _index_ngrams(size_t end_position) {
+        size_t hash = 0;
+        for (size_t ngram_size = 1; ngram_size <= std::min(m_max_ngram_size, end_position); ++ngram_size) {
+            hash = _hash_combine(hash, m_tokens[end_position - ngram_size]);
+            // newer occurrences replace older ones
+            m_ngrams[ngram_size - 1][hash] = end_position;
+        }
+    }
+
+public:
+    explicit NGramIndex(size_t max_ngram_size) :
+        m_max_ngram_size(max_ngram_size),
+        m_ngrams(max_ngram_size) {
+        OPENVINO_ASSERT(max_ngram_size > 0, "Max n-gram size must be positive");
+    }
+
+    // appends tokens which are not indexed yet; 'prompt_ids' and 'generated_ids' must extend previously indexed tokens
+    void update(const std::vector<int64_t>& prompt_ids, const std::vector<int64_t>& generated_ids) {
+        size_t num_tokens = prompt_ids.size() + generated_ids.size();
+        OPENVINO_ASSERT(num_tokens >= m_tokens.size(), "Indexed tokens cannot be removed");
+        m_tokens.reserve(num_tokens);
+        for (size_t position = m_tokens.size(); position < num_tokens; ++position)
+            m_tokens.push_back(position < prompt_ids.size() ? prompt_ids[position] : generated_ids[position - prompt_ids.size()]);
+
+        // n-grams ending at the last token have no continuation yet, so they are indexed on next updates
+        for (; m_num_indexed_tokens + 1 < m_tokens.size(); ++m_num_indexed_tokens)
+            _index_ngrams(m_num_indexed_tokens + 1);
+    }
+
+    // returns up to 'num_candidates' tokens, which followed the longest suffix of indexed tokens before
+    std::vector<int64_t> find_candidates(size_t num_candidates) const {
+        const size_t num_tokens = m_tokens.size();
+        std::vector<size_t> suffix_hashes;
+        size_t hash = 0;
+        for (size_t ngram_size = 1; ngram_size <= std::min(m_max_ngram_size, num_tokens); ++ngram_size)
+            suffix_hashes.push_back(hash = _hash_combine(hash, m_tokens[num_tokens - ngram_size]));
+
+        for (size_t ngram_size = suffix_hashes.size(); ngram_size > 0; --ngram_size) {
+            const auto& ngrams = m_ngrams[ngram_size - 1];
+            auto ngram_it = ngrams.find(suffix_hashes[ngram_size - 1]);
+            if (ngram_it == ngrams.end())
+                continue;
+
+            // protect from hash collisions
+            const size_t continuation_position = ngram_it->second;
+            if (!std::equal(m_tokens.begin() + (continuation_position - ngram_size), m_tokens.begin() + continuation_position,
+                            m_tokens.end() - ngram_size))
+                continue;
+
+            size_t continuation_end = std::min(num_tokens, continuation_position + num_candidates);
+            return std::vector<int64_t>(m_tokens.begin() + continuation_position, m_tokens.begin() + continuation_end);
+        }
+
+        return {};
+    }
+};
@@ -0,0 +1,63 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// parses CPU list in Linux sysfs format, e.g. "0-3,8,10-11"
+inline std::vector<int> parse_cpu_list(const std::string& cpu_list) {
+    std::vector<int> cpus;
+    std::stringstream stream(cpu_list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        const size_t dash_pos = range.find('-');
+        const int first_cpu = std::stoi(range.substr(0, dash_pos));
+        const int last_cpu = dash_pos == std::string::npos ? first_cpu : std::stoi(range.substr(dash_pos + 1));
+        for (int cpu = first_cpu; cpu <= last_cpu; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// CPUs of each NUMA node with CPUs (e.g. socket of multi-socket host); empty if NUMA topology is unknown
+inline std::vector<std::vector<int>> get_numa_nodes_cpus() {
+    std::vector<std::vector<int>> nodes_cpus;
+#ifdef __linux__
+    for (size_t node_id = 0; ; ++node_id) {
+        std::ifstream cpu_list_file("/sys/devices/system/node/node" + std::to_string(node_id) + "/cpulist");
+        if (!cpu_list_file)
+            break;
+        std::string cpu_list;
+        std::getline(cpu_list_file, cpu_list);
+        std::vector<int> cpus = parse_cpu_list(cpu_list);
+        // memory only nodes cannot run workers
+        if (!cpus.empty())
+            nodes_cpus.push_back(std::move(cpus));
+    }
+#endif
+    return nodes_cpus;
+}
+
+// pins calling thread (and threads created by it later) to 'cpus'; returns false if it's not supported
+inline bool pin_current_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
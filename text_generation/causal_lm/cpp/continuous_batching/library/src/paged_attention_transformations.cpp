@@ -2,11 +2,18 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "openvino/core/model.hpp"
+#include "openvino/op/add.hpp"
+#include "openvino/op/constant.hpp"
+#include "openvino/op/gather.hpp"
+#include "openvino/op/matmul.hpp"
+#include "openvino/op/multiply.hpp"
+#include "openvino/op/parameter.hpp"
 
 #include "openvino/pass/manager.hpp"
 #include "openvino/pass/sdpa_to_paged_attention.hpp"
 
 #include "device_config.hpp"
+#include "lora_adapter_pool.hpp"
 
 inline ov::PartialShape to_partial_with_dyn_0_dim(const ov::Shape& static_shape) {
     ov::PartialShape partial_shape = static_shape;
@@ -14,6 +21,119 @@ inline ov::PartialShape to_partial_with_dyn_0_dim(const ov::Shape& static_shape)
     return partial_shape;
 }
 
+// returns LM head MatMul, which computes logits of the single model output, or nullptr
+std::shared_ptr<ov::Node> find_lm_head(std::shared_ptr<ov::Model> model) {
+    const ov::ResultVector& results = model->get_results();
+    if (results.size() != 1)
+        return nullptr;
+
+    // skip post-processing of logits (e.g. conversion to f32 or scaling by a constant)
+    std::shared_ptr<ov::Node> lm_head = results[0]->get_input_node_shared_ptr(0);
+    while (!ov::is_type<ov::op::v0::MatMul>(lm_head)) {
+        for (size_t input_id = 1; input_id < lm_head->get_input_size(); ++input_id) {
+            if (!ov::is_type<ov::op::v0::Constant>(lm_head->get_input_node_shared_ptr(input_id)))
+                return nullptr;
+        }
+        if (lm_head->get_input_size() == 0 || lm_head->get_output_size() != 1)
+            return nullptr;
+        lm_head = lm_head->get_input_node_shared_ptr(0);
+    }
+    return lm_head;
+}
+
+// gathers hidden states of tokens, which logits are used by sampler, before LM head, so the largest MatMul of the model
+// and logits are computed only for them; indices of such tokens are passed by ModelRunner via 'sampled_tokens_indices'
+// returns false if LM head is not found and model is left unchanged
+bool apply_gather_before_lm_head(std::shared_ptr<ov::Model> model) {
+    std::shared_ptr<ov::Node> lm_head = find_lm_head(model);
+    if (!lm_head)
+        return false;
+
+    // hidden states are [num_tokens, 1, hidden_size]
+    ov::Output<ov::Node> hidden_states = lm_head->input_value(0);
+    if (hidden_states.get_partial_shape().rank() != 3)
+        return false;
+
+    auto sampled_tokens_indices = std::make_shared<ov::op::v0::Parameter>(ov::element::i64, ov::PartialShape{-1});
+    sampled_tokens_indices->set_friendly_name("sampled_tokens_indices");
+    sampled_tokens_indices->output(0).get_tensor().set_names({"sampled_tokens_indices"});
+    auto axis = ov::op::v0::Constant::create(ov::element::i64, ov::Shape{}, {0});
+    auto sampled_hidden_states = std::make_shared<ov::op::v8::Gather>(hidden_states, sampled_tokens_indices, axis);
+    lm_head->input(0).replace_source_output(sampled_hidden_states);
+    model->add_parameters({sampled_tokens_indices});
+    return true;
+}
+
+// whether node is computed from constants only, e.g. compressed weights with decompression subgraph
+static bool is_constant_subgraph(const std::shared_ptr<ov::Node>& node, size_t max_depth = 4) {
+    if (ov::is_type<ov::op::v0::Constant>(node))
+        return true;
+    if (max_depth == 0 || node->get_input_size() == 0 || ov::is_type<ov::op::v0::Parameter>(node))
+        return false;
+    for (size_t input_id = 0; input_id < node->get_input_size(); ++input_id) {
+        if (!is_constant_subgraph(node->get_input_node_shared_ptr(input_id), max_depth - 1))
+            return false;
+    }
+    return true;
+}
+
+static std::shared_ptr<ov::op::v0::Parameter> create_named_parameter(const std::string& name, const ov::PartialShape& shape) {
+    auto parameter = std::make_shared<ov::op::v0::Parameter>(ov::element::f32, shape);
+    parameter->set_friendly_name(name);
+    parameter->output(0).get_tensor().set_names({name});
+    return parameter;
+}
+
+// adds low-rank deltas of multiple LoRA adapters to outputs of linear layers (except LM head):
+//   y = x * W^T + ((x * A^T) . mask) * B^T,
+// where A [num_channels, in_features] and B [out_features, num_channels] stack weights of all loaded adapters
+// ('lora_A.<layer_id>' and 'lora_B.<layer_id>' inputs), and 'lora_mask' [num_tokens, 1, num_channels] selects
+// channels of adapter used by each token's request; returns transformed layers in order of their inputs
+std::vector<LoRALayer> apply_lora_transformations(std::shared_ptr<ov::Model> model, size_t num_channels) {
+    std::shared_ptr<ov::Node> lm_head = find_lm_head(model);
+    auto lora_mask = create_named_parameter("lora_mask", ov::PartialShape{-1, 1, static_cast<int64_t>(num_channels)});
+
+    std::vector<LoRALayer> layers;
+    ov::ParameterVector lora_parameters = {lora_mask};
+    for (const std::shared_ptr<ov::Node>& node : model->get_ordered_ops()) {
+        auto matmul = ov::as_type_ptr<ov::op::v0::MatMul>(node);
+        if (!matmul || matmul == lm_head || matmul->get_transpose_a() || !is_constant_subgraph(matmul->get_input_node_shared_ptr(1)))
+            continue;
+
+        // hidden states are [num_tokens, 1, in_features] and weights are static matrices
+        const ov::Output<ov::Node> hidden_states = matmul->input_value(0);
+        const ov::PartialShape& weights_shape = matmul->get_input_partial_shape(1);
+        if (hidden_states.get_partial_shape().rank() != 3 || hidden_states.get_element_type() != ov::element::f32 ||
+            weights_shape.rank() != 2 || weights_shape.is_dynamic())
+            continue;
+
+        const ov::Shape weights = weights_shape.to_shape();
+        LoRALayer layer{matmul->get_friendly_name(),
+                        matmul->get_transpose_b() ? weights[1] : weights[0],
+                        matmul->get_transpose_b() ? weights[0] : weights[1]};
+        const std::string layer_id = std::to_string(layers.size());
+        auto lora_a = create_named_parameter("lora_A." + layer_id, ov::PartialShape{static_cast<int64_t>(num_channels), static_cast<int64_t>(layer.m_in_features)});
+        auto lora_b = create_named_parameter("lora_B." + layer_id, ov::PartialShape{static_cast<int64_t>(layer.m_out_features), static_cast<int64_t>(num_channels)});
+
+        auto down = std::make_shared<ov::op::v0::MatMul>(hidden_states, lora_a, false, true);
+        auto masked = std::make_shared<ov::op::v1::Multiply>(down, lora_mask);
+        auto delta = std::make_shared<ov::op::v0::MatMul>(masked, lora_b, false, true);
+        auto output = std::make_shared<ov::op::v1::Add>(matmul, delta);
+        for (ov::Input<ov::Node> consumer : matmul->output(0).get_target_inputs()) {
+            if (consumer.get_node() != output.get())
+                consumer.replace_source_output(output);
+        }
+
+        lora_parameters.push_back(lora_a);
+        lora_parameters.push_back(lora_b);
+        layers.push_back(layer);
+    }
+
+    model->add_parameters(lora_parameters);
+    model->validate_nodes_and_infer_types();
+    return layers;
+}
+
 void apply_paged_attention_transformations(std::shared_ptr<ov::Model> model, DeviceConfig& device_config) {
     const ov::op::util::VariableVector& variables = model->get_variables();
     OPENVINO_ASSERT(!variables.empty(), "Model is supposed to be stateful");
@@ -41,5 +161,8 @@ void apply_paged_attention_transformations(std::shared_ptr<ov::Model> model, Dev
         parameters[kv_caches_inputs_offset + 2 * decoder_layer_id]->set_partial_shape(to_partial_with_dyn_0_dim(device_config.get_key_cache_shape()));
         parameters[kv_caches_inputs_offset + 2 * decoder_layer_id + 1]->set_partial_shape(to_partial_with_dyn_0_dim(device_config.get_value_cache_shape()));
     }
+
+    apply_gather_before_lm_head(model);
+
     model->validate_nodes_and_infer_types();
 }
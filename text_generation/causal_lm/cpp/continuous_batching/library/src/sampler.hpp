@@ -12,7 +12,9 @@
 #include <cmath>
 #include <random>
 #include <set>
+#include <unordered_map>
 
+#include "openvino/core/parallel.hpp"
 #include "openvino/runtime/tensor.hpp"
 
 #include "logit_processor.hpp"
@@ -60,11 +62,15 @@ std::vector<int64_t> kmp_search(const std::vector<int64_t>& haystack, const std:
     return res;
 }
 
-std::vector<Token> log_softmax(const ov::Tensor& logits, size_t batch_idx) {
+// Returns 'top_k' most probable tokens of the last position of 'batch_idx' in log-softmax space, most probable in front;
+// 'penalties' are subtracted from log probabilities of specific tokens. Logits are scanned in place and only
+// the tokens that can get into top-k are touched, so neither vocabulary-sized vector nor its sorting is required
+std::vector<Token> top_k_log_softmax(const ov::Tensor& logits, size_t batch_idx, size_t top_k, const std::unordered_map<int64_t, float>& penalties) {
     ov::Shape shape = logits.get_shape();
     OPENVINO_ASSERT(shape.size() == 3);
     size_t batch = shape[0], seq_len = shape[1], vocab_size = shape[2];
     OPENVINO_ASSERT(batch_idx < batch, "Logits batch size doesn't match the number of beams");
+    OPENVINO_ASSERT(top_k <= vocab_size, "Vocabulary is smaller than number of beam search candidates");
 
     size_t batch_offset = batch_idx * seq_len * vocab_size, sequence_offset = (seq_len - 1) * vocab_size;
     const float* beam_logits = logits.data<const float>() + batch_offset + sequence_offset;
@@ -73,15 +79,60 @@ std::vector<Token> log_softmax(const ov::Tensor& logits, size_t batch_idx) {
         beam_logits, beam_logits + vocab_size, 0.0f, [max_logit](float accumulated, float to_add) {
             return accumulated + std::exp(to_add - max_logit);
     }));
+    const float normalizer = max_logit + log_sum;
 
+    // negative penalties increase log probabilities, so a token can pass the threshold of top-k only after penalization
+    float max_boost = 0.0f;
+    for (const auto& penalty : penalties)
+        max_boost = std::max(max_boost, -penalty.second);
+
+    // min-heap of the best tokens found so far: the worst of them is the first
+    auto greater_log_prob = [](const Token& left, const Token& right) {
+        return left.m_log_prob > right.m_log_prob;
+    };
     std::vector<Token> tokens;
-    tokens.reserve(vocab_size);
-    for (size_t idx = 0; idx < vocab_size; ++idx)
-        tokens.push_back({beam_logits[idx] - max_logit - log_sum, int64_t(idx)});
+    tokens.reserve(top_k + 1);
+    for (size_t idx = 0; idx < vocab_size; ++idx) {
+        float log_prob = beam_logits[idx] - normalizer;
+        if (tokens.size() == top_k && log_prob + max_boost <= tokens.front().m_log_prob)
+            continue;
 
+        if (!penalties.empty()) {
+            auto penalty_it = penalties.find(int64_t(idx));
+            if (penalty_it != penalties.end())
+                log_prob -= penalty_it->second;
+        }
+        if (tokens.size() == top_k) {
+            if (log_prob <= tokens.front().m_log_prob)
+                continue;
+            std::pop_heap(tokens.begin(), tokens.end(), greater_log_prob);
+            tokens.pop_back();
+        }
+        tokens.push_back({log_prob, int64_t(idx)});
+        std::push_heap(tokens.begin(), tokens.end(), greater_log_prob);
+    }
+
+    std::sort_heap(tokens.begin(), tokens.end(), greater_log_prob);
     return tokens;
 }
 
+// Returns log-softmax of 'token_id' over a row of logits; maximum and sum of exponents are accumulated in a single pass,
+// rescaling the sum whenever maximum grows, so the row is read only once
+float token_log_softmax(const float* logits, size_t vocab_size, int64_t token_id) {
+    OPENVINO_ASSERT(token_id >= 0 && static_cast<size_t>(token_id) < vocab_size, "Scored token ", token_id, " is out of vocabulary");
+    float max_logit = -std::numeric_limits<float>::infinity(), sum_exp = 0.0f;
+    for (size_t idx = 0; idx < vocab_size; ++idx) {
+        const float logit = logits[idx];
+        if (logit > max_logit) {
+            sum_exp = sum_exp * std::exp(max_logit - logit) + 1.0f;
+            max_logit = logit;
+        } else {
+            sum_exp += std::exp(logit - max_logit);
+        }
+    }
+    return logits[token_id] - max_logit - std::log(sum_exp);
+}
+
 struct Beam {
     Sequence::Ptr m_sequence;
     size_t m_global_beam_idx = 0;
@@ -163,6 +214,14 @@ struct SamplerOutput {
     std::unordered_map<uint64_t, std::list<uint64_t>> m_forked_sequences;
 };
 
+// candidates proposed by draft model for a sequence group on current step (speculative decoding)
+struct DraftCandidates {
+    // state of logits transformations, which takes already proposed candidates into account
+    LogitProcessor::Ptr m_logit_processor;
+    // draft model probabilities over vocabulary for each candidate (multinomial sampling only)
+    std::vector<std::vector<float>> m_probs;
+};
+
 class GroupBeamSearcher {
     SequenceGroup::Ptr m_sequence_group;
     GenerationConfig m_parameters;
@@ -197,11 +256,15 @@ public:
 class Sampler {
 
     std::vector<Token> _get_logit_vector(ov::Tensor logits, size_t batch_idx = 1) {
+        return _get_logit_vector(logits, batch_idx, logits.get_shape()[1] - 1);
+    }
+
+    std::vector<Token> _get_logit_vector(ov::Tensor logits, size_t batch_idx, size_t token_idx) {
         ov::Shape logits_shape = logits.get_shape();
         size_t batch_size = logits_shape[0], seq_len = logits_shape[1], vocab_size = logits_shape[2];
-        OPENVINO_ASSERT(batch_idx <= batch_size);
+        OPENVINO_ASSERT(batch_idx < batch_size && token_idx < seq_len);
         size_t batch_offset = batch_idx * seq_len * vocab_size;
-        size_t sequence_offset = (seq_len - 1) * vocab_size;
+        size_t sequence_offset = token_idx * vocab_size;
         const float* logits_data = logits.data<const float>() + batch_offset + sequence_offset;
 
         std::vector<Token> logit_vector(vocab_size);
@@ -211,12 +274,26 @@ class Sampler {
         return logit_vector;
     }
 
+    // argmax over raw logits without materialization of Token vector
+    Token _greedy_sample(ov::Tensor logits, size_t batch_idx) const {
+        return _greedy_sample(logits, batch_idx, logits.get_shape()[1] - 1);
+    }
+
+    Token _greedy_sample(ov::Tensor logits, size_t batch_idx, size_t token_idx) const {
+        ov::Shape logits_shape = logits.get_shape();
+        size_t batch_size = logits_shape[0], seq_len = logits_shape[1], vocab_size = logits_shape[2];
+        OPENVINO_ASSERT(batch_idx < batch_size && token_idx < seq_len);
+        const float* logits_data = logits.data<const float>() + batch_idx * seq_len * vocab_size + token_idx * vocab_size;
+        const float* max_logit = std::max_element(logits_data, logits_data + vocab_size);
+        return Token(*max_logit, max_logit - logits_data);
+    }
+
     Token _greedy_sample(const std::vector<Token>& logit_vector) const {
         auto out_token = std::max_element(logit_vector.begin(), logit_vector.end(), [](const Token& lhs, const Token& rhs) { return lhs.m_log_prob < rhs.m_log_prob; });
         return *out_token;
     }
 
-    std::vector<Token> _multinomial_sample(const std::vector<Token>& logit_vector, size_t num_tokens_per_sequence) {
+    std::vector<Token> _multinomial_sample(const std::vector<Token>& logit_vector, size_t num_tokens_per_sequence, std::mt19937& rng_engine) {
         std::vector<float> multinomial_weights(logit_vector.size());
         for (size_t i = 0; i < logit_vector.size(); i++) multinomial_weights[i] = logit_vector[i].m_log_prob;
 
@@ -229,132 +306,419 @@ class Sampler {
         return out_tokens;
     }
 
-    // request ID => beam search tracking information
+    // probabilities of all tokens in vocabulary; tokens filtered out by logits transformations have zero probability
+    static std::vector<float> _get_dense_probs(const std::vector<Token>& probs, size_t vocab_size) {
+        std::vector<float> dense_probs(vocab_size, 0.0f);
+        for (const Token& token : probs)
+            dense_probs[token.m_index] = token.m_log_prob;
+        return dense_probs;
+    }
+
+    // validates candidates of draft model or prompt lookup with main model logits computed for each of them: candidates are accepted
+    // one by one until the first rejected one, which is replaced with a token sampled from main model; for multinomial sampling rejection
+    // sampling is used, so generated tokens follow main model distribution; returns a number of processed tokens, which become invalid
+    size_t _validate_candidates(SequenceGroup::Ptr sequence_group, ov::Tensor sequence_group_logits);
+
+    // computes log-probabilities of scored prompt tokens, which follow positions with logits; finishes sequence group with the last chunk of prompt
+    void _score_sequence_group(SequenceGroup::Ptr sequence_group, ov::Tensor sequence_group_logits, SamplerOutput& sampler_output);
+
+    void _sample_sequence_group(SequenceGroup::Ptr sequence_group, ov::Tensor sequence_group_logits, SamplerOutput& sampler_output);
+
+    // group ID => beam search tracking information
     std::map<uint64_t, GroupBeamSearcher> m_beam_search_info;
 
-    std::mt19937 rng_engine;
-    // { request_id, logit_processor }
-    std::map<uint64_t, LogitProcessor> m_logit_processors;
+    // group ID => candidates proposed by draft model
+    std::map<uint64_t, DraftCandidates> m_draft_candidates;
+
+    // whether to sample sequence groups in parallel
+    bool m_parallel = false;
+
+    // whether handles are notified only about finished sequence groups, while running ones are notified by caller
+    bool m_notify_finished_only = false;
 
 public:
     SamplerOutput sample(std::vector<SequenceGroup::Ptr> & sequence_groups, ov::Tensor logits);
 
-    void set_seed(size_t seed) { rng_engine.seed(seed); }
+    // samples only specified sequence groups in given order; 'logits' must correspond to them
+    SamplerOutput sample(std::vector<SequenceGroup::Ptr> & sequence_groups, ov::Tensor logits, const std::vector<uint64_t>& sequence_group_ids);
+
+    // samples candidates from logits of draft model pass 'draft_step' and appends them to sequences of speculating groups
+    void sample_candidates(std::vector<SequenceGroup::Ptr> & sequence_groups, ov::Tensor logits, const std::vector<uint64_t>& sequence_group_ids, size_t draft_step);
+
+    // drops internal state of finished sequence group
+    void clear_request_info(uint64_t group_id) {
+        m_beam_search_info.erase(group_id);
+        m_draft_candidates.erase(group_id);
+    }
+
+    void set_parallel(bool parallel) { m_parallel = parallel; }
+
+    // multi-step decode pushes tokens of running sequence groups to their streams once per several steps
+    void set_notify_finished_only(bool notify_finished_only) { m_notify_finished_only = notify_finished_only; }
 };
 
 SamplerOutput Sampler::sample(std::vector<SequenceGroup::Ptr> & sequence_groups, ov::Tensor logits) {
+    std::vector<uint64_t> scheduled_sequence_group_ids;
+    for (size_t sequence_group_id = 0; sequence_group_id < sequence_groups.size(); ++sequence_group_id) {
+        if (sequence_groups[sequence_group_id]->is_scheduled())
+            scheduled_sequence_group_ids.push_back(sequence_group_id);
+    }
+    return sample(sequence_groups, logits, scheduled_sequence_group_ids);
+}
+
+SamplerOutput Sampler::sample(std::vector<SequenceGroup::Ptr> & sequence_groups, ov::Tensor logits, const std::vector<uint64_t>& sequence_group_ids) {
     const float * logits_data = logits.data<float>();
     ov::Shape logits_shape = logits.get_shape();
     OPENVINO_ASSERT(logits_shape.size() == 3);
     size_t batch_seq_len = logits_shape[1], vocab_size = logits_shape[2];
 
-    SamplerOutput sampler_output;
+    // model can compute logits only for sampled tokens (see apply_paged_attention_transformations)
+    size_t total_num_scheduled_tokens = 0;
+    for (uint64_t sequence_group_id : sequence_group_ids) {
+        SequenceGroup::CPtr sequence_group = sequence_groups[sequence_group_id];
+        if (sequence_group->is_scheduled())
+            total_num_scheduled_tokens += std::max(sequence_group->get_num_scheduled_tokens(), batch_seq_len) * sequence_group->num_running_seqs();
+    }
+    const bool sampled_logits_only = batch_seq_len == 1 && logits_shape[0] != total_num_scheduled_tokens;
 
-    for (size_t sequence_group_id = 0, currently_processed_tokens = 0; sequence_group_id < sequence_groups.size(); ++sequence_group_id) {
-        SequenceGroup::Ptr sequence_group = sequence_groups[sequence_group_id];
+    // serial part: compute logits offsets and create beam search state, so parallel part does not modify shared maps
+    std::vector<SequenceGroup::Ptr> scheduled_groups;
+    std::vector<size_t> logits_offsets, logits_seq_lens;
+    for (size_t i = 0, currently_processed_tokens = 0; i < sequence_group_ids.size(); ++i) {
+        SequenceGroup::Ptr sequence_group = sequence_groups[sequence_group_ids[i]];
         if (!sequence_group->is_scheduled())
             continue;
 
         size_t num_running_sequences = sequence_group->num_running_seqs();
-        size_t actual_seq_len = sequence_group->get_num_scheduled_tokens(); // points to a token which needs to be sampled
-        size_t padded_amount_of_processed_tokens = std::max(actual_seq_len, batch_seq_len);
+        // the last token always points to a token which needs to be sampled
+        size_t actual_seq_len = sampled_logits_only ? sequence_group->get_num_sampled_tokens() : sequence_group->get_num_scheduled_tokens();
+        size_t padded_amount_of_processed_tokens = sampled_logits_only ? actual_seq_len : std::max(actual_seq_len, batch_seq_len);
         const GenerationConfig& sampling_params = sequence_group->get_sampling_parameters();
 
-        const auto request_id = sequence_group->get_request_id();
-        if (!m_logit_processors.count(request_id)) {
-            m_logit_processors.insert({request_id, LogitProcessor(sampling_params, sequence_group->get_prompt_ids())});
+        const auto group_id = sequence_group->get_group_id();
+        if (sequence_group->requires_sampling() && sampling_params.is_beam_search()) {
+            // create beam search info if we are on the first generate
+            // or re-create it if sequence group is returned after preemption and became empty
+            auto beam_search_it = m_beam_search_info.find(group_id);
+            if (beam_search_it == m_beam_search_info.end() || sequence_group->is_empty()) {
+                if (beam_search_it != m_beam_search_info.end())
+                    m_beam_search_info.erase(beam_search_it);
+                m_beam_search_info.emplace(group_id, GroupBeamSearcher(sequence_group));
+            }
         }
-        auto& logit_processor = m_logit_processors.at(request_id);
 
-        const void * sequence_group_logits_data = logits_data + vocab_size * currently_processed_tokens;
+        scheduled_groups.push_back(sequence_group);
+        logits_offsets.push_back(vocab_size * currently_processed_tokens);
+        logits_seq_lens.push_back(actual_seq_len);
+
+        // accumulate a number of processed tokens
+        currently_processed_tokens += padded_amount_of_processed_tokens * num_running_sequences;
+    }
+
+    // parallel part: sequence groups are independent, outputs are merged in the original order afterwards
+    std::vector<SamplerOutput> group_outputs(scheduled_groups.size());
+    auto sample_group = [&] (size_t group_idx) {
+        SequenceGroup::Ptr sequence_group = scheduled_groups[group_idx];
+        size_t num_running_sequences = sequence_group->num_running_seqs();
+        size_t actual_seq_len = logits_seq_lens[group_idx];
+        const void * sequence_group_logits_data = logits_data + logits_offsets[group_idx];
         ov::Tensor sequence_group_logits(ov::element::f32, ov::Shape{num_running_sequences, actual_seq_len, vocab_size}, (void *)sequence_group_logits_data);
+        _sample_sequence_group(sequence_group, sequence_group_logits, group_outputs[group_idx]);
+    };
 
-        if (sequence_group->requires_sampling()) {
-            if (sampling_params.is_greedy_sampling() || sampling_params.is_multinomial()) {
-                std::vector<Sequence::Ptr> running_sequences = sequence_group->get_running_sequences();
-                if (sampling_params.is_greedy_sampling()) {
-                    OPENVINO_ASSERT(num_running_sequences == 1);
-                }
-                auto register_new_token = [&](const Token& sampled_token_id, Sequence::Ptr running_sequence) {
-                    logit_processor.register_new_generated_token(sampled_token_id.m_index);
-                    running_sequence->append_token(sampled_token_id.m_index, sampled_token_id.m_log_prob);
-                };
-                for (size_t running_sequence_id = 0; running_sequence_id < num_running_sequences; ++running_sequence_id) {
-                    auto logit_vector = _get_logit_vector(sequence_group_logits, running_sequence_id);
-                    logit_vector = logit_processor.apply(logit_vector);
-
-                    Token sampled_token_id;
-                    if (sampling_params.is_greedy_sampling()) {
-                        sampled_token_id = _greedy_sample(logit_vector);
-                    } else {
-                        // is_multinomial()
-                        const bool is_generate_n_tokens = sequence_group->num_total_seqs() == 1;
-                        const size_t num_tokens_per_sequence = is_generate_n_tokens ? sampling_params.num_return_sequences : 1;
-                        auto sampled_token_ids = _multinomial_sample(logit_vector, num_tokens_per_sequence);
-                        sampled_token_id = sampled_token_ids[0];
-
-                        if (is_generate_n_tokens) {
-                            auto sequence_to_fork = running_sequences[0];
-                            std::list<uint64_t> forked_seq_ids;
-                            for (size_t i = num_running_sequences; i < num_tokens_per_sequence; ++i) {
-                                const auto forked_sequence = sequence_group->fork_sequence(sequence_to_fork);
-                                forked_seq_ids.push_back(forked_sequence->get_id());
-                                register_new_token(sampled_token_ids[i], forked_sequence);
-                            }
-                            sampler_output.m_forked_sequences.insert({running_sequences[0]->get_id(), forked_seq_ids});
-                        }
-                    }
-                    
-                    register_new_token(sampled_token_id, running_sequences[running_sequence_id]);
-                }
-                logit_processor.increment_gen_tokens();
-                for (const auto& dropped_seq_id : sequence_group->try_finish_generation()) {
-                    sampler_output.m_dropped_sequences.push_back(dropped_seq_id);
-                }
-            } else if (sampling_params.is_beam_search()) {
-                uint64_t request_id = sequence_group->get_request_id();
+    if (m_parallel && scheduled_groups.size() > 1) {
+        ov::parallel_for(scheduled_groups.size(), sample_group);
+    } else {
+        for (size_t group_idx = 0; group_idx < scheduled_groups.size(); ++group_idx)
+            sample_group(group_idx);
+    }
 
-                // create beam search info if we are on the first generate
-                if (m_beam_search_info.find(request_id) == m_beam_search_info.end()) {
-                    m_beam_search_info.emplace(request_id, GroupBeamSearcher(sequence_group));
-                }
-                else {
-                    // sequence group can be empty if returned after preemption
-                    if (sequence_group->is_empty()) {
-                        // clear beam search info
-                        m_beam_search_info.erase(request_id);
-                        m_beam_search_info.emplace(request_id, GroupBeamSearcher(sequence_group));
-                    }
-                }
+    SamplerOutput sampler_output;
+    for (const SamplerOutput& group_output : group_outputs) {
+        sampler_output.m_dropped_sequences.insert(sampler_output.m_dropped_sequences.end(),
+            group_output.m_dropped_sequences.begin(), group_output.m_dropped_sequences.end());
+        sampler_output.m_forked_sequences.insert(group_output.m_forked_sequences.begin(), group_output.m_forked_sequences.end());
+    }
 
+    return sampler_output;
+}
+
+void Sampler::sample_candidates(std::vector<SequenceGroup::Ptr> & sequence_groups, ov::Tensor logits, const std::vector<uint64_t>& sequence_group_ids, size_t draft_step) {
+    const float * logits_data = logits.data<float>();
+    ov::Shape logits_shape = logits.get_shape();
+    OPENVINO_ASSERT(logits_shape.size() == 3);
+    size_t batch_seq_len = logits_shape[1], vocab_size = logits_shape[2];
 
-                // current algorithm already adds new tokens to running sequences and
-                m_beam_search_info.at(request_id).select_next_tokens(sequence_group_logits, sampler_output);
+    size_t total_num_draft_tokens = 0;
+    for (uint64_t sequence_group_id : sequence_group_ids) {
+        size_t num_draft_tokens = sequence_groups[sequence_group_id]->get_num_draft_tokens(draft_step);
+        total_num_draft_tokens += num_draft_tokens > 0 ? std::max(num_draft_tokens, batch_seq_len) : 0;
+    }
+    const bool sampled_logits_only = batch_seq_len == 1 && logits_shape[0] != total_num_draft_tokens;
 
-                // check max length stop criteria
-                std::vector<Sequence::Ptr> running_sequences = sequence_group->get_running_sequences();
-                if (!sequence_group->has_finished() &&
-                    running_sequences[0]->get_generated_len() == sampling_params.max_new_tokens) {
-                    // stop sequence by max_new_tokens
-                    m_beam_search_info.at(request_id).finalize(sampler_output);
-                }
+    for (size_t i = 0, currently_processed_tokens = 0; i < sequence_group_ids.size(); ++i) {
+        SequenceGroup::Ptr sequence_group = sequence_groups[sequence_group_ids[i]];
+        size_t num_draft_tokens = sampled_logits_only ? sequence_group->get_num_sampled_draft_tokens(draft_step) :
+                                                        sequence_group->get_num_draft_tokens(draft_step);
+        if (num_draft_tokens == 0)
+            continue;
+
+        // draft model processes only groups with a single running sequence
+        const float * sequence_group_logits_data = logits_data + vocab_size * currently_processed_tokens;
+        currently_processed_tokens += sampled_logits_only ? num_draft_tokens : std::max(num_draft_tokens, batch_seq_len);
+
+        // group only keeps draft KV cache in sync on this step
+        if (draft_step >= sequence_group->get_num_candidate_tokens())
+            continue;
+
+        ov::Tensor sequence_group_logits(ov::element::f32, ov::Shape{1, num_draft_tokens, vocab_size}, (void *)sequence_group_logits_data);
+        const GenerationConfig& sampling_params = sequence_group->get_sampling_parameters();
+        Sequence::Ptr sequence = sequence_group->get_running_sequences()[0];
+
+        DraftCandidates& draft_candidates = m_draft_candidates[sequence_group->get_group_id()];
+        if (draft_step == 0) {
+            draft_candidates.m_logit_processor = sequence->get_logit_processor().fork();
+            draft_candidates.m_probs.clear();
+        }
+        LogitProcessor& logit_processor = *draft_candidates.m_logit_processor;
+
+        Token candidate;
+        if (sampling_params.is_greedy_sampling() && logit_processor.is_identity()) {
+            candidate = _greedy_sample(sequence_group_logits, 0);
+        } else {
+            auto logit_vector = _get_logit_vector(sequence_group_logits, 0);
+            logit_processor.apply(logit_vector);
+            if (sampling_params.is_greedy_sampling()) {
+                candidate = _greedy_sample(logit_vector);
+            } else {
+                candidate = _multinomial_sample(logit_vector, 1, sequence_group->get_rng_engine())[0];
+                draft_candidates.m_probs.push_back(_get_dense_probs(logit_vector, vocab_size));
             }
-            // Notify handle after sampling is done. 
-            // For non-streaming this is effective only when the generation is finished.
-            sequence_group->notify_handle();
+        }
+
+        logit_processor.register_new_generated_token(candidate.m_index);
+        logit_processor.increment_gen_tokens();
+        // candidates are replaced with validated tokens later, so they don't contribute to cumulative log probability
+        sequence->append_token(candidate.m_index, 0.0f);
+    }
+}
+
+size_t Sampler::_validate_candidates(SequenceGroup::Ptr sequence_group, ov::Tensor sequence_group_logits) {
+    const GenerationConfig& sampling_params = sequence_group->get_sampling_parameters();
+    const size_t num_candidates = sequence_group->get_num_candidate_tokens(), vocab_size = sequence_group_logits.get_shape()[2];
+    // prompt lookup also processes the last candidate, which gives one more token if all candidates are accepted
+    const size_t num_validated_tokens = sequence_group_logits.get_shape()[1];
+    OPENVINO_ASSERT(sequence_group->num_running_seqs() == 1 && num_validated_tokens == sequence_group->get_num_scheduled_tokens());
+
+    Sequence::Ptr sequence = sequence_group->get_running_sequences()[0];
+    LogitProcessor& logit_processor = sequence->get_logit_processor();
+    std::mt19937& rng_engine = sequence_group->get_rng_engine();
+    // candidates of prompt lookup are deterministic, so their draft distribution is one-hot
+    // map is not modified here, so concurrent lookups are safe
+    const DraftCandidates* draft_candidates = sequence_group->is_prompt_lookup() ? nullptr : &m_draft_candidates.find(sequence_group->get_group_id())->second;
+    OPENVINO_ASSERT(!draft_candidates || sampling_params.is_greedy_sampling() || draft_candidates->m_probs.size() == num_candidates);
+
+    const TokenIds candidates(sequence->get_generated_ids().end() - num_candidates, sequence->get_generated_ids().end());
+    sequence->remove_last_tokens(num_candidates);
+
+    size_t num_generated_tokens = 0;
+    while (num_generated_tokens < num_validated_tokens) {
+        // logits of i-th token give distribution of i-th candidate
+        const size_t token_idx = num_generated_tokens;
+        const bool has_candidate = token_idx < num_candidates;
+        const int64_t candidate = has_candidate ? candidates[token_idx] : -1;
+        OPENVINO_ASSERT(candidate < static_cast<int64_t>(vocab_size), "Candidate token ", candidate, " is out of model vocabulary");
+        bool accepted = false;
+        Token token;
+
+        if (sampling_params.is_greedy_sampling()) {
+            if (logit_processor.is_identity()) {
+                token = _greedy_sample(sequence_group_logits, 0, token_idx);
+            } else {
+                auto logit_vector = _get_logit_vector(sequence_group_logits, 0, token_idx);
+                logit_processor.apply(logit_vector);
+                token = _greedy_sample(logit_vector);
+            }
+            accepted = token.m_index == candidate;
         } else {
-            // we are in prompt processing phase when prompt is split into chunks and processed step by step
+            auto logit_vector = _get_logit_vector(sequence_group_logits, 0, token_idx);
+            logit_processor.apply(logit_vector);
+            if (!has_candidate) {
+                token = _multinomial_sample(logit_vector, 1, rng_engine)[0];
+            } else {
+                const std::vector<float> probs = _get_dense_probs(logit_vector, vocab_size);
+                std::vector<float> draft_probs(vocab_size, 0.0f);
+                if (draft_candidates) {
+                    // vocabulary of draft model can be padded differently
+                    const std::vector<float>& candidate_probs = draft_candidates->m_probs[token_idx];
+                    std::copy_n(candidate_probs.begin(), std::min(vocab_size, candidate_probs.size()), draft_probs.begin());
+                } else {
+                    draft_probs[candidate] = 1.0f;
+                }
+
+                // candidate is accepted with probability min(1, p / q)
+                accepted = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng_engine) * draft_probs[candidate] < probs[candidate];
+                if (accepted) {
+                    token = Token(probs[candidate], candidate);
+                } else {
+                    // otherwise a token is sampled from normalized max(0, p - q)
+                    std::vector<float> residual_probs(vocab_size);
+                    float residual_sum = 0.0f;
+                    for (size_t i = 0; i < vocab_size; ++i)
+                        residual_sum += residual_probs[i] = std::max(0.0f, probs[i] - draft_probs[i]);
+                    const std::vector<float>& weights = residual_sum > 0.0f ? residual_probs : probs;
+                    size_t token_id = std::discrete_distribution<size_t>(weights.begin(), weights.end())(rng_engine);
+                    token = Token(probs[token_id], token_id);
+                }
+            }
         }
 
-        // NOTE: it should be before 'get_num_scheduled_tokens' is used
-        // update internal state of sequence group to reset scheduler tokens and update currently processed ones
+        logit_processor.register_new_generated_token(token.m_index);
+        logit_processor.increment_gen_tokens();
+        sequence->append_token(token.m_index, token.m_log_prob);
+        ++num_generated_tokens;
+
+        // tokens after EOS are not needed
+        if (!accepted || sampling_params.is_stop_token(token.m_index))
+            break;
+    }
+
+    // KV cache of the last generated token is not computed yet, so it's valid up to the last accepted candidate
+    return num_validated_tokens - num_generated_tokens;
+}
+
+void Sampler::_score_sequence_group(SequenceGroup::Ptr sequence_group, ov::Tensor sequence_group_logits, SamplerOutput& sampler_output) {
+    const ov::Shape logits_shape = sequence_group_logits.get_shape();
+    OPENVINO_ASSERT(logits_shape[0] == 1, "Scoring is supported only for a single sequence");
+    const size_t seq_len = logits_shape[1], vocab_size = logits_shape[2];
+    const size_t num_sampled_tokens = sequence_group->get_num_sampled_tokens();
+    OPENVINO_ASSERT(num_sampled_tokens <= seq_len);
+
+    const TokenIds& prompt_ids = sequence_group->get_prompt_ids();
+    const size_t prompt_len = prompt_ids.size(), context_len = sequence_group->get_context_len();
+    const float* logits_data = sequence_group_logits.data<const float>();
+    // logits rows correspond to the last tokens of a chunk; logits of the last prompt token predict a token, which is not scored
+    for (size_t row_idx = 0, position = context_len - num_sampled_tokens; row_idx < num_sampled_tokens && position + 1 < prompt_len; ++row_idx, ++position) {
+        const float* row_logits = logits_data + (seq_len - num_sampled_tokens + row_idx) * vocab_size;
+        sequence_group->set_scored_log_prob(position, token_log_softmax(row_logits, vocab_size, prompt_ids[position + 1]));
+    }
+
+    if (context_len == prompt_len) {
+        Sequence::Ptr sequence = (*sequence_group)[0];
+        sequence->set_status(SequenceStatus::FINISHED);
+        sampler_output.m_dropped_sequences.push_back(sequence->get_id());
+        sequence_group->notify_handle();
+    }
+    sequence_group->finish_iteration();
+}
+
+void Sampler::_sample_sequence_group(SequenceGroup::Ptr sequence_group, ov::Tensor sequence_group_logits, SamplerOutput& sampler_output) {
+    if (sequence_group->is_scoring()) {
+        _score_sequence_group(sequence_group, sequence_group_logits, sampler_output);
+        return;
+    }
+    if (sequence_group->is_exporting_kv_cache()) {
+        // nothing is sampled: request finishes with its prompt, while handle is notified by pipeline after KV cache is exported
+        if (sequence_group->get_context_len() + 1 == sequence_group->get_prompt_len()) {
+            Sequence::Ptr sequence = (*sequence_group)[0];
+            sequence->set_status(SequenceStatus::FINISHED);
+            sampler_output.m_dropped_sequences.push_back(sequence->get_id());
+        }
         sequence_group->finish_iteration();
+        return;
+    }
 
-        // accumulate a number of processed tokens
-        currently_processed_tokens += padded_amount_of_processed_tokens * num_running_sequences;
+    size_t num_running_sequences = sequence_group->num_running_seqs();
+    const GenerationConfig& sampling_params = sequence_group->get_sampling_parameters();
+    // each request has its own random stream, so results depend neither on batch composition nor on threads
+    std::mt19937& rng_engine = sequence_group->get_rng_engine();
+    // a number of tokens processed by the model, which are dropped after validation of speculative candidates
+    size_t num_rejected_tokens = 0;
+
+    if (sequence_group->requires_sampling()) {
+        if (sequence_group->get_num_candidate_tokens() > 0) {
+            num_rejected_tokens = _validate_candidates(sequence_group, sequence_group_logits);
+            for (const auto& dropped_seq_id : sequence_group->try_finish_generation()) {
+                sampler_output.m_dropped_sequences.push_back(dropped_seq_id);
+            }
+        } else if (sampling_params.is_greedy_sampling() || sampling_params.is_multinomial()) {
+            std::vector<Sequence::Ptr> running_sequences = sequence_group->get_running_sequences();
+            if (sampling_params.is_greedy_sampling()) {
+                OPENVINO_ASSERT(num_running_sequences == 1);
+            }
+            auto register_new_token = [&](const Token& sampled_token_id, Sequence::Ptr running_sequence) {
+                LogitProcessor& logit_processor = running_sequence->get_logit_processor();
+                logit_processor.register_new_generated_token(sampled_token_id.m_index);
+                logit_processor.increment_gen_tokens();
+                running_sequence->append_token(sampled_token_id.m_index, sampled_token_id.m_log_prob);
+            };
+            for (size_t running_sequence_id = 0; running_sequence_id < num_running_sequences; ++running_sequence_id) {
+                LogitProcessor& logit_processor = running_sequences[running_sequence_id]->get_logit_processor();
+                Token sampled_token_id;
+                if (sampling_params.is_greedy_sampling() && logit_processor.is_identity()) {
+                    // fast path: no logits transformations are required
+                    sampled_token_id = _greedy_sample(sequence_group_logits, running_sequence_id);
+                    register_new_token(sampled_token_id, running_sequences[running_sequence_id]);
+                    continue;
+                }
+
+                auto logit_vector = _get_logit_vector(sequence_group_logits, running_sequence_id);
+                logit_processor.apply(logit_vector);
+
+                if (sampling_params.is_greedy_sampling()) {
+                    sampled_token_id = _greedy_sample(logit_vector);
+                } else {
+                    // is_multinomial()
+                    const bool is_generate_n_tokens = sequence_group->num_total_seqs() == 1;
+                    const size_t num_tokens_per_sequence = is_generate_n_tokens ? sampling_params.num_return_sequences : 1;
+                    auto sampled_token_ids = _multinomial_sample(logit_vector, num_tokens_per_sequence, rng_engine);
+                    sampled_token_id = sampled_token_ids[0];
+
+                    if (is_generate_n_tokens) {
+                        auto sequence_to_fork = running_sequences[0];
+                        std::list<uint64_t> forked_seq_ids;
+                        for (size_t i = num_running_sequences; i < num_tokens_per_sequence; ++i) {
+                            const auto forked_sequence = sequence_group->fork_sequence(sequence_to_fork);
+                            forked_seq_ids.push_back(forked_sequence->get_id());
+                            register_new_token(sampled_token_ids[i], forked_sequence);
+                        }
+                        sampler_output.m_forked_sequences.insert({running_sequences[0]->get_id(), forked_seq_ids});
+                    }
+                }
+
+                register_new_token(sampled_token_id, running_sequences[running_sequence_id]);
+            }
+            for (const auto& dropped_seq_id : sequence_group->try_finish_generation()) {
+                sampler_output.m_dropped_sequences.push_back(dropped_seq_id);
+            }
+        } else if (sampling_params.is_beam_search()) {
+            // map is not modified here, so concurrent lookups are safe
+            GroupBeamSearcher& beam_searcher = m_beam_search_info.find(sequence_group->get_group_id())->second;
+
+            // current algorithm already adds new tokens to running sequences and
+            beam_searcher.select_next_tokens(sequence_group_logits, sampler_output);
+
+            // check max length stop criteria
+            std::vector<Sequence::Ptr> running_sequences = sequence_group->get_running_sequences();
+            if (!sequence_group->has_finished() &&
+                running_sequences[0]->get_generated_len() == sampling_params.max_new_tokens) {
+                // stop sequence by max_new_tokens
+                beam_searcher.finalize(sampler_output);
+            }
+        }
+        // Notify handle after sampling is done. 
+        // For non-streaming this is effective only when the generation is finished.
+        if (!m_notify_finished_only || sequence_group->has_finished())
+            sequence_group->notify_handle();
+    } else {
+        // we are in prompt processing phase when prompt is split into chunks and processed step by step
     }
 
-    return sampler_output;
+    // NOTE: it should be before 'get_num_scheduled_tokens' is used
+    // update internal state of sequence group to reset scheduler tokens and update currently processed ones
+    sequence_group->finish_iteration();
+    if (num_rejected_tokens > 0)
+        sequence_group->rollback_processed_tokens(num_rejected_tokens);
 }
 
 GroupBeamSearcher::GroupBeamSearcher(SequenceGroup::Ptr sequence_group)
@@ -383,20 +747,22 @@ void GroupBeamSearcher::select_next_tokens(const ov::Tensor& logits, SamplerOutp
     // parent sequence ID -> number of child sequences
     std::map<uint64_t, uint64_t> parent_2_num_childs_map;
 
+    // here we need to map index of sequence in beam search group(s) and sequence group
+    std::unordered_map<uint64_t, size_t> seq_id_2_global_beam_idx;
+    {
+        std::vector<Sequence::Ptr> running_seqs = m_sequence_group->get_running_sequences();
+        for (size_t seq_global_index = 0; seq_global_index < running_seqs.size(); ++seq_global_index)
+            seq_id_2_global_beam_idx[running_seqs[seq_global_index]->get_id()] = seq_global_index;
+    }
+
     for (Group& group : m_groups) {
         if (!group.done) {
             for (Beam& beam : group.ongoing) {
                 uint64_t parent_seq_id = beam.m_sequence->get_id();
 
-                // here we need to map index of sequence in beam search group(s) and sequence group
-                beam.m_global_beam_idx = [this] (uint64_t seq_id) -> size_t {
-                    std::vector<Sequence::Ptr> running_seqs = m_sequence_group->get_running_sequences();
-                    for (size_t seq_global_index = 0; seq_global_index < running_seqs.size(); ++seq_global_index) {
-                        if (seq_id == running_seqs[seq_global_index]->get_id())
-                            return seq_global_index;
-                    }
-                    OPENVINO_THROW("Internal error in beam search: should not be here");
-                } (parent_seq_id);
+                auto global_beam_idx_it = seq_id_2_global_beam_idx.find(parent_seq_id);
+                OPENVINO_ASSERT(global_beam_idx_it != seq_id_2_global_beam_idx.end(), "Internal error in beam search: should not be here");
+                beam.m_global_beam_idx = global_beam_idx_it->second;
 
                 // zero out all parent forks counts
                 parent_2_num_childs_map[parent_seq_id] = 0;
@@ -449,30 +815,32 @@ void GroupBeamSearcher::select_next_tokens(const ov::Tensor& logits, SamplerOutp
         std::vector<Beam> candidates;
         candidates.reserve(m_parameters.group_size * 2 * m_parameters.group_size);
 
-        for (const Beam& beam : group.ongoing) {
-            std::vector<Token> tokens = log_softmax(logits, beam.m_global_beam_idx);
-
-            // apply diversity penalty
-            for (auto prev_group_id = 0; prev_group_id < group_id; ++prev_group_id) {
-                for (const Beam& prev_beam : child_beams_per_group[prev_group_id]) {
-                    tokens[prev_beam.m_token_id].m_log_prob -= m_parameters.diversity_penalty;
-                }
+        // apply diversity penalty
+        std::unordered_map<int64_t, float> group_penalties;
+        for (auto prev_group_id = 0; prev_group_id < group_id; ++prev_group_id) {
+            for (const Beam& prev_beam : child_beams_per_group[prev_group_id]) {
+                group_penalties[prev_beam.m_token_id] += m_parameters.diversity_penalty;
             }
+        }
+
+        for (const Beam& beam : group.ongoing) {
+            std::unordered_map<int64_t, float> penalties = group_penalties;
 
             // apply n_gramm
-            std::vector<int64_t> full_text{m_sequence_group->get_prompt_ids()};
-            full_text.insert(full_text.end(), beam.m_sequence->get_generated_ids().begin(), beam.m_sequence->get_generated_ids().end());
-            if (full_text.size() > 1 && full_text.size() >= m_parameters.no_repeat_ngram_size) {
+            const std::vector<int64_t>& prompt_ids = m_sequence_group->get_prompt_ids();
+            const std::vector<int64_t>& generated_ids = beam.m_sequence->get_generated_ids();
+            size_t full_text_size = prompt_ids.size() + generated_ids.size();
+            if (full_text_size > 1 && full_text_size >= m_parameters.no_repeat_ngram_size) {
+                std::vector<int64_t> full_text{prompt_ids};
+                full_text.insert(full_text.end(), generated_ids.begin(), generated_ids.end());
                 auto tail_start = full_text.end() - ptrdiff_t(m_parameters.no_repeat_ngram_size) + 1;
                 for (int64_t banned_token : kmp_search(full_text, {tail_start, full_text.end()})) {
-                    tokens[banned_token].m_log_prob = -std::numeric_limits<float>::infinity();
+                    penalties[banned_token] = std::numeric_limits<float>::infinity();
                 }
             }
 
-            // sort tokens
-            std::sort(tokens.begin(), tokens.end(), [](Token left, Token right) {
-                return left.m_log_prob > right.m_log_prob;  // Most probable tokens in front
-            });
+            // only 2 * group_size best tokens of each beam can become candidates
+            std::vector<Token> tokens = top_k_log_softmax(logits, beam.m_global_beam_idx, 2 * m_parameters.group_size, penalties);
 
             size_t add_count = 0;
             for (Token token : tokens) {
@@ -501,7 +869,7 @@ void GroupBeamSearcher::select_next_tokens(const ov::Tensor& logits, SamplerOutp
 
         for (size_t cand_idx = 0; cand_idx < candidates.size(); ++cand_idx) {
             Beam & candidate = candidates[cand_idx];
-            if (m_parameters.eos_token_id == candidate.m_token_id) {
+            if (m_parameters.eos_token_id == candidate.m_token_id || m_parameters.stop_token_ids.count(candidate.m_token_id) > 0) {
                 // If beam_token does not belong to top num_beams tokens, it should not be added
                 if (cand_idx >= m_parameters.group_size)
                     continue;
@@ -4,7 +4,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdlib>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "block_manager.hpp"
@@ -15,13 +21,36 @@
 class Scheduler {
     SchedulerConfig m_config;
     BlockManager m_block_manager;
+    // fair share: active tenant => scheduled tokens divided by weight of the tenant (virtual time of weighted fair queuing)
+    std::map<size_t, double> m_tenant_virtual_times;
+    // tenants, which had requests to process on the last step
+    std::set<size_t> m_active_tenants;
 
 public:
+    // resources of a tenant on a step (see SchedulerConfig::enable_fair_share)
+    struct TenantUsage {
+        size_t m_num_scheduled_tokens = 0;
+        // KV blocks in block tables of sequences of the tenant (blocks shared by sequences are counted by each of them)
+        size_t m_num_kv_blocks = 0;
+        size_t m_num_preemptions = 0;
+    };
+
+    // blob's blocks starting from 'm_first_block_idx' are written to 'm_block_ids'; the previous ones are restored from prefix cache
+    struct KVCacheImport {
+        KVCacheBlob::Ptr m_kv_cache;
+        size_t m_first_block_idx = 0;
+        std::vector<size_t> m_block_ids;
+    };
+
     struct Output {
         // IDs of scheduled groups
         std::vector<uint64_t> m_scheduled_sequence_groups_ids;
         // map of src -> dst blocks copies, which need to be performed by CacheManager
         std::map<size_t, std::list<size_t>> m_block_copy_map;
+        // map of device -> swap blocks copies for sequence groups preempted by swapping
+        std::map<size_t, size_t> m_swap_out_block_map;
+        // map of swap -> device blocks copies for swapped sequence groups, which are scheduled again
+        std::map<size_t, size_t> m_swap_in_block_map;
         // block tables for scheduled sequences
         std::map<uint64_t, std::vector<KVCacheBlock::Ptr>> m_block_tables;
         // total number of scheduled tokens
@@ -30,38 +59,95 @@ public:
         bool is_prompt = false;
         // current cache usage
         float m_cache_usage = 0.0;
+        // number of KV blocks, which must be allocated by CacheManager before execution of this step
+        size_t m_num_kv_blocks = 0;
+        // number of sequence groups preempted on this step by swapping or recomputation
+        size_t m_num_preemptions = 0;
+        // KV caches imported on this step, which need to be written to allocated blocks by CacheManager
+        std::vector<KVCacheImport> m_kv_cache_imports;
+        // tenant => its resources after this step; filled only for fair share scheduling
+        std::map<size_t, TenantUsage> m_tenant_usage;
     };
 
     explicit Scheduler(const SchedulerConfig & config = {}) :
-        m_config(config), m_block_manager(m_config.num_kv_blocks) { }
+        m_config(config),
+        m_block_manager(_get_initial_num_kv_blocks(m_config), m_config.enable_prefix_caching, m_config.num_swap_blocks, m_config.num_kv_blocks) {
+        OPENVINO_ASSERT(!m_config.enable_prefix_caching || m_config.dynamic_split_fuse,
+            "Prefix caching is supported only with dynamic_split_fuse scheduling");
+        OPENVINO_ASSERT(m_config.min_prefill_chunk_size < m_config.max_num_batched_tokens,
+            "Min prefill chunk size (", m_config.min_prefill_chunk_size, ") must be less than max number of tokens in batch (", m_config.max_num_batched_tokens, ")");
+        OPENVINO_ASSERT(m_config.max_prefill_fraction > 0.0f && m_config.max_prefill_fraction <= 1.0f,
+            "Max prefill fraction must be in the interval (0, 1]");
+        OPENVINO_ASSERT(m_config.num_decode_steps > 0, "Number of decode steps must be positive");
+        OPENVINO_ASSERT(!m_config.enable_prefix_caching || m_config.kv_window_blocks == 0,
+            "Prefix caching is not supported with sliding window KV cache");
+        OPENVINO_ASSERT(!m_config.enable_prefix_grouping || m_config.enable_prefix_caching,
+            "Prefix grouping requires prefix caching");
+        OPENVINO_ASSERT(!m_config.enable_fair_share || m_config.dynamic_split_fuse,
+            "Fair share scheduling is supported only with dynamic_split_fuse scheduling");
+        for (const auto& tenant : m_config.tenants)
+            OPENVINO_ASSERT(tenant.second.weight > 0.0f, "Weight of tenant ", tenant.first, " must be positive");
+    }
 
     Output schedule(std::vector<SequenceGroup::Ptr>& sequence_groups) {
         Output scheduler_output;
 
+        // swap blocks of sequences swapped in on previous step are already copied by CacheManager
+        m_block_manager.free_swapped_in_blocks();
+
+        if (m_config.enable_prefix_caching) {
+            // blocks computed on previous step become available for prefix matching
+            for (const SequenceGroup::CPtr& sequence_group : sequence_groups) {
+                m_block_manager.update_cached_blocks(sequence_group);
+            }
+        }
+
+        if (m_config.enable_fair_share)
+            _update_tenants(sequence_groups, scheduler_output);
+        // the same order is used by both phases, so it's computed before any tokens are scheduled
+        const std::vector<size_t> schedule_order = _get_schedule_order(sequence_groups);
+
         if (m_config.dynamic_split_fuse) {
             // deepspeed-mii case
-            // generation phase is always scheduled first
-            _schedule_generate_phase_dynamic_split_fuse(sequence_groups, scheduler_output);
+            // generation phase is always scheduled first, but a part of megabatch is reserved for prompts
+            size_t num_reserved_prompt_tokens = _has_prompts_to_process(sequence_groups) ? m_config.min_prefill_chunk_size : 0;
+            _schedule_generate_phase_dynamic_split_fuse(sequence_groups, schedule_order, scheduler_output, m_config.max_num_batched_tokens - num_reserved_prompt_tokens);
             // some tokens from generation prompt are also scheduled
-            _schedule_prompt_phase_dynamic_split_fuse(sequence_groups, scheduler_output);
+            _schedule_prompt_phase_dynamic_split_fuse(sequence_groups, schedule_order, scheduler_output);
         } else {
             // vLLM case
             // schedule prompt phase using whole prompt's input_ids
             // note, that we also apply padding, while need to be considered by model runner
 
-            _schedule_prompt_phase_vllm(sequence_groups, scheduler_output);
+            _schedule_prompt_phase_vllm(sequence_groups, schedule_order, scheduler_output);
 
             if (!scheduler_output.is_prompt) {
                 // prompt sequences are not scheduler => scheduler generation phase by dynamic_split_fuse implementation
-                _schedule_generate_phase_dynamic_split_fuse(sequence_groups, scheduler_output);
+                _schedule_generate_phase_dynamic_split_fuse(sequence_groups, schedule_order, scheduler_output, m_config.max_num_batched_tokens);
             }
         }
 
+        // model runner and sampler process groups in this order, so keep it consistent with order of 'sequence_groups'
+        std::sort(scheduler_output.m_scheduled_sequence_groups_ids.begin(), scheduler_output.m_scheduled_sequence_groups_ids.end());
+
+        // tenants advance in virtual time by their scheduled tokens, so tenants of higher weight advance slower
+        for (const auto& tenant_usage : scheduler_output.m_tenant_usage)
+            m_tenant_virtual_times[tenant_usage.first] += tenant_usage.second.m_num_scheduled_tokens / _get_tenant_config(tenant_usage.first).weight;
+
         _clear_waiting_sequences(sequence_groups);
         scheduler_output.m_cache_usage = m_block_manager.get_used_percentage();
+        scheduler_output.m_num_kv_blocks = m_block_manager.get_total_num_blocks();
         return scheduler_output;
     }
 
+    // shrinks lazily allocated KV cache to a single chunk, when all sequences are freed;
+    // returns a number of KV blocks, which must be allocated by CacheManager
+    size_t release_idle_kv_cache() {
+        if (m_config.num_kv_blocks_per_chunk > 0 && m_block_manager.num_free_blocks() == m_block_manager.get_total_num_blocks())
+            m_block_manager.resize(_get_initial_num_kv_blocks(m_config));
+        return m_block_manager.get_total_num_blocks();
+    }
+
     const std::vector<KVCacheBlock::Ptr>& get_block_table(const Sequence& seq) {
         return m_block_manager.get_block_table(seq.get_id());
     }
@@ -82,7 +168,350 @@ public:
         return m_config;
     }
 
+    // multi-step decode: reserves KV cache for up to 'max_num_tokens' more tokens of each running sequence of groups
+    // scheduled by 'scheduler_output', whose iteration is already finished, and updates their block tables in
+    // 'scheduler_output'; returns the number of reserved tokens, which is limited by sliding window (blocks are not
+    // evicted between the steps), or 0 if there are not enough free blocks. Redundant blocks are released by free_rejected_tokens
+    size_t reserve_decode_slots(const std::vector<SequenceGroup::Ptr>& sequence_groups, Output& scheduler_output, size_t max_num_tokens) {
+        auto get_num_cached_tokens = [] (SequenceGroup::CPtr sequence_group) {
+            return sequence_group->get_context_len() - sequence_group->get_num_evicted_tokens();
+        };
+        size_t num_tokens = max_num_tokens;
+        if (m_config.kv_window_blocks > 0) {
+            const size_t max_num_window_tokens = (m_config.num_sink_blocks + m_config.kv_window_blocks) * m_config.block_size;
+            for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+                const size_t num_cached_tokens = get_num_cached_tokens(sequence_groups[sequence_group_id]);
+                num_tokens = std::min(num_tokens, max_num_window_tokens - std::min(max_num_window_tokens, num_cached_tokens));
+            }
+        }
+        if (num_tokens == 0)
+            return 0;
+
+        auto get_num_blocks = [&] (SequenceGroup::CPtr sequence_group) {
+            return (get_num_cached_tokens(sequence_group) + num_tokens + m_config.block_size - 1) / m_config.block_size;
+        };
+        size_t num_required_blocks = 0;
+        for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+            SequenceGroup::CPtr sequence_group = sequence_groups[sequence_group_id];
+            const size_t num_blocks = get_num_blocks(sequence_group);
+            for (const auto& sequence : sequence_group->get_running_sequences())
+                num_required_blocks += num_blocks - std::min(num_blocks, m_block_manager.get_block_table(sequence->get_id()).size());
+        }
+        if (!m_block_manager.can_allocate_blocks(num_required_blocks))
+            return 0;
+
+        for (uint64_t sequence_group_id : scheduler_output.m_scheduled_sequence_groups_ids) {
+            SequenceGroup::CPtr sequence_group = sequence_groups[sequence_group_id];
+            const size_t num_blocks = get_num_blocks(sequence_group);
+            for (const auto& sequence : sequence_group->get_running_sequences()) {
+                const size_t num_allocated_blocks = m_block_manager.get_block_table(sequence->get_id()).size();
+                if (num_blocks > num_allocated_blocks)
+                    m_block_manager.allocate(sequence->get_id(), num_blocks - num_allocated_blocks);
+                scheduler_output.m_block_tables[sequence->get_id()] = m_block_manager.get_block_table(sequence->get_id());
+            }
+        }
+        scheduler_output.m_cache_usage = m_block_manager.get_used_percentage();
+        return num_tokens;
+    }
+
+    // releases KV blocks of rejected speculative candidates (or slots reserved by reserve_decode_slots, but not used),
+    // so block table corresponds to sequence group context again
+    void free_rejected_tokens(SequenceGroup::CPtr sequence_group) {
+        for (const auto& sequence : sequence_group->get_running_sequences())
+            m_block_manager.free_redundant_blocks(sequence->get_id(), sequence_group->get_num_logical_blocks());
+    }
+
 private:
+    static size_t _get_initial_num_kv_blocks(const SchedulerConfig& config) {
+        return config.num_kv_blocks_per_chunk > 0 ? std::min(config.num_kv_blocks_per_chunk, config.num_kv_blocks) : config.num_kv_blocks;
+    }
+
+    // grows lazily allocated KV cache by chunks, so it has at least 'num_required_blocks' free blocks (if possible);
+    // returns false if KV cache was not grown
+    bool _try_grow_kv_cache(size_t num_required_blocks) {
+        size_t num_free_blocks = m_block_manager.num_free_blocks(), num_blocks = m_block_manager.get_total_num_blocks();
+        if (m_config.num_kv_blocks_per_chunk == 0 || num_free_blocks >= num_required_blocks || num_blocks >= m_config.num_kv_blocks)
+            return false;
+
+        size_t num_chunks = (num_required_blocks - num_free_blocks + m_config.num_kv_blocks_per_chunk - 1) / m_config.num_kv_blocks_per_chunk;
+        m_block_manager.resize(std::min(m_config.num_kv_blocks, num_blocks + num_chunks * m_config.num_kv_blocks_per_chunk));
+        return true;
+    }
+
+    // allocates blocks for KV cache imported by a not yet scheduled sequence group, which content is copied by CacheManager
+    // on this step; if there are not enough free blocks, prompt is computed as usual
+    // KV cache of prompt prefix is imported after prefix cache restore, so only blocks, which are not cached, are written
+    void _import_kv_cache(SequenceGroup::Ptr sequence_group, Output& scheduler_output) {
+        KVCacheBlob::Ptr kv_cache = sequence_group->release_imported_kv_cache();
+        uint64_t seq_id = (*sequence_group)[0]->get_id();
+        // only blocks of restored prefix can be allocated
+        const size_t num_restored_tokens = sequence_group->get_num_processed_tokens();
+        const size_t num_restored_blocks = m_block_manager.has_block_table(seq_id) ? m_block_manager.get_block_table(seq_id).size() : 0;
+        if (num_restored_blocks * m_config.block_size != num_restored_tokens)
+            return;
+
+        // blob can be stored for a different continuation of the same prefix (see SessionKVStore), so only common tokens are imported;
+        // logits of sampled prompt positions are computed by this pipeline
+        const TokenIds& prompt_ids = sequence_group->get_prompt_ids();
+        const std::vector<int64_t> kv_cache_ids = kv_cache->get_prompt_ids();
+        const size_t num_kv_tokens = std::min(kv_cache->get_num_kv_tokens(), prompt_ids.size());
+        const size_t num_common_tokens = std::mismatch(prompt_ids.begin(), prompt_ids.begin() + num_kv_tokens, kv_cache_ids.begin()).first - prompt_ids.begin();
+        const size_t num_imported_tokens = std::min(num_common_tokens, sequence_group->get_first_sampled_prompt_position());
+        if (num_imported_tokens <= num_restored_tokens)
+            return;
+
+        const size_t first_block_idx = num_restored_blocks;
+        const size_t num_imported_blocks = (num_imported_tokens + m_config.block_size - 1) / m_config.block_size - first_block_idx;
+        _try_grow_kv_cache(num_imported_blocks);
+        if (!m_block_manager.can_allocate_blocks(num_imported_blocks))
+            return;
+
+        m_block_manager.allocate(seq_id, num_imported_blocks);
+        KVCacheImport kv_cache_import;
+        kv_cache_import.m_kv_cache = std::move(kv_cache);
+        kv_cache_import.m_first_block_idx = first_block_idx;
+        const std::vector<KVCacheBlock::Ptr>& block_table = m_block_manager.get_block_table(seq_id);
+        for (size_t block_idx = first_block_idx; block_idx < block_table.size(); ++block_idx)
+            kv_cache_import.m_block_ids.push_back(block_table[block_idx]->get_index());
+        scheduler_output.m_kv_cache_imports.push_back(std::move(kv_cache_import));
+        sequence_group->update_processed_tokens_num(num_imported_tokens);
+        sequence_group->record_imported_prompt_tokens(num_imported_tokens - num_restored_tokens);
+    }
+
+    // prefix grouping: a block-level radix index over prompts scheduled on the current step, which maps a rolling hash of
+    // the first K prompt blocks (i.e. a path from the root of the tree) to a sequence group, which computes the K-th block
+    using PrefixIndex = std::unordered_map<size_t, size_t>;
+
+    // adds full prompt blocks of a scheduled sequence group, which are not computed yet, to 'prefix_index'
+    static void _index_prompt_blocks(const std::vector<SequenceGroup::Ptr>& sequence_groups, size_t sequence_group_id, PrefixIndex& prefix_index) {
+        SequenceGroup::CPtr sequence_group = sequence_groups[sequence_group_id];
+        const TokenIds& prompt_ids = sequence_group->get_prompt_ids();
+        const size_t block_size = sequence_group->get_block_size();
+        const size_t first_block_idx = sequence_group->get_num_processed_tokens() / block_size, num_blocks = prompt_ids.size() / block_size;
+        // KV cache depends on LoRA adapter, so prefixes are grouped for requests of the same adapter only
+        size_t hash = sequence_group->get_sampling_parameters().lora_adapter_id;
+        for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+            hash = BlockManager::compute_block_hash(hash, prompt_ids, block_idx, block_size);
+            if (block_idx >= first_block_idx)
+                prefix_index.emplace(hash, sequence_group_id);
+        }
+    }
+
+    // whether a not yet scheduled sequence group shares a prompt block with a group of 'prefix_index', which is computed
+    // on this step; such a group waits and restores the common prefix from prefix cache later
+    static bool _has_prefix_in_flight(const std::vector<SequenceGroup::Ptr>& sequence_groups, SequenceGroup::CPtr sequence_group, const PrefixIndex& prefix_index) {
+        if (prefix_index.empty() || sequence_group->get_num_processed_tokens() > 0 || sequence_group->has_imported_kv_cache())
+            return false;
+        const TokenIds& prompt_ids = sequence_group->get_prompt_ids();
+        const size_t block_size = sequence_group->get_block_size();
+        // prompt tokens, whose logits are used, are computed by the group itself (see BlockManager::restore_cached_blocks)
+        const size_t max_num_cached_blocks = prompt_ids.empty() ? 0 : sequence_group->get_first_sampled_prompt_position() / block_size;
+        size_t hash = sequence_group->get_sampling_parameters().lora_adapter_id;
+        for (size_t block_idx = 0; block_idx < max_num_cached_blocks; ++block_idx) {
+            hash = BlockManager::compute_block_hash(hash, prompt_ids, block_idx, block_size);
+            auto owner_it = prefix_index.find(hash);
+            if (owner_it == prefix_index.end())
+                continue;
+            // hashes of different prefixes can collide, so tokens are compared
+            const TokenIds& owner_prompt_ids = sequence_groups[owner_it->second]->get_prompt_ids();
+            const size_t num_common_tokens = (block_idx + 1) * block_size;
+            if (std::equal(prompt_ids.begin(), prompt_ids.begin() + num_common_tokens, owner_prompt_ids.begin()))
+                return true;
+        }
+        return false;
+    }
+
+    static bool _is_prompt_to_process(SequenceGroup::CPtr sequence_group) {
+        return !sequence_group->can_generate_tokens() && !sequence_group->is_waiting();
+    }
+
+    static bool _has_prompts_to_process(const std::vector<SequenceGroup::Ptr>& sequence_groups) {
+        return std::any_of(sequence_groups.begin(), sequence_groups.end(), [] (const SequenceGroup::Ptr& sequence_group) {
+            return _is_prompt_to_process(sequence_group);
+        });
+    }
+
+    // requests with higher priority are scheduled first, requests of the same priority are served by earliest deadline
+    // and then in order of arrival; requests at the end of this order are preempted first
+    std::vector<size_t> _get_schedule_order(const std::vector<SequenceGroup::Ptr>& sequence_groups) const {
+        std::vector<size_t> sequence_group_ids(sequence_groups.size());
+        std::iota(sequence_group_ids.begin(), sequence_group_ids.end(), 0);
+        std::stable_sort(sequence_group_ids.begin(), sequence_group_ids.end(), [&] (size_t lhs, size_t rhs) {
+            size_t lhs_priority = sequence_groups[lhs]->get_sampling_parameters().priority,
+                   rhs_priority = sequence_groups[rhs]->get_sampling_parameters().priority;
+            if (lhs_priority != rhs_priority)
+                return lhs_priority > rhs_priority;
+            return sequence_groups[lhs]->get_deadline() < sequence_groups[rhs]->get_deadline();
+        });
+        if (!m_config.enable_fair_share)
+            return sequence_group_ids;
+
+        // weighted fair queuing: requests of the same priority are served by virtual time, when their tokens are processed,
+        // i.e. after tokens of the previous requests of the same tenant, while requests of a tenant keep the order above
+        std::vector<double> finish_times(sequence_groups.size(), 0.0);
+        std::map<size_t, double> tenant_times;
+        for (size_t sequence_group_id : sequence_group_ids) {
+            SequenceGroup::CPtr sequence_group = sequence_groups[sequence_group_id];
+            if (sequence_group->has_finished())
+                continue;
+            const size_t tenant_id = _get_tenant_id(sequence_group);
+            auto tenant_virtual_time_it = m_tenant_virtual_times.find(tenant_id);
+            double& tenant_time = tenant_times.emplace(tenant_id, tenant_virtual_time_it != m_tenant_virtual_times.end() ?
+                                                       tenant_virtual_time_it->second : 0.0).first->second;
+            tenant_time += sequence_group->get_num_available_tokens_for_batching() * sequence_group->num_running_seqs() /
+                _get_tenant_config(tenant_id).weight;
+            finish_times[sequence_group_id] = tenant_time;
+        }
+        std::stable_sort(sequence_group_ids.begin(), sequence_group_ids.end(), [&] (size_t lhs, size_t rhs) {
+            size_t lhs_priority = sequence_groups[lhs]->get_sampling_parameters().priority,
+                   rhs_priority = sequence_groups[rhs]->get_sampling_parameters().priority;
+            if (lhs_priority != rhs_priority)
+                return lhs_priority > rhs_priority;
+            return finish_times[lhs] < finish_times[rhs];
+        });
+        return sequence_group_ids;
+    }
+
+    static size_t _get_tenant_id(SequenceGroup::CPtr sequence_group) {
+        return sequence_group->get_sampling_parameters().tenant_id;
+    }
+
+    const TenantConfig& _get_tenant_config(size_t tenant_id) const {
+        static const TenantConfig default_tenant_config;
+        auto tenant_it = m_config.tenants.find(tenant_id);
+        return tenant_it != m_config.tenants.end() ? tenant_it->second : default_tenant_config;
+    }
+
+    size_t _get_num_kv_blocks(SequenceGroup::CPtr sequence_group) {
+        size_t num_kv_blocks = 0;
+        for (const auto& sequence : sequence_group->get_running_sequences()) {
+            if (m_block_manager.has_block_table(sequence->get_id()))
+                num_kv_blocks += m_block_manager.get_block_table(sequence->get_id()).size();
+        }
+        return num_kv_blocks;
+    }
+
+    // fair share: collects KV blocks of tenants, which have requests to process; a tenant getting requests again starts
+    // from the least virtual time of already active tenants, so it's not served ahead of them for the time it was idle;
+    // that's why virtual times of idle tenants are not kept
+    void _update_tenants(const std::vector<SequenceGroup::Ptr>& sequence_groups, Output& scheduler_output) {
+        std::set<size_t> active_tenants;
+        for (const SequenceGroup::CPtr& sequence_group : sequence_groups) {
+            if (sequence_group->has_finished())
+                continue;
+            const size_t tenant_id = _get_tenant_id(sequence_group);
+            active_tenants.insert(tenant_id);
+            scheduler_output.m_tenant_usage[tenant_id].m_num_kv_blocks += _get_num_kv_blocks(sequence_group);
+        }
+
+        double min_virtual_time = std::numeric_limits<double>::max();
+        for (size_t tenant_id : active_tenants) {
+            if (m_active_tenants.count(tenant_id) > 0)
+                min_virtual_time = std::min(min_virtual_time, m_tenant_virtual_times[tenant_id]);
+        }
+        // if all tenants become active on this step, they start at the same virtual time
+        if (min_virtual_time == std::numeric_limits<double>::max()) {
+            min_virtual_time = 0.0;
+            for (size_t tenant_id : active_tenants)
+                min_virtual_time = std::max(min_virtual_time, m_tenant_virtual_times[tenant_id]);
+        }
+        for (size_t tenant_id : active_tenants) {
+            if (m_active_tenants.count(tenant_id) == 0)
+                m_tenant_virtual_times[tenant_id] = std::max(m_tenant_virtual_times[tenant_id], min_virtual_time);
+        }
+        for (auto tenant_it = m_tenant_virtual_times.begin(); tenant_it != m_tenant_virtual_times.end();) {
+            if (active_tenants.count(tenant_it->first) == 0)
+                tenant_it = m_tenant_virtual_times.erase(tenant_it);
+            else
+                ++tenant_it;
+        }
+        m_active_tenants = std::move(active_tenants);
+    }
+
+    // KV blocks, which sequences of a tenant can use before they are preempted in favor of other tenants: a share of KV cache
+    // proportional to weight of the tenant among active ones, but not more than its limit
+    size_t _get_tenant_kv_quota(size_t tenant_id) const {
+        double total_weight = 0.0;
+        for (size_t active_tenant_id : m_active_tenants)
+            total_weight += _get_tenant_config(active_tenant_id).weight;
+        const TenantConfig& tenant_config = _get_tenant_config(tenant_id);
+        size_t kv_quota = total_weight > 0.0 ? static_cast<size_t>(m_config.num_kv_blocks * tenant_config.weight / total_weight) : m_config.num_kv_blocks;
+        return tenant_config.max_num_kv_blocks > 0 ? std::min(kv_quota, tenant_config.max_num_kv_blocks) : kv_quota;
+    }
+
+    bool _is_over_kv_quota(SequenceGroup::CPtr sequence_group, const Output& scheduler_output) const {
+        const size_t tenant_id = _get_tenant_id(sequence_group);
+        auto tenant_usage_it = scheduler_output.m_tenant_usage.find(tenant_id);
+        return tenant_usage_it != scheduler_output.m_tenant_usage.end() && tenant_usage_it->second.m_num_kv_blocks > _get_tenant_kv_quota(tenant_id);
+    }
+
+    // limits of a tenant left on this step: 'max_value' is the limit (0 means no limit) and 'used' is already taken
+    static size_t _get_tenant_budget(size_t max_value, size_t used) {
+        if (max_value == 0)
+            return std::numeric_limits<size_t>::max();
+        return max_value > used ? max_value - used : 0;
+    }
+
+    size_t _get_tenant_token_budget(SequenceGroup::CPtr sequence_group, Output& scheduler_output) const {
+        if (!m_config.enable_fair_share)
+            return std::numeric_limits<size_t>::max();
+        const size_t tenant_id = _get_tenant_id(sequence_group);
+        return _get_tenant_budget(_get_tenant_config(tenant_id).max_num_batched_tokens, scheduler_output.m_tenant_usage[tenant_id].m_num_scheduled_tokens);
+    }
+
+    size_t _get_tenant_kv_budget(SequenceGroup::CPtr sequence_group, Output& scheduler_output) const {
+        if (!m_config.enable_fair_share)
+            return std::numeric_limits<size_t>::max();
+        const size_t tenant_id = _get_tenant_id(sequence_group);
+        return _get_tenant_budget(_get_tenant_config(tenant_id).max_num_kv_blocks, scheduler_output.m_tenant_usage[tenant_id].m_num_kv_blocks);
+    }
+
+    // KV blocks added to block tables of running sequences of a group by append_slots (counted as TenantUsage::m_num_kv_blocks)
+    size_t _get_num_appended_kv_blocks(SequenceGroup::CPtr sequence_group) {
+        const size_t num_logical_blocks = sequence_group->get_num_logical_blocks();
+        size_t num_appended_blocks = 0;
+        for (const auto& sequence : sequence_group->get_running_sequences()) {
+            const size_t num_blocks = m_block_manager.has_block_table(sequence->get_id()) ? m_block_manager.get_block_table(sequence->get_id()).size() : 0;
+            num_appended_blocks += num_logical_blocks > num_blocks ? num_logical_blocks - num_blocks : 0;
+        }
+        return num_appended_blocks;
+    }
+
+    bool _exceeds_tenant_kv_budget(SequenceGroup::CPtr sequence_group, Output& scheduler_output) {
+        return m_config.enable_fair_share && _get_num_appended_kv_blocks(sequence_group) > _get_tenant_kv_budget(sequence_group, scheduler_output);
+    }
+
+    // fair share: a group, which KV blocks don't fit TenantConfig::max_num_kv_blocks, evicts lower priority groups of its own tenant;
+    // groups of other tenants are kept, as the limit is not related to their usage
+    void _apply_tenant_kv_limit(size_t order_idx, const std::vector<SequenceGroup::Ptr>& sequence_groups, const std::vector<size_t>& schedule_order, Output& scheduler_output) {
+        SequenceGroup::Ptr sequence_group = sequence_groups[schedule_order[order_idx]];
+        const size_t tenant_id = _get_tenant_id(sequence_group);
+        while (_exceeds_tenant_kv_budget(sequence_group, scheduler_output)) {
+            // the lowest priority group of the tenant, which KV blocks can be freed
+            size_t evicted_order_idx = schedule_order.size() - 1;
+            for (; evicted_order_idx > order_idx; --evicted_order_idx) {
+                SequenceGroup::CPtr evicted_group = sequence_groups[schedule_order[evicted_order_idx]];
+                if (_get_tenant_id(evicted_group) == tenant_id && evicted_group->get_num_processed_tokens() > 0 && !m_block_manager.is_swapped(evicted_group))
+                    break;
+            }
+            if (evicted_order_idx == order_idx)
+                break;
+            // recomputed groups release blocks until there are 'blocks_needed' free ones, so exceeding blocks are added to currently free ones
+            const size_t num_exceeding_blocks = _get_num_appended_kv_blocks(sequence_group) - _get_tenant_kv_budget(sequence_group, scheduler_output);
+            if (!_preempt(sequence_groups[schedule_order[evicted_order_idx]], m_block_manager.num_free_blocks() + num_exceeding_blocks, scheduler_output))
+                break;
+        }
+    }
+
+    // fair share: accounts tokens scheduled for a sequence group and a change of its KV blocks since 'num_kv_blocks_before'
+    void _update_tenant_usage(SequenceGroup::CPtr sequence_group, size_t num_scheduled_tokens, size_t num_kv_blocks_before, Output& scheduler_output) {
+        if (!m_config.enable_fair_share)
+            return;
+        TenantUsage& tenant_usage = scheduler_output.m_tenant_usage[_get_tenant_id(sequence_group)];
+        tenant_usage.m_num_scheduled_tokens += num_scheduled_tokens;
+        tenant_usage.m_num_kv_blocks = tenant_usage.m_num_kv_blocks + _get_num_kv_blocks(sequence_group) - num_kv_blocks_before;
+    }
+
     static size_t _num_running_sequence_groups(const std::vector<SequenceGroup::Ptr>& sequence_groups) {
         size_t num_running = 0;
         for (const SequenceGroup::CPtr& seq_group : sequence_groups) {
@@ -94,6 +523,41 @@ private:
     }
 
 
+    size_t _get_num_candidate_tokens(SequenceGroup::CPtr sequence_group, size_t available_tokens_per_seq_in_megabatch) const {
+        if (!sequence_group->can_speculate())
+            return 0;
+        // generated tokens must not exceed max_new_tokens, because all candidates can be accepted
+        const GenerationConfig& sampling_params = sequence_group->get_sampling_parameters();
+        size_t num_remaining_tokens = sampling_params.max_new_tokens - (*sequence_group)[0]->get_generated_len();
+
+        if (sequence_group->is_prompt_lookup()) {
+            // one more token is generated when all candidates are accepted
+            return std::min({sampling_params.prompt_lookup_num_tokens, available_tokens_per_seq_in_megabatch - 1, num_remaining_tokens - 1});
+        }
+
+        size_t num_candidate_tokens = std::min({m_config.num_speculative_tokens, available_tokens_per_seq_in_megabatch, num_remaining_tokens});
+        // a single candidate of draft model gives nothing compared to regular generation
+        return num_candidate_tokens > 1 ? num_candidate_tokens : 0;
+    }
+
+    // sliding window KV cache: evicts the oldest blocks following sink ones, so context of a sequence group together with
+    // scheduled and 'num_tokens' more tokens fits into num_sink_blocks + kv_window_blocks; only blocks of processed tokens
+    // are evicted, so the window can be exceeded by a part of prompt scheduled at once
+    void _apply_sliding_window(SequenceGroup::Ptr sequence_group, size_t num_tokens = 0) {
+        if (m_config.kv_window_blocks == 0)
+            return;
+        const size_t block_size = m_config.block_size, max_num_blocks = m_config.num_sink_blocks + m_config.kv_window_blocks;
+        const size_t num_evicted_tokens = sequence_group->get_num_evicted_tokens();
+        const size_t num_blocks = (sequence_group->get_context_len() + num_tokens - num_evicted_tokens + block_size - 1) / block_size;
+        const size_t num_processed_blocks = (sequence_group->get_num_processed_tokens() - num_evicted_tokens) / block_size;
+        if (num_blocks <= max_num_blocks || num_processed_blocks <= m_config.num_sink_blocks)
+            return;
+
+        const size_t num_evicted_blocks = std::min(num_blocks - max_num_blocks, num_processed_blocks - m_config.num_sink_blocks);
+        m_block_manager.evict_blocks(sequence_group, m_config.num_sink_blocks, num_evicted_blocks);
+        sequence_group->evict_tokens(num_evicted_blocks * block_size);
+    }
+
     bool _preempt_by_recompute(SequenceGroup::Ptr sequence_group, size_t blocks_needed) {
         size_t total_num_released_blocks = 0;
         size_t processed_tokens = sequence_group->get_num_processed_tokens();
@@ -102,6 +566,14 @@ private:
         size_t num_running_sequences = sequence_group->num_running_seqs();
         size_t preempted_tokens = 0;
 
+        // evicted part of context can be recomputed only from the beginning
+        if (sequence_group->get_num_evicted_tokens() > 0 && num_running_sequences == 1) {
+            m_block_manager.free_sequence((*sequence_group)[0]->get_id());
+            sequence_group->preempt_tokens(processed_tokens);
+            sequence_group->set_waiting();
+            return m_block_manager.num_free_blocks() > prev_blocks_count;
+        }
+
         if (num_running_sequences > 1) {
             for (size_t s = 0; s < sequence_group->num_running_seqs(); ++s) {
                 auto seq_id = (*sequence_group)[s]->get_id();
@@ -120,8 +592,11 @@ private:
                 // no blocks are allocated for this sequence, so it can't be preempted
                 return false;
             }
-            auto block_table = m_block_manager.get_block_table(seq_id);
+            const auto& block_table = m_block_manager.get_block_table(seq_id);
             size_t required_blocks = blocks_needed - total_num_released_blocks;
+            // a number of blocks removed from sequence's block table
+            // note, that with prefix caching some of them can be still used by other sequences
+            size_t dropped_blocks = std::min(required_blocks, block_table.size());
             if (required_blocks >= block_table.size()) {
                 // fully drop a sequence(s) from block_manager
                 m_block_manager.free_sequence(seq_id);
@@ -142,7 +617,7 @@ private:
                 tokens_in_last_block = block_size;
             }
 
-            preempted_tokens += tokens_in_last_block + std::max<size_t>((int)released_blocks - 1, 0) * block_size;
+            preempted_tokens += tokens_in_last_block + std::max<size_t>((int)dropped_blocks - 1, 0) * block_size;
             if (m_block_manager.num_free_blocks() >= blocks_needed) {
                 break;
             }
@@ -159,40 +634,99 @@ private:
         return total_num_released_blocks > 0;
     }
 
-    static size_t _get_low_priority_sequence_group_id(const std::vector<SequenceGroup::Ptr>& sequence_groups) {
-        for (size_t seq_group_id = 0, num_groups = sequence_groups.size(); seq_group_id < num_groups; ++seq_group_id) {
-            size_t group_idx = num_groups - seq_group_id - 1;
-            SequenceGroup::CPtr sequence_group = sequence_groups[group_idx];
-            if (sequence_group->get_num_processed_tokens() > 0) {
+    bool _preempt_by_swap(SequenceGroup::Ptr sequence_group, Output& scheduler_output) {
+        size_t prev_blocks_count = m_block_manager.num_free_blocks();
+        std::map<size_t, size_t> swap_out_map = m_block_manager.swap_out(sequence_group);
+        scheduler_output.m_swap_out_block_map.insert(swap_out_map.begin(), swap_out_map.end());
+        // processed tokens are kept, so generation continues from the same place after swapping in
+        sequence_group->set_waiting();
+        return m_block_manager.num_free_blocks() > prev_blocks_count;
+    }
+
+    bool _preempt(SequenceGroup::Ptr sequence_group, size_t blocks_needed, Output& scheduler_output) {
+        const size_t num_processed_tokens = sequence_group->get_num_processed_tokens();
+        const size_t num_kv_blocks = m_config.enable_fair_share ? _get_num_kv_blocks(sequence_group) : 0;
+        bool is_preempted = false;
+        // recomputation cost grows with context length faster than cost of swapping, so long contexts are swapped
+        if (m_config.num_swap_blocks > 0 &&
+            sequence_group->get_num_processed_tokens() >= m_config.swap_min_context_len &&
+            m_block_manager.can_swap_out(sequence_group)) {
+            is_preempted = _preempt_by_swap(sequence_group, scheduler_output);
+        } else {
+            is_preempted = _preempt_by_recompute(sequence_group, blocks_needed);
+        }
+        if (is_preempted) {
+            // swapped out sequence groups keep processed tokens
+            sequence_group->record_preemption(num_processed_tokens - sequence_group->get_num_processed_tokens());
+            ++scheduler_output.m_num_preemptions;
+            if (m_config.enable_fair_share) {
+                _update_tenant_usage(sequence_group, 0, num_kv_blocks, scheduler_output);
+                ++scheduler_output.m_tenant_usage[_get_tenant_id(sequence_group)].m_num_preemptions;
+            }
+        }
+        return is_preempted;
+    }
+
+    bool _swap_in(SequenceGroup::Ptr sequence_group, Output& scheduler_output) {
+        _try_grow_kv_cache(m_block_manager.required_swap_in_blocks_count(sequence_group));
+        if (!m_block_manager.can_swap_in(sequence_group))
+            return false;
+        std::map<size_t, size_t> swap_in_map = m_block_manager.swap_in(sequence_group);
+        scheduler_output.m_swap_in_block_map.insert(swap_in_map.begin(), swap_in_map.end());
+        return true;
+    }
+
+    // returns a position in 'schedule_order' after 'current_order_idx' of the lowest priority sequence group, which KV blocks
+    // can be freed; with fair share, groups of the same priority are taken from tenants exceeding their KV quota first
+    size_t _get_low_priority_sequence_group_id(const std::vector<SequenceGroup::Ptr>& sequence_groups, const std::vector<size_t>& schedule_order,
+                                               size_t current_order_idx, const Output& scheduler_output) {
+        size_t low_priority_order_idx = std::numeric_limits<size_t>::max();
+        for (size_t order_idx = schedule_order.size(); order_idx > current_order_idx + 1; --order_idx) {
+            SequenceGroup::CPtr sequence_group = sequence_groups[schedule_order[order_idx - 1]];
+            if (sequence_group->get_num_processed_tokens() > 0 && !m_block_manager.is_swapped(sequence_group)) {
                 // we are here, because current sequence group has some reserved KV blocks in block manager
                 // which can be freed
-                return group_idx;
+                if (!m_config.enable_fair_share)
+                    return order_idx - 1;
+                if (low_priority_order_idx == std::numeric_limits<size_t>::max())
+                    low_priority_order_idx = order_idx - 1;
+                else if (sequence_group->get_sampling_parameters().priority !=
+                         sequence_groups[schedule_order[low_priority_order_idx]]->get_sampling_parameters().priority)
+                    break;
+                if (_is_over_kv_quota(sequence_group, scheduler_output))
+                    return order_idx - 1;
             }
         }
 
-        return std::numeric_limits<size_t>::max();
+        return low_priority_order_idx;
     }
 
-    void _apply_preemption(size_t sequence_group_id, const std::vector<SequenceGroup::Ptr>& sequence_groups) {
-        SequenceGroup::Ptr sequence_group = sequence_groups[sequence_group_id];
+    // 'order_idx' is a position of sequence group in 'schedule_order'; only groups after it can be evicted,
+    // because they have lower priority and are not scheduled yet
+    void _apply_preemption(size_t order_idx, const std::vector<SequenceGroup::Ptr>& sequence_groups, const std::vector<size_t>& schedule_order, Output& scheduler_output) {
+        SequenceGroup::Ptr sequence_group = sequence_groups[schedule_order[order_idx]];
 
         // check whether current sequence requires a new slot / block
         while (!m_block_manager.can_append_slots(sequence_group)) {
+            // allocate more KV cache instead of eviction, if possible
+            if (_try_grow_kv_cache(m_block_manager.required_blocks_count(sequence_group)))
+                continue;
+
             // let's run a sequence for eviction
-            size_t evicted_sequence_group_id = _get_low_priority_sequence_group_id(sequence_groups);
-        
-            if (evicted_sequence_group_id <= sequence_group_id) {
+            size_t evicted_order_idx = _get_low_priority_sequence_group_id(sequence_groups, schedule_order, order_idx, scheduler_output);
+
+            if (evicted_order_idx == std::numeric_limits<size_t>::max()) {
                 // we have a cycle when current group need to evict itself to be in a running state
                 break;
             }
             size_t blocks_needed = m_block_manager.required_blocks_count(sequence_group);
-            if (!_preempt_by_recompute(sequence_groups[evicted_sequence_group_id], blocks_needed)){
+            if (!_preempt(sequence_groups[schedule_order[evicted_order_idx]], blocks_needed, scheduler_output)){
                 break;
             }
         }
     }
 
-    void _schedule_prompt_phase_dynamic_split_fuse(std::vector<SequenceGroup::Ptr>& sequence_groups, Output& scheduler_output) {
+    void _schedule_prompt_phase_dynamic_split_fuse(std::vector<SequenceGroup::Ptr>& sequence_groups, const std::vector<size_t>& schedule_order, Output& scheduler_output) {
         // in the current method we need to balance multiple prompts (or parts of prompts) between
         // available amount of tokens in megabatch
         // Considerations:
@@ -200,26 +734,54 @@ private:
         //    we can slice prompt on chunks and schedule only portion of each prompt instead of
         //    greedy scheduling of prompt with higher priority
         // 2. The machanism below performs greedy scheduling of high priority prompts
+        // 3. Prompts cannot occupy more than max_prefill_fraction of megabatch to bound latency of generation steps
 
-        for (size_t sequence_group_id = 0; sequence_group_id < sequence_groups.size(); ++sequence_group_id) {
+        size_t max_num_prompt_tokens = std::max(m_config.min_prefill_chunk_size,
+            static_cast<size_t>(m_config.max_prefill_fraction * m_config.max_num_batched_tokens));
+        size_t max_num_batched_tokens = std::min(m_config.max_num_batched_tokens,
+            scheduler_output.m_total_num_scheduled_tokens + max_num_prompt_tokens);
+
+        PrefixIndex prefix_index;
+        for (size_t sequence_group_id : schedule_order) {
             SequenceGroup::Ptr sequence_group = sequence_groups[sequence_group_id];
-            if (!sequence_group->can_generate_tokens() && !sequence_group->is_waiting()) {
+            if (_is_prompt_to_process(sequence_group)) {
                 size_t num_running_seqs = sequence_group->num_running_seqs();
                 // prompt phases can have a single running sequence
                 OPENVINO_ASSERT(num_running_seqs == 1);
                 Sequence::Ptr sequence = (*sequence_group)[0];
                 uint64_t seq_id = sequence->get_id();
 
-                size_t num_tokens_in_megabatch = m_config.max_num_batched_tokens - scheduler_output.m_total_num_scheduled_tokens;
+                // partially processed prompt can be swapped out as well
+                if (m_block_manager.is_swapped(sequence_group) && !_swap_in(sequence_group, scheduler_output))
+                    continue;
+
+                // common prefix with a prompt scheduled before is computed once
+                if (m_config.enable_prefix_grouping && _has_prefix_in_flight(sequence_groups, sequence_group, prefix_index))
+                    continue;
+
+                const size_t num_kv_blocks = m_config.enable_fair_share ? _get_num_kv_blocks(sequence_group) : 0;
+
+                // skip computation of prompt prefix, which is already present in KV cache or imported
+                if (m_config.enable_prefix_caching && sequence_group->get_num_processed_tokens() == 0)
+                    sequence_group->record_cached_prompt_tokens(m_block_manager.restore_cached_blocks(sequence_group));
+                if (sequence_group->has_imported_kv_cache())
+                    _import_kv_cache(sequence_group, scheduler_output);
+
+                size_t num_tokens_in_megabatch = std::min(max_num_batched_tokens - scheduler_output.m_total_num_scheduled_tokens,
+                                                          _get_tenant_token_budget(sequence_group, scheduler_output));
                 size_t num_available_tokens = sequence_group->get_num_available_tokens_for_batching();
 
                 // apply megabatch limitations
                 size_t num_scheduled_tokens = std::min(num_tokens_in_megabatch, num_available_tokens);
 
                 // apply KV cache limitations
-                size_t available_slots = sequence_group->get_num_blocks() * m_config.block_size - sequence_group->get_num_processed_tokens(),
+                _apply_sliding_window(sequence_group, num_scheduled_tokens);
+                size_t num_cached_tokens = sequence_group->get_num_processed_tokens() - sequence_group->get_num_evicted_tokens();
+                size_t available_slots = sequence_group->get_num_blocks() * m_config.block_size - num_cached_tokens,
                        required_slots = num_scheduled_tokens > available_slots ? num_scheduled_tokens - available_slots : 0;
-                size_t num_required_blocks = (required_slots + m_config.block_size - 1) / m_config.block_size, num_free_blocks = m_block_manager.num_free_blocks();
+                size_t num_required_blocks = (required_slots + m_config.block_size - 1) / m_config.block_size;
+                _try_grow_kv_cache(num_required_blocks);
+                size_t num_free_blocks = std::min(m_block_manager.num_free_blocks(), _get_tenant_kv_budget(sequence_group, scheduler_output));
                 size_t num_scheduled_blocks = std::min(num_required_blocks, num_free_blocks);
                 // some scheduled blocks can be no fully occupied, so we need to take min between num_scheduled_blocks
                 // and total "scheduled capacity"
@@ -238,17 +800,25 @@ private:
                         scheduler_output.m_block_tables[seq_id] = m_block_manager.get_block_table(seq_id);
                         scheduler_output.m_total_num_scheduled_tokens += num_scheduled_tokens * num_running_seqs;
                     }
+
+                    if (m_config.enable_prefix_grouping)
+                        _index_prompt_blocks(sequence_groups, sequence_group_id, prefix_index);
                 }
+                // restored and imported blocks are accounted as well, even if no tokens are scheduled
+                _update_tenant_usage(sequence_group, num_scheduled_tokens, num_kv_blocks, scheduler_output);
 
                 // if we added maximum amount of tokens to compute
-                if (scheduler_output.m_total_num_scheduled_tokens == m_config.max_num_batched_tokens)
+                if (scheduler_output.m_total_num_scheduled_tokens == max_num_batched_tokens)
                     break;
             }
         }
     }
 
-    void _schedule_generate_phase_dynamic_split_fuse(const std::vector<SequenceGroup::Ptr>& sequence_groups, Output& scheduler_output) {
-        for (size_t sequence_group_id = 0; sequence_group_id < sequence_groups.size(); ++sequence_group_id) {
+    // 'max_num_batched_tokens' is a part of megabatch available for generation phase
+    void _schedule_generate_phase_dynamic_split_fuse(const std::vector<SequenceGroup::Ptr>& sequence_groups, const std::vector<size_t>& schedule_order,
+                                                     Output& scheduler_output, size_t max_num_batched_tokens) {
+        for (size_t order_idx = 0; order_idx < schedule_order.size(); ++order_idx) {
+            size_t sequence_group_id = schedule_order[order_idx];
             SequenceGroup::Ptr sequence_group = sequence_groups[sequence_group_id];
             // Note, that can_generate_tokens will mix preempted sequence groups
             // and real generate ones
@@ -257,8 +827,13 @@ private:
             //         keep latencies for sequence groups of high priority
             if (sequence_group->can_generate_tokens() && !sequence_group->is_waiting()) {
                 OPENVINO_ASSERT(!sequence_group->has_finished());
+                // swapped out groups are restored first; if there is no room for them, they wait for the next steps
+                if (m_block_manager.is_swapped(sequence_group) && !_swap_in(sequence_group, scheduler_output))
+                    continue;
+
                 size_t num_running_seqs = sequence_group->num_running_seqs();
-                size_t num_tokens_in_megabatch = m_config.max_num_batched_tokens - scheduler_output.m_total_num_scheduled_tokens;
+                size_t num_tokens_in_megabatch = std::min(max_num_batched_tokens - scheduler_output.m_total_num_scheduled_tokens,
+                                                          _get_tenant_token_budget(sequence_group, scheduler_output));
                 size_t available_tokens_per_seq_in_megabatch = num_tokens_in_megabatch / num_running_seqs;
 
                 // we cannot schedule even a single token per each sequence in a group
@@ -272,16 +847,39 @@ private:
                 size_t num_scheduled_tokens_per_seq = std::min(available_tokens_per_seq_in_megabatch, num_available_tokens_per_seq);
                 sequence_group->schedule_tokens(num_scheduled_tokens_per_seq);
 
-                _apply_preemption(sequence_group_id, sequence_groups);
+                // with speculative decoding several candidates are validated at once, so KV cache is reserved for all of them
+                size_t num_candidate_tokens = _get_num_candidate_tokens(sequence_group, available_tokens_per_seq_in_megabatch);
+                if (num_candidate_tokens > 0 && num_available_tokens_per_seq == 1) {
+                    sequence_group->schedule_candidate_tokens(num_candidate_tokens);
+                    num_scheduled_tokens_per_seq = sequence_group->get_num_scheduled_tokens();
+                }
+
+                _apply_sliding_window(sequence_group);
+
+                // candidates are optional, so other groups are not preempted for them: fallback to generation of a single
+                // token, if there is no room for candidates
+                if (sequence_group->get_num_candidate_tokens() > 0) {
+                    _try_grow_kv_cache(m_block_manager.required_blocks_count(sequence_group));
+                    if (!m_block_manager.can_append_slots(sequence_group) || _exceeds_tenant_kv_budget(sequence_group, scheduler_output)) {
+                        sequence_group->clear_scheduled_tokens();
+                        sequence_group->schedule_tokens(num_scheduled_tokens_per_seq = 1);
+                    }
+                }
+
+                _apply_preemption(order_idx, sequence_groups, schedule_order, scheduler_output);
+                _apply_tenant_kv_limit(order_idx, sequence_groups, schedule_order, scheduler_output);
 
-                // if we can't preemt any more sequences, clear scheduled tokens and move to next sequence
-                if (!m_block_manager.can_append_slots(sequence_group)){
+                // if we can't preemt any more sequences, clear scheduled tokens and move to next sequence;
+                // a group, which doesn't fit the KV limit of its tenant, waits for other groups of the tenant to finish
+                if (!m_block_manager.can_append_slots(sequence_group) || _exceeds_tenant_kv_budget(sequence_group, scheduler_output)) {
                     sequence_group->clear_scheduled_tokens();
                     continue;
                 }
                 
                 // allocate new slots
+                const size_t num_kv_blocks = m_config.enable_fair_share ? _get_num_kv_blocks(sequence_group) : 0;
                 std::map<size_t, std::list<size_t>> copy_blocks_map = m_block_manager.append_slots(sequence_group);
+                _update_tenant_usage(sequence_group, num_scheduled_tokens_per_seq * num_running_seqs, num_kv_blocks, scheduler_output);
 
                 // add information to scheduler_output
                 {
@@ -305,13 +903,13 @@ private:
                 }
 
                 // if we added maximum amount of tokens to compute
-                if (scheduler_output.m_total_num_scheduled_tokens == m_config.max_num_batched_tokens)
+                if (scheduler_output.m_total_num_scheduled_tokens == max_num_batched_tokens)
                     break;
             }
         }
     }
 
-    void _schedule_prompt_phase_vllm(std::vector<SequenceGroup::Ptr>& sequence_groups, Output& scheduler_output) {
+    void _schedule_prompt_phase_vllm(std::vector<SequenceGroup::Ptr>& sequence_groups, const std::vector<size_t>& schedule_order, Output& scheduler_output) {
         // Current scheduling method schedules prompts only in a manner similar to vLLM:
         // - Limits max batch size by:
         //   - max_num_seqs (256 in vLLM's defaults)
@@ -325,7 +923,9 @@ private:
         // TODO: it currently does not handle beam search, where beam width should contribute to total number of "num running sequences"
         size_t num_running_sequence_groups = _num_running_sequence_groups(sequence_groups);
 
-        for (size_t sequence_group_id = 0, num_scheduled_tokens = 0, max_sequence_len = 0; sequence_group_id < sequence_groups.size(); ++sequence_group_id) {
+        // prompts are admitted in order of priority
+        size_t num_scheduled_tokens = 0, max_sequence_len = 0;
+        for (size_t sequence_group_id : schedule_order) {
             SequenceGroup::Ptr sequence_group = sequence_groups[sequence_group_id];
             if (!sequence_group->can_generate_tokens() && !sequence_group->is_waiting()) {
                 size_t num_running_seqs = sequence_group->num_running_seqs();
@@ -352,6 +952,7 @@ private:
 
                 // apply KV cache limitations
                 const size_t num_required_blocks = (sequence_len + m_config.block_size - 1) / m_config.block_size;
+                _try_grow_kv_cache(num_required_blocks);
                 if (!m_block_manager.can_allocate_blocks(num_required_blocks))
                     break;
 
@@ -3,13 +3,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <vector>
+#include <numeric>
 #include <set>
 #include <cstdlib>
+#include <random>
 
 #include "generation_handle.hpp"
 #include "generation_config.hpp"
 #include "generation_stream.hpp"
+#include "logit_processor.hpp"
+#include "ngram_index.hpp"
+#include "stop_string_matcher.hpp"
 
 enum class SequenceStatus {
     RUNNING = 0,
@@ -21,9 +28,10 @@ enum class SequenceStatus {
 using TokenIds = std::vector<int64_t>;
 
 class Sequence {
-    // This can be a problem if we launch two pipelines in the same application.
+    // ids are unique within the process, so several pipelines (e.g. replicas stepping on different threads) never
+    // share ids in block tables; atomic, because sequences are created and forked from multiple threads
     static uint64_t _get_next_global_sequence_id() {
-        static uint64_t m_counter = 0;
+        static std::atomic<uint64_t> m_counter(0);
         return m_counter++;
     }
 
@@ -32,6 +40,11 @@ class Sequence {
     uint64_t m_id = _get_next_global_sequence_id();
     SequenceStatus m_status = SequenceStatus::RUNNING;
     float m_cumulative_log_prob = 0.0f;
+    // state of logits transformations (e.g. penalties for generated tokens), which is specific for each sequence
+    LogitProcessor::Ptr m_logit_processor;
+    // state of stop strings matching and a number of generated tokens already fed to it
+    int m_stop_string_state = 0;
+    size_t m_num_stop_checked_tokens = 0;
 
 public:
     using Ptr = std::shared_ptr<Sequence>;
@@ -45,7 +58,10 @@ public:
         m_generated_ids(seq.m_generated_ids),
         m_grouped_id(id),
         m_status(seq.m_status),
-        m_cumulative_log_prob(seq.m_cumulative_log_prob) {
+        m_cumulative_log_prob(seq.m_cumulative_log_prob),
+        m_logit_processor(seq.m_logit_processor ? seq.m_logit_processor->fork() : nullptr),
+        m_stop_string_state(seq.m_stop_string_state),
+        m_num_stop_checked_tokens(seq.m_num_stop_checked_tokens) {
         OPENVINO_ASSERT(seq.m_id != m_id);
     }
 
@@ -95,11 +111,27 @@ public:
         m_generated_ids.push_back(token_id);     
     }
 
-    GenerationOutput get_last_generation_output() {
+    // removes tokens from the end of a generated part, e.g. speculative candidates rejected by main model
+    // note, that tokens are expected to be appended with zero log probability
+    void remove_last_tokens(size_t num_tokens) {
+        OPENVINO_ASSERT(num_tokens <= m_generated_ids.size());
+        m_generated_ids.resize(m_generated_ids.size() - num_tokens);
+    }
+
+    // feeds generated tokens, which were not checked yet; returns a number of generated tokens up to the one completing stop string, or 0
+    size_t match_stop_strings(const StopStringMatcher& stop_string_matcher) {
+        while (m_num_stop_checked_tokens < m_generated_ids.size()) {
+            if (stop_string_matcher.feed_token(m_stop_string_state, m_generated_ids[m_num_stop_checked_tokens++]))
+                return m_num_stop_checked_tokens;
+        }
+        return 0;
+    }
+
+    GenerationOutput get_last_generation_output(size_t num_tokens = 1) {
         GenerationOutput output;
-        OPENVINO_ASSERT(m_generated_ids.size());
+        OPENVINO_ASSERT(num_tokens > 0 && num_tokens <= m_generated_ids.size());
         output.score = get_cumulative_log_probs();
-        output.generated_token_ids = std::vector<int64_t> {m_generated_ids.back()};
+        output.generated_token_ids = std::vector<int64_t>(m_generated_ids.end() - num_tokens, m_generated_ids.end());
         return output;
     }
 
@@ -111,6 +143,15 @@ public:
         return m_generated_ids;
     }
 
+    void set_logit_processor(const LogitProcessor::Ptr& logit_processor) {
+        m_logit_processor = logit_processor;
+    }
+
+    LogitProcessor& get_logit_processor() {
+        OPENVINO_ASSERT(m_logit_processor, "Logit processor is not set for sequence ", m_id);
+        return *m_logit_processor;
+    }
+
     float get_cumulative_log_probs() const {
         return m_cumulative_log_prob;
     }
@@ -127,7 +168,15 @@ public:
 // - in case of beam search each sequence also shares specific part of generic phase
 //   via reference counter machanism on BlockManager level
 class SequenceGroup {
+    // request ids are chosen by callers and may repeat (e.g. generate() and serving share a pipeline), so per-request
+    // state of pipeline components is keyed by this id, which is unique within the process
+    static uint64_t _get_next_global_group_id() {
+        static std::atomic<uint64_t> m_counter(0);
+        return m_counter++;
+    }
+
     uint64_t m_request_id;
+    uint64_t m_group_id = _get_next_global_group_id();
     std::vector<Sequence::Ptr> m_sequences;
     GenerationConfig m_sampling_params;
     std::size_t m_block_size;
@@ -136,6 +185,15 @@ class SequenceGroup {
 
     uint64_t m_next_sequence_id = 0;
 
+    // random stream of the request, so sampling results do not depend on other requests in a batch
+    std::mt19937 m_rng_engine;
+    // index of prompt and generated tokens for prompt lookup decoding
+    std::shared_ptr<NGramIndex> m_ngram_index;
+    // constraint of generated text, shared by requests with the same pattern
+    TokenConstraint::Ptr m_token_constraint;
+    // automaton of stop strings, sequences keep their own matching states
+    StopStringMatcher::Ptr m_stop_string_matcher;
+
     bool m_preempted = false;
  
     // amount of processed tokens, e.g. prompt can be processed using multiple consequence inferences
@@ -145,13 +203,47 @@ class SequenceGroup {
     size_t m_num_scheduled_tokens = 0;
     // context length of longest sequence within a group
     size_t m_max_content_len = 0;
+    // a number of candidate tokens proposed by draft model on current step (speculative decoding)
+    size_t m_num_candidate_tokens = 0;
+    // a number of generated tokens already pushed to generation stream
+    size_t m_num_streamed_tokens = 0;
+    // sliding window KV cache: a number of processed tokens, whose KV blocks are evicted; it's a multiple of block size,
+    // so the rest of context is stored in KV blocks in the same way as a context without evicted tokens
+    size_t m_num_evicted_tokens = 0;
+    // requests without deadline have the latest possible one
+    std::chrono::steady_clock::time_point m_deadline = std::chrono::steady_clock::time_point::max();
+    // telemetry of token latencies: a number of generated tokens already timed and time of the last of them,
+    // which is the time of adding the request until the first token is generated
+    size_t m_num_timed_tokens = 0;
+    std::chrono::steady_clock::time_point m_last_token_time;
+    // lifecycle of the request, which is published to generation stream on notifications
+    RequestMetrics m_metrics;
+    // log-probabilities of scored prompt tokens, which are computed chunk by chunk of the prompt
+    std::vector<float> m_scored_log_probs;
+    // KV cache of prompt prefix computed by another pipeline, which is imported when prompt is scheduled for the first time
+    KVCacheBlob::Ptr m_imported_kv_cache;
+    // KV cache of processed prompt, which is returned by KV cache export request
+    KVCacheBlob::Ptr m_exported_kv_cache;
 
     SequenceGroup(uint64_t request_id, const GenerationConfig& sampling_params, std::size_t block_size)
         : m_request_id(request_id),
           m_sampling_params(sampling_params),
           m_block_size(block_size) {
-            m_generation_stream = GenerationStream::create();    
+            m_generation_stream = GenerationStream::create();
+            m_metrics.enqueued_time = m_last_token_time = std::chrono::steady_clock::now();
+            if (m_sampling_params.deadline_ms > 0)
+                m_deadline = m_metrics.enqueued_time + std::chrono::milliseconds(m_sampling_params.deadline_ms);
+            std::seed_seq seed{static_cast<uint64_t>(m_sampling_params.rng_seed), m_request_id};
+            m_rng_engine.seed(seed);
+            if (m_sampling_params.prompt_lookup_num_tokens > 0)
+                m_ngram_index = std::make_shared<NGramIndex>(m_sampling_params.max_ngram_size);
            }
+
+    Sequence::Ptr _create_sequence() {
+        Sequence::Ptr sequence = Sequence::create(m_next_sequence_id++);
+        sequence->set_logit_processor(std::make_shared<LogitProcessor>(m_sampling_params, m_prompt_ids, m_token_constraint));
+        return sequence;
+    }
 public:
     using Ptr = std::shared_ptr<SequenceGroup>;
     using CPtr = std::shared_ptr<const SequenceGroup>;
@@ -162,10 +254,18 @@ public:
 
     SequenceGroup(uint64_t request_id, const ov::Tensor input_ids, const GenerationConfig& sampling_params, std::size_t block_size)
         : SequenceGroup(request_id, sampling_params, block_size) {
-        add_sequence(Sequence::create(m_next_sequence_id++));
-
         m_prompt_ids.resize(input_ids.get_size());
         std::copy_n(input_ids.data<int64_t>(), input_ids.get_size(), m_prompt_ids.begin());
+        if (m_sampling_params.is_scoring()) {
+            // the first prompt token has no context to be scored in
+            OPENVINO_ASSERT(m_sampling_params.num_scored_tokens < m_prompt_ids.size(), "Scoring request ", request_id,
+                " scores more tokens than its prompt has after the first one");
+            m_scored_log_probs.resize(m_sampling_params.num_scored_tokens);
+        }
+        OPENVINO_ASSERT(!m_sampling_params.export_kv_cache || m_prompt_ids.size() > 1, "KV cache export request ", request_id,
+            " must have at least 2 prompt tokens, since the last one is not exported");
+
+        add_sequence(_create_sequence());
     }
 
     void add_sequence(const Sequence::Ptr & sequence) {
@@ -184,9 +284,18 @@ public:
         std::vector<int64_t> dropped_seq_ids;
         for (auto& running_sequence : get_running_sequences()) {
             const auto generated_len = running_sequence->get_generated_len();
-            if (m_sampling_params.max_new_tokens == generated_len ||
-                running_sequence->get_generated_ids().back() == m_sampling_params.eos_token_id && !m_sampling_params.ignore_eos) {
-                // stop sequence by max_new_tokens or EOS token
+            bool is_stopped = m_sampling_params.max_new_tokens == generated_len ||
+                m_sampling_params.is_stop_token(running_sequence->get_generated_ids().back());
+            if (!is_stopped && m_stop_string_matcher) {
+                const size_t stopped_len = running_sequence->match_stop_strings(*m_stop_string_matcher);
+                if (stopped_len > 0) {
+                    // several tokens can be generated on a step (e.g. validated speculative candidates), tokens after stop string are dropped
+                    running_sequence->remove_last_tokens(generated_len - stopped_len);
+                    is_stopped = true;
+                }
+            }
+            if (is_stopped) {
+                // stop sequence by max_new_tokens, stop token or stop string; KV blocks are freed on the same step
                 running_sequence->set_status(SequenceStatus::FINISHED);
                 dropped_seq_ids.push_back(running_sequence->get_id());
             }
@@ -281,6 +390,10 @@ public:
         return m_request_id;
     }
 
+    uint64_t get_group_id() const {
+        return m_group_id;
+    }
+
     size_t get_num_scheduled_tokens() const {
         return m_num_scheduled_tokens;
     }
@@ -292,9 +405,29 @@ public:
     void preempt_tokens(size_t num_preempt_tokens) {
         OPENVINO_ASSERT(num_preempt_tokens <= m_num_processed_tokens);
         m_num_processed_tokens -= num_preempt_tokens;
+        // evicted tokens are recomputed only together with the whole context
+        if (m_num_processed_tokens == 0)
+            m_num_evicted_tokens = 0;
+        OPENVINO_ASSERT(m_num_processed_tokens >= m_num_evicted_tokens, "Evicted tokens cannot be preempted partially");
         m_preempted = true;
     }
 
+    size_t get_num_evicted_tokens() const {
+        return m_num_evicted_tokens;
+    }
+
+    // marks 'num_tokens' processed tokens after already evicted ones as evicted (see BlockManager::evict_blocks)
+    void evict_tokens(size_t num_tokens) {
+        OPENVINO_ASSERT(num_tokens % m_block_size == 0 && m_num_evicted_tokens + num_tokens <= m_num_processed_tokens);
+        m_num_evicted_tokens += num_tokens;
+    }
+
+    // marks tokens as processed without computation, e.g. when their KV cache is restored by prefix caching
+    void update_processed_tokens_num(size_t processed_tokens) {
+        m_num_processed_tokens = processed_tokens;
+        m_max_content_len = std::max(m_max_content_len, m_num_processed_tokens);
+    }
+
     // returns context length taking into account scheduled tokens
     size_t get_context_len() const {
         OPENVINO_ASSERT(!has_finished());
@@ -311,6 +444,130 @@ public:
 
     void clear_scheduled_tokens() {
         m_num_scheduled_tokens = 0;
+        m_num_candidate_tokens = 0;
+    }
+
+    // whether candidates can be proposed for this group; currently only a single sequence is supported
+    bool can_speculate() const {
+        return num_total_seqs() == 1 && !is_scoring() && (m_sampling_params.is_greedy_sampling() ||
+            (m_sampling_params.is_multinomial() && m_sampling_params.num_return_sequences == 1));
+    }
+
+    // whether candidates are proposed by prompt lookup instead of draft model
+    bool is_prompt_lookup() const {
+        return m_ngram_index != nullptr;
+    }
+
+    // constrains text of generated tokens; must be set before generation is started
+    void set_token_constraint(const TokenConstraint::Ptr& token_constraint) {
+        OPENVINO_ASSERT(m_num_processed_tokens == 0 && m_sequences.size() == 1, "Token constraint must be set before generation is started");
+        m_token_constraint = token_constraint;
+        m_sequences[0]->set_logit_processor(std::make_shared<LogitProcessor>(m_sampling_params, m_prompt_ids, m_token_constraint));
+    }
+
+    void set_stop_string_matcher(const StopStringMatcher::Ptr& stop_string_matcher) {
+        m_stop_string_matcher = stop_string_matcher;
+    }
+
+    NGramIndex& get_ngram_index() {
+        OPENVINO_ASSERT(m_ngram_index, "Prompt lookup is not enabled for request ", m_request_id);
+        return *m_ngram_index;
+    }
+
+    // schedules validation of 'num_candidate_tokens' candidates together with the last generated token:
+    // - draft model does not compute KV cache of the last candidate, so to keep KV caches of both models in sync
+    //   main model does not process it as well
+    // - prompt lookup has no such limitation, so all candidates are processed and one more token is generated
+    //   when all of them are accepted
+    void schedule_candidate_tokens(size_t num_candidate_tokens) {
+        m_num_candidate_tokens = num_candidate_tokens;
+        m_num_scheduled_tokens = is_prompt_lookup() ? num_candidate_tokens + 1 : num_candidate_tokens;
+    }
+
+    size_t get_num_candidate_tokens() const {
+        return m_num_candidate_tokens;
+    }
+
+    // draft model proposes candidates token by token, so speculating groups process a single token on each
+    // of the first 'num_candidate_tokens' draft passes, while other groups keep draft KV cache in sync on the first pass
+    size_t get_num_draft_tokens(size_t draft_step) const {
+        if (!is_scheduled() || !can_speculate() || is_prompt_lookup())
+            return 0;
+        if (m_num_candidate_tokens > 0)
+            return draft_step < m_num_candidate_tokens ? 1 : 0;
+        return draft_step == 0 ? m_num_scheduled_tokens : 0;
+    }
+
+    // position of the first token processed by draft model on 'draft_step' pass
+    size_t get_draft_position(size_t draft_step) const {
+        return m_num_processed_tokens + (m_num_candidate_tokens > 0 ? draft_step : 0);
+    }
+
+    // a number of last scheduled tokens of each running sequence, whose logits are used by sampler:
+    // none for a part of prompt, all of them for validation of candidates and the last one otherwise
+    size_t get_num_sampled_tokens() const {
+        if (is_scoring()) {
+            // logits of all tokens starting from the first sampled position are computed, so they are the last tokens of a chunk
+            const size_t first_sampled_position = get_first_sampled_prompt_position(), context_len = get_context_len();
+            return context_len > first_sampled_position ? std::min(context_len - first_sampled_position, m_num_scheduled_tokens) : 0;
+        }
+        if (!requires_sampling())
+            return 0;
+        return m_num_candidate_tokens > 0 ? m_num_scheduled_tokens : 1;
+    }
+
+    // scoring requests only process prompt, its tokens are scored by logits of preceding positions
+    bool is_scoring() const {
+        return m_sampling_params.is_scoring();
+    }
+
+    // position of the first prompt token, whose logits are used: the last one predicts the first generated token,
+    // while for scoring it's the one preceding the first scored token; for KV cache export it's the last exported token,
+    // which is computed to finish the request; KV cache of earlier tokens can be restored from cache
+    size_t get_first_sampled_prompt_position() const {
+        if (is_exporting_kv_cache())
+            return get_prompt_len() - 2;
+        return get_prompt_len() - m_sampling_params.num_scored_tokens - 1;
+    }
+
+    // KV cache export requests process prompt without its last token and finish without sampling
+    bool is_exporting_kv_cache() const {
+        return m_sampling_params.export_kv_cache;
+    }
+
+    void set_exported_kv_cache(KVCacheBlob::Ptr kv_cache) {
+        m_exported_kv_cache = std::move(kv_cache);
+    }
+
+    void set_imported_kv_cache(KVCacheBlob::Ptr kv_cache) {
+        m_imported_kv_cache = std::move(kv_cache);
+    }
+
+    bool has_imported_kv_cache() const {
+        return m_imported_kv_cache != nullptr;
+    }
+
+    // import is attempted once: if it fails or imported KV cache is preempted later, prompt is computed
+    KVCacheBlob::Ptr release_imported_kv_cache() {
+        return std::move(m_imported_kv_cache);
+    }
+
+    // stores log-probability of the prompt token following 'position', which is computed by logits of this position
+    void set_scored_log_prob(size_t position, float log_prob) {
+        OPENVINO_ASSERT(position >= get_first_sampled_prompt_position() && position + 1 < get_prompt_len());
+        m_scored_log_probs[position - get_first_sampled_prompt_position()] = log_prob;
+    }
+
+    // the same for draft model pass 'draft_step': only proposed candidates are sampled
+    size_t get_num_sampled_draft_tokens(size_t draft_step) const {
+        return m_num_candidate_tokens > 0 ? get_num_draft_tokens(draft_step) : 0;
+    }
+
+    // drops KV cache of tokens, which were processed, but are not valid anymore (e.g. rejected speculative candidates)
+    void rollback_processed_tokens(size_t num_tokens) {
+        OPENVINO_ASSERT(num_tokens + m_num_evicted_tokens <= m_num_processed_tokens);
+        m_num_processed_tokens -= num_tokens;
+        m_max_content_len = m_num_processed_tokens;
     }
 
     bool is_scheduled() const {
@@ -321,7 +578,7 @@ public:
         OPENVINO_ASSERT(!has_finished(), "Internal error: this function cannot be called on finished sequence group");
         OPENVINO_ASSERT(get_num_scheduled_tokens() == 0, "Internal error: this function cannot be called when we are already in scheduling phase");
         // if sequence group has not finished, it has at least one token to process
-        size_t num_available_tokens = std::max(get_prompt_len(), m_max_content_len);
+        size_t num_available_tokens = is_exporting_kv_cache() ? get_prompt_len() - 1 : std::max(get_prompt_len(), m_max_content_len);
         return std::max<size_t>(num_available_tokens - m_num_processed_tokens, 1u);
     }
 
@@ -345,8 +602,9 @@ public:
         return m_prompt_ids;
     }
 
+    // blocks of evicted tokens are not counted
     size_t get_num_logical_blocks() const {
-        return (get_context_len() + m_block_size - 1) / m_block_size;
+        return (get_context_len() - m_num_evicted_tokens + m_block_size - 1) / m_block_size;
     }
 
     // requires number of physical blocks for next generation
@@ -367,13 +625,19 @@ public:
         return m_sampling_params;
     }
 
+    std::mt19937& get_rng_engine() {
+        return m_rng_engine;
+    }
+
     void reset() {
         m_sequences.clear();
         m_next_sequence_id = 0;
-        add_sequence(Sequence::create(m_next_sequence_id++));
+        add_sequence(_create_sequence());
         clear_scheduled_tokens();
         m_num_processed_tokens = 0;
         m_max_content_len = 0;
+        m_num_streamed_tokens = 0;
+        m_num_evicted_tokens = 0;
     }
 
     bool is_empty() {
@@ -424,25 +688,106 @@ public:
     }
 
     void set_generation_status(GenerationStatus status) {
+        // final metrics are published before status, so completion callbacks observe them
+        if (status != GenerationStatus::RUNNING) {
+            m_metrics.finished_time = std::chrono::steady_clock::now();
+            m_generation_stream->set_metrics(m_metrics);
+        }
         m_generation_stream->set_generation_status(status);
     }
 
+    const RequestMetrics& get_metrics() const {
+        return m_metrics;
+    }
+
+    void record_scheduled(std::chrono::steady_clock::time_point now) {
+        if (m_metrics.first_scheduled_time == std::chrono::steady_clock::time_point{})
+            m_metrics.first_scheduled_time = now;
+    }
+
+    void record_preemption(size_t num_recomputed_tokens) {
+        ++m_metrics.num_preemptions;
+        m_metrics.num_recomputed_tokens += num_recomputed_tokens;
+    }
+
+    void record_cached_prompt_tokens(size_t num_tokens) {
+        m_metrics.num_cached_prompt_tokens += num_tokens;
+    }
+
+    void record_imported_prompt_tokens(size_t num_tokens) {
+        m_metrics.num_imported_prompt_tokens += num_tokens;
+    }
+
     bool handle_dropped() {
         return m_generation_stream->get_status() == GenerationStatus::DROPPED_BY_HANDLE;
     }
 
-    void notify_handle() {
+    bool dropped_by_pipeline() {
+        return m_generation_stream->get_status() == GenerationStatus::DROPPED_BY_PIPELINE;
+    }
 
-        if (out_of_memory()) {
-            set_generation_status(GenerationStatus::IGNORED);
-        } else if (has_finished()) {
-            set_generation_status(GenerationStatus::FINISHED);
-        }
+    std::chrono::steady_clock::time_point get_deadline() const {
+        return m_deadline;
+    }
+
+    bool is_deadline_exceeded(std::chrono::steady_clock::time_point now) const {
+        return now > m_deadline;
+    }
+
+    size_t get_num_timed_tokens() const {
+        return m_num_timed_tokens;
+    }
 
+    // returns a number of tokens generated since the previous call and sets 'duration_s' to time of their generation;
+    // tokens regenerated after preemption by recomputation are not timed again
+    size_t time_generated_tokens(std::chrono::steady_clock::time_point now, double& duration_s) {
+        size_t num_generated_tokens = 0;
+        for (const auto& sequence : m_sequences)
+            num_generated_tokens = std::max(num_generated_tokens, sequence->get_generated_len());
+        if (num_generated_tokens <= m_num_timed_tokens)
+            return 0;
+
+        duration_s = std::chrono::duration<double>(now - m_last_token_time).count();
+        const size_t num_new_tokens = num_generated_tokens - m_num_timed_tokens;
+        m_num_timed_tokens = num_generated_tokens;
+        m_last_token_time = now;
+        return num_new_tokens;
+    }
+
+    void notify_handle() {
         GenerationOutputs outputs;
 
+        if (m_metrics.first_token_time == std::chrono::steady_clock::time_point{}) {
+            for (const auto& sequence : m_sequences) {
+                if (sequence->get_generated_len() > 0) {
+                    m_metrics.first_token_time = std::chrono::steady_clock::now();
+                    break;
+                }
+            }
+        }
+        m_generation_stream->set_metrics(m_metrics);
+
+        // Exported KV cache is available only when prompt is processed, not when request is out of memory
+        if (is_exporting_kv_cache()) {
+            if (m_sequences[0]->has_finished() && m_exported_kv_cache) {
+                GenerationOutput output;
+                output.score = 0.0f;
+                output.kv_cache = std::move(m_exported_kv_cache);
+                outputs.emplace(m_sequences[0]->get_grouped_id(), output);
+                m_generation_stream->push(outputs);
+            }
+        // Scoring results are available only when the whole prompt is processed, not when request is out of memory
+        } else if (is_scoring()) {
+            if (m_sequences[0]->has_finished()) {
+                GenerationOutput output;
+                output.generated_token_ids.assign(m_prompt_ids.end() - m_scored_log_probs.size(), m_prompt_ids.end());
+                output.log_probs = m_scored_log_probs;
+                output.score = std::accumulate(m_scored_log_probs.begin(), m_scored_log_probs.end(), 0.0f);
+                outputs.emplace(m_sequences[0]->get_grouped_id(), output);
+                m_generation_stream->push(outputs);
+            }
         // For beam search streaming is not available, so we notify only upon finishing
-        if(m_sampling_params.is_beam_search()) {
+        } else if(m_sampling_params.is_beam_search()) {
             if (has_finished()) {
                 std::vector<Sequence::CPtr> finished_sequences = get_finished_sequences();
 
@@ -466,10 +811,17 @@ public:
                 for (auto& sequence : m_sequences) {
                     // todo: check seq.is_finished() to generate without several </s>
                     // or is it ok to use padding?
-                    const auto last_gen_token = sequence->get_last_generation_output();
+                    // nothing new to stream (e.g. handle is notified again on OOM or drop)
+                    if (sequence->get_generated_len() == m_num_streamed_tokens)
+                        continue;
+                    // speculative decoding can generate several tokens per step
+                    const auto last_gen_token = sequence->get_last_generation_output(sequence->get_generated_len() - m_num_streamed_tokens);
+                    m_num_streamed_tokens = sequence->get_generated_len();
                     outputs.emplace(sequence->get_grouped_id(), last_gen_token);
                 }
-                m_generation_stream->push(outputs);
+                if (outputs.size()) {
+                    m_generation_stream->push(outputs);
+                }
             } else if (has_finished()) {
                 std::vector<Sequence::CPtr> finished_sequences = get_finished_sequences();
 
@@ -486,5 +838,12 @@ public:
                 }
             }
         }
+
+        // status is updated after final outputs are pushed, so readers and completion callbacks observe all of them
+        if (out_of_memory()) {
+            set_generation_status(GenerationStatus::IGNORED);
+        } else if (has_finished()) {
+            set_generation_status(GenerationStatus::FINISHED);
+        }
     } 
 };
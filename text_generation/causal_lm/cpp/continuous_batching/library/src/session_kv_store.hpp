@@ -0,0 +1,395 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "openvino/core/except.hpp"
+
+#include "block_manager.hpp"
+#include "kv_cache_blob.hpp"
+
+// KV cache of finished sessions (e.g. chat conversations) stored on disk, so a later request, whose prompt continues
+// a stored session, imports KV cache of its prefix instead of computing it; sessions survive restarts of the pipeline.
+// Each session is a KVCacheBlob file with full KV blocks of its tokens, named by prefix caching hash of the last block
+// (see BlockManager::compute_block_hash). Hashes of all blocks are indexed, so a prompt sharing only the first blocks
+// of a session finds it as well. Files are written by a background thread, so generation steps only copy KV cache
+// to host memory, and are memory mapped on load, so file pages are read by the import of KV blocks itself
+class SessionKVStore {
+    struct Session {
+        std::string m_path;
+        size_t m_byte_size = 0;
+        // chain of block hashes of session tokens
+        std::vector<size_t> m_block_hashes;
+        // KV cache is kept in memory until it's written to disk
+        KVCacheBlob::Ptr m_pending_kv_cache;
+    };
+    using SessionIt = std::list<Session>::iterator;
+
+    // writes 'm_kv_cache' to 'm_path' or removes the file, if blob is empty
+    struct IOTask {
+        std::string m_path;
+        size_t m_hash = 0;
+        KVCacheBlob::Ptr m_kv_cache;
+    };
+
+    std::string m_dir;
+    size_t m_block_size;
+    size_t m_max_byte_size;
+    size_t m_byte_size = 0;
+
+    std::mutex m_mutex;
+    // the most recently used sessions first
+    std::list<Session> m_sessions;
+    // block hash => the longest session containing this block
+    std::unordered_map<size_t, SessionIt> m_index;
+
+    std::condition_variable m_io_cv;
+    std::deque<IOTask> m_io_tasks;
+    bool m_io_busy = false;
+    bool m_stop_io = false;
+    std::thread m_io_thread;
+
+    // sessions are not keyed by LoRA adapter, since adapter ids are not persistent; such requests are not stored
+    std::vector<size_t> _compute_block_hashes(const TokenIds& token_ids, size_t num_blocks) const {
+        std::vector<size_t> block_hashes(num_blocks);
+        size_t hash = 0;
+        for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx)
+            block_hashes[block_idx] = hash = BlockManager::compute_block_hash(hash, token_ids, block_idx, m_block_size);
+        return block_hashes;
+    }
+
+    std::string _get_path(size_t hash) const {
+        std::stringstream name;
+        name << std::hex << hash;
+        return m_dir + "/" + name.str() + ".kv";
+    }
+
+    void _index_session(SessionIt session_it) {
+        for (size_t hash : session_it->m_block_hashes) {
+            auto indexed = m_index.emplace(hash, session_it);
+            if (!indexed.second && indexed.first->second->m_block_hashes.size() < session_it->m_block_hashes.size())
+                indexed.first->second = session_it;
+        }
+    }
+
+    // must be called under m_mutex
+    void _remove_session(SessionIt session_it) {
+        m_io_tasks.push_back({session_it->m_path, session_it->m_block_hashes.back(), nullptr});
+        m_io_cv.notify_all();
+        m_byte_size -= session_it->m_byte_size;
+        m_sessions.erase(session_it);
+        // blocks of the removed session can be contained in other sessions
+        m_index.clear();
+        for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it)
+            _index_session(it);
+    }
+
+    // must be called under m_mutex
+    void _evict_sessions() {
+        while (m_byte_size > m_max_byte_size && !m_sessions.empty())
+            _remove_session(std::prev(m_sessions.end()));
+    }
+
+    static bool _write_file(const std::string& path, const KVCacheBlob& kv_cache) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(kv_cache.data()), kv_cache.size());
+        file.close();
+        return !file.fail();
+    }
+
+    void _io_loop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_io_cv.wait(lock, [this] { return m_stop_io || !m_io_tasks.empty(); });
+            // queued sessions are written before the store is destroyed
+            if (m_io_tasks.empty())
+                break;
+            IOTask task = std::move(m_io_tasks.front());
+            m_io_tasks.pop_front();
+            m_io_busy = true;
+            lock.unlock();
+
+            if (task.m_kv_cache) {
+                // a partially written file is never found by the scan of directory
+                const std::string tmp_path = task.m_path + ".tmp";
+                const bool is_written = _write_file(tmp_path, *task.m_kv_cache);
+                lock.lock();
+                // session can be removed while it's written
+                auto index_it = m_index.find(task.m_hash);
+                const bool is_stored = index_it != m_index.end() && index_it->second->m_path == task.m_path;
+                if (is_written && is_stored && std::rename(tmp_path.c_str(), task.m_path.c_str()) == 0) {
+                    index_it->second->m_pending_kv_cache.reset();
+                } else {
+                    // if the file cannot be written, session is kept in memory
+                    std::remove(tmp_path.c_str());
+                }
+            } else {
+                std::remove(task.m_path.c_str());
+                lock.lock();
+            }
+            m_io_busy = false;
+            m_io_cv.notify_all();
+        }
+    }
+
+    static std::vector<std::string> _list_files(const std::string& dir) {
+        std::vector<std::string> file_names;
+#ifdef _WIN32
+        _finddata_t file_data;
+        intptr_t handle = _findfirst((dir + "/*").c_str(), &file_data);
+        if (handle == -1)
+            return file_names;
+        do {
+            if (!(file_data.attrib & _A_SUBDIR))
+                file_names.push_back(file_data.name);
+        } while (_findnext(handle, &file_data) == 0);
+        _findclose(handle);
+#else
+        DIR* dir_handle = opendir(dir.c_str());
+        if (!dir_handle)
+            return file_names;
+        while (dirent* entry = readdir(dir_handle)) {
+            const std::string file_name = entry->d_name;
+            if (file_name != "." && file_name != "..")
+                file_names.push_back(file_name);
+        }
+        closedir(dir_handle);
+#endif
+        return file_names;
+    }
+
+    static bool _ends_with(const std::string& str, const std::string& suffix) {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // reads tokens of a stored session without its KV cache
+    bool _read_session_tokens(const std::string& path, size_t file_size, TokenIds& token_ids) const {
+        std::ifstream file(path, std::ios::binary);
+        KVCacheBlob::Header header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            header.magic != KVCacheBlob::kMagic || header.version != KVCacheBlob::kVersion || header.block_size != m_block_size ||
+            header.num_blocks == 0 || header.num_kv_tokens != header.num_prompt_tokens || header.num_kv_tokens != header.num_blocks * m_block_size ||
+            header.num_prompt_tokens > (file_size - sizeof(header)) / sizeof(int64_t))
+            return false;
+        token_ids.resize(header.num_prompt_tokens);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(token_ids.data()), token_ids.size() * sizeof(int64_t)));
+    }
+
+    // indexes sessions stored by previous runs, the most recently written ones are evicted last
+    void _scan_dir() {
+        std::vector<std::pair<time_t, Session>> sessions;
+        for (const std::string& file_name : _list_files(m_dir)) {
+            const std::string path = m_dir + "/" + file_name;
+            if (_ends_with(file_name, ".kv.tmp")) {
+                std::remove(path.c_str());
+                continue;
+            }
+            struct stat file_stat;
+            TokenIds token_ids;
+            if (!_ends_with(file_name, ".kv") || stat(path.c_str(), &file_stat) != 0 ||
+                static_cast<size_t>(file_stat.st_size) < sizeof(KVCacheBlob::Header) || !_read_session_tokens(path, file_stat.st_size, token_ids))
+                continue;
+            Session session;
+            session.m_path = path;
+            session.m_byte_size = static_cast<size_t>(file_stat.st_size);
+            session.m_block_hashes = _compute_block_hashes(token_ids, token_ids.size() / m_block_size);
+            sessions.emplace_back(file_stat.st_mtime, std::move(session));
+        }
+        std::stable_sort(sessions.begin(), sessions.end(), [] (const std::pair<time_t, Session>& lhs, const std::pair<time_t, Session>& rhs) {
+            return lhs.first > rhs.first;
+        });
+
+        for (auto& session : sessions) {
+            m_byte_size += session.second.m_byte_size;
+            m_sessions.push_back(std::move(session.second));
+            _index_session(std::prev(m_sessions.end()));
+        }
+        _evict_sessions();
+    }
+
+    static KVCacheBlob::Ptr _load(const std::string& path) {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return nullptr;
+        std::vector<uint8_t> buffer(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(buffer.data()), buffer.size()))
+            return nullptr;
+        return std::make_shared<KVCacheBlob>(std::move(buffer));
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        const size_t size = static_cast<size_t>(file_stat.st_size);
+        // private mapping: writes to blob memory never reach the file; mapping stays valid after the file is removed
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return nullptr;
+        std::shared_ptr<uint8_t> mapping(static_cast<uint8_t*>(data), [size] (uint8_t* ptr) {
+            munmap(ptr, size);
+        });
+        return std::make_shared<KVCacheBlob>(std::move(mapping), size);
+#endif
+    }
+
+public:
+    // sessions stored in 'dir' by previous runs with the same 'block_size' are available immediately; when total size
+    // of sessions exceeds 'max_byte_size', the least recently used ones are removed
+    SessionKVStore(const std::string& dir, size_t block_size, size_t max_byte_size)
+        : m_dir(dir), m_block_size(block_size), m_max_byte_size(max_byte_size) {
+        OPENVINO_ASSERT(!m_dir.empty() && m_block_size > 0, "Session KV cache requires a directory and positive block size");
+#ifdef _WIN32
+        _mkdir(m_dir.c_str());
+#else
+        mkdir(m_dir.c_str(), 0755);
+#endif
+        struct stat dir_stat;
+        OPENVINO_ASSERT(stat(m_dir.c_str(), &dir_stat) == 0 && (dir_stat.st_mode & S_IFDIR), "Session KV cache directory ", m_dir, " cannot be created");
+        _scan_dir();
+        m_io_thread = std::thread(&SessionKVStore::_io_loop, this);
+    }
+
+    SessionKVStore(const SessionKVStore&) = delete;
+    SessionKVStore& operator=(const SessionKVStore&) = delete;
+
+    ~SessionKVStore() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop_io = true;
+        }
+        m_io_cv.notify_all();
+        m_io_thread.join();
+    }
+
+    const std::string& get_dir() const {
+        return m_dir;
+    }
+
+    size_t get_block_size() const {
+        return m_block_size;
+    }
+
+    size_t get_num_sessions() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_sessions.size();
+    }
+
+    // whether all full blocks of 'token_ids' are stored
+    bool contains(const TokenIds& token_ids) {
+        const size_t num_blocks = token_ids.size() / m_block_size;
+        if (num_blocks == 0)
+            return false;
+        const size_t hash = _compute_block_hashes(token_ids, num_blocks).back();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_index.count(hash) > 0;
+    }
+
+    // stores KV cache of full blocks of session tokens (KVCacheBlob prompt), which replaces stored prefixes of the session
+    void store(KVCacheBlob::Ptr kv_cache) {
+        OPENVINO_ASSERT(kv_cache && kv_cache->get_header().block_size == m_block_size && kv_cache->get_num_blocks() > 0 &&
+                        kv_cache->get_num_kv_tokens() == kv_cache->get_num_blocks() * m_block_size &&
+                        kv_cache->get_num_kv_tokens() == kv_cache->get_header().num_prompt_tokens,
+                        "Session KV cache must contain full blocks of all session tokens");
+        if (kv_cache->size() > m_max_byte_size)
+            return;
+
+        Session session;
+        session.m_block_hashes = _compute_block_hashes(kv_cache->get_prompt_ids(), kv_cache->get_num_blocks());
+        session.m_path = _get_path(session.m_block_hashes.back());
+        session.m_byte_size = kv_cache->size();
+        session.m_pending_kv_cache = kv_cache;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto index_it = m_index.find(session.m_block_hashes.back());
+        if (index_it != m_index.end()) {
+            // the same session or its continuation is already stored
+            m_sessions.splice(m_sessions.begin(), m_sessions, index_it->second);
+            return;
+        }
+        for (size_t hash : session.m_block_hashes) {
+            index_it = m_index.find(hash);
+            if (index_it != m_index.end() && index_it->second->m_block_hashes.back() == hash)
+                _remove_session(index_it->second);
+        }
+
+        m_io_tasks.push_back({session.m_path, session.m_block_hashes.back(), kv_cache});
+        m_byte_size += session.m_byte_size;
+        m_sessions.push_front(std::move(session));
+        _index_session(m_sessions.begin());
+        _evict_sessions();
+        m_io_cv.notify_all();
+    }
+
+    // KV cache of a session sharing the most of the first 'max_num_blocks' blocks with 'token_ids' or nullptr; the session
+    // can be a different continuation of the common prefix, so its tokens must be compared by caller
+    KVCacheBlob::Ptr find(const TokenIds& token_ids, size_t max_num_blocks) {
+        max_num_blocks = std::min(max_num_blocks, token_ids.size() / m_block_size);
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t hash = 0;
+            SessionIt session_it = m_sessions.end();
+            for (size_t block_idx = 0; block_idx < max_num_blocks; ++block_idx) {
+                hash = BlockManager::compute_block_hash(hash, token_ids, block_idx, m_block_size);
+                auto index_it = m_index.find(hash);
+                if (index_it == m_index.end())
+                    break;
+                session_it = index_it->second;
+            }
+            if (session_it == m_sessions.end())
+                return nullptr;
+            m_sessions.splice(m_sessions.begin(), m_sessions, session_it);
+            if (session_it->m_pending_kv_cache)
+                return session_it->m_pending_kv_cache;
+            path = session_it->m_path;
+        }
+
+        // the file can be removed or damaged meanwhile, then prompt is computed
+        try {
+            return _load(path);
+        } catch (const ov::Exception&) {
+            return nullptr;
+        }
+    }
+
+    // waits until queued sessions are written to disk
+    void flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_io_cv.wait(lock, [this] { return m_io_tasks.empty() && !m_io_busy; });
+    }
+};
@@ -0,0 +1,95 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "openvino/core/except.hpp"
+
+#include "token_constraint.hpp"
+
+// Aho-Corasick automaton over bytes of stop strings: texts of generated tokens are fed one by one and
+// a stop string is found as soon as its last byte is fed, even if it spans several tokens. Each sequence
+// keeps only its automaton state instead of a text buffer, so matching costs O(token text length) per token
+class StopStringMatcher {
+    struct Node {
+        std::array<int, 256> m_next;
+        // whether some stop string is a suffix of text matched in this node
+        bool m_is_match = false;
+    };
+
+    std::vector<Node> m_nodes;
+    TokenVocabulary::Ptr m_vocabulary;
+
+public:
+    using Ptr = std::shared_ptr<StopStringMatcher>;
+
+    StopStringMatcher(const std::set<std::string>& stop_strings, const TokenVocabulary::Ptr& vocabulary) :
+        m_vocabulary(vocabulary) {
+        m_nodes.emplace_back();
+        m_nodes[0].m_next.fill(-1);
+        for (const std::string& stop_string : stop_strings) {
+            OPENVINO_ASSERT(!stop_string.empty(), "Stop strings must not be empty");
+            int node_id = 0;
+            for (char c : stop_string) {
+                uint8_t byte = static_cast<uint8_t>(c);
+                if (m_nodes[node_id].m_next[byte] < 0) {
+                    m_nodes[node_id].m_next[byte] = static_cast<int>(m_nodes.size());
+                    m_nodes.emplace_back();
+                    m_nodes.back().m_next.fill(-1);
+                }
+                node_id = m_nodes[node_id].m_next[byte];
+            }
+            m_nodes[node_id].m_is_match = true;
+        }
+
+        // breadth-first traversal turns trie into automaton: missing transitions follow failure links
+        std::vector<int> failure_links(m_nodes.size(), 0);
+        std::queue<int> nodes_to_visit;
+        for (int& next : m_nodes[0].m_next) {
+            if (next < 0) {
+                next = 0;
+            } else {
+                nodes_to_visit.push(next);
+            }
+        }
+        while (!nodes_to_visit.empty()) {
+            int node_id = nodes_to_visit.front();
+            nodes_to_visit.pop();
+            const int failure_link = failure_links[node_id];
+            m_nodes[node_id].m_is_match = m_nodes[node_id].m_is_match || m_nodes[failure_link].m_is_match;
+            for (size_t byte = 0; byte < 256; ++byte) {
+                int& next = m_nodes[node_id].m_next[byte];
+                if (next < 0) {
+                    next = m_nodes[failure_link].m_next[byte];
+                } else {
+                    failure_links[next] = m_nodes[failure_link].m_next[byte];
+                    nodes_to_visit.push(next);
+                }
+            }
+        }
+    }
+
+    int get_initial_state() const {
+        return 0;
+    }
+
+    // feeds text of the token; returns true if any stop string ends within it
+    bool feed_token(int& state, int64_t token_id) const {
+        if (token_id < 0 || token_id >= static_cast<int64_t>(m_vocabulary->size()))
+            return false;
+        bool is_match = false;
+        for (char c : m_vocabulary->get_text(token_id)) {
+            state = m_nodes[state].m_next[static_cast<uint8_t>(c)];
+            is_match = is_match || m_nodes[state].m_is_match;
+        }
+        return is_match;
+    }
+};
@@ -0,0 +1,350 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "openvino/core/except.hpp"
+
+// histogram with fixed upper bounds of buckets; unlike Prometheus buckets, counts are not cumulative,
+// so histograms are merged by adding counts, while cumulative counts are computed on export
+class Histogram {
+    std::vector<double> m_upper_bounds;
+    std::vector<size_t> m_bucket_counts;
+    double m_sum = 0.0;
+    size_t m_count = 0;
+
+public:
+    explicit Histogram(std::vector<double> upper_bounds) :
+        m_upper_bounds(std::move(upper_bounds)),
+        m_bucket_counts(m_upper_bounds.size(), 0) {
+        OPENVINO_ASSERT(std::is_sorted(m_upper_bounds.begin(), m_upper_bounds.end()), "Upper bounds of histogram buckets must be sorted");
+    }
+
+    // 'count' observations of the same 'value'
+    void observe(double value, size_t count = 1) {
+        auto bucket_it = std::lower_bound(m_upper_bounds.begin(), m_upper_bounds.end(), value);
+        // values above the last bound are counted by implicit +Inf bucket only
+        if (bucket_it != m_upper_bounds.end())
+            m_bucket_counts[bucket_it - m_upper_bounds.begin()] += count;
+        m_sum += value * count;
+        m_count += count;
+    }
+
+    void merge(const Histogram& other) {
+        OPENVINO_ASSERT(m_upper_bounds == other.m_upper_bounds, "Only histograms with the same buckets can be merged");
+        for (size_t bucket_idx = 0; bucket_idx < m_bucket_counts.size(); ++bucket_idx)
+            m_bucket_counts[bucket_idx] += other.m_bucket_counts[bucket_idx];
+        m_sum += other.m_sum;
+        m_count += other.m_count;
+    }
+
+    const std::vector<double>& get_upper_bounds() const {
+        return m_upper_bounds;
+    }
+
+    // number of observations in bucket (upper_bounds[idx - 1], upper_bounds[idx]]
+    size_t get_bucket_count(size_t bucket_idx) const {
+        return m_bucket_counts.at(bucket_idx);
+    }
+
+    double get_sum() const {
+        return m_sum;
+    }
+
+    size_t get_count() const {
+        return m_count;
+    }
+
+    // writes samples of Prometheus histogram 'name'; 'labels' are comma separated pairs, e.g. phase="forward"
+    void write_prometheus(std::ostream& os, const std::string& name, const std::string& labels = "") const {
+        const std::string bucket_labels = labels.empty() ? "" : labels + ",";
+        size_t cumulative_count = 0;
+        for (size_t bucket_idx = 0; bucket_idx < m_upper_bounds.size(); ++bucket_idx) {
+            cumulative_count += m_bucket_counts[bucket_idx];
+            os << name << "_bucket{" << bucket_labels << "le=\"" << m_upper_bounds[bucket_idx] << "\"} " << cumulative_count << "\n";
+        }
+        os << name << "_bucket{" << bucket_labels << "le=\"+Inf\"} " << m_count << "\n";
+        const std::string sample_labels = labels.empty() ? "" : "{" + labels + "}";
+        os << name << "_sum" << sample_labels << " " << m_sum << "\n";
+        os << name << "_count" << sample_labels << " " << m_count << "\n";
+    }
+
+    // 'num_buckets' bounds start, start * factor, start * factor^2, ...
+    static std::vector<double> exponential_bounds(double start, double factor, size_t num_buckets) {
+        std::vector<double> upper_bounds(num_buckets);
+        for (size_t bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx, start *= factor)
+            upper_bounds[bucket_idx] = start;
+        return upper_bounds;
+    }
+};
+
+// metrics of ContinuousBatchingPipeline collected on every step; durations are in seconds as it's conventional
+// for Prometheus. Metrics are written by a thread running steps and read by any thread, so access is synchronized
+class PipelineTelemetry {
+public:
+    enum class StepPhase {
+        SCHEDULE,
+        LOOKUP_CANDIDATES,
+        PROPOSE_CANDIDATES,
+        FORWARD,
+        SAMPLE,
+        // forward and sample of two parts of batch overlapped on two infer requests
+        FORWARD_AND_SAMPLE,
+        FORK,
+        MULTI_STEP_DECODE,
+        FREE,
+        NUM_PHASES
+    };
+
+    // metrics of a tenant of fair share scheduling
+    struct TenantMetrics {
+        size_t scheduled_tokens = 0;
+        size_t preemptions = 0;
+        // gauge of the last step
+        size_t kv_blocks = 0;
+    };
+
+    // gauges of the last step
+    struct Snapshot {
+        size_t requests = 0;
+        size_t scheduled_requests = 0;
+        float cache_usage = 0.0f;
+    };
+
+private:
+    static constexpr size_t NUM_PHASES = static_cast<size_t>(StepPhase::NUM_PHASES);
+
+    Histogram m_time_to_first_token{Histogram::exponential_bounds(0.01, 2.0, 14)};
+    Histogram m_inter_token_latency{Histogram::exponential_bounds(0.001, 2.0, 14)};
+    Histogram m_step_duration{Histogram::exponential_bounds(0.001, 2.0, 14)};
+    std::array<Histogram, NUM_PHASES> m_phase_durations;
+    Histogram m_tokenize_duration{Histogram::exponential_bounds(0.0001, 2.0, 14)};
+    Histogram m_batch_num_tokens{Histogram::exponential_bounds(1.0, 2.0, 15)};
+
+    size_t m_num_preemptions = 0;
+    size_t m_num_generated_tokens = 0;
+    size_t m_num_out_of_memory_steps = 0;
+    Snapshot m_snapshot;
+    // startup stage => duration; set once by constructor of pipeline
+    std::map<std::string, double> m_startup_durations;
+    // size of KV cache allocated by pipeline; set once by constructor of pipeline
+    size_t m_num_kv_cache_blocks = 0;
+    size_t m_kv_cache_byte_size = 0;
+    // op-level profiling: node type => total execution time; collected only if pipeline is compiled with ov::enable_profiling
+    std::map<std::string, double> m_op_durations;
+    // tenant => its metrics; collected only if scheduler has fair share enabled
+    std::map<size_t, TenantMetrics> m_tenants;
+
+    mutable std::mutex m_mutex;
+
+    static std::array<Histogram, NUM_PHASES> _create_phase_histograms() {
+        std::vector<double> upper_bounds = Histogram::exponential_bounds(0.0001, 2.0, 16);
+        return {Histogram(upper_bounds), Histogram(upper_bounds), Histogram(upper_bounds), Histogram(upper_bounds),
+                Histogram(upper_bounds), Histogram(upper_bounds), Histogram(upper_bounds), Histogram(upper_bounds),
+                Histogram(upper_bounds)};
+    }
+
+    static const char* _get_phase_name(size_t phase_idx) {
+        static const char* phase_names[NUM_PHASES] = {
+            "schedule", "lookup_candidates", "propose_candidates", "forward", "sample",
+            "forward_and_sample", "fork", "multi_step_decode", "free"
+        };
+        return phase_names[phase_idx];
+    }
+
+    static void _write_header(std::ostream& os, const std::string& name, const std::string& type, const std::string& help) {
+        os << "# HELP " << name << " " << help << "\n";
+        os << "# TYPE " << name << " " << type << "\n";
+    }
+
+public:
+    PipelineTelemetry() : m_phase_durations(_create_phase_histograms()) {}
+
+    PipelineTelemetry(const PipelineTelemetry& other) : m_phase_durations(_create_phase_histograms()) {
+        merge(other);
+    }
+
+    void observe_step(double duration_s, size_t num_scheduled_tokens) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_step_duration.observe(duration_s);
+        m_batch_num_tokens.observe(static_cast<double>(num_scheduled_tokens));
+    }
+
+    void observe_phase(StepPhase phase, double duration_s) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_phase_durations[static_cast<size_t>(phase)].observe(duration_s);
+    }
+
+    void observe_tokenize(double duration_s) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tokenize_duration.observe(duration_s);
+    }
+
+    void observe_time_to_first_token(double duration_s) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_time_to_first_token.observe(duration_s);
+        ++m_num_generated_tokens;
+    }
+
+    // 'num_tokens' tokens generated since the previous observation are spaced evenly in 'duration_s'
+    void observe_inter_token_latency(double duration_s, size_t num_tokens) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inter_token_latency.observe(duration_s / num_tokens, num_tokens);
+        m_num_generated_tokens += num_tokens;
+    }
+
+    void add_preemptions(size_t num_preemptions) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_num_preemptions += num_preemptions;
+    }
+
+    void observe_tenant(size_t tenant_id, size_t num_scheduled_tokens, size_t num_kv_blocks, size_t num_preemptions) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        TenantMetrics& tenant = m_tenants[tenant_id];
+        tenant.scheduled_tokens += num_scheduled_tokens;
+        tenant.preemptions += num_preemptions;
+        tenant.kv_blocks = num_kv_blocks;
+    }
+
+    std::map<size_t, TenantMetrics> get_tenants() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_tenants;
+    }
+
+    void add_out_of_memory_step() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_num_out_of_memory_steps;
+    }
+
+    void add_op_duration(const std::string& node_type, double duration_s) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_op_durations[node_type] += duration_s;
+    }
+
+    void set_startup_duration(const std::string& stage, double duration_s) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_startup_durations[stage] = duration_s;
+    }
+
+    void set_kv_cache_size(size_t num_blocks, size_t byte_size) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_num_kv_cache_blocks = num_blocks;
+        m_kv_cache_byte_size = byte_size;
+    }
+
+    void set_snapshot(const Snapshot& snapshot) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_snapshot = snapshot;
+    }
+
+    Snapshot get_snapshot() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_snapshot;
+    }
+
+    // adds metrics of 'other' to this one, e.g. to aggregate NUMA workers; gauges are summed except
+    // cache usage, which is averaged by caller, and startup durations, which are taken as the longest ones
+    void merge(const PipelineTelemetry& other) {
+        std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+        std::unique_lock<std::mutex> other_lock(other.m_mutex, std::defer_lock);
+        std::lock(lock, other_lock);
+
+        m_time_to_first_token.merge(other.m_time_to_first_token);
+        m_inter_token_latency.merge(other.m_inter_token_latency);
+        m_step_duration.merge(other.m_step_duration);
+        for (size_t phase_idx = 0; phase_idx < NUM_PHASES; ++phase_idx)
+            m_phase_durations[phase_idx].merge(other.m_phase_durations[phase_idx]);
+        m_tokenize_duration.merge(other.m_tokenize_duration);
+        m_batch_num_tokens.merge(other.m_batch_num_tokens);
+
+        m_num_preemptions += other.m_num_preemptions;
+        m_num_generated_tokens += other.m_num_generated_tokens;
+        m_num_out_of_memory_steps += other.m_num_out_of_memory_steps;
+        m_snapshot.requests += other.m_snapshot.requests;
+        m_snapshot.scheduled_requests += other.m_snapshot.scheduled_requests;
+        m_snapshot.cache_usage += other.m_snapshot.cache_usage;
+        m_num_kv_cache_blocks += other.m_num_kv_cache_blocks;
+        m_kv_cache_byte_size += other.m_kv_cache_byte_size;
+        for (const auto& stage : other.m_startup_durations)
+            m_startup_durations[stage.first] = std::max(m_startup_durations[stage.first], stage.second);
+        for (const auto& op : other.m_op_durations)
+            m_op_durations[op.first] += op.second;
+        for (const auto& tenant : other.m_tenants) {
+            TenantMetrics& metrics = m_tenants[tenant.first];
+            metrics.scheduled_tokens += tenant.second.scheduled_tokens;
+            metrics.preemptions += tenant.second.preemptions;
+            metrics.kv_blocks += tenant.second.kv_blocks;
+        }
+    }
+
+    // Prometheus text exposition format, version 0.0.4
+    std::string to_prometheus() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ostringstream os;
+
+        _write_header(os, "cb_time_to_first_token_seconds", "histogram", "Time from adding request to its first generated token");
+        m_time_to_first_token.write_prometheus(os, "cb_time_to_first_token_seconds");
+        _write_header(os, "cb_inter_token_latency_seconds", "histogram", "Time between subsequent generated tokens of request");
+        m_inter_token_latency.write_prometheus(os, "cb_inter_token_latency_seconds");
+        _write_header(os, "cb_step_duration_seconds", "histogram", "Duration of pipeline step");
+        m_step_duration.write_prometheus(os, "cb_step_duration_seconds");
+        _write_header(os, "cb_step_phase_duration_seconds", "histogram", "Duration of phases of pipeline step");
+        for (size_t phase_idx = 0; phase_idx < NUM_PHASES; ++phase_idx)
+            m_phase_durations[phase_idx].write_prometheus(os, "cb_step_phase_duration_seconds", std::string("phase=\"") + _get_phase_name(phase_idx) + "\"");
+        _write_header(os, "cb_tokenize_duration_seconds", "histogram", "Duration of prompt tokenization");
+        m_tokenize_duration.write_prometheus(os, "cb_tokenize_duration_seconds");
+        _write_header(os, "cb_batch_num_tokens", "histogram", "Number of tokens scheduled on pipeline step");
+        m_batch_num_tokens.write_prometheus(os, "cb_batch_num_tokens");
+
+        _write_header(os, "cb_preemptions_total", "counter", "Number of sequence groups preempted by swapping or recomputation");
+        os << "cb_preemptions_total " << m_num_preemptions << "\n";
+        _write_header(os, "cb_generated_tokens_total", "counter", "Number of generated tokens");
+        os << "cb_generated_tokens_total " << m_num_generated_tokens << "\n";
+        _write_header(os, "cb_out_of_memory_steps_total", "counter", "Number of steps, which could not schedule any token");
+        os << "cb_out_of_memory_steps_total " << m_num_out_of_memory_steps << "\n";
+
+        _write_header(os, "cb_requests", "gauge", "Number of requests processed by pipeline");
+        os << "cb_requests " << m_snapshot.requests << "\n";
+        _write_header(os, "cb_scheduled_requests", "gauge", "Number of requests scheduled on the last step");
+        os << "cb_scheduled_requests " << m_snapshot.scheduled_requests << "\n";
+        _write_header(os, "cb_cache_usage_percent", "gauge", "KV cache usage");
+        os << "cb_cache_usage_percent " << m_snapshot.cache_usage << "\n";
+
+        if (m_num_kv_cache_blocks > 0) {
+            _write_header(os, "cb_kv_cache_blocks", "gauge", "Number of KV cache blocks allocated by pipeline");
+            os << "cb_kv_cache_blocks " << m_num_kv_cache_blocks << "\n";
+            _write_header(os, "cb_kv_cache_bytes", "gauge", "Size of KV cache allocated by pipeline");
+            os << "cb_kv_cache_bytes " << m_kv_cache_byte_size << "\n";
+        }
+        if (!m_startup_durations.empty()) {
+            _write_header(os, "cb_startup_duration_seconds", "gauge", "Duration of pipeline startup stages");
+            for (const auto& stage : m_startup_durations)
+                os << "cb_startup_duration_seconds{stage=\"" << stage.first << "\"} " << stage.second << "\n";
+        }
+        if (!m_op_durations.empty()) {
+            _write_header(os, "cb_op_duration_seconds_total", "counter", "Execution time of model operations by node type");
+            for (const auto& op : m_op_durations)
+                os << "cb_op_duration_seconds_total{node_type=\"" << op.first << "\"} " << op.second << "\n";
+        }
+        if (!m_tenants.empty()) {
+            _write_header(os, "cb_tenant_scheduled_tokens_total", "counter", "Number of tokens scheduled for requests of tenant");
+            for (const auto& tenant : m_tenants)
+                os << "cb_tenant_scheduled_tokens_total{tenant=\"" << tenant.first << "\"} " << tenant.second.scheduled_tokens << "\n";
+            _write_header(os, "cb_tenant_preemptions_total", "counter", "Number of preempted sequence groups of tenant");
+            for (const auto& tenant : m_tenants)
+                os << "cb_tenant_preemptions_total{tenant=\"" << tenant.first << "\"} " << tenant.second.preemptions << "\n";
+            _write_header(os, "cb_tenant_kv_blocks", "gauge", "Number of KV blocks used by requests of tenant on the last step");
+            for (const auto& tenant : m_tenants)
+                os << "cb_tenant_kv_blocks{tenant=\"" << tenant.first << "\"} " << tenant.second.kv_blocks << "\n";
+        }
+        return os.str();
+    }
+};
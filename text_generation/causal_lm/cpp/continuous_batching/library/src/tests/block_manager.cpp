@@ -30,3 +30,125 @@ TEST(TestBlockManager, general_test) {
     EXPECT_TRUE(bm.has_block_table(1));
     EXPECT_EQ(bm.get_block_table(1).back()->get_references_count(), 2);
 }
+
+TEST(TestBlockManager, prefix_caching) {
+    const size_t block_size = 4;
+    BlockManager bm = BlockManager(4, true);
+
+    std::vector<int64_t> prompt = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+    SequenceGroup::Ptr sequence_group1 = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                                         GenerationConfig::greedy(), block_size);
+    auto seq_id1 = (*sequence_group1)[0]->get_id();
+    bm.allocate(seq_id1, 3);
+    sequence_group1->update_processed_tokens_num(prompt.size());
+    bm.update_cached_blocks(sequence_group1);
+    bm.free_sequence(seq_id1);
+    // cached blocks are still counted as free ones
+    EXPECT_EQ(bm.num_free_blocks(), 4);
+
+    SequenceGroup::Ptr sequence_group2 = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                                         GenerationConfig::greedy(), block_size);
+    auto seq_id2 = (*sequence_group2)[0]->get_id();
+    // two full blocks are restored, while the last prompt token must be recomputed
+    EXPECT_EQ(bm.restore_cached_blocks(sequence_group2), 8);
+    EXPECT_EQ(sequence_group2->get_num_processed_tokens(), 8);
+    EXPECT_EQ(bm.get_block_table(seq_id2).size(), 2);
+    EXPECT_EQ(bm.num_free_blocks(), 2);
+
+    // prompt with different second block can reuse only the first one
+    std::vector<int64_t> other_prompt = {0, 1, 2, 3, 9, 9, 9, 9, 9};
+    SequenceGroup::Ptr sequence_group3 = std::make_shared<SequenceGroup>(2, ov::Tensor(ov::element::i64, {other_prompt.size()}, other_prompt.data()),
+                                                                         GenerationConfig::greedy(), block_size);
+    auto seq_id3 = (*sequence_group3)[0]->get_id();
+    EXPECT_EQ(bm.restore_cached_blocks(sequence_group3), 4);
+    EXPECT_EQ(bm.get_block_table(seq_id3)[0]->get_references_count(), 2);
+
+    // unused cached blocks are evicted when there are no other free blocks
+    bm.free_sequence(seq_id2);
+    bm.free_sequence(seq_id3);
+    bm.allocate(seq_id1, 4);
+    EXPECT_EQ(bm.num_free_blocks(), 0);
+    bm.free_sequence(seq_id1);
+
+    SequenceGroup::Ptr sequence_group4 = std::make_shared<SequenceGroup>(3, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                                         GenerationConfig::greedy(), block_size);
+    EXPECT_EQ(bm.restore_cached_blocks(sequence_group4), 0);
+}
+
+TEST(TestBlockManager, prefix_caching_hash_collision) {
+    BlockAllocator allocator(2);
+    KVCacheBlock::Ptr block = allocator.allocate_block();
+    allocator.cache_block(block, 42, 1);
+    allocator.free(block);
+
+    // another content with the same hash has a different check hash, so the block is not reused
+    EXPECT_EQ(allocator.get_cached_block(42, 2), nullptr);
+    EXPECT_EQ(allocator.num_free_blocks(), 2);
+    EXPECT_EQ(allocator.get_cached_block(42, 1), block);
+    EXPECT_EQ(allocator.num_free_blocks(), 1);
+}
+
+TEST(TestBlockManager, swap_out_and_in) {
+    const size_t block_size = 4;
+    BlockManager bm = BlockManager(4, false, 4);
+
+    std::vector<int64_t> prompt = {0, 1, 2, 3, 4, 5};
+    SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                                        GenerationConfig::greedy(), block_size);
+    auto seq_id = (*sequence_group)[0]->get_id();
+    bm.allocate(seq_id, 2);
+    sequence_group->update_processed_tokens_num(prompt.size());
+    EXPECT_FALSE(bm.is_swapped(sequence_group));
+    EXPECT_TRUE(bm.can_swap_out(sequence_group));
+
+    auto swap_out_map = bm.swap_out(sequence_group);
+    EXPECT_EQ(swap_out_map.size(), 2);
+    EXPECT_TRUE(bm.is_swapped(sequence_group));
+    EXPECT_FALSE(bm.has_block_table(seq_id));
+    EXPECT_EQ(bm.num_free_blocks(), 4);
+
+    // occupy device blocks, so swapped sequence cannot be restored
+    bm.allocate(seq_id + 1, 3);
+    EXPECT_FALSE(bm.can_swap_in(sequence_group));
+    bm.free_sequence(seq_id + 1);
+
+    auto swap_in_map = bm.swap_in(sequence_group);
+    EXPECT_EQ(swap_in_map.size(), 2);
+    EXPECT_FALSE(bm.is_swapped(sequence_group));
+    EXPECT_EQ(bm.get_block_table(seq_id).size(), 2);
+    EXPECT_EQ(bm.num_free_blocks(), 2);
+    // swapped out and swapped in block correspond to each other
+    for (const auto& device_swap : swap_out_map) {
+        EXPECT_EQ(swap_in_map.count(device_swap.second), 1);
+    }
+
+    bm.free_swapped_in_blocks();
+    bm.free_sequence(seq_id);
+    EXPECT_EQ(bm.num_free_blocks(), 4);
+}
+
+TEST(TestBlockManager, resize) {
+    BlockManager bm = BlockManager(2, false, 0, 6);
+    EXPECT_EQ(bm.get_total_num_blocks(), 2);
+    EXPECT_EQ(bm.num_free_blocks(), 2);
+
+    bm.allocate(0, 2);
+    EXPECT_FALSE(bm.can_allocate_blocks(1));
+
+    // new blocks are appended without affecting allocated ones
+    bm.resize(6);
+    EXPECT_EQ(bm.num_free_blocks(), 4);
+    bm.allocate(0, 4);
+    const auto& block_table = bm.get_block_table(0);
+    for (size_t block_id = 0; block_id < block_table.size(); ++block_id)
+        EXPECT_EQ(block_table[block_id]->get_index(), block_id);
+
+    // cache can be shrunk only when all blocks are free
+    EXPECT_THROW(bm.resize(2), ov::Exception);
+    bm.free_sequence(0);
+    bm.resize(2);
+    EXPECT_EQ(bm.num_free_blocks(), 2);
+    bm.allocate(1, 2);
+    for (const auto& block : bm.get_block_table(1))
+        EXPECT_LT(block->get_index(), 2);
+}
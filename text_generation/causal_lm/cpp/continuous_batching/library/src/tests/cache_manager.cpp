@@ -34,3 +34,147 @@ TEST(TestCacheManager, general_test) {
     
     ASSERT_EQ(allocated_bytes, 2146959360);
 }
+
+TEST(TestCacheManager, quantized_kv_cache) {
+    ov::Core core;
+    SchedulerConfig scheduler_config = {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 0,
+        .cache_size = 2,
+        .block_size = 32,
+        .max_num_seqs = 2,
+    };
+
+    DeviceConfig device_config(core, scheduler_config, "CPU", {ov::hint::kv_cache_precision(ov::element::u8)});
+    size_t num_decoder_layers = 12;
+    device_config.set_model_params(12, 64, num_decoder_layers);
+    EXPECT_EQ(device_config.get_cache_precision(), ov::element::u8);
+    // scale and zero point are stored per token in each head
+    EXPECT_EQ(device_config.get_key_cache_shape(), ov::Shape({3236, 12, 32, 64 + 8}));
+
+    auto cache_manager = std::make_shared<CacheManager>(device_config);
+
+    size_t allocated_bytes = 0;
+    for (size_t i = 0; i < num_decoder_layers; i++) {
+        auto key_cache = cache_manager->get_key_cache(i);
+        auto value_cache = cache_manager->get_value_cache(i);
+        allocated_bytes += key_cache.get_byte_size() + value_cache.get_byte_size();
+    }
+
+    // ~1.8x more blocks than f16 KV cache of the same size
+    ASSERT_EQ(allocated_bytes, 2147254272);
+}
+
+TEST(TestCacheManager, copy_blocks) {
+    ov::Core core;
+    SchedulerConfig scheduler_config = {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 4,
+        .block_size = 4,
+        .max_num_seqs = 2,
+    };
+
+    DeviceConfig device_config(core, scheduler_config, "CPU");
+    size_t num_decoder_layers = 3;
+    device_config.set_model_params(2, 8, num_decoder_layers);
+    CacheManager cache_manager(device_config);
+
+    size_t block_byte_size = cache_manager.get_key_cache(0).get_byte_size() / scheduler_config.num_kv_blocks;
+    for (size_t i = 0; i < num_decoder_layers; i++) {
+        for (ov::Tensor cache : {cache_manager.get_key_cache(i), cache_manager.get_value_cache(i)}) {
+            uint8_t* data = static_cast<uint8_t*>(cache.data());
+            for (size_t byte_id = 0; byte_id < block_byte_size; ++byte_id)
+                data[byte_id] = static_cast<uint8_t>(byte_id + i);
+        }
+    }
+
+    cache_manager.copy_blocks({{0, {2, 3}}});
+
+    for (size_t i = 0; i < num_decoder_layers; i++) {
+        for (ov::Tensor cache : {cache_manager.get_key_cache(i), cache_manager.get_value_cache(i)}) {
+            const uint8_t* data = static_cast<const uint8_t*>(cache.data());
+            for (size_t block_id : {2, 3})
+                EXPECT_EQ(std::memcmp(data, data + block_id * block_byte_size, block_byte_size), 0);
+            // block 1 is not touched
+            for (size_t byte_id = 0; byte_id < block_byte_size; ++byte_id)
+                EXPECT_EQ(data[block_byte_size + byte_id], 0);
+        }
+    }
+}
+
+TEST(TestCacheManager, export_and_import_blocks) {
+    ov::Core core;
+    SchedulerConfig scheduler_config = {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 4,
+        .block_size = 4,
+        .max_num_seqs = 2,
+    };
+
+    DeviceConfig device_config(core, scheduler_config, "CPU");
+    size_t num_decoder_layers = 3;
+    device_config.set_model_params(2, 8, num_decoder_layers);
+    CacheManager src_cache_manager(device_config), dst_cache_manager(device_config);
+
+    size_t block_byte_size = src_cache_manager.get_key_block_byte_size();
+    for (size_t i = 0; i < num_decoder_layers; i++) {
+        for (ov::Tensor cache : {src_cache_manager.get_key_cache(i), src_cache_manager.get_value_cache(i)}) {
+            uint8_t* data = static_cast<uint8_t*>(cache.data());
+            for (size_t byte_id = 0; byte_id < cache.get_byte_size(); ++byte_id)
+                data[byte_id] = static_cast<uint8_t>(byte_id * 7 + i);
+        }
+    }
+
+    // 6 tokens of blocks 3 and 1 are exported and imported to blocks 0 and 2 of another cache
+    KVCacheBlob::Ptr blob = src_cache_manager.export_blocks({3, 1}, {0, 1, 2, 3, 4, 5, 6}, 6, scheduler_config.block_size);
+    ASSERT_EQ(blob->get_num_blocks(), 2);
+    EXPECT_TRUE(dst_cache_manager.is_compatible(*blob));
+    dst_cache_manager.import_blocks(KVCacheBlob(std::vector<uint8_t>(blob->data(), blob->data() + blob->size())), {0, 2});
+
+    for (size_t i = 0; i < num_decoder_layers; i++) {
+        const ov::Tensor src_caches[] = {src_cache_manager.get_key_cache(i), src_cache_manager.get_value_cache(i)};
+        const ov::Tensor dst_caches[] = {dst_cache_manager.get_key_cache(i), dst_cache_manager.get_value_cache(i)};
+        for (size_t cache_idx = 0; cache_idx < 2; ++cache_idx) {
+            const uint8_t* src_data = static_cast<const uint8_t*>(src_caches[cache_idx].data());
+            const uint8_t* dst_data = static_cast<const uint8_t*>(dst_caches[cache_idx].data());
+            EXPECT_EQ(std::memcmp(dst_data, src_data + 3 * block_byte_size, block_byte_size), 0);
+            EXPECT_EQ(std::memcmp(dst_data + 2 * block_byte_size, src_data + block_byte_size, block_byte_size), 0);
+            // block 1 is not touched
+            for (size_t byte_id = 0; byte_id < block_byte_size; ++byte_id)
+                EXPECT_EQ(dst_data[block_byte_size + byte_id], 0);
+        }
+    }
+
+    // KV cache of another model cannot be imported
+    DeviceConfig other_device_config(core, scheduler_config, "CPU");
+    other_device_config.set_model_params(4, 8, num_decoder_layers);
+    EXPECT_FALSE(CacheManager(other_device_config).is_compatible(*blob));
+}
+
+TEST(TestCacheManager, kv_cache_sized_by_free_memory) {
+    ov::Core core;
+    SchedulerConfig scheduler_config = {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 0,
+        .cache_size = 0,
+        .kv_cache_memory_fraction = 0.01f,
+        .block_size = 32,
+        .max_num_seqs = 2,
+    };
+
+    DeviceConfig device_config(core, scheduler_config, "CPU");
+    device_config.set_model_params(12, 64, 12);
+    ASSERT_TRUE(device_config.requires_num_kv_blocks());
+
+    const size_t free_memory = device_config.get_free_memory(core);
+    if (free_memory == 0)
+        GTEST_SKIP() << "Free host memory cannot be detected";
+    device_config.set_num_kv_blocks_by_free_memory(core, scheduler_config.kv_cache_memory_fraction);
+    EXPECT_FALSE(device_config.requires_num_kv_blocks());
+    // free memory can change between measurements, so only their order is checked
+    EXPECT_GT(device_config.get_num_kv_blocks(), 0);
+    EXPECT_LT(device_config.get_num_kv_blocks() * device_config.get_block_byte_size(), free_memory / 10);
+    EXPECT_EQ(device_config.get_key_cache_shape()[0], device_config.get_num_kv_blocks());
+
+    EXPECT_THROW(device_config.set_num_kv_blocks_by_free_memory(core, 0.0f), ov::Exception);
+}
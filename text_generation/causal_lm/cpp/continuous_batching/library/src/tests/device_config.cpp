@@ -0,0 +1,82 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "openvino/runtime/core.hpp"
+#include "openvino/op/add.hpp"
+#include "openvino/op/parameter.hpp"
+#include "device_config.hpp"
+
+TEST(TestDeviceConfig, layer_devices) {
+    // input_ids, position_ids and KV caches of 2 decoder layers, which are consumed by operations computed by different devices
+    ov::ParameterVector parameters;
+    for (size_t input_id = 0; input_id < 6; ++input_id)
+        parameters.push_back(std::make_shared<ov::op::v0::Parameter>(ov::element::f32, ov::PartialShape{-1}));
+    ov::OutputVector outputs;
+    for (size_t decoder_layer_id = 0; decoder_layer_id < 2; ++decoder_layer_id) {
+        auto attention = std::make_shared<ov::op::v1::Add>(parameters[2 + decoder_layer_id * 2], parameters[3 + decoder_layer_id * 2]);
+        attention->set_friendly_name("attention_" + std::to_string(decoder_layer_id));
+        outputs.push_back(attention);
+    }
+    auto model = std::make_shared<ov::Model>(outputs, parameters);
+
+    const ov::SupportedOpsMap devices = {{"attention_0", "GPU.0"}, {"attention_1", "GPU.1"}};
+    EXPECT_EQ(DeviceConfig::get_layer_devices(model, devices, 2), std::vector<std::string>({"GPU.0", "GPU.1"}));
+    // layers without KV cache inputs and not assigned operations
+    EXPECT_THROW(DeviceConfig::get_layer_devices(model, devices, 3), ov::Exception);
+    EXPECT_THROW(DeviceConfig::get_layer_devices(model, {{"attention_0", "GPU.0"}}, 2), ov::Exception);
+
+    const std::vector<std::string> stage_devices = {"GPU.0", "GPU.1"};
+    EXPECT_EQ(DeviceConfig::get_layer_stages(stage_devices, {"GPU.0", "GPU.0", "GPU.1"}), std::vector<size_t>({0, 0, 1}));
+    EXPECT_THROW(DeviceConfig::get_layer_stages(stage_devices, {"GPU.0", "GPU.2"}), ov::Exception);
+}
+
+TEST(TestDeviceConfig, num_kv_blocks_by_stages) {
+    const size_t layer_block_byte_size = 1024;
+    // the first device keeps 3 layers, while the second one has more memory per layer
+    EXPECT_EQ(DeviceConfig::get_num_kv_blocks_by_stages({0, 0, 0, 1}, {3 * 1024 * 100, 1024 * 200}, layer_block_byte_size, 1.0f), 100);
+    EXPECT_EQ(DeviceConfig::get_num_kv_blocks_by_stages({0, 0, 0, 1}, {3 * 1024 * 100, 1024 * 200}, layer_block_byte_size, 0.5f), 50);
+    // the second device has less memory per layer
+    EXPECT_EQ(DeviceConfig::get_num_kv_blocks_by_stages({0, 1, 1, 1}, {1024 * 100, 3 * 1024 * 20}, layer_block_byte_size, 1.0f), 20);
+    // a device without layers doesn't limit KV cache
+    EXPECT_EQ(DeviceConfig::get_num_kv_blocks_by_stages({0, 0}, {2 * 1024 * 100, 0}, layer_block_byte_size, 1.0f), 100);
+    EXPECT_EQ(DeviceConfig::get_num_kv_blocks_by_stages({}, {1024}, layer_block_byte_size, 1.0f), 0);
+}
+
+TEST(TestDeviceConfig, set_layer_devices) {
+    ov::Core core;
+    SchedulerConfig scheduler_config = {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 0,
+        .cache_size = 0,
+        .block_size = 16,
+        .max_num_seqs = 2,
+    };
+
+    // layers are assigned only to devices of pipeline parallel execution
+    DeviceConfig cpu_device_config(core, scheduler_config, "CPU");
+    cpu_device_config.set_model_params(2, 64, 2);
+    EXPECT_FALSE(cpu_device_config.is_pipeline_parallel());
+    EXPECT_THROW(cpu_device_config.set_layer_devices({"CPU", "CPU"}), ov::Exception);
+
+    const std::vector<std::string> available_devices = core.get_available_devices();
+    if (std::find(available_devices.begin(), available_devices.end(), "GPU.0") == available_devices.end() ||
+        std::find(available_devices.begin(), available_devices.end(), "GPU.1") == available_devices.end())
+        GTEST_SKIP() << "Pipeline parallel execution requires 2 GPU devices";
+
+    DeviceConfig device_config(core, scheduler_config, "HETERO:GPU.0,GPU.1");
+    device_config.set_model_params(2, 64, 3);
+    EXPECT_EQ(device_config.get_stage_devices(), std::vector<std::string>({"GPU.0", "GPU.1"}));
+    EXPECT_THROW(device_config.set_layer_devices({"GPU.0", "GPU.1"}), ov::Exception);
+    EXPECT_THROW(device_config.set_layer_devices({"GPU.0", "GPU.1", "GPU.2"}), ov::Exception);
+    device_config.set_layer_devices({"GPU.0", "GPU.1", "GPU.1"});
+    // KV cache of each layer is allocated by context of its device
+    EXPECT_EQ(device_config.get_remote_context(0).get_device_name(), "GPU.0");
+    EXPECT_EQ(device_config.get_remote_context(2).get_device_name(), "GPU.1");
+
+    // every device has enough memory for blocks of its layers
+    device_config.set_num_kv_blocks_by_free_memory(core, 0.01f);
+    EXPECT_GT(device_config.get_num_kv_blocks(), 0);
+    EXPECT_EQ(device_config.get_key_cache_shape()[0], device_config.get_num_kv_blocks());
+}
@@ -88,3 +88,14 @@ TEST(GenerationConfigTest, valid_frequence_penalty) {
     config.frequence_penalty = -2.0;
     EXPECT_NO_THROW(config.validate());
 }
+
+TEST(GenerationConfigTest, scoring_requires_greedy_parameters) {
+    GenerationConfig config;
+    config.num_scored_tokens = 4;
+    EXPECT_NO_THROW(config.validate());
+    config.stop_strings = {"."};
+    EXPECT_THROW(config.validate(), ov::Exception);
+    config = GenerationConfig::beam_search();
+    config.num_scored_tokens = 4;
+    EXPECT_THROW(config.validate(), ov::Exception);
+}
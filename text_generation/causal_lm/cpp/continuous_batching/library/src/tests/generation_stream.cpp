@@ -0,0 +1,71 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include <thread>
+#include "generation_stream.hpp"
+
+TEST(TestGenerationStream, try_read_does_not_block) {
+    auto stream = GenerationStream::create();
+    GenerationOutputs outputs;
+    EXPECT_FALSE(stream->try_read(outputs));
+
+    stream->push({{0, {{1, 2}, 0.5f}}});
+    EXPECT_TRUE(stream->try_read(outputs));
+    EXPECT_EQ(outputs.at(0).generated_token_ids, std::vector<int64_t>({1, 2}));
+    EXPECT_FALSE(stream->try_read(outputs));
+}
+
+TEST(TestGenerationStream, read_returns_outputs_pushed_before_completion) {
+    auto stream = GenerationStream::create();
+    std::thread producer([&stream] {
+        stream->push({{0, {{1}, 0.0f}}});
+        stream->push({{0, {{2}, 0.0f}}});
+        stream->set_generation_status(GenerationStatus::FINISHED);
+    });
+
+    std::vector<int64_t> token_ids;
+    GenerationOutputs outputs;
+    while (stream->read(outputs))
+        token_ids.push_back(outputs.at(0).generated_token_ids.at(0));
+    producer.join();
+
+    EXPECT_EQ(token_ids, std::vector<int64_t>({1, 2}));
+}
+
+TEST(TestGenerationStream, completion_callback) {
+    auto stream = GenerationStream::create();
+    size_t num_calls = 0;
+    GenerationStatus final_status = GenerationStatus::RUNNING;
+    stream->set_completion_callback([&] (GenerationStatus status) {
+        ++num_calls;
+        final_status = status;
+    });
+
+    stream->set_generation_status(GenerationStatus::RUNNING);
+    EXPECT_EQ(num_calls, 0);
+    stream->set_generation_status(GenerationStatus::IGNORED);
+    stream->set_generation_status(GenerationStatus::IGNORED);
+    EXPECT_EQ(num_calls, 1);
+    EXPECT_EQ(final_status, GenerationStatus::IGNORED);
+
+    // generation has already completed, so callback is called immediately
+    stream->set_completion_callback([&] (GenerationStatus status) { ++num_calls; });
+    EXPECT_EQ(num_calls, 2);
+}
+
+TEST(TestGenerationStream, output_callback) {
+    auto stream = GenerationStream::create();
+    size_t num_calls = 0;
+    stream->set_output_callback([&] { ++num_calls; });
+
+    stream->push({{0, {{1}, 0.0f}}});
+    stream->set_generation_status(GenerationStatus::FINISHED);
+    EXPECT_EQ(num_calls, 2);
+
+    // there are no calls after the stream is dropped
+    stream->drop();
+    stream->push({{0, {{2}, 0.0f}}});
+    EXPECT_EQ(num_calls, 2);
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <openvino/core/except.hpp>
+#include "kv_cache_blob.hpp"
+
+namespace {
+
+std::vector<uint8_t> get_buffer(const KVCacheBlob& blob) {
+    return std::vector<uint8_t>(blob.data(), blob.data() + blob.size());
+}
+
+}  // namespace
+
+TEST(TestKVCacheBlob, buffer_round_trip) {
+    const std::vector<int64_t> prompt_ids = {5, 3, 8, 1, 9, 2, 7};
+    // 6 tokens with KV cache occupy 2 blocks of 4 tokens
+    KVCacheBlob blob(prompt_ids, 6, "f16", 4, 3, 16, 24);
+    EXPECT_EQ(blob.get_num_blocks(), 2);
+    EXPECT_EQ(blob.get_block_byte_size(), 3 * (16 + 24));
+    // blocks are aligned and contiguous
+    EXPECT_EQ((blob.get_block_data(0) - blob.data()) % KVCacheBlob::kAlignment, 0);
+    EXPECT_EQ(blob.get_block_data(1), blob.get_block_data(0) + blob.get_block_byte_size());
+    EXPECT_EQ(blob.get_block_data(1) + blob.get_block_byte_size(), blob.data() + blob.size());
+    for (size_t block_idx = 0; block_idx < blob.get_num_blocks(); ++block_idx) {
+        for (size_t byte_idx = 0; byte_idx < blob.get_block_byte_size(); ++byte_idx)
+            blob.get_block_data(block_idx)[byte_idx] = static_cast<uint8_t>(block_idx * 31 + byte_idx);
+    }
+
+    // received buffer is taken as is
+    KVCacheBlob received_blob(get_buffer(blob));
+    EXPECT_EQ(received_blob.get_prompt_ids(), prompt_ids);
+    EXPECT_EQ(received_blob.get_num_kv_tokens(), 6);
+    EXPECT_STREQ(received_blob.get_header().precision, "f16");
+    EXPECT_EQ(received_blob.get_header().block_size, 4);
+    EXPECT_EQ(received_blob.get_header().num_layers, 3);
+    EXPECT_EQ(get_buffer(received_blob), get_buffer(blob));
+    EXPECT_THROW(received_blob.get_block_data(2), ov::Exception);
+}
+
+TEST(TestKVCacheBlob, invalid_buffers) {
+    EXPECT_THROW(KVCacheBlob(std::vector<int64_t>{1, 2}, 3, "f16", 4, 1, 8, 8), ov::Exception);
+    EXPECT_THROW(KVCacheBlob(std::vector<uint8_t>(8)), ov::Exception);
+
+    KVCacheBlob blob(std::vector<int64_t>{1, 2, 3}, 2, "f16", 4, 1, 8, 8);
+    // truncated buffer
+    std::vector<uint8_t> buffer = get_buffer(blob);
+    buffer.pop_back();
+    EXPECT_THROW(KVCacheBlob(std::move(buffer)), ov::Exception);
+    // not a blob
+    buffer = get_buffer(blob);
+    buffer[0] ^= 0xFF;
+    EXPECT_THROW(KVCacheBlob(std::move(buffer)), ov::Exception);
+
+    // byte size of a block wraps around to 0, so the header matches a buffer without blocks
+    KVCacheBlob empty_blob(std::vector<int64_t>{1, 2, 3}, 0, "f16", 4, 1, 8, 8);
+    buffer = get_buffer(empty_blob);
+    KVCacheBlob::Header header = empty_blob.get_header();
+    header.block_size = header.num_kv_tokens = header.num_blocks = 1;
+    header.key_block_byte_size = header.value_block_byte_size = uint64_t{1} << 63;
+    std::copy_n(reinterpret_cast<const uint8_t*>(&header), sizeof(header), buffer.data());
+    EXPECT_THROW(KVCacheBlob(std::move(buffer)), ov::Exception);
+}
+
+TEST(TestKVCacheBlob, wraps_external_memory) {
+    KVCacheBlob blob(std::vector<int64_t>{4, 2, 6, 1, 3}, 4, "u8", 2, 2, 4, 4);
+    std::fill(blob.get_block_data(0), blob.get_block_data(1) + blob.get_block_byte_size(), 3);
+
+    // e.g. memory mapped file, which is released together with the last blob referring to it
+    std::shared_ptr<uint8_t> memory(new uint8_t[blob.size()], std::default_delete<uint8_t[]>());
+    std::copy(blob.data(), blob.data() + blob.size(), memory.get());
+    KVCacheBlob mapped_blob(memory, blob.size());
+    EXPECT_EQ(mapped_blob.data(), memory.get());
+    EXPECT_EQ(mapped_blob.get_prompt_ids(), blob.get_prompt_ids());
+    EXPECT_EQ(mapped_blob.get_block_data(1)[0], 3);
+    EXPECT_THROW(KVCacheBlob(memory, blob.size() - 1), ov::Exception);
+    EXPECT_THROW(KVCacheBlob(nullptr, blob.size()), ov::Exception);
+}
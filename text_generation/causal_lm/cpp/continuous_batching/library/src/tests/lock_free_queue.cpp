@@ -0,0 +1,57 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "lock_free_queue.hpp"
+
+TEST(TestLockFreeQueue, spsc_keeps_order_across_segments) {
+    SPSCQueue<size_t, 4> queue;
+    const size_t num_items = 1000;
+    std::thread producer([&queue] {
+        for (size_t i = 0; i < num_items; ++i)
+            queue.push(i);
+    });
+
+    std::vector<size_t> items;
+    size_t item;
+    while (items.size() < num_items) {
+        if (queue.try_pull(item))
+            items.push_back(item);
+    }
+    producer.join();
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.try_pull(item));
+    for (size_t i = 0; i < num_items; ++i)
+        EXPECT_EQ(items[i], i);
+}
+
+TEST(TestLockFreeQueue, mpsc_receives_items_of_all_producers) {
+    MPSCQueue<size_t> queue;
+    const size_t num_producers = 4, num_items_per_producer = 1000;
+    std::vector<std::thread> producers;
+    for (size_t producer_id = 0; producer_id < num_producers; ++producer_id) {
+        producers.emplace_back([&queue, producer_id] {
+            for (size_t i = 0; i < num_items_per_producer; ++i)
+                queue.push(producer_id * num_items_per_producer + i);
+        });
+    }
+
+    // each producer's items are received in order
+    std::vector<size_t> next_items(num_producers, 0);
+    size_t num_received = 0, item;
+    while (num_received < num_producers * num_items_per_producer) {
+        if (!queue.try_pull(item))
+            continue;
+        size_t producer_id = item / num_items_per_producer;
+        EXPECT_EQ(item % num_items_per_producer, next_items[producer_id]++);
+        ++num_received;
+    }
+    for (auto& producer : producers)
+        producer.join();
+
+    EXPECT_TRUE(queue.empty());
+}
@@ -0,0 +1,47 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "lora_adapter_pool.hpp"
+
+TEST(TestLoRAAdapterPool, adapters_occupy_own_slots) {
+    std::vector<LoRALayer> layers = {{"__module.model.layers.0.self_attn.q_proj/aten::linear/MatMul", 3, 2}};
+    LoRAAdapterPool pool(layers, 2, 2);
+    EXPECT_EQ(pool.get_num_channels(), 4);
+
+    // rank 1 adapter is padded to max rank
+    std::vector<float> a_data = {1, 2, 3}, b_data = {4, 5};
+    LoRAAdapter adapter = {{"model.layers.0.self_attn.q_proj", {ov::Tensor(ov::element::f32, {1, 3}, a_data.data()),
+                                                               ov::Tensor(ov::element::f32, {2, 1}, b_data.data())}}};
+    pool.add_adapter(7, adapter, 0.5f);
+    pool.add_adapter(9, adapter, 1.0f);
+    EXPECT_EQ(pool.get_slot(7), 0);
+    EXPECT_EQ(pool.get_slot(9), 1);
+
+    // A rows and B columns of the second slot start from max rank channel; B is scaled by alpha
+    const float* lora_a = pool.get_a_weights(0).data<float>();
+    const float* lora_b = pool.get_b_weights(0).data<float>();
+    std::vector<float> ref_a = {1, 2, 3, 0, 0, 0, 1, 2, 3, 0, 0, 0}, ref_b = {2, 0, 4, 0, 2.5, 0, 5, 0};
+    EXPECT_EQ(std::vector<float>(lora_a, lora_a + ref_a.size()), ref_a);
+    EXPECT_EQ(std::vector<float>(lora_b, lora_b + ref_b.size()), ref_b);
+
+    pool.remove_adapter(7);
+    EXPECT_FALSE(pool.has_adapter(7));
+    EXPECT_THROW(pool.get_slot(7), ov::Exception);
+    // a free slot is reused by the next adapter
+    pool.add_adapter(11, adapter, 1.0f);
+    EXPECT_EQ(pool.get_slot(11), 0);
+    EXPECT_EQ(lora_b[0], 4);
+    EXPECT_THROW(pool.add_adapter(12, adapter, 1.0f), ov::Exception);
+}
+
+TEST(TestLoRAAdapterPool, unknown_layer) {
+    std::vector<LoRALayer> layers = {{"__module.model.layers.0.mlp.up_proj/aten::linear/MatMul", 3, 2}};
+    LoRAAdapterPool pool(layers, 1, 2);
+    std::vector<float> a_data = {1, 2, 3}, b_data = {4, 5};
+    LoRAAdapter adapter = {{"model.layers.0.self_attn.q_proj", {ov::Tensor(ov::element::f32, {1, 3}, a_data.data()),
+                                                               ov::Tensor(ov::element::f32, {2, 1}, b_data.data())}}};
+    EXPECT_THROW(pool.add_adapter(1, adapter, 1.0f), ov::Exception);
+    EXPECT_FALSE(pool.has_adapter(1));
+}
@@ -0,0 +1,39 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "ngram_index.hpp"
+
+TEST(TestNGramIndex, finds_continuation_of_longest_suffix) {
+    NGramIndex ngram_index(3);
+    std::vector<int64_t> prompt_ids = {1, 2, 3, 4, 5, 2, 3, 6, 7};
+    std::vector<int64_t> generated_ids = {1, 2, 3};
+    ngram_index.update(prompt_ids, generated_ids);
+
+    // suffix {1, 2, 3} occurs at the beginning of prompt
+    std::vector<int64_t> ref_candidates = {4, 5};
+    EXPECT_EQ(ngram_index.find_candidates(2), ref_candidates);
+
+    // suffix {2, 3, 6} occurs in the middle of prompt
+    generated_ids.push_back(6);
+    ngram_index.update(prompt_ids, generated_ids);
+    ref_candidates = {7, 1, 2};
+    EXPECT_EQ(ngram_index.find_candidates(3), ref_candidates);
+
+    // candidates are limited by indexed tokens
+    ref_candidates = {7, 1, 2, 3, 6};
+    EXPECT_EQ(ngram_index.find_candidates(10), ref_candidates);
+
+    // only suffix {6} has occurrences, the most recent one is used
+    generated_ids.push_back(6);
+    ngram_index.update(prompt_ids, generated_ids);
+    ref_candidates = {6};
+    EXPECT_EQ(ngram_index.find_candidates(3), ref_candidates);
+}
+
+TEST(TestNGramIndex, no_candidates_for_unseen_suffix) {
+    NGramIndex ngram_index(2);
+    ngram_index.update({1, 2, 3}, {4});
+    EXPECT_TRUE(ngram_index.find_candidates(5).empty());
+}
@@ -0,0 +1,12 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "numa_utils.hpp"
+
+TEST(TestNumaUtils, parses_cpu_list) {
+    EXPECT_EQ(parse_cpu_list("0-3,8,10-11"), std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(parse_cpu_list("5"), std::vector<int>({5}));
+    EXPECT_TRUE(parse_cpu_list("").empty());
+}
@@ -0,0 +1,124 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <numeric>
+#include "sampler.hpp"
+#include "sequence_group.hpp"
+#include "generation_config.hpp"
+
+namespace {
+
+const size_t kVocabSize = 8;
+
+// logits of a position, which are different for each position and token
+std::vector<float> get_logits(size_t position) {
+    std::vector<float> logits(kVocabSize);
+    for (size_t token_id = 0; token_id < kVocabSize; ++token_id)
+        logits[token_id] = std::sin(float(position * kVocabSize + token_id));
+    return logits;
+}
+
+float get_reference_log_prob(size_t position, int64_t token_id) {
+    std::vector<float> logits = get_logits(position);
+    float sum_exp = std::accumulate(logits.begin(), logits.end(), 0.0f, [] (float sum, float logit) {
+        return sum + std::exp(logit);
+    });
+    return logits[token_id] - std::log(sum_exp);
+}
+
+// runs sampler for 'num_tokens' next tokens of prompt with logits of all of them
+SamplerOutput sample_prompt_chunk(Sampler& sampler, SequenceGroup::Ptr sequence_group, size_t num_tokens) {
+    const size_t first_position = sequence_group->get_num_processed_tokens();
+    std::vector<float> logits;
+    for (size_t position = first_position; position < first_position + num_tokens; ++position) {
+        std::vector<float> position_logits = get_logits(position);
+        logits.insert(logits.end(), position_logits.begin(), position_logits.end());
+    }
+    sequence_group->schedule_tokens(num_tokens);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group};
+    return sampler.sample(requests, ov::Tensor(ov::element::f32, {1, num_tokens, kVocabSize}, logits.data()));
+}
+
+}  // namespace
+
+TEST(TestSampler, token_log_softmax_matches_reference) {
+    std::vector<float> logits = get_logits(3);
+    for (int64_t token_id = 0; token_id < int64_t(kVocabSize); ++token_id)
+        EXPECT_NEAR(token_log_softmax(logits.data(), logits.size(), token_id), get_reference_log_prob(3, token_id), 1e-5);
+    EXPECT_THROW(token_log_softmax(logits.data(), logits.size(), kVocabSize), ov::Exception);
+}
+
+TEST(TestSampler, scoring_is_computed_over_prompt_chunks) {
+    std::vector<int64_t> prompt = {1, 5, 2, 7, 0, 3};
+    GenerationConfig sampling_params = GenerationConfig::greedy();
+    sampling_params.num_scored_tokens = 3;
+    SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                                        sampling_params, 4);
+    GenerationHandle handle = std::make_unique<GenerationHandleImpl>(sequence_group->get_generation_stream(), sampling_params);
+    EXPECT_EQ(sequence_group->get_first_sampled_prompt_position(), 2);
+
+    Sampler sampler;
+    // the first chunk has logits of positions 2 and 3, which score tokens 3 and 4
+    sequence_group->schedule_tokens(4);
+    EXPECT_EQ(sequence_group->get_num_sampled_tokens(), 2);
+    EXPECT_TRUE(sample_prompt_chunk(sampler, sequence_group, 4).m_dropped_sequences.empty());
+    EXPECT_FALSE(sequence_group->has_finished());
+    EXPECT_FALSE(handle->can_read());
+
+    // the last chunk scores token 5 by position 4, while logits of the last position are not used
+    sequence_group->schedule_tokens(2);
+    EXPECT_EQ(sequence_group->get_num_sampled_tokens(), 2);
+    SamplerOutput sampler_output = sample_prompt_chunk(sampler, sequence_group, 2);
+    EXPECT_EQ(sampler_output.m_dropped_sequences, std::vector<uint64_t>({(*sequence_group)[0]->get_id()}));
+    EXPECT_TRUE(sequence_group->has_finished());
+    EXPECT_FALSE(sequence_group->can_speculate());
+
+    std::vector<GenerationOutput> outputs = handle->read_all();
+    ASSERT_EQ(outputs.size(), 1);
+    EXPECT_EQ(outputs[0].generated_token_ids, std::vector<int64_t>(prompt.end() - 3, prompt.end()));
+    ASSERT_EQ(outputs[0].log_probs.size(), 3);
+    float score = 0.0f;
+    for (size_t i = 0; i < 3; ++i) {
+        const size_t position = 2 + i;
+        EXPECT_NEAR(outputs[0].log_probs[i], get_reference_log_prob(position, prompt[position + 1]), 1e-5);
+        score += outputs[0].log_probs[i];
+    }
+    EXPECT_NEAR(outputs[0].score, score, 1e-5);
+}
+
+TEST(TestSampler, scoring_tokens_must_have_context) {
+    std::vector<int64_t> prompt = {1, 5, 2};
+    GenerationConfig sampling_params = GenerationConfig::greedy();
+    sampling_params.num_scored_tokens = 3;
+    EXPECT_THROW(std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()), sampling_params, 4),
+                 ov::Exception);
+}
+
+TEST(TestSampler, kv_cache_export_finishes_without_sampling) {
+    std::vector<int64_t> prompt = {1, 5, 2, 7, 0, 3};
+    GenerationConfig sampling_params = GenerationConfig::greedy();
+    sampling_params.export_kv_cache = true;
+    SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {prompt.size()}, prompt.data()),
+                                                                        sampling_params, 4);
+    GenerationHandle handle = std::make_unique<GenerationHandleImpl>(sequence_group->get_generation_stream(), sampling_params);
+
+    Sampler sampler;
+    EXPECT_TRUE(sample_prompt_chunk(sampler, sequence_group, 3).m_dropped_sequences.empty());
+    EXPECT_EQ(sequence_group->get_num_available_tokens_for_batching(), 2);
+    SamplerOutput sampler_output = sample_prompt_chunk(sampler, sequence_group, 2);
+    EXPECT_EQ(sampler_output.m_dropped_sequences, std::vector<uint64_t>({(*sequence_group)[0]->get_id()}));
+    EXPECT_TRUE(sequence_group->has_finished());
+    // handle is notified by pipeline, when KV cache is exported
+    EXPECT_FALSE(handle->can_read());
+
+    sequence_group->set_exported_kv_cache(std::make_shared<KVCacheBlob>(prompt, prompt.size() - 1, "f16", 4, 1, 8, 8));
+    sequence_group->notify_handle();
+    std::vector<GenerationOutput> outputs = handle->read_all();
+    ASSERT_EQ(outputs.size(), 1);
+    EXPECT_TRUE(outputs[0].generated_token_ids.empty());
+    ASSERT_TRUE(outputs[0].kv_cache);
+    EXPECT_EQ(outputs[0].kv_cache->get_num_kv_tokens(), prompt.size() - 1);
+}
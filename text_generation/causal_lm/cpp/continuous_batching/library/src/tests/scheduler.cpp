@@ -385,3 +385,586 @@ TEST(TestScheduler, test_partially_preempted_prompt) {
         EXPECT_FALSE(scheduler.has_block_table(idx0));
     }
 }
+
+TEST(TestScheduler, test_speculative_candidates) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 6,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .num_speculative_tokens = 3,
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3,4,5,6};
+    SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                        GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group};
+    Sequence::Ptr sequence = (*sequence_group)[0];
+    auto idx0 = sequence->get_id();
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out1 = scheduler.schedule(requests);
+    // no candidates on prompt phase
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, tokens.size());
+    EXPECT_EQ(sequence_group->get_num_candidate_tokens(), 0);
+    sequence->append_token(16, 0.9);
+    sequence_group->finish_iteration();
+
+    // KV cache is reserved for all candidates, which are validated at once
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(out2.m_total_num_scheduled_tokens, 3);
+    EXPECT_EQ(sequence_group->get_num_candidate_tokens(), 3);
+    EXPECT_EQ(out2.m_block_tables[idx0].size(), 3);
+    // draft model appends candidates, the last one is not processed by main model
+    EXPECT_EQ(sequence_group->get_num_draft_tokens(0), 1);
+    EXPECT_EQ(sequence_group->get_draft_position(2), tokens.size() + 2);
+    EXPECT_EQ(sequence_group->get_num_draft_tokens(3), 0);
+    for (int64_t candidate : {17, 18, 19})
+        sequence->append_token(candidate, 0.0f);
+
+    // the first candidate is rejected by main model
+    sequence->remove_last_tokens(3);
+    sequence->append_token(20, 0.9);
+    sequence_group->finish_iteration();
+    sequence_group->rollback_processed_tokens(2);
+    scheduler.free_rejected_tokens(sequence_group);
+
+    EXPECT_EQ(sequence_group->get_num_processed_tokens(), tokens.size() + 1);
+    EXPECT_EQ(sequence->get_generated_len(), 2);
+    EXPECT_EQ(scheduler.get_block_table(*sequence).size(), 2);
+    EXPECT_EQ(sequence_group->get_num_available_tokens_for_batching(), 1);
+}
+
+TEST(TestScheduler, test_speculative_candidates_do_not_preempt) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 3,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .num_speculative_tokens = 3,
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3,4,5,6};
+    GenerationConfig high_priority_config = GenerationConfig::greedy();
+    high_priority_config.priority = 1;
+    SequenceGroup::Ptr high_priority_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                             high_priority_config, scheduler_config.block_size);
+    SequenceGroup::Ptr low_priority_group = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {4}, tokens.data()),
+                                                                            GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {high_priority_group, low_priority_group};
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, tokens.size() + 4);
+    for (auto& request : requests) {
+        (*request)[0]->append_token(16, 0.9);
+        request->finish_iteration();
+    }
+
+    // candidates require a new block, which is not free, so a single token is generated instead of preemption of the other group
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(out2.m_num_preemptions, 0);
+    EXPECT_EQ(high_priority_group->get_num_candidate_tokens(), 0);
+    EXPECT_EQ(high_priority_group->get_num_scheduled_tokens(), 1);
+    EXPECT_EQ(low_priority_group->get_num_processed_tokens(), 4);
+}
+
+TEST(TestScheduler, test_prefill_budget) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 16,
+        .num_kv_blocks = 20,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .min_prefill_chunk_size = 4,
+        .max_prefill_fraction = 0.5f,
+    };
+    std::vector<uint64_t> short_tokens = {0,1,2,3};
+    std::vector<uint64_t> long_tokens(20, 1);
+    GenerationConfig high_priority_config = GenerationConfig::greedy();
+    high_priority_config.priority = 1;
+
+    SequenceGroup::Ptr sequence_group1 = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {short_tokens.size()}, short_tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group1};
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, short_tokens.size());
+    (*sequence_group1)[0]->append_token(16, 0.9);
+    sequence_group1->finish_iteration();
+
+    SequenceGroup::Ptr sequence_group2 = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {long_tokens.size()}, long_tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    SequenceGroup::Ptr sequence_group3 = std::make_shared<SequenceGroup>(2, ov::Tensor(ov::element::i64, {long_tokens.size()}, long_tokens.data()),
+                                                                         high_priority_config, scheduler_config.block_size);
+    requests.push_back(sequence_group2);
+    requests.push_back(sequence_group3);
+
+    // generation token is scheduled first, prompts are limited by max_prefill_fraction of megabatch
+    // and the prompt of a request with higher priority is processed first
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(out2.m_total_num_scheduled_tokens, 1 + 8);
+    EXPECT_EQ(sequence_group1->get_num_scheduled_tokens(), 1);
+    EXPECT_EQ(sequence_group2->get_num_scheduled_tokens(), 0);
+    EXPECT_EQ(sequence_group3->get_num_scheduled_tokens(), 8);
+    std::vector<uint64_t> ref_ids = {0, 2};
+    EXPECT_EQ(out2.m_scheduled_sequence_groups_ids, ref_ids);
+}
+
+TEST(TestScheduler, test_lazy_kv_cache_allocation) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 8,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .num_kv_blocks_per_chunk = 3,
+        .release_idle_kv_cache = true,
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3,4,5,6,7};
+    SequenceGroup::Ptr sequence_group1 = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    SequenceGroup::Ptr sequence_group2 = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group1, sequence_group2};
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    // KV cache grows by chunks instead of preemption, when prompts do not fit into allocated blocks
+    auto out = scheduler.schedule(requests);
+    EXPECT_EQ(out.m_total_num_scheduled_tokens, 2 * tokens.size());
+    EXPECT_EQ(out.m_num_kv_blocks, 6);
+
+    for (auto& sequence_group : requests) {
+        scheduler.free_sequence((*sequence_group)[0]->get_id());
+    }
+    EXPECT_EQ(scheduler.release_idle_kv_cache(), 3);
+}
+
+TEST(TestScheduler, test_priority_preemption) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 16,
+        .num_kv_blocks = 2,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3};
+    GenerationConfig high_priority_config = GenerationConfig::greedy();
+    high_priority_config.priority = 1;
+    SequenceGroup::Ptr sequence_group1 = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    SequenceGroup::Ptr sequence_group2 = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         high_priority_config, scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group1, sequence_group2};
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, 2 * tokens.size());
+    for (auto& sequence_group : requests) {
+        (*sequence_group)[0]->append_token(16, 0.9);
+        sequence_group->finish_iteration();
+    }
+
+    // both groups require a new block, so a request with lower priority is preempted, though it was added earlier
+    auto out2 = scheduler.schedule(requests);
+    std::vector<uint64_t> ref_ids = {1};
+    EXPECT_EQ(out2.m_scheduled_sequence_groups_ids, ref_ids);
+    EXPECT_EQ(sequence_group1->get_num_processed_tokens(), 0);
+    EXPECT_EQ(sequence_group2->get_num_scheduled_tokens(), 1);
+    EXPECT_EQ(out2.m_block_tables[(*sequence_group2)[0]->get_id()].size(), 2);
+    // KV cache of the prompt is released by preemption, so it will be recomputed
+    EXPECT_EQ(out2.m_num_preemptions, 1);
+    EXPECT_EQ(sequence_group1->get_metrics().num_preemptions, 1);
+    EXPECT_EQ(sequence_group1->get_metrics().num_recomputed_tokens, tokens.size());
+    EXPECT_EQ(sequence_group2->get_metrics().num_preemptions, 0);
+}
+
+TEST(TestScheduler, test_earliest_deadline_first) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 4,
+        .num_kv_blocks = 8,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3};
+    GenerationConfig deadline_config = GenerationConfig::greedy();
+    deadline_config.deadline_ms = 60000;
+    SequenceGroup::Ptr sequence_group1 = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    SequenceGroup::Ptr sequence_group2 = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         deadline_config, scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group1, sequence_group2};
+
+    // requests of the same priority are served by earliest deadline, requests without deadline are the last ones
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out = scheduler.schedule(requests);
+    std::vector<uint64_t> ref_ids = {1};
+    EXPECT_EQ(out.m_scheduled_sequence_groups_ids, ref_ids);
+    EXPECT_FALSE(sequence_group2->is_deadline_exceeded(std::chrono::steady_clock::now()));
+    EXPECT_TRUE(sequence_group2->is_deadline_exceeded(std::chrono::steady_clock::now() + std::chrono::milliseconds(60001)));
+}
+
+TEST(TestScheduler, test_reserve_decode_slots) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 3,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3};
+    SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                        GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group};
+    const uint64_t seq_id = (*sequence_group)[0]->get_id();
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    for (size_t step = 0; step < 2; ++step) {
+        scheduler.schedule(requests);
+        (*sequence_group)[0]->append_token(16, 0.9);
+        sequence_group->finish_iteration();
+    }
+
+    // KV cache of 6 processed tokens occupies 2 blocks, while 4 more decode steps require the third one
+    auto out = scheduler.schedule(requests);
+    (*sequence_group)[0]->append_token(16, 0.9);
+    sequence_group->finish_iteration();
+    EXPECT_EQ(scheduler.reserve_decode_slots(requests, out, 4), 4);
+    EXPECT_EQ(out.m_block_tables[seq_id].size(), 3);
+    EXPECT_EQ(scheduler.reserve_decode_slots(requests, out, 8), 0);
+    EXPECT_EQ(out.m_block_tables[seq_id].size(), 3);
+
+    // unused reservation is released
+    scheduler.free_rejected_tokens(sequence_group);
+    EXPECT_EQ(scheduler.get_block_table(*(*sequence_group)[0]).size(), 2);
+}
+
+TEST(TestScheduler, test_sliding_window_kv_cache) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 4,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+    };
+    scheduler_config.kv_window_blocks = 2;
+    scheduler_config.num_sink_blocks = 1;
+    std::vector<uint64_t> tokens = {0,1,2,3};
+    SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                        GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group};
+    const uint64_t seq_id = (*sequence_group)[0]->get_id();
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out = scheduler.schedule(requests);
+    const int sink_block_index = out.m_block_tables[seq_id][0]->get_index();
+    (*sequence_group)[0]->append_token(16, 0.9);
+    sequence_group->finish_iteration();
+
+    // generation continues beyond KV cache capacity, while sink block is kept and the oldest blocks after it are evicted
+    for (size_t step = 0; step < 20; ++step) {
+        out = scheduler.schedule(requests);
+        EXPECT_EQ(out.m_scheduled_sequence_groups_ids.size(), 1);
+        EXPECT_LE(out.m_block_tables[seq_id].size(), 3);
+        EXPECT_EQ(out.m_block_tables[seq_id][0]->get_index(), sink_block_index);
+        (*sequence_group)[0]->append_token(16, 0.9);
+        sequence_group->finish_iteration();
+    }
+    // KV cache of 24 processed tokens keeps the first block and the last 8 tokens
+    EXPECT_EQ(sequence_group->get_num_processed_tokens(), 24);
+    EXPECT_EQ(sequence_group->get_num_evicted_tokens(), 12);
+    EXPECT_EQ(scheduler.get_block_table(*(*sequence_group)[0]).size(), 3);
+}
+
+TEST(TestScheduler, test_reserve_decode_slots_within_sliding_window) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 8,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+    };
+    scheduler_config.kv_window_blocks = 2;
+    scheduler_config.num_sink_blocks = 1;
+    std::vector<uint64_t> tokens = {0,1,2,3,4,5};
+    SequenceGroup::Ptr sequence_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                        GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {sequence_group};
+    const uint64_t seq_id = (*sequence_group)[0]->get_id();
+
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out = scheduler.schedule(requests);
+    (*sequence_group)[0]->append_token(16, 0.9);
+    sequence_group->finish_iteration();
+
+    // blocks are not evicted between decode steps, so KV cache of 6 processed tokens can grow by 6 tokens only within 3 blocks
+    EXPECT_EQ(scheduler.reserve_decode_slots(requests, out, 8), 6);
+    EXPECT_EQ(out.m_block_tables[seq_id].size(), 3);
+}
+
+TEST(TestScheduler, test_kv_cache_export_and_import) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 4,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+    };
+    std::vector<int64_t> tokens = {0,1,2,3,4,5,6,7,8,9};
+    GenerationConfig export_config = GenerationConfig::greedy();
+    export_config.export_kv_cache = true;
+    SequenceGroup::Ptr exporting_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         export_config, scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {exporting_group};
+
+    // the last prompt token is not processed by export request
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, tokens.size() - 1);
+    EXPECT_EQ(exporting_group->get_num_sampled_tokens(), 0);
+    scheduler.free_sequence((*exporting_group)[0]->get_id());
+
+    // importing request computes only the last prompt token, KV cache of others is written to allocated blocks
+    auto kv_cache = std::make_shared<KVCacheBlob>(tokens, tokens.size() - 1, "f16", scheduler_config.block_size, 1, 8, 8);
+    SequenceGroup::Ptr importing_group = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    importing_group->set_imported_kv_cache(kv_cache);
+    requests = {importing_group};
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(out2.m_total_num_scheduled_tokens, 1);
+    EXPECT_EQ(importing_group->get_num_processed_tokens(), tokens.size() - 1);
+    EXPECT_EQ(importing_group->get_metrics().num_imported_prompt_tokens, tokens.size() - 1);
+    ASSERT_EQ(out2.m_kv_cache_imports.size(), 1);
+    EXPECT_EQ(out2.m_kv_cache_imports[0].m_kv_cache, kv_cache);
+    EXPECT_EQ(out2.m_kv_cache_imports[0].m_first_block_idx, 0);
+    EXPECT_EQ(out2.m_kv_cache_imports[0].m_block_ids.size(), 3);
+    EXPECT_FALSE(importing_group->has_imported_kv_cache());
+    importing_group->finish_iteration();
+    scheduler.free_sequence((*importing_group)[0]->get_id());
+
+    // when KV cache has no free blocks for import, prompt is computed
+    std::vector<int64_t> long_tokens(20, 1);
+    auto long_kv_cache = std::make_shared<KVCacheBlob>(long_tokens, long_tokens.size() - 1, "f16", scheduler_config.block_size, 1, 8, 8);
+    SequenceGroup::Ptr long_group = std::make_shared<SequenceGroup>(2, ov::Tensor(ov::element::i64, {long_tokens.size()}, long_tokens.data()),
+                                                                    GenerationConfig::greedy(), scheduler_config.block_size);
+    long_group->set_imported_kv_cache(long_kv_cache);
+    requests = {long_group};
+    auto out3 = scheduler.schedule(requests);
+    EXPECT_TRUE(out3.m_kv_cache_imports.empty());
+    EXPECT_EQ(out3.m_total_num_scheduled_tokens, 16);
+    EXPECT_FALSE(long_group->has_imported_kv_cache());
+}
+
+TEST(TestScheduler, test_kv_cache_import_after_prefix_cache_restore) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 8,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .enable_prefix_caching = true,
+    };
+    std::vector<int64_t> tokens = {0,1,2,3,4,5,6,7,8,9,10,11,12,13};
+    SequenceGroup::Ptr cached_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {6}, tokens.data()),
+                                                                      GenerationConfig::greedy(), scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {cached_group};
+    Scheduler scheduler = Scheduler(scheduler_config);
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, 6);
+    cached_group->finish_iteration();
+
+    // the first block is restored from prefix cache, while KV cache of the next tokens is imported; imported blob is
+    // stored for another continuation of the first 10 tokens, so only common tokens are imported
+    std::vector<int64_t> kv_cache_tokens(tokens.begin(), tokens.begin() + 10);
+    kv_cache_tokens.insert(kv_cache_tokens.end(), {100, 101});
+    auto kv_cache = std::make_shared<KVCacheBlob>(kv_cache_tokens, kv_cache_tokens.size(), "f16", scheduler_config.block_size, 1, 8, 8);
+    SequenceGroup::Ptr importing_group = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                         GenerationConfig::greedy(), scheduler_config.block_size);
+    importing_group->set_imported_kv_cache(kv_cache);
+    requests.push_back(importing_group);
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(importing_group->get_num_processed_tokens(), 10);
+    EXPECT_EQ(importing_group->get_num_scheduled_tokens(), tokens.size() - 10);
+    EXPECT_EQ(importing_group->get_metrics().num_cached_prompt_tokens, 4);
+    EXPECT_EQ(importing_group->get_metrics().num_imported_prompt_tokens, 6);
+    ASSERT_EQ(out2.m_kv_cache_imports.size(), 1);
+    EXPECT_EQ(out2.m_kv_cache_imports[0].m_first_block_idx, 1);
+    EXPECT_EQ(out2.m_kv_cache_imports[0].m_block_ids.size(), 2);
+
+    const auto& block_table = scheduler.get_block_table(*(*importing_group)[0]);
+    ASSERT_EQ(block_table.size(), 4);
+    EXPECT_EQ(block_table[0], scheduler.get_block_table(*(*cached_group)[0])[0]);
+    EXPECT_EQ(out2.m_kv_cache_imports[0].m_block_ids[0], block_table[1]->get_index());
+}
+
+TEST(TestScheduler, test_prefix_grouping) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 16,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .enable_prefix_caching = true,
+        .enable_prefix_grouping = true,
+    };
+    // requests share the first 2 blocks of prompt, while the third one has another LoRA adapter
+    std::vector<int64_t> first_tokens = {0,1,2,3,4,5,6,7,8,9}, second_tokens = {0,1,2,3,4,5,6,7,10,11,12};
+    GenerationConfig lora_config = GenerationConfig::greedy();
+    lora_config.lora_adapter_id = 1;
+    SequenceGroup::Ptr first_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {first_tokens.size()}, first_tokens.data()),
+                                                                     GenerationConfig::greedy(), scheduler_config.block_size);
+    SequenceGroup::Ptr second_group = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {second_tokens.size()}, second_tokens.data()),
+                                                                      GenerationConfig::greedy(), scheduler_config.block_size);
+    SequenceGroup::Ptr lora_group = std::make_shared<SequenceGroup>(2, ov::Tensor(ov::element::i64, {second_tokens.size()}, second_tokens.data()),
+                                                                    lora_config, scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {first_group, second_group, lora_group};
+    Scheduler scheduler = Scheduler(scheduler_config);
+
+    // the second request waits, while the common prefix is computed by the first one
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_scheduled_sequence_groups_ids, std::vector<uint64_t>({0, 2}));
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, first_tokens.size() + second_tokens.size());
+    for (auto& request : requests)
+        request->finish_iteration();
+
+    // and then restores blocks of the prefix computed by the first request
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(second_group->get_num_processed_tokens(), 8);
+    EXPECT_EQ(second_group->get_num_scheduled_tokens(), second_tokens.size() - 8);
+    EXPECT_EQ(second_group->get_metrics().num_cached_prompt_tokens, 8);
+    const auto& block_table = scheduler.get_block_table(*(*second_group)[0]);
+    const auto& first_block_table = scheduler.get_block_table(*(*first_group)[0]);
+    EXPECT_EQ(block_table[0], first_block_table[0]);
+    EXPECT_EQ(block_table[1], first_block_table[1]);
+    EXPECT_NE(block_table[1], scheduler.get_block_table(*(*lora_group)[0])[1]);
+
+    // grouping reuses blocks of prefix cache
+    scheduler_config.enable_prefix_caching = false;
+    EXPECT_THROW(Scheduler{scheduler_config}, ov::Exception);
+}
+
+TEST(TestScheduler, test_fair_share_scheduling) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 8,
+        .num_kv_blocks = 32,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .enable_fair_share = true,
+        .tenants = {{1, TenantConfig{1.0f, 4, 0}}},
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3,4,5,6,7};
+    GenerationConfig tenant_config = GenerationConfig::greedy();
+    tenant_config.tenant_id = 1;
+    std::vector<SequenceGroup::Ptr> requests;
+    // the first tenant adds two requests before a request of the second tenant
+    for (size_t request_id = 0; request_id < 3; ++request_id)
+        requests.push_back(std::make_shared<SequenceGroup>(request_id, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                           request_id == 2 ? tenant_config : GenerationConfig::greedy(), scheduler_config.block_size));
+    Scheduler scheduler = Scheduler(scheduler_config);
+
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_scheduled_sequence_groups_ids, std::vector<uint64_t>({0}));
+    EXPECT_EQ(out1.m_tenant_usage[0].m_num_scheduled_tokens, tokens.size());
+    EXPECT_EQ(out1.m_tenant_usage[0].m_num_kv_blocks, 2);
+    EXPECT_EQ(out1.m_tenant_usage[1].m_num_scheduled_tokens, 0);
+    (*requests[0])[0]->append_token(16, 0.9);
+    for (auto& request : requests)
+        request->finish_iteration();
+
+    // the second tenant is served before the second request of the first one, but not more than its limit of tokens
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(out2.m_scheduled_sequence_groups_ids, std::vector<uint64_t>({0, 1, 2}));
+    EXPECT_EQ(requests[2]->get_num_scheduled_tokens(), 4);
+    EXPECT_EQ(requests[1]->get_num_scheduled_tokens(), 3);
+    EXPECT_EQ(out2.m_tenant_usage[1].m_num_scheduled_tokens, 4);
+    EXPECT_EQ(out2.m_tenant_usage[0].m_num_kv_blocks, 4);
+
+    // fair share is based on scheduling of dynamic_split_fuse
+    scheduler_config.dynamic_split_fuse = false;
+    EXPECT_THROW(Scheduler{scheduler_config}, ov::Exception);
+    scheduler_config.dynamic_split_fuse = true;
+    scheduler_config.tenants[1].weight = 0.0f;
+    EXPECT_THROW(Scheduler{scheduler_config}, ov::Exception);
+}
+
+TEST(TestScheduler, test_fair_share_preemption) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 6,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .enable_fair_share = true,
+        .tenants = {{2, TenantConfig{1.0f, 4, 0}}},
+    };
+    std::vector<uint64_t> tokens(16);
+    std::iota(tokens.begin(), tokens.end(), 0);
+    GenerationConfig high_priority_config = GenerationConfig::greedy(), over_quota_config = GenerationConfig::greedy(),
+                     under_quota_config = GenerationConfig::greedy();
+    high_priority_config.priority = 1;
+    over_quota_config.tenant_id = 1;
+    under_quota_config.tenant_id = 2;
+    SequenceGroup::Ptr high_priority_group = std::make_shared<SequenceGroup>(0, ov::Tensor(ov::element::i64, {8}, tokens.data()),
+                                                                             high_priority_config, scheduler_config.block_size);
+    SequenceGroup::Ptr over_quota_group = std::make_shared<SequenceGroup>(1, ov::Tensor(ov::element::i64, {12}, tokens.data()),
+                                                                          over_quota_config, scheduler_config.block_size);
+    SequenceGroup::Ptr under_quota_group = std::make_shared<SequenceGroup>(2, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                                           under_quota_config, scheduler_config.block_size);
+    std::vector<SequenceGroup::Ptr> requests = {high_priority_group, over_quota_group, under_quota_group};
+    Scheduler scheduler = Scheduler(scheduler_config);
+
+    // the third tenant processes its prompt by 4 tokens per step, while the whole KV cache is occupied
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_total_num_scheduled_tokens, 24);
+    EXPECT_EQ(out1.m_tenant_usage[1].m_num_kv_blocks, 3);
+    (*high_priority_group)[0]->append_token(16, 0.9);
+    (*over_quota_group)[0]->append_token(16, 0.9);
+    for (auto& request : requests)
+        request->finish_iteration();
+
+    // the request with the longest remaining prompt is the last one, but the second tenant exceeds its share of KV cache
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(out2.m_num_preemptions, 1);
+    EXPECT_EQ(out2.m_tenant_usage[1].m_num_preemptions, 1);
+    EXPECT_EQ(over_quota_group->get_metrics().num_preemptions, 1);
+    EXPECT_EQ(under_quota_group->get_metrics().num_preemptions, 0);
+    EXPECT_EQ(under_quota_group->get_num_processed_tokens(), 4);
+}
+
+TEST(TestScheduler, test_fair_share_kv_limit) {
+    SchedulerConfig scheduler_config {
+        .max_num_batched_tokens = 32,
+        .num_kv_blocks = 32,
+        .block_size = 4,
+        .dynamic_split_fuse = true,
+        .max_num_seqs = 5,
+        .enable_fair_share = true,
+        .tenants = {{1, TenantConfig{1.0f, 0, 4}}},
+    };
+    std::vector<uint64_t> tokens = {0,1,2,3};
+    GenerationConfig tenant_config = GenerationConfig::greedy();
+    tenant_config.tenant_id = 1;
+    std::vector<SequenceGroup::Ptr> requests;
+    for (size_t request_id = 0; request_id < 3; ++request_id)
+        requests.push_back(std::make_shared<SequenceGroup>(request_id, ov::Tensor(ov::element::i64, {tokens.size()}, tokens.data()),
+                                                           tenant_config, scheduler_config.block_size));
+    Scheduler scheduler = Scheduler(scheduler_config);
+
+    auto out1 = scheduler.schedule(requests);
+    EXPECT_EQ(out1.m_scheduled_sequence_groups_ids, std::vector<uint64_t>({0, 1, 2}));
+    EXPECT_EQ(out1.m_tenant_usage[1].m_num_kv_blocks, 3);
+    for (auto& request : requests) {
+        (*request)[0]->append_token(16, 0.9);
+        request->finish_iteration();
+    }
+
+    // every generated token requires a new block, so the last request of the tenant is preempted to keep its limit
+    auto out2 = scheduler.schedule(requests);
+    EXPECT_EQ(out2.m_scheduled_sequence_groups_ids, std::vector<uint64_t>({0, 1}));
+    EXPECT_EQ(out2.m_tenant_usage[1].m_num_kv_blocks, 4);
+    EXPECT_EQ(out2.m_tenant_usage[1].m_num_preemptions, 1);
+    EXPECT_EQ(requests[2]->get_num_processed_tokens(), 0);
+}
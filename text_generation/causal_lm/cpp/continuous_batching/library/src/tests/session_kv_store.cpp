@@ -0,0 +1,91 @@
+// Copyright (C) 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include "session_kv_store.hpp"
+
+namespace {
+
+const size_t kBlockSize = 4;
+
+// session KV cache, which bytes depend on session tokens
+KVCacheBlob::Ptr make_session(const std::vector<int64_t>& token_ids) {
+    auto kv_cache = std::make_shared<KVCacheBlob>(token_ids, token_ids.size(), "f16", kBlockSize, 2, 8, 8);
+    for (size_t block_idx = 0; block_idx < kv_cache->get_num_blocks(); ++block_idx) {
+        uint8_t* block_data = kv_cache->get_block_data(block_idx);
+        std::fill(block_data, block_data + kv_cache->get_block_byte_size(), static_cast<uint8_t>(token_ids[block_idx * kBlockSize]));
+    }
+    return kv_cache;
+}
+
+// empty directory, which is removed by the test
+std::filesystem::path get_empty_dir(const std::string& name) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(dir);
+    return dir;
+}
+
+}  // namespace
+
+TEST(TestSessionKVStore, sessions_are_found_after_restart) {
+    const std::filesystem::path dir = get_empty_dir("session_kv_store_restart_test");
+    const std::vector<int64_t> session = {1, 2, 3, 4, 5, 6, 7, 8};
+    {
+        SessionKVStore store(dir.string(), kBlockSize, 1024 * 1024);
+        KVCacheBlob::Ptr kv_cache = make_session(session);
+        store.store(kv_cache);
+        EXPECT_TRUE(store.contains(session));
+        // session is found while it's written in background as well
+        KVCacheBlob::Ptr found_kv_cache = store.find(session, 2);
+        ASSERT_TRUE(found_kv_cache);
+        EXPECT_EQ(found_kv_cache->get_prompt_ids(), session);
+        store.flush();
+    }
+    EXPECT_TRUE(std::filesystem::exists(dir));
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()), 1);
+
+    SessionKVStore store(dir.string(), kBlockSize, 1024 * 1024);
+    EXPECT_EQ(store.get_num_sessions(), 1);
+    // a prompt sharing the first block of session finds it, while the rest of tokens is compared by caller
+    KVCacheBlob::Ptr kv_cache = store.find({1, 2, 3, 4, 9, 9, 9, 9, 9}, 2);
+    ASSERT_TRUE(kv_cache);
+    EXPECT_EQ(kv_cache->get_prompt_ids(), session);
+    EXPECT_EQ(kv_cache->get_block_data(1)[0], 5);
+    EXPECT_FALSE(store.find({9, 2, 3, 4, 5, 6, 7, 8}, 2));
+    // blocks, which logits are required, are not looked up
+    EXPECT_FALSE(store.find(session, 0));
+
+    // sessions of other block size are ignored
+    SessionKVStore other_store(dir.string(), kBlockSize * 2, 1024 * 1024);
+    EXPECT_EQ(other_store.get_num_sessions(), 0);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(TestSessionKVStore, sessions_are_replaced_by_continuations_and_evicted) {
+    const std::filesystem::path dir = get_empty_dir("session_kv_store_eviction_test");
+    const std::vector<int64_t> first_turn = {1, 2, 3, 4}, second_turn = {1, 2, 3, 4, 5, 6, 7, 8}, other_session = {5, 6, 7, 8};
+    const size_t session_byte_size = make_session(second_turn)->size();
+    SessionKVStore store(dir.string(), kBlockSize, session_byte_size + make_session(other_session)->size() / 2);
+
+    store.store(make_session(first_turn));
+    store.store(make_session(second_turn));
+    EXPECT_EQ(store.get_num_sessions(), 1);
+    // stored prefix of a session is not stored again
+    store.store(make_session(first_turn));
+    EXPECT_EQ(store.get_num_sessions(), 1);
+    EXPECT_EQ(store.find(first_turn, 1)->get_prompt_ids(), second_turn);
+
+    // the least recently used session is removed, when stored sessions exceed the size limit
+    store.store(make_session(other_session));
+    store.flush();
+    EXPECT_EQ(store.get_num_sessions(), 1);
+    EXPECT_FALSE(store.contains(second_turn));
+    EXPECT_TRUE(store.contains(other_session));
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()), 1);
+
+    EXPECT_THROW(store.store(std::make_shared<KVCacheBlob>(second_turn, 6, "f16", kBlockSize, 2, 8, 8)), ov::Exception);
+    std::filesystem::remove_all(dir);
+}
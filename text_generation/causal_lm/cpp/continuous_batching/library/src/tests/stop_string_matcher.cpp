@@ -0,0 +1,78 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "openvino/runtime/tensor.hpp"
+#include "sequence_group.hpp"
+#include "stop_string_matcher.hpp"
+
+static TokenVocabulary::Ptr create_vocabulary() {
+    return std::make_shared<TokenVocabulary>(std::vector<std::string>{"", "Hello", " world", "wor", "ld", "!", "\n\n"});
+}
+
+TEST(TestStopStringMatcher, finds_stop_strings_spanning_tokens) {
+    StopStringMatcher stop_string_matcher({"world", "\n\n"}, create_vocabulary());
+
+    int state = stop_string_matcher.get_initial_state();
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 1));
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 3));
+    EXPECT_TRUE(stop_string_matcher.feed_token(state, 4));
+
+    state = stop_string_matcher.get_initial_state();
+    EXPECT_TRUE(stop_string_matcher.feed_token(state, 2));
+
+    state = stop_string_matcher.get_initial_state();
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 5));
+    EXPECT_TRUE(stop_string_matcher.feed_token(state, 6));
+}
+
+TEST(TestStopStringMatcher, finds_overlapping_stop_strings) {
+    auto vocabulary = std::make_shared<TokenVocabulary>(std::vector<std::string>{"a", "b", "c"});
+    StopStringMatcher stop_string_matcher({"aab", "bc"}, vocabulary);
+
+    // "aa" followed by "a" is still a prefix of "aab", while "ab" is completed by "c" via failure link
+    int state = stop_string_matcher.get_initial_state();
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 0));
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 0));
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 0));
+    EXPECT_TRUE(stop_string_matcher.feed_token(state, 1));
+
+    state = stop_string_matcher.get_initial_state();
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 0));
+    EXPECT_FALSE(stop_string_matcher.feed_token(state, 1));
+    EXPECT_TRUE(stop_string_matcher.feed_token(state, 2));
+}
+
+TEST(TestStopStringMatcher, finishes_sequence_and_drops_tokens_after_stop_string) {
+    std::vector<int64_t> prompt_ids = {1};
+    GenerationConfig config = GenerationConfig::greedy();
+    config.stop_strings = {"world"};
+    SequenceGroup sequence_group(0, ov::Tensor(ov::element::i64, {prompt_ids.size()}, prompt_ids.data()), config, 4);
+    sequence_group.set_stop_string_matcher(std::make_shared<StopStringMatcher>(config.stop_strings, create_vocabulary()));
+
+    Sequence::Ptr sequence = sequence_group[0];
+    sequence->append_token(1, 0.0f);
+    EXPECT_TRUE(sequence_group.try_finish_generation().empty());
+
+    // several tokens appended on the same step, e.g. validated speculative candidates
+    sequence->append_token(3, 0.0f);
+    sequence->append_token(4, 0.0f);
+    sequence->append_token(1, 0.0f);
+    EXPECT_EQ(sequence_group.try_finish_generation().size(), 1);
+    EXPECT_TRUE(sequence->has_finished());
+    EXPECT_EQ(sequence->get_generated_ids(), std::vector<int64_t>({1, 3, 4}));
+}
+
+TEST(TestStopStringMatcher, stop_tokens_finish_sequence) {
+    std::vector<int64_t> prompt_ids = {1};
+    GenerationConfig config = GenerationConfig::greedy();
+    config.stop_token_ids = {5};
+    config.ignore_eos = true;
+    SequenceGroup sequence_group(0, ov::Tensor(ov::element::i64, {prompt_ids.size()}, prompt_ids.data()), config, 4);
+
+    Sequence::Ptr sequence = sequence_group[0];
+    sequence->append_token(5, 0.0f);
+    EXPECT_EQ(sequence_group.try_finish_generation().size(), 1);
+    EXPECT_TRUE(sequence->has_finished());
+}
@@ -0,0 +1,95 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "telemetry.hpp"
+
+TEST(TestTelemetry, histogram_counts_observations_by_buckets) {
+    Histogram histogram({1.0, 2.0, 4.0});
+    histogram.observe(0.5);
+    histogram.observe(1.0);
+    histogram.observe(3.0, 2);
+    histogram.observe(10.0);
+
+    EXPECT_EQ(histogram.get_bucket_count(0), 2);
+    EXPECT_EQ(histogram.get_bucket_count(1), 0);
+    EXPECT_EQ(histogram.get_bucket_count(2), 2);
+    EXPECT_EQ(histogram.get_count(), 5);
+    EXPECT_FLOAT_EQ(histogram.get_sum(), 17.5);
+
+    Histogram other({1.0, 2.0, 4.0});
+    other.observe(1.5);
+    histogram.merge(other);
+    EXPECT_EQ(histogram.get_bucket_count(1), 1);
+    EXPECT_EQ(histogram.get_count(), 6);
+
+    EXPECT_THROW(histogram.merge(Histogram({1.0})), ov::Exception);
+}
+
+TEST(TestTelemetry, histogram_is_written_with_cumulative_buckets) {
+    Histogram histogram({1.0, 2.0});
+    histogram.observe(0.5);
+    histogram.observe(1.5);
+    histogram.observe(5.0);
+
+    std::ostringstream os;
+    histogram.write_prometheus(os, "latency_seconds", "phase=\"forward\"");
+    EXPECT_EQ(os.str(),
+        "latency_seconds_bucket{phase=\"forward\",le=\"1\"} 1\n"
+        "latency_seconds_bucket{phase=\"forward\",le=\"2\"} 2\n"
+        "latency_seconds_bucket{phase=\"forward\",le=\"+Inf\"} 3\n"
+        "latency_seconds_sum{phase=\"forward\"} 7\n"
+        "latency_seconds_count{phase=\"forward\"} 3\n");
+}
+
+TEST(TestTelemetry, pipeline_telemetry_is_merged_and_exported) {
+    PipelineTelemetry first, second;
+    first.observe_time_to_first_token(0.1);
+    first.observe_inter_token_latency(0.2, 4);
+    first.add_preemptions(2);
+    first.set_snapshot({3, 2, 50.0f});
+    second.observe_time_to_first_token(0.3);
+    second.add_preemptions(1);
+    second.set_snapshot({1, 1, 10.0f});
+    second.add_op_duration("FullyConnected", 0.5);
+    first.set_kv_cache_size(8, 8192);
+    second.set_kv_cache_size(4, 4096);
+
+    first.merge(second);
+    PipelineTelemetry::Snapshot snapshot = first.get_snapshot();
+    EXPECT_EQ(snapshot.requests, 4);
+    EXPECT_EQ(snapshot.scheduled_requests, 3);
+
+    const std::string metrics = first.to_prometheus();
+    EXPECT_NE(metrics.find("cb_time_to_first_token_seconds_count 2\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_inter_token_latency_seconds_count 4\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_generated_tokens_total 6\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_preemptions_total 3\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_step_phase_duration_seconds_count{phase=\"forward\"} 0\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_op_duration_seconds_total{node_type=\"FullyConnected\"} 0.5\n"), std::string::npos);
+    // each NUMA worker allocates its own KV cache
+    EXPECT_NE(metrics.find("cb_kv_cache_blocks 12\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_kv_cache_bytes 12288\n"), std::string::npos);
+    // startup stages are not timed by this telemetry
+    EXPECT_EQ(metrics.find("cb_startup_duration_seconds"), std::string::npos);
+}
+
+TEST(TestTelemetry, tenant_metrics_are_exported_with_labels) {
+    PipelineTelemetry first, second;
+    // KV blocks are the gauge of the last step, while tokens and preemptions are accumulated
+    first.observe_tenant(1, 16, 4, 0);
+    first.observe_tenant(1, 8, 2, 1);
+    second.observe_tenant(1, 4, 3, 0);
+    second.observe_tenant(2, 32, 8, 0);
+
+    first.merge(second);
+    EXPECT_EQ(first.get_tenants().size(), 2);
+    const std::string metrics = first.to_prometheus();
+    EXPECT_NE(metrics.find("cb_tenant_scheduled_tokens_total{tenant=\"1\"} 28\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_tenant_preemptions_total{tenant=\"1\"} 1\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_tenant_kv_blocks{tenant=\"1\"} 5\n"), std::string::npos);
+    EXPECT_NE(metrics.find("cb_tenant_kv_blocks{tenant=\"2\"} 8\n"), std::string::npos);
+    // tenants are not exported without fair share scheduling
+    EXPECT_EQ(PipelineTelemetry().to_prometheus().find("cb_tenant"), std::string::npos);
+}
@@ -0,0 +1,77 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "logit_processor.hpp"
+#include "token_constraint.hpp"
+
+static bool matches(const std::string& pattern, const std::string& text) {
+    RegexAutomaton automaton(pattern);
+    int state = automaton.get_initial_state();
+    for (char c : text)
+        state = automaton.next_state(state, static_cast<uint8_t>(c));
+    return automaton.is_accepting(state);
+}
+
+TEST(TestRegexAutomaton, matches_whole_text) {
+    EXPECT_TRUE(matches("abc", "abc"));
+    EXPECT_FALSE(matches("abc", "ab"));
+    EXPECT_FALSE(matches("abc", "abcd"));
+    EXPECT_TRUE(matches("(ab|cd){2,3}", "abcdab"));
+    EXPECT_FALSE(matches("(ab|cd){2,3}", "abababab"));
+    EXPECT_TRUE(matches("\\d{3}-\\d{2}", "123-45"));
+    EXPECT_TRUE(matches("[a-z]+@[a-z]+\\.com", "user@example.com"));
+    EXPECT_FALSE(matches("[^0-9]+", "a1"));
+    EXPECT_TRUE(matches("(?:yes|no)?", ""));
+    EXPECT_TRUE(matches("\\{\"age\": \\d+\\}", "{\"age\": 42}"));
+    // non-ASCII characters are matched as a whole
+    EXPECT_TRUE(matches(".{2}", "\xD0\xBF\xD1\x80"));
+    EXPECT_TRUE(matches("\xD0\xBF+", "\xD0\xBF\xD0\xBF"));
+}
+
+TEST(TestRegexAutomaton, rejects_invalid_patterns) {
+    EXPECT_THROW(RegexAutomaton("(ab"), ov::Exception);
+    EXPECT_THROW(RegexAutomaton("a{3,2}"), ov::Exception);
+    EXPECT_THROW(RegexAutomaton("*a"), ov::Exception);
+    EXPECT_THROW(RegexAutomaton("[a-"), ov::Exception);
+}
+
+TEST(TestTokenConstraint, allows_tokens_continuing_pattern) {
+    // EOS has no text
+    auto vocabulary = std::make_shared<TokenVocabulary>(std::vector<std::string>{"", "a", "b", "ab", "ba", "c"});
+    TokenConstraint token_constraint("(ab)+", vocabulary);
+
+    int state = token_constraint.get_initial_state();
+    EXPECT_EQ(token_constraint.get_allowed_tokens(state)[0], (1 << 1) | (1 << 3));
+    EXPECT_FALSE(token_constraint.is_accepting(state));
+
+    state = token_constraint.next_state(state, 3);
+    EXPECT_TRUE(token_constraint.is_accepting(state));
+    EXPECT_EQ(token_constraint.get_allowed_tokens(state)[0], (1 << 1) | (1 << 3));
+
+    state = token_constraint.next_state(state, 1);
+    EXPECT_FALSE(token_constraint.is_accepting(state));
+    EXPECT_EQ(token_constraint.get_allowed_tokens(state)[0], (1 << 2) | (1 << 4));
+}
+
+TEST(TestTokenConstraint, transform_keeps_allowed_tokens) {
+    auto vocabulary = std::make_shared<TokenVocabulary>(std::vector<std::string>{"", "a", "b", "ab", "ba", "c"});
+    auto token_constraint = std::make_shared<TokenConstraint>("(ab)+", vocabulary);
+    LogitTransformers::TokenConstraintTransform transform(token_constraint, 0);
+
+    std::vector<Token> logits;
+    for (size_t token_id = 0; token_id < vocabulary->size(); ++token_id)
+        logits.push_back({float(token_id), int64_t(token_id)});
+
+    std::vector<Token> result = transform.apply(logits);
+    ASSERT_EQ(result.size(), 2);
+    EXPECT_EQ(result[0].m_index, 1);
+    EXPECT_EQ(result[1].m_index, 3);
+
+    // EOS is allowed once the pattern is matched
+    transform.register_new_generated_token(3);
+    result = transform.apply(logits);
+    ASSERT_EQ(result.size(), 3);
+    EXPECT_EQ(result[2].m_index, 0);
+}
@@ -0,0 +1,50 @@
+// Copyright (C) 2018-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+//
+
+#include <gtest/gtest.h>
+#include "tokenization_cache.hpp"
+
+static ov::Tensor create_input_ids(std::vector<int64_t> token_ids) {
+    ov::Tensor input_ids(ov::element::i64, {1, token_ids.size()});
+    std::copy(token_ids.begin(), token_ids.end(), input_ids.data<int64_t>());
+    return input_ids;
+}
+
+TEST(TestTokenizationCache, returns_cached_tensor) {
+    TokenizationCache cache(1024);
+    ov::Tensor input_ids = create_input_ids({1, 2, 3});
+    cache.put("abc", input_ids);
+
+    ov::Tensor cached_input_ids;
+    ASSERT_TRUE(cache.get("abc", cached_input_ids));
+    EXPECT_EQ(cached_input_ids.data<int64_t>(), input_ids.data<int64_t>());
+    EXPECT_FALSE(cache.get("abcd", cached_input_ids));
+    EXPECT_EQ(cache.get_size(), 3 + 3 * sizeof(int64_t));
+}
+
+TEST(TestTokenizationCache, evicts_least_recently_used) {
+    // each entry takes 1 + 8 bytes
+    TokenizationCache cache(20);
+    cache.put("a", create_input_ids({1}));
+    cache.put("b", create_input_ids({2}));
+
+    ov::Tensor input_ids;
+    ASSERT_TRUE(cache.get("a", input_ids));
+    cache.put("c", create_input_ids({3}));
+    EXPECT_TRUE(cache.get("a", input_ids));
+    EXPECT_FALSE(cache.get("b", input_ids));
+    EXPECT_TRUE(cache.get("c", input_ids));
+
+    cache.set_capacity(10);
+    EXPECT_TRUE(cache.get("c", input_ids));
+    EXPECT_FALSE(cache.get("a", input_ids));
+}
+
+TEST(TestTokenizationCache, zero_capacity_disables_cache) {
+    TokenizationCache cache;
+    cache.put("a", create_input_ids({1}));
+    ov::Tensor input_ids;
+    EXPECT_FALSE(cache.get("a", input_ids));
+    EXPECT_EQ(cache.get_size(), 0);
+}
@@ -3,30 +3,26 @@
 
 #pragma once
 
-#include <string>
 #include <chrono>
-#include <iostream>
 
+// measures durations of code sections, which are reported to PipelineTelemetry
 class ManualTimer {
-    double m_total;
-    decltype(std::chrono::steady_clock::now()) m_start;
-    std::string m_title;
+    double m_total = 0.;
+    std::chrono::steady_clock::time_point m_start;
 public:
-    ManualTimer(const std::string& title) :
-        m_total(0.),
-        m_title(title) {
-    }
-
     void start() {
         m_start = std::chrono::steady_clock::now();
     }
 
-    void end() {
-        auto m_end = std::chrono::steady_clock::now();
-        m_total += std::chrono::duration<double, std::milli>(m_end - m_start).count();
+    // returns duration of the section since start() in seconds
+    double end() {
+        double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        m_total += duration;
+        return duration;
     }
 
-    ~ManualTimer() {
-        std::cout << m_title << ": " << m_total / 1000. << " secs" << std::endl;
+    // total duration of all measured sections in seconds
+    double get_total() const {
+        return m_total;
     }
 };
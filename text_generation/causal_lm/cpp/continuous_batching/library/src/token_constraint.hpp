@@ -0,0 +1,597 @@
+// Copyright (C) 2023-2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "openvino/core/except.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Byte trie over texts of all tokens of the vocabulary: tokens with common prefixes are matched against
+// an automaton together. It's built once and shared by constraints of all patterns
+class TokenVocabulary {
+public:
+    struct Node {
+        std::vector<std::pair<uint8_t, size_t>> m_children;
+        // tokens, which text ends in this node
+        std::vector<int64_t> m_token_ids;
+    };
+
+    using Ptr = std::shared_ptr<TokenVocabulary>;
+
+    // 'token_texts' are indexed by token id; tokens without text (e.g. special ones) are never allowed by constraints
+    explicit TokenVocabulary(std::vector<std::string> token_texts) :
+        m_nodes(1),
+        m_token_texts(std::move(token_texts)) {
+        for (size_t token_id = 0; token_id < m_token_texts.size(); ++token_id) {
+            size_t node_id = 0;
+            for (char c : m_token_texts[token_id]) {
+                node_id = _get_or_add_child(node_id, static_cast<uint8_t>(c));
+            }
+            if (node_id != 0)
+                m_nodes[node_id].m_token_ids.push_back(token_id);
+        }
+    }
+
+    size_t size() const {
+        return m_token_texts.size();
+    }
+
+    const std::string& get_text(int64_t token_id) const {
+        OPENVINO_ASSERT(token_id >= 0 && token_id < static_cast<int64_t>(m_token_texts.size()), "Token ", token_id, " is out of vocabulary");
+        return m_token_texts[token_id];
+    }
+
+    const Node& get_node(size_t node_id) const {
+        return m_nodes[node_id];
+    }
+
+    const Node& get_root() const {
+        return m_nodes[0];
+    }
+
+private:
+    std::vector<Node> m_nodes;
+    std::vector<std::string> m_token_texts;
+
+    size_t _get_or_add_child(size_t node_id, uint8_t byte) {
+        for (const auto& child : m_nodes[node_id].m_children) {
+            if (child.first == byte)
+                return child.second;
+        }
+        m_nodes.emplace_back();
+        m_nodes[node_id].m_children.emplace_back(byte, m_nodes.size() - 1);
+        return m_nodes.size() - 1;
+    }
+};
+
+// Regular expression over UTF-8 bytes, which must match the whole text. Supported syntax: literals, escapes
+// (\d \w \s \D \W \S \n \t \r \f \v and escaped punctuation), '.', classes with ranges and negation, groups
+// '(...)' and '(?:...)', alternation '|' and quantifiers '*' '+' '?' '{m}' '{m,}' '{m,n}'; '^' and '$' are ignored.
+// Character ranges and negated classes operate on ASCII, while '.' and negated classes also match any non-ASCII character.
+// Pattern is compiled to NFA, which is determinized lazily, so only DFA states reachable by generated texts are built
+class RegexAutomaton {
+public:
+    static constexpr int DEAD_STATE = -1;
+
+    explicit RegexAutomaton(const std::string& pattern) : m_pattern(pattern) {
+        std::unique_ptr<Node> root = _parse_alternation();
+        OPENVINO_ASSERT(m_pos == m_pattern.size(), "Unexpected '", m_pattern[m_pos], "' at position ", m_pos, " of regular expression '", m_pattern, "'");
+
+        std::pair<int, int> fragment = _build(*root);
+        m_nfa_final = fragment.second;
+        _add_dfa_state(_closure({fragment.first}));
+    }
+
+    int get_initial_state() const {
+        return 0;
+    }
+
+    bool is_accepting(int state) const {
+        return state != DEAD_STATE && m_dfa[state].m_accepting;
+    }
+
+    int next_state(int state, uint8_t byte) {
+        if (state == DEAD_STATE)
+            return DEAD_STATE;
+        int next = m_dfa[state].m_next[byte];
+        if (next != UNKNOWN_STATE)
+            return next;
+
+        std::vector<int> nfa_states;
+        for (int nfa_state : m_dfa[state].m_nfa_states) {
+            if (m_nfa[nfa_state].m_next >= 0 && m_nfa[nfa_state].m_bytes[byte])
+                nfa_states.push_back(m_nfa[nfa_state].m_next);
+        }
+        nfa_states = _closure(nfa_states);
+
+        if (nfa_states.empty()) {
+            next = DEAD_STATE;
+        } else {
+            auto dfa_it = m_dfa_ids.find(nfa_states);
+            next = dfa_it != m_dfa_ids.end() ? dfa_it->second : _add_dfa_state(std::move(nfa_states));
+        }
+        m_dfa[state].m_next[byte] = next;
+        return next;
+    }
+
+private:
+    static constexpr int UNKNOWN_STATE = -2;
+    static constexpr size_t INFINITE_REPEAT = std::numeric_limits<size_t>::max();
+    static constexpr size_t MAX_BOUNDED_REPEAT = 1000;
+
+    struct Node {
+        enum class Type { BYTES, CONCAT, ALTERNATION, REPEAT };
+        Type m_type;
+        std::bitset<256> m_bytes;
+        std::vector<std::unique_ptr<Node>> m_children;
+        size_t m_min = 0, m_max = 0;
+
+        explicit Node(Type type) : m_type(type) {}
+    };
+
+    // NFA state has at most one byte transition and any number of epsilon transitions
+    struct NFAState {
+        std::bitset<256> m_bytes;
+        int m_next = -1;
+        std::vector<int> m_epsilons;
+    };
+
+    struct DFAState {
+        // sorted epsilon closure of NFA states
+        std::vector<int> m_nfa_states;
+        bool m_accepting = false;
+        std::array<int, 256> m_next;
+    };
+
+    std::string m_pattern;
+    size_t m_pos = 0;
+
+    std::vector<NFAState> m_nfa;
+    int m_nfa_final = -1;
+
+    std::vector<DFAState> m_dfa;
+    std::map<std::vector<int>, int> m_dfa_ids;
+
+    // parsing
+
+    static std::unique_ptr<Node> _bytes(const std::bitset<256>& bytes) {
+        std::unique_ptr<Node> node(new Node(Node::Type::BYTES));
+        node->m_bytes = bytes;
+        return node;
+    }
+
+    static std::unique_ptr<Node> _byte_range(uint8_t first, uint8_t last) {
+        std::bitset<256> bytes;
+        for (size_t byte = first; byte <= last; ++byte)
+            bytes.set(byte);
+        return _bytes(bytes);
+    }
+
+    // any UTF-8 encoded non-ASCII character
+    static std::unique_ptr<Node> _any_multibyte_char() {
+        std::unique_ptr<Node> alternation(new Node(Node::Type::ALTERNATION));
+        const uint8_t leading_bytes[3][2] = {{0xC2, 0xDF}, {0xE0, 0xEF}, {0xF0, 0xF4}};
+        for (size_t num_continuation_bytes = 1; num_continuation_bytes <= 3; ++num_continuation_bytes) {
+            std::unique_ptr<Node> sequence(new Node(Node::Type::CONCAT));
+            sequence->m_children.push_back(_byte_range(leading_bytes[num_continuation_bytes - 1][0], leading_bytes[num_continuation_bytes - 1][1]));
+            for (size_t i = 0; i < num_continuation_bytes; ++i)
+                sequence->m_children.push_back(_byte_range(0x80, 0xBF));
+            alternation->m_children.push_back(std::move(sequence));
+        }
+        return alternation;
+    }
+
+    // either one of ASCII bytes or any non-ASCII character
+    static std::unique_ptr<Node> _with_multibyte_chars(const std::bitset<256>& ascii_bytes) {
+        std::unique_ptr<Node> alternation(new Node(Node::Type::ALTERNATION));
+        alternation->m_children.push_back(_bytes(ascii_bytes));
+        alternation->m_children.push_back(_any_multibyte_char());
+        return alternation;
+    }
+
+    static std::bitset<256> _ascii_complement(const std::bitset<256>& bytes) {
+        std::bitset<256> complement;
+        for (size_t byte = 0; byte < 128; ++byte)
+            complement[byte] = !bytes[byte];
+        return complement;
+    }
+
+    bool _at_end() const {
+        return m_pos >= m_pattern.size();
+    }
+
+    char _peek() const {
+        return m_pattern[m_pos];
+    }
+
+    void _expect(char c) {
+        OPENVINO_ASSERT(!_at_end() && _peek() == c, "Expected '", c, "' at position ", m_pos, " of regular expression '", m_pattern, "'");
+        ++m_pos;
+    }
+
+    std::unique_ptr<Node> _parse_alternation() {
+        std::unique_ptr<Node> alternation(new Node(Node::Type::ALTERNATION));
+        alternation->m_children.push_back(_parse_concat());
+        while (!_at_end() && _peek() == '|') {
+            ++m_pos;
+            alternation->m_children.push_back(_parse_concat());
+        }
+        if (alternation->m_children.size() == 1)
+            return std::move(alternation->m_children.front());
+        return alternation;
+    }
+
+    std::unique_ptr<Node> _parse_concat() {
+        std::unique_ptr<Node> concat(new Node(Node::Type::CONCAT));
+        while (!_at_end() && _peek() != '|' && _peek() != ')') {
+            concat->m_children.push_back(_parse_repeat());
+        }
+        return concat;
+    }
+
+    size_t _parse_number() {
+        size_t start = m_pos, value = 0;
+        while (!_at_end() && _peek() >= '0' && _peek() <= '9') {
+            value = value * 10 + (_peek() - '0');
+            ++m_pos;
+        }
+        OPENVINO_ASSERT(m_pos > start, "Expected a number at position ", start, " of regular expression '", m_pattern, "'");
+        return value;
+    }
+
+    std::unique_ptr<Node> _parse_repeat() {
+        std::unique_ptr<Node> atom = _parse_atom();
+        while (!_at_end()) {
+            size_t min = 0, max = 0;
+            char c = _peek();
+            if (c == '*') {
+                min = 0, max = INFINITE_REPEAT;
+                ++m_pos;
+            } else if (c == '+') {
+                min = 1, max = INFINITE_REPEAT;
+                ++m_pos;
+            } else if (c == '?') {
+                min = 0, max = 1;
+                ++m_pos;
+            } else if (c == '{') {
+                ++m_pos;
+                min = max = _parse_number();
+                if (!_at_end() && _peek() == ',') {
+                    ++m_pos;
+                    max = !_at_end() && _peek() == '}' ? INFINITE_REPEAT : _parse_number();
+                }
+                _expect('}');
+                OPENVINO_ASSERT(min <= max, "Invalid quantifier in regular expression '", m_pattern, "'");
+                OPENVINO_ASSERT(max == INFINITE_REPEAT || max <= MAX_BOUNDED_REPEAT,
+                    "Quantifier bound exceeds 1000 in regular expression '", m_pattern, "'");
+            } else {
+                break;
+            }
+            std::unique_ptr<Node> repeat(new Node(Node::Type::REPEAT));
+            repeat->m_min = min;
+            repeat->m_max = max;
+            repeat->m_children.push_back(std::move(atom));
+            atom = std::move(repeat);
+        }
+        return atom;
+    }
+
+    // parses escape sequence after '\'; returns ASCII bytes and whether non-ASCII characters are also matched
+    std::bitset<256> _parse_escape(bool& matches_multibyte_chars) {
+        OPENVINO_ASSERT(!_at_end(), "Unterminated escape sequence in regular expression '", m_pattern, "'");
+        char c = m_pattern[m_pos++];
+        std::bitset<256> bytes;
+        matches_multibyte_chars = false;
+        switch (c) {
+        case 'd': case 'D':
+            for (char digit = '0'; digit <= '9'; ++digit)
+                bytes.set(static_cast<uint8_t>(digit));
+            break;
+        case 'w': case 'W':
+            for (size_t byte = 0; byte < 128; ++byte)
+                bytes[byte] = std::isalnum(static_cast<int>(byte)) || byte == '_';
+            break;
+        case 's': case 'S':
+            for (char space : {' ', '\t', '\n', '\r', '\f', '\v'})
+                bytes.set(static_cast<uint8_t>(space));
+            break;
+        case 'n': bytes.set('\n'); return bytes;
+        case 't': bytes.set('\t'); return bytes;
+        case 'r': bytes.set('\r'); return bytes;
+        case 'f': bytes.set('\f'); return bytes;
+        case 'v': bytes.set('\v'); return bytes;
+        default:
+            bytes.set(static_cast<uint8_t>(c));
+            return bytes;
+        }
+        if (std::isupper(static_cast<unsigned char>(c))) {
+            matches_multibyte_chars = true;
+            return _ascii_complement(bytes);
+        }
+        return bytes;
+    }
+
+    // UTF-8 encoded character starting at current position
+    std::unique_ptr<Node> _parse_literal() {
+        uint8_t leading_byte = static_cast<uint8_t>(m_pattern[m_pos++]);
+        std::bitset<256> bytes;
+        bytes.set(leading_byte);
+        if (leading_byte < 0x80)
+            return _bytes(bytes);
+
+        std::unique_ptr<Node> sequence(new Node(Node::Type::CONCAT));
+        sequence->m_children.push_back(_bytes(bytes));
+        while (!_at_end() && (static_cast<uint8_t>(_peek()) & 0xC0) == 0x80) {
+            std::bitset<256> continuation_byte;
+            continuation_byte.set(static_cast<uint8_t>(m_pattern[m_pos++]));
+            sequence->m_children.push_back(_bytes(continuation_byte));
+        }
+        return sequence;
+    }
+
+    std::unique_ptr<Node> _parse_class() {
+        bool negated = false;
+        if (!_at_end() && _peek() == '^') {
+            negated = true;
+            ++m_pos;
+        }
+        std::bitset<256> bytes;
+        bool matches_multibyte_chars = false;
+        std::vector<std::unique_ptr<Node>> multibyte_chars;
+        bool first = true;
+        while (!_at_end() && (_peek() != ']' || first)) {
+            first = false;
+            if (_peek() == '\\') {
+                ++m_pos;
+                bool escape_matches_multibyte_chars = false;
+                bytes |= _parse_escape(escape_matches_multibyte_chars);
+                matches_multibyte_chars |= escape_matches_multibyte_chars;
+                continue;
+            }
+            if (static_cast<uint8_t>(_peek()) >= 0x80) {
+                multibyte_chars.push_back(_parse_literal());
+                continue;
+            }
+            uint8_t first_byte = static_cast<uint8_t>(m_pattern[m_pos++]);
+            if (m_pos + 1 < m_pattern.size() && _peek() == '-' && m_pattern[m_pos + 1] != ']') {
+                uint8_t last_byte = static_cast<uint8_t>(m_pattern[m_pos + 1]);
+                OPENVINO_ASSERT(first_byte <= last_byte && last_byte < 0x80, "Invalid range in regular expression '", m_pattern, "'");
+                for (size_t byte = first_byte; byte <= last_byte; ++byte)
+                    bytes.set(byte);
+                m_pos += 2;
+            } else {
+                bytes.set(first_byte);
+            }
+        }
+        _expect(']');
+
+        if (negated)
+            return _with_multibyte_chars(_ascii_complement(bytes));
+        if (matches_multibyte_chars)
+            return _with_multibyte_chars(bytes);
+
+        std::unique_ptr<Node> alternation(new Node(Node::Type::ALTERNATION));
+        alternation->m_children.push_back(_bytes(bytes));
+        for (auto& multibyte_char : multibyte_chars)
+            alternation->m_children.push_back(std::move(multibyte_char));
+        return alternation;
+    }
+
+    std::unique_ptr<Node> _parse_atom() {
+        char c = _peek();
+        OPENVINO_ASSERT(c != '*' && c != '+' && c != '?' && c != '{',
+            "Quantifier without operand at position ", m_pos, " of regular expression '", m_pattern, "'");
+        ++m_pos;
+        switch (c) {
+        case '(': {
+            if (m_pattern.compare(m_pos, 2, "?:") == 0)
+                m_pos += 2;
+            std::unique_ptr<Node> group = _parse_alternation();
+            _expect(')');
+            return group;
+        }
+        case '[':
+            return _parse_class();
+        case '.': {
+            std::bitset<256> bytes;
+            bytes.set('\n');
+            return _with_multibyte_chars(_ascii_complement(bytes));
+        }
+        case '\\': {
+            bool matches_multibyte_chars = false;
+            std::bitset<256> bytes = _parse_escape(matches_multibyte_chars);
+            return matches_multibyte_chars ? _with_multibyte_chars(bytes) : _bytes(bytes);
+        }
+        case '^': case '$':
+            // the whole text is matched anyway
+            return std::unique_ptr<Node>(new Node(Node::Type::CONCAT));
+        default:
+            --m_pos;
+            return _parse_literal();
+        }
+    }
+
+    // NFA construction
+
+    int _add_nfa_state() {
+        m_nfa.emplace_back();
+        return static_cast<int>(m_nfa.size()) - 1;
+    }
+
+    // returns start and end states of NFA fragment
+    std::pair<int, int> _build(const Node& node) {
+        int start = _add_nfa_state(), end = start;
+        switch (node.m_type) {
+        case Node::Type::BYTES:
+            end = _add_nfa_state();
+            m_nfa[start].m_bytes = node.m_bytes;
+            m_nfa[start].m_next = end;
+            break;
+        case Node::Type::CONCAT:
+            for (const auto& child : node.m_children) {
+                std::pair<int, int> fragment = _build(*child);
+                m_nfa[end].m_epsilons.push_back(fragment.first);
+                end = fragment.second;
+            }
+            break;
+        case Node::Type::ALTERNATION:
+            end = _add_nfa_state();
+            for (const auto& child : node.m_children) {
+                std::pair<int, int> fragment = _build(*child);
+                m_nfa[start].m_epsilons.push_back(fragment.first);
+                m_nfa[fragment.second].m_epsilons.push_back(end);
+            }
+            break;
+        case Node::Type::REPEAT: {
+            const Node& child = *node.m_children.front();
+            for (size_t i = 0; i < node.m_min; ++i) {
+                std::pair<int, int> fragment = _build(child);
+                m_nfa[end].m_epsilons.push_back(fragment.first);
+                end = fragment.second;
+            }
+            if (node.m_max == INFINITE_REPEAT) {
+                std::pair<int, int> fragment = _build(child);
+                m_nfa[end].m_epsilons.push_back(fragment.first);
+                m_nfa[fragment.second].m_epsilons.push_back(end);
+            } else {
+                int optional_end = _add_nfa_state();
+                for (size_t i = node.m_min; i < node.m_max; ++i) {
+                    std::pair<int, int> fragment = _build(child);
+                    m_nfa[end].m_epsilons.push_back(fragment.first);
+                    m_nfa[end].m_epsilons.push_back(optional_end);
+                    end = fragment.second;
+                }
+                m_nfa[end].m_epsilons.push_back(optional_end);
+                end = optional_end;
+            }
+            break;
+        }
+        }
+        return {start, end};
+    }
+
+    // determinization
+
+    std::vector<int> _closure(const std::vector<int>& nfa_states) const {
+        std::vector<bool> visited(m_nfa.size(), false);
+        std::vector<int> stack(nfa_states), closure;
+        while (!stack.empty()) {
+            int nfa_state = stack.back();
+            stack.pop_back();
+            if (visited[nfa_state])
+                continue;
+            visited[nfa_state] = true;
+            // states with epsilon transitions only don't affect DFA transitions and acceptance
+            if (m_nfa[nfa_state].m_next >= 0 || nfa_state == m_nfa_final)
+                closure.push_back(nfa_state);
+            for (int epsilon : m_nfa[nfa_state].m_epsilons)
+                stack.push_back(epsilon);
+        }
+        std::sort(closure.begin(), closure.end());
+        return closure;
+    }
+
+    int _add_dfa_state(std::vector<int> nfa_states) {
+        DFAState dfa_state;
+        dfa_state.m_accepting = std::binary_search(nfa_states.begin(), nfa_states.end(), m_nfa_final);
+        dfa_state.m_next.fill(int(UNKNOWN_STATE));
+        dfa_state.m_nfa_states = nfa_states;
+        m_dfa.push_back(std::move(dfa_state));
+        int id = static_cast<int>(m_dfa.size()) - 1;
+        m_dfa_ids[std::move(nfa_states)] = id;
+        return id;
+    }
+};
+
+// Token level automaton of constrained generation: text of generated tokens must match regular expression.
+// For each state a bitmask of allowed tokens over the vocabulary is computed once with a single trie traversal,
+// so logits processing costs O(vocab_size / 64) per step; compiled constraints are shared between requests
+class TokenConstraint {
+    RegexAutomaton m_automaton;
+    TokenVocabulary::Ptr m_vocabulary;
+    // automaton state => allowed tokens bitmask; std::map keeps references valid on insertion
+    std::map<int, std::vector<uint64_t>> m_allowed_tokens;
+    // constraint is used by requests sampled in parallel, while automaton is built lazily
+    std::mutex m_mutex;
+
+    const std::vector<uint64_t>& _compute_allowed_tokens(int state) {
+        std::vector<uint64_t> allowed_tokens((m_vocabulary->size() + 63) / 64, 0);
+        std::vector<std::pair<size_t, int>> stack{{0, state}};
+        while (!stack.empty()) {
+            const TokenVocabulary::Node& node = m_vocabulary->get_node(stack.back().first);
+            int node_state = stack.back().second;
+            stack.pop_back();
+            for (const auto& child : node.m_children) {
+                int child_state = m_automaton.next_state(node_state, child.first);
+                if (child_state == RegexAutomaton::DEAD_STATE)
+                    continue;
+                for (int64_t token_id : m_vocabulary->get_node(child.second).m_token_ids)
+                    allowed_tokens[token_id / 64] |= uint64_t(1) << (token_id % 64);
+                stack.emplace_back(child.second, child_state);
+            }
+        }
+        return m_allowed_tokens.emplace(state, std::move(allowed_tokens)).first->second;
+    }
+
+public:
+    using Ptr = std::shared_ptr<TokenConstraint>;
+
+    // index of the lowest set bit of non-zero mask word
+    static size_t lowest_bit_index(uint64_t word) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return index;
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    TokenConstraint(const std::string& pattern, const TokenVocabulary::Ptr& vocabulary) :
+        m_automaton(pattern),
+        m_vocabulary(vocabulary) {
+    }
+
+    int get_initial_state() const {
+        return m_automaton.get_initial_state();
+    }
+
+    // bit 'token_id % 64' of word 'token_id / 64' is set if text of the token can continue text matched in 'state'
+    const std::vector<uint64_t>& get_allowed_tokens(int state) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto allowed_tokens_it = m_allowed_tokens.find(state);
+        return allowed_tokens_it != m_allowed_tokens.end() ? allowed_tokens_it->second : _compute_allowed_tokens(state);
+    }
+
+    // whether text matched in 'state' matches the whole pattern
+    bool is_accepting(int state) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_automaton.is_accepting(state);
+    }
+
+    // tokens without text (e.g. EOS) don't change the state
+    int next_state(int state, int64_t token_id) {
+        if (token_id < 0 || token_id >= static_cast<int64_t>(m_vocabulary->size()))
+            return state;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (char c : m_vocabulary->get_text(token_id))
+            state = m_automaton.next_state(state, static_cast<uint8_t>(c));
+        return state;
+    }
+};
@@ -2,10 +2,12 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <future>
 #include <mutex>
 #include "openvino/runtime/core.hpp"
 
 #include "tokenizer.hpp"
+#include "tokenization_cache.hpp"
 
 class Tokenizer::Impl {
     const size_t TOKENIZER_BATCH_SIZE = 1;
@@ -15,6 +17,10 @@ class Tokenizer::Impl {
     //Using multiple infer requests hangs. For now we synchronize entire execution on a single infer request.
     std::mutex m_tokenizer_mutex;
     std::mutex m_detokenizer_mutex;
+    TokenizationCache m_cache;
+    // set, if tokenizer wraps another one instead of own models
+    std::function<ov::Tensor(const std::string&)> m_encode;
+    std::function<std::vector<std::string>(std::vector<std::vector<int64_t>>)> m_decode;
 
 public:
     explicit Impl(const std::string& models_path)
@@ -27,30 +33,77 @@ public:
         OPENVINO_ASSERT(rt_info.find("eos_token_id") != rt_info.end(), "Failed to detect \"eos_token_id\" in openvino_tokenizer.xml runtime information");
         m_eos_token_id = rt_info.at("eos_token_id").as<int64_t>();
 
-        // tokenizer and detokenizer work on CPU only
+        // tokenizer and detokenizer work on CPU only, they are independent and compiled concurrently
+        auto detokenizer = std::async(std::launch::async, [&core, &models_path] {
+            return core.compile_model(models_path + "/openvino_detokenizer.xml", "CPU").create_infer_request();
+        });
         m_tokenizer = core.compile_model(
             tokenizer_model, "CPU").create_infer_request();
-        m_detokenizer = core.compile_model(
-            models_path + "/openvino_detokenizer.xml", "CPU").create_infer_request();
+        m_detokenizer = detokenizer.get();
+    }
+
+    Impl(std::function<ov::Tensor(const std::string&)> encode,
+         std::function<std::vector<std::string>(std::vector<std::vector<int64_t>>)> decode,
+         size_t eos_token_id) :
+        m_eos_token_id(eos_token_id),
+        m_encode(std::move(encode)),
+        m_decode(std::move(decode)) {
     }
 
     ov::Tensor encode(std::string prompt) {
+        ov::Tensor output_tensor;
+        if (m_cache.get(prompt, output_tensor))
+            return output_tensor;
+
+        if (m_encode) {
+            output_tensor = m_encode(prompt);
+            m_cache.put(prompt, output_tensor);
+            return output_tensor;
+        }
+
         std::unique_lock<std::mutex> lock(m_tokenizer_mutex);
         m_tokenizer.set_input_tensor(ov::Tensor{ov::element::string, {TOKENIZER_BATCH_SIZE}, &prompt});
         m_tokenizer.infer();
         ov::Tensor tmp_tensor = m_tokenizer.get_tensor("input_ids");
-        ov::Tensor output_tensor(tmp_tensor.get_element_type(), tmp_tensor.get_shape());
+        output_tensor = ov::Tensor(tmp_tensor.get_element_type(), tmp_tensor.get_shape());
         tmp_tensor.copy_to(output_tensor);
+        lock.unlock();
+
+        m_cache.put(prompt, output_tensor);
         return output_tensor;
     }
 
+    void set_cache_capacity(size_t capacity_bytes) {
+        m_cache.set_capacity(capacity_bytes);
+    }
+
     std::string decode(std::vector<int64_t> tokens) {
+        if (m_decode)
+            return m_decode({std::move(tokens)}).at(0);
+
         std::unique_lock<std::mutex> lock(m_detokenizer_mutex);
         m_detokenizer.set_input_tensor(ov::Tensor{ov::element::i64, {TOKENIZER_BATCH_SIZE, tokens.size()}, tokens.data()});
         m_detokenizer.infer();
         return m_detokenizer.get_output_tensor().data<std::string>()[0];
     }
 
+    std::vector<std::string> decode_tokens(std::vector<int64_t> tokens) {
+        if (m_decode) {
+            std::vector<std::vector<int64_t>> sequences;
+            sequences.reserve(tokens.size());
+            for (int64_t token : tokens)
+                sequences.push_back({token});
+            return m_decode(std::move(sequences));
+        }
+
+        std::unique_lock<std::mutex> lock(m_detokenizer_mutex);
+        // each token is a separate sequence of a single batch
+        m_detokenizer.set_input_tensor(ov::Tensor{ov::element::i64, {tokens.size(), 1}, tokens.data()});
+        m_detokenizer.infer();
+        const std::string* texts = m_detokenizer.get_output_tensor().data<std::string>();
+        return std::vector<std::string>(texts, texts + tokens.size());
+    }
+
     size_t get_eos_token_id() const {
         return m_eos_token_id;
     }
@@ -60,14 +113,28 @@ Tokenizer::Tokenizer(const std::string& models_path) {
     m_impl = std::make_shared<Impl>(models_path);
 }
 
+Tokenizer::Tokenizer(std::function<ov::Tensor(const std::string&)> encode,
+                     std::function<std::vector<std::string>(std::vector<std::vector<int64_t>>)> decode,
+                     size_t eos_token_id) {
+    m_impl = std::make_shared<Impl>(std::move(encode), std::move(decode), eos_token_id);
+}
+
 ov::Tensor Tokenizer::encode(std::string prompt) {
     return m_impl->encode(prompt);
 }
 
+void Tokenizer::set_cache_capacity(size_t capacity_bytes) {
+    m_impl->set_cache_capacity(capacity_bytes);
+}
+
 std::string Tokenizer::decode(std::vector<int64_t> tokens) {
     return m_impl->decode(tokens);
 }
 
+std::vector<std::string> Tokenizer::decode_tokens(std::vector<int64_t> tokens) {
+    return m_impl->decode_tokens(tokens);
+}
+
 size_t Tokenizer::get_eos_token_id() const {
     return m_impl->get_eos_token_id();
 }
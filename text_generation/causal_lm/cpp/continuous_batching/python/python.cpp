@@ -3,6 +3,7 @@
 //
 
 #include "pybind11/pybind11.h"
+#include <pybind11/chrono.h>
 #include <pybind11/stl.h>
 
 #include "continuous_batching_pipeline.hpp"
@@ -21,7 +22,92 @@ std::ostream& operator << (std::ostream& stream, const GenerationResult& generat
     return stream << std::endl;
 }
 
+namespace {
+
+// completes 'future' of asyncio by outputs of the next iteration or by StopAsyncIteration once generation is over;
+// returns false, if there are no outputs yet; requires GIL
+bool try_complete_future(GenerationHandleImpl& handle, py::object& future) {
+    if (future.attr("done")().cast<bool>()) {
+        // cancelled by the caller
+        return true;
+    }
+    // final outputs are pushed before status is changed
+    GenerationStatus status = handle.get_status();
+    GenerationOutputs outputs;
+    if (handle.try_read(outputs)) {
+        future.attr("set_result")(outputs);
+    } else if (status != GenerationStatus::RUNNING) {
+        future.attr("set_exception")(py::handle(PyExc_StopAsyncIteration));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// the last reference to Python objects captured by output callback of a handle can be released
+// by the thread running pipeline steps, which does not hold GIL
+std::shared_ptr<py::object> make_gil_safe(py::object object) {
+    return std::shared_ptr<py::object>(new py::object(std::move(object)), [] (py::object* object) {
+        py::gil_scoped_acquire acquire;
+        delete object;
+    });
+}
+
+// destructor of a serving pipeline joins the serving thread, whose callbacks acquire GIL, so it must run without GIL
+struct GilReleasingDelete {
+    void operator()(ContinuousBatchingPipeline* pipe) const {
+        py::gil_scoped_release release;
+        delete pipe;
+    }
+};
+
+// awaitable of the next outputs of 'py_handle', which is woken up by the pipeline thread instead of polling
+py::object read_next_async(py::object py_handle) {
+    GenerationHandleImpl& handle = py_handle.cast<GenerationHandleImpl&>();
+    py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+    py::object future = loop.attr("create_future")();
+    if (try_complete_future(handle, future))
+        return future;
+
+    // runs on the event loop, so handle and future are accessed by a single thread; the callback owns the handle
+    // until a future is completed, so outputs of a dropped Python handle are never read
+    auto wake_up = make_gil_safe(py::cpp_function([py_handle, future] () mutable {
+        GenerationHandleImpl& handle = py_handle.cast<GenerationHandleImpl&>();
+        if (try_complete_future(handle, future))
+            handle.set_output_callback(nullptr);
+    }));
+    auto call_soon_threadsafe = make_gil_safe(loop.attr("call_soon_threadsafe"));
+    handle.set_output_callback([wake_up, call_soon_threadsafe] () {
+        py::gil_scoped_acquire acquire;
+        try {
+            (*call_soon_threadsafe)(*wake_up);
+        } catch (py::error_already_set& error) {
+            // event loop is closed, so nobody awaits the outputs
+            error.discard_as_unraisable("GenerationHandle output callback");
+        }
+    });
+
+    // outputs could be pushed before the callback is set
+    if (try_complete_future(handle, future))
+        handle.set_output_callback(nullptr);
+    return future;
+}
+
+}  // namespace
+
 PYBIND11_MODULE(py_continuous_batching, m) {
+    // steady clock time points are converted to datetime.timedelta, so only their differences are meaningful
+    py::class_<RequestMetrics>(m, "RequestMetrics")
+        .def(py::init<>())
+        .def_readonly("enqueued_time", &RequestMetrics::enqueued_time)
+        .def_readonly("first_scheduled_time", &RequestMetrics::first_scheduled_time)
+        .def_readonly("first_token_time", &RequestMetrics::first_token_time)
+        .def_readonly("finished_time", &RequestMetrics::finished_time)
+        .def_readonly("num_preemptions", &RequestMetrics::num_preemptions)
+        .def_readonly("num_recomputed_tokens", &RequestMetrics::num_recomputed_tokens)
+        .def_readonly("num_cached_prompt_tokens", &RequestMetrics::num_cached_prompt_tokens)
+        .def_readonly("num_imported_prompt_tokens", &RequestMetrics::num_imported_prompt_tokens);
+
     py::class_<GenerationResult>(m, "GenerationResult")
         .def(py::init<>())
         .def_readonly("m_request_id", &GenerationResult::m_request_id)
@@ -39,6 +125,7 @@ PYBIND11_MODULE(py_continuous_batching, m) {
                 r.m_generation_ids = generation_ids;
             })
         .def_readwrite("m_scores", &GenerationResult::m_scores)
+        .def_readonly("m_metrics", &GenerationResult::m_metrics)
         .def("__repr__",
             [](const GenerationResult &r) -> py::str{
                 std::stringstream stream;
@@ -58,6 +145,65 @@ PYBIND11_MODULE(py_continuous_batching, m) {
             return res;
         });
 
+    py::enum_<GenerationStatus>(m, "GenerationStatus")
+        .value("RUNNING", GenerationStatus::RUNNING)
+        .value("FINISHED", GenerationStatus::FINISHED)
+        .value("IGNORED", GenerationStatus::IGNORED)
+        .value("DROPPED_BY_PIPELINE", GenerationStatus::DROPPED_BY_PIPELINE)
+        .value("DROPPED_BY_HANDLE", GenerationStatus::DROPPED_BY_HANDLE)
+        .export_values();
+
+    // exported KV cache exposes its serialized buffer via buffer protocol, so memoryview(blob) is sent without copies;
+    // received bytes are copied once into the blob
+    py::class_<KVCacheBlob, std::shared_ptr<KVCacheBlob>>(m, "KVCacheBlob", py::buffer_protocol())
+        .def(py::init([](const py::bytes& buffer) {
+            char* data = nullptr;
+            Py_ssize_t size = 0;
+            if (PyBytes_AsStringAndSize(buffer.ptr(), &data, &size) != 0)
+                throw py::error_already_set();
+            const uint8_t* begin = reinterpret_cast<const uint8_t*>(data);
+            return std::make_shared<KVCacheBlob>(std::vector<uint8_t>(begin, begin + size));
+        }))
+        .def_buffer([](KVCacheBlob& blob) {
+            return py::buffer_info(const_cast<uint8_t*>(blob.data()), blob.size(), true);
+        })
+        .def_property_readonly("prompt_ids", &KVCacheBlob::get_prompt_ids)
+        .def_property_readonly("num_kv_tokens", &KVCacheBlob::get_num_kv_tokens)
+        .def_property_readonly("num_blocks", &KVCacheBlob::get_num_blocks);
+
+    py::class_<GenerationOutput>(m, "GenerationOutput")
+        .def(py::init<>())
+        .def_readonly("generated_token_ids", &GenerationOutput::generated_token_ids)
+        .def_readonly("score", &GenerationOutput::score)
+        .def_readonly("log_probs", &GenerationOutput::log_probs)
+        .def_property_readonly("kv_cache", [](const GenerationOutput& output) {
+            return std::const_pointer_cast<KVCacheBlob>(output.kv_cache);
+        });
+
+    // outputs of a request are read as {sequence id: GenerationOutput} per iteration; blocking reads release GIL, so
+    // other Python threads run while the pipeline is generating; in asyncio code use "async for outputs in handle"
+    py::class_<GenerationHandleImpl>(m, "GenerationHandle")
+        .def("get_status", &GenerationHandleImpl::get_status)
+        .def("get_metrics", &GenerationHandleImpl::get_metrics)
+        .def("can_read", &GenerationHandleImpl::can_read)
+        .def("read", py::overload_cast<>(&GenerationHandleImpl::read), py::call_guard<py::gil_scoped_release>())
+        .def("read_available", &GenerationHandleImpl::read_available)
+        .def("read_all", &GenerationHandleImpl::read_all, py::call_guard<py::gil_scoped_release>())
+        .def("__iter__", [](py::object self) { return self; })
+        .def("__next__", [](GenerationHandleImpl& handle) {
+            GenerationOutputs outputs;
+            bool has_outputs;
+            {
+                py::gil_scoped_release release;
+                has_outputs = handle.read(outputs);
+            }
+            if (!has_outputs)
+                throw py::stop_iteration();
+            return outputs;
+        })
+        .def("__aiter__", [](py::object self) { return self; })
+        .def("__anext__", &read_next_async);
+
     py::enum_<StopCriteria>(m, "StopCriteria")
         .value("EARLY", StopCriteria::EARLY)
         .value("HEURISTIC", StopCriteria::HEURISTIC)
@@ -70,6 +216,8 @@ PYBIND11_MODULE(py_continuous_batching, m) {
         .def_readwrite("min_new_tokens", &GenerationConfig::min_new_tokens)
         .def_readwrite("max_length", &GenerationConfig::max_length)
         .def_readwrite("ignore_eos", &GenerationConfig::ignore_eos)
+        .def_readwrite("stop_token_ids", &GenerationConfig::stop_token_ids)
+        .def_readwrite("stop_strings", &GenerationConfig::stop_strings)
         .def_readwrite("num_groups", &GenerationConfig::num_groups)
         .def_readwrite("group_size", &GenerationConfig::group_size)
         .def_readwrite("diversity_penalty", &GenerationConfig::diversity_penalty)
@@ -85,9 +233,25 @@ PYBIND11_MODULE(py_continuous_batching, m) {
         .def_readwrite("top_p", &GenerationConfig::top_p)
         .def_readwrite("do_sample", &GenerationConfig::do_sample)
         .def_readwrite("rng_seed", &GenerationConfig::rng_seed)
+        .def_readwrite("prompt_lookup_num_tokens", &GenerationConfig::prompt_lookup_num_tokens)
+        .def_readwrite("max_ngram_size", &GenerationConfig::max_ngram_size)
+        .def_readwrite("priority", &GenerationConfig::priority)
+        .def_readwrite("deadline_ms", &GenerationConfig::deadline_ms)
+        .def_readwrite("tenant_id", &GenerationConfig::tenant_id)
+        .def_readwrite("lora_adapter_id", &GenerationConfig::lora_adapter_id)
+        .def_readwrite("regex_constraint", &GenerationConfig::regex_constraint)
+        .def_readwrite("num_scored_tokens", &GenerationConfig::num_scored_tokens)
+        .def_readwrite("export_kv_cache", &GenerationConfig::export_kv_cache)
+        .def_property_readonly("is_scoring", &GenerationConfig::is_scoring)
         .def_property_readonly("is_greedy_sampling", &GenerationConfig::is_greedy_sampling)
         .def_property_readonly("is_beam_search", &GenerationConfig::is_beam_search);
 
+    py::class_<TenantConfig>(m, "TenantConfig")
+        .def(py::init<>())
+        .def_readwrite("weight", &TenantConfig::weight)
+        .def_readwrite("max_num_batched_tokens", &TenantConfig::max_num_batched_tokens)
+        .def_readwrite("max_num_kv_blocks", &TenantConfig::max_num_kv_blocks);
+
     py::class_<SchedulerConfig>(m, "SchedulerConfig")
         .def(py::init<>())
         .def_readwrite("max_num_batched_tokens", &SchedulerConfig::max_num_batched_tokens)
@@ -95,21 +259,57 @@ PYBIND11_MODULE(py_continuous_batching, m) {
         .def_readwrite("cache_size", &SchedulerConfig::cache_size)
         .def_readwrite("block_size", &SchedulerConfig::block_size)
         .def_readwrite("cache_size", &SchedulerConfig::cache_size)
+        .def_readwrite("kv_cache_memory_fraction", &SchedulerConfig::kv_cache_memory_fraction)
         .def_readwrite("dynamic_split_fuse", &SchedulerConfig::dynamic_split_fuse)
-        .def_readwrite("max_num_seqs", &SchedulerConfig::max_num_seqs);
+        .def_readwrite("num_swap_blocks", &SchedulerConfig::num_swap_blocks)
+        .def_readwrite("swap_min_context_len", &SchedulerConfig::swap_min_context_len)
+        .def_readwrite("max_num_seqs", &SchedulerConfig::max_num_seqs)
+        .def_readwrite("enable_async_execution", &SchedulerConfig::enable_async_execution)
+        .def_readwrite("num_decode_steps", &SchedulerConfig::num_decode_steps)
+        .def_readwrite("enable_prefix_caching", &SchedulerConfig::enable_prefix_caching)
+        .def_readwrite("enable_prefix_grouping", &SchedulerConfig::enable_prefix_grouping)
+        .def_readwrite("session_cache_dir", &SchedulerConfig::session_cache_dir)
+        .def_readwrite("session_cache_size", &SchedulerConfig::session_cache_size)
+        .def_readwrite("token_constraint_cache_size", &SchedulerConfig::token_constraint_cache_size)
+        .def_readwrite("num_speculative_tokens", &SchedulerConfig::num_speculative_tokens)
+        .def_readwrite("min_prefill_chunk_size", &SchedulerConfig::min_prefill_chunk_size)
+        .def_readwrite("max_prefill_fraction", &SchedulerConfig::max_prefill_fraction)
+        .def_readwrite("num_kv_blocks_per_chunk", &SchedulerConfig::num_kv_blocks_per_chunk)
+        .def_readwrite("release_idle_kv_cache", &SchedulerConfig::release_idle_kv_cache)
+        .def_readwrite("kv_window_blocks", &SchedulerConfig::kv_window_blocks)
+        .def_readwrite("num_sink_blocks", &SchedulerConfig::num_sink_blocks)
+        .def_readwrite("enable_numa_workers", &SchedulerConfig::enable_numa_workers)
+        .def_readwrite("max_num_lora_adapters", &SchedulerConfig::max_num_lora_adapters)
+        .def_readwrite("max_lora_rank", &SchedulerConfig::max_lora_rank)
+        .def_readwrite("enable_fair_share", &SchedulerConfig::enable_fair_share)
+        .def_readwrite("tenants", &SchedulerConfig::tenants);
 
-    py::class_<ContinuousBatchingPipeline>(m, "ContinuousBatchingPipeline")
-        .def(py::init<const std::string &, const SchedulerConfig&>())
+    // methods running inference or waiting for it release GIL; Python callbacks must acquire it back
+    py::class_<ContinuousBatchingPipeline, std::unique_ptr<ContinuousBatchingPipeline, GilReleasingDelete>>(m, "ContinuousBatchingPipeline")
+        .def(py::init<const std::string &, const SchedulerConfig&>(), py::call_guard<py::gil_scoped_release>())
+        .def(py::init<const std::string &, const std::string &, const SchedulerConfig&>(), py::call_guard<py::gil_scoped_release>())
+        .def("create_replica", &ContinuousBatchingPipeline::create_replica, py::call_guard<py::gil_scoped_release>())
         .def("get_tokenizer", &ContinuousBatchingPipeline::get_tokenizer)
         .def("get_config", &ContinuousBatchingPipeline::get_config)
-        .def("add_request", &ContinuousBatchingPipeline::add_request)
-        .def("step", &ContinuousBatchingPipeline::step)
-        .def("has_non_finished_requests", &ContinuousBatchingPipeline::has_non_finished_requests)
-        .def("generate", &ContinuousBatchingPipeline::generate);
+        .def("get_prometheus_metrics", &ContinuousBatchingPipeline::get_prometheus_metrics)
+        .def("add_request", py::overload_cast<uint64_t, std::string, GenerationConfig>(&ContinuousBatchingPipeline::add_request),
+            py::call_guard<py::gil_scoped_release>())
+        .def("add_request", [](ContinuousBatchingPipeline& pipe, uint64_t request_id, std::shared_ptr<KVCacheBlob> kv_cache, GenerationConfig sampling_params) {
+                return pipe.add_request(request_id, std::move(kv_cache), sampling_params);
+            }, py::call_guard<py::gil_scoped_release>())
+        .def("step", &ContinuousBatchingPipeline::step, py::call_guard<py::gil_scoped_release>())
+        .def("has_non_finished_requests", &ContinuousBatchingPipeline::has_non_finished_requests, py::call_guard<py::gil_scoped_release>())
+        .def("start_serving", &ContinuousBatchingPipeline::start_serving)
+        .def("stop_serving", &ContinuousBatchingPipeline::stop_serving, py::call_guard<py::gil_scoped_release>())
+        .def("is_serving", &ContinuousBatchingPipeline::is_serving)
+        .def("add_lora_adapter", &ContinuousBatchingPipeline::add_lora_adapter, py::arg("adapter_id"), py::arg("adapter"), py::arg("alpha") = 1.0f)
+        .def("remove_lora_adapter", &ContinuousBatchingPipeline::remove_lora_adapter)
+        .def("generate", &ContinuousBatchingPipeline::generate, py::call_guard<py::gil_scoped_release>());
 
     py::class_<Tokenizer, std::shared_ptr<Tokenizer>>(m, "Tokenizer")
         .def(py::init<const std::string&>())
         .def("encode", &Tokenizer::encode)
         .def("decode", &Tokenizer::decode)
+        .def("set_cache_capacity", &Tokenizer::set_cache_capacity)
         .def("get_eos_token_id", &Tokenizer::get_eos_token_id);
 }
@@ -1,11 +1,14 @@
 # Copyright (C) 2018-2024 Intel Corporation
 # SPDX-License-Identifier: Apache-2.0
+import asyncio
 import os
 import pytest
 import shutil
+import threading
+import time
 from dataclasses import dataclass
 from pathlib import Path
-from py_continuous_batching import GenerationConfig, ContinuousBatchingPipeline
+from py_continuous_batching import GenerationConfig, ContinuousBatchingPipeline, KVCacheBlob
 from typing import List
 
 from common import run_test_pipeline, get_models_list, get_model_and_tokenizer, save_ov_model_from_optimum, \
@@ -202,4 +205,162 @@ def test_post_oom_health(tmp_path):
     output = pipe.generate(["What is OpenVINO?"], generation_configs)
     assert(len(output))
     del pipe
-    shutil.rmtree(model_path)
\ No newline at end of file
+    shutil.rmtree(model_path)
+
+@pytest.mark.precommit
+def test_streaming_handle_releases_gil(tmp_path):
+    generation_config = get_greedy()
+    generation_config.max_new_tokens = 20
+    model_id : str = "facebook/opt-125m"
+    model, hf_tokenizer = get_model_and_tokenizer(model_id, use_optimum=True)
+
+    model_path : Path = tmp_path / model_id
+    save_ov_model_from_optimum(model, hf_tokenizer, model_path)
+
+    pipe = ContinuousBatchingPipeline(model_path.absolute().as_posix(), get_scheduler_config())
+    pipe.start_serving()
+
+    def read_tokens(outputs_iterable):
+        token_ids = []
+        for outputs in outputs_iterable:
+            token_ids += outputs[0].generated_token_ids
+        return token_ids
+
+    # blocking read releases GIL, so another Python thread keeps running while tokens are generated
+    ticks = 0
+    stop_ticking = threading.Event()
+    def tick():
+        nonlocal ticks
+        while not stop_ticking.is_set():
+            ticks += 1
+            time.sleep(0.001)
+    ticker = threading.Thread(target=tick)
+    ticker.start()
+    sync_token_ids = read_tokens(pipe.add_request(0, "What is OpenVINO?", generation_config))
+    stop_ticking.set()
+    ticker.join()
+    assert ticks > 0
+
+    # event loop is woken up by the pipeline thread
+    async def read_tokens_async():
+        token_ids = []
+        async for outputs in pipe.add_request(1, "What is OpenVINO?", generation_config):
+            token_ids += outputs[0].generated_token_ids
+        return token_ids
+    async_token_ids = asyncio.run(read_tokens_async())
+
+    pipe.stop_serving()
+    assert len(sync_token_ids) > 0
+    assert sync_token_ids == async_token_ids
+    del pipe
+    shutil.rmtree(model_path)
+
+@pytest.mark.precommit
+def test_scoring_matches_hf_log_probs(tmp_path):
+    model_id : str = "facebook/opt-125m"
+    model, hf_tokenizer = get_model_and_tokenizer(model_id, use_optimum=True)
+
+    model_path : Path = tmp_path / model_id
+    save_ov_model_from_optimum(model, hf_tokenizer, model_path)
+
+    prompt = "OpenVINO is a toolkit for optimizing and deploying deep learning models"
+    generation_config = get_greedy()
+    generation_config.num_scored_tokens = 5
+
+    # small chunks split the prompt, so scored tokens are computed on several steps
+    scheduler_config = get_scheduler_config({"max_num_batched_tokens": 8, "dynamic_split_fuse": True, "num_kv_blocks": 60, "max_num_seqs": 256})
+    pipe = ContinuousBatchingPipeline(model_path.absolute().as_posix(), scheduler_config)
+    pipe.start_serving()
+    outputs = [step_outputs[0] for step_outputs in pipe.add_request(0, prompt, generation_config)]
+    pipe.stop_serving()
+    assert len(outputs) == 1
+
+    input_ids = hf_tokenizer(prompt, return_tensors="pt")["input_ids"]
+    log_probs = model(input_ids).logits[0].log_softmax(dim=-1)
+    scored_positions = range(input_ids.shape[1] - 1 - generation_config.num_scored_tokens, input_ids.shape[1] - 1)
+    ref_token_ids = [int(input_ids[0, position + 1]) for position in scored_positions]
+    ref_log_probs = [float(log_probs[position, input_ids[0, position + 1]]) for position in scored_positions]
+
+    assert outputs[0].generated_token_ids == ref_token_ids
+    assert outputs[0].log_probs == pytest.approx(ref_log_probs, abs=1e-2)
+    assert outputs[0].score == pytest.approx(sum(ref_log_probs), abs=5e-2)
+    del pipe
+    shutil.rmtree(model_path)
+
+@pytest.mark.precommit
+def test_kv_cache_export_and_import(tmp_path):
+    model_id : str = "facebook/opt-125m"
+    model, hf_tokenizer = get_model_and_tokenizer(model_id, use_optimum=True)
+
+    model_path : Path = tmp_path / model_id
+    save_ov_model_from_optimum(model, hf_tokenizer, model_path)
+
+    prompt = "OpenVINO is a toolkit for optimizing and deploying deep learning models"
+    generation_config = get_greedy()
+    generation_config.max_new_tokens = 20
+    # prefill and decode pipelines have own KV caches, like on different machines
+    prefill_pipe = ContinuousBatchingPipeline(model_path.absolute().as_posix(), get_scheduler_config())
+    decode_pipe = ContinuousBatchingPipeline(model_path.absolute().as_posix(), get_scheduler_config())
+    decode_pipe.start_serving()
+    ref_token_ids = []
+    for outputs in decode_pipe.add_request(0, prompt, generation_config):
+        ref_token_ids += outputs[0].generated_token_ids
+
+    prefill_pipe.start_serving()
+    export_config = get_greedy()
+    export_config.export_kv_cache = True
+    exported = [outputs[0] for outputs in prefill_pipe.add_request(1, prompt, export_config)]
+    prefill_pipe.stop_serving()
+    assert len(exported) == 1 and exported[0].generated_token_ids == []
+    kv_cache = exported[0].kv_cache
+    assert kv_cache.num_kv_tokens == len(kv_cache.prompt_ids) - 1
+
+    # serialized buffer is sent as is
+    received_kv_cache = KVCacheBlob(bytes(memoryview(kv_cache)))
+    handle = decode_pipe.add_request(2, received_kv_cache, generation_config)
+    token_ids = []
+    for outputs in handle:
+        token_ids += outputs[0].generated_token_ids
+    decode_pipe.stop_serving()
+    assert handle.get_metrics().num_imported_prompt_tokens == kv_cache.num_kv_tokens
+    assert token_ids == ref_token_ids
+    del prefill_pipe
+    del decode_pipe
+    shutil.rmtree(model_path)
+
+
+@pytest.mark.precommit
+def test_session_kv_cache_is_reused_after_restart(tmp_path):
+    model_id : str = "facebook/opt-125m"
+    model, hf_tokenizer = get_model_and_tokenizer(model_id, use_optimum=True)
+
+    model_path : Path = tmp_path / model_id
+    save_ov_model_from_optimum(model, hf_tokenizer, model_path)
+
+    # prompt takes several KV blocks, so its full blocks are stored
+    prompt = "OpenVINO is a toolkit for optimizing and deploying deep learning models. " * 4
+    generation_config = get_greedy()
+    generation_config.max_new_tokens = 20
+    scheduler_config = get_scheduler_config()
+    scheduler_config.session_cache_dir = (tmp_path / "sessions").as_posix()
+
+    def generate():
+        pipe = ContinuousBatchingPipeline(model_path.absolute().as_posix(), scheduler_config)
+        pipe.start_serving()
+        handle = pipe.add_request(0, prompt, generation_config)
+        token_ids = []
+        for outputs in handle:
+            token_ids += outputs[0].generated_token_ids
+        pipe.stop_serving()
+        # sessions are written to disk before the pipeline is destroyed
+        del pipe
+        return token_ids, handle.get_metrics().num_imported_prompt_tokens
+
+    ref_token_ids, num_imported_tokens = generate()
+    assert num_imported_tokens == 0
+    assert len(os.listdir(scheduler_config.session_cache_dir)) == 1
+
+    token_ids, num_imported_tokens = generate()
+    assert num_imported_tokens > 0 and num_imported_tokens % scheduler_config.block_size == 0
+    assert token_ids == ref_token_ids
+    shutil.rmtree(model_path)